@@ -0,0 +1,270 @@
+/*
+ * adc.cpp - analog inputs sampled continuously by the ADC and the PDC
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See adc.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "util.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "adc.h"
+
+#ifdef __ANALOG_INPUTS
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+adSingleton_t ad;
+
+static void _set_channels(void);
+static void _set_filter_gain(void);
+
+/*
+ * ad_init() - start the ADC in free run mode with the PDC filling the double buffer
+ *
+ *	Conversions are tagged (ADC_EMR TAG), so the channel number rides in the top 4
+ *	bits of each half word the PDC moves, and the buffer is sorted by channel
+ *	without knowing where the sequence started.
+ */
+void ad_init(void)
+{
+	ad.half = 0;
+	ad.buffers = 0;
+
+	hw_enable_periph_clk(ID_ADC);
+	ADC->ADC_CR = ADC_CR_SWRST;
+	ADC->ADC_MR = ADC_MR_PRESCAL((F_CPU / (2 * AD_CLOCK)) - 1) | ADC_MR_STARTUP_SUT64 |
+				  ADC_MR_SETTLING_AST3 | ADC_MR_TRACKTIM(2) | ADC_MR_TRANSFER(1) | ADC_MR_FREERUN_ON;
+	ADC->ADC_EMR = ADC_EMR_TAG;
+	ADC->ADC_IDR = 0xFFFFFFFF;
+
+	ADC->ADC_PTCR = ADC_PTCR_RXTDIS;
+	ADC->ADC_RPR = (uint32_t)ad.buffer[0];	// the first half fills first...
+	ADC->ADC_RCR = AD_BUFFER_SAMPLES;
+	ADC->ADC_RNPR = (uint32_t)ad.buffer[1];	// ...and the PDC carries on in the second
+	ADC->ADC_RNCR = AD_BUFFER_SAMPLES;
+	ADC->ADC_PTCR = ADC_PTCR_RXTEN;
+	ADC->ADC_IER = ADC_IER_ENDRX;
+
+	NVIC_SetPriority(ADC_IRQn, AD_ISR_PRIORITY);
+	NVIC_EnableIRQ(ADC_IRQn);
+
+	_set_filter_gain();
+	ad.ready = true;
+	_set_channels();						// starts converting if any channel is on
+}
+
+/*
+ * ad_get_value() - filtered reading of an input (0..AD_INPUTS-1) in its scaled units
+ */
+float ad_get_value(const uint8_t input)
+{
+	return (ad.in[input].value);
+}
+
+/*
+ * ADC_Handler() - average the buffer half the PDC just filled and filter the inputs
+ *
+ *	ENDRX means the PDC has moved on to the other half. The filled half is given
+ *	back as the next buffer before it is read - the PDC won't reach it until the
+ *	other half fills, AD_BUFFER_USEC from now. Writing RNCR clears ENDRX.
+ */
+void ADC_Handler(void)
+{
+	if ((ADC->ADC_ISR & ADC_ISR_ENDRX) == 0) { return;}
+
+	uint16_t *buffer = ad.buffer[ad.half];
+	ADC->ADC_RNPR = (uint32_t)buffer;
+	ADC->ADC_RNCR = AD_BUFFER_SAMPLES;
+	ad.half ^= 1;
+
+	uint32_t sum[AD_CHANNELS] = {0};
+	uint16_t count[AD_CHANNELS] = {0};
+	for (uint16_t i=0; i<AD_BUFFER_SAMPLES; i++) {
+		uint8_t channel = buffer[i] >> 12;
+		sum[channel] += buffer[i] & AD_FULL_SCALE;
+		count[channel]++;
+	}
+	for (uint8_t input=0; input<AD_INPUTS; input++) {
+		adInput_t *in = &ad.in[input];
+		if (in->channel == 0) { continue;}
+		uint8_t channel = in->channel - 1;
+		if (count[channel] == 0) { continue;}
+		float reading = (float)sum[channel] / (float)count[channel] / AD_FULL_SCALE * in->scale + in->offset;
+		if (ad.buffers == 0) {
+			in->value = reading;				// start the filter at the first reading
+		} else {
+			in->value += ad.filter_gain * (reading - in->value);
+		}
+	}
+	ad.buffers++;
+}
+
+/*
+ * ad_feed_callback() - scale the feed to the spindle load (see adc.h)
+ *
+ *	Runs from the millisecond tasks. Each update multiplies the factor by 
+ *	1 + $ldg * (setpoint - load) / setpoint, which is integral action on the ratio 
+ *	- it settles where the load meets the setpoint, or at a limit.
+ */
+stat_t ad_feed_callback(void)
+{
+	if (ad.feed_input == 0) { return (STAT_NOOP);}
+	if (++ad.feed_tick < AD_FEED_INTERVAL_MS) { return (STAT_NOOP);}
+	ad.feed_tick = 0;
+
+	if ((cm.cycle_state != CYCLE_MACHINING) || (cm_get_spindle_mode(RUNTIME) == SPINDLE_OFF)) {
+		mp_set_adaptive_factor(1);			// no cut - the next one starts at programmed feed
+		return (STAT_OK);
+	}
+	if ((cm.hold_state != FEEDHOLD_OFF) || (cm.motion_state != MOTION_RUN) ||
+		(cm_get_motion_mode(RUNTIME) == MOTION_MODE_STRAIGHT_TRAVERSE)) {
+		return (STAT_OK);					// not cutting - keep the factor for the next cut
+	}
+	if (ad.feed_setpoint < EPSILON) { return (STAT_OK);}
+
+	float error = (ad.feed_setpoint - ad_get_value(ad.feed_input - 1)) / ad.feed_setpoint;
+	if (fabs(error) < AD_FEED_DEADBAND) { return (STAT_OK);}
+	float factor = mm.adaptive_factor * max(1 + ad.feed_gain * error, 0);
+	mp_set_adaptive_factor(min(max(factor, ad.feed_min), ad.feed_max));
+	return (STAT_OK);
+}
+
+/*
+ * _set_channels() - convert the channels the inputs use, and only those
+ *
+ *	The die temperature sensor (AD15) is powered only while it is used.
+ */
+static void _set_channels(void)
+{
+	if (ad.ready == false) { return;}		// config_init() runs before ad_init()
+
+	uint32_t mask = 0;
+	for (uint8_t input=0; input<AD_INPUTS; input++) {
+		if (ad.in[input].channel != 0) { mask |= 1 << (ad.in[input].channel - 1);}
+	}
+	ADC->ADC_CHDR = ~mask & 0xFFFF;
+	ADC->ADC_CHER = mask;
+	if (mask & (1 << 15)) {
+		ADC->ADC_ACR |= ADC_ACR_TSON;
+	} else {
+		ADC->ADC_ACR &= ~ADC_ACR_TSON;
+	}
+	ad.buffers = 0;							// the filters start over on the new set
+}
+
+/*
+ * _set_filter_gain() - first order low pass with a time constant of $anf ms
+ */
+static void _set_filter_gain(void)
+{
+	if (ad.filter < EPSILON) {
+		ad.filter_gain = 1;					// no filter - the buffer average
+	} else {
+		ad.filter_gain = 1 - expf(-AD_BUFFER_USEC / (ad.filter * 1000));
+	}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+stat_t ad_set_anc(cmdObj_t *cmd)			// ADC channel of an input
+{
+	if ((cmd->value < 0) || (cmd->value > AD_CHANNELS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_ui8(cmd);
+	_set_channels();
+	return (STAT_OK);
+}
+
+stat_t ad_set_anf(cmdObj_t *cmd)			// filter time constant
+{
+	if (cmd->value < 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_flt(cmd);
+	_set_filter_gain();
+	return (STAT_OK);
+}
+
+stat_t ad_set_ldi(cmdObj_t *cmd)			// load-adaptive feed input
+{
+	if ((cmd->value < 0) || (cmd->value > AD_INPUTS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_ui8(cmd);
+	ad.feed_tick = 0;
+	mp_set_adaptive_factor(1);				// off, or starting over on another input
+	return (STAT_OK);
+}
+
+stat_t ad_set_ldn(cmdObj_t *cmd)			// lowest adaptive factor
+{
+	if (cmd->value < FEED_OVERRIDE_MIN) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (cmd->value > 1) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+	set_flt(cmd);
+	return (STAT_OK);
+}
+
+stat_t ad_set_ldx(cmdObj_t *cmd)			// highest adaptive factor
+{
+	if (cmd->value < 1) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (cmd->value > FEED_OVERRIDE_MAX) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+	set_flt(cmd);
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_an[] PROGMEM = "Analog input %s:%15.3f\n";
+static const char fmt_anc[] PROGMEM = "[%s] analog input channel%14d [0=off,1-16=AD0-AD15]\n";
+static const char fmt_ans[] PROGMEM = "[%s] analog input scale%16.3f at full scale\n";
+static const char fmt_ano[] PROGMEM = "[%s] analog input offset%15.3f\n";
+static const char fmt_anf[] PROGMEM = "[anf] analog input filter%14.1f ms [0=off]\n";
+static const char fmt_ldi[] PROGMEM = "[ldi] load feed input%18d [0=off,1-4=an1-an4]\n";
+static const char fmt_lds[] PROGMEM = "[lds] load feed setpoint%15.3f\n";
+static const char fmt_ldg[] PROGMEM = "[ldg] load feed gain%19.3f\n";
+static const char fmt_ldn[] PROGMEM = "[ldn] load feed minimum factor%9.3f\n";
+static const char fmt_ldx[] PROGMEM = "[ldx] load feed maximum factor%9.3f\n";
+static const char fmt_ldf[] PROGMEM = "Load feed factor:%15.3f\n";
+
+void ad_print_an(cmdObj_t *cmd) { fprintf_P(stderr, fmt_an, cmd->token, cmd->value);}
+void ad_print_anc(cmdObj_t *cmd) { fprintf_P(stderr, fmt_anc, cmd->token, (uint8_t)cmd->value);}
+void ad_print_ans(cmdObj_t *cmd) { fprintf_P(stderr, fmt_ans, cmd->token, cmd->value);}
+void ad_print_ano(cmdObj_t *cmd) { fprintf_P(stderr, fmt_ano, cmd->token, cmd->value);}
+void ad_print_anf(cmdObj_t *cmd) { text_print_flt(cmd, fmt_anf);}
+void ad_print_ldi(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_ldi);}
+void ad_print_lds(cmdObj_t *cmd) { text_print_flt(cmd, fmt_lds);}
+void ad_print_ldg(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ldg);}
+void ad_print_ldn(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ldn);}
+void ad_print_ldx(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ldx);}
+void ad_print_ldf(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ldf);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ANALOG_INPUTS
@@ -0,0 +1,145 @@
+/*
+ * adc.h - analog inputs sampled continuously by the ADC and the PDC
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Analog inputs are enabled by __ANALOG_INPUTS in tinyg2.h. They are meant for
+ * slowly changing machine signals - spindle load, VFD feedback, a probe voltage.
+ *
+ * Up to AD_INPUTS inputs are each given an ADC channel with $an1c..$an4c (0=off,
+ * or 1..16 for AD0..AD15 - AD15 is the die temperature sensor). Enabling a channel
+ * takes its pin from the PIO. In the Due pinout A8, A9 and A10 (AD10, AD11, AD12)
+ * are free - the other analog pins are switches and grbl inputs (hardware.h).
+ *
+ * The ADC runs free, converting the enabled channels in turn, and the PDC moves
+ * each result into one half of a double buffer. Each result is tagged with its
+ * channel. When a half fills the PDC carries on in the other half and the ADC
+ * interrupt (AD_ISR_PRIORITY, well below the steppers) averages the full half by
+ * channel and runs each input's low pass filter ($anf, a time constant in ms).
+ * That is about every AD_BUFFER_USEC, so a filtered reading is always at hand
+ * at segment rate and nothing polls the ADC.
+ *
+ * A reading is scaled to the input's units as counts / 4095 * $anNs + $anNo - with
+ * the defaults that is volts at the pin. The readings are $an1..$an4, which can be
+ * put in the status report. The runtime reads them with ad_get_value(), a single
+ * float read that is safe from any interrupt.
+ *
+ * Load-adaptive feed: with $ldi set to an input that reads spindle load, every
+ * AD_FEED_INTERVAL_MS ad_feed_callback() compares the load to the setpoint $lds
+ * and moves the adaptive factor toward it - down when the cut is heavy, up toward
+ * $ldx when it is light - by $ldg times the relative load error. The factor is
+ * kept in [$ldn, $ldx] and goes to the planner through mp_set_adaptive_factor(),
+ * which replans like a feed rate override so every change is jerk-limited. It
+ * multiplies the host's $mfo. Traverses and holds leave the factor alone, and it
+ * goes back to 1 when the cycle ends or the spindle is off. $ldf reads the factor.
+ */
+
+#ifndef ADC_H_ONCE
+#define ADC_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __ANALOG_INPUTS
+
+#define AD_INPUTS				4		// analog inputs - $an1..$an4
+#define AD_CHANNELS				16		// SAM3X ADC channels AD0..AD15
+#define AD_FULL_SCALE			4095	// 12 bit conversions
+#define AD_CLOCK				1000000UL	// ADC clock - MCK / ((PRESCAL+1) * 2)
+#define AD_CONVERSION_CLOCKS	25		// ADC clocks per conversion in free run mode (nominal)
+#define AD_BUFFER_SAMPLES		200		// conversions in each half of the double buffer
+#define AD_BUFFER_USEC			((float)AD_BUFFER_SAMPLES * AD_CONVERSION_CLOCKS * 1000000 / AD_CLOCK)
+#define AD_ISR_PRIORITY			8		// NVIC priority of the ADC interrupt - below the DMAC
+#define AD_FEED_INTERVAL_MS		50		// load-adaptive feed update period
+#define AD_FEED_DEADBAND		((float)0.05)	// relative load error that is left alone
+
+typedef struct adInput {
+	uint8_t channel;					// $anNc - ADC channel + 1, 0=off
+	float scale;						// $anNs - reading at full scale counts
+	float offset;						// $anNo - reading at 0 counts
+	volatile float value;				// $anN	 - filtered reading in scaled units
+} adInput_t;
+
+typedef struct adSingleton {
+	uint8_t ready;						// set once the ADC is running
+	uint8_t half;						// buffer half the PDC filled last
+	float filter;						// $anf - low pass time constant in ms, 0=off
+	float filter_gain;					// weight of a new buffer average - from $anf
+	uint32_t buffers;					// buffer halves processed
+	uint8_t feed_input;					// $ldi - analog input read as spindle load (1-4), 0=off
+	float feed_setpoint;				// $lds - load to hold, in the input's units
+	float feed_gain;					// $ldg - factor change per update at 100% load error
+	float feed_min;						// $ldn - lowest adaptive factor
+	float feed_max;						// $ldx - highest adaptive factor
+	uint16_t feed_tick;					// ms since the last adaptive feed update
+	adInput_t in[AD_INPUTS];
+	uint16_t buffer[2][AD_BUFFER_SAMPLES];	// PDC double buffer - tagged conversions
+} adSingleton_t;
+
+extern adSingleton_t ad;
+
+void ad_init(void);
+float ad_get_value(const uint8_t input);
+
+stat_t ad_feed_callback(void);
+
+stat_t ad_set_anc(cmdObj_t *cmd);
+stat_t ad_set_anf(cmdObj_t *cmd);
+stat_t ad_set_ldi(cmdObj_t *cmd);
+stat_t ad_set_ldn(cmdObj_t *cmd);
+stat_t ad_set_ldx(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void ad_print_an(cmdObj_t *cmd);
+	void ad_print_anc(cmdObj_t *cmd);
+	void ad_print_ans(cmdObj_t *cmd);
+	void ad_print_ano(cmdObj_t *cmd);
+	void ad_print_anf(cmdObj_t *cmd);
+	void ad_print_ldi(cmdObj_t *cmd);
+	void ad_print_lds(cmdObj_t *cmd);
+	void ad_print_ldg(cmdObj_t *cmd);
+	void ad_print_ldn(cmdObj_t *cmd);
+	void ad_print_ldx(cmdObj_t *cmd);
+	void ad_print_ldf(cmdObj_t *cmd);
+#else
+	#define ad_print_an tx_print_stub
+	#define ad_print_anc tx_print_stub
+	#define ad_print_ans tx_print_stub
+	#define ad_print_ano tx_print_stub
+	#define ad_print_anf tx_print_stub
+	#define ad_print_ldi tx_print_stub
+	#define ad_print_lds tx_print_stub
+	#define ad_print_ldg tx_print_stub
+	#define ad_print_ldn tx_print_stub
+	#define ad_print_ldx tx_print_stub
+	#define ad_print_ldf tx_print_stub
+#endif
+
+#define LOAD_FEED_CALLBACK() ad_feed_callback()
+
+#else
+
+#define LOAD_FEED_CALLBACK() (STAT_NOOP)
+
+#endif // __ANALOG_INPUTS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: ADC_H_ONCE
@@ -0,0 +1,257 @@
+/*
+ * benchmark.cpp - planner throughput benchmark
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See benchmark.h for a description of how the benchmark is run */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "benchmark.h"
+
+#ifdef __PLANNER_BENCHMARK
+
+#include "hardware.h"
+#include "gcode_parser.h"
+#include "canonical_machine.h"
+#include "plan_arc.h"
+#include "planner.h"
+#include "stepper.h"
+#include "xio.h"
+#include "controller.h"
+#include "json_parser.h"
+#include "report.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include BENCHMARK_GCODE_FILE
+
+bmSingleton_t bm;
+
+static void _bm_exec_until(mpBufCount_t available);
+static void _bm_time_serialize(void);
+static void _bm_time_index(void);
+static void _bm_time_dot(void);
+static void _bm_report(const char *label, uint8_t timer, uint16_t budget);
+
+/*
+ * bm_get_cycles() - return the free-running DWT cycle counter
+ * bm_record()     - accumulate one measurement of a timed function
+ */
+
+uint32_t bm_get_cycles() { return (HW_DWT_CYCCNT);}
+
+void bm_record(uint8_t timer, uint32_t cycles)
+{
+	bmTime_t *t = &bm.t[timer];
+
+	t->count++;
+	t->cycles += cycles;
+	if (cycles > t->cycles_max) t->cycles_max = cycles;
+}
+
+/*
+ * bm_run_benchmark() - run the benchmark program and report the results
+ *
+ *	Must be called after all subsystems are initialized. Lines are copied
+ *	out of the program string one at a time since the parser works in place.
+ */
+
+void bm_run_benchmark()
+{
+	char_t line[BENCHMARK_LINE_MAX];
+	const char *p = BENCHMARK_GCODE_NAME;
+	uint32_t start;
+	uint8_t i;
+
+	memset(&bm, 0, sizeof(bm));
+	hw_start_cycle_counter();
+	HW_DWT_CYCCNT = 0;
+
+	while (*p != NUL) {
+		for (i=0; (*p != NUL) && (*p != LF) && (*p != CR); p++) {
+			if (i < BENCHMARK_LINE_MAX-1) line[i++] = *p;
+		}
+		line[i] = NUL;
+		while ((*p == LF) || (*p == CR)) p++;
+
+		_bm_exec_until(PLANNER_BUFFER_HEADROOM);	// same condition the controller tests
+		start = bm_get_cycles();
+		gc_gcode_parser(line);
+		bm_record(BM_PARSE, bm_get_cycles() - start);
+
+		while (cm_arc_callback() != STAT_NOOP) {	// arcs run behind the parser
+			_bm_exec_until(PLANNER_BUFFER_HEADROOM);
+		}
+	}
+	_bm_exec_until(PLANNER_BUFFER_POOL_SIZE);		// drain the planner completely
+	_bm_time_serialize();
+	_bm_time_index();
+	_bm_time_dot();
+
+	fprintf(stderr, "benchmark: %s\n", BENCHMARK_GCODE_FILE);
+	_bm_report("blocks parsed", BM_PARSE, BENCHMARK_BUDGET_PARSE);
+	_bm_report("blocks planned", BM_PLAN, BENCHMARK_BUDGET_PLAN);
+	_bm_report("segments executed", BM_EXEC, BENCHMARK_BUDGET_EXEC);
+	_bm_report("trapezoids", BM_TRAPEZOID, BENCHMARK_BUDGET_TRAPEZOID);
+	_bm_report("junctions", BM_JUNCTION, BENCHMARK_BUDGET_JUNCTION);
+	_bm_report("arcs set up", BM_ARC, BENCHMARK_BUDGET_ARC);
+	_bm_report("status reports", BM_SERIALIZE, BENCHMARK_BUDGET_SERIALIZE);
+	_bm_report("token lookups", BM_INDEX, BENCHMARK_BUDGET_INDEX);
+	_bm_report("unit dots", BM_DOT, BENCHMARK_BUDGET_DOT);
+	_bm_report("unit dots (float)", BM_DOT_FLOAT, BENCHMARK_BUDGET_DOT);
+	if (bm.failures == 0) {
+		fprintf(stderr, "benchmark: PASS\n");
+	} else {
+		fprintf(stderr, "benchmark: FAIL - %u over budget or not found\n", bm.failures);
+	}
+}
+
+/*
+ * _bm_exec_until() - run the exec function until N planner buffers are free
+ *
+ *	The run buffer returning NULL is also a stop condition so a program that
+ *	ends in a feedhold or other stalled state cannot hang the benchmark.
+ */
+
+static void _bm_exec_until(mpBufCount_t available)
+{
+	uint32_t start;
+	stat_t status;
+
+	while (mp_get_planner_buffers_available() < available) {
+		if (mp_get_run_buffer() == NULL) return;
+		start = bm_get_cycles();
+		status = st_benchmark_exec_move();
+		if (status == STAT_NOOP) return;
+		bm_record(BM_EXEC, bm_get_cycles() - start);
+	}
+}
+
+/*
+ * _bm_time_serialize() - time json_serialize() on a full status report
+ * _bm_time_index()     - time cmd_get_index() on every token in the config table
+ *
+ *	Tokens are looked up as stored, so each must come back at its own index. One
+ *	that doesn't is a broken hash (see cmd_get_index()) and fails the benchmark.
+ */
+
+static void _bm_time_serialize()
+{
+	uint32_t start;
+
+	sr_populate_unfiltered_status_report();
+	for (uint8_t i=0; i<BENCHMARK_REPEATS; i++) {
+		start = bm_get_cycles();
+		json_serialize(cmd_header, cs.out_buf, sizeof(cs.out_buf));
+		bm_record(BM_SERIALIZE, bm_get_cycles() - start);
+	}
+	cmd_reset_list();
+}
+
+static void _bm_time_index()
+{
+	char_t token[CMD_TOKEN_LEN+1];
+	uint32_t start;
+	index_t found;
+
+	for (index_t i=0; i<cmd_index_max(); i++) {
+		strcpy_P(token, cfgArray[i].token);			// always terminated
+		if (token[0] == NUL) continue;
+		start = bm_get_cycles();
+		found = cmd_get_index((const char_t *)"", token);
+		bm_record(BM_INDEX, bm_get_cycles() - start);
+		if (found != i) {
+			fprintf(stderr, "token lookup: %s found at %d, not %d\n", token, (int)found, (int)i);
+			bm.failures++;
+		}
+	}
+}
+
+/*
+ * _bm_time_dot() - time mp_unit_dot() against unpacking the vectors to float
+ *
+ *	The vectors turn around Z in 1 degree steps with a Z component, so the dot 
+ *	products cover the range. The two must agree to the Q15 packing error.
+ */
+
+static void _bm_time_dot()
+{
+	float a[AXES] = {0,0,0,0,0,0};
+	float b[AXES] = {0,0,0,0,0,0};
+	int16_t a_packed[AXES], b_packed[AXES];
+	uint32_t start;
+
+	for (uint16_t i=0; i<360; i++) {
+		a[AXIS_X] = cosf(i * M_PI_F/180) * 0.8f;
+		a[AXIS_Y] = sinf(i * M_PI_F/180) * 0.8f;
+		a[AXIS_Z] = 0.6f;
+		b[AXIS_X] = 0.6f;
+		b[AXIS_Z] = 0.8f;
+		mp_set_unit(a_packed, a);
+		mp_set_unit(b_packed, b);
+
+		start = bm_get_cycles();
+		float dot = mp_unit_dot(a_packed, b_packed);
+		bm_record(BM_DOT, bm_get_cycles() - start);
+
+		start = bm_get_cycles();
+		mp_get_unit(a, a_packed);
+		mp_get_unit(b, b_packed);
+		float dot_float = 0;
+		for (uint8_t axis=0; axis<AXES; axis++) { dot_float += a[axis] * b[axis];}
+		bm_record(BM_DOT_FLOAT, bm_get_cycles() - start);
+
+		if (fabsf(dot - dot_float) > 1e-4f) {
+			fprintf(stderr, "unit dot: %0.6f, float %0.6f at %u degrees\n", (double)dot, (double)dot_float, i);
+			bm.failures++;
+		}
+	}
+}
+
+/*
+ * _bm_report() - print the count, average and worst case of a timed function
+ *
+ *	The average is tested against the budget in uSec. 0 skips the test.
+ */
+
+static void _bm_report(const char *label, uint8_t timer, uint16_t budget)
+{
+	bmTime_t *t = &bm.t[timer];
+	uint32_t rate = 0;
+	float average = 0;
+
+	if (t->cycles != 0) rate = (uint32_t)(((uint64_t)t->count * F_CPU) / t->cycles);
+	if (t->count != 0) average = (float)t->cycles * 1000000 / F_CPU / t->count;
+	fprintf(stderr, "%-18s %lu in %lu uSec, %lu per second, %0.1f uSec average, %0.1f worst",
+		label, (unsigned long)t->count, (unsigned long)(t->cycles * 1000000 / F_CPU),
+		(unsigned long)rate, (double)average, (double)t->cycles_max * 1000000 / F_CPU);
+	if ((budget != 0) && (average > budget)) {
+		fprintf(stderr, " - OVER BUDGET (%u)\n", budget);
+		bm.failures++;
+	} else {
+		fprintf(stderr, "\n");
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PLANNER_BENCHMARK
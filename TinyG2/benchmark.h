@@ -0,0 +1,122 @@
+/*
+ * benchmark.h - planner throughput benchmark
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The benchmark is enabled by __PLANNER_BENCHMARK in tinyg2.h, or built on its own
+ * with "make BENCHMARK=1", which leaves the normal build alone. When enabled the
+ * program selected by BENCHMARK_GCODE_FILE is fed line-by-line into the Gcode
+ * parser at startup, bypassing USB. The exec interrupt is inhibited and the
+ * benchmark drains the planner itself by calling the exec function directly, so
+ * prepared segments are discarded and the steppers never run. Results are
+ * reported to stderr once the program has been fully planned and executed.
+ *
+ * The benchmark doubles as a performance regression check for new firmware. The
+ * parser, planner and exec are timed on the program, as are _calculate_trapezoid()
+ * and _get_junction_vmax() on each block it plans, and the setup of each arc - the
+ * trig and roots of the arc math, in float. json_serialize() is then timed on
+ * status reports and cmd_get_index() on every token in the config table, which also
+ * checks that each token is found at its own index. mp_unit_dot() is timed against
+ * the float dot product it replaced, and checked to agree with it. Each average is tested against
+ * its BENCHMARK_BUDGET_xxx, below, and the report ends in PASS or FAIL with the
+ * number of functions over budget (or tokens not found). The budgets are averages
+ * in microseconds on the Due with some headroom over the present code - lower them
+ * as the code gets faster so a slower build fails. A budget of 0 is not tested.
+ *
+ * Timing uses the Cortex-M3 DWT cycle counter (F_CPU ticks per second).
+ */
+
+#ifndef BENCHMARK_H_ONCE
+#define BENCHMARK_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __PLANNER_BENCHMARK
+
+#ifndef BENCHMARK_GCODE_FILE
+#define BENCHMARK_GCODE_FILE "gcode/gcode_braid2d.h"	// program to run
+#endif
+#ifndef BENCHMARK_GCODE_NAME
+#define BENCHMARK_GCODE_NAME gcode_file					// name of the string in that file
+#endif
+#define BENCHMARK_LINE_MAX 128							// longest gcode block accepted
+#define BENCHMARK_REPEATS 100							// runs of each microbenchmark
+
+#ifndef BENCHMARK_BUDGET_PARSE							// average uSec budgets - see above
+#define BENCHMARK_BUDGET_PARSE 150						// gc_gcode_parser() per block
+#define BENCHMARK_BUDGET_PLAN 300						// _plan_block_list() per block
+#define BENCHMARK_BUDGET_EXEC 40						// mp_exec_move() per segment
+#define BENCHMARK_BUDGET_TRAPEZOID 30					// _calculate_trapezoid() per block
+#define BENCHMARK_BUDGET_JUNCTION 5						// _get_junction_vmax() per block
+#define BENCHMARK_BUDGET_ARC 100						// _compute_center_arc() per arc
+#define BENCHMARK_BUDGET_SERIALIZE 400					// json_serialize() per status report
+#define BENCHMARK_BUDGET_INDEX 10						// cmd_get_index() per token
+#define BENCHMARK_BUDGET_DOT 0							// mp_unit_dot() per call - compared, not tested
+#endif
+
+enum bmTimer {						// functions timed
+	BM_PARSE = 0,
+	BM_PLAN,						// includes arc segments
+	BM_EXEC,
+	BM_TRAPEZOID,
+	BM_JUNCTION,
+	BM_ARC,							// arc setup, not its segments
+	BM_SERIALIZE,
+	BM_INDEX,
+	BM_DOT,							// mp_unit_dot() on packed unit vectors
+	BM_DOT_FLOAT,					// the same unpacked to float - the scalar reference
+	BM_TIMERS
+};
+
+typedef struct bmTime {
+	uint32_t count;					// calls timed
+	uint64_t cycles;				// total cycles spent in them
+	uint32_t cycles_max;			// worst case call
+} bmTime_t;
+
+typedef struct bmSingleton {
+	bmTime_t t[BM_TIMERS];
+	uint16_t failures;				// functions over budget plus tokens not found
+} bmSingleton_t;
+
+extern bmSingleton_t bm;
+
+void bm_run_benchmark(void);
+uint32_t bm_get_cycles(void);
+void bm_record(uint8_t timer, uint32_t cycles);
+
+#define BENCHMARK_PLAN_START uint32_t bm_plan_start = bm_get_cycles();
+#define BENCHMARK_PLAN_END bm_record(BM_PLAN, bm_get_cycles() - bm_plan_start);
+#define BENCHMARK_ARC_START uint32_t bm_arc_start = bm_get_cycles();
+#define BENCHMARK_ARC_END bm_record(BM_ARC, bm_get_cycles() - bm_arc_start);
+
+#else
+
+#define BENCHMARK_PLAN_START
+#define BENCHMARK_PLAN_END
+#define BENCHMARK_ARC_START
+#define BENCHMARK_ARC_END
+
+#endif // __PLANNER_BENCHMARK
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: BENCHMARK_H_ONCE
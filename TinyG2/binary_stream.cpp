@@ -0,0 +1,289 @@
+/*
+ * binary_stream.cpp - pre-parsed motion blocks over a USB vendor bulk interface
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See binary_stream.h for the frame format */
+
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "planner.h"
+#include "stepper.h"
+#include "util.h"
+#include "xio.h"
+#include "binary_stream.h"
+#include "program_store.h"
+#include "stepq.h"
+
+#ifdef __BINARY_STREAM
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+bsSingleton_t bs;
+
+static uint8_t _run_frame(void);
+static stat_t _run_move(uint8_t type, uint8_t *payload, uint8_t length, uint32_t *linenum);
+static stat_t _run_planned(uint8_t *payload, uint8_t length, uint32_t *linenum);
+static stat_t _run_store(uint8_t type, uint8_t *payload, uint8_t length, uint32_t *linenum);
+static stat_t _run_steps(uint8_t *payload, uint8_t length, uint32_t *linenum);
+static void _send_status(uint32_t linenum, stat_t status);
+
+/*
+ * bs_stream_callback() - read and run binary frames while the planner has room
+ *
+ *	Called from the controller after the Gcode queue, so parsed Gcode blocks that are
+ *	waiting for the planner are always run first. Nothing is read from the endpoint
+ *	while the planner is full - that is the flow control (see binary_stream.h).
+ */
+stat_t bs_stream_callback()
+{
+	for (uint8_t i=0; i<BS_FRAMES_PER_PASS; i++) {
+		if ((gc_get_queued_blocks() != 0) || (mp_get_planner_buffers_available() < PLANNER_BUFFER_HEADROOM)) {
+			return (STAT_OK);
+		}
+		if (bs.count < BS_BUFFER_SIZE) {
+			bs.count += VendorUSB.readAvailable(&bs.buf[bs.count], BS_BUFFER_SIZE - bs.count);
+		}
+		if (_run_frame() == false) { return (STAT_OK);}
+	}
+	return (STAT_OK);
+}
+
+/*
+ * _run_frame() - run the frame at the start of the buffer. Returns false if there is no complete frame
+ *				  or the frame has to wait for room
+ *
+ *	Bytes ahead of a sync byte are dropped. A bad frame drops only its sync byte so a
+ *	frame that starts inside it is not lost.
+ */
+static uint8_t _run_frame()
+{
+	uint8_t drop = 0;
+	while ((drop < bs.count) && (bs.buf[drop] != BS_SYNC)) { drop++;}
+
+	if (drop == 0) {
+		if (bs.count < BS_HEADER_LEN) { return (false);}
+		uint8_t type = bs.buf[1];
+		uint8_t length = bs.buf[2];
+		uint8_t frame_len = BS_HEADER_LEN + length + 1;
+		if (frame_len > BS_BUFFER_SIZE) {			// can't be a frame - resync
+			drop = 1;
+			_send_status(0, STAT_INPUT_EXCEEDS_MAX_LENGTH);
+		} else {
+			if (bs.count < frame_len) { return (false);}
+			uint8_t checksum = 0;
+			for (uint8_t i=1; i<frame_len; i++) { checksum ^= bs.buf[i];}	// includes the checksum byte
+
+			uint32_t linenum = 0;
+			stat_t status = STAT_CHECKSUM_MATCH_FAILED;
+			if (checksum == 0) {
+				status = _run_move(type, &bs.buf[BS_HEADER_LEN], length, &linenum);
+			}
+			if (status == STAT_EAGAIN) { return (false);}	// left in the buffer to run again
+			if (status == STAT_OK) {
+				bs.frames++;
+				if (type == BS_STORE_END) { _send_status(linenum, status);}	// the upload is always answered
+			} else {
+				_send_status(linenum, status);
+			}
+			drop = (status == STAT_CHECKSUM_MATCH_FAILED) ? 1 : frame_len;
+		}
+	}
+	bs.count -= drop;
+	memmove(bs.buf, &bs.buf[drop], bs.count);
+	return (true);
+}
+
+/*
+ * _run_move() - queue a BS_FEED or BS_TRAVERSE payload
+ */
+static stat_t _run_move(uint8_t type, uint8_t *payload, uint8_t length, uint32_t *linenum)
+{
+	if (type == BS_PLANNED) { return (_run_planned(payload, length, linenum));}
+	if ((type >= BS_STORE_BEGIN) && (type <= BS_STORE_END)) { return (_run_store(type, payload, length, linenum));}
+	if (type == BS_STEPS) { return (_run_steps(payload, length, linenum));}
+	if ((type != BS_FEED) && (type != BS_TRAVERSE)) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	if (length < BS_MOVE_LEN) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+
+	float feed_rate;
+	uint8_t mask = payload[8];
+	memcpy(linenum, &payload[0], sizeof(uint32_t));
+	memcpy(&feed_rate, &payload[4], sizeof(float));
+
+	float target[] = {0,0,0,0,0,0};
+	float flags[] = {false, false, false, false, false, false};
+	uint8_t *src = &payload[BS_MOVE_LEN];
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		if ((mask & (1<<axis)) == 0) { continue;}
+		if (src + sizeof(float) > payload + length) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+		memcpy(&target[axis], src, sizeof(float));
+		flags[axis] = true;
+		src += sizeof(float);
+	}
+	if (src != payload + length) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+
+	gm.linenum = *linenum;
+	if (type == BS_TRAVERSE) {
+		return (cm_straight_traverse(target, flags));
+	}
+	if (fp_NOT_ZERO(feed_rate)) { cm_set_feed_rate(feed_rate);}
+	return (cm_straight_feed(target, flags));
+}
+
+/*
+ * _run_planned() - queue a BS_PLANNED payload
+ *
+ *	The move is a feed from the model position along the unit vector, in machine
+ *	coordinates and millimeters. The move time is only nominal - the planned 
+ *	velocities set the actual time of the move.
+ */
+static stat_t _run_planned(uint8_t *payload, uint8_t length, uint32_t *linenum)
+{
+	if (length < BS_PLANNED_LEN) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (length > BS_PLANNED_LEN) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+
+	mpPlannedMove_t move;
+	memcpy(linenum, &payload[0], sizeof(uint32_t));
+	memcpy(&move.length, &payload[4], sizeof(float));
+	memcpy(&move.entry_velocity, &payload[8], sizeof(float));
+	memcpy(&move.cruise_velocity, &payload[12], sizeof(float));
+	memcpy(&move.exit_velocity, &payload[16], sizeof(float));
+	memcpy(&move.jerk, &payload[20], sizeof(float));
+	memcpy(move.unit, &payload[24], sizeof(move.unit));
+	move.jerk *= JERK_MULTIPLIER;					// sent in the units of $xjm
+
+	gm.linenum = *linenum;
+	gm.motion_mode = MOTION_MODE_STRAIGHT_FEED;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		gm.target[axis] = gmx.position[axis] + move.unit[axis] * move.length;
+	}
+	cm_set_work_offsets(&gm);
+	gm.move_time = move.length / max(move.cruise_velocity, EPSILON);
+	gm.minimum_time = gm.move_time;
+	cm_cycle_start();
+	stat_t status = mp_aline_planned(&gm, &move);
+	cm_conditional_set_model_position(status);
+	return (status);
+}
+
+/*
+ * _run_store() - pass a program upload frame to the program store
+ *
+ *	The line number reported for a data frame is its offset, and for the end frame the length.
+ */
+static stat_t _run_store(uint8_t type, uint8_t *payload, uint8_t length, uint32_t *linenum)
+{
+#ifdef __PROGRAM_STORE
+	if (type == BS_STORE_BEGIN) {
+		if (length != 0) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+		return (pg_load_begin());
+	}
+	if (length < sizeof(uint32_t)) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	memcpy(linenum, &payload[0], sizeof(uint32_t));
+	if (type == BS_STORE_DATA) {
+		if (length == sizeof(uint32_t)) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+		if (length > sizeof(uint32_t) + BS_STORE_DATA_MAX) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+		return (pg_load_data(*linenum, &payload[4], length - sizeof(uint32_t)));
+	}
+	if (length != 2 * sizeof(uint32_t)) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	uint32_t checksum;
+	memcpy(&checksum, &payload[4], sizeof(uint32_t));
+	return (pg_load_end(*linenum, checksum));
+#else
+	return (STAT_INPUT_VALUE_UNSUPPORTED);
+#endif
+}
+
+/*
+ * _run_steps() - queue a BS_STEPS payload
+ *
+ *	Returns STAT_EAGAIN while the motor has no room for the moves, so the frame waits.
+ */
+static stat_t _run_steps(uint8_t *payload, uint8_t length, uint32_t *linenum)
+{
+#ifdef __STEP_QUEUE
+	if (length < BS_STEPS_LEN + BS_STEPS_MOVE_LEN) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (length > BS_STEPS_LEN + BS_STEPS_MOVES * BS_STEPS_MOVE_LEN) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+	if (((length - BS_STEPS_LEN) % BS_STEPS_MOVE_LEN) != 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	memcpy(linenum, &payload[0], sizeof(uint32_t));
+	if (sq.mode == 0) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	uint8_t motor = payload[4] - 1;
+	if (motor >= MOTORS) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+
+	sqMove_t move[BS_STEPS_MOVES];
+	uint8_t moves = (length - BS_STEPS_LEN) / BS_STEPS_MOVE_LEN;
+	for (uint8_t i=0; i<moves; i++) {
+		uint8_t *src = &payload[BS_STEPS_LEN + i * BS_STEPS_MOVE_LEN];
+		memcpy(&move[i].interval, &src[0], sizeof(uint32_t));
+		memcpy(&move[i].count, &src[4], sizeof(int16_t));
+		memcpy(&move[i].add, &src[6], sizeof(int16_t));
+		if (move[i].interval == 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	}
+	if (sq_moves_available(motor) < moves) { return (STAT_EAGAIN);}
+	for (uint8_t i=0; i<moves; i++) {
+		sq_queue_move(motor, move[i].interval, move[i].count, move[i].add);
+	}
+	st_request_exec_move();
+	return (STAT_OK);
+#else
+	return (STAT_INPUT_VALUE_UNSUPPORTED);
+#endif
+}
+
+/*
+ * _send_status() - report a frame to the host - a rejected frame, or the end of an upload
+ */
+static void _send_status(uint32_t linenum, stat_t status)
+{
+	uint8_t frame[BS_HEADER_LEN + 5 + 1];
+	frame[0] = BS_SYNC;
+	frame[1] = BS_STATUS;
+	frame[2] = 5;
+	memcpy(&frame[3], &linenum, sizeof(uint32_t));
+	frame[7] = (uint8_t)status;
+	frame[8] = 0;
+	for (uint8_t i=1; i<8; i++) { frame[8] ^= frame[i];}
+
+	if (status != STAT_OK) { bs.errors++;}
+	VendorUSB.writeAvailable(frame, sizeof(frame));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_bsf[] PROGMEM = "Binary stream frames run:%10.0f\n";
+static const char fmt_bse[] PROGMEM = "Binary stream frames rejected:%5.0f\n";
+
+void bs_print_bsf(cmdObj_t *cmd) { text_print_flt(cmd, fmt_bsf);}
+void bs_print_bse(cmdObj_t *cmd) { text_print_flt(cmd, fmt_bse);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __BINARY_STREAM
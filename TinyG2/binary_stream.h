@@ -0,0 +1,145 @@
+/*
+ * binary_stream.h - pre-parsed motion blocks over a USB vendor bulk interface
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The binary stream is enabled by __BINARY_STREAM in tinyg2.h. It adds a vendor-specific
+ * USB interface (Motate::USBVendor) next to the CDC serial port. Hosts that already have
+ * their moves in binary send them there as frames, and each frame goes straight to
+ * cm_straight_feed() or cm_straight_traverse() without passing through the Gcode parser.
+ * Commands, settings and reports stay on the serial port.
+ *
+ * A frame is (multi-byte values are little-endian, floats are IEEE 754 single):
+ *
+ *	0xA5			sync
+ *	type			BS_FEED (G1), BS_TRAVERSE (G0) or BS_PLANNED (below)
+ *	length			payload bytes that follow
+ *	uint32			line number
+ *	float			feed rate - 0 keeps the current feed rate (ignored by BS_TRAVERSE)
+ *	uint8			axis mask - bit 0 = X ... bit 5 = C
+ *	float ...		one target per axis in the mask, in axis order
+ *	checksum		XOR of the type, length and payload bytes
+ *
+ * Targets and feed rates are interpreted in the current Gcode model state - units, distance
+ * mode, coordinate system and feed rate mode - exactly as the words of a G1 or G0 block
+ * would be, so the host sets those up with Gcode on the serial port first.
+ *
+ * A host that plans its own velocities sends BS_PLANNED frames instead. The payload is
+ * always BS_PLANNED_LEN bytes, in millimeters, mm/min and machine axes:
+ *
+ *	uint32			line number
+ *	float			length
+ *	float			entry velocity
+ *	float			cruise velocity
+ *	float			exit velocity
+ *	float			jerk, in the units of $xjm
+ *	float x 6		unit vector X ... C
+ *
+ * The move runs from the current position and goes into the planner as it is, without
+ * replanning (see mp_aline_planned() for the checks and for what happens if the host
+ * falls behind a move that exits at speed).
+ *
+ * There are no acknowledgements. Frames are only read while the planner has room and no
+ * parsed Gcode blocks are waiting, so when the planner is full the endpoint stays full
+ * and the USB hardware NAKs the host until there is room again. A frame that is rejected
+ * is answered on the IN endpoint with a BS_STATUS frame carrying its line number and the
+ * status code. A frame with a bad checksum or an unknown type is answered with line 0
+ * and the stream is resynchronised on the next sync byte. Status frames are dropped if
+ * the host is not reading the IN endpoint.
+ *
+ * With __PROGRAM_STORE the BS_STORE_BEGIN, BS_STORE_DATA and BS_STORE_END frames upload
+ * a Gcode program into flash (see program_store.h for the payloads).
+ *
+ * With __STEP_QUEUE a BS_STEPS frame queues step schedule moves for one motor, as a
+ * {"sq":...} line does (see stepq.h). The payload is:
+ *
+ *	uint32			line number
+ *	uint8			motor, 1 to 6
+ *	uint32, int16, int16 ...	interval, count and add of up to BS_STEPS_MOVES moves
+ *
+ * A BS_STEPS frame waits in the buffer until its motor has room for its moves, so the
+ * endpoint fills and the host is held as it is by a full planner.
+ *
+ * {"bsf":""} and {"bse":""} read the count of frames run and frames rejected.
+ *
+ * The vendor interface and the second CDC port of __DUAL_USB_CDC do not both fit in the
+ * endpoint memory of the SAM3X at high-speed, so only one of them may be enabled.
+ */
+
+#ifndef BINARY_STREAM_H_ONCE
+#define BINARY_STREAM_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __BINARY_STREAM
+
+#define BS_SYNC					0xA5
+#define BS_BUFFER_SIZE			128		// frame assembly buffer - holds at least 2 frames
+#define BS_HEADER_LEN			3		// sync, type, length
+#define BS_MOVE_LEN				9		// move payload without the targets
+#define BS_PLANNED_LEN			48		// planned move payload
+#define BS_FRAMES_PER_PASS		4		// frames run per pass of the controller
+#define BS_STORE_DATA_MAX		56		// program bytes per BS_STORE_DATA frame - 2 frames fit the buffer
+#define BS_STEPS_LEN			5		// step moves payload without the moves
+#define BS_STEPS_MOVE_LEN		8		// bytes per step move
+#define BS_STEPS_MOVES			6		// most step moves in a BS_STEPS frame
+
+enum bsFrameType {
+	BS_FEED = 0x01,						// host to device - straight feed (G1)
+	BS_TRAVERSE = 0x02,					// host to device - straight traverse (G0)
+	BS_PLANNED = 0x03,					// host to device - feed with velocities planned by the host
+	BS_STEPS = 0x04,					// host to device - step schedule moves for a motor (see stepq.h)
+	BS_STORE_BEGIN = 0x10,				// host to device - start a program upload (see program_store.h)
+	BS_STORE_DATA = 0x11,				// host to device - uint32 offset, program text
+	BS_STORE_END = 0x12,				// host to device - uint32 length, uint32 checksum
+	BS_STATUS = 0x80					// device to host - uint32 line number, uint8 status
+};
+
+typedef struct bsSingleton {
+	uint32_t frames;					// $bsf - frames run
+	uint32_t errors;					// $bse - frames rejected
+	uint8_t count;						// bytes in the buffer
+	uint8_t buf[BS_BUFFER_SIZE];
+} bsSingleton_t;
+
+extern bsSingleton_t bs;
+
+stat_t bs_stream_callback(void);
+
+#ifdef __TEXT_MODE
+	void bs_print_bsf(cmdObj_t *cmd);
+	void bs_print_bse(cmdObj_t *cmd);
+#else
+	#define bs_print_bsf tx_print_stub
+	#define bs_print_bse tx_print_stub
+#endif
+
+#define BINARY_STREAM() bs_stream_callback()
+
+#else
+
+#define BINARY_STREAM() (STAT_NOOP)
+
+#endif // __BINARY_STREAM
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: BINARY_STREAM_H_ONCE
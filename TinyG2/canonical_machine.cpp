@@ -73,6 +73,8 @@
  *		by the runtime. See typedef for *exec in planner.h for details
  *
  *	  - mp_queue_command() stores the callback and the args in a planner buffer.
+ *		Zero-time commands (coolant, spindle speed) call mp_queue_attached_command(), 
+ *		which runs them as the next buffer starts so the moves don't stop for them.
  *
  *	  - When planner execution reaches the buffer it executes the callback w/ the args. 
  *		Take careful note that the callback executes under an interrupt, so beware of 
@@ -92,14 +94,22 @@
 #include "plan_arc.h"
 #include "planner.h"
 #include "stepper.h"
+#include "kinematics.h"
 #include "spindle.h"
 #include "report.h"
 //#include "gpio.h"
 #include "switch.h"
 #include "hardware.h"
 #include "util.h"
+#include "settings.h"		// AXES_USED
+#include "memguard.h"
+#include "program_store.h"
+#include "gcode_macro.h"
+#include "swo.h"
 //#include "xio.h"			// for serial queue flush
 
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -118,19 +128,24 @@ GCodeInput_t  gf;		// gcode input flags - transient
  **** GENERIC STATIC FUNCTIONS AND VARIABLES ***************************************
  ***********************************************************************************/
 
-#define _to_millimeters(a) ((gm.units_mode == INCHES) ? (a * MM_PER_INCH) : a)
+#define _to_millimeters(a) ((gmx.modal.units_mode == INCHES) ? (a * MM_PER_INCH) : a)
 
 // command execution callbacks from planner queue
+static void _queue_offset(void);
 static void _exec_offset(float *value, float *flag);
 static void _exec_change_tool(float *value, float *flag);
 static void _exec_select_tool(float *value, float *flag);
 static void _exec_mist_coolant_control(float *value, float *flag);
 static void _exec_flood_coolant_control(float *value, float *flag);
 static void _exec_absolute_origin(float *value, float *flag);
+static void _exec_wrap_position(float *value, float *flag);
 static void _exec_program_finalize(float *value, float *flag);
 
 static int8_t _get_axis(const index_t index);
 static int8_t _get_axis_type(const index_t index);
+static uint8_t _soft_limit_exceeded(const uint8_t axis, const float target);
+static void _wrap_position(void);
+static float _wrap_degrees(const uint8_t axis, const float degrees);
 
 /***********************************************************************************
  **** CODE *************************************************************************
@@ -172,6 +187,7 @@ uint8_t cm_get_homing_state() { return cm.homing_state;}
 void cm_set_motion_state(uint8_t motion_state) 
 { 
 	cm.motion_state = motion_state;
+	SR_MODAL_CHANGED();						// the active model changes with it
 
 	switch (motion_state) {
 		case (MOTION_STOP): { ACTIVE_MODEL = MODEL; break; }
@@ -186,13 +202,13 @@ void cm_set_motion_state(uint8_t motion_state)
 
 uint32_t cm_get_linenum(GCodeState_t *gcode_state) { return gcode_state->linenum;}
 uint8_t cm_get_motion_mode(GCodeState_t *gcode_state) { return gcode_state->motion_mode;}
-uint8_t cm_get_coord_system(GCodeState_t *gcode_state) { return gcode_state->coord_system;}
-uint8_t cm_get_units_mode(GCodeState_t *gcode_state) { return gcode_state->units_mode;}
-uint8_t cm_get_select_plane(GCodeState_t *gcode_state) { return gcode_state->select_plane;}
+uint8_t cm_get_coord_system(GCodeState_t *gcode_state) { return cm_get_modal(gcode_state)->coord_system;}
+uint8_t cm_get_units_mode(GCodeState_t *gcode_state) { return cm_get_modal(gcode_state)->units_mode;}
+uint8_t cm_get_select_plane(GCodeState_t *gcode_state) { return cm_get_modal(gcode_state)->select_plane;}
 uint8_t cm_get_path_control(GCodeState_t *gcode_state) { return gcode_state->path_control;}
-uint8_t cm_get_distance_mode(GCodeState_t *gcode_state) { return gcode_state->distance_mode;}
+uint8_t cm_get_distance_mode(GCodeState_t *gcode_state) { return cm_get_modal(gcode_state)->distance_mode;}
 uint8_t cm_get_inverse_feed_rate_mode(GCodeState_t *gcode_state) { return gcode_state->inverse_feed_rate_mode;}
-uint8_t cm_get_tool(GCodeState_t *gcode_state) { return gcode_state->tool;}
+uint8_t cm_get_tool(GCodeState_t *gcode_state) { return cm_get_modal(gcode_state)->tool;}
 uint8_t cm_get_spindle_mode(GCodeState_t *gcode_state) { return gcode_state->spindle_mode;}
 uint8_t	cm_get_block_delete_switch() { return gmx.block_delete_switch;}
 uint8_t cm_get_runtime_busy() { return (mp_get_runtime_busy());}
@@ -200,7 +216,7 @@ uint8_t cm_get_runtime_busy() { return (mp_get_runtime_busy());}
 void cm_set_motion_mode(GCodeState_t *gcode_state, uint8_t motion_mode) { gcode_state->motion_mode = motion_mode;}
 void cm_set_spindle_mode(GCodeState_t *gcode_state, uint8_t spindle_mode) { gcode_state->spindle_mode = spindle_mode;}
 void cm_set_spindle_speed_parameter(GCodeState_t *gcode_state, float speed) { gcode_state->spindle_speed = speed;}
-void cm_set_tool_number(GCodeState_t *gcode_state, uint8_t tool) { gcode_state->tool = tool;}
+void cm_set_tool_number(GCodeState_t *gcode_state, uint8_t tool) { cm_get_modal(gcode_state)->tool = tool;}
 
 void cm_set_absolute_override(GCodeState_t *gcode_state, uint8_t absolute_override)
 {
@@ -270,19 +286,31 @@ void cm_set_model_linenum(uint32_t linenum)
 
 /*
  * cm_get_active_coord_offset() - return the currently active coordinate offset for an axis
+ * _set_coord_offset()			- recompute the cached G5x + G92 offset
  *
  *	Takes G5x, G92 and absolute override into account to return the active offset for this move
  *
  *	This function is typically used to evaluate and set offsets, as opposed to cm_get_work_offset()
- *	which merely returns what's in the work_offset[] array.
+ *	which merely returns the work offset set a gcode_state refers to.
+ *
+ *	The G5x, G92 and G43 offsets are combined in gmx.coord_offset[] when they change (G10,
+ *	G5x, G92, G43/G49 and the $g54x... and $tof settings), so blocks and status reports do
+ *	not add them up again.
  */
 
 float cm_get_active_coord_offset(uint8_t axis)
 {
 	if (gm.absolute_override == true) return (0);		// no offset if in absolute override mode
-	float offset = cm.offset[gm.coord_system][axis];
-	if (gmx.origin_offset_enable == true) offset += gmx.origin_offset[axis]; // includes G5x and G92 compoenents
-	return (offset); 
+	return (gmx.coord_offset[axis]);					// includes G5x and G92 components
+}
+
+static void _set_coord_offset()
+{
+	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+		gmx.coord_offset[axis] = cm.offset[gmx.modal.coord_system][axis];
+		if (gmx.origin_offset_enable == true) gmx.coord_offset[axis] += gmx.origin_offset[axis];
+	}
+	gmx.coord_offset[AXIS_Z] += gmx.tool_offset;
 }
 
 /*
@@ -291,17 +319,82 @@ float cm_get_active_coord_offset(uint8_t axis)
 
 float cm_get_work_offset(GCodeState_t *gcode_state, uint8_t axis) 
 {
-	return (gcode_state->work_offset[axis]);
+	return (cm.work_offset[gcode_state->work_offset_set][axis]);
 }
 
 /*
  * cm_set_work_offsets() - capture coord offsets from the model into absolute values in the gcode_state
+ *
+ *	Also captures the model's modal state into its set, as this is called for every
+ *	gcode_state that is queued.
  */
 void cm_set_work_offsets(GCodeState_t *gcode_state)
 {
-	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
-		gcode_state->work_offset[axis] = cm_get_active_coord_offset(axis);
+	if (gm.absolute_override == true) {
+		float offset[AXES] = { 0,0,0,0,0,0 };
+		gcode_state->work_offset_set = cm_get_work_offset_set(offset);
+	} else {
+		gcode_state->work_offset_set = cm_get_work_offset_set(gmx.coord_offset);
 	}
+	gcode_state->modal_set = cm_get_modal_set(&gmx.modal);
+}
+
+/*
+ * cm_get_work_offset_set() - return the index of a set of work offsets in cm.work_offset[]
+ * cm_get_work_offset_sets_free() - return the number of sets no queued block refers to
+ *
+ *	A Gcode state carries the index of its work offsets rather than the offsets, which 
+ *	keeps the planner buffers small. The sets are a ring, written in the order the blocks
+ *	are queued, and the runtime moves through them in the same order - so the sets from 
+ *	the runtime's to the newest are the ones the queue can still refer to. Blocks share 
+ *	the newest set until the offsets change, then the next set is written.
+ *
+ *	Planning stalls while fewer than CM_WORK_OFFSET_SETS_HEADROOM sets are free and the
+ *	planner has blocks in it (see mp_planner_has_room()), so the sets free up as the
+ *	runtime moves on. Once the planner is empty no queued block refers to the newest
+ *	set, so it is rewritten if the ring is still full.
+ */
+uint8_t cm_get_work_offset_set(const float offset[])
+{
+	uint8_t set = cm.work_offset_newest;
+	if (memcmp(cm.work_offset[set], offset, sizeof(cm.work_offset[0])) == 0) { return (set);}
+
+	set = (set + 1) % CM_WORK_OFFSET_SETS;
+	if (set != mp_get_runtime_work_offset_set()) { cm.work_offset_newest = set;}
+	copy_axis_vector(cm.work_offset[cm.work_offset_newest], offset);
+	return (cm.work_offset_newest);
+}
+
+uint8_t cm_get_work_offset_sets_free()
+{
+	return ((mp_get_runtime_work_offset_set() + CM_WORK_OFFSET_SETS - cm.work_offset_newest - 1) % CM_WORK_OFFSET_SETS);
+}
+
+/*
+ * cm_get_modal() - return the modal state of a gcode_state
+ * cm_get_modal_set() - return the index of a modal state in cm.modal[]
+ *
+ *	The modes that seldom change (plane, units, coordinate system, distance mode, tool
+ *	and coolant) are shared by the queued blocks the same way as the work offsets - see
+ *	cm_get_work_offset_set(). The model keeps its own in gmx.modal. A queue with more
+ *	mode changes in it than there are sets rewrites the newest set, which only changes
+ *	the modes its blocks report.
+ */
+GCodeModal_t *cm_get_modal(GCodeState_t *gcode_state)
+{
+	if (gcode_state == MODEL) { return (&gmx.modal);}
+	return (&cm.modal[gcode_state->modal_set]);
+}
+
+uint8_t cm_get_modal_set(const GCodeModal_t *modal)
+{
+	uint8_t set = cm.modal_newest;
+	if (memcmp(&cm.modal[set], modal, sizeof(GCodeModal_t)) == 0) { return (set);}
+
+	set = (set + 1) % CM_MODAL_SETS;
+	if (set != mp_get_runtime_modal_set()) { cm.modal_newest = set;}
+	cm.modal[cm.modal_newest] = *modal;
+	return (cm.modal_newest);
 }
 
 /*
@@ -336,7 +429,7 @@ float cm_get_work_position(GCodeState_t *gcode_state, uint8_t axis)
 	} else {
 		position = mp_get_runtime_work_position(axis);
 	}
-	if (gcode_state->units_mode == INCHES) { position /= MM_PER_INCH; }
+	if (cm_get_modal(gcode_state)->units_mode == INCHES) { position /= MM_PER_INCH; }
 	return (position);
 }
 
@@ -360,21 +453,33 @@ float cm_get_work_position(GCodeState_t *gcode_state, uint8_t axis)
  * 	RADIUS	  - ABC axis value is provided in Gcode block in linear units
  *			  - Target is set to degrees based on axis' Radius value
  *			  - Radius mode is only processed for ABC axes. Application to XYZ is ignored.
+ *	WRAP	  - ABC axis value is in degrees, as for ENABLED, and taken modulo 360
+ *			  - An absolute target is reached the shortest way round - 350 to 10
+ *				turns 20 degrees forward, not 340 back. Incremental moves turn as given
+ *			  - Positions are reported in [0, 360). The axis has no soft limits
  *
  *	Target coordinates are provided in target[]
  *	Axes that need processing are signaled in flag[]
+ *
+ *	Asynchronous axes ($xas) are queued to the aux queue here and the model takes 
+ *	their target as its position at once, so the move itself never carries them.
  */
 
+#ifdef __COORD_TRANSFORM
+static void _transform_target(float target[], float flag[]);
+#endif
+
 // ESTEE: _calc_ABC is a fix to workaround a gcc compiler bug wherein it runs out of spill 
 //        registers we moved this block into its own function so that we get a fresh stack push
 // ALDEN: This shows up in avr-gcc 4.7.0 and avr-libc 1.8.0
 
 static float _calc_ABC(uint8_t axis, float target[], float flag[])
 {
-	if ((cm.a[axis].axis_mode == AXIS_STANDARD) || (cm.a[axis].axis_mode == AXIS_INHIBITED)) {
+	if ((cm.a[axis].axis_mode == AXIS_STANDARD) || (cm.a[axis].axis_mode == AXIS_INHIBITED) ||
+		(cm.a[axis].axis_mode == AXIS_WRAP)) {
 		return(target[axis]);	// no mm conversion - it's in degrees
 	}
-	return(_to_millimeters(target[axis]) * 360 / (2 * M_PI * cm.a[axis].radius));
+	return(_to_millimeters(target[axis]) * 360 / (2 * M_PI_F * cm.a[axis].radius));
 }
 
 void cm_set_model_target(float target[], float flag[])
@@ -382,12 +487,14 @@ void cm_set_model_target(float target[], float flag[])
 	uint8_t axis;
 	float tmp = 0;
 
+	_wrap_position();				// take back whole turns of wrapped axes first
+
 	// process XYZABC for lower modes
 	for (axis=AXIS_X; axis<=AXIS_Z; axis++) {
 		if ((fp_FALSE(flag[axis])) || (cm.a[axis].axis_mode == AXIS_DISABLED)) {
 			continue;		// skip axis if not flagged for update or its disabled
 		} else if ((cm.a[axis].axis_mode == AXIS_STANDARD) || (cm.a[axis].axis_mode == AXIS_INHIBITED)) {
-			if (gm.distance_mode == ABSOLUTE_MODE) {
+			if (gmx.modal.distance_mode == ABSOLUTE_MODE) {
 				gm.target[axis] = cm_get_active_coord_offset(axis) + _to_millimeters(target[axis]);
 			} else {
 				gm.target[axis] += _to_millimeters(target[axis]);
@@ -401,12 +508,71 @@ void cm_set_model_target(float target[], float flag[])
 		} else {
 			tmp = _calc_ABC(axis, target, flag);
 		}
-		if (gm.distance_mode == ABSOLUTE_MODE) {
+		if (gmx.modal.distance_mode == ABSOLUTE_MODE) {
 			gm.target[axis] = tmp + cm_get_active_coord_offset(axis); // sacidu93's fix to Issue #22
+			if (cm.a[axis].axis_mode == AXIS_WRAP) {		// the shortest way round
+				float turn = gm.target[axis] - gmx.position[axis];
+				gm.target[axis] = gmx.position[axis] + turn - 360 * floorf((turn + 180) / 360);
+			}
 		} else {
 			gm.target[axis] += tmp;
 		}
 	}
+#ifdef __COORD_TRANSFORM
+	if ((gmx.transform.active == true) && (gm.absolute_override == false)) { _transform_target(target, flag);}
+#endif
+#ifdef __AUX_MOTION
+	for (axis=AXIS_A; axis<=AXIS_C; axis++) {		// the caller rejects a target past the soft limits
+		if (AUX_AXIS(axis) && (_soft_limit_exceeded(axis, gm.target[axis]))) { return;}
+	}
+	mp_queue_aux(gm.target);
+	for (axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if (AUX_AXIS(axis)) { gmx.position[axis] = gm.target[axis];}
+	}
+#endif
+}
+
+/*
+ * _wrap_position()		 - take whole turns off the position of wrapped axes
+ * _exec_wrap_position() - the same for the runtime, in its place in the queue
+ * _wrap_degrees()		 - return a position of a wrapped axis in [0, 360) for reporting
+ *
+ *	A wrapped axis (AXIS_WRAP) that keeps turning one way would lose float
+ *	resolution as its position grows. Once it is AXIS_WRAP_TURNS turns from 0 the
+ *	model and planner positions are taken back by whole turns, as G28.3 would set
+ *	them, and the runtime is set to match when it reaches that point in the queue.
+ *	The axis does not move. Asynchronous axes ($xas) are left alone - they do not
+ *	run from the planner queue.
+ */
+static void _wrap_position()
+{
+	float value[AXES] = {0,0,0,0,0,0};
+	float flag[AXES] = {0,0,0,0,0,0};
+	uint8_t wrapped = false;
+
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if ((cm.a[axis].axis_mode != AXIS_WRAP) || (AUX_AXIS(axis))) { continue;}
+		if (fabsf(gmx.position[axis]) < (360 * AXIS_WRAP_TURNS)) { continue;}
+		value[axis] = fmodf(gmx.position[axis], 360);	// exact - whole turns come off
+		flag[axis] = 1;
+		cm_set_axis_origin(axis, value[axis]);
+		wrapped = true;
+	}
+	if (wrapped == true) { mp_queue_command(_exec_wrap_position, value, flag);}
+}
+
+static void _exec_wrap_position(float *value, float *flag)
+{
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if (fp_TRUE(flag[axis])) { mp_set_runtime_position(axis, value[axis]);}
+	}
+}
+
+static float _wrap_degrees(const uint8_t axis, const float degrees)
+{
+	if ((axis >= AXES) || (cm.a[axis].axis_mode != AXIS_WRAP)) { return (degrees);}
+	float wrapped = fmodf(degrees, 360);
+	return ((wrapped < 0) ? (wrapped + 360) : wrapped);
 }
 
 /* 
@@ -507,11 +673,11 @@ void cm_set_move_times(GCodeState_t *gcode_state)
 		if (gm.inverse_feed_rate_mode == true) {
 			inv_time = gmx.inverse_feed_rate;
 		} else {
-			xyz_time = sqrt(square(gm.target[AXIS_X] - gmx.position[AXIS_X]) + // in mm
+			xyz_time = sqrtf(square(gm.target[AXIS_X] - gmx.position[AXIS_X]) + // in mm
 							square(gm.target[AXIS_Y] - gmx.position[AXIS_Y]) +
 							square(gm.target[AXIS_Z] - gmx.position[AXIS_Z])) / gm.feed_rate; // in linear units
 			if (fp_ZERO(xyz_time)) {
-				abc_time = sqrt(square(gm.target[AXIS_A] - gmx.position[AXIS_A]) + // in deg
+				abc_time = sqrtf(square(gm.target[AXIS_A] - gmx.position[AXIS_A]) + // in deg
 								square(gm.target[AXIS_B] - gmx.position[AXIS_B]) +
 								square(gm.target[AXIS_C] - gmx.position[AXIS_C])) / gm.feed_rate; // in degree units
 			}
@@ -519,9 +685,9 @@ void cm_set_move_times(GCodeState_t *gcode_state)
 	}
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
 		if (gm.motion_mode == MOTION_MODE_STRAIGHT_FEED) {
-			tmp_time = fabs(gm.target[axis] - gmx.position[axis]) / cm.a[axis].feedrate_max;
+			tmp_time = fabsf(gm.target[axis] - gmx.position[axis]) / cm.a[axis].feedrate_max;
 		} else { // gm.motion_mode == MOTION_MODE_STRAIGHT_TRAVERSE
-			tmp_time = fabs(gm.target[axis] - gmx.position[axis]) / cm.a[axis].velocity_max;
+			tmp_time = fabsf(gm.target[axis] - gmx.position[axis]) / cm.a[axis].velocity_max;
 		}
 		max_time = max(max_time, tmp_time);
 		gcode_state->minimum_time = min(gcode_state->minimum_time, tmp_time);
@@ -530,20 +696,70 @@ void cm_set_move_times(GCodeState_t *gcode_state)
 }
 
 /* 
- * _test_soft_limits() - return error code if soft limit is exceeded
- *
- *	Must be called with target properly set in GM struct. Best done after cm_set_model_target() 
+ * cm_set_soft_limits()  - precompute the soft limit envelope in steps
+ * cm_test_soft_limits() - stop and return an error if a point is outside the envelope
+ *
+ *	The envelope of an axis is its travel_max from the homing switch in machine
+ *	coordinates: 0 to travel_max if it homes to the min switch, -travel_max to 0 if it
+ *	homes to the max. Axes with no travel_max or no motor mapped are not checked. It is
+ *	kept in steps of the axis' first motor, so the test of a point is a multiply and
+ *	two integer compares per axis. It must be recomputed when travel_max, the motor
+ *	map or the steps per unit change (ik_set_motor_map() does this) and after homing.
+ *
+ *	Only homed axes are tested, and points are not tested in the homing and probe
+ *	cycles, which move to switches and not to targets. Moves are tested at their
+ *	endpoint - the start is the last endpoint, and a line between two points in the
+ *	box stays in it. Arcs also test their extents (see _setup_arc()).
+ *
+ *	A point outside the envelope is rejected before it is queued, and a program stop
+ *	is queued in its place. The moves ahead of it run, then the machine stops, so
+ *	the moves sent after it do not run on from the wrong place.
  */
-stat_t _test_soft_limits()
+void cm_set_soft_limits()
+{
+	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+		cm.soft_steps[axis] = 0;
+		if (cm.a[axis].travel_max <= 0) { continue;}
+		for (uint8_t motor = MOTOR_1; motor < MOTORS; motor++) {
+			if (st.m[motor].motor_map == axis) {
+				cm.soft_steps[axis] = st.m[motor].steps_per_unit;
+				break;
+			}
+		}
+		int32_t travel = (int32_t)lrintf(cm.a[axis].travel_max * cm.soft_steps[axis]);
+		if (get_switch_mode(MIN_SWITCH(axis)) & SW_HOMING_BIT) {
+			cm.soft_min[axis] = 0;
+			cm.soft_max[axis] = travel;
+		} else if (get_switch_mode(MAX_SWITCH(axis)) & SW_HOMING_BIT) {
+			cm.soft_min[axis] = -travel;
+			cm.soft_max[axis] = 0;
+		} else {
+			cm.soft_min[axis] = 0;					// homed by G28.3 - the envelope starts at 0
+			cm.soft_max[axis] = travel;
+		}
+	}
+}
+
+stat_t cm_test_soft_limits(const float target[])
 {
+	if ((cm.cycle_state == CYCLE_HOMING) || (cm.cycle_state == CYCLE_PROBE)) { return (STAT_OK);}
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
-		if ((gm.target[axis] < 0) || (gm.target[axis] > cm.a[axis].travel_max)) {
+		if (_soft_limit_exceeded(axis, target[axis])) {
+			cm_program_stop();						// queued - the machine stops where this move was
 			return (STAT_SOFT_LIMIT_EXCEEDED);
 		}
 	}
 	return (STAT_OK);
 }
 
+static uint8_t _soft_limit_exceeded(const uint8_t axis, const float target)
+{
+	if ((cm.homed[axis] == false) || (cm.soft_steps[axis] == 0)) { return (false);}
+	if (cm.a[axis].axis_mode == AXIS_WRAP) { return (false);}	// turns without end
+	int32_t steps = (int32_t)lrintf(target * cm.soft_steps[axis]);
+	return ((steps < cm.soft_min[axis]) || (steps > cm.soft_max[axis]));
+}
+
 /*************************************************************************
  * CANONICAL MACHINING FUNCTIONS
  *	Values are passed in pre-unit_converted state (from gn structure)
@@ -567,15 +783,25 @@ void canonical_machine_init()
 	// setup magic numbers
 	cm.magic_start = MAGICNUM;
 	cm.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_CANONICAL_MACHINE, cm);
 	gmx.magic_start = MAGICNUM;
 	gmx.magic_end = MAGICNUM;
 
+	memset(cm.work_offset, 0, sizeof(cm.work_offset));	// set 0 is no offset, which the runtime starts in
+	cm.work_offset_newest = 0;
+
 	// set gcode defaults
 	cm_set_units_mode(cm.units_mode);
 	cm_set_coord_system(cm.coord_system);
 	cm_select_plane(cm.select_plane);
 	cm_set_path_control(cm.path_control);
 	cm_set_distance_mode(cm.distance_mode);
+	cm.modal[0] = gmx.modal;						// set 0 is the one the runtime starts in
+#ifdef __COORD_TRANSFORM
+	cm_cancel_scaling();							// scale factors first - the inverse divides by them
+	cm_cancel_rotation();
+#endif
+	cm.modal_newest = 0;
 
 	gmx.block_delete_switch = true;
 
@@ -657,7 +883,7 @@ stat_t cm_assertions()
  */
 stat_t cm_select_plane(uint8_t plane) 
 {
-	gm.select_plane = plane;
+	gmx.modal.select_plane = plane;
 	if (plane == CANON_PLANE_YZ) {
 		gmx.plane_axis_0 = AXIS_Y;
 		gmx.plane_axis_1 = AXIS_Z;
@@ -679,7 +905,7 @@ stat_t cm_select_plane(uint8_t plane)
  */
 stat_t cm_set_units_mode(uint8_t mode)
 {
-	gm.units_mode = mode;		// 0 = inches, 1 = mm.
+	gmx.modal.units_mode = mode;		// 0 = inches, 1 = mm.
 	return(STAT_OK);
 }
 
@@ -688,7 +914,16 @@ stat_t cm_set_units_mode(uint8_t mode)
  */
 stat_t cm_set_distance_mode(uint8_t mode)
 {
-	gm.distance_mode = mode;		// 0 = absolute mode, 1 = incremental
+	gmx.modal.distance_mode = mode;		// 0 = absolute mode, 1 = incremental
+	return (STAT_OK);
+}
+
+/*
+ * cm_set_retract_mode() - G98, G99 (affects MODEL only)
+ */
+stat_t cm_set_retract_mode(uint8_t mode)
+{
+	gmx.retract_mode = mode;		// 0 = initial level (G98), 1 = R plane (G99)
 	return (STAT_OK);
 }
 
@@ -713,31 +948,35 @@ stat_t cm_set_coord_offsets(uint8_t coord_system, float offset[], float flag[])
 			cm.g10_persist_flag = true;		// this will persist offsets to NVM once move has stopped
 		}
 	}
+	_set_coord_offset();
 	return (STAT_OK);
 }
 
 /*
  * cm_set_coord_system() - G54-G59 
+ * _queue_offset() - queue the model's work offsets to the runtime
  * _exec_offset() - callback from planner
+ *
+ *	The offsets are resolved to a work offset set as the command is queued, so the 
+ *	runtime reports the offsets that were in effect for the blocks around it.
  */
 stat_t cm_set_coord_system(uint8_t coord_system)
 {
-	gm.coord_system = coord_system;
+	gmx.modal.coord_system = coord_system;
+	_set_coord_offset();
+	_queue_offset();
+	return (STAT_OK);
+}
 
-	float value[AXES] = { (float)coord_system,0,0,0,0,0 };	// pass coordinate system in value[0] element
+static void _queue_offset()
+{
+	float value[AXES] = { (float)cm_get_work_offset_set(gmx.coord_offset),0,0,0,0,0 }; // pass the set in value[0]
 	mp_queue_command(_exec_offset, value, value);			// second vector (flags) is not used, so fake it
-	return (STAT_OK);
 }
 
 static void _exec_offset(float *value, float *flag)
 {
-	uint8_t coord_system = ((uint8_t)value[0]);				// coordinate system is passed in value[0] element
-	float offsets[AXES];
-	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
-		offsets[axis] = cm.offset[coord_system][axis] + (gmx.origin_offset[axis] * gmx.origin_offset_enable);
-	}
-	mp_set_runtime_work_offset(offsets);
-//	cm_set_work_offsets(RUNTIME);
+	mp_set_runtime_work_offset_set((uint8_t)value[0]);		// offset set is passed in value[0] element
 }
 
 /*
@@ -757,7 +996,7 @@ stat_t cm_set_absolute_origin(float origin[], float flag[])
 
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
 		if (fp_TRUE(flag[axis])) {
-			value[axis] = cm.offset[gm.coord_system][axis] + _to_millimeters(origin[axis]);
+			value[axis] = cm.offset[gmx.modal.coord_system][axis] + _to_millimeters(origin[axis]);
 			cm_set_axis_origin(axis, value[axis]);
 		}
 	}
@@ -790,6 +1029,24 @@ void cm_set_axis_origin(uint8_t axis, const float position)
 	mp_set_planner_position(axis, position);
 }
 
+/*
+ * cm_set_tool_offset() - G43 H, G49 - apply the tool length offset of a tool table entry
+ *
+ *	The entry's Z offset ($tof1...) is added to the work offset, so Z targets from the
+ *	next block on are for the tip of the tool. Entry 0 is G49, no offset. Changing the
+ *	table entry in use takes effect at the next block as well, so the program does not
+ *	have to be posted again for a tool of another length.
+ */
+stat_t cm_set_tool_offset(uint8_t entry)
+{
+	if (entry > TOOLS) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	gmx.tool_offset_entry = entry;
+	gmx.tool_offset = cm.tool_offset[entry];
+	_set_coord_offset();
+	_queue_offset();											// the runtime offsets follow
+	return (STAT_OK);
+}
+
 /* 
  * cm_set_origin_offsets() 		- G92
  * cm_reset_origin_offsets() 	- G92.1
@@ -806,12 +1063,11 @@ stat_t cm_set_origin_offsets(float offset[], float flag[])
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
 		if (fp_TRUE(flag[axis])) {
 			gmx.origin_offset[axis] = gmx.position[axis] - 
-									  cm.offset[gm.coord_system][axis] - _to_millimeters(offset[axis]);
+									  cm.offset[gmx.modal.coord_system][axis] - _to_millimeters(offset[axis]);
 		}
 	}
-	// now pass the offset to the callback - setting the coordinate system also applies the offsets
-	float value[AXES] = { (float)gm.coord_system,0,0,0,0,0 }; // pass coordinate system in value[0] element
-	mp_queue_command(_exec_offset, value, value);				  // second vector is not used
+	_set_coord_offset();
+	_queue_offset();							// now pass the offsets to the runtime
 	return (STAT_OK);
 }
 
@@ -821,42 +1077,270 @@ stat_t cm_reset_origin_offsets()
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
 		gmx.origin_offset[axis] = 0;
 	}
-	float value[AXES] = { (float)gm.coord_system,0,0,0,0,0 };
-	mp_queue_command(_exec_offset, value, value);
+	_set_coord_offset();
+	_queue_offset();
 	return (STAT_OK);
 }
 
 stat_t cm_suspend_origin_offsets()
 {
 	gmx.origin_offset_enable = 0;
-	float value[AXES] = { (float)gm.coord_system,0,0,0,0,0 };
-	mp_queue_command(_exec_offset, value, value);
+	_set_coord_offset();
+	_queue_offset();
 	return (STAT_OK);
 }
 
 stat_t cm_resume_origin_offsets()
 {
 	gmx.origin_offset_enable = 1;
-	float value[AXES] = { (float)gm.coord_system,0,0,0,0,0 };
-	mp_queue_command(_exec_offset, value, value);
+	_set_coord_offset();
+	_queue_offset();
+	return (STAT_OK);
+}
+
+/*
+ * cm_set_rotation()	- G68
+ * cm_cancel_rotation() - G69
+ * cm_set_scaling()		- G51
+ * cm_cancel_scaling()	- G50
+ *
+ *	Centers and factors are taken as the block gives them and the cached matrix is
+ *	rebuilt. The transform only changes what later blocks are planned to - nothing is
+ *	queued. See cmTransform_t in canonical_machine.h.
+ */
+#ifdef __COORD_TRANSFORM
+static void _set_transform(void);
+static void _get_program_position(float program[]);
+
+stat_t cm_set_rotation(float center[], float flag[], float angle, float angle_flag)
+{
+	if (fp_FALSE(angle_flag)) { return (STAT_GCODE_INPUT_ERROR);}	// R is required
+	cmTransform_t *xf = &gmx.transform;
+	float program[3];
+
+	_get_program_position(program);
+	xf->rotation_axis_0 = gmx.plane_axis_0;
+	xf->rotation_axis_1 = gmx.plane_axis_1;
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) {
+		xf->rotation_center[axis] = (fp_TRUE(flag[axis])) ? _to_millimeters(center[axis]) : program[axis];
+	}
+	xf->rotation = angle;
+	_set_transform();
+	return (STAT_OK);
+}
+
+stat_t cm_cancel_rotation()
+{
+	gmx.transform.rotation = 0;
+	_set_transform();
 	return (STAT_OK);
 }
 
+stat_t cm_set_scaling(float center[], float flag[], float factor[], float factor_flag[], float p, float p_flag)
+{
+	cmTransform_t *xf = &gmx.transform;
+	float scale[3];
+	float program[3];
+
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) {
+		if (fp_TRUE(factor_flag[axis])) { scale[axis] = factor[axis];}
+		else if (fp_TRUE(p_flag)) { scale[axis] = p;}
+		else { return (STAT_GCODE_INPUT_ERROR);}		// no factor for this axis
+		if (scale[axis] <= 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}	// no mirroring
+	}
+	_get_program_position(program);
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) {
+		xf->scale[axis] = scale[axis];
+		xf->scale_center[axis] = (fp_TRUE(flag[axis])) ? _to_millimeters(center[axis]) : program[axis];
+	}
+	_set_transform();
+	return (STAT_OK);
+}
+
+stat_t cm_cancel_scaling()
+{
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) { gmx.transform.scale[axis] = 1;}
+	_set_transform();
+	return (STAT_OK);
+}
+
+/*
+ * _set_transform() - fold the scaling and the rotation into the cached matrix and its inverse
+ *
+ *	w = R.(S.(p - cs) + cs - cr) + cr, so m = R.S and t = R.(cs - S.cs - cr) + cr. The
+ *	inverse is m_inv = S^-1.R^T and t_inv = -m_inv.t - R is orthogonal and S diagonal.
+ */
+static void _set_transform()
+{
+	cmTransform_t *xf = &gmx.transform;
+	float r[3][3] = {{1,0,0},{0,1,0},{0,0,1}};
+	float u[3];
+
+	if (fp_NOT_ZERO(xf->rotation)) {
+		float theta = xf->rotation * M_PI_F / 180;
+		float c = cosf(theta);
+		float s = sinf(theta);
+		r[xf->rotation_axis_0][xf->rotation_axis_0] = c;
+		r[xf->rotation_axis_0][xf->rotation_axis_1] = -s;
+		r[xf->rotation_axis_1][xf->rotation_axis_0] = s;
+		r[xf->rotation_axis_1][xf->rotation_axis_1] = c;
+	}
+	for (uint8_t j=0; j<3; j++) {
+		u[j] = xf->scale_center[j] * (1 - xf->scale[j]) - xf->rotation_center[j];
+	}
+	for (uint8_t i=0; i<3; i++) {
+		xf->t[i] = xf->rotation_center[i];
+		for (uint8_t j=0; j<3; j++) {
+			xf->m[i][j] = r[i][j] * xf->scale[j];
+			xf->m_inv[i][j] = r[j][i] / xf->scale[i];
+			xf->t[i] += r[i][j] * u[j];
+		}
+	}
+	for (uint8_t i=0; i<3; i++) {
+		xf->t_inv[i] = 0;
+		for (uint8_t j=0; j<3; j++) { xf->t_inv[i] -= xf->m_inv[i][j] * xf->t[j];}
+	}
+	xf->active = ((fp_NOT_ZERO(xf->rotation)) || (fp_NE(xf->scale[AXIS_X], 1)) ||
+				  (fp_NE(xf->scale[AXIS_Y], 1)) || (fp_NE(xf->scale[AXIS_Z], 1)));
+}
+
+/*
+ * _get_program_position() - XYZ of the model position as the program sees it (mm)
+ * _transform_target()	   - set the XYZ of gm.target through the transform
+ *
+ *	The target is worked out in program coordinates - from where the last block ended,
+ *	taken back through the inverse - then put through the matrix, so incremental moves
+ *	and axes left off the block come out as they were programmed.
+ */
+static void _get_program_position(float program[])
+{
+	cmTransform_t *xf = &gmx.transform;
+	float work[3];
+
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) {
+		work[axis] = gmx.position[axis] - cm_get_active_coord_offset(axis);
+	}
+	for (uint8_t i=0; i<3; i++) {
+		program[i] = xf->t_inv[i];
+		for (uint8_t j=0; j<3; j++) { program[i] += xf->m_inv[i][j] * work[j];}
+	}
+}
+
+static void _transform_target(float target[], float flag[])
+{
+	cmTransform_t *xf = &gmx.transform;
+	float program[3];
+
+	_get_program_position(program);
+	for (uint8_t axis=AXIS_X; axis<=AXIS_Z; axis++) {
+		if ((fp_FALSE(flag[axis])) || (cm.a[axis].axis_mode == AXIS_DISABLED)) { continue;}
+		if (gmx.modal.distance_mode == ABSOLUTE_MODE) {
+			program[axis] = _to_millimeters(target[axis]);
+		} else {
+			program[axis] += _to_millimeters(target[axis]);
+		}
+	}
+	for (uint8_t i=0; i<3; i++) {
+		if (cm.a[i].axis_mode == AXIS_DISABLED) { continue;}
+		gm.target[i] = cm_get_active_coord_offset(i) + xf->t[i];
+		for (uint8_t j=0; j<3; j++) { gm.target[i] += xf->m[i][j] * program[j];}
+	}
+}
+
+/*
+ * cm_transform_vector() - put an XYZ offset (mm) through the transform - no translation
+ * cm_transform_arc()	 - put the arc's center offset and radius through the transform
+ *
+ *	cm_transform_arc() is called once the target is set, so the endpoint has already
+ *	been moved. An arc that would not stay a circle in its plane is rejected.
+ */
+void cm_transform_vector(float v[])
+{
+	cmTransform_t *xf = &gmx.transform;
+	float w[3];
+
+	for (uint8_t i=0; i<3; i++) {
+		w[i] = 0;
+		for (uint8_t j=0; j<3; j++) { w[i] += xf->m[i][j] * v[j];}
+	}
+	for (uint8_t i=0; i<3; i++) { v[i] = w[i];}
+}
+
+stat_t cm_transform_arc()
+{
+	cmTransform_t *xf = &gmx.transform;
+
+	if ((xf->active == false) || (gm.absolute_override == true)) { return (STAT_OK);}
+	if (fp_NE(xf->scale[gmx.plane_axis_0], xf->scale[gmx.plane_axis_1])) {
+		return (STAT_ARC_SPECIFICATION_ERROR);
+	}
+	if ((fp_NOT_ZERO(xf->rotation)) && ((xf->rotation_axis_0 != gmx.plane_axis_0) ||
+										(xf->rotation_axis_1 != gmx.plane_axis_1))) {
+		return (STAT_ARC_SPECIFICATION_ERROR);
+	}
+	cm_transform_vector(gmx.arc_offset);
+	gmx.arc_radius *= xf->scale[gmx.plane_axis_0];
+	return (STAT_OK);
+}
+#endif // __COORD_TRANSFORM
+
 /***************************** 
  * Free Space Motion (4.3.4) *
  *****************************/
 /*
  * cm_straight_traverse() - G0 linear rapid
+ *
+ *	A coordinated rapid is one line, so its velocity and jerk are held to what the
+ *	slowest axis in it allows - a rapid with a little Z in it runs at Z's pace. With
+ *	$gtr=1 (RAPID_DOGLEG) a rapid that moves Z and any other axis is run as two lines
+ *	through a corner: Z alone first when it rises, Z alone last when it falls, and the
+ *	other axes together in the other leg. Each leg is planned at the limits of its own
+ *	axes, and the corner is a 90 degree junction, so it is a stop. This assumes +Z is
+ *	away from the work, as it is for a mill - the tool clears before it crosses, and
+ *	only plunges once it is over the target.
+ *
+ *	Both legs stay inside the box of the start and the target, so the soft limits test
+ *	of the target covers them. A leg too short to plan is folded into the other one.
  */
 
+static stat_t _traverse_dogleg()
+{
+	float dz = gm.target[AXIS_Z] - gmx.position[AXIS_Z];
+	if (fp_ZERO(dz)) { return (STAT_NOOP);}
+
+	float corner[AXES], target[AXES];
+	copy_axis_vector(target, gm.target);
+	if (dz > 0) {								// retract - Z leg first
+		copy_axis_vector(corner, gmx.position);
+		corner[AXIS_Z] = target[AXIS_Z];
+	} else {									// plunge - Z leg last
+		copy_axis_vector(corner, target);
+		corner[AXIS_Z] = gmx.position[AXIS_Z];
+	}
+	if (vector_equal(corner, target) || vector_equal(corner, gmx.position)) { return (STAT_NOOP);}	// Z alone
+
+	copy_axis_vector(gm.target, corner);		// first leg
+	cm_set_move_times(&gm);
+	cm_cycle_start();
+	stat_t status = mp_aline(&gm);
+	cm_conditional_set_model_position(status);
+	copy_axis_vector(gm.target, target);		// second leg is left to the caller
+	if ((status != STAT_OK) && (status != STAT_MINIMUM_LENGTH_MOVE_ERROR)) { return (status);}
+	return (STAT_OK);
+}
+
 stat_t cm_straight_traverse(float target[], float flags[])
 {
 	gm.motion_mode = MOTION_MODE_STRAIGHT_TRAVERSE;
 	cm_set_model_target(target,flags);
 	if (vector_equal(gm.target, gmx.position)) { return (STAT_OK); }
-//	ritorno(_test_soft_limits());
+	ritorno(cm_test_soft_limits(gm.target));
 
 	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
+	if (cm.rapid_mode == RAPID_DOGLEG) {
+		stat_t status = _traverse_dogleg();		// queue the first leg, if it splits
+		if ((status != STAT_OK) && (status != STAT_NOOP)) { return (status);}
+	}
 	cm_set_move_times(&gm);						// set move time and minimum time in the state
 	cm_cycle_start();							// required for homing & other cycles
 	stat_t status = mp_aline(&gm);				// run the move
@@ -881,7 +1365,7 @@ stat_t cm_goto_g28_position(float target[], float flags[])
 {
 	cm_set_absolute_override(MODEL, true);
 	cm_straight_traverse(target, flags);			 // move through intermediate point, or skip
-	while (mp_get_planner_buffers_available() == 0); // make sure you have an available buffer
+	while (mp_planner_has_room(CM_MOVE_BUFFERS) == false); // make sure there is room for the stored move
 	float f[] = {1,1,1,1,1,1};
 	return(cm_straight_traverse(gmx.g28_position, f));// execute actual stored move
 }
@@ -896,7 +1380,7 @@ stat_t cm_goto_g30_position(float target[], float flags[])
 {
 	cm_set_absolute_override(MODEL, true);
 	cm_straight_traverse(target, flags);			 // move through intermediate point, or skip
-	while (mp_get_planner_buffers_available() == 0); // make sure you have an available buffer
+	while (mp_planner_has_room(CM_MOVE_BUFFERS) == false); // make sure there is room for the stored move
 	float f[] = {1,1,1,1,1,1};
 	return(cm_straight_traverse(gmx.g30_position, f));// execute actual stored move
 }
@@ -946,6 +1430,21 @@ stat_t cm_set_path_control(uint8_t mode)
 	return (STAT_OK);
 }
 
+/*
+ * cm_set_path_tolerance() - G64 P - corner blend tolerance (affects MODEL only)
+ *
+ *	In continuous mode the planner takes corners at the speed a blend arc that 
+ *	stays within this distance of the corner would allow. Zero (G64 with no P)
+ *	returns to the per-axis junction deviations. See _get_junction_vmax().
+ */
+
+stat_t cm_set_path_tolerance(float tolerance)
+{
+	if (tolerance < 0) { return (STAT_GCODE_INPUT_ERROR);}
+	gm.path_tolerance = _to_millimeters(tolerance);
+	return (STAT_OK);
+}
+
 /******************************* 
  * Machining Functions (4.3.6) *
  *******************************/
@@ -984,12 +1483,12 @@ stat_t cm_straight_feed(float target[], float flags[])
 
 	cm_set_model_target(target, flags);
 	if (vector_equal(gm.target, gmx.position)) { return (STAT_OK); }
-//	ritorno(_test_soft_limits());
+	ritorno(cm_test_soft_limits(gm.target));
 
 	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
 	cm_set_move_times(&gm);						// set move time and minimum time in the state
 	cm_cycle_start();							// required for homing & other cycles
-	stat_t status = mp_aline(&gm);				// run the move
+	stat_t status = mp_coalesce_line(&gm);		// run the move (via the G1 coalescing stage)
 	cm_conditional_set_model_position(status);	// update position if the move was successful
 	return (status);
 }
@@ -1021,19 +1520,20 @@ stat_t cm_select_tool(uint8_t tool_select)
 
 static void _exec_select_tool(float *value, float *flag)
 {
-	gm.tool_select = (uint8_t)value[0];
+	gmx.modal.tool_select = (uint8_t)value[0];
 }
 
 stat_t cm_change_tool(uint8_t tool_change)
 {
-	float value[AXES] = { (float)gm.tool_select,0,0,0,0,0 };
+	float value[AXES] = { (float)gmx.modal.tool_select,0,0,0,0,0 };
+	AUX_SYNC();									// a carousel on the aux queue gets there first
 	mp_queue_command(_exec_change_tool, value, value);
 	return (STAT_OK);
 }
 
 static void _exec_change_tool(float *value, float *flag)
 {
-	gm.tool = (uint8_t)value[0];
+	gmx.modal.tool = (uint8_t)value[0];
 }
 
 /*********************************** 
@@ -1046,22 +1546,21 @@ static void _exec_change_tool(float *value, float *flag)
 
 stat_t cm_mist_coolant_control(uint8_t mist_coolant)
 {
-	float value[AXES] = { (float)mist_coolant,0,0,0,0,0 };
-	mp_queue_command(_exec_mist_coolant_control, value, value);
+	mp_queue_attached_command(_exec_mist_coolant_control, (float)mist_coolant);	// no stop - runs as the next move starts
 	return (STAT_OK);
 }
 static void _exec_mist_coolant_control(float *value, float *flag)
 {
-	gm.mist_coolant = (uint8_t)value[0];
+	gmx.modal.mist_coolant = (uint8_t)value[0];
 
 #ifdef __AVR
-	if (gm.mist_coolant == true)
+	if (gmx.modal.mist_coolant == true)
 		gpio_set_bit_on(MIST_COOLANT_BIT);	// if
 	gpio_set_bit_off(MIST_COOLANT_BIT);		// else
 #endif // __AVR
 
 #ifdef __ARM
-	if (gm.mist_coolant == true)
+	if (gmx.modal.mist_coolant == true)
 		coolant_enable_pin.set();	// if
 	coolant_enable_pin.clear();		// else
 #endif // __ARM
@@ -1069,16 +1568,15 @@ static void _exec_mist_coolant_control(float *value, float *flag)
 
 stat_t cm_flood_coolant_control(uint8_t flood_coolant)
 {
-	float value[AXES] = { (float)flood_coolant,0,0,0,0,0 };
-	mp_queue_command(_exec_flood_coolant_control, value, value);
+	mp_queue_attached_command(_exec_flood_coolant_control, (float)flood_coolant);	// no stop - runs as the next move starts
 	return (STAT_OK);
 }
 static void _exec_flood_coolant_control(float *value, float *flag)
 {
-	gm.flood_coolant = (uint8_t)value[0];
+	gmx.modal.flood_coolant = (uint8_t)value[0];
 
 #ifdef __AVR
-	if (gm.flood_coolant == true) {
+	if (gmx.modal.flood_coolant == true) {
 		gpio_set_bit_on(FLOOD_COOLANT_BIT);
 	} else {
 		gpio_set_bit_off(FLOOD_COOLANT_BIT);
@@ -1088,7 +1586,7 @@ static void _exec_flood_coolant_control(float *value, float *flag)
 #endif // __AVR
 
 #ifdef __ARM
-	if (gm.flood_coolant == true) {
+	if (gmx.modal.flood_coolant == true) {
 		coolant_enable_pin.set();
 	} else {
 		coolant_enable_pin.clear();
@@ -1116,6 +1614,7 @@ stat_t cm_override_enables(uint8_t flag)			// M48, M49
 	gmx.feed_rate_override_enable = flag;
 	gmx.traverse_override_enable = flag;
 	gmx.spindle_override_enable = flag;
+	if (flag == false) { return (mp_feed_rate_override(false, 0));}	// M49 cancels any feed override
 	return (STAT_OK);
 }
 
@@ -1123,6 +1622,7 @@ stat_t cm_feed_rate_override_enable(uint8_t flag)	// M50
 {
 	if (fp_TRUE(gf.parameter) && fp_ZERO(gn.parameter)) {
 		gmx.feed_rate_override_enable = false;
+		return (mp_feed_rate_override(false, 0));
 	} else {
 		gmx.feed_rate_override_enable = true;
 	}
@@ -1133,8 +1633,7 @@ stat_t cm_feed_rate_override_factor(uint8_t flag)	// M50.1
 {
 	gmx.feed_rate_override_enable = flag;
 	gmx.feed_rate_override_factor = gn.parameter;
-//	mp_feed_rate_override(flag, gn.parameter);		// replan the queue for new feed rate
-	return (STAT_OK);
+	return (mp_feed_rate_override(flag, gn.parameter));	// replan the queue for new feed rate
 }
 
 stat_t cm_traverse_override_enable(uint8_t flag)	// M50.2
@@ -1235,18 +1734,20 @@ void cm_message(char_t *message)
  *		should start to run anything in the planner queue
  */
 
-void cm_request_feedhold(void) { cm.feedhold_requested = true; }
+void cm_request_feedhold(void)
+{
+	if (cm.feedhold_requested == false) { mm.hold_cycles = HW_DWT_CYCCNT;}	// start of $hlat and $hstp
+	cm.feedhold_requested = true;
+}
 void cm_request_queue_flush(void) { cm.queue_flush_requested = true; }
 void cm_request_cycle_start(void) { cm.cycle_start_requested = true; }
 
 stat_t cm_feedhold_sequencing_callback()
 {
-	if (cm.feedhold_requested == true) {
-		if ((cm.motion_state == MOTION_RUN) && (cm.hold_state == FEEDHOLD_OFF)) {
-			cm_set_motion_state(MOTION_HOLD);
-			cm.hold_state = FEEDHOLD_SYNC;	// invokes hold from aline execution
+	if (cm.feedhold_requested == true) {	// a hold during motion is picked up by the aline exec
+		if ((cm.motion_state != MOTION_RUN) || (cm.hold_state != FEEDHOLD_OFF)) {
+			cm.feedhold_requested = false;	// ignore and reset
 		}
-		cm.feedhold_requested = false;
 	}
 	if (cm.queue_flush_requested == true) {
 		if ((cm.motion_state == MOTION_STOP) ||
@@ -1258,6 +1759,7 @@ stat_t cm_feedhold_sequencing_callback()
 	if ((cm.cycle_start_requested == true) && (cm.queue_flush_requested == false)) {
 		cm.cycle_start_requested = false;
 		cm.hold_state = FEEDHOLD_END_HOLD;
+		SWO_HOLD_STATE();
 		cm_cycle_start();
 		mp_end_hold();
 	}
@@ -1270,11 +1772,18 @@ stat_t cm_queue_flush()
 	xio_reset_usb_rx_buffers();		// flush serial queues
 #endif
 	mp_flush_planner();				// flush planner queue
+#ifdef __PROGRAM_STORE
+	pg_stop();						// a flush ends a stored program run
+#endif
+#ifdef __GCODE_MACROS
+	mc_reset();						// ...and any macro calls and loops
+#endif
 
 	// Note: The following uses low-level mp calls for absolute position.
 	//		 It could also use cm_get_absolute_position(RUNTIME, axis);
 
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+		if (AUX_AXIS(axis)) { continue;}		// the aux queue runs on - see plan_aux.cpp
 		mp_set_planner_position(axis, mp_get_runtime_absolute_position(axis)); // set mm from mr
 		gmx.position[axis] = mp_get_runtime_absolute_position(axis);
 		gm.target[axis] = gmx.position[axis];
@@ -1328,11 +1837,14 @@ static void _exec_program_finalize(float *value, float *flag)
 		cm.cycle_state = CYCLE_OFF;					// don't end cycle if homing, probing, etc.
 	}
 	cm.hold_state = FEEDHOLD_OFF;					// end feedhold (if in feed hold)
+	SWO_HOLD_STATE();
 	cm.cycle_start_requested = false;				// cancel any pending cycle start request
 	mp_zero_segment_velocity();						// for reporting purposes
 
 	// execute program END resets
 	if (cm.machine_state == MACHINE_PROGRAM_END) {
+		mp_end_job_time();							// the next move starts a new job timer
+		rpt_request_job_report();					// where the time of the job went
 		cm_reset_origin_offsets();					// G92.1 - we do G91.1 instead of G92.2
 	//	cm_suspend_origin_offsets();				// G92.2 - as per Kramer
 		cm_set_coord_system(cm.coord_system);		// reset to default coordinate system
@@ -1342,6 +1854,13 @@ static void _exec_program_finalize(float *value, float *flag)
 		cm_spindle_control(SPINDLE_OFF);			// M5
 		cm_flood_coolant_control(false);			// M9
 		cm_set_inverse_feed_rate_mode(false);
+#ifdef __COORD_TRANSFORM
+		cm_cancel_rotation();						// G69
+		cm_cancel_scaling();						// G50
+#endif
+#ifdef __SPINDLE_CSS
+		cm_cancel_css();							// G97
+#endif
 	//	cm_set_motion_mode(MOTION_MODE_STRAIGHT_FEED);// NIST specifies G1, but we cancel motion mode. Safer.
 		cm_set_motion_mode(MODEL, MOTION_MODE_CANCEL_MOTION_MODE);
 	}
@@ -1382,6 +1901,9 @@ void cm_optional_program_stop()
 void cm_program_end()
 {
 	float value[AXES] = { (float)MACHINE_PROGRAM_END, 0,0,0,0,0 };
+#ifdef __SPINDLE_CSS
+	css.mode = false;								// G97 in the model - the exec cancels the runtime
+#endif
 	mp_queue_command(_exec_program_finalize, value, value);
 }
 
@@ -1410,7 +1932,8 @@ static const char msg_am00[] PROGMEM = "[disabled]";
 static const char msg_am01[] PROGMEM = "[standard]";
 static const char msg_am02[] PROGMEM = "[inhibited]";
 static const char msg_am03[] PROGMEM = "[radius]";
-static const char *const msg_am[] PROGMEM = { msg_am00, msg_am01, msg_am02, msg_am03};
+static const char msg_am04[] PROGMEM = "[wrap]";
+static const char *const msg_am[] PROGMEM = { msg_am00, msg_am01, msg_am02, msg_am03, msg_am04};
 
 static const char msg_g20[] PROGMEM = "G20 - inches mode";
 static const char msg_g21[] PROGMEM = "G21 - millimeter mode";
@@ -1474,7 +1997,24 @@ static const char msg_g01[] PROGMEM = "G1  - linear feed";
 static const char msg_g02[] PROGMEM = "G2  - clockwise arc feed";
 static const char msg_g03[] PROGMEM = "G3  - counter clockwise arc feed";
 static const char msg_g80[] PROGMEM = "G80 - cancel motion mode (none active)";
-static const char *const msg_momo[] PROGMEM = { msg_g00, msg_g01, msg_g02, msg_g03, msg_g80 };
+static const char msg_g38[] PROGMEM = "G38.2 - straight probe";
+static const char msg_g81[] PROGMEM = "G81 - drilling cycle";
+static const char msg_g82[] PROGMEM = "G82 - drilling cycle with dwell";
+static const char msg_g83[] PROGMEM = "G83 - peck drilling cycle";
+static const char msg_g84[] PROGMEM = "G84 - tapping cycle";
+static const char msg_g85[] PROGMEM = "G85 - boring cycle, feed out";
+static const char msg_g86[] PROGMEM = "G86 - boring cycle, spindle stop, rapid out";
+static const char msg_g87[] PROGMEM = "G87 - back boring cycle";
+static const char msg_g88[] PROGMEM = "G88 - boring cycle, spindle stop, manual out";
+static const char msg_g89[] PROGMEM = "G89 - boring cycle, dwell, feed out";
+static const char msg_g73[] PROGMEM = "G73 - peck drilling cycle with chip breaking";
+static const char msg_g05[] PROGMEM = "G5  - cubic spline feed";
+static const char msg_g051[] PROGMEM = "G5.1 - quadratic spline feed";
+static const char msg_g33[] PROGMEM = "G33 - spindle synchronized motion";
+static const char *const msg_momo[] PROGMEM = { msg_g00, msg_g01, msg_g02, msg_g03, msg_g80, msg_g38,
+												msg_g81, msg_g82, msg_g83, msg_g84, msg_g85, msg_g86,
+												msg_g87, msg_g88, msg_g89, msg_g73, msg_g05, msg_g051,
+												msg_g33 };
 
 static const char msg_g17[] PROGMEM = "G17 - XY plane";
 static const char msg_g18[] PROGMEM = "G18 - XZ plane";
@@ -1574,6 +2114,8 @@ static int8_t _get_axis_type(const index_t index)
  * cm_get_mline()- get model line number for status reports
  * cm_get_line() - get active (model or runtime) line number for status reports
  * cm_get_vel()  - get runtime velocity
+ * cm_get_jet()  - get job elapsed time in seconds
+ * cm_get_jrt()  - get job remaining time in seconds (planned time left in the queue)
  * cm_get_ofs()  - get runtime work offset
  * cm_get_pos()  - get runtime work position
  * cm_get_mpos() - get runtime machine position
@@ -1640,9 +2182,26 @@ stat_t cm_get_vel(cmdObj_t *cmd)
 	return (STAT_OK);
 }
 
+stat_t cm_get_jet(cmdObj_t *cmd) 
+{
+	cmd->value = mp_get_job_elapsed_time();
+	cmd->precision = GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
+}
+
+stat_t cm_get_jrt(cmdObj_t *cmd) 
+{
+	cmd->value = mp_get_job_remaining_time();
+	cmd->precision = GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
+}
+
 stat_t cm_get_pos(cmdObj_t *cmd) 
 {
-	cmd->value = cm_get_work_position(ACTIVE_MODEL, _get_axis(cmd->index));
+	int8_t axis = _get_axis(cmd->index);
+	cmd->value = _wrap_degrees(axis, cm_get_work_position(ACTIVE_MODEL, axis));
 	cmd->precision = GET_TABLE_WORD(precision);
 	cmd->objtype = TYPE_FLOAT;
 	return (STAT_OK);
@@ -1650,7 +2209,8 @@ stat_t cm_get_pos(cmdObj_t *cmd)
 
 stat_t cm_get_mpo(cmdObj_t *cmd) 
 {
-	cmd->value = cm_get_absolute_position(RUNTIME, _get_axis(cmd->index));
+	int8_t axis = _get_axis(cmd->index);
+	cmd->value = _wrap_degrees(axis, cm_get_absolute_position(RUNTIME, axis));
 	cmd->precision = GET_TABLE_WORD(precision);
 	cmd->objtype = TYPE_FLOAT;
 	return (STAT_OK);
@@ -1685,10 +2245,39 @@ stat_t cm_set_am(cmdObj_t *cmd)		// axis mode
 	} else {
 		if (cmd->value > AXIS_MODE_MAX_ROTARY) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
 	}
+	if ((AXIS_USED(_get_axis(cmd->index)) == false) && (cmd->value != AXIS_DISABLED)) {
+		return (STAT_INPUT_VALUE_UNSUPPORTED);	// compiled out - see AXES_USED in settings.h
+	}
 	set_ui8(cmd);
+	ik_set_motor_map();						// inhibited axes are compiled into the map
 	return(STAT_OK);
 }
 
+stat_t cm_set_tm(cmdObj_t *cmd)		// travel maximum
+{
+	if (_get_axis_type(cmd->index) == 0) {	// linear
+		set_flu(cmd);
+	} else {
+		set_flt(cmd);
+	}
+	cm_set_soft_limits();					// the envelope is kept in steps
+	return(STAT_OK);
+}
+
+stat_t cm_set_cofs(cmdObj_t *cmd)		// coordinate system offset
+{
+	set_flu(cmd);
+	_set_coord_offset();					// the active offset is cached
+	return(STAT_OK);
+}
+
+stat_t cm_set_tof(cmdObj_t *cmd)		// tool table offset
+{
+	set_flu(cmd);
+	if (gmx.tool_offset_entry == 0) { return (STAT_OK);}
+	return (cm_set_tool_offset(gmx.tool_offset_entry));	// the entry in use may have changed
+}
+
 /*
  * cm_get_jrk()	- get jerk value 
  * cm_set_jrk()	- set jerk value 
@@ -1711,11 +2300,32 @@ stat_t cm_set_jrk(cmdObj_t *cmd)
 	return(STAT_OK);
 }
 
+/*
+ * cm_set_mfo() - set the feed rate override factor ($mfo) and replan the queue
+ *
+ *	The runtime equivalent of M50.1 for a host override knob. 1.0 is no override.
+ */
+stat_t cm_set_mfo(cmdObj_t *cmd)
+{
+	gmx.feed_rate_override_factor = cmd->value;
+	return (mp_feed_rate_override(true, cmd->value));
+}
+
+/*
+ * cm_set_pea() - set the pressure advance extruder axis ($pea) - takes effect from the next move
+ */
+stat_t cm_set_pea(cmdObj_t *cmd)
+{
+	if (cmd->value >= AXES) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_ui8(cmd));
+}
+
 /*
  * Commands
  *
  * cm_run_qf() - flush planner queue 
  * cm_run_home() - run homing sequence
+ * cm_run_map()  - run surface mapping cycle
  */
 
 stat_t cm_run_qf(cmdObj_t *cmd) 
@@ -1730,6 +2340,12 @@ stat_t cm_run_home(cmdObj_t *cmd)
 	return (STAT_OK);
 }
 
+stat_t cm_run_map(cmdObj_t *cmd)
+{
+	if (fp_TRUE(cmd->value)) { return (cm_map_cycle_start());}
+	return (STAT_OK);
+}
+
 /***********************************************************************************
  * TEXT MODE SUPPORT
  * Functions to print variables from the cfgArray table
@@ -1742,6 +2358,8 @@ stat_t cm_run_home(cmdObj_t *cmd)
 const char fmt_vel[]  PROGMEM = "Velocity:%17.3f%s/min\n";
 const char fmt_feed[] PROGMEM = "Feed rate:%16.3f%s/min\n";
 const char fmt_line[] PROGMEM = "Line number:%10.0f\n";
+const char fmt_jet[]  PROGMEM = "Job elapsed time:%9.1f sec\n";
+const char fmt_jrt[]  PROGMEM = "Job remaining time:%7.1f sec\n";
 const char fmt_stat[] PROGMEM = "Machine state:       %s\n"; // combined machine state
 const char fmt_macs[] PROGMEM = "Raw machine state:   %s\n"; // raw machine state
 const char fmt_cycs[] PROGMEM = "Cycle state:         %s\n";
@@ -1756,6 +2374,10 @@ const char fmt_path[] PROGMEM = "Path Mode:           %s\n";
 const char fmt_dist[] PROGMEM = "Distance mode:       %s\n";
 const char fmt_frmo[] PROGMEM = "Feed rate mode:      %s\n";
 const char fmt_tool[] PROGMEM = "Tool number          %d\n";
+const char fmt_mfo[]  PROGMEM = "Feed rate override:%7.3f\n";
+const char fmt_hlat[] PROGMEM = "Hold latency:%13.0f uSec\n";
+const char fmt_hstp[] PROGMEM = "Hold stop time:%11.0f uSec\n";
+const char fmt_rlat[] PROGMEM = "Resume latency:%11.0f uSec\n";
 
 const char fmt_pos[] PROGMEM = "%c position:%15.3f%s\n";
 const char fmt_mpo[] PROGMEM = "%c machine posn:%11.3f%s\n";
@@ -1767,15 +2389,22 @@ const char fmt_gun[] PROGMEM = "[gun] default gcode units mode%5d [0=G20,1=G21]\
 const char fmt_gco[] PROGMEM = "[gco] default gcode coord system%3d [1-6 (G54-G59)]\n";
 const char fmt_gpa[] PROGMEM = "[gpa] default gcode path control%3d [0=G61,1=G61.1,2=G64]\n";
 const char fmt_gdi[] PROGMEM = "[gdi] default gcode distance mode%2d [0=G90,1=G91]\n";
+const char fmt_gtr[] PROGMEM = "[gtr] G0 traverse mode%13d [0=coordinated,1=dogleg]\n";
 
 void cm_print_vel(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_vel, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_feed(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_feed, GET_UNITS(ACTIVE_MODEL));}
+void cm_print_mfo(cmdObj_t *cmd) { text_print_flt(cmd, fmt_mfo);}
 void cm_print_line(cmdObj_t *cmd) { text_print_int(cmd, fmt_line);}
+void cm_print_jet(cmdObj_t *cmd) { text_print_flt(cmd, fmt_jet);}
+void cm_print_jrt(cmdObj_t *cmd) { text_print_flt(cmd, fmt_jrt);}
 void cm_print_stat(cmdObj_t *cmd) { text_print_str(cmd, fmt_stat);}
 void cm_print_macs(cmdObj_t *cmd) { text_print_str(cmd, fmt_macs);}
 void cm_print_cycs(cmdObj_t *cmd) { text_print_str(cmd, fmt_cycs);}
 void cm_print_mots(cmdObj_t *cmd) { text_print_str(cmd, fmt_mots);}
 void cm_print_hold(cmdObj_t *cmd) { text_print_str(cmd, fmt_hold);}
+void cm_print_hlat(cmdObj_t *cmd) { text_print_flt(cmd, fmt_hlat);}
+void cm_print_hstp(cmdObj_t *cmd) { text_print_flt(cmd, fmt_hstp);}
+void cm_print_rlat(cmdObj_t *cmd) { text_print_flt(cmd, fmt_rlat);}
 void cm_print_home(cmdObj_t *cmd) { text_print_str(cmd, fmt_home);}
 void cm_print_unit(cmdObj_t *cmd) { text_print_str(cmd, fmt_unit);}
 void cm_print_coor(cmdObj_t *cmd) { text_print_str(cmd, fmt_coor);}
@@ -1791,17 +2420,28 @@ void cm_print_gun(cmdObj_t *cmd) { text_print_int(cmd, fmt_gun);}
 void cm_print_gco(cmdObj_t *cmd) { text_print_int(cmd, fmt_gco);}
 void cm_print_gpa(cmdObj_t *cmd) { text_print_int(cmd, fmt_gpa);}
 void cm_print_gdi(cmdObj_t *cmd) { text_print_int(cmd, fmt_gdi);}
+void cm_print_gtr(cmdObj_t *cmd) { text_print_int(cmd, fmt_gtr);}
 
 /* system state print functions */
 
 const char fmt_ja[] PROGMEM = "[ja]  junction acceleration%8.0f%s\n";
 const char fmt_ct[] PROGMEM = "[ct]  chordal tolerance%16.3f%s\n";
+const char fmt_lca[] PROGMEM = "[lca] line coalesce angle%14.3f degrees\n";
+const char fmt_lct[] PROGMEM = "[lct] line coalesce tolerance%10.4f%s\n";
+const char fmt_prt[] PROGMEM = "[prt] probe retouches%14d [0=fast approach only]\n";
+const char fmt_pea[] PROGMEM = "[pea] pressure advance axis%12d [0-5=X-C]\n";
+const char fmt_pek[] PROGMEM = "[pek] pressure advance%17.3f sec [0=off]\n";
 const char fmt_ml[] PROGMEM = "[ml]  min line segment%17.3f%s\n";
 const char fmt_ma[] PROGMEM = "[ma]  min arc segment%18.3f%s\n";
 const char fmt_ms[] PROGMEM = "[ms]  min segment time%13.0f uSec\n";
 
 void cm_print_ja(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ja, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_ct(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ct, GET_UNITS(ACTIVE_MODEL));}
+void cm_print_lca(cmdObj_t *cmd) { text_print_flt(cmd, fmt_lca);}
+void cm_print_lct(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_lct, GET_UNITS(ACTIVE_MODEL));}
+void cm_print_prt(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_prt);}
+void cm_print_pea(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_pea);}
+void cm_print_pek(cmdObj_t *cmd) { text_print_flt(cmd, fmt_pek);}
 void cm_print_ml(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ml, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_ma(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ma, GET_UNITS(ACTIVE_MODEL));}
 void cm_print_ms(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ms, GET_UNITS(ACTIVE_MODEL));}
@@ -1820,12 +2460,16 @@ void cm_print_ms(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ms, GET_UNITS(AC
  *	cm_print_jm()
  *	cm_print_jh()
  *	cm_print_jd()
+ *	cm_print_ac()
  *	cm_print_ra()
  *	cm_print_sn()
  *	cm_print_sx()
  *	cm_print_lv()
  *	cm_print_lb()
  *	cm_print_zb()
+ *	cm_print_hg()
+ *	cm_print_sq()
+ *	cm_print_bl()
  *
  *	cm_print_pos() - print position with unit displays for MM or Inches
  * 	cm_print_mpo() - print position with fixed unit display - always in Degrees or MM
@@ -1838,6 +2482,7 @@ const char fmt_Xtm[] PROGMEM = "[%s%s] %s travel maximum%17.3f%s\n";
 const char fmt_Xjm[] PROGMEM = "[%s%s] %s jerk maximum%15.0f%s/min^3 * 1 million\n";
 const char fmt_Xjh[] PROGMEM = "[%s%s] %s jerk homing%16.0f%s/min^3 * 1 million\n";
 const char fmt_Xjd[] PROGMEM = "[%s%s] %s junction deviation%14.4f%s (larger is faster)\n";
+const char fmt_Xac[] PROGMEM = "[%s%s] %s accel maximum%14.0f%s/min^2 (0=jerk limited only)\n";
 const char fmt_Xra[] PROGMEM = "[%s%s] %s radius value%20.4f%s\n";
 const char fmt_Xsn[] PROGMEM = "[%s%s] %s switch min%17d [0=off,1=homing,2=limit,3=limit+homing]\n";
 const char fmt_Xsx[] PROGMEM = "[%s%s] %s switch max%17d [0=off,1=homing,2=limit,3=limit+homing]\n";
@@ -1845,7 +2490,11 @@ const char fmt_Xsv[] PROGMEM = "[%s%s] %s search velocity%16.3f%s/min\n";
 const char fmt_Xlv[] PROGMEM = "[%s%s] %s latch velocity%17.3f%s/min\n";
 const char fmt_Xlb[] PROGMEM = "[%s%s] %s latch backoff%18.3f%s\n";
 const char fmt_Xzb[] PROGMEM = "[%s%s] %s zero backoff%19.3f%s\n";
+const char fmt_Xhg[] PROGMEM = "[%s%s] %s homing group%15d [0=home alone]\n";
+const char fmt_Xsq[] PROGMEM = "[%s%s] %s squaring switch%12d [0=off,1-12=xmin,xmax,ymin...]\n";
+const char fmt_Xbl[] PROGMEM = "[%s%s] %s backlash%23.3f%s\n";
 const char fmt_cofs[] PROGMEM = "[%s%s] %s %s offset%20.3f%s\n";
+const char fmt_tof[] PROGMEM = "[%s%s] tool %s length offset%14.3f%s\n";
 const char fmt_cpos[] PROGMEM = "[%s%s] %s %s position%18.3f%s\n";
 
 static void _print_axis_ui8(cmdObj_t *cmd, const char *format)
@@ -1861,7 +2510,7 @@ static void _print_axis_flt(cmdObj_t *cmd, const char *format)
 	} else {
 		units = (char *)GET_TEXT_ITEM(msg_units, DEGREE_INDEX);
 	}
-	fprintf_P(stderr, format, cmd->group, cmd->token, cmd->group, cmd->value, units);
+	fprintf_P(stderr, format, cmd->group, cmd->token, cmd->group, (double)cmd->value, units);
 }
 
 static void _print_axis_coord_flt(cmdObj_t *cmd, const char *format)
@@ -1872,7 +2521,7 @@ static void _print_axis_coord_flt(cmdObj_t *cmd, const char *format)
 	} else {
 		units = (char *)GET_TEXT_ITEM(msg_units, DEGREE_INDEX);
 	}
-	fprintf_P(stderr, format, cmd->group, cmd->token, cmd->group, cmd->token, cmd->value, units);
+	fprintf_P(stderr, format, cmd->group, cmd->token, cmd->group, cmd->token, (double)cmd->value, units);
 }
 
 static void _print_pos(cmdObj_t *cmd, const char *format, uint8_t units)
@@ -1880,7 +2529,7 @@ static void _print_pos(cmdObj_t *cmd, const char *format, uint8_t units)
 	char axes[] = {"XYZABC"};
 	uint8_t axis = _get_axis(cmd->index);
 	if (axis >= AXIS_A) { units = DEGREES;}
-	fprintf_P(stderr, format, axes[axis], cmd->value, GET_TEXT_ITEM(msg_units, units));
+	fprintf_P(stderr, format, axes[axis], (double)cmd->value, GET_TEXT_ITEM(msg_units, units));
 }
 
 void cm_print_am(cmdObj_t *cmd)	// print axis mode with enumeration string
@@ -1895,6 +2544,7 @@ void cm_print_tm(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xtm);}
 void cm_print_jm(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xjm);}
 void cm_print_jh(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xjh);}
 void cm_print_jd(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xjd);}
+void cm_print_ac(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xac);}
 void cm_print_ra(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xra);}
 void cm_print_sn(cmdObj_t *cmd) { _print_axis_ui8(cmd, fmt_Xsn);}
 void cm_print_sx(cmdObj_t *cmd) { _print_axis_ui8(cmd, fmt_Xsx);}
@@ -1902,8 +2552,15 @@ void cm_print_sv(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xsv);}
 void cm_print_lv(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xlv);}
 void cm_print_lb(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xlb);}
 void cm_print_zb(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xzb);}
+void cm_print_hg(cmdObj_t *cmd) { _print_axis_ui8(cmd, fmt_Xhg);}
+void cm_print_sq(cmdObj_t *cmd) { _print_axis_ui8(cmd, fmt_Xsq);}
+void cm_print_bl(cmdObj_t *cmd) { _print_axis_flt(cmd, fmt_Xbl);}
 
 void cm_print_cofs(cmdObj_t *cmd) { _print_axis_coord_flt(cmd, fmt_cofs);}
+void cm_print_tof(cmdObj_t *cmd)
+{
+	fprintf_P(stderr, fmt_tof, cmd->group, cmd->token, cmd->token, (double)cmd->value, GET_UNITS(MODEL));
+}
 void cm_print_cpos(cmdObj_t *cmd) { _print_axis_coord_flt(cmd, fmt_cpos);}
 
 void cm_print_pos(cmdObj_t *cmd) { _print_pos(cmd, fmt_pos, cm_get_units_mode(MODEL));}
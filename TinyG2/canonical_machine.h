@@ -40,10 +40,14 @@ extern "C"{
 /* Defines */
 
 #define MODEL 	(GCodeState_t *)&gm			// absolute pointer from canonical machine gm model
-#define PLANNER (GCodeState_t *)&bf->gm		// relative to buffer *bf is currently pointing to
+#define PLANNER (GCodeState_t *)bf->gm		// relative to buffer *bf is currently pointing to
 #define RUNTIME (GCodeState_t *)&mr.gm		// absolute pointer from runtime mm struct
 #define ACTIVE_MODEL cm.am					// active model pointer is maintained by state management
 
+#define CM_WORK_OFFSET_SETS 8				// sets of resolved work offsets the queued blocks can refer to
+#define CM_WORK_OFFSET_SETS_HEADROOM 2		// free sets planning waits for - a G5x and a G53 move in one block take two
+#define CM_MODAL_SETS 8						// sets of modal Gcode state the queued blocks can refer to
+
 /*****************************************************************************
  * CANONICAL MACHINE STRUCTURES
  */
@@ -56,13 +60,31 @@ typedef struct cmAxis {
 	float jerk_max;					// max jerk (Jm) in mm/min^3 divided by 1 million
 	float jerk_homing;				// homing jerk (Jh) in mm/min^3 divided by 1 million
 	float junction_dev;				// aka cornering delta
+	float accel_max;				// max acceleration in mm/min^2 or deg/min^2. 0 = jerk limited only
 	float radius;					// radius in mm for rotary axis modes
 	float search_velocity;			// homing search velocity
 	float latch_velocity;			// homing latch velocity
 	float latch_backoff;			// backoff from switches prior to homing latch movement
 	float zero_backoff;				// backoff from switches for machine zero
+	uint8_t homing_group;			// axes with the same non-zero group are homed together
+	uint8_t squaring_switch;		// 0=off, else 1 + switch number for the axis' second motor
+	float backlash;					// lost motion taken up by the steppers on a reversal. 0 = none (see stepper.cpp)
+	float shaper_freq;				// input shaper resonant frequency in Hz. 0 = not shaped (see shaper.h)
+	float shaper_damping;			// input shaper damping ratio
+	uint8_t async;					// TRUE if the axis is run by the aux queue, not the planner (see plan_aux.cpp)
 } cfgAxis_t;
 
+typedef struct GCodeModal {			// modes that seldom change - queued blocks share them by index (see cm_get_modal_set())
+	uint8_t select_plane;			// G17,G18,G19 - values to set plane to
+	uint8_t units_mode;				// G20,G21 - 0=inches (G20), 1 = mm (G21)
+	uint8_t coord_system;			// G54-G59 - select coordinate system 1-9
+	uint8_t distance_mode;			// G91   0=use absolute coords(G90), 1=incremental movement
+	uint8_t tool;					// M6 tool change - moves "tool_select" to "tool"
+	uint8_t tool_select;			// T value - T sets this value
+	uint8_t mist_coolant;			// TRUE = mist on (M7), FALSE = off (M9)
+	uint8_t flood_coolant;			// TRUE = flood on (M8), FALSE = off (M9)
+} GCodeModal_t;
+
 typedef struct cmSingleton {		// struct to manage cm globals and cycles
 	magic_t magic_start;			// magic number to test memory integity	
 
@@ -71,6 +93,11 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
 	// system group settings
 	float junction_acceleration;	// centripetal acceleration max for cornering
 	float chordal_tolerance;		// arc chordal accuracy setting in mm
+	float coalesce_angle;			// max direction change in degrees for merging G1 lines (0 = off)
+	float coalesce_tolerance;		// max deviation in mm of merged G1 lines from their chord
+	uint8_t probe_touches;			// G38.2 slow retouches averaged for the result (0 = fast approach only)
+	uint8_t pa_axis;				// extruder axis for pressure advance
+	float pa_k;						// pressure advance in seconds of extruder velocity (0 = off)
 
 	// hidden system settings
 	float min_segment_len;			// line drawing resolution in mm
@@ -83,9 +110,15 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
 	uint8_t units_mode;				// G20,G21 reset default
 	uint8_t path_control;			// G61,G61.1,G64 reset default
 	uint8_t distance_mode;			// G90,G91 reset default
+	uint8_t rapid_mode;				// G0 coordinated or dogleg - see cmRapidMode
 
 	// coordinate systems and offsets
 	float offset[COORDS+1][AXES];	// persistent coordinate offsets: absolute (G53) + G54,G55,G56,G57,G58,G59
+	float tool_offset[TOOLS+1];		// persistent tool table Z offsets for G43 H1-H8 - [0] is 0 (G49)
+	float work_offset[CM_WORK_OFFSET_SETS][AXES];	// resolved work offsets of the queued blocks - see cm_get_work_offset_set()
+	uint8_t work_offset_newest;		// last set written
+	GCodeModal_t modal[CM_MODAL_SETS];	// modal state of the queued blocks - see cm_get_modal_set()
+	uint8_t modal_newest;			// last set written
 
 	// settings for axes X,Y,Z,A B,C
 	cfgAxis_t a[AXES];
@@ -99,6 +132,10 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
 	uint8_t hold_state;				// hold: feedhold sub-state machine
 	uint8_t homing_state;			// home: homing cycle sub-state machine
 	uint8_t homed[AXES];			// individual axis homing flags
+	float soft_steps[AXES];			// steps per unit of the soft limit envelope - 0 if not checked
+	int32_t soft_min[AXES];			// soft limit envelope in steps - see cm_set_soft_limits()
+	int32_t soft_max[AXES];
+	float probe_position[AXES];		// machine position of the last G38.2 trigger per axis
 	uint8_t	g28_flag;				// true = complete a G28 move
 	uint8_t	g30_flag;				// true = complete a G30 move
 	uint8_t g10_persist_flag;		//.G10 changed offsets - persist them
@@ -108,6 +145,7 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
 	struct GCodeState *am;			// active Gcode model is maintained by state management
 
 	magic_t magic_end;
+	MEMORY_GUARD
 } cmSingleton_t;
 
 /*****************************************************************************
@@ -119,7 +157,9 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
  *	 canonical machine layer and should be accessed only through cm_ routines.
  *
  *	 The gm core struct is copied and passed as context to the runtime where it is 
- *	 used for planning, replanning, and reporting.
+ *	 used for planning, replanning, and reporting. The modes that seldom change are
+ *	 not copied with it - they are kept once in cm.modal[] and gm carries the index
+ *	 of its set. The model's own modes are in gmx.modal. Use cm_get_modal().
  *
  * - gmx is the extended gcode model variabales that are only used by the canonical 
  *	 machine and do not need to be passed further down.
@@ -142,39 +182,73 @@ typedef struct cmSingleton {		// struct to manage cm globals and cycles
  */
  typedef struct GCodeState {			// Gcode model state - used by model, planning and runtime
  	uint32_t linenum;					// Gcode block line number
-	uint8_t motion_mode;				// Group1: G0, G1, G2, G3, G38.2, G80, G81,
-										// G82, G83 G84, G85, G86, G87, G88, G89 
 	float target[AXES]; 				// XYZABC where the move should go
-	float work_offset[AXES];			// offset from the work coordinate system (for reporting only)
 
 	float move_time;					// optimal time for move given axis constraints
 	float minimum_time;					// minimum time possible for move given axis constraints
 	float feed_rate; 					// F - normalized to millimeters/minute
 	float spindle_speed;				// in RPM
 	float parameter;					// P - parameter used for dwell time in seconds, G10 coord select...
+	float path_tolerance;				// G64 P - corner blend tolerance in mm (0 = use axis junction deviations)
+	float curve_vmax;					// centripetal velocity limit of an arc segment line (0 = not one)
 
+	uint8_t motion_mode;				// Group1: G0, G1, G2, G3, G38.2, G80, G81,
+										// G82, G83 G84, G85, G86, G87, G88, G89, G73
 	uint8_t inverse_feed_rate_mode;		// G93 TRUE = inverse, FALSE = normal (G94)
-	uint8_t select_plane;				// G17,G18,G19 - values to set plane to
-	uint8_t units_mode;					// G20,G21 - 0=inches (G20), 1 = mm (G21)
-	uint8_t coord_system;				// G54-G59 - select coordinate system 1-9
+	uint8_t modal_set;					// index into cm.modal[] - see cm_get_modal_set()
+	uint8_t work_offset_set;			// offsets from the work coordinate system - index into cm.work_offset[] (for reporting only)
 	uint8_t absolute_override;			// G53 TRUE = move using machine coordinates - this block only (G53)
 	uint8_t path_control;				// G61... EXACT_PATH, EXACT_STOP, CONTINUOUS
-	uint8_t distance_mode;				// G91   0=use absolute coords(G90), 1=incremental movement
-	uint8_t tool;						// M6 tool change - moves "tool_select" to "tool"
-	uint8_t tool_select;				// T value - T sets this value
-	uint8_t mist_coolant;				// TRUE = mist on (M7), FALSE = off (M9)
-	uint8_t flood_coolant;				// TRUE = flood on (M8), FALSE = off (M9)
 	uint8_t spindle_mode;				// 0=OFF (M5), 1=CW (M3), 2=CCW (M4)
+	uint8_t raster;						// raster row move type - see raster.h
+	uint8_t curve_tangent;				// TRUE if an arc segment line continues the one before it
 
 } GCodeState_t;
 
+/*
+ * G68 rotation and G51 scaling are enabled by __COORD_TRANSFORM in tinyg2.h. They turn
+ * and size the programmed XYZ about a center in work coordinates, so one program can
+ * serve a fixture at any angle without being posted again:
+ *
+ *	G68 X Y R	rotate R degrees in the selected plane about X,Y (the plane's two axes),
+ *				axis 0 toward axis 1 - X to Y in G17, X to Z in G18, Y to Z in G19.
+ *				A missing center axis is the current position. G69 cancels
+ *	G51 X Y Z P	scale by P about X,Y,Z. I, J, K scale X, Y, Z on their own and P is
+ *				the factor for those not given. G50 cancels
+ *
+ * Scaling is applied first, then the rotation. Both are folded into one matrix and
+ * its inverse when a G68, G69, G51 or G50 runs, and cm_set_model_target() puts each
+ * block's XYZ through it once - the rest of the machine only sees the result. G53
+ * moves are not transformed. Arcs must stay circles: scaling in the arc's plane must
+ * be even, and a rotation must be in the arc's plane. Positions are reported in
+ * work coordinates as run, not as programmed. M2 and M30 cancel both.
+ */
+#ifdef __COORD_TRANSFORM
+typedef struct cmTransform {			// program XYZ to work XYZ: w = m.p + t
+	uint8_t active;						// TRUE if a rotation or a scaling is in effect
+	uint8_t rotation_axis_0;			// plane of the G68 rotation
+	uint8_t rotation_axis_1;
+	float rotation;						// G68 R in degrees, 0 if off
+	float rotation_center[3];			// G68 center in program coordinates (mm)
+	float scale[3];						// G51 XYZ factors, 1 if off
+	float scale_center[3];				// G51 center in program coordinates (mm)
+	float m[3][3];						// cached transform - see _set_transform()
+	float t[3];
+	float m_inv[3][3];					// and its inverse: p = m_inv.w + t_inv
+	float t_inv[3];
+} cmTransform_t;
+#endif
+
 typedef struct GCodeStateExtended {		// Gcode dynamic state extensions - used by model and arcs
 	uint16_t magic_start;				// magic number to test memory integity
 	uint8_t next_action;				// handles G modal group 1 moves & non-modals
 	uint8_t program_flow;				// used only by the gcode_parser
+	GCodeModal_t modal;					// modal state of the model - see cm_get_modal()
 
 	float position[AXES];				// XYZABC model position (Note: not used in gn or gf) 
 	float origin_offset[AXES];			// XYZABC G92 offsets (Note: not used in gn or gf)
+	float coord_offset[AXES];			// XYZABC cached G5x + G92 + G43 offsets - see cm_get_active_coord_offset()
+	float tool_offset;					// Z tool length offset of the tool table entry in use (G43)
 	float g28_position[AXES];			// XYZABC stored machine position for G28
 	float g30_position[AXES];			// XYZABC stored machine position for G30
 
@@ -184,6 +258,7 @@ typedef struct GCodeStateExtended {		// Gcode dynamic state extensions - used by
 	uint8_t	feed_rate_override_enable;	// TRUE = overrides enabled (M48), F=(M49)
 	uint8_t	traverse_override_enable;	// TRUE = traverse override enabled
 	uint8_t l_word;						// L word - used by G10s
+	uint8_t retract_mode;				// G98, G99 - canned cycle return level
 
 	uint8_t plane_axis_0;		 		// actual axes of the selected plane
 	uint8_t plane_axis_1;		 		// ...(used in gm only)
@@ -196,10 +271,13 @@ typedef struct GCodeStateExtended {		// Gcode dynamic state extensions - used by
 
 	float arc_radius;					// R - radius value in arc radius mode
 	float arc_offset[3];  				// IJK - used by arc commands
+	uint8_t tool_offset_entry;			// H - tool table entry of the tool length offset (0 is off)
+#ifdef __COORD_TRANSFORM
+	cmTransform_t transform;			// G68 rotation and G51 scaling
+#endif
 
 // unimplemented gcode parameters
 //	float cutter_radius;				// D - cutter radius compensation (0 is off)
-//	float cutter_length;				// H - cutter length compensation (0 is off)
 
 	uint16_t magic_end;
 
@@ -208,7 +286,7 @@ typedef struct GCodeStateExtended {		// Gcode dynamic state extensions - used by
 typedef struct GCodeInput {				// Gcode model inputs - meaning depends on context
 	uint8_t next_action;				// handles G modal group 1 moves & non-modals
 	uint8_t motion_mode;				// Group1: G0, G1, G2, G3, G38.2, G80, G81,
-										// G82, G83 G84, G85, G86, G87, G88, G89 
+										// G82, G83 G84, G85, G86, G87, G88, G89, G73
 	uint8_t program_flow;				// used only by the gcode_parser
 	uint32_t linenum;					// N word or autoincrement in the model
 
@@ -222,13 +300,16 @@ typedef struct GCodeInput {				// Gcode model inputs - meaning depends on contex
 	uint8_t	feed_rate_override_enable;	// TRUE = overrides enabled (M48), F=(M49)
 	uint8_t	traverse_override_enable;	// TRUE = traverse override enabled
 	uint8_t override_enables;			// enables for feed and spoindle (GN/GF only)
-	uint8_t l_word;						// L word - used by G10s
+	uint8_t l_word;						// L word - used by G10s and canned cycle repeats
+	uint8_t retract_mode;				// G98, G99 - canned cycle return level
 
 	uint8_t select_plane;				// G17,G18,G19 - values to set plane to
 	uint8_t units_mode;					// G20,G21 - 0=inches (G20), 1 = mm (G21)
 	uint8_t coord_system;				// G54-G59 - select coordinate system 1-9
 	uint8_t absolute_override;			// G53 TRUE = move using machine coordinates - this block only (G53)
 	uint8_t origin_offset_mode;			// G92...TRUE=in origin offset mode
+	uint8_t tool_offset_mode;			// G43 TRUE = tool length offset on, FALSE = off (G49)
+	uint8_t tool_offset_entry;			// H - tool table entry for G43 (the current tool if absent)
 	uint8_t path_control;				// G61... EXACT_PATH, EXACT_STOP, CONTINUOUS
 	uint8_t distance_mode;				// G91   0=use absolute coords(G90), 1=incremental movement
 
@@ -242,14 +323,18 @@ typedef struct GCodeInput {				// Gcode model inputs - meaning depends on contex
 	float spindle_speed;				// in RPM
 	float spindle_override_factor;		// 1.0000 x S spindle speed. Go up or down from there
 	uint8_t	spindle_override_enable;	// TRUE = override enabled
+#ifdef __SPINDLE_CSS
+	uint8_t css_mode;					// G96 TRUE = S is a surface speed, FALSE = S is RPM (G97)
+	float spindle_max;					// D - G96 maximum spindle speed in RPM
+#endif
 
 	float parameter;					// P - parameter used for dwell time in seconds, G10 coord select...
-	float arc_radius;					// R - radius value in arc radius mode
+	float arc_radius;					// R - radius value in arc radius mode, or canned cycle R plane
 	float arc_offset[3];  				// IJK - used by arc commands
+	float peck_increment;				// Q - canned cycle peck depth (G73, G83)
 
 // unimplemented gcode parameters
 //	float cutter_radius;				// D - cutter radius compensation (0 is off)
-//	float cutter_length;				// H - cutter length compensation (0 is off)
 
 } GCodeInput_t;
 
@@ -322,7 +407,10 @@ enum cmCycleState {
 	CYCLE_MACHINING,				// in normal machining cycle
 	CYCLE_PROBE,					// in probe cycle
 	CYCLE_HOMING,					// homing is treated as a specialized cycle
-	CYCLE_JOG						// jogging is treated as a specialized cycle
+	CYCLE_JOG,						// jogging is treated as a specialized cycle
+	CYCLE_STEP_QUEUE,				// host step schedules are treated as a specialized cycle
+	CYCLE_STRESS_TEST,				// the stepper stress test is treated as a specialized cycle
+	CYCLE_REPLAY					// a segment cache replay is treated as a specialized cycle
 };
 
 enum cmMotionState {
@@ -365,7 +453,11 @@ enum cmNextAction {						// these are in order to optimized CASE statement
 	NEXT_ACTION_SUSPEND_ORIGIN_OFFSETS,	// G92.2
 	NEXT_ACTION_RESUME_ORIGIN_OFFSETS,	// G92.3
 	NEXT_ACTION_DWELL,					// G4
-	NEXT_ACTION_STRAIGHT_PROBE			// G38.2
+	NEXT_ACTION_STRAIGHT_PROBE,			// G38.2
+	NEXT_ACTION_SET_ROTATION,			// G68
+	NEXT_ACTION_CANCEL_ROTATION,		// G69
+	NEXT_ACTION_SET_SCALING,			// G51
+	NEXT_ACTION_CANCEL_SCALING			// G50
 };
 
 enum cmMotionMode {						// G Modal Group 1
@@ -383,7 +475,16 @@ enum cmMotionMode {						// G Modal Group 1
 	MOTION_MODE_CANNED_CYCLE_86,		// G86 - boring, spindle stop, rapid out
 	MOTION_MODE_CANNED_CYCLE_87,		// G87 - back boring
 	MOTION_MODE_CANNED_CYCLE_88,		// G88 - boring, spindle stop, manual out
-	MOTION_MODE_CANNED_CYCLE_89			// G89 - boring, dwell, feed out
+	MOTION_MODE_CANNED_CYCLE_89,		// G89 - boring, dwell, feed out
+	MOTION_MODE_CANNED_CYCLE_73,		// G73 - peck drilling with chip breaking
+	MOTION_MODE_CUBIC_SPLINE,			// G5 - cubic spline feed
+	MOTION_MODE_QUADRATIC_SPLINE,		// G5.1 - quadratic spline feed
+	MOTION_MODE_SPINDLE_SYNC			// G33 - spindle synchronized motion (threading)
+};
+
+enum cmRetractMode {					// G Modal Group 9 - canned cycle return mode
+	RETRACT_INITIAL_LEVEL = 0,			// G98 - retract to the level the cycle started from
+	RETRACT_R_PLANE						// G99 - retract to the R plane
 };
 
 enum cmModalGroup {						// Used for detecting gcode errors. See NIST section 3.4
@@ -398,6 +499,7 @@ enum cmModalGroup {						// Used for detecting gcode errors. See NIST section 3.
 	MODAL_GROUP_G9,						// {G98,G99}			return mode in canned cycles
 	MODAL_GROUP_G12,					// {G54,G55,G56,G57,G58,G59} coordinate system selection
 	MODAL_GROUP_G13,					// {G61,G61.1,G64}		path control mode
+	MODAL_GROUP_G14,					// {G96,G97}			spindle speed mode
 	MODAL_GROUP_M4,						// {M0,M1,M2,M30,M60}	stopping
 	MODAL_GROUP_M6,						// {M6}					tool change
 	MODAL_GROUP_M7,						// {M3,M4,M5}			spindle turning
@@ -437,6 +539,13 @@ enum cmPathControlMode {			// G Modal Group 13
 	PATH_CONTINUOUS					// G64 and typically the default mode
 };
 
+enum cmRapidMode {					// $gtr - see cm_straight_traverse()
+	RAPID_COORDINATED = 0,			// G0 is one straight line - all axes arrive together
+	RAPID_DOGLEG					// G0 is a Z leg and a leg of the other axes, each at its own limits
+};
+
+#define CM_MOVE_BUFFERS 3			// most buffers one traverse or feed queues - a rotary wrap and two dogleg legs
+
 enum cmDistanceMode {
 	ABSOLUTE_MODE = 0,				// G90
 	INCREMENTAL_MODE				// G91
@@ -476,10 +585,12 @@ enum cmAxisMode {					// axis modes (ordered: see _cm_get_feed_time())
 	AXIS_DISABLED = 0,				// kill axis
 	AXIS_STANDARD,					// axis in coordinated motion w/standard behaviors
 	AXIS_INHIBITED,					// axis is computed but not activated
-	AXIS_RADIUS						// rotary axis calibrated to circumference
+	AXIS_RADIUS,					// rotary axis calibrated to circumference
+	AXIS_WRAP						// rotary axis in degrees modulo 360 - see cm_set_model_target()
 };	// ordering must be preserved. See cm_set_move_times()
 #define AXIS_MODE_MAX_LINEAR AXIS_INHIBITED
-#define AXIS_MODE_MAX_ROTARY AXIS_RADIUS
+#define AXIS_MODE_MAX_ROTARY AXIS_WRAP
+#define AXIS_WRAP_TURNS 10			// turns a wrapped axis makes before its position is taken back
 
 /*****************************************************************************
  * FUNCTION PROTOTYPES
@@ -516,6 +627,10 @@ void cm_set_absolute_override(GCodeState_t *gcode_state, uint8_t absolute_overri
 float cm_get_active_coord_offset(uint8_t axis);
 float cm_get_work_offset(GCodeState_t *gcode_state, uint8_t axis);
 void cm_set_work_offsets(GCodeState_t *gcode_state);
+uint8_t cm_get_work_offset_set(const float offset[]);
+uint8_t cm_get_work_offset_sets_free(void);
+GCodeModal_t *cm_get_modal(GCodeState_t *gcode_state);
+uint8_t cm_get_modal_set(const GCodeModal_t *modal);
 float cm_get_absolute_position(GCodeState_t *gcode_state, uint8_t axis);
 float cm_get_work_position(GCodeState_t *gcode_state, uint8_t axis);
 void cm_set_move_times(GCodeState_t *gcode_state);
@@ -525,6 +640,8 @@ void cm_set_model_arc_radius(float r);
 void cm_set_model_linenum(uint32_t linenum);
 void cm_set_model_target(float target[], float flag[]);
 void cm_conditional_set_model_position(stat_t status);
+void cm_set_soft_limits(void);
+stat_t cm_test_soft_limits(const float target[]);
 
 /*--- canonical machining functions (loosely patterned after NIST) ---*/
 
@@ -552,24 +669,48 @@ stat_t cm_probe_cycle_start(void);								// G38.2
 stat_t cm_probe_callback(void);									// G38.2 main loop callback
 int8_t cm_probe_get_axis(void);
 void cm_probe_set_position(float);
+stat_t cm_map_cycle_start(void);								// surface mapping - see kinematics.h
 
 stat_t cm_set_coord_system(uint8_t coord_system);				// G54 - G59
 stat_t cm_set_coord_offsets(uint8_t coord_system, float offset[], float flag[]); // G10 L2
 stat_t cm_set_distance_mode(uint8_t mode);						// G90, G91
+stat_t cm_set_retract_mode(uint8_t mode);						// G98, G99
+stat_t cm_set_tool_offset(uint8_t entry);						// G43 H, G49
 stat_t cm_set_origin_offsets(float offset[], float flag[]);		// G92
 stat_t cm_reset_origin_offsets(void); 							// G92.1
 stat_t cm_suspend_origin_offsets(void); 						// G92.2
 stat_t cm_resume_origin_offsets(void);				 			// G92.3
+#ifdef __COORD_TRANSFORM
+stat_t cm_set_rotation(float center[], float flag[], float angle, float angle_flag);	// G68
+stat_t cm_cancel_rotation(void);								// G69
+stat_t cm_set_scaling(float center[], float flag[], float factor[], float factor_flag[],
+					  float p, float p_flag);					// G51
+stat_t cm_cancel_scaling(void);									// G50
+stat_t cm_transform_arc(void);
+void cm_transform_vector(float v[]);
+#endif
 
 stat_t cm_straight_traverse(float target[], float flags[]);
 stat_t cm_set_feed_rate(float feed_rate);						// F parameter
 stat_t cm_set_inverse_feed_rate_mode(uint8_t mode);				// True= inv mode
 stat_t cm_set_path_control(uint8_t mode);						// G61, G61.1, G64
+stat_t cm_set_path_tolerance(float tolerance);					// G64 P
 stat_t cm_straight_feed(float target[], float flags[]);			// G1
 stat_t cm_arc_feed(float target[], float flags[], 				// G2, G3
 				   float i, float j, float k, 
 				   float radius, uint8_t motion_mode);
 stat_t cm_dwell(float seconds);									// G4, P parameter
+stat_t cm_canned_cycle(float target[], float flags[],			// G73, G81, G82, G83, G84
+					   float r_word, float r_flag, float q_word, float q_flag,
+					   float p_word, float p_flag, uint8_t repeats, uint8_t motion_mode);
+stat_t cm_canned_cycle_callback(void);							// canned cycle main loop callback
+void cm_abort_canned_cycle(void);
+stat_t cm_spline_feed(float target[], float flags[],			// G5, G5.1
+					  float i, float i_flag, float j, float j_flag,
+					  float p, float p_flag, float q, float q_flag, uint8_t motion_mode);
+stat_t cm_spline_callback(void);								// spline segment main loop callback
+void cm_abort_spline(void);
+stat_t cm_spindle_sync_feed(float target[], float flags[], float k, float k_flag);	// G33
 
 // see spindle.h for spindle definitions - which would go right here
 
@@ -625,17 +766,25 @@ stat_t cm_get_dist(cmdObj_t *cmd);		// get distance mode...
 stat_t cm_get_frmo(cmdObj_t *cmd);		// get feedrate mode...
 stat_t cm_get_toolv(cmdObj_t *cmd);		// get tool (value)
 stat_t cm_get_vel(cmdObj_t *cmd);		// get runtime velocity...
+stat_t cm_get_jet(cmdObj_t *cmd);		// get job elapsed time...
+stat_t cm_get_jrt(cmdObj_t *cmd);		// get job remaining time...
 stat_t cm_get_pos(cmdObj_t *cmd);		// get runtime work position...
 stat_t cm_get_mpo(cmdObj_t *cmd);		// get runtime machine position...
 stat_t cm_get_ofs(cmdObj_t *cmd);		// get runtime work offset...
 
 stat_t cm_run_qf(cmdObj_t *cmd);		// run queue flush
 stat_t cm_run_home(cmdObj_t *cmd);		// start homing cycle
+stat_t cm_run_map(cmdObj_t *cmd);		// start surface mapping cycle
 
 stat_t cm_get_am(cmdObj_t *cmd);		// get axis mode
 stat_t cm_set_am(cmdObj_t *cmd);		// set axis mode
 stat_t cm_get_jrk(cmdObj_t *cmd);		// get jerk with 1,000,000 correction
 stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
+stat_t cm_set_tm(cmdObj_t *cmd);		// set travel maximum (soft limit)
+stat_t cm_set_cofs(cmdObj_t *cmd);		// set coordinate system offset
+stat_t cm_set_tof(cmdObj_t *cmd);		// set tool table offset
+stat_t cm_set_mfo(cmdObj_t *cmd);		// set feed rate override factor
+stat_t cm_set_pea(cmdObj_t *cmd);		// set the pressure advance extruder axis
 
 /*--- text_mode support functions ---*/
 
@@ -643,12 +792,18 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 
 	void cm_print_vel(cmdObj_t *cmd);		// model state reporting
 	void cm_print_feed(cmdObj_t *cmd);
+	void cm_print_mfo(cmdObj_t *cmd);
 	void cm_print_line(cmdObj_t *cmd);
+	void cm_print_jet(cmdObj_t *cmd);
+	void cm_print_jrt(cmdObj_t *cmd);
 	void cm_print_stat(cmdObj_t *cmd);
 	void cm_print_macs(cmdObj_t *cmd);
 	void cm_print_cycs(cmdObj_t *cmd);
 	void cm_print_mots(cmdObj_t *cmd);
 	void cm_print_hold(cmdObj_t *cmd);
+	void cm_print_hlat(cmdObj_t *cmd);
+	void cm_print_hstp(cmdObj_t *cmd);
+	void cm_print_rlat(cmdObj_t *cmd);
 	void cm_print_home(cmdObj_t *cmd);
 	void cm_print_unit(cmdObj_t *cmd);
 	void cm_print_coor(cmdObj_t *cmd);
@@ -664,6 +819,7 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	void cm_print_gco(cmdObj_t *cmd);
 	void cm_print_gpa(cmdObj_t *cmd);
 	void cm_print_gdi(cmdObj_t *cmd);
+	void cm_print_gtr(cmdObj_t *cmd);
 
 	void cm_print_lin(cmdObj_t *cmd);		// generic print for linear values 
 	void cm_print_pos(cmdObj_t *cmd);		// print runtime work position in prevailing units
@@ -671,6 +827,11 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 
 	void cm_print_ja(cmdObj_t *cmd);		// global CM settings
 	void cm_print_ct(cmdObj_t *cmd);
+	void cm_print_lca(cmdObj_t *cmd);
+	void cm_print_lct(cmdObj_t *cmd);
+	void cm_print_prt(cmdObj_t *cmd);
+	void cm_print_pea(cmdObj_t *cmd);
+	void cm_print_pek(cmdObj_t *cmd);
 	void cm_print_ml(cmdObj_t *cmd);
 	void cm_print_ma(cmdObj_t *cmd);
 	void cm_print_ms(cmdObj_t *cmd);
@@ -683,6 +844,7 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	void cm_print_jm(cmdObj_t *cmd);
 	void cm_print_jh(cmdObj_t *cmd);
 	void cm_print_jd(cmdObj_t *cmd);
+	void cm_print_ac(cmdObj_t *cmd);
 	void cm_print_ra(cmdObj_t *cmd);
 	void cm_print_sn(cmdObj_t *cmd);
 	void cm_print_sx(cmdObj_t *cmd);
@@ -690,19 +852,29 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	void cm_print_lv(cmdObj_t *cmd);
 	void cm_print_lb(cmdObj_t *cmd);
 	void cm_print_zb(cmdObj_t *cmd);
+	void cm_print_hg(cmdObj_t *cmd);
+	void cm_print_sq(cmdObj_t *cmd);
+	void cm_print_bl(cmdObj_t *cmd);
 	void cm_print_cofs(cmdObj_t *cmd);
+	void cm_print_tof(cmdObj_t *cmd);
 	void cm_print_cpos(cmdObj_t *cmd);
 
 #else // __TEXT_MODE
 
 	#define cm_print_vel tx_print_stub		// model state reporting
 	#define cm_print_feed tx_print_stub
+	#define cm_print_mfo tx_print_stub
 	#define cm_print_line tx_print_stub
+	#define cm_print_jet tx_print_stub
+	#define cm_print_jrt tx_print_stub
 	#define cm_print_stat tx_print_stub
 	#define cm_print_macs tx_print_stub
 	#define cm_print_cycs tx_print_stub
 	#define cm_print_mots tx_print_stub
 	#define cm_print_hold tx_print_stub
+	#define cm_print_hlat tx_print_stub
+	#define cm_print_hstp tx_print_stub
+	#define cm_print_rlat tx_print_stub
 	#define cm_print_home tx_print_stub
 	#define cm_print_unit tx_print_stub
 	#define cm_print_coor tx_print_stub
@@ -718,6 +890,7 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	#define cm_print_gco tx_print_stub
 	#define cm_print_gpa tx_print_stub
 	#define cm_print_gdi tx_print_stub
+	#define cm_print_gtr tx_print_stub
 
 	#define cm_print_lin tx_print_stub		// generic print for linear values 
 	#define cm_print_pos tx_print_stub		// print runtime work position in prevailing units
@@ -725,6 +898,11 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 
 	#define cm_print_ja tx_print_stub		// global CM settings
 	#define cm_print_ct tx_print_stub
+	#define cm_print_lca tx_print_stub
+	#define cm_print_lct tx_print_stub
+	#define cm_print_prt tx_print_stub
+	#define cm_print_pea tx_print_stub
+	#define cm_print_pek tx_print_stub
 	#define cm_print_ml tx_print_stub
 	#define cm_print_ma tx_print_stub
 	#define cm_print_ms tx_print_stub
@@ -737,6 +915,7 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	#define cm_print_jm tx_print_stub
 	#define cm_print_jh tx_print_stub
 	#define cm_print_jd tx_print_stub
+	#define cm_print_ac tx_print_stub
 	#define cm_print_ra tx_print_stub
 	#define cm_print_sn tx_print_stub
 	#define cm_print_sx tx_print_stub
@@ -744,7 +923,11 @@ stat_t cm_set_jrk(cmdObj_t *cmd);		// set jerk with 1,000,000 correction
 	#define cm_print_lv tx_print_stub
 	#define cm_print_lb tx_print_stub
 	#define cm_print_zb tx_print_stub
+	#define cm_print_hg tx_print_stub
+	#define cm_print_sq tx_print_stub
+	#define cm_print_bl tx_print_stub
 	#define cm_print_cofs tx_print_stub
+	#define cm_print_tof tx_print_stub
 	#define cm_print_cpos tx_print_stub
 
 #endif // __TEXT_MODE
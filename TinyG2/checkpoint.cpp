@@ -0,0 +1,310 @@
+/*
+ * checkpoint.cpp - job checkpoints in flash for a resume after a power loss
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See checkpoint.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "stepper.h"
+#include "persistence.h"
+#include "util.h"
+#include "xio.h"
+#include "checkpoint.h"
+
+#ifdef __CHECKPOINT
+
+#include <stddef.h>						// offsetof()
+#include "MotateTimers.h"
+using Motate::SysTickTimer;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define CK_MAGIC 0x434C					// "CK" + 1 - the modal state moved out of the Gcode state
+
+ckSingleton_t ck;
+
+static union {							// record being written, padded out to a page
+	ckRecord_t rec;
+	uint32_t word[CK_PAGE_SIZE / sizeof(uint32_t)];
+} ck_page;
+
+#define _page_addr(p) ((ckRecord_t *)(CK_FLASH_ADDR + ((p) * CK_PAGE_SIZE)))
+#define _next_page(p) ((uint8_t)(((p) + 1) % CK_PAGES))
+
+static uint16_t _checksum(const ckRecord_t *rec)
+{
+	const uint16_t *w = (const uint16_t *)&rec->state;
+	uint16_t sum = 0;
+	for (uint16_t i=0; i < ((sizeof(ckRecord_t) - offsetof(ckRecord_t, state)) / sizeof(uint16_t)); i++) { sum += w[i];}
+	return (sum);
+}
+
+static uint8_t _record_is_valid(const ckRecord_t *rec)
+{
+	if (rec->magic != CK_MAGIC) return (false);
+	return ((rec->checksum == _checksum(rec)) ? true : false);
+}
+
+/*
+ * ck_init() - find the newest checkpoint and start the supply monitor
+ *
+ *	The ring is scanned for the valid record with the highest sequence number, and
+ *	the next record goes in the page after it. An erased ring reads as CK_NONE.
+ */
+void ck_init()
+{
+	uint8_t newest = CK_PAGES;
+	for (uint8_t p=0; p < CK_PAGES; p++) {
+		const ckRecord_t *rec = _page_addr(p);
+		if (_record_is_valid(rec) == false) continue;
+		if ((newest == CK_PAGES) || ((int32_t)(rec->sequence - _page_addr(newest)->sequence) > 0)) {
+			newest = p;
+		}
+	}
+	memset(&ck.last, 0, sizeof(ck.last));
+	ck.head = 0;
+	if (newest != CK_PAGES) {
+		ck.last = *_page_addr(newest);
+		ck.head = _next_page(newest);
+	}
+	ck.armed = false;
+	ck.power_failed = false;
+
+	SUPC->SUPC_SMMR = CK_SUPPLY_THRESHOLD | SUPC_SMMR_SMSMPL_CSM | SUPC_SMMR_SMIEN;
+	SUPC->SUPC_SR;								// clear any old detection
+	NVIC_SetPriority(SUPC_IRQn, 3);				// below the stepper interrupts
+	NVIC_EnableIRQ(SUPC_IRQn);
+}
+
+/*
+ * _write_record() - write a checkpoint of the runtime into the next page of the ring
+ *
+ *	The runtime position and Gcode state are copied with interrupts off so the exec
+ *	can't change them half way through. The head moves on even if the page fails to
+ *	program, so a worn page is skipped rather than written again.
+ */
+static stat_t _write_record(uint8_t state)
+{
+	for (uint8_t i=0; i < (CK_PAGE_SIZE / sizeof(uint32_t)); i++) { ck_page.word[i] = 0xFFFFFFFF;}
+	memset(&ck_page.rec, 0, sizeof(ckRecord_t));
+	ck_page.rec.sequence = ck.last.sequence + 1;
+	ck_page.rec.magic = CK_MAGIC;
+	ck_page.rec.state = state;
+	if (state != CK_NONE) {
+		__disable_irq();
+		copy_axis_vector(ck_page.rec.position, mr.position);
+		ck_page.rec.gm = mr.gm;
+		ck_page.rec.modal = *cm_get_modal(RUNTIME);
+		__enable_irq();
+		for (uint8_t axis=0; axis<AXES; axis++) {
+			if (cm.homed[axis] == true) { ck_page.rec.homed |= (1 << axis);}
+		}
+	}
+	ck_page.rec.checksum = _checksum(&ck_page.rec);
+
+	uint8_t page = ck.head;
+	ck.head = _next_page(ck.head);
+	ck.tick = SysTickTimer.getValue();
+	ritorno(write_flash_page((uint32_t)_page_addr(page), ck_page.word));
+	ck.last = ck_page.rec;
+	return (STAT_OK);
+}
+
+/*
+ * _write_checkpoint() - write a record from the main loop
+ *
+ *	The supply monitor interrupt is held off while the page is assembled and
+ *	programmed, as it writes from the same buffer. It runs as soon as this returns.
+ */
+static stat_t _write_checkpoint(uint8_t state)
+{
+	NVIC_DisableIRQ(SUPC_IRQn);
+	stat_t status = _write_record(state);
+	NVIC_EnableIRQ(SUPC_IRQn);
+	return (status);
+}
+
+/*
+ * SUPC_Handler() - supply monitor interrupt - write a final checkpoint as the power fails
+ *
+ *	The interrupt fires once. ck_callback() turns it back on if the supply recovers.
+ */
+void SUPC_Handler(void)
+{
+	SUPC->SUPC_SMMR &= ~SUPC_SMMR_SMIEN;
+	SUPC->SUPC_SR;
+	ck.power_failed = true;
+	if (ck.armed == false) return;
+	while ((EFC1->EEFC_FSR & EEFC_FSR_FRDY) == 0);	// let any other flash write finish
+	_write_record(CK_POWER_FAILED);
+	ck.armed = false;
+}
+
+/*
+ * ck_callback() - write checkpoints while a machining cycle runs
+ *
+ *	A running record is written when $ckt has passed and the line or the position
+ *	has moved on. Once a session has written one, a stopped or ended record is
+ *	written when the motors stop. A checkpoint left from before a reset is kept until
+ *	the next job starts moving.
+ */
+stat_t ck_callback()
+{
+	if (ck.power_failed == true) {
+		if ((SUPC->SUPC_SR & SUPC_SR_SMOS) != SUPC_SR_SMOS_HIGH) return (STAT_NOOP);
+		ck.power_failed = false;				// it was a dip - watch again
+		SUPC->SUPC_SMMR |= SUPC_SMMR_SMIEN;
+	}
+	if (fp_ZERO(ck.interval)) return (STAT_NOOP);
+
+	if ((cm.cycle_state == CYCLE_MACHINING) && (cm.motion_state == MOTION_RUN)) {
+		if ((SysTickTimer.getValue() - ck.tick) < (uint32_t)(ck.interval * 1000)) return (STAT_NOOP);
+		if ((ck.armed == true) && (ck.last.state == CK_RUNNING) && (mr.gm.linenum == ck.last.gm.linenum)) {
+			uint8_t moved = false;
+			for (uint8_t axis=0; axis<AXES; axis++) {
+				if (fp_NE(mr.position[axis], ck.last.position[axis])) { moved = true;}
+			}
+			if (moved == false) return (STAT_NOOP);
+		}
+		ck.armed = true;
+		return (_write_checkpoint(CK_RUNNING));
+	}
+	if ((ck.armed == false) || (stepper_isbusy() == true)) return (STAT_NOOP);
+	ck.armed = false;
+	return (_write_checkpoint((cm.machine_state == MACHINE_PROGRAM_END) ? CK_ENDED : CK_STOPPED));
+}
+
+/*
+ * ck_get_homed_position() - the machine position of an axis to fast re-home from
+ *
+ *	Returns true and the position if the newest record was written with the motors
+ *	stopped and the axis homed, and the axis hasn't been homed since the reset - after
+ *	that the record is older than the position the machine has.
+ */
+uint8_t ck_get_homed_position(const uint8_t axis, float *position)
+{
+	if ((ck.last.state != CK_STOPPED) && (ck.last.state != CK_ENDED)) return (false);
+	if (((ck.last.homed & (1 << axis)) == 0) || (cm.homed[axis] == true)) return (false);
+	*position = ck.last.position[axis];
+	return (true);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * ck_set_cks() - clear the checkpoint ({"cks":0})
+ * ck_get_ckp() - return the checkpoint position as [x,y,z,a,b,c] in mm
+ * ck_get_ckm() - return the checkpoint modal state as a Gcode block
+ *
+ *	The modal block leaves out the motion words of canned cycles and probes (a
+ *	resume starts them over with G80 in force), and the F word in inverse time mode.
+ */
+stat_t ck_set_cks(cmdObj_t *cmd)
+{
+	if (fp_NE(cmd->value, CK_NONE)) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	ck.armed = false;
+	return (_write_checkpoint(CK_NONE));
+}
+
+stat_t ck_get_ckp(cmdObj_t *cmd)
+{
+	char_t buf[80];
+	char_t *ptr = buf;
+
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		ptr += sprintf((char *)ptr, (axis == 0) ? "%0.3f" : ",%0.3f", ck.last.position[axis]);
+	}
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+static const char *const ck_motion[] = { "G0", "G1", "G2", "G3", "G80" };
+static const char *const ck_path[] = { "G61", "G61.1", "G64" };
+
+stat_t ck_get_ckm(cmdObj_t *cmd)
+{
+	char_t buf[80];
+	char_t *ptr = buf;
+	GCodeState_t *gcode = &ck.last.gm;
+	GCodeModal_t *modal = &ck.last.modal;
+
+	if (ck.last.state == CK_NONE) {
+		buf[0] = NUL;
+		return (cmd_copy_string(cmd, buf));
+	}
+	ptr += sprintf((char *)ptr, "G%d G%d", (modal->units_mode == INCHES) ? 20 : 21,
+		(modal->distance_mode == INCREMENTAL_MODE) ? 91 : 90);
+	if ((modal->coord_system >= G54) && (modal->coord_system <= COORD_SYSTEM_MAX)) {
+		ptr += sprintf((char *)ptr, " G%d", 53 + modal->coord_system);
+	}
+	ptr += sprintf((char *)ptr, " G%d %s G%d %s", 17 + min(modal->select_plane, CANON_PLANE_YZ),
+		ck_path[min(gcode->path_control, PATH_CONTINUOUS)], (gcode->inverse_feed_rate_mode == true) ? 93 : 94,
+		ck_motion[min(gcode->motion_mode, MOTION_MODE_CANCEL_MOTION_MODE)]);
+	if (gcode->inverse_feed_rate_mode == false) {
+		ptr += sprintf((char *)ptr, " F%0.3f", (modal->units_mode == INCHES) ? gcode->feed_rate * INCH_PER_MM : gcode->feed_rate);
+	}
+	if (gcode->spindle_mode != SPINDLE_OFF) {
+		ptr += sprintf((char *)ptr, " M%d S%0.0f", (gcode->spindle_mode == SPINDLE_CW) ? 3 : 4, gcode->spindle_speed);
+	}
+	ptr += sprintf((char *)ptr, " T%d", modal->tool);
+	if (modal->mist_coolant == true) { ptr += sprintf((char *)ptr, " M7");}
+	if (modal->flood_coolant == true) { ptr += sprintf((char *)ptr, " M8");}
+	return (cmd_copy_string(cmd, buf));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char msg_units0[] PROGMEM = " in";	// used by generic print functions
+static const char msg_units1[] PROGMEM = " mm";
+static const char msg_units2[] PROGMEM = " deg";
+static const char *const msg_units[] PROGMEM = { msg_units0, msg_units1, msg_units2 };
+
+static const char fmt_ckt[] PROGMEM = "[ckt] checkpoint interval%14.1f sec [0=off]\n";
+static const char fmt_ckh[] PROGMEM = "[ckh] fast re-home margin%14.3f%s [0=off]\n";
+static const char fmt_cks[] PROGMEM = "Checkpoint state:%8d [0=none,1=running,2=stopped,3=ended,4=power failed]\n";
+static const char fmt_ckl[] PROGMEM = "Checkpoint line:%9.0f\n";
+static const char fmt_ckp[] PROGMEM = "Checkpoint position: %s mm\n";
+static const char fmt_ckm[] PROGMEM = "Checkpoint modes: %s\n";
+
+void ck_print_ckt(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ckt);}
+void ck_print_ckh(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_ckh, GET_UNITS(ACTIVE_MODEL));}
+void ck_print_cks(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_cks);}
+void ck_print_ckl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ckl);}
+void ck_print_ckp(cmdObj_t *cmd) { fprintf_P(stderr, fmt_ckp, *cmd->stringp);}
+void ck_print_ckm(cmdObj_t *cmd) { text_print_str(cmd, fmt_ckm);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CHECKPOINT
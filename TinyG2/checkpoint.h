@@ -0,0 +1,154 @@
+/*
+ * checkpoint.h - job checkpoints in flash for a resume after a power loss
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Job checkpoints are enabled by __CHECKPOINT in tinyg2.h. While a machining cycle
+ * runs, the line number of the block in the runtime, the runtime position and the
+ * runtime Gcode state are written to flash every $ckt seconds, so after a power loss
+ * or a crash the host can find out where the job got to and resume it:
+ *
+ *	{"cks":""}	checkpoint state - 0=none, 1=running, 2=stopped, 3=ended, 4=power failed
+ *	{"ckl":""}	line number of the block that was running
+ *	{"ckp":""}	machine position [x,y,z,a,b,c] in mm
+ *	{"ckm":""}	modal state as a Gcode block, e.g. "G21 G90 G54 G17 G64 G94 G1 F1200 M3 S12000 T1 M8"
+ *	{"cks":0}	clear the checkpoint
+ *
+ * A resume is up to the host - home (or restore the position some other way), send
+ * the modal block, move clear of the work and down to the position, then send the job
+ * from line ckl. The line is the one being run as the record was written, so it is run
+ * again from its start. The position is where the runtime had got to, which is a
+ * segment (a few ms) ahead of the motors. State 1 means the job was still running at
+ * the last checkpoint, so the machine may have gone on for up to $ckt seconds after it.
+ * State 4 means the supply monitor caught the power failing and the record is final.
+ * States 2 and 3 are written once the motors stop - a hold, M0 or the queue running
+ * dry, and M2 or M30. A new job writes over the checkpoint of the last one, so read it
+ * before sending anything that moves.
+ *
+ * A record is written only if the line or the position has changed, and no more than
+ * every $ckt seconds ($ckt=0 turns checkpoints off). Each write holds the main loop for
+ * the few ms it takes to program a page, which the planner queue rides through. The
+ * records are a ring of CK_PAGES pages in flash bank 1 below the program store, taken
+ * out of "rom" in gcc_flash.ld with the rest. Each record goes to the next page, so the
+ * page holding the last good record is never the one being erased. Each has a sequence
+ * number and a checksum and the newest valid one wins, so a write cut off by the power
+ * dropping leaves the one before it. At one write a second the ring wears through the
+ * flash endurance of ~10,000 cycles in about 170 hours of cutting - set $ckt longer on
+ * a machine that runs all day.
+ *
+ * The supply monitor watches the 3.3V rail (VDDUTMI) and interrupts as it falls below
+ * CK_SUPPLY_THRESHOLD, which writes a final record if a job is running. Whether there
+ * is time for it depends on the hold-up of the board's supplies - it is a bonus on
+ * top of the timed checkpoints, not a replacement.
+ *
+ * Fast re-homing: with $ckh set, the first G28.2 after a reset starts from the
+ * position of a stopped or ended record (states 2 and 3) for each axis that was homed
+ * when it was written. The axis runs at its velocity max ($xvm) to $ckh mm short of
+ * where its switch should be, then searches at most 2 * $ckh for it and latches as
+ * usual. If the switch closes during the fast move, or isn't found in the short
+ * search, the group falls back to the full clear and search. $ckh must be more than
+ * the stopping distance of the fast move, as a switch hit early stops it with a hold.
+ * The machine must not have been moved by hand while it was off.
+ */
+
+#ifndef CHECKPOINT_H_ONCE
+#define CHECKPOINT_H_ONCE
+
+#include "canonical_machine.h"			// GCodeState_t
+#include "persistence.h"				// NVM_FLASH_ADDR
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __CHECKPOINT
+
+#define CK_PAGE_SIZE IFLASH1_PAGE_SIZE	// 256 bytes
+#define CK_PAGES 64						// pages in the ring (one 16Kb lock region)
+#define CK_FLASH_SIZE (CK_PAGES * CK_PAGE_SIZE)
+#define CK_FLASH_ADDR (NVM_FLASH_ADDR - (128 * 1024UL) - CK_FLASH_SIZE)	// below the program store
+#define CK_SUPPLY_THRESHOLD SUPC_SMMR_SMTH_3_0V	// supply monitor interrupts below this
+
+enum ckState {							// $cks
+	CK_NONE = 0,						// no checkpoint
+	CK_RUNNING,							// written while the job was running
+	CK_STOPPED,							// motion stopped - hold, M0 or out of blocks
+	CK_ENDED,							// program end - M2 or M30
+	CK_POWER_FAILED						// written by the supply monitor
+};
+
+typedef struct ckRecord {				// one page of the ring
+	uint32_t sequence;					// increments with every record written
+	uint16_t magic;						// CK_MAGIC
+	uint16_t checksum;					// sum of the words from state on
+	uint8_t state;						// see ckState
+	uint8_t homed;						// bit per axis homed as the record was written
+	uint8_t reserved[2];
+	float position[AXES];				// runtime machine position in mm
+	GCodeState_t gm;					// runtime Gcode state - line number, motion mode, feed...
+	GCodeModal_t modal;					// runtime modal state - units, plane, tool... (see cm_get_modal())
+} ckRecord_t;
+
+typedef struct ckSingleton {
+	float interval;						// $ckt - seconds between checkpoints (0=off)
+	float rehome_margin;				// $ckh - fast re-home stops this far short of the switch (0=off)
+	uint8_t head;						// next page to write
+	uint8_t armed;						// TRUE once this session has written a running record
+	volatile uint8_t power_failed;		// TRUE once the supply monitor has fired
+	uint32_t tick;						// SysTick of the last record written
+	ckRecord_t last;					// newest record - read back by the ck tokens
+} ckSingleton_t;
+
+extern ckSingleton_t ck;
+
+void ck_init(void);
+stat_t ck_callback(void);
+uint8_t ck_get_homed_position(const uint8_t axis, float *position);
+
+stat_t ck_set_cks(cmdObj_t *cmd);
+stat_t ck_get_ckp(cmdObj_t *cmd);
+stat_t ck_get_ckm(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void ck_print_ckt(cmdObj_t *cmd);
+	void ck_print_ckh(cmdObj_t *cmd);
+	void ck_print_cks(cmdObj_t *cmd);
+	void ck_print_ckl(cmdObj_t *cmd);
+	void ck_print_ckp(cmdObj_t *cmd);
+	void ck_print_ckm(cmdObj_t *cmd);
+#else
+	#define ck_print_ckt tx_print_stub
+	#define ck_print_ckh tx_print_stub
+	#define ck_print_cks tx_print_stub
+	#define ck_print_ckl tx_print_stub
+	#define ck_print_ckp tx_print_stub
+	#define ck_print_ckm tx_print_stub
+#endif
+
+#define CHECKPOINT_CALLBACK() ck_callback()
+
+#else
+
+#define CHECKPOINT_CALLBACK() (STAT_NOOP)
+
+#endif // __CHECKPOINT
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: CHECKPOINT_H_ONCE
@@ -39,6 +39,8 @@
 #include "help.h"
 #include "util.h"
 #include "xio.h"
+#include "persistence.h"
+#include "memguard.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -51,6 +53,13 @@ extern "C"{
 cmdStr_t cmdStr;
 cmdObj_t cmd_list[CMD_LIST_LEN];	// JSON header element
 
+static struct cmdTextList {			// text mode listing being sent - see get_grp()
+	index_t index;					// command the listing is for, or NO_MATCH
+	uint16_t count;					// children reached so far on this run of the line
+	uint16_t skip;					// children sent on earlier runs of the line
+	uint8_t cut;					// TRUE once the TX buffer filled on this run
+} tl = { NO_MATCH, 0, 0, false };
+
 /***********************************************************************************
  **** CODE *************************************************************************
  ***********************************************************************************/
@@ -103,39 +112,59 @@ void cmd_persist(cmdObj_t *cmd)
 void config_init()
 {
 	cmdObj_t *cmd = cmd_reset_list();
+	cmd_index_init();						// must precede any cmd_get_index() calls
 	cmdStr.magic_start = MAGICNUM;
 	cmdStr.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_CMD_STRING, cmdStr);
 	cfg.magic_start = MAGICNUM;
 	cfg.magic_end = MAGICNUM;
 
-//+++++ There is a chunk of code missing from here until persistence is implemented
-/*
+	cfg.comm_mode = JSON_MODE;				// initial value until NVM is read
 	cm_set_units_mode(MILLIMETERS);			// must do inits in MM mode
-	hw.nvm_base_addr = NVM_BASE_ADDR;
-	hw.nvm_profile_base = hw.nvm_base_addr;
+	persistence_init();
 	cmd->index = 0;							// this will read the first record in NVM
 
 	cmd_read_NVM_value(cmd);
-	if (cmd->value != cs.fw_build) {
+	if (cmd->value != (float)TINYG_FIRMWARE_BUILD) {// cs.fw_build is not set until controller_init()
 		cmd->value = true;					// case (1) NVM is not setup or not in revision
 		set_defaults(cmd);
 	} else {								// case (2) NVM is setup and in revision
 		rpt_print_loading_configs_message();
 		for (cmd->index=0; cmd_index_is_single(cmd->index); cmd->index++) {
 			if (GET_TABLE_BYTE(flags) & F_INITIALIZE) {
-				strcpy_P(cmd->token, cfgArray[cmd->index].token);	// read the token from the array
-				cmd_read_NVM_value(cmd);
-				cmd_set(cmd);
+				if (cmd_read_NVM_value(cmd) != STAT_OK) { continue;}	// cmd->value is stale
+				if (isnan(cmd->value)) { cmd->value = GET_TABLE_FLOAT(def_value);}	// item is not persisted
+				cmd_restore_value(cmd);
 			}
 		}
 		sr_init_status_report();
 	}
-*/
-// do this instead:
-	cfg.comm_mode = JSON_MODE;				// initial value until EEPROM is read
-//	persistence_init();
-	cmd->value = true;
-	set_defaults(cmd);	
+}
+
+/*
+ * cmd_restore_value() - put a value loaded from NVM into its target
+ *
+ *	Most items are set by one of the generic setters, which only store the value.
+ *	Those are stored directly - the value was validated when it was persisted and
+ *	the init runs in MM mode, so set_flu() is a plain store as well. Only items 
+ *	with their own set function (e.g. st_set_mi(), which recomputes the motor 
+ *	steps) go through cmd_set(), which also needs the token. Also used to apply a
+ *	config backup (see config_backup.h).
+ */
+void cmd_restore_value(cmdObj_t *cmd)
+{
+	fptrCmd set = (fptrCmd)GET_TABLE_WORD(set);
+
+	if ((set == set_flt) || (set == set_flu)) {
+		*((float *)GET_TABLE_WORD(target)) = cmd->value;
+	} else if ((set == set_ui8) || (set == set_01) || (set == set_012) || (set == set_0123)) {
+		*((uint8_t *)GET_TABLE_WORD(target)) = cmd->value;
+	} else if (set == set_int) {
+		*((uint32_t *)GET_TABLE_WORD(target)) = cmd->value;
+	} else if (set != set_nul) {
+		strcpy_P(cmd->token, cfgArray[cmd->index].token);
+		cmd_set(cmd);
+	}
 }
 
 /*
@@ -317,8 +346,18 @@ stat_t set_flu(cmdObj_t *cmd)
  *	to a TYPE_PARENT. The group field is left nul - as the group field refers to a parent 
  *	group, which this group has none.
  *
- *	All subsequent cmdObjs in the body will be populated with their values.
+ *	In JSON mode all subsequent cmdObjs in the body will be populated with their values.
  *	The token field will be populated as will the parent name in the group field. 
+ *	If the group won't fit in the body it returns STAT_BUFFER_FULL, leaving the last 
+ *	object free for the footer.
+ *
+ *	In text mode the children are streamed - each one is populated into the object after
+ *	the parent and printed straight away, so a group (or a $$ dump) never uses more than 
+ *	one cmdObj and one string. This returns STAT_COMPLETE so the caller doesn't print the 
+ *	group a second time. The group's output is held and sent together - see xio_tx_hold().
+ *	A listing stops when the TX buffer reaches its high watermark, so that write() does
+ *	not wait on the host. The controller runs the line again once the buffer drains, and
+ *	the children already sent are skipped - see cmd_text_list_start().
  *
  *	The sys group is an exception where the children carry a blank group field, even though 
  *	the sys parent is labeled as a TYPE_PARENT.
@@ -326,18 +365,67 @@ stat_t set_flu(cmdObj_t *cmd)
 
 stat_t get_grp(cmdObj_t *cmd)
 {
-	char_t *parent_group = cmd->token;		// token in the parent cmd object is the group
-	char_t group[CMD_GROUP_LEN+1];			// group string retrieved from cfgArray child
+	cmdGroupIter_t iter;
+	index_t index;
+
 	cmd->objtype = TYPE_PARENT;				// make first object the parent 
-	for (index_t i=0; cmd_index_is_single(i); i++) {
-		strcpy_P(group, cfgArray[i].group);  // don't need strncpy as it's always terminated
-		if (strcmp(parent_group, group) != 0) continue;
-		(++cmd)->index = i;
+	if (cmd_group_first(&iter, cmd->token) == false) return (STAT_OK); // token in the parent is the group
+
+	if (cfg.comm_mode == TEXT_MODE) {
+		cmdObj_t *child = cmd_next(cmd);
+		uint16_t wp = cmdStr.wp;			// each child's strings are released after it prints
+		xio_tx_hold();
+		while ((index = cmd_group_next(&iter)) != NO_MATCH) {
+			if (tl.cut == true) { break;}
+			if (tl.count++ < tl.skip) { continue;}	// sent on an earlier run of the line
+			if (xio_tx_throttled() == true) {		// no room - send the rest on the next run
+				tl.count--;
+				tl.cut = true;
+				break;
+			}
+			child->index = index;
+			cmd_get_cmdObj(child);
+			cmd_print(child);
+			cmdStr.wp = wp;
+		}
+		xio_tx_release();
+		cmd_reset_obj(child);
+		return (STAT_COMPLETE);
+	}
+	while ((index = cmd_group_next(&iter)) != NO_MATCH) {
+		if ((cmd->nx == false) || (cmd_next(cmd)->nx == false)) return (STAT_BUFFER_FULL);
+		(++cmd)->index = index;
 		cmd_get_cmdObj(cmd);
 	}
 	return (STAT_OK);
 }
 
+/*
+ * cmd_text_list_start() - start a text mode line that may print a listing
+ * cmd_text_list_end()	 - end it. Returns TRUE if the listing was cut short and the line must run again
+ *
+ *	A run of the same command after a cut skips the children sent before it. Any other
+ *	command, or a listing that finished, starts from the beginning.
+ */
+void cmd_text_list_start(index_t index)
+{
+	if (index != tl.index) { tl.skip = 0;}
+	tl.index = index;
+	tl.count = 0;
+	tl.cut = false;
+}
+
+uint8_t cmd_text_list_end()
+{
+	if (tl.cut == false) {
+		tl.index = NO_MATCH;
+		tl.skip = 0;
+		return (false);
+	}
+	tl.skip = tl.count;
+	return (true);
+}
+
 /*
  * set_grp() - get or set one or more values in a group
  *
@@ -352,7 +440,7 @@ stat_t set_grp(cmdObj_t *cmd)
 {
 	if (cfg.comm_mode == TEXT_MODE) return (STAT_UNRECOGNIZED_COMMAND);
 	for (uint8_t i=0; i<CMD_MAX_OBJECTS; i++) {
-		if ((cmd = cmd->nx) == NULL) break;
+		if ((cmd = cmd_next(cmd)) == NULL) break;
 		if (cmd->objtype == TYPE_EMPTY) break;
 		else if (cmd->objtype == TYPE_NULL)	// NULL means GET the value
 			cmd_get(cmd);
@@ -385,32 +473,96 @@ uint8_t cmd_group_is_prefixed(char_t *group)
  * cmdObj helper functions and other low-level cmd helpers
  */
 
+/* cmd_index_init() - build the token hash table and group lists
+ *
+ * cfgHash[] is an open addressed (linear probe) hash of the full tokens in cfgArray.
+ * If a token ever appears twice the earlier table entry is the one that is found.
+ *
+ * cfgGroupList[] holds the indexes of the children of each group in table order,
+ * and cfgGroupStart[] is where each group's children start. Group g runs from
+ * cfgGroupStart[g] up to cfgGroupStart[g+1], with g counted from the first group 
+ * entry. get_grp() uses these instead of scanning every single in the table.
+ *
+ * Both are built once at config_init(). cfgHash[] is sized from the table so it is
+ * at most half full. The table sizes are checked at compile time in config_app.cpp -
+ * cfgArray holds function pointers so the contents themselves can't be evaluated by
+ * the compiler.
+ */
+static index_t _hash_token(const char_t *token)
+{
+	uint32_t hash = 2166136261;					// FNV-1a - tokens are at most 5 chars
+	while (*token != NUL) { hash = (hash ^ (uint8_t)*token++) * 16777619;}
+	return ((hash ^ (hash >> 15)) & cfgHashMask);
+}
+
+void cmd_index_init()
+{
+	index_t index_max = cmd_index_max();
+
+	for (index_t h=0; h <= cfgHashMask; h++) { cfgHash[h] = NO_MATCH;}
+	for (index_t i=0; i < index_max; i++) {
+		index_t h = _hash_token(cfgArray[i].token);
+		while (cfgHash[h] != NO_MATCH) {
+			if (strcmp(cfgArray[cfgHash[h]].token, cfgArray[i].token) == 0) break;
+			h = (h+1) & cfgHashMask;
+		}
+		if (cfgHash[h] == NO_MATCH) cfgHash[h] = i;
+	}
+
+	index_t n = 0;
+	index_t group_count = cmd_index_count_groups();
+	for (index_t g=0; g < group_count; g++) {
+		const char_t *parent = cfgArray[cmd_index_start_groups() + g].token;
+		cfgGroupStart[g] = n;
+		for (index_t i=0; cmd_index_is_single(i); i++) {
+			if (strcmp(cfgArray[i].group, parent) == 0) cfgGroupList[n++] = i;
+		}
+	}
+	cfgGroupStart[group_count] = n;
+}
+
+/* cmd_group_first() - set up an iterator over the children of a group
+ * cmd_group_next()  - return the index of the next child, or NO_MATCH when done
+ *
+ * The children come back in table order from the lists built by cmd_index_init().
+ * cmd_group_first() returns false if the token is not a group.
+ */
+uint8_t cmd_group_first(cmdGroupIter_t *iter, const char_t *group)
+{
+	index_t index = cmd_get_index((const char_t *)"", group);
+	if (cmd_index_is_group(index) == false) {
+		iter->next = iter->end = 0;
+		return (false);
+	}
+	index -= cmd_index_start_groups();
+	iter->next = cfgGroupStart[index];
+	iter->end = cfgGroupStart[index+1];
+	return (true);
+}
+
+index_t cmd_group_next(cmdGroupIter_t *iter)
+{
+	if (iter->next >= iter->end) return (NO_MATCH);
+	return (cfgGroupList[iter->next++]);
+}
+
 /* cmd_get_index() - get index from mnenonic token + group
  *
- * cmd_get_index() is the most expensive routine in the whole config. It does a 
- * linear table scan of the PROGMEM strings, which of course could be further 
- * optimized with indexes or hashing.
+ * cmd_get_index() used to be the most expensive routine in the whole config as it 
+ * did a linear scan of the table. It's now a lookup in the cfgHash[] table built by
+ * cmd_index_init() - usually one or two string compares.
  */
 index_t cmd_get_index(const char_t *group, const char_t *token)
 {
-	char_t c;
 	char_t str[CMD_TOKEN_LEN+1];
 	strcpy(str, group);
 	strcat(str, token);
 
-	index_t index_max = cmd_index_max();
-
-	for (index_t i=0; i < index_max; i++) {
-		if ((c = GET_TOKEN_BYTE(token[0])) != str[0]) {	continue; }					// 1st character mismatch
-		if ((c = GET_TOKEN_BYTE(token[1])) == NUL) { if (str[1] == NUL) return(i);}	// one character match
-		if (c != str[1]) continue;													// 2nd character mismatch
-		if ((c = GET_TOKEN_BYTE(token[2])) == NUL) { if (str[2] == NUL) return(i);}	// two character match
-		if (c != str[2]) continue;													// 3rd character mismatch
-		if ((c = GET_TOKEN_BYTE(token[3])) == NUL) { if (str[3] == NUL) return(i);}	// three character match
-		if (c != str[3]) continue;													// 4th character mismatch
-		if ((c = GET_TOKEN_BYTE(token[4])) == NUL) { if (str[4] == NUL) return(i);}	// four character match
-		if (c != str[4]) continue;													// 5th character mismatch
-		return (i);																	// five character match
+	index_t i;
+	index_t h = _hash_token(str);
+	while ((i = cfgHash[h]) != NO_MATCH) {
+		if (strcmp(cfgArray[i].token, str) == 0) return (i);
+		h = (h+1) & cfgHashMask;
 	}
 	return (NO_MATCH);
 }
@@ -514,13 +666,13 @@ cmdObj_t *cmd_reset_obj(cmdObj_t *cmd)		// clear a single cmdObj structure
 	cmd->group[0] = NUL;
 	cmd->stringp = NULL;
 
-	if (cmd->pv == NULL) { 					// set depth correctly
+	if (cmd->pv == false) { 					// set depth correctly
 		cmd->depth = 0;
 	} else {
-		if (cmd->pv->objtype == TYPE_PARENT) { 
-			cmd->depth = cmd->pv->depth + 1;
+		if (cmd_prev(cmd)->objtype == TYPE_PARENT) { 
+			cmd->depth = cmd_prev(cmd)->depth + 1;
 		} else {
-			cmd->depth = cmd->pv->depth;
+			cmd->depth = cmd_prev(cmd)->depth;
 		}
 	}
 	return (cmd);							// return pointer to cmd as a convenience to callers
@@ -531,17 +683,17 @@ cmdObj_t *cmd_reset_list()					// clear the header and response body
 	cmdStr.wp = 0;							// reset the shared string
 	cmdObj_t *cmd = cmd_list;				// set up linked list and initialize elements	
 	for (uint8_t i=0; i<CMD_LIST_LEN; i++, cmd++) {
-		cmd->pv = (cmd-1);					// the ends are bogus & corrected later
-		cmd->nx = (cmd+1);
+		cmd->pv = true;					// the ends are bogus & corrected later
+		cmd->nx = true;
 		cmd->index = 0;
 		cmd->depth = 1;						// header and footer are corrected later
 		cmd->precision = 0;
 		cmd->objtype = TYPE_EMPTY;
 		cmd->token[0] = NUL;
 	}
-	(--cmd)->nx = NULL;
+	(--cmd)->nx = false;
 	cmd = cmd_list;							// setup response header element ('r')
-	cmd->pv = NULL;
+	cmd->pv = false;
 	cmd->depth = 0;
 	cmd->objtype = TYPE_PARENT;
 	strcpy(cmd->token, "r");
@@ -572,7 +724,7 @@ cmdObj_t *cmd_add_object(const char_t *token)  // add an object to the body usin
 	cmdObj_t *cmd = cmd_body;
 	for (uint8_t i=0; i<CMD_BODY_LEN; i++) {
 		if (cmd->objtype != TYPE_EMPTY) {
-			if ((cmd = cmd->nx) == NULL) return(NULL); // not supposed to find a NULL; here for safety
+			if ((cmd = cmd_next(cmd)) == NULL) return(NULL); // not supposed to find a NULL; here for safety
 			continue;
 		}
 		// load the index from the token or die trying
@@ -588,7 +740,7 @@ cmdObj_t *cmd_add_integer(const char_t *token, const uint32_t value)// add an in
 	cmdObj_t *cmd = cmd_body;
 	for (uint8_t i=0; i<CMD_BODY_LEN; i++) {
 		if (cmd->objtype != TYPE_EMPTY) {
-			if ((cmd = cmd->nx) == NULL) return(NULL); // not supposed to find a NULL; here for safety
+			if ((cmd = cmd_next(cmd)) == NULL) return(NULL); // not supposed to find a NULL; here for safety
 			continue;
 		}
 		strncpy(cmd->token, token, CMD_TOKEN_LEN);
@@ -604,7 +756,7 @@ cmdObj_t *cmd_add_float(const char_t *token, const float value)	// add a float o
 	cmdObj_t *cmd = cmd_body;
 	for (uint8_t i=0; i<CMD_BODY_LEN; i++) {
 		if (cmd->objtype != TYPE_EMPTY) {
-			if ((cmd = cmd->nx) == NULL) return(NULL);		// not supposed to find a NULL; here for safety
+			if ((cmd = cmd_next(cmd)) == NULL) return(NULL);		// not supposed to find a NULL; here for safety
 			continue;
 		}
 		strncpy(cmd->token, token, CMD_TOKEN_LEN);
@@ -620,7 +772,7 @@ cmdObj_t *cmd_add_string(const char_t *token, const char_t *string) // add a str
 	cmdObj_t *cmd = cmd_body;
 	for (uint8_t i=0; i<CMD_BODY_LEN; i++) {
 		if (cmd->objtype != TYPE_EMPTY) {
-			if ((cmd = cmd->nx) == NULL) return(NULL);		// not supposed to find a NULL; here for safety
+			if ((cmd = cmd_next(cmd)) == NULL) return(NULL);		// not supposed to find a NULL; here for safety
 			continue;
 		}
 		strncpy(cmd->token, token, CMD_TOKEN_LEN);
@@ -634,7 +786,7 @@ cmdObj_t *cmd_add_string(const char_t *token, const char_t *string) // add a str
 
 cmdObj_t *cmd_add_conditional_message(const char_t *string)	// conditionally add a message object to the body
 {
-	if ((cfg.comm_mode == JSON_MODE) && (js.echo_json_messages != true)) { return (NULL);}
+	if ((cfg.comm_mode != TEXT_MODE) && (js.echo_json_messages != true)) { return (NULL);}
 	return(cmd_add_string((const char_t *)"msg", string));
 }
 
@@ -655,7 +807,7 @@ cmdObj_t *cmd_add_conditional_message(const char_t *string)	// conditionally add
 
 void cmd_print_list(stat_t status, uint8_t text_flags, uint8_t json_flags)
 {
-	if (cfg.comm_mode == JSON_MODE) {
+	if (cfg.comm_mode != TEXT_MODE) {
 		json_print_list(status, json_flags);
 	} else {
 		text_print_list(status, text_flags);
@@ -679,7 +831,7 @@ stat_t cmd_read_NVM_value(cmdObj_t *cmd)
 	memcpy(&cmd->value, &nvm_byte_array, NVM_VALUE_LEN);
 #endif // __AVR
 #ifdef __ARM
-	//+++++ No ARM persistence yet
+	return (read_persistent_value(cmd));
 #endif // __ARM
 	return (STAT_OK);
 }
@@ -699,7 +851,7 @@ stat_t cmd_write_NVM_value(cmdObj_t *cmd)
 	}
 #endif // __AVR
 #ifdef __ARM
-	//+++++ No ARM persistence yet
+	return (write_persistent_value(cmd));
 #endif // __ARM
 	return (STAT_OK);
 }
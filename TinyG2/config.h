@@ -108,8 +108,8 @@ extern "C"{
 
 /**** cmdObj lists ****
  *
- * 	Commands and groups of commands are processed internally a doubly linked list of cmdObj_t 
- *	structures. This isolates the command and config internals from the details of communications,
+ * 	Commands and groups of commands are processed internally as a list of cmdObj_t structures
+ *	held in a contiguous array. This isolates the command and config internals from the details of communications,
  *	parsing and display in text mode and JSON mode.
  *
  *	The first element of the list is designated the response header element ("r") but the list 
@@ -117,8 +117,12 @@ extern "C"{
  *
  *	To use the cmd list first reset it by calling cmd_reset_list(). This initializes the header, 
  *	marks the the objects as TYPE_EMPTY (-1), resets the shared string, relinks all objects with 
- *	NX and PV pointers, and makes the last element the terminating element by setting its NX 
- *	pointer to NULL. The terminating element may carry data, and will be processed.
+ *	the NX and PV flags, and makes the last element the terminating element by clearing its NX 
+ *	flag. The terminating element may carry data, and will be processed.
+ *
+ *	The links are flags rather than pointers as the next and previous objects are always the
+ *	adjacent array elements. Use cmd_next() and cmd_prev() to follow them - both return NULL 
+ *	at the ends of the list. This keeps the objects small (28 bytes on the ARM, from 36).
  *
  *	When you use the list you can terminate your own last element, or just leave the EMPTY elements 
  *	to be skipped over during output serialization.
@@ -201,7 +205,7 @@ typedef uint16_t index_t;			// use this if there are > 255 indexed objects
 enum tgCommunicationsMode {
 	TEXT_MODE = 0,					// text command line mode
 	JSON_MODE,						// strict JSON construction
-	JSON_MODE_RELAXED				// relaxed JSON construction (future)
+	JSON_MODE_RELAXED				// relaxed JSON construction - bare names and strings (see json_parser.cpp)
 };
 
 enum flowControl {
@@ -240,12 +244,14 @@ enum objType {						// object / value typing for config and JSON
 #define F_INITIALIZE	0x01			// initialize this item (run set during initialization)
 #define F_PERSIST 		0x02			// persist this item when set is run
 #define F_NOSTRIP		0x04			// do not strip the group prefix from the token
+#define F_NOBATCH		0x08			// builds its own cmd list - can't run in a JSON batch
 #define _f00			0x00
 #define _fin			F_INITIALIZE
 #define _fpe			F_PERSIST
 #define _fip			(F_INITIALIZE | F_PERSIST)
 #define _fns			F_NOSTRIP
 #define _f07			(F_INITIALIZE | F_PERSIST | F_NOSTRIP)
+#define _fnb			F_NOBATCH
 
 /**** Structures ****/
 
@@ -258,20 +264,24 @@ typedef struct cmdString {				// shared string object
   #endif
 	char_t string[CMD_SHARED_STRING_LEN];
 	uint16_t magic_end;					// guard to detect string buffer underruns
+	MEMORY_GUARD
 } cmdStr_t;
 
 typedef struct cmdObject {				// depending on use, not all elements may be populated
-	struct cmdObject *pv;				// pointer to previous object or NULL if first object
-	struct cmdObject *nx;				// pointer to next object or NULL if last object
+	float value;						// numeric value
+	char_t (*stringp)[];				// pointer to array of characters from shared character array
 	index_t index;						// index of tokenized name, or -1 if no token (optional)
+	uint8_t pv;							// TRUE if linked to the previous object (false if first object)
+	uint8_t nx;							// TRUE if linked to the next object (false if last object)
 	int8_t depth;						// depth of object in the tree. 0 is root (-1 is invalid)
 	int8_t objtype;						// see objType enum
 	int8_t precision;					// decimal precision for reporting (JSON)
-	float value;						// numeric value
 	char_t token[CMD_TOKEN_LEN+1];		// full mnemonic token for lookup
 	char_t group[CMD_GROUP_LEN+1];		// group prefix or NUL if not in a group
-	char_t (*stringp)[];				// pointer to array of characters from shared character array
-} cmdObj_t; 							// OK, so it's not REALLY an object
+} cmdObj_t; 							// OK, so it's not REALLY an object (fields ordered to pack)
+
+#define cmd_next(cmd) (((cmd)->nx == true) ? ((cmd)+1) : NULL)	// next object or NULL
+#define cmd_prev(cmd) (((cmd)->pv == true) ? ((cmd)-1) : NULL)	// previous object or NULL
 
 typedef uint8_t (*fptrCmd)(cmdObj_t *cmd);// required for cmd table access
 typedef void (*fptrPrint)(cmdObj_t *cmd);// required for PROGMEM access
@@ -294,6 +304,15 @@ typedef struct cfgItem {
 extern cmdStr_t cmdStr;
 extern cmdObj_t cmd_list[];
 extern const cfgItem_t cfgArray[];
+extern index_t cfgHash[];				// token hash table - see cmd_index_init()
+extern const index_t cfgHashMask;		// slots in cfgHash[] - 1
+extern index_t cfgGroupList[];			// group member indexes, grouped by parent
+extern index_t cfgGroupStart[];			// start of each group's members in cfgGroupList[]
+
+typedef struct cmdGroupIter {			// iterator over the children of a group - see cmd_group_first()
+	index_t next;						// next position in cfgGroupList[]
+	index_t end;						// one past the last position for the group
+} cmdGroupIter_t;
 
 #define cmd_header cmd_list
 #define cmd_body  (cmd_list+1)
@@ -312,7 +331,9 @@ void cmd_persist(cmdObj_t *cmd);		// main entry point for persistence
 // helpers
 uint8_t cmd_get_type(cmdObj_t *cmd);
 stat_t cmd_persist_offsets(uint8_t flag);
+void cmd_restore_value(cmdObj_t *cmd);
 
+void cmd_index_init(void);
 index_t cmd_get_index(const char_t *group, const char_t *token);
 index_t	cmd_index_max(void);
 uint8_t cmd_index_lt_max(index_t index);
@@ -320,7 +341,13 @@ uint8_t cmd_index_ge_max(index_t index);
 uint8_t cmd_index_is_single(index_t index);
 uint8_t cmd_index_is_group(index_t index);
 uint8_t cmd_index_lt_groups(index_t index);
+index_t cmd_index_start_groups(void);
+index_t cmd_index_count_groups(void);
 uint8_t cmd_group_is_prefixed(char_t *group);
+uint8_t cmd_group_first(cmdGroupIter_t *iter, const char_t *group);
+index_t cmd_group_next(cmdGroupIter_t *iter);
+void cmd_text_list_start(index_t index);
+uint8_t cmd_text_list_end(void);
 
 // generic internal functions and accessors
 stat_t set_nul(cmdObj_t *cmd);		// set nothing (no operation)
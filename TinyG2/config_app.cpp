@@ -35,6 +35,7 @@
 #include "settings.h"
 #include "planner.h"
 #include "stepper.h"
+#include "kinematics.h"
 #include "switch.h"
 //#include "pwm.h"
 #include "report.h"
@@ -42,8 +43,33 @@
 //#include "test.h"
 #include "util.h"
 #include "help.h"
+#include "persistence.h"
 //#include "network.h"
 #include "xio.h"
+#include "latency.h"
+#include "frame.h"
+#include "profiler.h"
+#include "trace.h"
+#include "raster.h"
+#include "pso.h"
+#include "sync.h"
+#include "stepcap.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "shaper.h"
+#include "tmc2660.h"
+#include "encoder.h"
+#include "adc.h"
+#include "program_store.h"
+#include "binary_stream.h"
+#include "stepq.h"
+#include "stress.h"
+#include "swo.h"
+#include "uart.h"
+#include "replay.h"
+#include "machine_profile.h"
+#include "config_backup.h"
+#include "selfbench.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -72,6 +98,7 @@ static stat_t _do_all(cmdObj_t *cmd);		// print all parameters
 //static stat_t set_ec(cmdObj_t *cmd);		// expand CRLF on TX output
 //static stat_t set_ee(cmdObj_t *cmd);		// enable character echo
 //static stat_t set_ex(cmdObj_t *cmd);		// enable XON/XOFF and RTS/CTS flow control
+static stat_t get_rx(cmdObj_t *cmd);		// get RX line credits
 //static stat_t set_baud(cmdObj_t *cmd);		// set USB baud rate
 //static stat_t get_rx(cmdObj_t *cmd);		// get bytes in RX buffer
 //static stat_t run_sx(cmdObj_t *cmd);		// send XOFF, XON
@@ -101,18 +128,25 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "sys", "fv", _f07, 3, hw_print_fv, get_flt,   set_nul,  (float *)&cs.fw_version, TINYG_FIRMWARE_VERSION },
 	{ "sys", "hp", _f07, 0, hw_print_hp, get_flt,   set_flt,  (float *)&cs.hw_platform,TINYG_HARDWARE_PLATFORM },
 	{ "sys", "hv", _f07, 0, hw_print_hv, get_flt,   hw_set_hv,(float *)&cs.hw_version, TINYG_HARDWARE_VERSION },
+	{ "",  "boot", _f00, 0, rpt_print_boot, rpt_get_boot, set_nul, (float *)&cs.null, 0 },	// boot phase times
 //	{ "sys", "id", _fns, 0, hw_print_id, hw_get_id, set_nul,  (float *)&cs.null, 0 },  // device ID (ASCII signature)
 
 	// dynamic model attributes for reporting purposes (up front for speed)
 	{ "",   "n",   _fin, 0, cm_print_line, cm_get_mline,set_int,(float *)&gm.linenum,0 },// Model line number
 	{ "",   "line",_fin, 0, cm_print_line, cm_get_line, set_int,(float *)&gm.linenum,0 },// Active line number - model or runtime line number
 	{ "",   "vel", _f00, 2, cm_print_vel,  cm_get_vel,  set_nul,(float *)&cs.null, 0 },	// current velocity
+	{ "",   "jet", _f00, 1, cm_print_jet,  cm_get_jet,  set_nul,(float *)&cs.null, 0 },	// job elapsed time
+	{ "",   "jrt", _f00, 1, cm_print_jrt,  cm_get_jrt,  set_nul,(float *)&cs.null, 0 },	// job remaining time
 	{ "",   "feed",_f00, 2, cm_print_feed, get_flu,  	set_nul,(float *)&cs.null, 0 },	// feed rate
+	{ "",   "mfo", _f00, 3, cm_print_mfo,  get_flt,  	cm_set_mfo,(float *)&mm.feed_override, 1 },	// feed rate override factor
 	{ "",   "stat",_f00, 0, cm_print_stat, cm_get_stat, set_nul,(float *)&cs.null, 0 },	// combined machine state
 	{ "",   "macs",_f00, 0, cm_print_macs, cm_get_macs, set_nul,(float *)&cs.null, 0 },	// raw machine state
 	{ "",   "cycs",_f00, 0, cm_print_cycs, cm_get_cycs, set_nul,(float *)&cs.null, 0 },	// cycle state
 	{ "",   "mots",_f00, 0, cm_print_mots, cm_get_mots, set_nul,(float *)&cs.null, 0 },	// motion state
 	{ "",   "hold",_f00, 0, cm_print_hold, cm_get_hold, set_nul,(float *)&cs.null, 0 },	// feedhold state
+	{ "",   "hlat",_f00, 0, cm_print_hlat, get_flt,     set_nul,(float *)&mm.hold_latency, 0 },	// last hold planning latency
+	{ "",   "hstp",_f00, 0, cm_print_hstp, get_flt,     set_nul,(float *)&mm.hold_stop_time, 0 },// last hold stop time
+	{ "",   "rlat",_f00, 0, cm_print_rlat, get_flt,     set_nul,(float *)&mm.resume_latency, 0 },// last resume latency
 	{ "",   "unit",_f00, 0, cm_print_unit, cm_get_unit, set_nul,(float *)&cs.null, 0 },	// units mode
 	{ "",   "coor",_f00, 0, cm_print_coor, cm_get_coor, set_nul,(float *)&cs.null, 0 },	// coordinate system
 	{ "",   "momo",_f00, 0, cm_print_momo, cm_get_momo, set_nul,(float *)&cs.null, 0 },	// motion mode
@@ -152,19 +186,137 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "hom","homb",_f00, 0, cm_print_pos, get_ui8, set_nul,(float *)&cm.homed[AXIS_B], false },// B homed
 	{ "hom","homc",_f00, 0, cm_print_pos, get_ui8, set_nul,(float *)&cm.homed[AXIS_C], false },// C homed
 
+	{ "prb","prbx",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_X], 0 },	// X probe position
+	{ "prb","prby",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_Y], 0 },
+	{ "prb","prbz",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_Z], 0 },
+	{ "prb","prba",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_A], 0 },
+	{ "prb","prbb",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_B], 0 },
+	{ "prb","prbc",_f00, 3, cm_print_mpo, get_flt, set_nul,(float *)&cm.probe_position[AXIS_C], 0 },
+
 	// Reports, tests, help, and messages
-	{ "", "sr",  _f00, 0, sr_print_sr,  sr_get,  sr_set,   (float *)&cs.null, 0 },	// status report object
+	{ "", "sr",  _fnb, 0, sr_print_sr,  sr_get,  sr_set,   (float *)&cs.null, 0 },	// status report object
+	{ "", "sg1", _fnb, 0, tx_print_nul, sr_get_sg, sr_set_sg, (float *)&cs.null, 0 },	// status report subscription groups
+	{ "", "sg2", _fnb, 0, tx_print_nul, sr_get_sg, sr_set_sg, (float *)&cs.null, 0 },
+	{ "", "sg3", _fnb, 0, tx_print_nul, sr_get_sg, sr_set_sg, (float *)&cs.null, 0 },
+	{ "", "sg1i",_f00, 0, tx_print_int, get_int, sr_set_sgi, (float *)&sr.group[0].interval, 0 },	// ms between group reports, 0 = on change
+	{ "", "sg2i",_f00, 0, tx_print_int, get_int, sr_set_sgi, (float *)&sr.group[1].interval, 0 },
+	{ "", "sg3i",_f00, 0, tx_print_int, get_int, sr_set_sgi, (float *)&sr.group[2].interval, 0 },
 //	{ "", "qri", _f00, 0, qr_print_qr,  qr_get_i,set_nul,  (float *)&cs.null, 0 },	// queue report - blocks in
 //	{ "", "qro", _f00, 0, qr_print_qr,  qr_get_o,set_nul,  (float *)&cs.null, 0 },	// queue report - block out
 	{ "", "qr",  _f00, 0, qr_print_qr,  qr_get,  set_nul,  (float *)&cs.null, 0 },	// queue report
+	{ "", "pq",  _f00, 0, pq_print_pq,  pq_get,  set_nul,  (float *)&cs.null, 0 },	// planner queue dump
+	{ "", "lef", _f00, 0, tx_print_int, le_get_lef,le_set_lef,(float *)&cs.null, 0 },	// flag a line for a line event
+	{ "", "lel", _f00, 0, tx_print_int, get_int, set_nul,  (float *)&le.lost, 0 },	// line events lost with the ring full
+	{ "", "qt",  _f00, 0, qr_print_qt,  qr_get_qt,set_nul, (float *)&cs.null, 0 },	// ms of motion queued
+	{ "", "qs",  _f00, 0, qr_print_qs,  qr_get_qs,set_nul, (float *)&cs.null, 0 },	// planner starvation flag
+	{ "", "psr", _f00, 0, tx_print_nul, get_nul, mp_run_reset_stats,(float *)&cs.null, 0 },	// reset planner stats
+	{ "ps","psstv",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mps.starved_exits, 0 },	// starved zero exits
+	{ "ps","psgap",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mps.dda_gaps, 0 },		// DDA idle gaps
+	{ "ps","psbuf",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mps.buffers_min, 0 },	// min buffers available
+	{ "ps","psnm", _f00, 0, tx_print_int, get_int, set_nul,(float *)&mps.exec_near_misses, 0 },// exec near misses
+	{ "ps","psmar",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mps.exec_margin_min, 0 },	// min exec margin (usec)
+	{ "js","jshed",_f00, 2, tx_print_flt, mp_get_job_seconds, set_nul,(float *)&mpj.section_usec[0], 0 },	// seconds in heads
+	{ "js","jsbod",_f00, 2, tx_print_flt, mp_get_job_seconds, set_nul,(float *)&mpj.section_usec[1], 0 },	// seconds in bodies
+	{ "js","jstal",_f00, 2, tx_print_flt, mp_get_job_seconds, set_nul,(float *)&mpj.section_usec[2], 0 },	// seconds in tails
+	{ "js","jsstp",_f00, 2, tx_print_flt, mp_get_job_seconds, set_nul,(float *)&mpj.stop_usec, 0 },	// seconds stopped between blocks
+	{ "js","jsnst",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.stops, 0 },				// stops between blocks
+	{ "js","jsblk",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.blocks, 0 },				// blocks run
+	{ "js","jslal",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.lookahead_limited, 0 },	// cruise below vmax
+	{ "js","jsfdl",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.feed_limited, 0 },		// cruise at vmax
+	{ "js","jsarc",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.arc_segments, 0 },		// chords run along arcs
+	{ "js","jsslk",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.exec_slack_min, 0 },	// min exec slack (usec)
+	{ "js","jsexm",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.exec_usec_max, 0 },	// max exec time (usec)
+	{ "js","jslat",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mpj.exec_late, 0 },		// late exec segments
+	{ "mem","memst",_f00, 0, tx_print_int, mem_get, set_nul,(float *)&mem.stack_used, 0 },	// stack high water mark (bytes)
+	{ "mem","memfr",_f00, 0, tx_print_int, mem_get, set_nul,(float *)&mem.free_min, 0 },		// least free RAM
+	{ "mem","memhp",_f00, 0, tx_print_int, mem_get, set_nul,(float *)&mem.heap, 0 },			// heap in use
+	{ "mem","memda",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.data, 0 },			// static data and bss
+	{ "mem","memmb",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.planner_pool, 0 },	// planner buffer pool
+	{ "mem","membf",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.planner_buffer, 0 },	// per planner buffer
+	{ "mem","memcl",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.cmd_list, 0 },		// cmd list
+	{ "mem","memcs",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.cmd_string, 0 },		// shared cmd string
+	{ "mem","memxb",_f00, 0, tx_print_int, get_int, set_nul,(float *)&mem.xio_buffers, 0 },	// USB buffers
 	{ "", "er",  _f00, 0, tx_print_nul, rpt_er,  set_nul,  (float *)&cs.null, 0 },	// invoke bogus exception report for testing
+	{ "", "erl", _f00, 0, tx_print_int, get_int, set_nul,  (float *)&er.lost, 0 },	// exception reports lost with the ring full
 	{ "", "qf",  _f00, 0, tx_print_nul, get_nul, cm_run_qf,(float *)&cs.null, 0 },	// queue flush
-//	{ "", "rx",  _f00, 0, tx_print_int, get_rx,  set_nul,  (float *)&cs.null, 0 },	// space in RX buffer
+	{ "", "rx",  _f00, 0, tx_print_int, get_rx,  set_nul,  (float *)&cs.null, 0 },	// RX line credits
+#ifdef __LINE_FRAMING
+	// Line framing - see frame.h
+	{ "", "lfm", _fin, 0, tx_print_ui8, get_ui8, fr_set_lfm,(float *)&fr.mode, LINE_FRAMING_MODE },	// 1 = lines from USB are framed
+	{ "", "lfs", _f00, 0, tx_print_int, get_int, fr_set_lfs,(float *)&fr.expected, 0 },	// next sequence number
+	{ "", "lfe", _f00, 0, tx_print_int, get_int, set_nul,  (float *)&fr.dropped, 0 },	// lines dropped
+#endif
 	{ "", "msg", _f00, 0, tx_print_str, get_nul, set_nul,  (float *)&cs.null, 0 },	// string for generic messages
 //	{ "", "sx",  _f00, 0, tx_print_nul, run_sx,  run_sx ,  (float *)&cs.null, 0 },	// send XOFF, XON test
+#ifdef __MOTION_TRACE
+	// Motion trace - see trace.h
+	{ "", "mte", _f00, 0, tx_print_ui8, get_ui8, mt_set_mode,(float *)&mt.mode, 0 },	// trace mode
+	{ "", "mtd", _f00, 0, tx_print_int, mt_get_download, set_nul,(float *)&cs.null, 0 },	// download the trace
+#endif
+#ifdef __STEP_CAPTURE
+	// Step timing capture - see stepcap.h
+	{ "", "sce", _f00, 0, tx_print_ui8, get_ui8, sc_set_mode,(float *)&sc.mode, 0 },	// capture on/off - on clears the results
+	{ "", "scj", _f00, 0, sc_print_scj, sc_get_jitter, set_nul,(float *)&cs.null, 0 },	// step jitter in nSec
+	{ "", "sch", _f00, 0, sc_print_sch, sc_get_histogram, set_nul,(float *)&cs.null, 0 },	// step jitter histogram
+#endif
+#ifdef __PROFILER
+	// Profiler - see profiler.h
+	{ "", "pfr",  _f00, 0, tx_print_nul, get_nul, pf_run_reset,(float *)&cs.null, 0 },	// reset all profile points
+	{ "pf","pfhsm",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_HSM], 0 },	// one pass of the controller
+	{ "pf","pfhrd",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_HARD_RESET], 0 },	// controller tasks in dispatch order
+	{ "pf","pfer", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_EXCEPTION], 0 },
+	{ "pf","pfalm",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_ALARM], 0 },
+	{ "pf","pflim",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_LIMIT], 0 },
+	{ "pf","pfrx", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_RX], 0 },
+	{ "pf","pftx", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_TX], 0 },
+	{ "pf","pffhs",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_FEEDHOLD], 0 },
+	{ "pf","pfhld",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PLAN_HOLD], 0 },
+	{ "pf","pfovr",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PLAN_OVERRIDE], 0 },
+	{ "pf","pftrp",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PLAN_TRAPEZOID], 0 },
+	{ "pf","pfast",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_ASSERTIONS], 0 },
+	{ "pf","pfmpw",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_MOTOR_POWER], 0 },
+	{ "pf","pfspn",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_SPINDLE], 0 },
+	{ "pf","pfckp",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_CHECKPOINT], 0 },
+	{ "pf","pfldf",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_LOAD_FEED], 0 },
+	{ "pf","pfdrv",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_MOTOR_DRIVERS], 0 },
+	{ "pf","pfsr", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_STATUS_REPORT], 0 },
+	{ "pf","pfqr", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_QUEUE_REPORT], 0 },
+	{ "pf","pfjr", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_JOB_REPORT], 0 },
+	{ "pf","pfpq", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PLAN_DUMP], 0 },
+	{ "pf","pfle", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_LINE_EVENT], 0 },
+	{ "pf","pfcoa",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_COALESCE], 0 },
+	{ "pf","pfarc",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_ARC], 0 },
+	{ "pf","pfcyc",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_CANNED_CYCLE], 0 },
+	{ "pf","pfspl",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_SPLINE], 0 },
+	{ "pf","pfjog",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_JOG], 0 },
+	{ "pf","pfsx", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_STRESS], 0 },
+	{ "pf","pfrp", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_REPLAY], 0 },
+	{ "pf","pfsb", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_SELF_BENCH], 0 },
+	{ "pf","pfhom",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_HOMING], 0 },
+	{ "pf","pfprb",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PROBE], 0 },
+	{ "pf","pfnvm",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_PERSISTENCE], 0 },
+	{ "pf","pfstx",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_SYNC_TX], 0 },
+	{ "pf","pfgcq",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_GCODE_QUEUE], 0 },
+	{ "pf","pfbin",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_BINARY_STREAM], 0 },
+	{ "pf","pfcmd",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_COMMAND], 0 },
+	{ "pf","pfidl",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_IDLER], 0 },
+	{ "pf","pfdda",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_DDA_ISR], 0 },	// interrupts
+	{ "pf","pfexe",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_EXEC_ISR], 0 },
+	{ "pf","pfld", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_LOAD_ISR], 0 },
+	{ "pf","pfdwl",_f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_DWELL_ISR], 0 },
+	{ "pf","pfsw", _f00, 0, pf_print_point, pf_get_point, set_nul,(float *)&pf.point[PF_SWITCH_ISR], 0 },
+#endif
+
+#ifdef __LATENCY_TEST
+	// Latency and throughput tests - see latency.h
+	{ "", "ping",_f00, 0, lt_print_ping, lt_get_ping, lt_set_ping,(float *)&cs.null, 0 },	// timestamps of this line
+	{ "", "tpi", _f00, 0, tx_print_nul, get_nul, lt_set_tpi,(float *)&cs.null, 0 },	// sink n megabytes from the host
+	{ "", "tpo", _f00, 0, tx_print_nul, get_nul, lt_set_tpo,(float *)&cs.null, 0 },	// source n megabytes to the host
+	{ "", "tpr", _f00, 0, lt_print_tpr, lt_get_tpr, set_nul,(float *)&cs.null, 0 },	// last throughput result
+#endif
 
 #ifdef __HELP_SCREENS
-	{ "", "defa",_f00, 0, tx_print_nul, help_defa,		 set_defaults,(float *)&cs.null,0 },	// set/print defaults / help screen
+	{ "", "defa",_fnb, 0, tx_print_nul, help_defa,		 set_defaults,(float *)&cs.null,0 },	// set/print defaults / help screen
 //	{ "", "test",_f00, 0, tx_print_nul, help_test,		 run_test, 	  (float *)&cs.null,0 },	// run tests, print test help screen
 //	{ "", "boot",_f00, 0, tx_print_nul, help_boot_loader,hw_run_boot, (float *)&cs.null,0 },
 	{ "", "help",_f00, 0, tx_print_nul, help_config,	 set_nul, 	  (float *)&cs.null,0 },	// prints config help screen
@@ -172,103 +324,236 @@ const cfgItem_t cfgArray[] PROGMEM = {
 #endif
 
 	// Motor parameters
-	{ "1","1ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_1].motor_map,	M1_MOTOR_MAP },
+	{ "1","1ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_1].motor_map,	M1_MOTOR_MAP },
 	{ "1","1sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_1].step_angle,	M1_STEP_ANGLE },
 	{ "1","1tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_1].travel_rev,	M1_TRAVEL_PER_REV },
 	{ "1","1mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_1].microsteps,	M1_MICROSTEPS },
 	{ "1","1po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_1].polarity,		M1_POLARITY },
 	{ "1","1pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_1].power_mode,	M1_POWER_MODE },
+	{ "1","1pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_1].power_level,	M1_POWER_LEVEL },
+	{ "1","1pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_1].power_idle,	M1_POWER_IDLE },
+	{ "1","1se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "1","1mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_1].morph_microsteps,	M1_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "1","1sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_1].stall_threshold,	M1_STALL_THRESHOLD },
+	{ "1","1ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_1].stall_switch,	M1_STALL_SWITCH },
+	{ "1","1sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_1].load, 0 },		// stallGuard load (read only)
+	{ "1","1sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_1].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "1","1enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_1].encoder,			M1_ENCODER },
+	{ "1","1ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_1].counts_per_step,	M1_ENCODER_COUNTS },
+	{ "1","1ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_1].correction_max,	M1_ENCODER_CORRECTION },
+	{ "1","1fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_1].following_error, 0 },	// following error (read only)
+#endif
 #if (MOTORS >= 2)
-	{ "2","2ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_2].motor_map,	M2_MOTOR_MAP },
+	{ "2","2ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_2].motor_map,	M2_MOTOR_MAP },
 	{ "2","2sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_2].step_angle,	M2_STEP_ANGLE },
 	{ "2","2tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_2].travel_rev,	M2_TRAVEL_PER_REV },
 	{ "2","2mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_2].microsteps,	M2_MICROSTEPS },
 	{ "2","2po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_2].polarity,		M2_POLARITY },
 	{ "2","2pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_2].power_mode,	M2_POWER_MODE },
+	{ "2","2pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_2].power_level,	M2_POWER_LEVEL },
+	{ "2","2pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_2].power_idle,	M2_POWER_IDLE },
+	{ "2","2se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "2","2mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_2].morph_microsteps,	M2_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "2","2sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_2].stall_threshold,	M2_STALL_THRESHOLD },
+	{ "2","2ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_2].stall_switch,	M2_STALL_SWITCH },
+	{ "2","2sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_2].load, 0 },		// stallGuard load (read only)
+	{ "2","2sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_2].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "2","2enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_2].encoder,			M2_ENCODER },
+	{ "2","2ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_2].counts_per_step,	M2_ENCODER_COUNTS },
+	{ "2","2ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_2].correction_max,	M2_ENCODER_CORRECTION },
+	{ "2","2fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_2].following_error, 0 },	// following error (read only)
+#endif
 #endif
 #if (MOTORS >= 3)
-	{ "3","3ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_3].motor_map,	M3_MOTOR_MAP },
+	{ "3","3ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_3].motor_map,	M3_MOTOR_MAP },
 	{ "3","3sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_3].step_angle,	M3_STEP_ANGLE },
 	{ "3","3tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_3].travel_rev,	M3_TRAVEL_PER_REV },
 	{ "3","3mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_3].microsteps,	M3_MICROSTEPS },
 	{ "3","3po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_3].polarity,		M3_POLARITY },
 	{ "3","3pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_3].power_mode,	M3_POWER_MODE },
+	{ "3","3pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_3].power_level,	M3_POWER_LEVEL },
+	{ "3","3pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_3].power_idle,	M3_POWER_IDLE },
+	{ "3","3se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "3","3mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_3].morph_microsteps,	M3_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "3","3sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_3].stall_threshold,	M3_STALL_THRESHOLD },
+	{ "3","3ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_3].stall_switch,	M3_STALL_SWITCH },
+	{ "3","3sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_3].load, 0 },		// stallGuard load (read only)
+	{ "3","3sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_3].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "3","3enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_3].encoder,			M3_ENCODER },
+	{ "3","3ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_3].counts_per_step,	M3_ENCODER_COUNTS },
+	{ "3","3ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_3].correction_max,	M3_ENCODER_CORRECTION },
+	{ "3","3fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_3].following_error, 0 },	// following error (read only)
+#endif
 #endif
 #if (MOTORS >= 4)
-	{ "4","4ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_4].motor_map,	M4_MOTOR_MAP },
+	{ "4","4ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_4].motor_map,	M4_MOTOR_MAP },
 	{ "4","4sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_4].step_angle,	M4_STEP_ANGLE },
 	{ "4","4tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_4].travel_rev,	M4_TRAVEL_PER_REV },
 	{ "4","4mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_4].microsteps,	M4_MICROSTEPS },
 	{ "4","4po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_4].polarity,		M4_POLARITY },
 	{ "4","4pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_4].power_mode,	M4_POWER_MODE },
+	{ "4","4pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_4].power_level,	M4_POWER_LEVEL },
+	{ "4","4pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_4].power_idle,	M4_POWER_IDLE },
+	{ "4","4se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "4","4mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_4].morph_microsteps,	M4_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "4","4sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_4].stall_threshold,	M4_STALL_THRESHOLD },
+	{ "4","4ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_4].stall_switch,	M4_STALL_SWITCH },
+	{ "4","4sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_4].load, 0 },		// stallGuard load (read only)
+	{ "4","4sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_4].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "4","4enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_4].encoder,			M4_ENCODER },
+	{ "4","4ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_4].counts_per_step,	M4_ENCODER_COUNTS },
+	{ "4","4ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_4].correction_max,	M4_ENCODER_CORRECTION },
+	{ "4","4fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_4].following_error, 0 },	// following error (read only)
+#endif
 #endif
 #if (MOTORS >= 5)
-	{ "5","5ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_5].motor_map,	M5_MOTOR_MAP },
+	{ "5","5ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_5].motor_map,	M5_MOTOR_MAP },
 	{ "5","5sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_5].step_angle,	M5_STEP_ANGLE },
 	{ "5","5tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_5].travel_rev,	M5_TRAVEL_PER_REV },
 	{ "5","5mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_5].microsteps,	M5_MICROSTEPS },
 	{ "5","5po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_5].polarity,		M5_POLARITY },
 	{ "5","5pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_5].power_mode,	M5_POWER_MODE },
+	{ "5","5pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_5].power_level,	M5_POWER_LEVEL },
+	{ "5","5pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_5].power_idle,	M5_POWER_IDLE },
+	{ "5","5se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "5","5mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_5].morph_microsteps,	M5_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "5","5sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_5].stall_threshold,	M5_STALL_THRESHOLD },
+	{ "5","5ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_5].stall_switch,	M5_STALL_SWITCH },
+	{ "5","5sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_5].load, 0 },		// stallGuard load (read only)
+	{ "5","5sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_5].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "5","5enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_5].encoder,			M5_ENCODER },
+	{ "5","5ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_5].counts_per_step,	M5_ENCODER_COUNTS },
+	{ "5","5ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_5].correction_max,	M5_ENCODER_CORRECTION },
+	{ "5","5fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_5].following_error, 0 },	// following error (read only)
+#endif
 #endif
 #if (MOTORS >= 6)
-	{ "6","6ma",_fip, 0, st_print_ma, get_ui8, set_ui8,   (float *)&st.m[MOTOR_6].motor_map,	M6_MOTOR_MAP },
+	{ "6","6ma",_fip, 0, st_print_ma, get_ui8, st_set_ma, (float *)&st.m[MOTOR_6].motor_map,	M6_MOTOR_MAP },
 	{ "6","6sa",_fip, 2, st_print_sa, get_flt, st_set_sa, (float *)&st.m[MOTOR_6].step_angle,	M6_STEP_ANGLE },
 	{ "6","6tr",_fip, 3, st_print_tr, get_flu, st_set_tr, (float *)&st.m[MOTOR_6].travel_rev,	M6_TRAVEL_PER_REV },
 	{ "6","6mi",_fip, 0, st_print_mi, get_ui8, st_set_mi, (float *)&st.m[MOTOR_6].microsteps,	M6_MICROSTEPS },
 	{ "6","6po",_fip, 0, st_print_po, get_ui8, set_01,    (float *)&st.m[MOTOR_6].polarity,		M6_POLARITY },
 	{ "6","6pm",_fip, 0, st_print_pm, get_ui8, st_set_pm, (float *)&st.m[MOTOR_6].power_mode,	M6_POWER_MODE },
+	{ "6","6pl",_fip, 3, st_print_pl, get_flt, st_set_pw, (float *)&st.m[MOTOR_6].power_level,	M6_POWER_LEVEL },
+	{ "6","6pi",_fip, 3, st_print_pi, get_flt, st_set_pw, (float *)&st.m[MOTOR_6].power_idle,	M6_POWER_IDLE },
+	{ "6","6se",_f00, 3, st_print_se, st_get_se, set_nul, (float *)&cs.null, 0 },	// step error (read only)
+#ifdef __MICROSTEP_MORPHING
+	{ "6","6mo",_fip, 0, st_print_mo, get_ui8, st_set_mo, (float *)&st.m[MOTOR_6].morph_microsteps,	M6_MORPH_MICROSTEPS },
+#endif
+#ifdef __TMC2660
+	{ "6","6sgt",_fip, 0, tmc_print_sgt, get_flt, tmc_set_sgt, (float *)&tmc.m[MOTOR_6].stall_threshold,	M6_STALL_THRESHOLD },
+	{ "6","6ssw",_fip, 0, tmc_print_ssw, get_ui8, tmc_set_ssw, (float *)&tmc.m[MOTOR_6].stall_switch,	M6_STALL_SWITCH },
+	{ "6","6sg", _f00, 0, tmc_print_sg,  get_int, set_nul,     (float *)&tmc.m[MOTOR_6].load, 0 },		// stallGuard load (read only)
+	{ "6","6sf", _f00, 0, tmc_print_sf,  get_int, set_nul,     (float *)&tmc.m[MOTOR_6].flags, 0 },		// driver status flags (read only)
+#endif
+#ifdef __ENCODERS
+	{ "6","6enc",_fip, 0, en_print_enc, get_ui8, en_set_enc, (float *)&en.m[MOTOR_6].encoder,			M6_ENCODER },
+	{ "6","6ecs",_fip, 3, en_print_ecs, get_flt, en_set_ecs, (float *)&en.m[MOTOR_6].counts_per_step,	M6_ENCODER_COUNTS },
+	{ "6","6ecm",_fip, 0, en_print_ecm, get_flt, set_flt,    (float *)&en.m[MOTOR_6].correction_max,	M6_ENCODER_CORRECTION },
+	{ "6","6fe", _f00, 3, en_print_fe,  get_flt, set_nul,    (float *)&en.m[MOTOR_6].following_error, 0 },	// following error (read only)
+#endif
 #endif
 
 	// Axis parameters
 	{ "x","xam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_X].axis_mode,		X_AXIS_MODE },
 	{ "x","xvm",_fip, 0, cm_print_vm, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].velocity_max,	X_VELOCITY_MAX },
 	{ "x","xfr",_fip, 0, cm_print_fr, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].feedrate_max,	X_FEEDRATE_MAX },
-	{ "x","xtm",_fip, 0, cm_print_tm, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].travel_max,		X_TRAVEL_MAX },
+	{ "x","xtm",_fip, 0, cm_print_tm, get_flu,   cm_set_tm, (float *)&cm.a[AXIS_X].travel_max,		X_TRAVEL_MAX },
 	{ "x","xjm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_X].jerk_max,		X_JERK_MAX },
 	{ "x","xjh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_X].jerk_homing,		X_JERK_HOMING },
 	{ "x","xjd",_fip, 4, cm_print_jd, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].junction_dev,	X_JUNCTION_DEVIATION },
+	{ "x","xac",_fip, 0, cm_print_ac, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].accel_max,		X_ACCEL_MAX },
 	{ "x","xsn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_X][SW_MIN].mode,	X_SWITCH_MODE_MIN },
 	{ "x","xsx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_X][SW_MAX].mode,	X_SWITCH_MODE_MAX },
 	{ "x","xsv",_fip, 0, cm_print_sv, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].search_velocity,	X_SEARCH_VELOCITY },
 	{ "x","xlv",_fip, 0, cm_print_lv, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].latch_velocity,	X_LATCH_VELOCITY },
 	{ "x","xlb",_fip, 3, cm_print_lb, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].latch_backoff,	X_LATCH_BACKOFF },
 	{ "x","xzb",_fip, 3, cm_print_zb, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].zero_backoff,	X_ZERO_BACKOFF },
+	{ "x","xhg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_X].homing_group,	X_HOMING_GROUP },
+	{ "x","xsq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_X].squaring_switch,	X_SQUARING_SWITCH },
+	{ "x","xbl",_fip, 3, cm_print_bl, get_flu,   set_flu,   (float *)&cm.a[AXIS_X].backlash,		X_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "x","xif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_X].shaper_freq,	X_SHAPER_FREQ },
+	{ "x","xiz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_X].shaper_damping,	X_SHAPER_DAMPING },
+#endif
 
 	{ "y","yam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_Y].axis_mode,		Y_AXIS_MODE },
 	{ "y","yvm",_fip, 0, cm_print_vm, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].velocity_max,	Y_VELOCITY_MAX },
 	{ "y","yfr",_fip, 0, cm_print_fr, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].feedrate_max,	Y_FEEDRATE_MAX },
-	{ "y","ytm",_fip, 0, cm_print_tm, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].travel_max,		Y_TRAVEL_MAX },
+	{ "y","ytm",_fip, 0, cm_print_tm, get_flu,   cm_set_tm, (float *)&cm.a[AXIS_Y].travel_max,		Y_TRAVEL_MAX },
 	{ "y","yjm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_Y].jerk_max,		Y_JERK_MAX },
 	{ "y","yjh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_Y].jerk_homing,		Y_JERK_HOMING },
 	{ "y","yjd",_fip, 4, cm_print_jd, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].junction_dev,	Y_JUNCTION_DEVIATION },
+	{ "y","yac",_fip, 0, cm_print_ac, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].accel_max,		Y_ACCEL_MAX },
 	{ "y","ysn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_Y][SW_MIN].mode,	Y_SWITCH_MODE_MIN },
 	{ "y","ysx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_Y][SW_MAX].mode,	Y_SWITCH_MODE_MAX },
 	{ "y","ysv",_fip, 0, cm_print_sv, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].search_velocity,	Y_SEARCH_VELOCITY },
 	{ "y","ylv",_fip, 0, cm_print_lv, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].latch_velocity,	Y_LATCH_VELOCITY },
 	{ "y","ylb",_fip, 3, cm_print_lb, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].latch_backoff,	Y_LATCH_BACKOFF },
 	{ "y","yzb",_fip, 3, cm_print_zb, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].zero_backoff,	Y_ZERO_BACKOFF },
+	{ "y","yhg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_Y].homing_group,	Y_HOMING_GROUP },
+	{ "y","ysq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_Y].squaring_switch,	Y_SQUARING_SWITCH },
+	{ "y","ybl",_fip, 3, cm_print_bl, get_flu,   set_flu,   (float *)&cm.a[AXIS_Y].backlash,		Y_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "y","yif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_Y].shaper_freq,	Y_SHAPER_FREQ },
+	{ "y","yiz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_Y].shaper_damping,	Y_SHAPER_DAMPING },
+#endif
 
 	{ "z","zam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_Z].axis_mode,		Z_AXIS_MODE },
 	{ "z","zvm",_fip, 0, cm_print_vm, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].velocity_max,	Z_VELOCITY_MAX },
 	{ "z","zfr",_fip, 0, cm_print_fr, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].feedrate_max,	Z_FEEDRATE_MAX },
-	{ "z","ztm",_fip, 0, cm_print_tm, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].travel_max,		Z_TRAVEL_MAX },
+	{ "z","ztm",_fip, 0, cm_print_tm, get_flu,   cm_set_tm, (float *)&cm.a[AXIS_Z].travel_max,		Z_TRAVEL_MAX },
 	{ "z","zjm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_Z].jerk_max,		Z_JERK_MAX },
 	{ "z","zjh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_Z].jerk_homing, 	Z_JERK_HOMING },
 	{ "z","zjd",_fip, 4, cm_print_jd, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].junction_dev,	Z_JUNCTION_DEVIATION },
+	{ "z","zac",_fip, 0, cm_print_ac, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].accel_max,		Z_ACCEL_MAX },
 	{ "z","zsn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_Z][SW_MIN].mode,	Z_SWITCH_MODE_MIN },
 	{ "z","zsx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_Z][SW_MAX].mode,	Z_SWITCH_MODE_MAX },
 	{ "z","zsv",_fip, 0, cm_print_sv, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].search_velocity,	Z_SEARCH_VELOCITY },
 	{ "z","zlv",_fip, 0, cm_print_lv, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].latch_velocity,	Z_LATCH_VELOCITY },
 	{ "z","zlb",_fip, 3, cm_print_lb, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].latch_backoff,	Z_LATCH_BACKOFF },
 	{ "z","zzb",_fip, 3, cm_print_zb, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].zero_backoff,	Z_ZERO_BACKOFF },
+	{ "z","zhg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_Z].homing_group,	Z_HOMING_GROUP },
+	{ "z","zsq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_Z].squaring_switch,	Z_SQUARING_SWITCH },
+	{ "z","zbl",_fip, 3, cm_print_bl, get_flu,   set_flu,   (float *)&cm.a[AXIS_Z].backlash,		Z_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "z","zif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_Z].shaper_freq,	Z_SHAPER_FREQ },
+	{ "z","ziz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_Z].shaper_damping,	Z_SHAPER_DAMPING },
+#endif
 
 	{ "a","aam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_A].axis_mode,		A_AXIS_MODE },
 	{ "a","avm",_fip, 0, cm_print_vm, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].velocity_max,	A_VELOCITY_MAX },
 	{ "a","afr",_fip, 0, cm_print_fr, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].feedrate_max,	A_FEEDRATE_MAX },
-	{ "a","atm",_fip, 0, cm_print_tm, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].travel_max,		A_TRAVEL_MAX },
+	{ "a","atm",_fip, 0, cm_print_tm, get_flt,   cm_set_tm, (float *)&cm.a[AXIS_A].travel_max,		A_TRAVEL_MAX },
 	{ "a","ajm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_A].jerk_max,		A_JERK_MAX },
 	{ "a","ajh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_A].jerk_homing, 	A_JERK_HOMING },
 	{ "a","ajd",_fip, 4, cm_print_jd, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].junction_dev,	A_JUNCTION_DEVIATION },
+	{ "a","aac",_fip, 0, cm_print_ac, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].accel_max,		A_ACCEL_MAX },
 	{ "a","ara",_fip, 3, cm_print_ra, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].radius,			A_RADIUS},
 	{ "a","asn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_A][SW_MIN].mode,	A_SWITCH_MODE_MIN },
 	{ "a","asx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_A][SW_MAX].mode,	A_SWITCH_MODE_MAX },
@@ -276,30 +561,52 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "a","alv",_fip, 0, cm_print_lv, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].latch_velocity,	A_LATCH_VELOCITY },
 	{ "a","alb",_fip, 3, cm_print_lb, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].latch_backoff,	A_LATCH_BACKOFF },
 	{ "a","azb",_fip, 3, cm_print_zb, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].zero_backoff,	A_ZERO_BACKOFF },
+	{ "a","ahg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_A].homing_group,	A_HOMING_GROUP },
+	{ "a","asq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_A].squaring_switch,	A_SQUARING_SWITCH },
+	{ "a","abl",_fip, 3, cm_print_bl, get_flt,   set_flt,   (float *)&cm.a[AXIS_A].backlash,		A_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "a","aif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_A].shaper_freq,	A_SHAPER_FREQ },
+	{ "a","aiz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_A].shaper_damping,	A_SHAPER_DAMPING },
+#endif
+#ifdef __AUX_MOTION
+	{ "a","aas",_fip, 0, mp_print_as, get_ui8,   mp_set_as, (float *)&cm.a[AXIS_A].async,			A_ASYNC },
+#endif
 
 	{ "b","bam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_B].axis_mode,		B_AXIS_MODE },
 	{ "b","bvm",_fip, 0, cm_print_vm, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].velocity_max,	B_VELOCITY_MAX },
 	{ "b","bfr",_fip, 0, cm_print_fr, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].feedrate_max,	B_FEEDRATE_MAX },
-	{ "b","btm",_fip, 0, cm_print_tm, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].travel_max,		B_TRAVEL_MAX },
+	{ "b","btm",_fip, 0, cm_print_tm, get_flt,   cm_set_tm, (float *)&cm.a[AXIS_B].travel_max,		B_TRAVEL_MAX },
 	{ "b","bjm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_B].jerk_max,		B_JERK_MAX },
 	{ "b","bjd",_fip, 0, cm_print_jd, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].junction_dev,	B_JUNCTION_DEVIATION },
+	{ "b","bac",_fip, 0, cm_print_ac, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].accel_max,		B_ACCEL_MAX },
 	{ "b","bra",_fip, 3, cm_print_ra, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].radius,			B_RADIUS },
 #ifdef __ARM	// B axis extended paramters
-	{ "b","asn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_B][SW_MIN].mode,	B_SWITCH_MODE_MIN },
-	{ "b","asx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_B][SW_MAX].mode,	B_SWITCH_MODE_MAX },
+	{ "b","bsn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_B][SW_MIN].mode,	B_SWITCH_MODE_MIN },
+	{ "b","bsx",_fip, 0, cm_print_sx, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_B][SW_MAX].mode,	B_SWITCH_MODE_MAX },
 	{ "b","bsv",_fip, 0, cm_print_sv, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].search_velocity,	B_SEARCH_VELOCITY },
 	{ "b","blv",_fip, 0, cm_print_lv, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].latch_velocity,	B_LATCH_VELOCITY },
 	{ "b","blb",_fip, 3, cm_print_lb, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].latch_backoff,	B_LATCH_BACKOFF },
 	{ "b","bzb",_fip, 3, cm_print_zb, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].zero_backoff,	B_ZERO_BACKOFF },
+	{ "b","bhg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_B].homing_group,	B_HOMING_GROUP },
+	{ "b","bsq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_B].squaring_switch,	B_SQUARING_SWITCH },
+	{ "b","bbl",_fip, 3, cm_print_bl, get_flt,   set_flt,   (float *)&cm.a[AXIS_B].backlash,		B_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "b","bif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_B].shaper_freq,	B_SHAPER_FREQ },
+	{ "b","biz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_B].shaper_damping,	B_SHAPER_DAMPING },
+#endif
+#ifdef __AUX_MOTION
+	{ "b","bas",_fip, 0, mp_print_as, get_ui8,   mp_set_as, (float *)&cm.a[AXIS_B].async,			B_ASYNC },
+#endif
 	{ "b","bjh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_B].jerk_homing,		B_JERK_HOMING },
 #endif
 
 	{ "c","cam",_fip, 0, cm_print_am, cm_get_am, cm_set_am, (float *)&cm.a[AXIS_C].axis_mode,		C_AXIS_MODE },
 	{ "c","cvm",_fip, 0, cm_print_vm, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].velocity_max,	C_VELOCITY_MAX },
 	{ "c","cfr",_fip, 0, cm_print_fr, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].feedrate_max,	C_FEEDRATE_MAX },
-	{ "c","ctm",_fip, 0, cm_print_tm, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].travel_max,		C_TRAVEL_MAX },
+	{ "c","ctm",_fip, 0, cm_print_tm, get_flt,   cm_set_tm, (float *)&cm.a[AXIS_C].travel_max,		C_TRAVEL_MAX },
 	{ "c","cjm",_fip, 0, cm_print_jm, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_C].jerk_max,		C_JERK_MAX },
 	{ "c","cjd",_fip, 0, cm_print_jd, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].junction_dev,	C_JUNCTION_DEVIATION },
+	{ "c","cac",_fip, 0, cm_print_ac, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].accel_max,		C_ACCEL_MAX },
 	{ "c","cra",_fip, 3, cm_print_ra, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].radius,			C_RADIUS },
 #ifdef __ARM	// C axis extended paramters
 	{ "c","csn",_fip, 0, cm_print_sn, get_ui8,   sw_set_sw, (float *)&sw.s[AXIS_C][SW_MIN].mode,	C_SWITCH_MODE_MIN },
@@ -308,6 +615,16 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "c","clv",_fip, 0, cm_print_lv, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].latch_velocity,	C_LATCH_VELOCITY },
 	{ "c","clb",_fip, 3, cm_print_lb, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].latch_backoff,	C_LATCH_BACKOFF },
 	{ "c","czb",_fip, 3, cm_print_zb, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].zero_backoff,	C_ZERO_BACKOFF },
+	{ "c","chg",_fip, 0, cm_print_hg, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_C].homing_group,	C_HOMING_GROUP },
+	{ "c","csq",_fip, 0, cm_print_sq, get_ui8,   set_ui8,   (float *)&cm.a[AXIS_C].squaring_switch,	C_SQUARING_SWITCH },
+	{ "c","cbl",_fip, 3, cm_print_bl, get_flt,   set_flt,   (float *)&cm.a[AXIS_C].backlash,		C_BACKLASH },
+#ifdef __INPUT_SHAPING
+	{ "c","cif",_fip, 2, sh_print_if, get_flt,   sh_set_if, (float *)&cm.a[AXIS_C].shaper_freq,	C_SHAPER_FREQ },
+	{ "c","ciz",_fip, 3, sh_print_iz, get_flt,   sh_set_iz, (float *)&cm.a[AXIS_C].shaper_damping,	C_SHAPER_DAMPING },
+#endif
+#ifdef __AUX_MOTION
+	{ "c","cas",_fip, 0, mp_print_as, get_ui8,   mp_set_as, (float *)&cm.a[AXIS_C].async,			C_ASYNC },
+#endif
 	{ "c","cjh",_fip, 0, cm_print_jh, cm_get_jrk,cm_set_jrk,(float *)&cm.a[AXIS_C].jerk_homing, 	C_JERK_HOMING },
 #endif
 /*
@@ -322,49 +639,60 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "p1","p1wpl",_fip, 3, pwm_print_p1wpl, get_flt, set_flt,(float *)&pwm.c[PWM_1].ccw_phase_lo,	P1_CCW_PHASE_LO },
 	{ "p1","p1wph",_fip, 3, pwm_print_p1wph, get_flt, set_flt,(float *)&pwm.c[PWM_1].ccw_phase_hi,	P1_CCW_PHASE_HI },
 	{ "p1","p1pof",_fip, 3, pwm_print_p1pof, get_flt, set_flt,(float *)&pwm.c[PWM_1].phase_off,		P1_PWM_PHASE_OFF },
+	{ "p1","p1lm", _fip, 0, pwm_print_p1lm,  get_ui8, set_ui8,(float *)&pwm.c[PWM_1].laser_mode,		P1_LASER_MODE },
+	{ "p1","p1acc",_fip, 0, pwm_print_p1acc, get_flt, set_flt,(float *)&pwm.c[PWM_1].spindle_accel,	P1_SPINDLE_ACCEL },
 */
 	// Coordinate system offsets (G54-G59 and G92)
-	{ "g54","g54x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_X], G54_X_OFFSET },
-	{ "g54","g54y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_Y], G54_Y_OFFSET },
-	{ "g54","g54z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_Z], G54_Z_OFFSET },
-	{ "g54","g54a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_A], G54_A_OFFSET },
-	{ "g54","g54b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_B], G54_B_OFFSET },
-	{ "g54","g54c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G54][AXIS_C], G54_C_OFFSET },
-
-	{ "g55","g55x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_X], G55_X_OFFSET },
-	{ "g55","g55y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_Y], G55_Y_OFFSET },
-	{ "g55","g55z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_Z], G55_Z_OFFSET },
-	{ "g55","g55a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_A], G55_A_OFFSET },
-	{ "g55","g55b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_B], G55_B_OFFSET },
-	{ "g55","g55c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G55][AXIS_C], G55_C_OFFSET },
-
-	{ "g56","g56x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_X], G56_X_OFFSET },
-	{ "g56","g56y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_Y], G56_Y_OFFSET },
-	{ "g56","g56z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_Z], G56_Z_OFFSET },
-	{ "g56","g56a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_A], G56_A_OFFSET },
-	{ "g56","g56b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_B], G56_B_OFFSET },
-	{ "g56","g56c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G56][AXIS_C], G56_C_OFFSET },
-
-	{ "g57","g57x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_X], G57_X_OFFSET },
-	{ "g57","g57y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_Y], G57_Y_OFFSET },
-	{ "g57","g57z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_Z], G57_Z_OFFSET },
-	{ "g57","g57a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_A], G57_A_OFFSET },
-	{ "g57","g57b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_B], G57_B_OFFSET },
-	{ "g57","g57c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G57][AXIS_C], G57_C_OFFSET },
-
-	{ "g58","g58x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_X], G58_X_OFFSET },
-	{ "g58","g58y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_Y], G58_Y_OFFSET },
-	{ "g58","g58z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_Z], G58_Z_OFFSET },
-	{ "g58","g58a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_A], G58_A_OFFSET },
-	{ "g58","g58b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_B], G58_B_OFFSET },
-	{ "g58","g58c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G58][AXIS_C], G58_C_OFFSET },
-
-	{ "g59","g59x",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_X], G59_X_OFFSET },
-	{ "g59","g59y",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_Y], G59_Y_OFFSET },
-	{ "g59","g59z",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_Z], G59_Z_OFFSET },
-	{ "g59","g59a",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_A], G59_A_OFFSET },
-	{ "g59","g59b",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_B], G59_B_OFFSET },
-	{ "g59","g59c",_fip, 3, cm_print_cofs, get_flu, set_flu,(float *)&cm.offset[G59][AXIS_C], G59_C_OFFSET },
+	{ "g54","g54x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_X], G54_X_OFFSET },
+	{ "g54","g54y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_Y], G54_Y_OFFSET },
+	{ "g54","g54z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_Z], G54_Z_OFFSET },
+	{ "g54","g54a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_A], G54_A_OFFSET },
+	{ "g54","g54b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_B], G54_B_OFFSET },
+	{ "g54","g54c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G54][AXIS_C], G54_C_OFFSET },
+
+	{ "g55","g55x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_X], G55_X_OFFSET },
+	{ "g55","g55y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_Y], G55_Y_OFFSET },
+	{ "g55","g55z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_Z], G55_Z_OFFSET },
+	{ "g55","g55a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_A], G55_A_OFFSET },
+	{ "g55","g55b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_B], G55_B_OFFSET },
+	{ "g55","g55c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G55][AXIS_C], G55_C_OFFSET },
+
+	{ "g56","g56x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_X], G56_X_OFFSET },
+	{ "g56","g56y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_Y], G56_Y_OFFSET },
+	{ "g56","g56z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_Z], G56_Z_OFFSET },
+	{ "g56","g56a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_A], G56_A_OFFSET },
+	{ "g56","g56b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_B], G56_B_OFFSET },
+	{ "g56","g56c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G56][AXIS_C], G56_C_OFFSET },
+
+	{ "g57","g57x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_X], G57_X_OFFSET },
+	{ "g57","g57y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_Y], G57_Y_OFFSET },
+	{ "g57","g57z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_Z], G57_Z_OFFSET },
+	{ "g57","g57a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_A], G57_A_OFFSET },
+	{ "g57","g57b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_B], G57_B_OFFSET },
+	{ "g57","g57c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G57][AXIS_C], G57_C_OFFSET },
+
+	{ "g58","g58x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_X], G58_X_OFFSET },
+	{ "g58","g58y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_Y], G58_Y_OFFSET },
+	{ "g58","g58z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_Z], G58_Z_OFFSET },
+	{ "g58","g58a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_A], G58_A_OFFSET },
+	{ "g58","g58b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_B], G58_B_OFFSET },
+	{ "g58","g58c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G58][AXIS_C], G58_C_OFFSET },
+
+	{ "g59","g59x",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_X], G59_X_OFFSET },
+	{ "g59","g59y",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_Y], G59_Y_OFFSET },
+	{ "g59","g59z",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_Z], G59_Z_OFFSET },
+	{ "g59","g59a",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_A], G59_A_OFFSET },
+	{ "g59","g59b",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_B], G59_B_OFFSET },
+	{ "g59","g59c",_fip, 3, cm_print_cofs, get_flu, cm_set_cofs,(float *)&cm.offset[G59][AXIS_C], G59_C_OFFSET },
+
+	{ "tof","tof1",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[1], TOOL_LENGTH_OFFSET },	// tool table for G43 H
+	{ "tof","tof2",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[2], TOOL_LENGTH_OFFSET },
+	{ "tof","tof3",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[3], TOOL_LENGTH_OFFSET },
+	{ "tof","tof4",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[4], TOOL_LENGTH_OFFSET },
+	{ "tof","tof5",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[5], TOOL_LENGTH_OFFSET },
+	{ "tof","tof6",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[6], TOOL_LENGTH_OFFSET },
+	{ "tof","tof7",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[7], TOOL_LENGTH_OFFSET },
+	{ "tof","tof8",_fip, 3, cm_print_tof, get_flu, cm_set_tof,(float *)&cm.tool_offset[8], TOOL_LENGTH_OFFSET },
 
 	{ "g92","g92x",_fin, 3, cm_print_cofs, get_flu, set_nul,(float *)&gmx.origin_offset[AXIS_X], 0 },// G92 handled differently
 	{ "g92","g92y",_fin, 3, cm_print_cofs, get_flu, set_nul,(float *)&gmx.origin_offset[AXIS_Y], 0 },
@@ -391,17 +719,160 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	// System parameters
 	{ "sys","ja",  _f07, 0, cm_print_ja,  get_flu,   set_flu,    (float *)&cm.junction_acceleration,JUNCTION_ACCELERATION },
 	{ "sys","ct",  _f07, 4, cm_print_ct,  get_flu,   set_flu,    (float *)&cm.chordal_tolerance,	CHORDAL_TOLERANCE },
+	{ "sys","lca", _f07, 3, cm_print_lca, get_flt,   set_flt,    (float *)&cm.coalesce_angle,		COALESCE_ANGLE },
+	{ "sys","lct", _f07, 4, cm_print_lct, get_flu,   set_flu,    (float *)&cm.coalesce_tolerance,	COALESCE_TOLERANCE },
+	{ "sys","prt", _f07, 0, cm_print_prt, get_ui8,   set_ui8,    (float *)&cm.probe_touches,		PROBE_TOUCHES },
+#ifdef __PRESSURE_ADVANCE
+	{ "sys","pea", _f07, 0, cm_print_pea, get_ui8,   cm_set_pea, (float *)&cm.pa_axis,			PRESSURE_ADVANCE_AXIS },
+	{ "sys","pek", _f07, 3, cm_print_pek, get_flt,   set_flt,    (float *)&cm.pa_k,				PRESSURE_ADVANCE_K },
+#endif
+#ifdef __SPINDLE_SYNC
+	{ "sys","sse", _f07, 0, en_print_sse, get_ui8,   en_set_sse, (float *)&en.spindle_encoder,		SPINDLE_ENCODER },
+	{ "sys","ssc", _f07, 0, en_print_ssc, get_flt,   en_set_ssc, (float *)&en.spindle_counts,		SPINDLE_ENCODER_COUNTS },
+#endif
 //	{ "sys","st",  _f07, 0, sw_print_st,  get_ui8,   sw_set_st,  (float *)&sw.switch_type,			SWITCH_TYPE },
 	{ "sys","mt",  _f07, 2, st_print_mt,  get_flt,   st_set_mt,  (float *)&st.motor_idle_timeout, 	MOTOR_IDLE_TIMEOUT},
+	{ "sys","sc",  _f07, 0, st_print_sc,  get_ui8,   set_01,     (float *)&st.step_correction,		STEP_CORRECTION },
+	{ "sys","sds", _f07, 2, st_print_sds, get_flt,   st_set_sds, (float *)&st.dir_setup,			STEP_DIR_SETUP },
+	{ "sys","sph", _f07, 2, st_print_sph, get_flt,   st_set_sph, (float *)&st.pulse_high,			STEP_PULSE_HIGH },
+	{ "sys","spl", _f07, 2, st_print_spl, get_flt,   st_set_spl, (float *)&st.pulse_low,			STEP_PULSE_LOW },
+	{ "sys","esl", _f07, 0, st_print_esl, get_flt,   set_flt,    (float *)&st.exec_slack_late,		EXEC_SLACK_LATE },
+#ifdef __MICROSTEP_MORPHING
+	{ "sys","msr", _f07, 0, st_print_msr, get_flt,   set_flt,    (float *)&st.morph_rate,			MICROSTEP_MORPH_RATE },
+#endif
+	{ "sys","kn",  _f07, 0, ik_print_kn,  get_ui8,   ik_set_kn,  (float *)&ik.kinematics,			KINEMATICS },
+	{ "sys","kdl", _f07, 3, ik_print_kdl, get_flu,   ik_set_kd,  (float *)&ik.delta_diagonal_rod,	DELTA_DIAGONAL_ROD },
+	{ "sys","kdr", _f07, 3, ik_print_kdr, get_flu,   ik_set_kd,  (float *)&ik.delta_radius,		DELTA_RADIUS },
+	{ "sys","kpx", _f07, 3, ik_print_kpx, get_flu,   ik_set_kd,  (float *)&ik.pivot[0],			RTCP_PIVOT_X },
+	{ "sys","kpy", _f07, 3, ik_print_kpy, get_flu,   ik_set_kd,  (float *)&ik.pivot[1],			RTCP_PIVOT_Y },
+	{ "sys","kpz", _f07, 3, ik_print_kpz, get_flu,   ik_set_kd,  (float *)&ik.pivot[2],			RTCP_PIVOT_Z },
+	{ "sys","sme", _f07, 0, ik_print_sme, get_ui8,   set_ui8,    (float *)&ik.map_enable,			SURFACE_MAP_ENABLE },
+	{ "sys","smx", _f07, 3, ik_print_smx, get_flu,   ik_set_smf, (float *)&ik.map_x,				SURFACE_MAP_X },
+	{ "sys","smy", _f07, 3, ik_print_smy, get_flu,   ik_set_smf, (float *)&ik.map_y,				SURFACE_MAP_Y },
+	{ "sys","smi", _f07, 3, ik_print_smi, get_flu,   ik_set_smf, (float *)&ik.map_dx,				SURFACE_MAP_SPACING_X },
+	{ "sys","smj", _f07, 3, ik_print_smj, get_flu,   ik_set_smf, (float *)&ik.map_dy,				SURFACE_MAP_SPACING_Y },
+	{ "sys","smc", _f07, 0, ik_print_smc, get_ui8,   ik_set_smn, (float *)&ik.map_cols,			SURFACE_MAP_COLS },
+	{ "sys","smr", _f07, 0, ik_print_smr, get_ui8,   ik_set_smn, (float *)&ik.map_rows,			SURFACE_MAP_ROWS },
+	{ "sys","smz", _f07, 3, ik_print_smz, get_flu,   set_flu,    (float *)&ik.map_clearance,		SURFACE_MAP_CLEARANCE },
+	{ "",   "smap",_f00, 0, ik_print_smap,get_ui8,   cm_run_map, (float *)&ik.map_valid, false },	// map state, invoke mapping cycle
+	{ "",   "jog", _f00, 0, tx_print_nul, get_nul,   mp_run_jog, (float *)&cs.null, 0 },	// jog velocity targets - see plan_jog.cpp
+#ifdef __RASTER
+	{ "sys","rsa", _f07, 0, rs_print_rsa, get_ui8,   rs_set_rsa, (float *)&rs.axis,				RASTER_AXIS },
+	{ "sys","rsp", _f07, 3, rs_print_rsp, get_flu,   set_flu,    (float *)&rs.pitch,				RASTER_PITCH },
+	{ "sys","rsv", _f07, 3, rs_print_rsv, get_flu,   set_flu,    (float *)&rs.velocity,			RASTER_VELOCITY },
+	{ "sys","rso", _f07, 3, rs_print_rso, get_flu,   set_flu,    (float *)&rs.overscan,			RASTER_OVERSCAN },
+	{ "",   "rst", _f00, 0, tx_print_nul, get_nul,   rs_run_row, (float *)&cs.null, 0 },	// raster row - see raster.h
+#endif
+#ifdef __INPUT_SHAPING
+	{ "sys","ist", _f07, 0, sh_print_ist, get_ui8,   sh_set_ist, (float *)&sh.type,				SHAPER_TYPE },
+#endif
+#ifdef __PSO
+	{ "sys","psw", _f07, 0, ps_print_psw, get_flt,   ps_set_psw, (float *)&ps.pulse_width,		PSO_PULSE_WIDTH },
+	{ "",   "pso", _f00, 0, tx_print_nul, get_nul,   ps_run_event,(float *)&cs.null, 0 },	// position synchronized output event - see pso.h
+#endif
+#ifdef __STEP_QUEUE
+	{ "sys","sqh", _f07, 3, sq_print_sqh, get_flt,   set_flt,    (float *)&sq.hold_time,			STEP_QUEUE_HOLD_TIME },
+	{ "",   "sqm", _f00, 0, tx_print_ui8, get_ui8,   sq_set_sqm, (float *)&sq.mode, 0 },	// step queue run on/off - see stepq.h
+	{ "",   "sqe", _f00, 0, tx_print_int, get_int,   set_nul,    (float *)&sq.late, 0 },	// steps run after their time
+	{ "",   "sq",  _f00, 0, tx_print_nul, get_nul,   sq_run_moves,(float *)&cs.null, 0 },	// step schedule moves for a motor
+#endif
+#ifdef __STRESS_TEST
+	{ "sys","sxr", _f07, 0, sx_print_sxr, get_flt,   sx_set_sxr, (float *)&sx.step_rate,		STRESS_STEP_RATE },
+	{ "sys","sxl", _f07, 0, sx_print_sxl, get_ui8,   set_ui8,    (float *)&sx.load,				STRESS_LOAD },
+	{ "",   "sxt", _f00, 0, tx_print_nul, get_nul,   sx_set_sxt, (float *)&cs.null, 0 },	// run the stress test for n seconds - see stress.h
+	{ "",   "sxs", _f00, 0, sx_print_sxs, sx_get_sxs, set_nul,   (float *)&cs.null, 0 },	// last stress test result
+#endif
+#ifdef __SELF_BENCHMARK
+	{ "",   "bench",_f00, 0, sb_print_bench,sb_get_bench,sb_set_bench,(float *)&cs.null, 0 },	// run the self benchmark n times - see selfbench.h
+#endif
+#ifdef __SWO_TRACE
+	{ "sys","swoe",_f07, 0, swo_print_swoe, get_ui8, swo_set_swoe,(float *)&swo.ports,			SWO_PORTS_ON },
+	{ "sys","swob",_f07, 0, swo_print_swob, get_flt, swo_set_swob,(float *)&swo.baud,			SWO_BAUD },
+	{ "",   "swod",_f00, 0, tx_print_int, get_int,   set_nul,    (float *)&swo.dropped, 0 },	// events dropped - see swo.h
+#endif
+#ifdef __SEGMENT_SYNC
+	{ "sys","sym", _f07, 0, sy_print_sym, get_ui8,   sy_set_sym, (float *)&sy.mode,				SYNC_MODE },
+	{ "",   "syw", _f00, 0, sy_print_syw, get_int,   set_nul,    (float *)&sy.waits, 0 },	// segments a slave held for a sync edge
+#endif
+#ifdef __ANALOG_INPUTS
+	{ "sys","anf", _f07, 1, ad_print_anf, get_flt,   ad_set_anf, (float *)&ad.filter,			ANALOG_FILTER },
+	{ "sys","an1c",_f07, 0, ad_print_anc, get_ui8,   ad_set_anc, (float *)&ad.in[0].channel,		AN1_CHANNEL },
+	{ "sys","an1s",_f07, 3, ad_print_ans, get_flt,   set_flt,    (float *)&ad.in[0].scale,			AN1_SCALE },
+	{ "sys","an1o",_f07, 3, ad_print_ano, get_flt,   set_flt,    (float *)&ad.in[0].offset,		AN1_OFFSET },
+	{ "",   "an1", _f00, 3, ad_print_an,  get_flt,   set_nul,    (float *)&ad.in[0].value, 0 },	// filtered reading (read only)
+	{ "sys","an2c",_f07, 0, ad_print_anc, get_ui8,   ad_set_anc, (float *)&ad.in[1].channel,		AN2_CHANNEL },
+	{ "sys","an2s",_f07, 3, ad_print_ans, get_flt,   set_flt,    (float *)&ad.in[1].scale,			AN2_SCALE },
+	{ "sys","an2o",_f07, 3, ad_print_ano, get_flt,   set_flt,    (float *)&ad.in[1].offset,		AN2_OFFSET },
+	{ "",   "an2", _f00, 3, ad_print_an,  get_flt,   set_nul,    (float *)&ad.in[1].value, 0 },	// filtered reading (read only)
+	{ "sys","an3c",_f07, 0, ad_print_anc, get_ui8,   ad_set_anc, (float *)&ad.in[2].channel,		AN3_CHANNEL },
+	{ "sys","an3s",_f07, 3, ad_print_ans, get_flt,   set_flt,    (float *)&ad.in[2].scale,			AN3_SCALE },
+	{ "sys","an3o",_f07, 3, ad_print_ano, get_flt,   set_flt,    (float *)&ad.in[2].offset,		AN3_OFFSET },
+	{ "",   "an3", _f00, 3, ad_print_an,  get_flt,   set_nul,    (float *)&ad.in[2].value, 0 },	// filtered reading (read only)
+	{ "sys","an4c",_f07, 0, ad_print_anc, get_ui8,   ad_set_anc, (float *)&ad.in[3].channel,		AN4_CHANNEL },
+	{ "sys","an4s",_f07, 3, ad_print_ans, get_flt,   set_flt,    (float *)&ad.in[3].scale,			AN4_SCALE },
+	{ "sys","an4o",_f07, 3, ad_print_ano, get_flt,   set_flt,    (float *)&ad.in[3].offset,		AN4_OFFSET },
+	{ "",   "an4", _f00, 3, ad_print_an,  get_flt,   set_nul,    (float *)&ad.in[3].value, 0 },	// filtered reading (read only)
+	{ "sys","ldi", _f07, 0, ad_print_ldi, get_ui8,   ad_set_ldi, (float *)&ad.feed_input,		LOAD_FEED_INPUT },
+	{ "sys","lds", _f07, 3, ad_print_lds, get_flt,   set_flt,    (float *)&ad.feed_setpoint,		LOAD_FEED_SETPOINT },
+	{ "sys","ldg", _f07, 3, ad_print_ldg, get_flt,   set_flt,    (float *)&ad.feed_gain,			LOAD_FEED_GAIN },
+	{ "sys","ldn", _f07, 3, ad_print_ldn, get_flt,   ad_set_ldn, (float *)&ad.feed_min,			LOAD_FEED_MIN },
+	{ "sys","ldx", _f07, 3, ad_print_ldx, get_flt,   ad_set_ldx, (float *)&ad.feed_max,			LOAD_FEED_MAX },
+	{ "",   "ldf", _f00, 3, ad_print_ldf, get_flt,   set_nul,    (float *)&mm.adaptive_factor, 0 },	// load-adaptive feed factor (read only)
+#endif
+#ifdef __BINARY_STREAM
+	{ "",   "bsf", _f00, 0, bs_print_bsf, get_int,   set_nul,    (float *)&bs.frames, 0 },	// binary stream frames run
+	{ "",   "bse", _f00, 0, bs_print_bse, get_int,   set_nul,    (float *)&bs.errors, 0 },	// binary stream frames rejected
+#endif
+#ifdef __PROGRAM_STORE
+	{ "",   "pgr", _f00, 0, tx_print_nul, get_nul,   pg_run_pgr, (float *)&cs.null, 0 },	// run (1) or stop (0) the stored program
+	{ "",   "pgs", _f00, 0, pg_print_pgs, get_ui8,   set_nul,    (float *)&pg.state, 0 },	// program store state
+	{ "",   "pgl", _f00, 0, pg_print_pgl, get_int,   set_nul,    (float *)&pg.length, 0 },	// stored program length
+#endif
+#ifdef __SEGMENT_REPLAY
+	{ "sys","rpm", _f07, 0, rp_print_rpm, get_ui8,   set_01,     (float *)&rp.mode,				SEGMENT_REPLAY_MODE },
+	{ "sys","rph", _f07, 2, rp_print_rph, get_flt,   set_flt,    (float *)&rp.hold_time,			SEGMENT_REPLAY_HOLD_TIME },
+	{ "",   "rps", _f00, 0, rp_print_rps, rp_get_rps, set_nul,   (float *)&cs.null, 0 },	// segment cache state - see replay.h
+	{ "",   "rpl", _f00, 0, rp_print_rpl, get_int,   set_nul,    (float *)&rp.length, 0 },	// bytes of recording in the cache
+#endif
+#ifdef __CHECKPOINT
+	{ "sys","ckt", _f07, 1, ck_print_ckt, get_flt,   set_flt,    (float *)&ck.interval,			CHECKPOINT_INTERVAL },
+	{ "sys","ckh", _f07, 3, ck_print_ckh, get_flu,   set_flu,    (float *)&ck.rehome_margin,		CHECKPOINT_REHOME_MARGIN },
+	{ "",   "cks", _f00, 0, ck_print_cks, get_ui8,   ck_set_cks, (float *)&ck.last.state, 0 },	// checkpoint state - set 0 to clear
+	{ "",   "ckl", _f00, 0, ck_print_ckl, get_int,   set_nul,    (float *)&ck.last.gm.linenum, 0 },	// checkpoint line number
+	{ "",   "ckp", _f00, 0, ck_print_ckp, ck_get_ckp,set_nul,    (float *)&cs.null, 0 },	// checkpoint machine position
+	{ "",   "ckm", _f00, 0, ck_print_ckm, ck_get_ckm,set_nul,    (float *)&cs.null, 0 },	// checkpoint modal state as Gcode
+#endif
+#ifdef __MACHINE_PROFILES
+	{ "sys","mfb", _f07, 0, mf_print_mfb, get_ui8,   mf_set_mfb, (float *)&mf.boot,				MACHINE_PROFILE_BOOT },
+	{ "",   "mfs", _f00, 0, mf_print_mfa, get_ui8,   mf_set_mfs, (float *)&mf.active, 0 },	// save the settings to a profile
+	{ "",   "mfl", _f00, 0, mf_print_mfa, get_ui8,   mf_set_mfl, (float *)&mf.active, 0 },	// load a profile
+	{ "",   "mfa", _f00, 0, mf_print_mfa, get_ui8,   set_nul,    (float *)&mf.active, 0 },	// profile last loaded or saved
+#endif
+#ifdef __CONFIG_BACKUP
+	{ "",   "cfx", _f00, 0, tx_print_int, cb_get_cfx, set_nul,   (float *)&cs.null, 0 },	// export the config blob - see config_backup.h
+	{ "",   "cfi", _f00, 0, tx_print_int, get_nul,   cb_set_cfi, (float *)&cs.null, 0 },	// import a chunk of the config blob
+#endif
+	{ "",   "kt",  _f00, 1, ik_print_kt,  ik_get_kt, ik_set_kt,  (float *)&cs.null, 0 },	// worst case kinematics time
+	{ "",   "kb",  _f00, 1, ik_print_kb,  ik_get_kb, ik_set_kt,  (float *)&cs.null, 0 },	// ...as a % of segment time
 	{ "",   "me",  _f00, 0, tx_print_str, st_set_me, st_set_me,  (float *)&cs.null, 0 },
 	{ "",   "md",  _f00, 0, tx_print_str, st_set_md, st_set_md,  (float *)&cs.null, 0 },
 
-	{ "sys","ej",  _f07, 0, js_print_ej,  get_ui8,   set_01,     (float *)&cfg.comm_mode,			COMM_MODE },
+	{ "sys","ej",  _f07, 0, js_print_ej,  get_ui8,   set_012,    (float *)&cfg.comm_mode,			COMM_MODE },
 	{ "sys","jv",  _f07, 0, js_print_jv,  get_ui8,   json_set_jv,(float *)&js.json_verbosity,		JSON_VERBOSITY },
 	{ "sys","tv",  _f07, 0, tx_print_tv,  get_ui8,   set_01,     (float *)&txt.text_verbosity,		TEXT_VERBOSITY },
 	{ "sys","qv",  _f07, 0, qr_print_qv,  get_ui8,   set_0123,   (float *)&qr.queue_report_verbosity,QR_VERBOSITY },
-	{ "sys","sv",  _f07, 0, sr_print_sv,  get_ui8,   set_012,    (float *)&sr.status_report_verbosity,SR_VERBOSITY },
+	{ "sys","lei", _f07, 0, le_print_lei, get_int,   set_int,    (float *)&le.interval,				LINE_EVENT_INTERVAL },
+	{ "sys","sv",  _f07, 0, sr_print_sv,  get_ui8,   sr_set_sv,  (float *)&sr.status_report_verbosity,SR_VERBOSITY },
 	{ "sys","si",  _f07, 0, sr_print_si,  get_int,   sr_set_si,  (float *)&sr.status_report_interval,STATUS_REPORT_INTERVAL_MS },
+	{ "sys","sim", _f07, 0, sr_print_sim, get_int,   sr_set_sim, (float *)&sr.status_report_interval_max,STATUS_REPORT_INTERVAL_MAX_MS },
+#ifdef __UART_DEVICES
+	{ "sys","u1m", _f07, 0, uart_print_um,get_ui8,   uart_set_um,(float *)&uart.port[UART_1].mode,	UART1_MODE },
+	{ "sys","u1b", _f07, 0, uart_print_ub,get_flt,   uart_set_ub,(float *)&uart.port[UART_1].baud,	UART1_BAUD },
+	{ "",   "u1e", _f00, 0, tx_print_int, get_int,   set_nul,    (float *)&uart.port[UART_1].errors, 0 },	// receive errors - see uart.h
+	{ "sys","u2m", _f07, 0, uart_print_um,get_ui8,   uart_set_um,(float *)&uart.port[UART_2].mode,	UART2_MODE },
+	{ "sys","u2b", _f07, 0, uart_print_ub,get_flt,   uart_set_ub,(float *)&uart.port[UART_2].baud,	UART2_BAUD },
+	{ "",   "u2e", _f00, 0, tx_print_int, get_int,   set_nul,    (float *)&uart.port[UART_2].errors, 0 },
+#endif
 
 //	{ "sys","ic",  _f07, 0, print_ui8,    get_ui8,   set_ic,     (float *)&cfg.ignore_crlf,			COM_IGNORE_CRLF },
 //	{ "sys","ec",  _f07, 0, co_print_ec,  get_ui8,   set_ec,     (float *)&cfg.enable_cr,			COM_EXPAND_CR },
@@ -428,6 +899,7 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "sys","gco", _f07, 0, cm_print_gco, get_ui8, set_ui8, (float *)&cm.coord_system,	GCODE_DEFAULT_COORD_SYSTEM },
 	{ "sys","gpa", _f07, 0, cm_print_gpa, get_ui8, set_012, (float *)&cm.path_control,	GCODE_DEFAULT_PATH_CONTROL },
 	{ "sys","gdi", _f07, 0, cm_print_gdi, get_ui8, set_01,  (float *)&cm.distance_mode,	GCODE_DEFAULT_DISTANCE_MODE },
+	{ "sys","gtr", _f07, 0, cm_print_gtr, get_ui8, set_01,  (float *)&cm.rapid_mode,	RAPID_MODE },
 	{ "",   "gc",  _f00, 0, tx_print_nul, gc_get_gc, gc_run_gc,(float *)&cs.null, 0 }, // gcode block - must be last in this group
 
 	// "hidden" parameters (not in system group)
@@ -435,6 +907,7 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "",   "ml",  _fip, 4, cm_print_ml,  get_flu, set_flu, (float *)&cm.min_segment_len,		MIN_LINE_LENGTH },
 	{ "",   "ma",  _fip, 4, cm_print_ma,  get_flu, set_flu, (float *)&cm.arc_segment_len,		ARC_SEGMENT_LENGTH },
 	{ "",   "fd",  _fip, 0, tx_print_ui8, get_ui8, set_01,  (float *)&js.json_footer_depth,		JSON_FOOTER_DEPTH },
+	{ "",   "ja",  _fip, 0, tx_print_ui8, get_ui8, set_ui8, (float *)&js.ack_coalesce,			JSON_ACK_COALESCE },
 
 	// Persistence for status report - must be in sequence
 	// *** Count must agree with CMD_STATUS_REPORT_LEN in config.h ***
@@ -493,12 +966,20 @@ const cfgItem_t cfgArray[] PROGMEM = {
 	{ "","g58",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },
 	{ "","g59",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },
 	{ "","g92",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// origin offsets
+	{ "","tof",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// tool table
 	{ "","g28",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// g28 home position
 	{ "","g30",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// g30 home position
 	{ "","mpo",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// machine position group
 	{ "","pos",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// work position group
 	{ "","ofs",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// work offset group
 	{ "","hom",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// axis homing state group
+	{ "","prb",_f00, 0, tx_print_nul, get_grp, set_grp,(float *)&cs.null,0 },	// probe position group
+	{ "","ps", _f00, 0, tx_print_nul, get_grp, set_nul,(float *)&cs.null,0 },	// planner stats group
+	{ "","js", _f00, 0, tx_print_nul, get_grp, set_nul,(float *)&cs.null,0 },	// job stats group
+	{ "","mem",_f00, 0, tx_print_nul, get_grp, set_nul,(float *)&cs.null,0 },	// memory usage group
+#ifdef __PROFILER
+	{ "","pf", _f00, 0, tx_print_nul, get_grp, set_nul,(float *)&cs.null,0 },	// profiler group
+#endif
 
 	// Uber-group (groups of groups, for text-mode displays only)
 	// *** Must agree with CMD_COUNT_UBER_GROUPS below ****
@@ -510,7 +991,11 @@ const cfgItem_t cfgArray[] PROGMEM = {
 
 /***** Make sure these defines line up with any changes in the above table *****/
 
-#define CMD_COUNT_GROUPS 		27		// count of simple groups
+#ifdef __PROFILER
+#define CMD_COUNT_GROUPS 		33		// count of simple groups
+#else
+#define CMD_COUNT_GROUPS 		32		// count of simple groups
+#endif
 #define CMD_COUNT_UBER_GROUPS 	4 		// count of uber-groups
 
 /* <DO NOT MESS WITH THESE DEFINES> */
@@ -520,10 +1005,29 @@ const cfgItem_t cfgArray[] PROGMEM = {
 #define CMD_INDEX_START_UBER_GROUPS (CMD_INDEX_MAX - CMD_COUNT_UBER_GROUPS)
 /* </DO NOT MESS WITH THESE DEFINES> */
 
+// token hash slots - the power of 2 at or above twice the table, so it is never more than half full
+#define CMD_HASH_SIZE ( ((2*CMD_INDEX_MAX) <= 256)  ? 256 :\
+						((2*CMD_INDEX_MAX) <= 512)  ? 512 :\
+						((2*CMD_INDEX_MAX) <= 1024) ? 1024 :\
+						((2*CMD_INDEX_MAX) <= 2048) ? 2048 : 4096 )
+
+// compile-time checks on the table sizing - a negative array size means the check failed
+typedef char cmd_hash_size_check[(CMD_HASH_SIZE >= (2*CMD_INDEX_MAX)) ? 1 : -1];
+typedef char cmd_hash_pow2_check[((CMD_HASH_SIZE & (CMD_HASH_SIZE-1)) == 0) ? 1 : -1];
+typedef char cmd_index_size_check[(CMD_INDEX_MAX < NO_MATCH) ? 1 : -1];
+typedef char cmd_nvm_size_check[(CMD_INDEX_MAX <= NVM_INDEX_MAX) ? 1 : -1];	// every index can be persisted
+
+index_t cfgHash[CMD_HASH_SIZE];					// token hash table - built by cmd_index_init()
+const index_t cfgHashMask = CMD_HASH_SIZE - 1;
+index_t cfgGroupList[CMD_INDEX_END_SINGLES+1];	// group member lists - built by cmd_index_init()
+index_t cfgGroupStart[CMD_COUNT_GROUPS+1];		// list offsets per group (+1 for the end)
+
 index_t	cmd_index_max() { return ( CMD_INDEX_MAX );}
 uint8_t cmd_index_is_single(index_t index) { return ((index <= CMD_INDEX_END_SINGLES) ? true : false);}
 uint8_t cmd_index_is_group(index_t index) { return (((index >= CMD_INDEX_START_GROUPS) && (index < CMD_INDEX_START_UBER_GROUPS)) ? true : false);}
 uint8_t cmd_index_lt_groups(index_t index) { return ((index <= CMD_INDEX_START_GROUPS) ? true : false);}
+index_t cmd_index_start_groups() { return (CMD_INDEX_START_GROUPS);}
+index_t cmd_index_count_groups() { return (CMD_COUNT_GROUPS);}
 
 
 /**** UberGroup Operations ****************************************************
@@ -569,7 +1073,7 @@ static stat_t _do_axes(cmdObj_t *cmd)	// print parameters for all axis groups
 
 static stat_t _do_offsets(cmdObj_t *cmd)	// print offset parameters for G54-G59,G92, G28, G30
 {
-	char list[][CMD_TOKEN_LEN+1] = {"g54","g55","g56","g57","g58","g59","g92","g28","g30",""}; // must have a terminating element
+	char list[][CMD_TOKEN_LEN+1] = {"g54","g55","g56","g57","g58","g59","g92","g28","g30","tof",""}; // must have a terminating element
 	return (_do_group_list(cmd, list));
 }
 
@@ -601,7 +1105,7 @@ static stat_t _do_all(cmdObj_t *cmd)	// print all parameters
  * set_ee() - enable character echo
  * set_ex() - enable XON/XOFF or RTS/CTS flow control
  * set_baud() - set USB baud rate
- * get_rx()	- get bytes available in RX buffer
+ * get_rx()	- get input lines that can be accepted (see controller_get_rx_lines())
  *
  *	The above assume USB is the std device
  */
@@ -653,14 +1157,15 @@ static stat_t set_ex(cmdObj_t *cmd)				// enable XON/XOFF or RTS/CTS flow contro
 	cfg.enable_flow_control = (uint8_t)cmd->value;
 	return(_set_comm_helper(cmd, XIO_XOFF, XIO_NOXOFF));
 }
+*/
 
 static stat_t get_rx(cmdObj_t *cmd)
 {
-	cmd->value = (float)xio_get_usb_rx_free();
+	cmd->value = (float)controller_get_rx_lines();
 	cmd->objtype = TYPE_INTEGER;
 	return (STAT_OK);
 }
-*/
+
 /* run_sx()	- send XOFF, XON --- test only 
 static stat_t run_sx(cmdObj_t *cmd)
 {
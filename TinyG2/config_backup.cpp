@@ -0,0 +1,214 @@
+/*
+ * config_backup.cpp - the persisted configuration backed up and restored as one blob
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See config_backup.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "stepper.h"
+#include "kinematics.h"
+#include "shaper.h"
+#include "persistence.h"
+#include "util.h"
+#include "config_backup.h"
+
+#ifdef __CONFIG_BACKUP
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+cbSingleton_t cb;
+
+/*
+ * _is_persisted() - TRUE if the item at the index goes in the blob
+ * _blob_length()  - length of a blob of count values
+ */
+static uint8_t _is_persisted(cmdObj_t *cmd)
+{
+	return ((cmd_index_lt_groups(cmd->index) && (GET_TABLE_BYTE(flags) & F_PERSIST)) ? true : false);
+}
+
+static uint16_t _blob_length(uint16_t count) { return (CB_HEADER_LEN + (count * sizeof(float)) + 2);}
+
+static uint8_t _machine_is_idle()
+{
+	return (((cm.cycle_state == CYCLE_OFF) && (mp_get_runtime_busy() == false)) ? true : false);
+}
+
+/*
+ * _build_blob() - put the persisted values in cb.blob and return its length
+ *
+ *	The whole table goes in. It is never larger than NVM_INDEX_MAX (checked at compile
+ *	time in config_app.cpp), so neither are the persisted values and cb.blob holds them.
+ */
+static uint16_t _build_blob()
+{
+	cmdObj_t item;
+	cmdObj_t *cmd = &item;
+	memset(cmd, 0, sizeof(cmdObj_t));
+	uint16_t count = 0;
+	uint16_t size = cmd_index_max();
+	float build = TINYG_FIRMWARE_BUILD;
+	uint8_t *dst = &cb.blob[CB_HEADER_LEN];
+
+	for (cmd->index=0; cmd->index < size; cmd->index++) {
+		if (_is_persisted(cmd) == false) { continue;}
+		cmd_read_NVM_value(cmd);
+		if (isnan(cmd->value)) { cmd->value = GET_TABLE_FLOAT(def_value);}	// as config_init() loads it
+		memcpy(dst, &cmd->value, sizeof(float));
+		dst += sizeof(float);
+		count++;
+	}
+	uint16_t magic = CB_MAGIC;
+	memcpy(&cb.blob[0], &magic, sizeof(uint16_t));
+	memcpy(&cb.blob[2], &count, sizeof(uint16_t));
+	memcpy(&cb.blob[4], &size, sizeof(uint16_t));
+	memcpy(&cb.blob[6], &build, sizeof(float));
+	uint16_t checksum = compute_fletcher16(cb.blob, dst - cb.blob);
+	*dst++ = (uint8_t)(checksum & 0xFF);
+	*dst++ = (uint8_t)(checksum >> 8);
+	return (dst - cb.blob);
+}
+
+/*
+ * _apply_blob() - check the imported blob and apply it. Returns the values applied in count
+ *
+ *	Items are restored as at boot, in MM mode - F_INITIALIZE items are put in their
+ *	targets, and all of them are persisted. What is worked out from the settings is
+ *	set up after.
+ */
+static stat_t _apply_blob(uint16_t *count)
+{
+	uint16_t magic, size, checksum;
+	float build;
+	memcpy(&magic, &cb.blob[0], sizeof(uint16_t));
+	memcpy(count, &cb.blob[2], sizeof(uint16_t));
+	memcpy(&size, &cb.blob[4], sizeof(uint16_t));
+	memcpy(&build, &cb.blob[6], sizeof(float));
+
+	uint16_t length = _blob_length(*count);
+	memcpy(&checksum, &cb.blob[length - 2], sizeof(uint16_t));
+	if (checksum != compute_fletcher16(cb.blob, length - 2)) { return (STAT_CHECKSUM_MATCH_FAILED);}
+	if ((magic != CB_MAGIC) || (size != cmd_index_max()) || fp_NE(build, TINYG_FIRMWARE_BUILD)) {
+		return (STAT_INPUT_VALUE_UNSUPPORTED);				// another firmware's table
+	}
+	if (_machine_is_idle() == false) { return (STAT_COMMAND_NOT_ACCEPTED);}
+
+	cmdObj_t item;
+	cmdObj_t *cmd = &item;
+	memset(cmd, 0, sizeof(cmdObj_t));
+	uint16_t n = 0;
+	for (cmd->index=0; cmd->index < size; cmd->index++) {
+		if (_is_persisted(cmd) == true) { n++;}
+	}
+	if (n != *count) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+
+	uint8_t units_mode = cm_get_units_mode(MODEL);
+	cm_set_units_mode(MILLIMETERS);							// must do inits in MM mode
+	const uint8_t *src = &cb.blob[CB_HEADER_LEN];
+	for (cmd->index=0; cmd->index < size; cmd->index++) {
+		if (_is_persisted(cmd) == false) { continue;}
+		cmd->objtype = TYPE_FLOAT;
+		memcpy(&cmd->value, src, sizeof(float));
+		src += sizeof(float);
+		if (GET_TABLE_BYTE(flags) & F_INITIALIZE) { cmd_restore_value(cmd);}
+		cmd_persist(cmd);
+	}
+	cm_set_units_mode(units_mode);
+
+	ik_set_motor_map();										// motor map and soft limits in steps
+	st_apply_config();										// microsteps, motor power and step timing
+#ifdef __INPUT_SHAPING
+	sh_set_shapers();
+#endif
+	return (STAT_OK);
+}
+
+/*
+ * cb_get_cfx() - send the blob as {"cfi":...} lines and return its length ({"cfx":""})
+ * cb_set_cfi() - take one chunk of an import, and apply the blob once it is all in ({"cfi":"..."})
+ *
+ *	An export discards any import in progress - they share the blob. A chunk out of
+ *	order, or a blob that does not check, also ends the import.
+ */
+stat_t cb_get_cfx(cmdObj_t *cmd)
+{
+	uint8_t chunk[sizeof(uint16_t) + CB_CHUNK_DATA];
+	char_t text[((sizeof(chunk) + 2) / 3) * 4 + 1];
+
+	cb.received = 0;
+	uint16_t length = _build_blob();
+	for (uint16_t offset=0; offset < length; offset += CB_CHUNK_DATA) {
+		uint16_t n = min(CB_CHUNK_DATA, length - offset);
+		memcpy(&chunk[0], &offset, sizeof(uint16_t));
+		memcpy(&chunk[2], &cb.blob[offset], n);
+		encode_base64(text, chunk, n + sizeof(uint16_t));
+		printf_P(PSTR("{\"cfi\":\"%s\"}\n"), (char *)text);
+	}
+	cmd->value = (float)length;
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+stat_t cb_set_cfi(cmdObj_t *cmd)
+{
+	uint8_t chunk[sizeof(uint16_t) + CB_CHUNK_DATA];
+	uint16_t length, offset;
+
+	if (cmd->objtype != TYPE_STRING) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	ritorno(decode_base64(*cmd->stringp, chunk, sizeof(chunk), &length));
+	if (length <= sizeof(uint16_t)) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	memcpy(&offset, &chunk[0], sizeof(uint16_t));
+	length -= sizeof(uint16_t);
+
+	if (offset == 0) { cb.received = 0;}					// a new import
+	if ((offset != cb.received) || (offset + length > CB_BLOB_MAX)) {
+		cb.received = 0;
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	memcpy(&cb.blob[offset], &chunk[2], length);
+	cb.received += length;
+
+	cmd->objtype = TYPE_INTEGER;
+	cmd->value = (float)cb.received;
+	if (cb.received < CB_HEADER_LEN) { return (STAT_OK);}
+	uint16_t count;
+	memcpy(&count, &cb.blob[2], sizeof(uint16_t));
+	if (count > NVM_INDEX_MAX) {
+		cb.received = 0;
+		return (STAT_INPUT_VALUE_UNSUPPORTED);
+	}
+	if (cb.received < _blob_length(count)) { return (STAT_OK);}
+	if (cb.received > _blob_length(count)) {
+		cb.received = 0;
+		return (STAT_INPUT_VALUE_TOO_LARGE);
+	}
+	cb.received = 0;
+	stat_t status = _apply_blob(&count);
+	cmd->value = (float)count;
+	return (status);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __CONFIG_BACKUP
@@ -0,0 +1,86 @@
+/*
+ * config_backup.h - the persisted configuration backed up and restored as one blob
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The config backup is enabled by __CONFIG_BACKUP in tinyg2.h. Every persisted item of
+ * the config table (F_PERSIST) goes out as one blob, so a machine is backed up, or its
+ * settings cloned onto the next one, with one command and one replay - not a $$ dump
+ * and a few hundred $ settings each answered in turn:
+ *
+ *	{"cfx":""}		export - sends the blob as {"cfi":...} lines ahead of the response,
+ *					which is the length of the blob in bytes
+ *	{"cfi":"..."}	import one chunk - send the exported lines back, in order. Each is
+ *					answered with the bytes received, and the last with the items applied
+ *
+ * The blob is binary, all multi-byte fields little-endian, floats IEEE 754 single:
+ *
+ *	uint16		CB_MAGIC
+ *	uint16		count of values - the persisted items of the config table
+ *	uint16		size of the config table (cmd_index_max()) - all of it is backed up
+ *	float		firmware build (TINYG_FIRMWARE_BUILD)
+ *	float ...	the value of each persisted item, in table order
+ *	uint16		Fletcher-16 over everything before it. Low byte is sum1
+ *
+ * It is carried base64 encoded so it passes through the line reader on any port. Each
+ * chunk is a uint16 offset into the blob followed by up to CB_CHUNK_DATA bytes of it -
+ * 240 characters, which fits the input line. A chunk at offset 0 starts a new import.
+ *
+ * Nothing is applied until the whole blob is in and its checksum, build and table size
+ * match this firmware - the values are indexes into the table, as in NVM. It is then
+ * applied in one pass through the path config_init() takes at boot (cmd_restore_value())
+ * and persisted. The kinematics map, the motor settings and the shapers are set up after,
+ * as a machine profile load does. An import is only taken with the machine idle - else
+ * STAT_COMMAND_NOT_ACCEPTED - and the main loop is held while the NVM pages are written.
+ *
+ * Values are exported as persisted. An item that has never been written exports its
+ * default, as it would load at boot.
+ */
+
+#ifndef CONFIG_BACKUP_H_ONCE
+#define CONFIG_BACKUP_H_ONCE
+
+#include "persistence.h"				// NVM_INDEX_MAX
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __CONFIG_BACKUP
+
+#define CB_MAGIC			0x4643		// "CF"
+#define CB_HEADER_LEN		10			// magic, count, table size, build
+#define CB_BLOB_MAX			(CB_HEADER_LEN + (NVM_INDEX_MAX * sizeof(float)) + 2)
+#define CB_CHUNK_DATA		176			// blob bytes per chunk - with the offset, 240 base64 characters
+
+typedef struct cbSingleton {
+	uint16_t received;					// bytes of the import received - the next offset expected
+	uint8_t blob[CB_BLOB_MAX];			// blob being exported or imported
+} cbSingleton_t;
+
+extern cbSingleton_t cb;
+
+stat_t cb_get_cfx(cmdObj_t *cmd);
+stat_t cb_set_cfi(cmdObj_t *cmd);
+
+#endif // __CONFIG_BACKUP
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: CONFIG_BACKUP_H_ONCE
@@ -38,11 +38,29 @@
 #include "stepper.h"
 #include "hardware.h"
 #include "switch.h"
+#include "spindle.h"
 //#include "gpio.h"
 #include "report.h"
 #include "help.h"
 #include "util.h"
 #include "xio.h"
+#include "persistence.h"
+#include "profiler.h"
+#include "raster.h"
+#include "pso.h"
+#include "binary_stream.h"
+#include "program_store.h"
+#include "gcode_macro.h"
+#include "tmc2660.h"
+#include "checkpoint.h"
+#include "memguard.h"
+#include "adc.h"
+#include "latency.h"
+#include "frame.h"
+#include "stepq.h"
+#include "stress.h"
+#include "replay.h"
+#include "selfbench.h"
 
 #include "Reset.h"
 
@@ -61,9 +79,14 @@ static stat_t _alarm_idler(void);
 static stat_t _normal_idler(void);
 static stat_t _limit_switch_handler(void);
 static stat_t _system_assertions(void);
-static stat_t _sync_to_planner(void);
+static stat_t _sync_to_planner(uint8_t buffers);
 static stat_t _sync_to_tx_buffer(void);
+static stat_t _gcode_queue_dispatch(void);
+static stat_t _read_line(void);
+static void _respond_to(uint8_t src);
 static stat_t _command_dispatch(void);
+static void _idle_sleep(void);
+static void _motion_tasks(void);
 
 // prep for export to other modules:
 stat_t hardware_hard_reset_handler(void);
@@ -80,12 +103,16 @@ void controller_init(uint8_t std_in, uint8_t std_out, uint8_t std_err)
 {
 	cs.magic_start = MAGICNUM;
 	cs.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_CONTROLLER, cs);
 	cs.fw_build = TINYG_FIRMWARE_BUILD;
 	cs.fw_version = TINYG_FIRMWARE_VERSION;
 	cs.hw_platform = TINYG_HARDWARE_PLATFORM;		// NB: HW version is set from EEPROM
 	
 	cs.linelen = 0;									// initialize index for read_line()
 	cs.state = CONTROLLER_NOT_CONNECTED;			// find USB next
+	for (uint8_t i=0; i<TASK_COUNT; i++) {			// run every task once so it can go idle
+		cs.task_ready[i] = true;
+	}
 //	cs.reset_requested = false;
 //	cs.bootloader_requested = false;
 
@@ -113,16 +140,44 @@ void controller_init(uint8_t std_in, uint8_t std_out, uint8_t std_err)
  * and runs the next routine in the list.
  *
  * A routine that had no action (i.e. is OFF or idle) should return STAT_NOOP
+ *
+ * DISPATCH_READY only calls tasks whose ready flag is set - see controller_request_task().
+ * The flag is cleared before the call and set again unless the task returns STAT_NOOP,
+ * so a task keeps running while it has work (or is waiting on something), and is 
+ * skipped once it goes idle until the code that gives it work requests it again. 
+ * A request made from an ISR while the task is running is never lost.
+ *
+ * Tasks that only poll timers run once per millisecond SysTick rather than every pass.
+ *
+ * With __PROFILER each task is wrapped in PROFILE() and the whole pass is timed as 
+ * well - see profiler.h. PROFILE() compiles to the plain call otherwise.
+ *
+ * With __IDLE_SLEEP the loop sleeps between passes once there is nothing to do -
+ * see _idle_sleep(). The sleep is outside the PF_HSM time.
+ *
+ * The tasks that feed the planner run ahead of the reports, so a report never 
+ * delays motion within a pass. With __MOTION_YIELD they also run while output
+ * waits on the host - see controller_yield().
  */
 
 void controller_run() 
 { 
 	while (true) { 
+		PROFILE_START;
 		_controller_HSM();
+		PROFILE_END(PF_HSM);
+		_idle_sleep();
 	}
 }
 
 #define	DISPATCH(func) if (func == STAT_EAGAIN) return; 
+#define	DISPATCH_READY(task,func) if (cs.task_ready[task] == true) {\
+			cs.task_ready[task] = false;\
+			stat_t _status = func;\
+			if (_status != STAT_NOOP) { cs.task_ready[task] = true;}\
+			if (_status == STAT_EAGAIN) return;\
+		}
+
 static void _controller_HSM()
 {
 //----- Interrupt Service Routines are the highest priority controller functions ----//
@@ -130,42 +185,68 @@ static void _controller_HSM()
 //
 //----- kernel level ISR handlers ----(flags are set in ISRs)------------------------//
 												// Order is important:
-	DISPATCH(hw_hard_reset_handler());			// 1. handle hard reset requests
-//	DISPATCH(hw_bootloader_handler());			// 2. handle requests to enter bootloader
-	DISPATCH(_alarm_idler());					// 3. idle in alarm state (shutdown)
-	DISPATCH( poll_switches());					// 4. run a switch polling cycle
-	DISPATCH(_limit_switch_handler());			// 5. limit switch has been thrown
-
-	DISPATCH(cm_feedhold_sequencing_callback());// 6a. feedhold state machine runner
-	DISPATCH(mp_plan_hold_callback());			// 6b. plan a feedhold from line runtime
-	DISPATCH(_system_assertions());				// 7. system integrity assertions
+	DISPATCH(PROFILE(PF_HARD_RESET, hw_hard_reset_handler()));	// 1. handle hard reset requests
+	DISPATCH_READY(TASK_EXCEPTION, PROFILE(PF_EXCEPTION, rpt_exception_callback()));// 2a. send queued exception reports, alarms included
+//	DISPATCH(hw_bootloader_handler());							// 2. handle requests to enter bootloader
+	DISPATCH(PROFILE(PF_ALARM, _alarm_idler()));				// 3. idle in alarm state (shutdown)
+	DISPATCH(PROFILE(PF_LIMIT, _limit_switch_handler()));		// 5. limit switch has been thrown
+	DISPATCH(PROFILE(PF_RX, xio_rx_callback()));				// 5a. read USB input and act on !, ~ and % signals
+	DISPATCH(PROFILE(PF_TX, xio_tx_callback()));				// 5b. send buffered output to USB
+
+	DISPATCH(PROFILE(PF_FEEDHOLD, cm_feedhold_sequencing_callback()));// 6a. feedhold state machine runner
+	DISPATCH_READY(TASK_PLAN_HOLD, PROFILE(PF_PLAN_HOLD, mp_plan_hold_callback()));	// 6b. plan a feedhold from line runtime
+	DISPATCH_READY(TASK_PLAN_OVERRIDE, PROFILE(PF_PLAN_OVERRIDE, mp_plan_override_callback()));// 6c. replan a feed rate override
+	DISPATCH_READY(TASK_PLAN_TRAPEZOID, PROFILE(PF_PLAN_TRAPEZOID, mp_plan_trapezoid_callback()));// 6d. plan the block the exec waits on
+	DISPATCH(PROFILE(PF_ASSERTIONS, _system_assertions()));	// 7. system integrity assertions
 
 //----- planner hierarchy for gcode and cycles ---------------------------------------//
 
-	DISPATCH(st_motor_power_callback());		// stepper motor power sequencing
-//	DISPATCH(switch_debounce_callback());		// debounce switches
-	DISPATCH(sr_status_report_callback());		// conditionally send status report
-	DISPATCH(qr_queue_report_callback());		// conditionally send queue report
-	DISPATCH(cm_arc_callback());				// arc generation runs behind lines
-	DISPATCH(cm_homing_callback());				// G28.2 continuation
-//	DISPATCH(cm_probe_callback());				// G38.2 continuation
+	if (SysTickTimer.getValue() != cs.task_tick) {	// millisecond tasks
+		cs.task_tick = SysTickTimer.getValue();
+		DISPATCH(PROFILE(PF_MOTOR_POWER, st_motor_power_callback()));	// stepper motor power sequencing
+		DISPATCH_READY(TASK_SPINDLE, PROFILE(PF_SPINDLE, cm_spindle_callback()));	// restart a move held for spindle speed
+		DISPATCH(PROFILE(PF_CHECKPOINT, CHECKPOINT_CALLBACK()));		// write job checkpoints to flash
+		DISPATCH(PROFILE(PF_LOAD_FEED, LOAD_FEED_CALLBACK()));		// scale feed to spindle load
+	}
+	DISPATCH(PROFILE(PF_MOTOR_DRIVERS, TMC_CALLBACK()));		// queue SPI motor driver register writes
+	DISPATCH_READY(TASK_COALESCE, PROFILE(PF_COALESCE, mp_coalesce_callback()));	// plan held G1 runs before the planner runs dry
+	DISPATCH_READY(TASK_ARC, PROFILE(PF_ARC, cm_arc_callback()));				// arc generation runs behind lines
+	DISPATCH_READY(TASK_CANNED_CYCLE, PROFILE(PF_CANNED_CYCLE, cm_canned_cycle_callback()));// G73, G81-G83 hole moves
+	DISPATCH_READY(TASK_SPLINE, PROFILE(PF_SPLINE, cm_spline_callback()));		// G5, G5.1 curve segments
+	DISPATCH_READY(TASK_JOG, PROFILE(PF_JOG, mp_jog_callback()));				// end a jog cycle once the axes stop
+	DISPATCH(PROFILE(PF_STRESS, STRESS_CALLBACK()));			// stress test load and result
+	DISPATCH(PROFILE(PF_REPLAY, RP_CALLBACK()));				// program the segment cache, end a replay
+	DISPATCH(PROFILE(PF_SELF_BENCH, SB_CALLBACK()));			// run the self benchmark
+	DISPATCH_READY(TASK_HOMING, PROFILE(PF_HOMING, cm_homing_callback()));		// G28.2 continuation
+	DISPATCH_READY(TASK_PERSISTENCE, PROFILE(PF_PERSISTENCE, persistence_callback()));// program NVM writes when idle
+	DISPATCH_READY(TASK_PROBE, PROFILE(PF_PROBE, cm_probe_callback()));			// G38.2 continuation
+	DISPATCH_READY(TASK_STATUS_REPORT, PROFILE(PF_STATUS_REPORT, sr_status_report_callback()));// conditionally send status report
+	DISPATCH_READY(TASK_QUEUE_REPORT, PROFILE(PF_QUEUE_REPORT, qr_queue_report_callback()));	// conditionally send queue report
+	DISPATCH_READY(TASK_JOB_REPORT, PROFILE(PF_JOB_REPORT, rpt_job_report_callback()));	// send the job stats at program end
+	DISPATCH_READY(TASK_PLAN_DUMP, PROFILE(PF_PLAN_DUMP, pq_dump_callback()));	// send the next rows of a planner queue dump
+	DISPATCH_READY(TASK_LINE_EVENT, PROFILE(PF_LINE_EVENT, le_line_event_callback()));// send events for finished lines
 
 //----- command readers and parsers --------------------------------------------------//
 
-	DISPATCH(_sync_to_planner());				// ensure there is at least one free buffer in planning queue
-	DISPATCH(_sync_to_tx_buffer());				// sync with TX buffer (pseudo-blocking)
-//	DISPATCH(set_baud_callback());				// perform baud rate update (must be after TX sync)
-	DISPATCH(_command_dispatch());				// read and execute next command
-	DISPATCH(_normal_idler());					// blink LEDs slowly to show everything is OK
+	DISPATCH(PROFILE(PF_SYNC_TX, _sync_to_tx_buffer()));		// sync with TX buffer (pseudo-blocking)
+//	DISPATCH(set_baud_callback());								// perform baud rate update (must be after TX sync)
+	DISPATCH(PROFILE(PF_GCODE_QUEUE, _gcode_queue_dispatch()));	// execute parsed Gcode blocks as planner buffers free up
+	DISPATCH(PROFILE(PF_BINARY_STREAM, BINARY_STREAM()));		// run binary motion frames from the USB vendor interface
+	DISPATCH(PROFILE(PF_COMMAND, _command_dispatch()));		// read and execute next command
+	DISPATCH(PROFILE(PF_IDLER, _normal_idler()));				// blink LEDs slowly to show everything is OK
 }
 
 /***************************************************************************** 
  * _command_dispatch() - dispatch line received from active input device
  *
  *	Reads next command line and dispatches to relevant parser or action
- *	Accepts commands if the move queue has room - EAGAINS if it doesn't
- *	Manages cutback to serial input from file devices (EOF)
+ *	Manages cutback to serial input from macros and the program store (EOF) - see _read_line()
  *	Also responsible for prompts and for flow control 
+ *
+ *	Gcode blocks are parsed into the Gcode block queue as soon as they are read,
+ *	even if the planner is full - see _gcode_queue_dispatch(). All other lines 
+ *	are held in the input buffer until the queued blocks have run and the move 
+ *	queue has room, so commands are still executed in the order received.
  */
 
 static stat_t _command_dispatch()
@@ -175,15 +256,43 @@ static stat_t _command_dispatch()
 
 	// read input line or return if not a completed line
 	if (cs.state == CONTROLLER_READY) {
-		if (read_line(cs.in_buf, &cs.linelen, sizeof(cs.in_buf)) != STAT_OK) {
-			cs.bufp = cs.in_buf;
-			return (STAT_OK);	// returns OK for anything NOT OK, so the idler always runs
+		if (cs.line_pending == false) {
+			if (gc_get_queued_blocks() >= GCODE_QUEUE_SIZE) { return (STAT_OK);} // no room to parse another block
+			if (_read_line() != STAT_OK) {
+				cs.bufp = cs.in_buf;
+				return (STAT_OK);	// returns OK for anything NOT OK, so the idler always runs
+			}
+			LATENCY_RX();
+			if ((cs.primary_src == DEV_STDIN) && (FRAME_LINE(cs.in_buf) != STAT_OK)) {
+				cs.linelen = 0;
+				return (STAT_OK);	// dropped as damaged or out of sequence - see frame.h
+			}
+			cs.line_pending = true;
 		}
+		if (controller_is_gcode_line(cs.bufp) == true) {
+			gc_queue_gcode_block(cs.bufp, cs.primary_src);
+			cs.line_pending = false;
+			cs.linelen = 0;
+			return (_gcode_queue_dispatch());	// run it now if the planner has room
+		}
+		if ((gc_get_queued_blocks() != 0) || (_sync_to_planner(PLANNER_BUFFER_HEADROOM) == STAT_EAGAIN) || (RASTER_HOLD(cs.bufp)) || (PSO_HOLD(cs.bufp)) || (SQ_HOLD(cs.bufp))) {
+			return (STAT_OK);	// hold the line until the queued blocks have run (or a raster row, pso event or step queue is free)
+		}
+		LATENCY_QUEUE();
+		cs.line_pending = false;
 
 	} else if (cs.state == CONTROLLER_NOT_CONNECTED) {
 		if (SerialUSB.isConnected() == false) return (STAT_OK);
-		cm_request_queue_flush();
+		if (FRAME_ENABLED() == false) {
+			cm_request_queue_flush();
+			gc_flush_queue();
+			cs.line_pending = false;
+		} else if (cs.line_pending == false) {
+			cs.linelen = 0;				// framed lines carry on - drop the partial one
+		}
+		cs.boot_ready_ms = SysTickTimer.getValue();
 		rpt_print_system_ready_message();
+		FRAME_RECONNECT();
 		cs.state = CONTROLLER_STARTUP;
 
 	} else if (cs.state == CONTROLLER_STARTUP) {		// run startup code
@@ -201,12 +310,14 @@ static stat_t _command_dispatch()
 //	strncpy(cs.saved_buf, cs.in_buf, SAVED_BUFFER_LEN-1);	// save input buffer for reporting
 	strncpy(cs.saved_buf, cs.bufp, SAVED_BUFFER_LEN-1);	// save input buffer for reporting
 	cs.linelen = 0;
+	SR_MODAL_CHANGED();
+	_respond_to(cs.primary_src);
 
 	// dispatch the new text line
 	switch (toupper(*cs.bufp)) {				// first char
 
 		case NUL: { 							// blank line (just a CR)
-			if (cfg.comm_mode != JSON_MODE) {
+			if (cfg.comm_mode == TEXT_MODE) {
 				text_response(STAT_OK, cs.saved_buf);
 			}
 			break;
@@ -219,27 +330,218 @@ static stat_t _command_dispatch()
 		}
 		case '$': case '?':{ 					// text-mode configs
 			cfg.comm_mode = TEXT_MODE;
-			text_response(text_parser(cs.bufp), cs.saved_buf);
+			stat_t status = text_parser(cs.bufp);
+			if (cmd_text_list_end() == true) {	// a listing filled the TX buffer - run the line again
+				cs.line_pending = true;			// for the rest once it drains (see get_grp())
+				break;
+			}
+			text_response(status, cs.saved_buf);
+			LATENCY_EMIT();
 			break;
 		}
 		case '{': { 							// JSON input
-			cfg.comm_mode = JSON_MODE;
+			if (cfg.comm_mode == TEXT_MODE) { cfg.comm_mode = JSON_MODE;}	// relaxed JSON stays relaxed
 			json_parser(cs.bufp);
+			LATENCY_EMIT();
 			break;
 		}
 		default: {								// anything else must be Gcode
-			if (cfg.comm_mode == JSON_MODE) {
-				strncpy(cs.out_buf, cs.bufp, INPUT_BUFFER_LEN -8);					// use out_buf as temp
-				sprintf((char *)cs.bufp,"{\"gc\":\"%s\"}\n", (char *)cs.out_buf);	// '-8' is used for JSON chars
-				json_parser(cs.bufp);
+			if (cfg.comm_mode != TEXT_MODE) {
+				json_gcode_parser(cs.bufp);		// responds as if wrapped in {"gc":"..."}
 			} else {
 				text_response(gc_gcode_parser(cs.bufp), cs.saved_buf);
 			}
 		}
 	}
+	_respond_to(DEV_STDIN);
+	return (STAT_OK);
+}
+
+/*
+ * _read_line() - read the next line from the macro body or the stored program being run, else from serial
+ *
+ *	Serial lines come from whichever xio device has one (see read_line()), and the
+ *	source is the device's - DEV_STDIN for USB, DEV_USB1, DEV_UART1 or DEV_UART2.
+ */
+
+static stat_t _read_line()
+{
+#ifdef __GCODE_MACROS
+	if (MC_IS_REPLAYING()) {
+		cs.primary_src = DEV_MACRO;
+		return (mc_read_line(cs.in_buf, &cs.linelen, sizeof(cs.in_buf)));
+	}
+#endif
+#ifdef __PROGRAM_STORE
+	if (PG_IS_RUNNING()) {
+		cs.primary_src = DEV_PGM;
+		return (pg_read_line(cs.in_buf, &cs.linelen, sizeof(cs.in_buf)));
+	}
+#endif
+	stat_t status = read_line(cs.in_buf, &cs.linelen, sizeof(cs.in_buf));
+	cs.primary_src = xio_get_rx_source();
+	return (status);
+}
+
+/*
+ * _respond_to() - send the output that follows to the device a line or block came from
+ *
+ *	Lines from the program store and macro bodies are answered on USB, as is anything
+ *	printed between lines - exception reports included. Batched acks only answer USB
+ *	lines (see json_parser.cpp), so any pending are sent before the device changes.
+ */
+static void _respond_to(uint8_t src)
+{
+	if (DEV_INTERNAL(src)) { src = DEV_STDIN;}
+	if (src == xio_get_tx_source()) { return;}
+	json_flush_acks();
+	xio_set_tx_source(src);
+}
+
+/*
+ * _gcode_queue_dispatch() - execute the next parsed Gcode block and respond to it
+ *
+ *	Runs a block from the Gcode block queue once the planner has headroom for it.
+ *	The response is sent when the block is executed, just as if it had been run 
+ *	directly from the input line. Blocks only queue while no JSON or config lines 
+ *	are pending, so the communications mode can't change under a queued block.
+ *
+ *	Blocks read from the program store or run from a macro body are only answered 
+ *	if they fail. The error ends the run, the calls and loops, and drops the queued 
+ *	blocks up to the next one from serial. Blocks from serial are answered on the
+ *	device they came from.
+ *
+ *	Acks batched by $ja are sent from here, once the host may be waiting on them.
+ */
+
+static stat_t _gcode_queue_dispatch()
+{
+	char_t *block;
+
+	json_ack_callback();						// send the batched acks if the host may be waiting
+	FRAME_ACK_CALLBACK();						// and the framing acks - see frame.h
+	if ((block = gc_get_queued_block()) == NULL) { return (STAT_NOOP);}
+	if (_sync_to_planner(gc_get_queued_block_buffers()) == STAT_EAGAIN) { return (STAT_OK);}	// keep reading and parsing
+	if (mp_jog_is_running() == true) { return (STAT_OK);}		// Gcode waits for the jog to stop
+	if (SQ_RUNNING()) { return (STAT_OK);}						// and for a step queue run to end
+	if (STRESS_ACTIVE()) { return (STAT_OK);}					// and for the stress test to end
+	if (RP_REPLAYING()) { return (STAT_OK);}					// and for a segment cache replay to end
+	SR_MODAL_CHANGED();
+
+	uint8_t src = gc_get_queued_block_src();
+	if (DEV_INTERNAL(src)) {
+		stat_t status;
+		strncpy(cs.saved_buf, block, SAVED_BUFFER_LEN-1);	// the block text is lost on the flush
+		status = gc_run_queued_block();
+		if ((status == STAT_OK) || (status == STAT_NOOP)) { return (STAT_OK);}
+#ifdef __PROGRAM_STORE
+		pg_stop();
+#endif
+#ifdef __GCODE_MACROS
+		mc_reset();
+#endif
+		gc_flush_queue_internal();
+		if (cfg.comm_mode != TEXT_MODE) {
+			json_gcode_object(cs.saved_buf);
+			json_gcode_response(status);
+		} else {
+			text_response(status, cs.saved_buf);
+		}
+		return (STAT_OK);
+	}
+	_respond_to(src);
+	if (cfg.comm_mode != TEXT_MODE) {
+		json_gcode_object(block);				// responds as if wrapped in {"gc":"..."}
+		json_gcode_response(gc_run_queued_block());
+	} else {
+		text_response(gc_run_queued_block(), block);
+	}
+	_respond_to(DEV_STDIN);
 	return (STAT_OK);
 }
 
+/*
+ * controller_request_task() - mark a task as having work to do
+ *
+ *	Call this wherever a DISPATCH_READY task is given work - e.g. when a report is 
+ *	requested or a cycle is started. Safe to call from ISRs.
+ */
+
+void controller_request_task(uint8_t task) { cs.task_ready[task] = true;}
+
+/*
+ * controller_yield() - run the motion tasks while output waits on the host
+ * _motion_tasks()	  - the tasks that keep the planner fed, in _controller_HSM() order
+ *
+ *	Everything outside the ISRs runs in the one cooperative loop, so a task that
+ *	blocks holds up all the others. The one place that blocks is xio_write() waiting
+ *	for a full TX buffer to drain - a help screen or long error sent to a slow host.
+ *	xio_write() calls this while it waits, so signals are still read and arcs, canned
+ *	cycles, splines, holds, overrides, jogs, homing and probing keep the planner
+ *	fed. Gcode, commands and reports are not run - the command that is printing
+ *	is one of them, and its output must not be broken up by theirs. Output from a
+ *	motion task is rare (an exception) - it waits in xio_write() without yielding again.
+ */
+
+void controller_yield()
+{
+#ifdef __MOTION_YIELD
+	if (cs.yielding == true) { return;}
+	if (__get_IPSR() != 0) { return;}		// printing from an ISR - an alarm raised by the exec
+	cs.yielding = true;
+	_motion_tasks();
+	cs.yielding = false;
+#endif
+}
+
+static void _motion_tasks()
+{
+	DISPATCH(xio_rx_callback());
+	DISPATCH(cm_feedhold_sequencing_callback());
+	DISPATCH_READY(TASK_PLAN_HOLD, mp_plan_hold_callback());
+	DISPATCH_READY(TASK_PLAN_OVERRIDE, mp_plan_override_callback());
+	DISPATCH_READY(TASK_PLAN_TRAPEZOID, mp_plan_trapezoid_callback());
+	DISPATCH_READY(TASK_COALESCE, mp_coalesce_callback());
+	DISPATCH_READY(TASK_ARC, cm_arc_callback());
+	DISPATCH_READY(TASK_CANNED_CYCLE, cm_canned_cycle_callback());
+	DISPATCH_READY(TASK_SPLINE, cm_spline_callback());
+	DISPATCH_READY(TASK_JOG, mp_jog_callback());
+	DISPATCH_READY(TASK_HOMING, cm_homing_callback());
+	DISPATCH_READY(TASK_PROBE, cm_probe_callback());
+}
+
+/*
+ * controller_get_rx_lines() - return the number of input lines that can be accepted now
+ *
+ *	Each slot in the Gcode block queue holds one received line, so free slots are 
+ *	line credits for the host. This is reported in the JSON footer and as $rx. 
+ *	A host can stream up to this many lines past the one being answered without 
+ *	waiting for each response. The count is zero while a non-Gcode line is held 
+ *	waiting for the queue to drain, as nothing more is read until it runs.
+ */
+
+uint8_t controller_get_rx_lines()
+{
+	if (cs.line_pending == true) { return (0);}
+	return (GCODE_QUEUE_SIZE - gc_get_queued_blocks());
+}
+
+/*
+ * controller_is_gcode_line() - return TRUE if the line goes to the Gcode parser
+ *
+ *	Must agree with the dispatch in _command_dispatch(). Token blocks from the 
+ *	program store are Gcode (see gcode_parser.h).
+ */
+
+uint8_t controller_is_gcode_line(char_t *buf)
+{
+	if (GC_IS_TOKEN_BLOCK(buf)) { return (true);}
+	switch (toupper(*buf)) {
+		case NUL: case 'H': case '$': case '?': case '{': { return (false);}
+	}
+	return (true);
+}
+
 /**** Local Utilities ********************************************************/
 /*
  * _alarm_idler() - blink rapidly and prevent further activity from occurring
@@ -271,6 +573,56 @@ static stat_t _normal_idler()
 	return (STAT_OK);
 }
 
+/*
+ * _idle_sleep() - wait for an interrupt once the controller is idle
+ * _controller_is_idle() - return TRUE if no task has work and the machine is stopped
+ *
+ *	WFI stops the core clock until the next interrupt. Everything the controller 
+ *	does is started by an interrupt (USB, switches, the stepper and dwell timers) or 
+ *	polls a timer, and the 1 ms SysTick interrupt wakes the core for those, so no 
+ *	polled work is missed - at worst it runs up to 1 ms later. Only the tasks that 
+ *	are idle in the test below can wait that long. The peripheral clocks run on, 
+ *	so an interrupt is taken as soon as it is raised and its latency is unchanged.
+ *
+ *	The test is made with interrupts masked, so an interrupt that sets a task 
+ *	ready after the test leaves WFI at once and is taken on the unmask. USB input 
+ *	that lands after xio_rx_callback() has run in a pass waits for the next 
+ *	SysTick at most. The test costs a few microseconds of masked interrupts, and
+ *	only ever with the machine stopped, so no step timing is affected.
+ */
+
+#ifdef __IDLE_SLEEP
+
+static uint8_t _controller_is_idle()
+{
+	for (uint8_t i=0; i<TASK_COUNT; i++) {
+		if (cs.task_ready[i] == true) return (false);
+	}
+	if ((cs.line_pending == true) || (gc_get_queued_blocks() != 0)) return (false);
+	if ((xio_get_rx_bufcount() != 0) || (xio_get_tx_bufcount() != 0)) return (false);
+	if ((cm.cycle_state != CYCLE_OFF) || (mp_get_runtime_busy() == true)) return (false);
+#ifdef __GCODE_MACROS
+	if (MC_IS_REPLAYING()) return (false);
+#endif
+#ifdef __PROGRAM_STORE
+	if (PG_IS_RUNNING()) return (false);
+#endif
+	return (true);
+}
+
+static void _idle_sleep()
+{
+	__disable_irq();
+	if (_controller_is_idle() == true) { __WFI();}
+	__enable_irq();
+}
+
+#else
+
+static void _idle_sleep() {}
+
+#endif // __IDLE_SLEEP
+
 /*
  * tg_reset_source() 		 - reset source to default input device (see note)
  * tg_set_primary_source() 	 - set current primary input source
@@ -289,19 +641,23 @@ void tg_set_secondary_source(uint8_t dev) { cs.secondary_src = dev;}
 /*
  * _sync_to_tx_buffer() - return eagain if TX queue is backed up
  * _sync_to_planner() - return eagain if planner is not ready for a new command
+ *
+ *	Parsed Gcode blocks wait for the buffers the parser counted for them - one for
+ *	a G1 - so the planner can fill to the last buffer. Other lines may do anything,
+ *	so they wait for PLANNER_BUFFER_HEADROOM.
  */
 
 static stat_t _sync_to_tx_buffer()
 {
-//	if ((xio_get_tx_bufcount_usart(ds[XIO_DEV_USB].x) >= XOFF_TX_LO_WATER_MARK)) {
-//		return (STAT_EAGAIN);
-//	}
+	if (xio_tx_throttled() == true) {
+		return (STAT_EAGAIN);
+	}
 	return (STAT_OK);
 }
 
-static stat_t _sync_to_planner()
+static stat_t _sync_to_planner(uint8_t buffers)
 {
-	if (mp_get_planner_buffers_available() < PLANNER_BUFFER_HEADROOM) { // allow up to N planner buffers for this line
+	if (mp_planner_has_room(buffers) == false) {	// allow up to N planner buffers for this line
 		return (STAT_EAGAIN);
 	}
 	return (STAT_OK);
@@ -332,11 +688,17 @@ stat_t _controller_assertions()
 
 /* 
  * _system_assertions() - check memory integrity and other assertions
+ *
+ *	With memory guards the MPU catches overruns as they happen, so the checks
+ *	only run every MG_ASSERTION_MS. Once they fail they run on every pass.
  */
 stat_t _system_assertions()
 {
 	stat_t status;
 
+#ifdef __MEMORY_GUARD
+	if ((SysTickTimer.getValue() - cs.assertion_tick) < MG_ASSERTION_MS) { return (STAT_OK);}
+#endif
 	for (;;) {	// run this loop only once, but enable breaks
 
 		if ((status = _controller_assertions()) != STAT_OK)  break;
@@ -349,7 +711,12 @@ stat_t _system_assertions()
 
 		break;
 	}
-	if (status == STAT_OK) return (STAT_OK);
+	if (status == STAT_OK) {
+#ifdef __MEMORY_GUARD
+		cs.assertion_tick = SysTickTimer.getValue();
+#endif
+		return (STAT_OK);
+	}
 	cm_alarm(status);		// else report exception and shut down
 	return (STAT_EAGAIN);	// do not allow main loop to advance beyond this point
 }
@@ -41,6 +41,38 @@ extern "C"{
 #define LED_NORMAL_TIMER 1000			// blink rate for normal operation (in ms)
 #define LED_ALARM_TIMER 100				// blink rate for alarm state (in ms)
 
+enum csTask {							// tasks that only run when ready - see controller_request_task()
+	TASK_EXCEPTION = 0,					// rpt_exception_callback()
+	TASK_STATUS_REPORT,					// sr_status_report_callback()
+	TASK_QUEUE_REPORT,					// qr_queue_report_callback()
+	TASK_JOB_REPORT,					// rpt_job_report_callback()
+	TASK_PLAN_DUMP,						// pq_dump_callback()
+	TASK_LINE_EVENT,					// le_line_event_callback()
+	TASK_PLAN_HOLD,						// mp_plan_hold_callback()
+	TASK_PLAN_OVERRIDE,					// mp_plan_override_callback()
+	TASK_PLAN_TRAPEZOID,				// mp_plan_trapezoid_callback()
+	TASK_COALESCE,						// mp_coalesce_callback()
+	TASK_ARC,							// cm_arc_callback()
+	TASK_CANNED_CYCLE,					// cm_canned_cycle_callback()
+	TASK_SPLINE,						// cm_spline_callback()
+	TASK_JOG,							// mp_jog_callback()
+	TASK_HOMING,						// cm_homing_callback()
+	TASK_PROBE,							// cm_probe_callback()
+	TASK_SPINDLE,						// cm_spindle_callback()
+	TASK_PERSISTENCE,					// persistence_callback()
+	TASK_COUNT							// must be last
+};
+
+enum csBootPhase {						// boot phases timed from main() - reported by {"boot":""}
+	BOOT_USB = 0,						// usb.attach() - USB enumerates from here on
+	BOOT_HARDWARE,						// hardware_init(), stack paint and guards
+	BOOT_CONFIG,						// config_init() - configs from NVM or defaults
+	BOOT_DRIVERS,						// switches, PWM, motor drivers, encoders, analog inputs
+	BOOT_MACHINE,						// controller, planner, canonical machine, kinematics
+	BOOT_LAST,							// steppers, program and checkpoint stores, instruments
+	BOOT_PHASES
+};
+
 typedef struct controllerSingleton {	// main TG controller struct
 	magic_t magic_start;				// magic number to test memory integrity
 	uint8_t state;						// controller state
@@ -56,6 +88,7 @@ typedef struct controllerSingleton {	// main TG controller struct
 	uint8_t default_src;				// default source device
 	uint8_t network_mode;				// 0=master, 1=repeater, 2=slave
 	uint16_t linelen;					// length of currently processing line
+	uint8_t line_pending;				// TRUE = a line has been read but not yet dispatched
 
 	// system state variables
 	uint8_t led_state;		// LEGACY	// 0=off, 1=on
@@ -63,13 +96,20 @@ typedef struct controllerSingleton {	// main TG controller struct
 	uint32_t led_timer;					// used by idlers to flash indicator LED
 	uint8_t hard_reset_requested;		// flag to perform a hard reset
 	uint8_t bootloader_requested;		// flag to enter the bootloader
+	volatile uint8_t task_ready[TASK_COUNT];// TRUE = task has work to do (may be set from ISRs)
+	uint32_t task_tick;					// SysTick of the last pass through the millisecond tasks
+	uint8_t yielding;					// TRUE while controller_yield() runs the motion tasks
+	uint32_t boot_cycles[BOOT_PHASES];	// cycle count at the end of each boot phase (see main.cpp)
+	uint32_t boot_ready_ms;				// SysTick as the host connected
 
 	// controller serial buffers
 	char_t *bufp;						// pointer to primary or secondary in buffer
 	char_t in_buf[INPUT_BUFFER_LEN];	// primary input buffer
 	char_t out_buf[OUTPUT_BUFFER_LEN];	// output buffer
 	char_t saved_buf[SAVED_BUFFER_LEN];	// save the input buffer
+	uint32_t assertion_tick;			// SysTick of the last passed assertions (see memguard.h)
 	magic_t magic_end;
+	MEMORY_GUARD
 } controller_t;
 
 extern controller_t cs;					// controller state structure
@@ -86,6 +126,10 @@ enum cmControllerState {				// manages startup lines
 
 void controller_init(uint8_t std_in, uint8_t std_out, uint8_t std_err);
 void controller_run(void);
+uint8_t controller_get_rx_lines(void);
+uint8_t controller_is_gcode_line(char_t *buf);
+void controller_request_task(uint8_t task);
+void controller_yield(void);
 //void controller_reset(void);
 
 //void tg_reset_source(void);
@@ -0,0 +1,379 @@
+/*
+ * cycle_drilling.cpp - canned drilling cycles extension to canonical_machine.c
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "tinyg2.h"
+#include "util.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "encoder.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define CYCLE_PECK_CLEARANCE	0.25	// mm - G83 rapids back down to this far short of the last peck
+#define CYCLE_CHIP_BREAK		0.25	// mm - G73 backs off this far after each peck
+
+/**** Canned cycle singleton structure ****/
+
+struct cyCannedCycleSingleton {	// persistent canned cycle runtime variables
+	stat_t (*func)(void);		// next step of the hole, NULL if no cycle is running
+	uint8_t motion_mode;		// G73, G81, G82, G83, G84
+	uint8_t axis_0;				// plane axes - the hole is positioned on these...
+	uint8_t axis_1;
+	uint8_t axis_2;				// ...and drilled along this one
+	uint8_t repeats;			// holes left to drill, this one included (L)
+
+	// sticky words - kept from block to block in the same cycle
+	uint8_t r_set;				// TRUE once an R word has been given
+	uint8_t z_set;				// TRUE once a depth has been given
+	float r_word;				// R - in mm
+	float z_word;				// depth - in mm
+	float peck;					// Q - peck increment in mm, G73 and G83
+	float dwell;				// P - seconds at the bottom of the hole, G82
+	float pitch;				// F/S - mm per spindle turn, G84
+
+	// hole - in machine coordinates
+	float hole_0;				// hole position in the plane
+	float hole_1;
+	float step_0;				// plane increment from one repeat to the next (G91 only)
+	float step_1;
+	float r_plane;				// level the feed starts from
+	float depth;				// bottom of the hole
+	float clear;				// level the tool retracts to when the hole is done
+	float drilled;				// bottom of the last peck
+	float direction;			// sign of the drilling direction along axis_2
+};
+static struct cyCannedCycleSingleton cy;
+
+/**** NOTE: global prototypes and other .h info is located in canonical_machine.h ****/
+
+static stat_t _cycle_clear(void);
+static stat_t _cycle_position(void);
+static stat_t _cycle_r_plane(void);
+static stat_t _cycle_feed(void);
+static stat_t _cycle_peck_out(void);
+static stat_t _cycle_peck_in(void);
+static stat_t _cycle_dwell(void);
+static stat_t _cycle_retract(void);
+static void _cycle_move(const uint8_t motion_mode);
+#ifdef __SPINDLE_SYNC
+static void _cycle_tap(void);
+#endif
+static float _short_of_r_plane(const float level);
+static uint8_t _is_canned_cycle(const uint8_t motion_mode);
+
+#define _to_mm(a) ((gmx.modal.units_mode == INCHES) ? (a * MM_PER_INCH) : a)
+
+/*****************************************************************************
+ * cm_canned_cycle()			- G73, G81, G82, G83, G84 canned drilling cycles
+ * cm_canned_cycle_callback()	- main loop callback that queues the moves of the cycle
+ * cm_abort_canned_cycle()		- stop a cycle without maintaining position
+ *
+ *	One block drills one hole - or L holes in incremental mode - and the moves are
+ *	fed straight to the planner by the callback, the way cm_arc_callback() feeds
+ *	arc segments. For each hole:
+ *
+ *	  0. If the tool is below the R plane, traverse the drill axis up to it
+ *	  1. Traverse the plane axes to the hole
+ *	  2. Traverse the drill axis to the R plane
+ *	  3. Feed to the depth given by the drill axis word
+ *		   G81 - in one move
+ *		   G82 - in one move, then dwell for P seconds
+ *		   G83 - in pecks of Q, traversing out to the R plane after each peck and
+ *				 back down to CYCLE_PECK_CLEARANCE short of the last one
+ *		   G73 - in pecks of Q, backing off CYCLE_CHIP_BREAK after each peck
+ *		   G84 - rigid tap to the depth at a pitch of F/S and back out to the R plane,
+ *				 following the spindle (__SPINDLE_SYNC - see plan_thread.cpp)
+ *	  4. Traverse the drill axis out to the initial level (G98) or the R plane (G99)
+ *
+ *	The axes follow the selected plane - the drill axis is Z for G17, Y for G18 and
+ *	X for G19. The initial level is where the drill axis is when the block starts,
+ *	or the R plane if that is further out. R, the depth, Q and P are sticky: the
+ *	first block of a cycle must give R and the depth, and the following blocks of
+ *	the same cycle need only the hole position. In G91 R is from the initial level,
+ *	the depth is from the R plane and the hole is from the previous one.
+ *
+ *	The cycle runs as a state machine that is driven by binding the next step of
+ *	the hole to cy.func. Each step queues one move and binds the step that follows
+ *	it. The model position is kept up to date move by move, and the callback holds
+ *	off the next block until the last move has been queued.
+ */
+
+stat_t cm_canned_cycle(float target[], float flags[],
+					   float r_word, float r_flag, float q_word, float q_flag,
+					   float p_word, float p_flag, uint8_t repeats, uint8_t motion_mode)
+{
+	if (_is_canned_cycle(gm.motion_mode) == false) {	// a new cycle starts the sticky words over
+		cy.r_set = false;
+		cy.z_set = false;
+		cy.peck = 0;
+		cy.dwell = 0;
+	}
+	gm.motion_mode = motion_mode;
+	cy.motion_mode = motion_mode;
+	cy.axis_0 = gmx.plane_axis_0;
+	cy.axis_1 = gmx.plane_axis_1;
+	cy.axis_2 = gmx.plane_axis_2;
+
+	// collect the sticky words
+	if (fp_TRUE(r_flag)) {
+		cy.r_word = _to_mm(r_word);
+		cy.r_set = true;
+	}
+	if (fp_TRUE(flags[cy.axis_2])) {
+		cy.z_word = _to_mm(target[cy.axis_2]);
+		cy.z_set = true;
+	}
+	if (fp_TRUE(q_flag)) {
+		if (q_word < EPSILON) { return (STAT_GCODE_INPUT_ERROR);}
+		cy.peck = _to_mm(q_word);
+	}
+	if (fp_TRUE(p_flag)) {
+		if (p_word < 0) { return (STAT_GCODE_INPUT_ERROR);}
+		cy.dwell = p_word;
+	}
+
+	// a block without axis words sets up the cycle but does not drill a hole
+	if (fp_FALSE(flags[cy.axis_0]) && fp_FALSE(flags[cy.axis_1]) && fp_FALSE(flags[cy.axis_2])) {
+		return (STAT_OK);
+	}
+	if ((cy.r_set == false) || (cy.z_set == false)) { return (STAT_GCODE_AXIS_WORD_MISSING);}
+	if (((motion_mode == MOTION_MODE_CANNED_CYCLE_83) || (motion_mode == MOTION_MODE_CANNED_CYCLE_73)) &&
+		(fp_ZERO(cy.peck))) {
+		return (STAT_GCODE_INPUT_ERROR);
+	}
+	if (gm.inverse_feed_rate_mode == true) { return (STAT_GCODE_INPUT_ERROR);}
+	if (fp_ZERO(gm.feed_rate)) { return (STAT_GCODE_FEEDRATE_ERROR);}
+#ifdef __SPINDLE_SYNC
+	if (motion_mode == MOTION_MODE_CANNED_CYCLE_84) {	// right hand taps - the spindle runs M3
+		if ((en.spindle_encoder == 0) || (gm.spindle_mode != SPINDLE_CW) || (fp_ZERO(gm.spindle_speed))) {
+			return (STAT_COMMAND_NOT_ACCEPTED);
+		}
+		cy.pitch = gm.feed_rate / gm.spindle_speed;
+		if (gm.feed_rate > cm.a[cy.axis_2].velocity_max) { return (STAT_MAX_SPINDLE_SPEED_EXCEEDED);}
+	}
+#endif
+
+	// resolve the hole to machine coordinates
+	float plane_flags[] = {0,0,0,0,0,0};
+	plane_flags[cy.axis_0] = flags[cy.axis_0];
+	plane_flags[cy.axis_1] = flags[cy.axis_1];
+	copy_axis_vector(gm.target, gmx.position);
+	cm_set_model_target(target, plane_flags);
+	cy.hole_0 = gm.target[cy.axis_0];
+	cy.hole_1 = gm.target[cy.axis_1];
+
+	float initial = gmx.position[cy.axis_2];
+	if (gmx.modal.distance_mode == ABSOLUTE_MODE) {
+		cy.r_plane = cm_get_active_coord_offset(cy.axis_2) + cy.r_word;
+		cy.depth = cm_get_active_coord_offset(cy.axis_2) + cy.z_word;
+		cy.step_0 = 0;
+		cy.step_1 = 0;
+	} else {
+		cy.r_plane = initial + cy.r_word;
+		cy.depth = cy.r_plane + cy.z_word;
+		cy.step_0 = cy.hole_0 - gmx.position[cy.axis_0];
+		cy.step_1 = cy.hole_1 - gmx.position[cy.axis_1];
+	}
+	cy.direction = (cy.depth < cy.r_plane) ? -1 : 1;
+	cy.clear = cy.r_plane;
+	if ((gmx.retract_mode == RETRACT_INITIAL_LEVEL) && ((initial - cy.r_plane) * cy.direction > 0)) {
+		cy.clear = initial;
+	}
+	cy.repeats = max(repeats, 1);
+
+	cy.func = _cycle_clear;
+	controller_request_task(TASK_CANNED_CYCLE);
+	return (STAT_OK);
+}
+
+stat_t cm_canned_cycle_callback()
+{
+	if (cy.func == NULL) { return (STAT_NOOP);}
+	if (mp_planner_has_room(CM_MOVE_BUFFERS) == false) { return (STAT_EAGAIN);}	// each step queues one move
+	return (cy.func());
+}
+
+void cm_abort_canned_cycle()
+{
+	cy.func = NULL;
+}
+
+/*
+ * Cycle steps - each one queues a move and binds the next step
+ */
+
+static stat_t _cycle_clear()
+{
+	if ((gmx.position[cy.axis_2] - cy.r_plane) * cy.direction > 0) {
+		copy_axis_vector(gm.target, gmx.position);
+		gm.target[cy.axis_2] = cy.r_plane;
+		_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+	}
+	cy.func = _cycle_position;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_position()
+{
+	copy_axis_vector(gm.target, gmx.position);
+	gm.target[cy.axis_0] = cy.hole_0;
+	gm.target[cy.axis_1] = cy.hole_1;
+	_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+	cy.func = _cycle_r_plane;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_r_plane()
+{
+	copy_axis_vector(gm.target, gmx.position);
+	gm.target[cy.axis_2] = cy.r_plane;
+	_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+	cy.drilled = cy.r_plane;
+	cy.func = _cycle_feed;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_feed()
+{
+#ifdef __SPINDLE_SYNC
+	if (cy.motion_mode == MOTION_MODE_CANNED_CYCLE_84) {	// in and back out in one move
+		copy_axis_vector(gm.target, gmx.position);
+		gm.target[cy.axis_2] = cy.depth;
+		_cycle_tap();
+		cy.func = _cycle_retract;
+		return (STAT_EAGAIN);
+	}
+#endif
+	float level = cy.depth;
+	if (((cy.motion_mode == MOTION_MODE_CANNED_CYCLE_83) || (cy.motion_mode == MOTION_MODE_CANNED_CYCLE_73)) &&
+		((cy.depth - cy.drilled) * cy.direction > cy.peck)) {
+		level = cy.drilled + cy.peck * cy.direction;
+		cy.func = _cycle_peck_out;
+	} else if ((cy.motion_mode == MOTION_MODE_CANNED_CYCLE_82) && (fp_NOT_ZERO(cy.dwell))) {
+		cy.func = _cycle_dwell;
+	} else {
+		cy.func = _cycle_retract;
+	}
+	copy_axis_vector(gm.target, gmx.position);
+	gm.target[cy.axis_2] = level;
+	_cycle_move(MOTION_MODE_STRAIGHT_FEED);
+	cy.drilled = level;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_peck_out()
+{
+	copy_axis_vector(gm.target, gmx.position);
+	if (cy.motion_mode == MOTION_MODE_CANNED_CYCLE_83) {
+		gm.target[cy.axis_2] = cy.r_plane;
+		cy.func = _cycle_peck_in;
+	} else {
+		gm.target[cy.axis_2] = _short_of_r_plane(cy.drilled - CYCLE_CHIP_BREAK * cy.direction);
+		cy.func = _cycle_feed;
+	}
+	_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_peck_in()
+{
+	copy_axis_vector(gm.target, gmx.position);
+	gm.target[cy.axis_2] = _short_of_r_plane(cy.drilled - CYCLE_PECK_CLEARANCE * cy.direction);
+	_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+	cy.func = _cycle_feed;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_dwell()
+{
+	mp_dwell(cy.dwell);
+	cy.func = _cycle_retract;
+	return (STAT_EAGAIN);
+}
+
+static stat_t _cycle_retract()
+{
+	copy_axis_vector(gm.target, gmx.position);
+	gm.target[cy.axis_2] = cy.clear;
+	_cycle_move(MOTION_MODE_STRAIGHT_TRAVERSE);
+
+	if (--cy.repeats > 0) {						// next hole - the tool is already clear
+		cy.hole_0 += cy.step_0;
+		cy.hole_1 += cy.step_1;
+		cy.func = _cycle_position;
+		return (STAT_EAGAIN);
+	}
+	cy.func = NULL;
+	return (STAT_OK);
+}
+
+/*
+ * _cycle_move() - queue a move to gm.target
+ *
+ *	The move is queued as a G0 or G1 so the move times and the runtime see the
+ *	motion they expect, then the model is put back in the cycle's motion mode.
+ */
+
+static void _cycle_move(const uint8_t motion_mode)
+{
+	if (vector_equal(gm.target, gmx.position)) { return;}
+	gm.motion_mode = motion_mode;
+	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
+	cm_set_move_times(&gm);						// set move time and minimum time in the state
+	cm_cycle_start();
+	cm_conditional_set_model_position(mp_aline(&gm));
+	gm.motion_mode = cy.motion_mode;
+}
+
+/*
+ * _cycle_tap() - queue a tap to gm.target and back - the model stays at the R plane
+ */
+
+#ifdef __SPINDLE_SYNC
+static void _cycle_tap()
+{
+	if (vector_equal(gm.target, gmx.position)) { return;}
+	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
+	cm_cycle_start();
+	mp_spindle_sync(&gm, cy.pitch);
+}
+#endif
+
+/*
+ * _short_of_r_plane() - limit a peck move so it does not go out past the R plane
+ */
+
+static float _short_of_r_plane(const float level)
+{
+	if ((level - cy.r_plane) * cy.direction < 0) { return (cy.r_plane);}
+	return (level);
+}
+
+static uint8_t _is_canned_cycle(const uint8_t motion_mode)
+{
+	return ((motion_mode == MOTION_MODE_CANNED_CYCLE_73) ||
+			((motion_mode >= MOTION_MODE_CANNED_CYCLE_81) && (motion_mode <= MOTION_MODE_CANNED_CYCLE_84)));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -28,12 +28,15 @@
 #include "tinyg2.h"
 #include "util.h"
 #include "config.h"
+#include "controller.h"
 #include "json_parser.h"
 #include "text_parser.h"
 #include "gcode_parser.h"
 #include "canonical_machine.h"
 #include "planner.h"
 #include "switch.h"
+#include "stepper.h"
+#include "checkpoint.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -43,31 +46,33 @@ extern "C"{
 
 struct hmHomingSingleton {		// persistent homing runtime variables
 	// controls for homing cycle
-	int8_t axis;				// axis currently being homed
-	uint8_t min_mode;			// mode for min switch for this axis
-	uint8_t max_mode;			// mode for max switch for this axis
-	int8_t homing_switch;		// homing switch for current axis (index into switch flag table)
-	int8_t limit_switch;		// limit switch for current axis, or -1 if none
-	uint8_t homing_closed;		// 0=open, 1=closed
-	uint8_t limit_closed;		// 0=open, 1=closed
+	int8_t axis;				// lead axis of the group currently being homed
 	uint8_t set_coordinates;	// G28.4 flag. true = set coords to zero at the end of homing cycle
 	stat_t (*func)(int8_t axis);// binding for callback function state machine
+	uint8_t axes[AXES];			// true for each axis in the group being homed
+	uint8_t done[AXES];			// true once an axis has been homed (or skipped) in this cycle
+	uint8_t tripped[AXES];		// true once the axis' homing switch has closed in the search
+	uint8_t fast;				// true while the group is re-homed from a checkpoint position
 
 	// per-axis parameters
-	float direction;			// set to 1 for positive (max), -1 for negative (to min);
-	float search_travel;		// signed distance to travel in search
-	float search_velocity;		// search speed as positive number
-	float latch_velocity;		// latch speed as positive number
-	float latch_backoff;		// max distance to back off switch during latch phase 
-	float zero_backoff;			// distance to back off switch before setting zero
-	float max_clear_backoff;	// maximum distance of switch clearing backoffs before erring out
+	int8_t homing_switch[AXES];	// homing switch for the axis (index into switch flag table)
+	int8_t limit_switch[AXES];	// limit switch for the axis, or -1 if none
+	int8_t square_switch[AXES];	// homing switch for the axis' second motor, or -1 if not squaring
+	int8_t motor[AXES];			// first motor mapped to the axis - stops on the homing switch
+	int8_t square_motor[AXES];	// second motor mapped to the axis - stops on the squaring switch
+	float search_travel[AXES];	// signed distance to travel in search
+	float search_velocity[AXES];// search speed as positive number
+	float latch_velocity[AXES];	// latch speed as positive number
+	float latch_backoff[AXES];	// max distance to back off switch during latch phase 
+	float zero_backoff[AXES];	// distance to back off switch before setting zero
+	float clear_backoff[AXES];	// signed distance to clear switches that are closed at the start
 
 	// state saved from gcode model
 	float saved_feed_rate;		// F setting
 	uint8_t saved_units_mode;	// G20,G21 global setting
 	uint8_t saved_coord_system;	// G54 - G59 setting
 	uint8_t saved_distance_mode;// G90,G91 global setting
-	float saved_jerk;			// saved and restored for each axis homed
+	float saved_jerk[AXES];		// saved and restored for each axis homed
 };
 static struct hmHomingSingleton hm;
 
@@ -76,18 +81,23 @@ static struct hmHomingSingleton hm;
 
 static stat_t _set_homing_func(stat_t (*func)(int8_t axis));
 static stat_t _homing_axis_start(int8_t axis);
+static stat_t _homing_axis_setup(int8_t axis);
+static stat_t _homing_axis_fast(int8_t axis);
+static stat_t _homing_axis_fast_check(int8_t axis);
+static stat_t _homing_axis_fallback(int8_t axis);
 static stat_t _homing_axis_clear(int8_t axis);
-static stat_t _homing_axis_backoff_home(int8_t axis);
-static stat_t _homing_axis_backoff_limit(int8_t axis);
+static stat_t _homing_axis_backoff(int8_t axis);
 static stat_t _homing_axis_search(int8_t axis);
+static stat_t _homing_axis_search_check(int8_t axis);
 static stat_t _homing_axis_latch(int8_t axis);
 static stat_t _homing_axis_zero_backoff(int8_t axis);
 static stat_t _homing_axis_set_zero(int8_t axis);
-static stat_t _homing_axis_move(int8_t axis, float target, float velocity);
+static stat_t _homing_axis_move(const float travel[], const float velocity[]);
 static stat_t _homing_finalize_exit(int8_t axis);
 static stat_t _homing_error_exit(int8_t axis);
 static int8_t _get_next_axis(int8_t axis);
-//static int8_t _get_next_axes(int8_t axis);
+static int8_t _get_next_axes(int8_t axis);
+static int8_t _get_axis_motor(uint8_t axis, uint8_t nth);
 
 /*****************************************************************************
  * cm_homing_cycle_start()	- G28.1 homing cycle using limit switches
@@ -124,6 +134,29 @@ static int8_t _get_next_axis(int8_t axis);
  *
  *	Once all moves for an axis are complete the next axis in the sequence is homed
  *
+ *	Homing groups: axes with the same non-zero homing group ({"xhg":1}, {"yhg":1})
+ *	are homed together when they are requested in the same G28.2. The group is led
+ *	by its first axis in the homing order, and each move drives all of its axes
+ *	at once. The first switch to close holds the search move; the axes that have
+ *	not yet tripped then carry on searching while tripped axes stay put, so each
+ *	axis finishes its search on its own switch. The latch and zero backoff moves
+ *	run on all axes together and each axis latches its own switch opening.
+ *	Group 0 homes the axis alone.
+ *
+ *	Fast re-homing: with __CHECKPOINT and $ckh set, a group whose axes all have a
+ *	position in a stopped checkpoint (see checkpoint.h) starts from it. Each axis
+ *	moves at its velocity max to $ckh short of its switch and then searches 2 * $ckh
+ *	at most. A switch closed by the fast move, or not found by the short search,
+ *	falls back to the full clear and search from where the axes are.
+ *
+ *	Gantry squaring: an axis driven by two motors can square itself if the second
+ *	motor has its own switch ({"ysq":4} uses the x max input, numbered from 1 as
+ *	xmin=1, xmax=2, ymin=3...). The first motor mapped to the axis runs to the
+ *	homing switch and the second to the squaring switch. Each motor is inhibited
+ *	in the stepper DDA as soon as its own switch closes in the search, and
+ *	again at the instant its switch opens in the latch, so both sides finish the
+ *	latch on their switches and the gantry is square to them before zero backoff.
+ *
  *	When a homing cycle is initiated the homing state is set to HOMING_NOT_HOMED
  *	When homing completes successfully this is set to HOMING_HOMED, otherwise it
  *	remains HOMING_NOT_HOMED.
@@ -144,9 +177,9 @@ static int8_t _get_next_axis(int8_t axis);
 stat_t cm_homing_cycle_start(void)
 {
 	// save relevant non-axis parameters from Gcode model
-	hm.saved_units_mode = gm.units_mode;
-	hm.saved_coord_system = gm.coord_system;
-	hm.saved_distance_mode = gm.distance_mode;
+	hm.saved_units_mode = gmx.modal.units_mode;
+	hm.saved_coord_system = gmx.modal.coord_system;
+	hm.saved_distance_mode = gmx.modal.distance_mode;
 	hm.saved_feed_rate = gm.feed_rate;
 
 	// set working values
@@ -156,9 +189,11 @@ stat_t cm_homing_cycle_start(void)
 	hm.set_coordinates = true;
 
 	hm.axis = -1;							// set to retrieve initial axis
+	for (uint8_t axis=0; axis<AXES; axis++) { hm.done[axis] = false;}
 	hm.func = _homing_axis_start; 			// bind initial processing function
 	cm.cycle_state = CYCLE_HOMING;
 	cm.homing_state = HOMING_NOT_HOMED;
+	controller_request_task(TASK_HOMING);
 	return (STAT_OK);
 }
 
@@ -179,6 +214,7 @@ static stat_t _homing_finalize_exit(int8_t axis)	// third part of return to home
 	cm_set_distance_mode(hm.saved_distance_mode);
 	cm_set_feed_rate(hm.saved_feed_rate);
 	cm_set_motion_mode(MODEL, MOTION_MODE_CANCEL_MOTION_MODE);
+	st_clear_motor_inhibits();
 	cm.homing_state = HOMING_HOMED;
 	cm.cycle_state = CYCLE_OFF;						// required
 	cm_cycle_end();
@@ -214,21 +250,27 @@ static stat_t _homing_error_exit(int8_t axis)
 	cm_set_distance_mode(hm.saved_distance_mode);
 	cm_set_feed_rate(hm.saved_feed_rate);
 	cm_set_motion_mode(MODEL, MOTION_MODE_CANCEL_MOTION_MODE);
+	st_clear_motor_inhibits();
 	cm.cycle_state = CYCLE_OFF;
 	cm_cycle_end();
 	return (STAT_HOMING_CYCLE_FAILED);			// homing state remains HOMING_NOT_HOMED
 }
 
-/* Homing axis moves - these execute in sequence for each axis
+/* Homing axis moves - these execute in sequence for each axis group
  * cm_homing_callback() 		- main loop callback for running the homing cycle
  *	_set_homing_func()			- a convenience for setting the next dispatch vector and exiting
- *	_homing_axis_start()		- get next axis, initialize variables, call the clear
- *	_homing_axis_clear()		- initiate a clear to move off a switch that is thrown at the start
- *	_homing_axis_backoff_home()	- back off the cleared home switch
- *	_homing_axis_backoff_limit()- back off the cleared limit switch
- *	_homing_axis_search()		- fast search for switch, closes switch
- *	_homing_axis_latch()		- slow reverse until switch opens again
- *	_homing_axis_final()		- backoff from latch location to zero position 
+ *	_homing_axis_start()		- get next axis group, initialize variables, call the clear
+ *	_homing_axis_setup()		- check the configuration and set the parameters for one axis
+ *	_homing_axis_fast()			- fast approach from a checkpoint position, if there is one
+ *	_homing_axis_fast_check()	- check no switch closed in the fast approach
+ *	_homing_axis_fallback()		- give up on the fast approach and run the full search
+ *	_homing_axis_clear()		- initiate a clear to move off switches that are thrown at the start
+ *	_homing_axis_backoff()		- back off the cleared switches some more
+ *	_homing_axis_search()		- fast search for switches, closes switches
+ *	_homing_axis_search_check()	- carry on searching with the axes whose switches are still open
+ *	_homing_axis_latch()		- slow reverse until switches open again
+ *	_homing_axis_zero_backoff()	- backoff from latch location to zero position 
+ *	_homing_axis_set_zero()		- set zero and finish up each axis in the group
  *	_homing_axis_move()			- helper that actually executes the above moves
  */
 
@@ -247,8 +289,8 @@ static stat_t _set_homing_func(stat_t (*func)(int8_t axis))
 
 static stat_t _homing_axis_start(int8_t axis)
 {
-	// get the first or next axis
-	if ((axis = _get_next_axis(axis)) < 0) { 				// axes are done or error
+	// get the first or next axis group
+	if ((axis = _get_next_axes(axis)) < 0) { 				// axes are done or error
 		if (axis == -1) {									// -1 is done
 			return (_set_homing_func(_homing_finalize_exit));
 		} else if (axis == -2) { 							// -2 is error
@@ -259,133 +301,317 @@ static stat_t _homing_axis_start(int8_t axis)
 			return (_homing_error_exit(-2));
 		}
 	}
+	hm.axis = axis;											// persist the lead axis
+
+	// set up each axis in the group, dropping axes that have homing disabled
+	uint8_t homing = false;
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		stat_t status = _homing_axis_setup(i);
+		if (status == STAT_NOOP) {
+			hm.axes[i] = false;
+		} else if (status != STAT_OK) {
+			return (_homing_error_exit(i));
+		} else {
+			homing = true;
+		}
+	}
+	if (homing == false) { 									// skip to the next axis group
+		return (_set_homing_func(_homing_axis_start));
+	}
+	return (_set_homing_func(_homing_axis_fast));			// start the fast approach or the clear
+}
+
+// returns STAT_OK if the axis is set up, STAT_NOOP if homing is disabled for it, or an error
+static stat_t _homing_axis_setup(int8_t axis)
+{
 	// trap gross mis-configurations
 	if ((fp_ZERO(cm.a[axis].search_velocity)) || (fp_ZERO(cm.a[axis].latch_velocity))) {
-		return (_homing_error_exit(axis));
+		return (STAT_HOMING_CYCLE_FAILED);
 	}
 	if ((cm.a[axis].travel_max <= 0) || (cm.a[axis].latch_backoff <= 0)) {
-		return (_homing_error_exit(axis));
+		return (STAT_HOMING_CYCLE_FAILED);
 	}
+	if (AUX_AXIS(axis)) { return (STAT_HOMING_CYCLE_FAILED);}	// the aux queue doesn't stop on switches
 
 	// determine the switch setup and that config is OK
-	hm.min_mode = get_switch_mode(MIN_SWITCH(axis));
-	hm.max_mode = get_switch_mode(MAX_SWITCH(axis));
+	uint8_t min_mode = get_switch_mode(MIN_SWITCH(axis));
+	uint8_t max_mode = get_switch_mode(MAX_SWITCH(axis));
 
-	if ( ((hm.min_mode & SW_HOMING_BIT) ^ (hm.max_mode & SW_HOMING_BIT)) == 0) {// one or the other must be homing
-		return (_homing_error_exit(axis));					// axis cannot be homed
+	if ( ((min_mode & SW_HOMING_BIT) ^ (max_mode & SW_HOMING_BIT)) == 0) {// one or the other must be homing
+		return (STAT_HOMING_CYCLE_FAILED);					// axis cannot be homed
 	}
-	hm.axis = axis;											// persist the axis
-	hm.search_velocity = fabs(cm.a[axis].search_velocity);	// search velocity is always positive
-	hm.latch_velocity = fabs(cm.a[axis].latch_velocity);	// latch velocity is always positive
+	hm.search_velocity[axis] = fabs(cm.a[axis].search_velocity);// search velocity is always positive
+	hm.latch_velocity[axis] = fabs(cm.a[axis].latch_velocity);	// latch velocity is always positive
+	hm.tripped[axis] = false;
 
 	// setup parameters homing to the minimum switch
-	if (hm.min_mode & SW_HOMING_BIT) {
-		hm.homing_switch = MIN_SWITCH(axis);				// the min is the homing switch
-		hm.limit_switch = MAX_SWITCH(axis);					// the max would be the limit switch
-		hm.search_travel = -cm.a[axis].travel_max;			// search travels in negative direction
-		hm.latch_backoff = cm.a[axis].latch_backoff;		// latch travels in positive direction
-		hm.zero_backoff = cm.a[axis].zero_backoff;
+	if (min_mode & SW_HOMING_BIT) {
+		hm.homing_switch[axis] = MIN_SWITCH(axis);			// the min is the homing switch
+		hm.limit_switch[axis] = MAX_SWITCH(axis);			// the max would be the limit switch
+		hm.search_travel[axis] = -cm.a[axis].travel_max;	// search travels in negative direction
+		hm.latch_backoff[axis] = cm.a[axis].latch_backoff;	// latch travels in positive direction
+		hm.zero_backoff[axis] = cm.a[axis].zero_backoff;
 
 	// setup parameters for positive travel (homing to the maximum switch)
 	} else {
-		hm.homing_switch = MAX_SWITCH(axis);				// the max is the homing switch
-		hm.limit_switch = MIN_SWITCH(axis);					// the min would be the limit switch
-		hm.search_travel = cm.a[axis].travel_max;			// search travels in positive direction
-		hm.latch_backoff = -cm.a[axis].latch_backoff;		// latch travels in negative direction
-		hm.zero_backoff = -cm.a[axis].zero_backoff;
+		hm.homing_switch[axis] = MAX_SWITCH(axis);			// the max is the homing switch
+		hm.limit_switch[axis] = MIN_SWITCH(axis);			// the min would be the limit switch
+		hm.search_travel[axis] = cm.a[axis].travel_max;		// search travels in positive direction
+		hm.latch_backoff[axis] = -cm.a[axis].latch_backoff;	// latch travels in negative direction
+		hm.zero_backoff[axis] = -cm.a[axis].zero_backoff;
 	}
-    // if homing is disabled for the axis then skip to the next axis
-	uint8_t sw_mode = get_switch_mode(hm.homing_switch);
+    // if homing is disabled for the axis then skip it
+	uint8_t sw_mode = get_switch_mode(hm.homing_switch[axis]);
 	if ((sw_mode != SW_MODE_HOMING) && (sw_mode != SW_MODE_HOMING_LIMIT)) {
-		return (_set_homing_func(_homing_axis_start));
+		return (STAT_NOOP);
 	}
 	// disable the limit switch parameter if there is no limit switch
-	if (get_switch_mode(hm.limit_switch) == SW_MODE_DISABLED) { hm.limit_switch = -1;}
-	hm.saved_jerk = cm.a[axis].jerk_max;					// save the max jerk value
-	return (_set_homing_func(_homing_axis_clear));			// start the clear
+	if (get_switch_mode(hm.limit_switch[axis]) == SW_MODE_DISABLED) { hm.limit_switch[axis] = -1;}
+
+	// set up gantry squaring - needs a second motor and a homing switch of its own
+	hm.square_switch[axis] = -1;
+	if (cm.a[axis].squaring_switch != 0) {
+		hm.square_switch[axis] = cm.a[axis].squaring_switch - 1;
+		hm.motor[axis] = _get_axis_motor(axis, 0);
+		hm.square_motor[axis] = _get_axis_motor(axis, 1);
+		if ((hm.square_motor[axis] < 0) || (hm.square_switch[axis] >= (SW_PAIRS * SW_POSITIONS)) ||
+			(hm.square_switch[axis] == hm.homing_switch[axis]) ||
+			((get_switch_mode(hm.square_switch[axis]) & SW_HOMING_BIT) == 0)) {
+			return (STAT_HOMING_CYCLE_FAILED);
+		}
+	}
+	hm.saved_jerk[axis] = cm.a[axis].jerk_max;				// save the max jerk value
+	return (STAT_OK);
+}
+
+// Fast approach to near the switches from the last checkpoint - every axis of the group or none
+static stat_t _homing_axis_fast(int8_t axis)
+{
+	hm.fast = false;
+#ifdef __CHECKPOINT
+	float position[AXES];
+	if (fp_ZERO(ck.rehome_margin)) { return (_homing_axis_clear(axis));}
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		if ((ck_get_homed_position(i, &position[i]) == false) ||
+			(get_switch_state(hm.homing_switch[i]) == SW_CLOSED) ||
+			((hm.limit_switch[i] != -1) && (get_switch_state(hm.limit_switch[i]) == SW_CLOSED))) {
+			return (_homing_axis_clear(axis));
+		}
+	}
+	float travel[] = {0,0,0,0,0,0};
+	float velocity[AXES];
+	for (uint8_t i=0; i<AXES; i++) {
+		velocity[i] = cm.a[i].velocity_max;
+		if (hm.axes[i] == false) { continue;}
+		cm_set_axis_origin(i, position[i]);
+		mp_set_runtime_position(i, position[i]);
+
+		// the switch opened zero backoff short of zero when the axis was last homed
+		float direction = (hm.search_travel[i] > 0) ? 1 : -1;
+		travel[i] = -hm.zero_backoff[i] - (direction * ck.rehome_margin) - position[i];
+		if ((travel[i] * direction) < 0) { travel[i] = 0;}	// already inside the margin
+		hm.search_travel[i] = direction * 2 * ck.rehome_margin;
+	}
+	hm.fast = true;
+	_homing_axis_move(travel, velocity);
+	return (_set_homing_func(_homing_axis_fast_check));
+#else
+	return (_homing_axis_clear(axis));
+#endif
+}
+
+static stat_t _homing_axis_fast_check(int8_t axis)			// a closed switch held the fast move
+{
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		if ((get_switch_state(hm.homing_switch[i]) == SW_CLOSED) ||
+			((hm.limit_switch[i] != -1) && (get_switch_state(hm.limit_switch[i]) == SW_CLOSED))) {
+			return (_homing_axis_fallback(axis));
+		}
+	}
+	return (_homing_axis_search(axis));						// short search
+}
+
+static stat_t _homing_axis_fallback(int8_t axis)			// the checkpoint doesn't match the machine
+{
+	hm.fast = false;
+	st_clear_motor_inhibits();
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		hm.tripped[i] = false;
+		hm.search_travel[i] = (hm.search_travel[i] > 0) ? cm.a[i].travel_max : -cm.a[i].travel_max;
+	}
+	return (_homing_axis_clear(axis));
 }
 
 // Handle an initial switch closure by backing off switches
 // NOTE: Relies on independent switches per axis (not shared)
 static stat_t _homing_axis_clear(int8_t axis)				// first clear move
 {
-//+++++	int8_t homing = read_switch(hm.homing_switch);
-//+++++	int8_t limit = read_switch(hm.limit_switch);
-	int8_t homing = SW_OPEN;	//+++++
-	int8_t limit = SW_OPEN;		//+++++
-
-	if ((homing == SW_OPEN) && (limit != SW_CLOSED)) {
- 		return (_set_homing_func(_homing_axis_search));		// OK to start the search
+	uint8_t clear = true;
+	for (uint8_t i=0; i<AXES; i++) {
+		hm.clear_backoff[i] = 0;
+		if (hm.axes[i] == false) { continue;}
+		if (get_switch_state(hm.homing_switch[i]) == SW_CLOSED) {
+			hm.clear_backoff[i] = hm.latch_backoff[i];		// back off the homing switch
+			clear = false;
+		} else if ((hm.limit_switch[i] != -1) && (get_switch_state(hm.limit_switch[i]) == SW_CLOSED)) {
+			hm.clear_backoff[i] = -hm.latch_backoff[i];		// back off the limit switch
+			clear = false;
+		}
 	}
-	if (homing == SW_CLOSED) {
-		_homing_axis_move(axis, hm.latch_backoff, hm.search_velocity);
- 		return (_set_homing_func(_homing_axis_backoff_home));// will backoff homing switch some more
+	if (clear == true) {
+ 		return (_set_homing_func(_homing_axis_search));		// OK to start the search
 	}
-	_homing_axis_move(axis, -hm.latch_backoff, hm.search_velocity);
- 	return (_set_homing_func(_homing_axis_backoff_limit));	// will backoff limit switch some more
+	_homing_axis_move(hm.clear_backoff, hm.search_velocity);
+ 	return (_set_homing_func(_homing_axis_backoff));		// will backoff the switches some more
 }
 
-static stat_t _homing_axis_backoff_home(int8_t axis)		// back off cleared homing switch
+static stat_t _homing_axis_backoff(int8_t axis)				// back off cleared switches
 {
-	_homing_axis_move(axis, hm.latch_backoff, hm.search_velocity);
+	_homing_axis_move(hm.clear_backoff, hm.search_velocity);
     return (_set_homing_func(_homing_axis_search));
 }
 
-static stat_t _homing_axis_backoff_limit(int8_t axis)		// back off cleared limit switch
+static stat_t _homing_axis_search(int8_t axis)				// start the search
 {
-	_homing_axis_move(axis, -hm.latch_backoff, hm.search_velocity);
-    return (_set_homing_func(_homing_axis_search));
+	float travel[] = {0,0,0,0,0,0};
+	for (uint8_t i=0; i<AXES; i++) {
+		if ((hm.axes[i] == false) || (hm.tripped[i] == true)) { continue;}
+		cm.a[i].jerk_max = cm.a[i].jerk_homing;				// use the homing jerk for search onward
+		travel[i] = hm.search_travel[i];
+	}
+	_homing_axis_move(travel, hm.search_velocity);
+    return (_set_homing_func(_homing_axis_search_check));
 }
 
-static stat_t _homing_axis_search(int8_t axis)				// start the search
+static stat_t _homing_axis_search_check(int8_t axis)		// search again for any switches not yet hit
 {
-	cm.a[axis].jerk_max = cm.a[axis].jerk_homing;			// use the homing jerk for search onward
-	_homing_axis_move(axis, hm.search_travel, hm.search_velocity);
-    return (_set_homing_func(_homing_axis_latch));
+	uint8_t tripped = false;
+	uint8_t searching = false;
+	for (uint8_t i=0; i<AXES; i++) {
+		if ((hm.axes[i] == false) || (hm.tripped[i] == true)) { continue;}
+		uint8_t closed = (get_switch_state(hm.homing_switch[i]) == SW_CLOSED);
+		if (hm.square_switch[i] != -1) {					// each side of a gantry stops on its own switch
+			uint8_t square_closed = (get_switch_state(hm.square_switch[i]) == SW_CLOSED);
+			st_set_motor_inhibit(hm.motor[i], closed);
+			st_set_motor_inhibit(hm.square_motor[i], square_closed);
+			if (closed != square_closed) {					// one side is still searching
+				tripped = true;
+				searching = true;
+				continue;
+			}
+		}
+		if (closed) {
+			hm.tripped[i] = true;
+			tripped = true;
+		} else {
+			searching = true;
+		}
+	}
+	if ((tripped == true) && (searching == true)) {			// a switch held the move - carry on with the rest
+		return (_homing_axis_search(axis));
+	}
+	if ((hm.fast == true) && (searching == true)) {			// the short search ran out short of a switch
+		return (_homing_axis_fallback(axis));
+	}
+	st_clear_motor_inhibits();								// both sides of any gantry are on their switches
+	return (_homing_axis_latch(axis));						// all switches hit, or a full length search
 }
 
 static stat_t _homing_axis_latch(int8_t axis)				// latch to switch open
 {
-	_homing_axis_move(axis, hm.latch_backoff, hm.latch_velocity);    
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		sw_arm_latch(hm.homing_switch[i], SW_TRAILING);		// capture the step positions as the switch opens
+		if (hm.square_switch[i] != -1) {					// and stop each side of a gantry there
+			sw_set_latch_inhibit(hm.homing_switch[i], hm.motor[i]);
+			sw_arm_latch(hm.square_switch[i], SW_TRAILING);
+			sw_set_latch_inhibit(hm.square_switch[i], hm.square_motor[i]);
+		}
+	}
+	_homing_axis_move(hm.latch_backoff, hm.latch_velocity);    
 	return (_set_homing_func(_homing_axis_zero_backoff)); 
 }
 
 static stat_t _homing_axis_zero_backoff(int8_t axis)		// backoff to zero position
 {
-	_homing_axis_move(axis, hm.zero_backoff, hm.search_velocity);
+	st_clear_motor_inhibits();								// a squared gantry moves as one again
+	_homing_axis_move(hm.zero_backoff, hm.search_velocity);
 	return (_set_homing_func(_homing_axis_set_zero));
 }
 
 static stat_t _homing_axis_set_zero(int8_t axis)			// set zero and finish up
 {
-	if (hm.set_coordinates != false) {						// do not set axis if in G28.4 cycle
-		cm_set_axis_origin(axis, 0);
-		mp_set_runtime_position(axis, 0);
-	} else {
-//		cm_set_axis_origin(axis, cm_get_runtime_work_position(axis));
-		cm_set_axis_origin(axis, cm_get_work_position(RUNTIME, axis));
+	for (uint8_t i=0; i<AXES; i++) {
+		if (hm.axes[i] == false) { continue;}
+		if (hm.set_coordinates != false) {					// do not set axis if in G28.4 cycle
+			// zero is the zero backoff from where the switch opened, regardless of any decel overrun
+			float latch_position;
+			float position = 0;
+			if (sw_get_latch_position(hm.homing_switch[i], &latch_position) == true) {
+				position = mp_get_runtime_absolute_position(i) - latch_position - hm.zero_backoff[i];
+			}
+			cm_set_axis_origin(i, position);
+			mp_set_runtime_position(i, position);
+		} else {
+//			cm_set_axis_origin(i, cm_get_runtime_work_position(i));
+			cm_set_axis_origin(i, cm_get_work_position(RUNTIME, i));
+		}
+		cm.a[i].jerk_max = hm.saved_jerk[i];				// restore the max jerk value
+		cm.homed[i] = true;
 	}
-	cm.a[axis].jerk_max = hm.saved_jerk;					// restore the max jerk value
-	cm.homed[axis] = true;
+	cm_set_soft_limits();									// the envelope depends on the homing switch
 	return (_set_homing_func(_homing_axis_start));
 }
 
-static stat_t _homing_axis_move(int8_t axis, float target, float velocity)
+/*
+ * _homing_axis_move() - move the axes with non-zero travel
+ *
+ *	The feed rate is the fastest at which no axis exceeds its own velocity, so an
+ *	axis moving alone runs at its velocity and the axes of a group finish together.
+ */
+static stat_t _homing_axis_move(const float travel[], const float velocity[])
 {
 	float vect[] = {0,0,0,0,0,0};
 	float flags[] = {false, false, false, false, false, false};
+	float length = 0;
 
-	vect[axis] = target;
-	flags[axis] = true;
-	cm_set_feed_rate(velocity);
+	for (uint8_t i=0; i<AXES; i++) {
+		if (fp_ZERO(travel[i])) { continue;}
+		vect[i] = travel[i];
+		flags[i] = true;
+		length += square(travel[i]);
+	}
+	if (fp_ZERO(length)) { return (STAT_NOOP);}
+	length = sqrt(length);
+
+	float feed_rate = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		if (flags[i] == false) { continue;}
+		float axis_feed_rate = velocity[i] * length / fabs(travel[i]);
+		if ((fp_ZERO(feed_rate)) || (axis_feed_rate < feed_rate)) { feed_rate = axis_feed_rate;}
+	}
+	cm_set_feed_rate(feed_rate);
 	mp_flush_planner();										// don't use cm_request_queue_flush() here
 	cm_request_cycle_start();
 	ritorno(cm_straight_feed(vect, flags));
 	return (STAT_EAGAIN);
 }
 
-// _run_homing_dual_axis() - kernal routine for running homing on a dual axis
-//static stat_t _run_homing_dual_axis(int8_t axis) { return (STAT_OK);}
+/*
+ * _get_axis_motor() - return the nth (from 0) motor mapped to an axis, or -1 if none
+ */
+static int8_t _get_axis_motor(uint8_t axis, uint8_t nth)
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		if (st.m[motor].motor_map != axis) { continue;}
+		if (nth-- == 0) { return (motor);}
+	}
+	return (-1);
+}
 
 /*
  * _get_next_axis() - return next axis in sequence based on axis in arg
@@ -435,58 +661,34 @@ static int8_t _get_next_axis(int8_t axis)
 }
 
 /*
- * _get_next_axes() - return next axis in sequence based on axis in arg
+ * _get_next_axes() - return the lead axis of the next group and set hm.axes[]
  *
- *	Accepts "axis" arg as the current axis; or -1 to retrieve the first axis
- *	Returns next axis based on "axis" argument
- *	Returns -1 when all axes have been processed
- *	Returns -2 if no axes are specified (Gcode calling error)
- *
- *	hm.axis2 is set to the secondary axis if axis is a dual axis
- *	hm.axis2 is set to -1 otherwise
- *
- *	Isolating this function facilitates implementing more complex and 
- *	user-specified axis homing orders
+ *	Accepts "axis" arg as the current lead axis; or -1 to retrieve the first group
+ *	Returns the next axis from _get_next_axis() that has not already been homed
+ *	with an earlier group, or -1 or -2 as _get_next_axis() does
  *
- *	Note: the logic to test for disabled or inhibited axes will allow the 
- *	following condition to occur: A single axis is specified but it is
- *	disabled or inhibited - homing will say that it was successfully homed.
+ *	hm.axes[] is set for the lead axis and every other requested axis that shares
+ *	its non-zero homing group. All of them are marked done. B and C are not in the
+ *	homing order, so they are only homed as members of a group led by X, Y, Z or A.
  */
-/*
-int8_t _get_next_axes(int8_t axis)
+static int8_t _get_next_axes(int8_t axis)
 {
-	int8_t next_axis;
-	hm.axis2 = -1;
-
-	// Scan target vector for case where no valid axes are specified
-	for (next_axis = 0; next_axis < AXES; next_axis++) {
-		if ((fp_TRUE(gf.target[next_axis])) &&
-			(cm.a[next_axis].axis_mode != AXIS_INHIBITED) &&
-			(cm.a[next_axis].axis_mode != AXIS_DISABLED)) {
-			break;
+	do {
+		axis = _get_next_axis(axis);
+	} while ((axis >= 0) && (hm.done[axis] == true));
+	if (axis < 0) { return (axis);}
+
+	uint8_t group = cm.a[axis].homing_group;
+	for (uint8_t i=0; i<AXES; i++) {
+		hm.axes[i] = false;
+		if ((i == axis) || ((group != 0) && (hm.done[i] == false) &&
+			(fp_TRUE(gf.target[i])) && (cm.a[i].homing_group == group))) {
+			hm.axes[i] = true;
+			hm.done[i] = true;
 		}
 	}
-	if (next_axis == AXES) {
-//		fprintf_P(stderr, PSTR("***** Homing failed: none or disabled/inhibited axes specified\n"));
-		return (-2);	// didn't find any axes to process
-	}
-
-	// Scan target vector from the current axis to find next axis or the end
-	for (next_axis = ++axis; next_axis < AXES; next_axis++) {
-		if (fp_TRUE(gf.target[next_axis])) {
-			if ((cm.a[next_axis].axis_mode == AXIS_INHIBITED) ||
-				(cm.a[next_axis].axis_mode == AXIS_DISABLED)) {	// Skip if axis disabled or inhibited
-				continue;
-			}
-			break;		// got a good one
-		}
-		return (-1);	// you are done
-	}
-
-	// Got a valid axis. Find out if it's a dual
-	return (STAT_OK);
+	return (axis);
 }
-*/
 
 #ifdef __cplusplus
 }
@@ -28,6 +28,7 @@
 #include "tinyg2.h"
 #include "util.h"
 #include "config.h"
+#include "controller.h"
 #include "json_parser.h"
 #include "text_parser.h"
 #include "gcode_parser.h"
@@ -36,6 +37,7 @@
 #include "stepper.h"
 #include "report.h"
 #include "switch.h"
+#include "kinematics.h"
 
 #ifdef __cplusplus
 extern "C"{
@@ -43,33 +45,36 @@ extern "C"{
 
 /**** Probe singleton structure ****/
 
-struct pbProbingSingleton {		// persistent homing runtime variables
+struct pbProbingSingleton {		// persistent probing runtime variables
 	// controls for probing cycle
-	int8_t axis;				// axis currently being homed
+	int8_t axis;				// axis currently being probed
 	uint8_t min_mode;			// mode for min switch fo this axis
 	uint8_t max_mode;			// mode for max switch fo this axis
-	int8_t homing_switch;		// homing switch for current axis (index into switch flag table)
+	int8_t homing_switch;		// probe switch for current axis (index into switch flag table)
 	int8_t limit_switch;		// limit switch for current axis, or -1 if none
-	uint8_t homing_closed;		// 0=open, 1=closed
-	uint8_t limit_closed;		// 0=open, 1=closed
 	uint8_t (*func)(int8_t axis);// binding for callback function state machine
-	float open_position;
-	
+	uint8_t mapping;			// TRUE while running the surface mapping cycle
+	uint16_t point;				// mapping: grid points probed so far
+	uint16_t cell;				// mapping: map_z[] index of the point being probed
+
 	// per-axis parameters
-	float direction;			// set to 1 for positive (max), -1 for negative (to min);
-	float search_travel;		// signed distance to travel in search
-	float search_velocity;		// search speed as positive number
-	float latch_velocity;		// latch speed as positive number
-	float latch_backoff;		// max distance to back off switch during latch phase 
-	float zero_backoff;			// distance to back off switch before setting zero
-	float max_clear_backoff;	// maximum distance of switch clearing backoffs before erring out
+	float search_travel;		// signed distance to travel in the fast approach
+	float search_velocity;		// fast approach speed as positive number
+	float latch_velocity;		// retouch speed as positive number
+	float latch_backoff;		// signed distance to retract from the trigger point before a retouch
+	float zero_backoff;			// signed distance from the trigger point to finish the axis
+	float trigger_position;		// machine position of the most recent probe trigger
+
+	// multi-touch averaging
+	uint8_t touch_count;		// retouches taken for this axis
+	float touch_sum;			// sum of the retouch trigger positions
 
 	// state saved from gcode model
 	float saved_feed_rate;		// F setting
 	uint8_t saved_units_mode;	// G20,G21 global setting
 	uint8_t saved_coord_system;	// G54 - G59 setting
 	uint8_t saved_distance_mode;// G90,G91 global setting
-	float saved_jerk;			// saved and restored for each axis homed	
+	float saved_jerk;			// saved and restored for each axis probed
 };
 static struct pbProbingSingleton pb;
 
@@ -78,99 +83,108 @@ static struct pbProbingSingleton pb;
 
 static stat_t _set_pb_func(uint8_t (*func)(int8_t axis));
 static stat_t _probing_axis_start(int8_t axis);
+static stat_t _probing_axis_setup(int8_t axis);
 static stat_t _probing_axis_clear(int8_t axis);
 static stat_t _probing_axis_backoff_home(int8_t axis);
 static stat_t _probing_axis_backoff_limit(int8_t axis);
 static stat_t _probing_axis_search(int8_t axis);
-static stat_t _probing_axis_latch(int8_t axis);
+static stat_t _probing_axis_search_check(int8_t axis);
+static stat_t _probing_axis_retract(int8_t axis);
+static stat_t _probing_axis_retouch(int8_t axis);
+static stat_t _probing_axis_retouch_check(int8_t axis);
 static stat_t _probing_axis_zero_backoff(int8_t axis);
 static stat_t _probing_axis_set_zero(int8_t axis);
 static stat_t _probing_axis_move(int8_t axis, float target, float velocity);
 static stat_t _probing_finalize_exit(int8_t axis);
 static stat_t _probing_error_exit(int8_t axis);
 static int8_t _get_next_axis(int8_t axis);
+static void _probing_save_state(void);
+static stat_t _mapping_raise(int8_t axis);
+static stat_t _mapping_move_to_point(int8_t axis);
+static stat_t _mapping_probe_point(int8_t axis);
+static stat_t _mapping_finalize_exit(int8_t axis);
+static stat_t _mapping_traverse(float target[], float flags[]);
 
 
 /*****************************************************************************
- * cm_probing_cycle_start()	- G28.1 homing cycle using limit switches
- * cm_probing_callback() 	- main loop callback for running the homing cycle
- *
- * Homing works from a G28.1 according to the following writeup: 
- *	https://github.com/synthetos/TinyG/wiki/TinyG-Homing-(version-0.95-and-above)
+ * cm_probing_cycle_start()	- G38.2 probing cycle using the homing switch inputs
+ * cm_probing_callback() 	- main loop callback for running the probing cycle
  *
  *	--- How does this work? ---
  *
- *	Homing is invoked using a G28.1 command with 1 or more axes specified in the
- *	command: e.g. g28.1 x0 y0 z0     (FYI: the number after each axis is irrelevant)
- *
- *	Homing is always run in the following order - for each enabeled axis:
- *	  Z,X,Y,A			Note: B and C cannot be homed
- *
- *	At the start of a homing cycle those switches configured for homing 
- *	(or for homing and limits) are treated as homing switches (they are modal).
+ *	Probing is invoked using a G38.2 command with 1 or more axes specified in the
+ *	command: e.g. g38.2 z0     (FYI: the number after each axis is irrelevant)
  *
- *	After initialization the following sequence is run for each axis to be homed:
+ *	Probing is run in the following order - for each enabled axis:
+ *	  Z,X,Y,A			Note: B and C cannot be probed
  *
- *	  0. If a homing or limit switch is closed on invocation, clear off the switch
- *	  1. Drive towards the homing switch at search velocity until switch is hit
- *	  2. Drive away from the homing switch at latch velocity until switch opens
- *	  3. Back off switch by the zero backoff distance and set zero for that axis
+ *	The probe is the switch configured for homing on the axis. After initialization
+ *	the following sequence is run for each axis to be probed:
  *
- *	Homing works as a state machine that is driven by registering a callback 
- *	function at hm.func() for the next state to be run. Once the axis is 
- *	initialized each callback basically does two things (1) start the move 
- *	for the current function, and (2) register the next state with hm.func(). 
- *	When a move is started it will either be interrupted if the homing switch 
- *	changes state, This will cause the move to stop with a feedhold. The other 
- *	thing that can happen is the move will run to its full length if no switch 
- *	change is detected (hit or open),
+ *	  0. If the probe or limit switch is closed on invocation, clear off the switch
+ *	  1. Fast approach towards the probe at the search velocity until it triggers
+ *	  2. Retract to the latch backoff distance short of where the probe triggered
+ *	  3. Retouch at the latch velocity until the probe triggers again
+ *	  4. Repeat 2 and 3 for the number of touches set by {"prt":n}
+ *	  5. Back off to the zero backoff distance from the trigger position
  *
- *	Once all moves for an axis are complete the next axis in the sequence is homed
+ *	The trigger position of every touch is latched by the switch interrupt as the
+ *	probe closes (see sw_arm_latch()), so it does not depend on how far the move
+ *	coasts while it decelerates in the feedhold. This is what lets the approach run
+ *	fast - overtravel only costs the retract. The retouches are averaged for the
+ *	result, or with {"prt":0} the fast approach position is used alone. The result
+ *	is reported in machine coordinates by the "prb" group (prbx, prby...).
  *
- *	When a homing cycle is intiated the homing state is set to HOMING_NOT_HOMED
- *	When homing comples successfully this si set to HOMING_HOMED, otherwise it
- *	remains HOMING_NOT_HOMED.	
+ *	Probing works as a state machine that is driven by registering a callback
+ *	function at pb.func() for the next state to be run. Each callback starts the
+ *	move for the current state and registers the next state with pb.func().
+ *	A move either stops in a feedhold when the probe closes, or runs its full
+ *	length if the probe does not trigger - which is an error.
  */
 /*	--- Some further details ---
  *
- *	Note: When coding a cycle (like this one) you get to perform one queued 
- *	move per entry into the continuation, then you must exit. 
+ *	Note: When coding a cycle (like this one) you get to perform one queued
+ *	move per entry into the continuation, then you must exit.
  *
- *	Another Note: When coding a cycle (like this one) you must wait until 
+ *	Another Note: When coding a cycle (like this one) you must wait until
  *	the last move has actually been queued (or has finished) before declaring
- *	the cycle to be done. Otherwise there is a nasty race condition in the 
- *	tg_controller() that will accept the next command before the position of 
+ *	the cycle to be done. Otherwise there is a nasty race condition in the
+ *	tg_controller() that will accept the next command before the position of
  *	the final move has been recorded in the Gcode model. That's what the call
  *	to cm_isbusy() is about.
  */
 
 uint8_t cm_probe_cycle_start(void)
 {
-	// save relevant non-axis parameters from Gcode model
-	pb.saved_units_mode = gm.units_mode;
-	pb.saved_coord_system = gm.coord_system;
-	pb.saved_distance_mode = gm.distance_mode;
-	pb.saved_feed_rate = gm.feed_rate;
-	
-	pb.open_position = 0;
-	
-	// set working values
-	cm_set_units_mode(MILLIMETERS);
-	cm_set_distance_mode(INCREMENTAL_MODE);
-	cm_set_coord_system(ABSOLUTE_COORDS);	// homing is done in machine coordinates
-
+	_probing_save_state();
+	pb.mapping = false;
 	pb.axis = -1;							// set to retrieve initial axis
 	pb.func = _probing_axis_start; 			// bind initial processing function
 	cm.cycle_state = CYCLE_PROBE;
 	st_energize_motors();					// enable motors if not already enabled
+	controller_request_task(TASK_PROBE);
 	return (STAT_OK);
 }
 
+static void _probing_save_state()
+{
+	// save relevant non-axis parameters from Gcode model
+	pb.saved_units_mode = gmx.modal.units_mode;
+	pb.saved_coord_system = gmx.modal.coord_system;
+	pb.saved_distance_mode = gmx.modal.distance_mode;
+	pb.saved_feed_rate = gm.feed_rate;
+
+	// set working values
+	cm_set_units_mode(MILLIMETERS);
+	cm_set_distance_mode(INCREMENTAL_MODE);
+	cm_set_coord_system(ABSOLUTE_COORDS);	// probing is done in machine coordinates
+}
+
 uint8_t cm_probe_callback(void)
 {
-	if (cm.cycle_state != CYCLE_PROBE) { return (STAT_NOOP);}	// exit if not in a homing cycle
+	if (cm.cycle_state != CYCLE_PROBE) { return (STAT_NOOP);}	// exit if not in a probing cycle
 	if (cm_get_runtime_busy() == true) { return (STAT_EAGAIN);}	// sync to planner move ends
-	return (pb.func(pb.axis));									// execute the current homing move
+	return (pb.func(pb.axis));									// execute the current probing move
 }
 
 int8_t cm_probe_get_axis(void)
@@ -180,7 +194,7 @@ int8_t cm_probe_get_axis(void)
 
 void cm_probe_set_position(float p)
 {
-	pb.open_position = p;
+	cm.probe_position[pb.axis] = p;
 }
 
 
@@ -199,20 +213,24 @@ static stat_t _probing_finalize_exit(int8_t axis)	// third part of return to hom
 }
 
 
-/* 
- * _probing_error_exit()
+/*
+ * _probing_error_exit() - axis is -2 for no probe axes, -3 if the probe did not trigger on pb.axis
  */
 
 static stat_t _probing_error_exit(int8_t axis)
 {
-	// Generate the warning message. Since the error exit returns via the homing callback 
-	// - and not the main controller - it requires its own display processing 
+	// Generate the warning message. Since the error exit returns via the homing callback
+	// - and not the main controller - it requires its own display processing
 	cmd_reset_list();
 	if (axis == -2) {
 		cmd_add_conditional_message((const char_t *)"*** WARNING *** Probing error: Specified axis(es) cannot use probe");
 	} else {
 		char message[CMD_MESSAGE_LEN];
-		sprintf_P(message, (const PROGMEM char *)("*** WARNING *** Probing error: %c axis settings misconfigured"), cm_get_axis_char(axis));
+		if (axis == -3) {
+			sprintf_P(message, (const PROGMEM char *)("*** WARNING *** Probing error: %c axis probe did not trigger"), cm_get_axis_char(pb.axis));
+		} else {
+			sprintf_P(message, (const PROGMEM char *)("*** WARNING *** Probing error: %c axis settings misconfigured"), cm_get_axis_char(axis));
+		}
 		cmd_add_conditional_message((const char_t *)message);
 	}
 	cmd_print_list(STAT_PROBING_CYCLE_FAILED, TEXT_INLINE_VALUES, JSON_RESPONSE_FORMAT);
@@ -220,25 +238,31 @@ static stat_t _probing_error_exit(int8_t axis)
 	// clean up and exit
 	mp_flush_planner(); 						// should be stopped, but in case of switch closure
 												// don't use cm_request_queue_flush() here
+	if (pb.axis >= 0) { cm.a[pb.axis].jerk_max = pb.saved_jerk;}
 
 	cm_set_coord_system(pb.saved_coord_system);	// restore to work coordinate system
 	cm_set_units_mode(pb.saved_units_mode);
 	cm_set_distance_mode(pb.saved_distance_mode);
 	cm_set_feed_rate(pb.saved_feed_rate);
 	cm_set_motion_mode(MODEL, MOTION_MODE_CANCEL_MOTION_MODE);
+	pb.mapping = false;							// the map stays invalid
 	cm.cycle_state = CYCLE_OFF;
 	cm_cycle_end();
 	return (STAT_PROBING_CYCLE_FAILED);
 }
 
-/* Homing axis moves - these execute in sequence for each axis
+/* Probing axis moves - these execute in sequence for each axis
  *	_probing_axis_start()		- get next axis, initialize variables, call the clear
  *	_probing_axis_clear()		- initiate a clear to move off a switch that is thrown at the start
- *	_probing_axis_backoff_home()	- back off the cleared home switch
+ *	_probing_axis_backoff_home()	- back off the cleared probe switch
  *	_probing_axis_backoff_limit()- back off the cleared limit switch
- *	_probing_axis_search()		- fast search for switch, closes switch
- *	_probing_axis_latch()		- slow reverse until switch opens again
- *	_probing_axis_final()		- backoff from latch location to zero position 
+ *	_probing_axis_search()		- fast approach to the probe, latching the trigger position
+ *	_probing_axis_search_check()	- check the probe triggered and start the retouches
+ *	_probing_axis_retract()		- retract to the latch backoff short of the last trigger
+ *	_probing_axis_retouch()		- slow retouch, latching the trigger position
+ *	_probing_axis_retouch_check()- accumulate the retouch and run the next one
+ *	_probing_axis_zero_backoff()	- back off to the zero backoff from the trigger position
+ *	_probing_axis_set_zero()		- record the result and finish up
  *	_probing_axis_move()			- helper that actually executes the above moves
  */
 
@@ -256,76 +280,89 @@ static stat_t _probing_axis_start(int8_t axis)
 			return (_probing_error_exit(-2));
 		}
 	}
+	stat_t status = _probing_axis_setup(axis);
+	if (status == STAT_NOOP) {								// skip to the next axis
+		return (_set_pb_func(_probing_axis_start));
+	} else if (status != STAT_OK) {
+		return (_probing_error_exit(axis));
+	}
+	return (_set_pb_func(_probing_axis_clear));				// start the clear
+}
+
+// returns STAT_OK if the axis is set up, STAT_NOOP if homing is disabled for it, or an error
+static stat_t _probing_axis_setup(int8_t axis)
+{
 	// trap gross mis-configurations
 //	if ((cm.a[axis].search_velocity == 0) || (cm.a[axis].latch_velocity == 0)) {
 	if ((fp_ZERO(cm.a[axis].search_velocity)) || (fp_ZERO(cm.a[axis].latch_velocity))) {
-		return (_probing_error_exit(axis));
+		return (STAT_PROBING_CYCLE_FAILED);
 	}
 	if ((cm.a[axis].travel_max <= 0) || (cm.a[axis].latch_backoff <= 0)) {
-		return (_probing_error_exit(axis));
+		return (STAT_PROBING_CYCLE_FAILED);
 	}
+	if (AUX_AXIS(axis)) { return (STAT_PROBING_CYCLE_FAILED);}	// the aux queue doesn't stop on switches
 
 	// determine the switch setup and that config is OK
 	pb.min_mode = get_switch_mode(MIN_SWITCH(axis));
 	pb.max_mode = get_switch_mode(MAX_SWITCH(axis));
 
 	if ( ((pb.min_mode & SW_HOMING_BIT) ^ (pb.max_mode & SW_HOMING_BIT)) == 0) {// one or the other must be homing
-		return (_probing_error_exit(axis));					// axis cannot be homed
+		return (STAT_PROBING_CYCLE_FAILED);					// axis cannot be probed
 	}
 	pb.axis = axis;											// persist the axis
 	pb.search_velocity = fabs(cm.a[axis].search_velocity);	// search velocity is always positive
 	pb.latch_velocity = fabs(cm.a[axis].latch_velocity);	// latch velocity is always positive
+	pb.touch_count = 0;
+	pb.touch_sum = 0;
 
-	// setup parameters homing to the minimum switch
+	// setup parameters probing to the minimum switch
 	if (pb.min_mode & SW_HOMING_BIT) {
-		pb.homing_switch = MIN_SWITCH(axis);				// the min is the homing switch
+		pb.homing_switch = MIN_SWITCH(axis);				// the min is the probe switch
 		pb.limit_switch = MAX_SWITCH(axis);					// the max would be the limit switch
 		pb.search_travel = -cm.a[axis].travel_max;			// search travels in negative direction
-		pb.latch_backoff = cm.a[axis].latch_backoff;		// latch travels in positive direction
+		pb.latch_backoff = cm.a[axis].latch_backoff;		// retract travels in positive direction
 		pb.zero_backoff = cm.a[axis].zero_backoff;
 
-	// setup parameters for positive travel (homing to the maximum switch)
+	// setup parameters for positive travel (probing to the maximum switch)
 	} else {
-		pb.homing_switch = MAX_SWITCH(axis);				// the max is the homing switch
+		pb.homing_switch = MAX_SWITCH(axis);				// the max is the probe switch
 		pb.limit_switch = MIN_SWITCH(axis);					// the min would be the limit switch
 		pb.search_travel = cm.a[axis].travel_max;			// search travels in positive direction
-		pb.latch_backoff = -cm.a[axis].latch_backoff;		// latch travels in negative direction
+		pb.latch_backoff = -cm.a[axis].latch_backoff;		// retract travels in negative direction
 		pb.zero_backoff = -cm.a[axis].zero_backoff;
 	}
-    // if homing is disabled for the axis then skip to the next axis
+    // if homing is disabled for the axis then skip it
 	uint8_t sw_mode = get_switch_mode(pb.homing_switch);
 	if ((sw_mode != SW_MODE_HOMING) && (sw_mode != SW_MODE_HOMING_LIMIT)) {
-		return (_set_pb_func(_probing_axis_start));
+		return (STAT_NOOP);
 	}
 	// disable the limit switch parameter if there is no limit switch
 	if (get_switch_mode(pb.limit_switch) == SW_MODE_DISABLED) {
 		pb.limit_switch = -1;
 	}
 	pb.saved_jerk = cm.a[axis].jerk_max;					// save the max jerk value
-	return (_set_pb_func(_probing_axis_clear));				// start the clear
+	return (STAT_OK);
 }
 
 // Handle an initial switch closure by backing off switches
 // NOTE: Relies on independent switches per axis (not shared)
 static stat_t _probing_axis_clear(int8_t axis)				// first clear move
 {
-//+++++	int8_t homing = read_switch(pb.homing_switch);
-//+++++	int8_t limit = read_switch(pb.limit_switch);
-	int8_t homing = SW_OPEN;
-	int8_t limit = SW_OPEN;
+	int8_t homing = get_switch_state(pb.homing_switch);
+	int8_t limit = (pb.limit_switch == -1) ? SW_OPEN : get_switch_state(pb.limit_switch);
 
 	if ((homing == SW_OPEN) && (limit != SW_CLOSED)) {
  		return (_set_pb_func(_probing_axis_search));		// OK to start the search
 	}
 	if (homing == SW_CLOSED) {
 		_probing_axis_move(axis, pb.latch_backoff, pb.search_velocity);
- 		return (_set_pb_func(_probing_axis_backoff_home));	// will backoff homing switch some more
+ 		return (_set_pb_func(_probing_axis_backoff_home));	// will backoff probe switch some more
 	}
 	_probing_axis_move(axis, -pb.latch_backoff, pb.search_velocity);
  	return (_set_pb_func(_probing_axis_backoff_limit));		// will backoff limit switch some more
 }
 
-static stat_t _probing_axis_backoff_home(int8_t axis)		// back off cleared homing switch
+static stat_t _probing_axis_backoff_home(int8_t axis)		// back off cleared probe switch
 {
 	_probing_axis_move(axis, pb.latch_backoff, pb.search_velocity);
     return (_set_pb_func(_probing_axis_search));
@@ -337,29 +374,69 @@ static stat_t _probing_axis_backoff_limit(int8_t axis)		// back off cleared limi
     return (_set_pb_func(_probing_axis_search));
 }
 
-static stat_t _probing_axis_search(int8_t axis)				// start the search
+static stat_t _probing_axis_search(int8_t axis)				// fast approach
 {
-	cm.a[axis].jerk_max = cm.a[axis].jerk_homing;	// use the homing jerk for search onward
+	cm.a[axis].jerk_max = cm.a[axis].jerk_homing;			// use the homing jerk for search onward
+	sw_arm_latch(pb.homing_switch, SW_LEADING);				// capture the step positions as the probe closes
 	_probing_axis_move(axis, pb.search_travel, pb.search_velocity);
-    return (_set_pb_func(_probing_axis_latch));
+    return (_set_pb_func(_probing_axis_search_check));
+}
+
+static stat_t _probing_axis_search_check(int8_t axis)
+{
+	if (sw_get_latch_position(pb.homing_switch, &pb.trigger_position) == false) {
+		return (_probing_error_exit(-3));					// ran the full search without a trigger
+	}
+	if (cm.probe_touches == 0) {							// the fast approach is the result
+		cm_probe_set_position(pb.trigger_position);
+		return (_probing_axis_zero_backoff(axis));
+	}
+	return (_probing_axis_retract(axis));
 }
 
-static stat_t _probing_axis_latch(int8_t axis)				// latch to switch open
+static stat_t _probing_axis_retract(int8_t axis)			// retract short of the last trigger
 {
-	_probing_axis_move(axis, pb.latch_backoff, pb.latch_velocity);    
-	return (_set_pb_func(_probing_axis_zero_backoff)); 
+	float travel = pb.trigger_position + pb.latch_backoff - mp_get_runtime_absolute_position(axis);
+	_probing_axis_move(axis, travel, pb.search_velocity);	// takes up any overtravel as well
+	return (_set_pb_func(_probing_axis_retouch));
+}
+
+static stat_t _probing_axis_retouch(int8_t axis)			// slow retouch
+{
+	sw_arm_latch(pb.homing_switch, SW_LEADING);
+	_probing_axis_move(axis, -2 * pb.latch_backoff, pb.latch_velocity);
+	return (_set_pb_func(_probing_axis_retouch_check));
+}
+
+static stat_t _probing_axis_retouch_check(int8_t axis)
+{
+	if (sw_get_latch_position(pb.homing_switch, &pb.trigger_position) == false) {
+		return (_probing_error_exit(-3));
+	}
+	pb.touch_sum += pb.trigger_position;
+	if (++pb.touch_count < cm.probe_touches) {
+		return (_probing_axis_retract(axis));
+	}
+	pb.trigger_position = pb.touch_sum / pb.touch_count;	// average of the retouches
+	cm_probe_set_position(pb.trigger_position);
+	return (_probing_axis_zero_backoff(axis));
 }
 
 static stat_t _probing_axis_zero_backoff(int8_t axis)		// backoff to zero position
 {
-	_probing_axis_move(axis, pb.zero_backoff, pb.search_velocity);
+	float travel = pb.trigger_position + pb.zero_backoff - mp_get_runtime_absolute_position(axis);
+	_probing_axis_move(axis, travel, pb.search_velocity);
 	return (_set_pb_func(_probing_axis_set_zero));
 }
 
-static stat_t _probing_axis_set_zero(int8_t axis)			// set zero and finish up
+static stat_t _probing_axis_set_zero(int8_t axis)			// finish up
 {
 	cm.a[axis].jerk_max = pb.saved_jerk;					// restore the max jerk value
-	//cm.homed[axis] = true;
+	if (pb.mapping == true) {								// record the point and go to the next
+		ik.map_z[pb.cell] = pb.trigger_position;
+		pb.point++;
+		return (_set_pb_func(_mapping_raise));
+	}
 	return (_set_pb_func(_probing_axis_start));
 }
 
@@ -368,14 +445,97 @@ static stat_t _probing_axis_move(int8_t axis, float target, float velocity)
 	float flags[] = {1,1,1,1,1,1};
 	set_vector_by_axis(target, axis);
 	cm_set_feed_rate(velocity);
-	cm_request_queue_flush();
+	mp_flush_planner();										// don't use cm_request_queue_flush() here
 	cm_request_cycle_start();
 	ritorno(cm_straight_feed(vector, flags));
 	return (STAT_EAGAIN);
 }
 
-/* _run_homing_dual_axis() - kernal routine for running homing on a dual axis */
-//static stat_t _run_homing_dual_axis(int8_t axis) { return (STAT_OK);}
+/*****************************************************************************
+ * cm_map_cycle_start() - surface mapping cycle - see kinematics.h
+ *
+ *	Probes Z at each point of the surface map grid with the G38.2 sequence above,
+ *	so the probe touches and averaging are the same. Between points Z rises to
+ *	the clearance height ($smz) and X and Y traverse to the next point. Rows are
+ *	probed in alternate directions to save travel, and each height is stored in
+ *	row major order. The map is invalid (not applied) until every point is probed.
+ *
+ *	_mapping_raise()			- rise to the clearance height
+ *	_mapping_move_to_point()	- traverse to the next grid point, or finish
+ *	_mapping_probe_point()		- start the probing sequence on Z
+ *	_mapping_finalize_exit()	- validate the map and finish the cycle
+ *	_mapping_traverse()			- helper to run the moves between points
+ */
+
+stat_t cm_map_cycle_start(void)
+{
+	if ((ik.map_cols < 2) || (ik.map_rows < 2) || (ik.map_dx <= 0) || (ik.map_dy <= 0)) {
+		return (STAT_INPUT_VALUE_UNSUPPORTED);
+	}
+	_probing_save_state();
+	ik_set_map_valid(false);					// map with no compensation
+	pb.mapping = true;
+	pb.point = 0;
+	pb.axis = AXIS_Z;
+	pb.func = _mapping_raise;
+	cm.cycle_state = CYCLE_PROBE;
+	st_energize_motors();
+	controller_request_task(TASK_PROBE);
+	return (STAT_OK);
+}
+
+static stat_t _mapping_raise(int8_t axis)
+{
+	float target[] = {0,0,0,0,0,0};
+	float flags[] = {0,0,0,0,0,0};
+	target[AXIS_Z] = ik.map_clearance - mp_get_runtime_absolute_position(AXIS_Z);
+	flags[AXIS_Z] = 1;
+	_mapping_traverse(target, flags);
+	return (_set_pb_func(_mapping_move_to_point));
+}
+
+static stat_t _mapping_move_to_point(int8_t axis)
+{
+	if (pb.point == (uint16_t)ik.map_cols * ik.map_rows) {
+		return (_mapping_finalize_exit(axis));
+	}
+	uint8_t row = pb.point / ik.map_cols;
+	uint8_t col = pb.point % ik.map_cols;
+	if (row & 1) { col = ik.map_cols - 1 - col;}				// serpentine
+	pb.cell = (uint16_t)row * ik.map_cols + col;
+
+	float target[] = {0,0,0,0,0,0};
+	float flags[] = {0,0,0,0,0,0};
+	target[AXIS_X] = ik.map_x + col * ik.map_dx - mp_get_runtime_absolute_position(AXIS_X);
+	target[AXIS_Y] = ik.map_y + row * ik.map_dy - mp_get_runtime_absolute_position(AXIS_Y);
+	flags[AXIS_X] = 1;
+	flags[AXIS_Y] = 1;
+	_mapping_traverse(target, flags);
+	return (_set_pb_func(_mapping_probe_point));
+}
+
+static stat_t _mapping_probe_point(int8_t axis)
+{
+	if (_probing_axis_setup(AXIS_Z) != STAT_OK) {
+		return (_probing_error_exit(AXIS_Z));
+	}
+	return (_set_pb_func(_probing_axis_clear));
+}
+
+static stat_t _mapping_finalize_exit(int8_t axis)
+{
+	ik_set_map_valid(true);
+	pb.mapping = false;
+	return (_probing_finalize_exit(axis));
+}
+
+static stat_t _mapping_traverse(float target[], float flags[])
+{
+	mp_flush_planner();										// don't use cm_request_queue_flush() here
+	cm_request_cycle_start();
+	ritorno(cm_straight_traverse(target, flags));
+	return (STAT_EAGAIN);
+}
 
 /**** HELPERS ****************************************************************/
 /*
@@ -0,0 +1,229 @@
+/*
+ * encoder.cpp - quadrature encoder feedback and position correction
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See encoder.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "stepper.h"
+#include "util.h"
+#include "encoder.h"
+
+#ifdef __ENCODERS
+
+using namespace Motate;
+
+static Timer<encoder_1_timer_num> encoder_1_timer;
+static Timer<encoder_2_timer_num> encoder_2_timer;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+enSingleton_t en;
+
+static int8_t _get_motor(const index_t index);
+static int32_t _get_count(const uint8_t encoder);
+static void _zero_encoder(const uint8_t motor);
+static void _update_motor(const uint8_t motor);
+
+/*
+ * en_init() - start the quadrature decoders and zero the encoders
+ *
+ *	Each TC block is put in position mode with channel 0 clocked by the decoder from
+ *	XC0. Both edges of both phases are counted. The software trigger clears the count.
+ */
+void en_init(void)
+{
+	encoder_1_timer.enablePeripheralClock();
+	encoder_1_timer.tc()->TC_BMR = TC_BMR_QDEN | TC_BMR_POSEN | TC_BMR_MAXFILT(ENCODER_FILTER);
+	encoder_1_timer.tcChan()->TC_CMR = TC_CMR_TCCLKS_XC0;
+	encoder_1_timer.tcChan()->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+
+	encoder_2_timer.enablePeripheralClock();
+	encoder_2_timer.tc()->TC_BMR = TC_BMR_QDEN | TC_BMR_POSEN | TC_BMR_MAXFILT(ENCODER_FILTER);
+	encoder_2_timer.tcChan()->TC_CMR = TC_CMR_TCCLKS_XC0;
+	encoder_2_timer.tcChan()->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) { _zero_encoder(motor);}
+	en.ready = true;
+}
+
+/*
+ * en_sample() - measure the following error and correct it - called from st_prep_line()
+ *
+ *	Adds the corrections to the substep residual of the segment being prepared.
+ *	Only whole steps are corrected, so an error inside one step (or one encoder
+ *	count) is left alone.
+ */
+void en_sample(float substep_residual[], const float substeps_per_step)
+{
+	if ((en.ready == false) || (en.active == 0)) { return;}
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		if ((en.active & (1 << motor)) == 0) { continue;}
+		enMotor_t *m = &en.m[motor];
+		float error = (float)(st_get_step_position(motor) - m->reference) -
+					  (float)_get_count(m->encoder) * m->steps_per_count;
+		m->following_error = error;
+
+		if (m->correction_max < 1) { continue;}
+		int32_t correction = (int32_t)error;			// truncates toward zero
+		int32_t limit = (int32_t)m->correction_max;
+		if (correction > limit) { correction = limit;}
+		if (correction < -limit) { correction = -limit;}
+		if (correction != 0) {
+			substep_residual[motor] += (float)correction * substeps_per_step;
+			m->reference += correction;					// counted now - see encoder.h
+		}
+	}
+}
+
+/*
+ * en_get_spindle_count() - read the spindle encoder - from the exec (see plan_thread.cpp)
+ */
+#ifdef __SPINDLE_SYNC
+int32_t en_get_spindle_count() { return (_get_count(en.spindle_encoder));}
+#endif
+
+/*
+ * _get_count() - read an encoder - a single register read, safe from any interrupt
+ */
+static int32_t _get_count(const uint8_t encoder)
+{
+	switch (encoder) {
+		case 1: { return ((int32_t)encoder_1_timer.tcChan()->TC_CV);}
+		case 2: { return ((int32_t)encoder_2_timer.tcChan()->TC_CV);}
+	}
+	return (0);
+}
+
+/*
+ * _zero_encoder() - take the motor's present position as no following error
+ */
+static void _zero_encoder(const uint8_t motor)
+{
+	enMotor_t *m = &en.m[motor];
+	m->reference = st_get_step_position(motor) - (int32_t)lrintf((float)_get_count(m->encoder) * m->steps_per_count);
+	m->following_error = 0;
+}
+
+/*
+ * _update_motor() - apply a changed encoder or encoder scale
+ */
+static void _update_motor(const uint8_t motor)
+{
+	enMotor_t *m = &en.m[motor];
+	m->steps_per_count = 1 / m->counts_per_step;
+	if (m->encoder != 0) {
+		en.active |= (1 << motor);
+	} else {
+		en.active &= ~(1 << motor);
+	}
+	if (en.ready == true) { _zero_encoder(motor);}	// config_init() runs before en_init()
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * _get_motor() - helper to return motor number as an index or -1 if na
+ */
+static int8_t _get_motor(const index_t index)
+{
+	char_t *ptr;
+	char_t motors[] = {"123456"};
+	char_t tmp[CMD_TOKEN_LEN+1];
+
+	strcpy_P(tmp, cfgArray[index].group);
+	if ((ptr = strchr(motors, tmp[0])) == NULL) {
+		return (-1);
+	}
+	return (ptr - motors);
+}
+
+stat_t en_set_enc(cmdObj_t *cmd)			// encoder on the motor
+{
+	if ((cmd->value < 0) || (cmd->value > ENCODERS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	int8_t motor = _get_motor(cmd->index);
+	if (motor < 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	set_ui8(cmd);
+	_update_motor(motor);
+	return (STAT_OK);
+}
+
+stat_t en_set_ecs(cmdObj_t *cmd)			// encoder counts per step
+{
+	if (fabs(cmd->value) < EPSILON) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	int8_t motor = _get_motor(cmd->index);
+	if (motor < 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	set_flt(cmd);
+	_update_motor(motor);
+	return (STAT_OK);
+}
+
+/*
+ * en_set_sse() - encoder on the spindle
+ * en_set_ssc() - spindle encoder counts per revolution - at least one
+ */
+#ifdef __SPINDLE_SYNC
+stat_t en_set_sse(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value > ENCODERS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_ui8(cmd));
+}
+
+stat_t en_set_ssc(cmdObj_t *cmd)
+{
+	if (fabs(cmd->value) < 1) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_flt(cmd));
+}
+#endif // __SPINDLE_SYNC
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_0enc[] PROGMEM = "[%s%s] m%s encoder%22d [0=none,1,2]\n";
+static const char fmt_0ecs[] PROGMEM = "[%s%s] m%s encoder counts per step%14.3f\n";
+static const char fmt_0ecm[] PROGMEM = "[%s%s] m%s encoder correction max%11.0f steps per segment [0=off]\n";
+static const char fmt_0fe[] PROGMEM = "[%s%s] m%s following error%15.3f steps\n";
+static const char fmt_sse[] PROGMEM = "[sse] spindle encoder%17d [0=none,1,2]\n";
+static const char fmt_ssc[] PROGMEM = "[ssc] spindle encoder counts%10.0f per revolution\n";
+
+void en_print_enc(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0enc, cmd->group, cmd->token, cmd->group, (uint8_t)cmd->value);}
+void en_print_ecs(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0ecs, cmd->group, cmd->token, cmd->group, cmd->value);}
+void en_print_ecm(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0ecm, cmd->group, cmd->token, cmd->group, cmd->value);}
+void en_print_fe(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0fe, cmd->group, cmd->token, cmd->group, cmd->value);}
+void en_print_sse(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sse);}
+void en_print_ssc(cmdObj_t *cmd) { text_print_flt(cmd, fmt_ssc);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ENCODERS
@@ -0,0 +1,120 @@
+/*
+ * encoder.h - quadrature encoder feedback and position correction
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Encoder feedback is enabled by __ENCODERS in tinyg2.h. The SAM3X timer counter
+ * blocks decode quadrature in hardware, so the counts cost no interrupts:
+ *
+ *	  - encoder 1 is TC0 (Motate timer 0) on TIOA0/TIOB0 - Due D2 and D13
+ *	  - encoder 2 is TC2 (Motate timer 6) on TIOA6/TIOB6 - Due D5 and D4
+ *
+ * The DDA runs on TC0 channel 2, which the decoder leaves free. The encoder inputs
+ * are the step and dir pins of motor 1, the step pin of motor 3 and the indicator
+ * LED in the Due pinout (hardware.h), so a board built for encoders routes those
+ * elsewhere.
+ *
+ * An encoder is given to a motor with $1enc (0=none, 1, 2), and its counts per step
+ * with $1ecs - negative if the encoder counts down when the motor steps forward.
+ * The encoder is read each time a segment is prepared (st_prep_line(), in the exec),
+ * and compared with the steps the DDA has emitted to the motor. The difference is
+ * the following error ($1fe, in steps - positive when the motor is behind), which
+ * can be added to the status report like any other value.
+ *
+ * If $1ecm is set, whole steps of following error, up to $1ecm per segment, are
+ * added to the segment being prepared - the same way the step error correction
+ * rides on the substep residual. Corrections are counted as soon as they are
+ * prepared, so one that has not been stepped out yet is not made twice. With $1ecm
+ * at 0 the error is only measured. The encoder is zeroed against the motor at
+ * startup and when $1enc or $1ecs is set, so a motor moved by hand while corrections
+ * are on is put back by the next move.
+ *
+ * With __SPINDLE_SYNC an encoder can be put on the spindle instead, for G33 and G84
+ * (see plan_thread.cpp): $sse gives the encoder (0=none, 1, 2) and $ssc its counts
+ * per spindle revolution - negative if it counts down when the spindle runs M3. An
+ * encoder on the spindle should not also be given to a motor.
+ */
+
+#ifndef ENCODER_H_ONCE
+#define ENCODER_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __ENCODERS
+
+#define ENCODERS				2		// hardware quadrature decoders - TC0 and TC2
+#define ENCODER_FILTER			2		// glitch filter on the inputs - MAXFILT, in 3 MCK units
+
+typedef struct enMotor {
+	uint8_t encoder;					// $1enc - encoder on this motor, 1..ENCODERS, 0=none
+	float counts_per_step;				// $1ecs - encoder counts per motor step (signed)
+	float correction_max;				// $1ecm - most steps corrected per segment, 0=off
+	float steps_per_count;				// 1 / counts_per_step - keeps the divide out of the exec
+	int32_t reference;					// step position at encoder zero, plus the corrections made
+	float following_error;				// $1fe - steps emitted less steps measured
+} enMotor_t;
+
+typedef struct enSingleton {
+	uint8_t ready;						// set once the decoders are running
+	uint8_t active;						// motors with an encoder - 1 bit per motor
+	enMotor_t m[MOTORS];
+#ifdef __SPINDLE_SYNC
+	uint8_t spindle_encoder;			// $sse - encoder on the spindle, 1..ENCODERS, 0=none
+	float spindle_counts;				// $ssc - encoder counts per spindle revolution (signed)
+#endif
+} enSingleton_t;
+
+extern enSingleton_t en;
+
+void en_init(void);
+void en_sample(float substep_residual[], const float substeps_per_step);
+#ifdef __SPINDLE_SYNC
+int32_t en_get_spindle_count(void);
+#endif
+
+stat_t en_set_enc(cmdObj_t *cmd);
+stat_t en_set_ecs(cmdObj_t *cmd);
+#ifdef __SPINDLE_SYNC
+stat_t en_set_sse(cmdObj_t *cmd);
+stat_t en_set_ssc(cmdObj_t *cmd);
+#endif
+
+#ifdef __TEXT_MODE
+	void en_print_enc(cmdObj_t *cmd);
+	void en_print_ecs(cmdObj_t *cmd);
+	void en_print_ecm(cmdObj_t *cmd);
+	void en_print_fe(cmdObj_t *cmd);
+	void en_print_sse(cmdObj_t *cmd);
+	void en_print_ssc(cmdObj_t *cmd);
+#else
+	#define en_print_enc tx_print_stub
+	#define en_print_ecs tx_print_stub
+	#define en_print_ecm tx_print_stub
+	#define en_print_fe tx_print_stub
+	#define en_print_sse tx_print_stub
+	#define en_print_ssc tx_print_stub
+#endif
+
+#endif // __ENCODERS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: ENCODER_H_ONCE
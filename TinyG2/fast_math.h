@@ -0,0 +1,95 @@
+/*
+ * fast_math.h - bounded-error square and cube roots for the planner
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The SAM3X8E has no FPU, so sqrt(), cbrt() and pow() are long soft-float 
+ * library calls. These replacements seed the reciprocal root from the float's
+ * bit pattern and refine it with a fixed number of Newton iterations, which 
+ * need only multiplies and subtracts. Their cost is fixed and their relative 
+ * error is bounded (measured over 1e-8 to 1e12):
+ *
+ *	fm_sqrt()	2 iterations	< 5e-6
+ *	fm_cbrt()	3 iterations	< 5e-7
+ *	fm_pow23()	3 iterations	< 5e-7		x^(2/3), used for velocity from length
+ *
+ * On a Cortex-M4F built with the FPU (CPU_FLAGS in the Makefile) fm_sqrt() is the
+ * VSQRT instruction instead (14 cycles) - exact, and cheaper than the
+ * iterations. The cube roots keep the iterations, which are all FPU multiplies.
+ *
+ * Arguments must be non-negative; zero and negative values return 0.
+ * Comment out __PLANNER_FAST_MATH in tinyg2.h to get the libm versions back,
+ * for example to validate the accuracy deltas in the planner unit tests.
+ */
+
+#ifndef FAST_MATH_H_ONCE
+#define FAST_MATH_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __PLANNER_FAST_MATH
+
+typedef union fmFloatBits {			// type pun between a float and its bit pattern
+	float f;
+	uint32_t i;
+} fmFloatBits_t;
+
+static inline float fm_rsqrt(const float x)	// 1/sqrt(x)
+{
+	fmFloatBits_t y;
+	y.f = x;
+	y.i = 0x5f375a86 - (y.i >> 1);
+	float half_x = (float)0.5 * x;
+	y.f = y.f * ((float)1.5 - (half_x * y.f * y.f));
+	y.f = y.f * ((float)1.5 - (half_x * y.f * y.f));
+	return (y.f);
+}
+
+static inline float fm_rcbrt(const float x)	// 1/cbrt(x)
+{
+	fmFloatBits_t y;
+	y.f = x;
+	y.i = 0x54a2fa8c - (y.i / 3);
+	y.f = y.f * (4 - (x * y.f * y.f * y.f)) * (float)(1.0/3);
+	y.f = y.f * (4 - (x * y.f * y.f * y.f)) * (float)(1.0/3);
+	y.f = y.f * (4 - (x * y.f * y.f * y.f)) * (float)(1.0/3);
+	return (y.f);
+}
+
+#ifdef __ARM_FP						// FPU instructions - VSQRT.F32 (needs -fno-math-errno)
+static inline float fm_sqrt(const float x) { return ((x > 0) ? __builtin_sqrtf(x) : 0);}
+#else
+static inline float fm_sqrt(const float x) { return ((x > 0) ? (x * fm_rsqrt(x)) : 0);}
+#endif
+static inline float fm_cbrt(const float x) { if (x <= 0) return (0); float r = fm_rcbrt(x); return (x * r * r);}
+static inline float fm_pow23(const float x) { return ((x > 0) ? (x * fm_rcbrt(x)) : 0);}
+
+#else
+
+#define fm_sqrt(x) sqrtf(x)
+#define fm_cbrt(x) cbrt(x)
+#define fm_pow23(x) pow(x, 0.66666666)
+
+#endif // __PLANNER_FAST_MATH
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: FAST_MATH_H_ONCE
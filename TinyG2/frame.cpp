@@ -0,0 +1,169 @@
+/*
+ * frame.cpp - sequence numbered line framing for windowed streaming
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See frame.h for the line format and the host's side of it */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "util.h"
+#include "xio.h"
+#include "frame.h"
+
+#ifdef __LINE_FRAMING
+
+#include "MotateTimers.h"
+using Motate::SysTickTimer;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define FRAME_NO_NAK (FRAME_SEQ_MASK+1)	// nak_seq while no nak is outstanding
+
+frSingleton_t fr;
+
+static stat_t _nak(void);
+static void _ack(void);
+
+/*
+ * fr_strip_frame() - check the framing of a line from USB and leave just the line in buf
+ *
+ *	Returns STAT_OK if the line is to be dispatched - it is the line wanted next,
+ *	or framing is off - and STAT_NOOP if it was dropped. Only the next line in
+ *	sequence is accepted, so a line that arrives is either run in order or sent
+ *	again by the host.
+ */
+
+stat_t fr_strip_frame(char_t *buf)
+{
+	if (fr.mode == 0) { return (STAT_OK);}
+	if (*buf == NUL) { return (STAT_NOOP);}				// the other half of a CR LF
+
+	char_t *star = (char_t *)strrchr((char *)buf, '*');
+	if ((*buf != FRAME_CHAR) || (star == NULL)) { return (_nak());}
+
+	char *end;
+	uint32_t seq = strtoul((char *)buf+1, &end, 10);
+	if ((end == (char *)buf+1) || (*end != ' ') || (seq > FRAME_SEQ_MASK)) { return (_nak());}
+
+	char *check_end;
+	uint32_t checksum = strtoul((char *)star+1, &check_end, 10);
+	if ((check_end == (char *)star+1) || (*check_end != NUL) ||
+		(checksum != compute_checksum(buf, (uint16_t)(star - buf)))) {
+		return (_nak());
+	}
+
+	int16_t ahead = (int16_t)((seq - fr.expected) & FRAME_SEQ_MASK);
+	if (ahead > 0) { return (_nak());}					// a line was lost before this one
+	if (ahead < 0) {									// received before - the host went back too far
+		fr.dropped++;
+		fr.ack_now = true;
+		return (STAT_NOOP);
+	}
+	fr.expected = (fr.expected + 1) & FRAME_SEQ_MASK;
+	fr.unacked++;
+	fr.nak_seq = FRAME_NO_NAK;
+
+	*star = NUL;
+	memmove(buf, end+1, (char *)star - end);			// the line and its NUL
+	return (STAT_OK);
+}
+
+/*
+ * _nak() - drop the line and ask for the one wanted next
+ *
+ *	A nak is not repeated for FRAME_NAK_MS, as every line of the window behind a
+ *	damaged one comes here too. After that it is, in case the resend was damaged.
+ */
+
+static stat_t _nak()
+{
+	uint32_t now = SysTickTimer.getValue();
+
+	fr.dropped++;
+	if ((fr.nak_seq == fr.expected) && ((now - fr.nak_ms) < FRAME_NAK_MS)) { return (STAT_NOOP);}
+	fr.nak_seq = fr.expected;
+	fr.nak_ms = now;
+	printf_P(PSTR("{\"lfn\":%lu}\n"), (unsigned long)fr.expected);
+	return (STAT_NOOP);
+}
+
+/*
+ * fr_ack_callback() - send the cumulative ack once enough lines wait on it or the input is quiet
+ * fr_reconnect()	 - tell the host where to pick up after USB comes back
+ */
+
+void fr_ack_callback()
+{
+	if ((fr.unacked == 0) && (fr.ack_now == false)) { return;}
+	if ((fr.unacked < FRAME_ACK_LINES) && (fr.ack_now == false) && (xio_get_rx_bufcount() != 0)) { return;}
+	_ack();
+}
+
+void fr_reconnect()
+{
+	if (fr.mode == 0) { return;}
+	fr.nak_seq = FRAME_NO_NAK;
+	_ack();
+}
+
+static void _ack()
+{
+	fr.unacked = 0;
+	fr.ack_now = false;
+	printf_P(PSTR("{\"lfa\":%lu}\n"), (unsigned long)((fr.expected - 1) & FRAME_SEQ_MASK));
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * fr_set_lfm() - turn framing on or off - off numbers from 0 again
+ * fr_set_lfs() - set the sequence number of the next line to accept
+ */
+
+stat_t fr_set_lfm(cmdObj_t *cmd)
+{
+	uint8_t mode = fr.mode;
+
+	ritorno(set_01(cmd));
+	if (fr.mode == mode) { return (STAT_OK);}
+	if (fr.mode == 0) { fr.expected = 0;}
+	fr.dropped = 0;
+	fr.unacked = 0;
+	fr.ack_now = false;
+	fr.nak_seq = FRAME_NO_NAK;
+	return (STAT_OK);
+}
+
+stat_t fr_set_lfs(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value > FRAME_SEQ_MASK)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	fr.expected = (uint32_t)cmd->value;
+	fr.nak_seq = FRAME_NO_NAK;
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LINE_FRAMING
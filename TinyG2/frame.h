@@ -0,0 +1,110 @@
+/*
+ * frame.h - sequence numbered line framing for windowed streaming
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Line framing is compiled in by __LINE_FRAMING in tinyg2.h and turned on by the
+ * host with {"lfm":1}. It lets a host keep a large window of lines in flight and
+ * recover from lost or damaged lines - or a USB reconnect - without restarting the
+ * job. Line credits ($rx) still say how much the firmware can take; framing says
+ * what it got.
+ *
+ * While it is on every line read from USB must be framed as:
+ *
+ *	@<seq> <line>*<checksum>
+ *
+ *	seq			0 to 65535, one more than the last line, wrapping to 0
+ *	line		the Gcode block, JSON object or command, as it would be sent unframed
+ *	checksum	compute_checksum() of everything before the '*', the '@' included -
+ *				the same hash the JSON footer carries
+ *
+ * Lines from macros and the program store are not framed. Blank lines are ignored,
+ * so CR LF line ends do no harm. The framing is stripped before the line is
+ * dispatched, so responses and reports are unchanged. The firmware sends:
+ *
+ *	{"lfa":n}	cumulative ack - every line up to and including n was received intact
+ *				and will be run. Sent once FRAME_ACK_LINES are waiting on it or the
+ *				input has gone quiet, and after a reconnect.
+ *	{"lfn":n}	nak - line n is wanted next. Sent when a line fails its checksum, is
+ *				unframed, or is not n. The lines after n are dropped, so the host
+ *				sends again from n. A nak for the same line is repeated no more
+ *				often than every FRAME_NAK_MS, so a window of damaged lines draws
+ *				one resend, and a damaged resend draws another.
+ *
+ * Lines that have already been received are dropped and acked again. The window is
+ * whatever the host keeps to resend - up to half the sequence space. The firmware
+ * holds nothing out of order; a go-back to the nak'd line is the retransmit, which
+ * keeps the receive side to a compare per line.
+ *
+ * With framing on, a USB disconnect no longer flushes the queues: the job runs on
+ * from what was received and the host picks up from the {"lfa":n} sent on reconnect.
+ * {"lfm":1} starts the numbering at {"lfs":n}, 0 unless it was set. {"lfm":0} - sent
+ * framed - returns to unframed lines. {"lfe":""} counts the lines dropped.
+ */
+
+#ifndef FRAME_H_ONCE
+#define FRAME_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __LINE_FRAMING
+
+#define FRAME_CHAR			'@'			// first char of a framed line
+#define FRAME_SEQ_MASK		0xFFFF		// sequence numbers wrap to 0 after this
+#define FRAME_ACK_LINES		8			// ack once this many lines are waiting on one
+#define FRAME_NAK_MS		100			// least time before a nak for the same line is repeated
+
+typedef struct frSingleton {
+	uint8_t mode;						// lfm - 1 = lines from USB must be framed
+	uint32_t expected;					// lfs - sequence number of the next line to accept
+	uint32_t dropped;					// lfe - lines dropped as damaged, unframed or out of order
+	uint8_t unacked;					// lines accepted since the last ack
+	uint8_t ack_now;					// a line that was already received came again - ack it
+	uint32_t nak_seq;					// line last nak'd
+	uint32_t nak_ms;					// SysTick time of the last nak
+} frSingleton_t;
+
+extern frSingleton_t fr;
+
+stat_t fr_strip_frame(char_t *buf);
+void fr_ack_callback(void);
+void fr_reconnect(void);
+
+stat_t fr_set_lfm(cmdObj_t *cmd);
+stat_t fr_set_lfs(cmdObj_t *cmd);
+
+#define FRAME_LINE(b) fr_strip_frame(b)
+#define FRAME_ACK_CALLBACK() fr_ack_callback()
+#define FRAME_ENABLED() (fr.mode != 0)
+#define FRAME_RECONNECT() fr_reconnect()
+
+#else
+
+#define FRAME_LINE(b) (STAT_OK)
+#define FRAME_ACK_CALLBACK()
+#define FRAME_ENABLED() (false)
+#define FRAME_RECONNECT()
+
+#endif // __LINE_FRAMING
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: FRAME_H_ONCE
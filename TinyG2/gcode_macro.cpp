@@ -0,0 +1,616 @@
+/*
+ * gcode_macro.cpp - O-word subroutines and loops, and numbered parameters
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See gcode_macro.h for usage
+ *
+ *	Every Gcode line passes through mc_line() as it is parsed, in the order received.
+ *	Bodies are kept in mc.buf as records of a length byte and the text of the line.
+ *	Subroutines are at the bottom of the buffer and loops that are being kept from
+ *	the input are above them. The top frame of the stack decides where lines come
+ *	from: while it is recording (the first pass of a loop from the input) the input
+ *	lines are added to the buffer as they run; otherwise the controller reads lines
+ *	from mc_read_line() until the frame ends. A loop that starts inside a body that
+ *	is already in memory reads that body in place.
+ */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "controller.h"
+#include "gcode_parser.h"
+#include "util.h"
+#include "xio.h"
+#include "gcode_macro.h"
+
+#ifdef __GCODE_MACROS
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+mcSingleton_t mc;
+
+enum mcWord {							// O-word keywords, in the order of _words[]
+	MC_WORD_NONE = 0,
+	MC_WORD_SUB,
+	MC_WORD_ENDSUB,
+	MC_WORD_CALL,
+	MC_WORD_REPEAT,
+	MC_WORD_ENDREPEAT,
+	MC_WORD_WHILE,
+	MC_WORD_ENDWHILE
+};
+static const char *const _words[] = { "SUB", "ENDSUB", "CALL", "REPEAT", "ENDREPEAT", "WHILE", "ENDWHILE" };
+#define MC_WORDS (sizeof(_words) / sizeof(_words[0]))
+
+static stat_t _read_oword(char_t **p, uint32_t *onum, uint8_t *word);
+static stat_t _end_define(void);
+static void _free_sub(uint32_t onum);
+static stat_t _call(char_t *p, uint32_t onum);
+static stat_t _start_loop(uint8_t type, uint32_t onum, char_t *line);
+static stat_t _assign(char_t *p);
+static stat_t _record(const char_t *line);
+static stat_t _push(uint8_t type, uint32_t onum);
+static void _pop(void);
+static mcFrame_t *_top(uint8_t type, uint32_t onum);
+static stat_t _expression(char_t **p, float *value);
+static stat_t _sum(char_t **p, float *value);
+static stat_t _product(char_t **p, float *value);
+static stat_t _primary(char_t **p, float *value);
+static stat_t _number(char_t **p, float *value);
+static stat_t _parameter(float index, uint8_t *parameter);
+static char_t _next(char_t **p);
+
+#define _recording() ((mc.depth != 0) && (mc.stack[mc.depth-1].recording == true))
+
+/*
+ * mc_init()	- clear all subroutines and parameters
+ * mc_reset()	- abandon calls, loops and a definition in progress - subroutines are kept
+ */
+void mc_init()
+{
+	memset(&mc, 0, sizeof(mc));
+}
+
+void mc_reset()
+{
+	while (mc.depth != 0) { _pop();}	// restores the call arguments
+	mc.define = 0;
+	mc.skip = 0;
+	mc.end = mc.subs_end;
+}
+
+/*
+ * mc_line() - run the macro part of a Gcode line - called by the Gcode parser
+ *
+ *	Returns STAT_OK if the line is for the Gcode parser, STAT_NOOP if it was taken here
+ *	(an O-word or # line, or a line kept in a body and not run now), or an error.
+ */
+stat_t mc_line(char_t *line)
+{
+	char_t *p = line;
+	uint32_t onum = 0;
+	uint8_t word = MC_WORD_NONE;
+	stat_t status = STAT_OK;
+
+	if (GC_IS_TOKEN_BLOCK(line)) {				// the program store never makes these inside a body
+		if ((mc.define != 0) || (mc.skip != 0) || (_recording())) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+		return (STAT_OK);
+	}
+	if (_next(&p) == 'O') {
+		p++;
+		status = _read_oword(&p, &onum, &word);
+	}
+	if (_recording()) {							// first pass of a loop - keep the line for the repeats
+		stat_t record_status;
+		if ((record_status = _record(line)) != STAT_OK) {
+			mc_reset();
+			return (record_status);
+		}
+	}
+	if (mc.define != 0) {						// defining - keep the line, don't run it
+		if ((word == MC_WORD_ENDSUB) && (onum == mc.define)) {
+			if (mc.define_full == false) { mc.define_full = (_record(line) != STAT_OK);}
+			return (_end_define());
+		}
+		if (mc.define_full == false) { mc.define_full = (_record(line) != STAT_OK);}
+		return (STAT_NOOP);
+	}
+	if (mc.skip != 0) {							// loop that runs no times - skip to its end
+		if ((onum == mc.skip) && ((word == MC_WORD_ENDREPEAT) || (word == MC_WORD_ENDWHILE))) { mc.skip = 0;}
+		return (STAT_NOOP);
+	}
+	ritorno(status);							// a bad O-word
+	if (word == MC_WORD_NONE) {
+		if (_next(&p) == '#') { return (_assign(p));}
+		return (STAT_OK);						// Gcode - "O100" alone is rejected by the parser
+	}
+
+	mcFrame_t *f;
+	float value;
+
+	switch (word) {
+		case MC_WORD_SUB: {
+			if (mc.depth != 0) { return (STAT_COMMAND_NOT_ACCEPTED);}
+			_free_sub(onum);					// a new definition replaces the old one
+			mc.define = onum;
+			mc.define_start = mc.end;
+			mc.define_full = false;
+			return (STAT_NOOP);
+		}
+		case MC_WORD_ENDSUB: {
+			if (_top(MC_CALL, onum) == NULL) { return (STAT_COMMAND_NOT_ACCEPTED);}
+			_pop();
+			return (STAT_NOOP);
+		}
+		case MC_WORD_CALL: { return (_call(p, onum));}
+
+		case MC_WORD_REPEAT: {
+			if (_next(&p) != '[') { return (STAT_BAD_NUMBER_FORMAT);}
+			ritorno(_primary(&p, &value));
+			if (value < 1) {
+				mc.skip = onum;
+				return (STAT_NOOP);
+			}
+			ritorno(_start_loop(MC_REPEAT, onum, line));
+			mc.stack[mc.depth-1].count = (uint32_t)value;
+			return (STAT_NOOP);
+		}
+		case MC_WORD_ENDREPEAT: {
+			if ((f = _top(MC_REPEAT, onum)) == NULL) { return (STAT_COMMAND_NOT_ACCEPTED);}
+			if (--f->count > 0) {
+				f->recording = false;
+				f->read = f->start;
+			} else {
+				_pop();
+			}
+			return (STAT_NOOP);
+		}
+		case MC_WORD_WHILE: {
+			if (_next(&p) != '[') { return (STAT_BAD_NUMBER_FORMAT);}
+			ritorno(_primary(&p, &value));
+			f = _top(MC_WHILE, onum);
+			if ((f != NULL) && (f->recording == false) && (mc.last == f->start)) {	// back at the top
+				if (fp_ZERO(value)) {
+					f->read = f->end;
+					_pop();
+				}
+				return (STAT_NOOP);
+			}
+			if (fp_ZERO(value)) {
+				mc.skip = onum;
+				return (STAT_NOOP);
+			}
+			return (_start_loop(MC_WHILE, onum, line));
+		}
+		case MC_WORD_ENDWHILE: {
+			if ((f = _top(MC_WHILE, onum)) == NULL) { return (STAT_COMMAND_NOT_ACCEPTED);}
+			f->end = (f->recording == true) ? mc.end : f->read;
+			f->recording = false;
+			f->read = f->start;					// the while line tests the condition again
+			return (STAT_NOOP);
+		}
+	}
+	return (STAT_UNRECOGNIZED_COMMAND);
+}
+
+/*
+ * mc_read_line() - read the next line of the body being run - for _command_dispatch()
+ */
+stat_t mc_read_line(char_t *buffer, uint16_t *index, size_t size)
+{
+	if (MC_IS_REPLAYING() == false) { return (STAT_EOF);}
+
+	mcFrame_t *f = &mc.stack[mc.depth-1];
+	if (f->read >= mc.end) {					// a body always ends with its end line
+		mc_reset();
+		return (STAT_EOF);
+	}
+	uint8_t length = mc.buf[f->read];
+	if (length >= size) { return (STAT_BUFFER_FULL);}
+	memcpy(buffer, &mc.buf[f->read+1], length);
+	buffer[length] = NUL;
+	mc.last = f->read;
+	f->read += length + 1;
+	*index = length;
+	return (STAT_OK);
+}
+
+/*
+ * mc_eval() - read a word value that is a parameter or an expression - for the Gcode parser
+ *
+ *	*pstr is at the # or [ and is left after the value.
+ */
+stat_t mc_eval(char_t **pstr, float *value)
+{
+	return (_primary(pstr, value));
+}
+
+/*
+ * mc_get_nesting() - return +1 if the line starts a body, -1 if it ends one, else 0
+ *
+ *	For the program store, which keeps lines inside bodies as text (see program_store.h).
+ */
+int8_t mc_get_nesting(const char_t *line)
+{
+	char_t *p = (char_t *)line;
+	uint32_t onum;
+	uint8_t word = MC_WORD_NONE;
+
+	if (_next(&p) != 'O') { return (0);}
+	p++;
+	if (_read_oword(&p, &onum, &word) != STAT_OK) { return (0);}
+	switch (word) {
+		case MC_WORD_SUB: case MC_WORD_REPEAT: case MC_WORD_WHILE: { return (1);}
+		case MC_WORD_ENDSUB: case MC_WORD_ENDREPEAT: case MC_WORD_ENDWHILE: { return (-1);}
+	}
+	return (0);
+}
+
+/*
+ * _read_oword() - read the number and keyword of an O-word line - *p is after the O
+ *
+ *	Returns MC_WORD_NONE if there is no keyword.
+ */
+static stat_t _read_oword(char_t **p, uint32_t *onum, uint8_t *word)
+{
+	float number;
+	char_t name[10];
+	uint8_t i = 0;
+
+	_next(p);
+	ritorno(_number(p, &number));
+	if (number < 1) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	*onum = (uint32_t)number;
+
+	_next(p);
+	while (isalpha((char)**p)) {
+		if (i < sizeof(name)-1) { name[i++] = (char_t)toupper((char)**p);}
+		(*p)++;
+	}
+	name[i] = NUL;
+	*word = MC_WORD_NONE;
+	if (i == 0) { return (STAT_OK);}
+	for (uint8_t w=0; w<MC_WORDS; w++) {
+		if (strcmp((char *)name, _words[w]) == 0) {
+			*word = w + 1;
+			return (STAT_OK);
+		}
+	}
+	return (STAT_UNRECOGNIZED_COMMAND);
+}
+
+/*
+ * _end_define()	- keep the subroutine just defined, if it fit
+ * _free_sub()		- forget a subroutine and close up the buffer over its body
+ */
+static stat_t _end_define()
+{
+	uint32_t onum = mc.define;
+	mc.define = 0;
+	if (mc.define_full == true) {
+		mc.end = mc.define_start;
+		return (STAT_BUFFER_FULL);
+	}
+	for (uint8_t i=0; i<MC_SUBROUTINES; i++) {
+		if (mc.sub[i].onum == 0) {
+			mc.sub[i].onum = onum;
+			mc.sub[i].start = mc.define_start;
+			mc.sub[i].length = mc.end - mc.define_start;
+			mc.subs_end = mc.end;
+			return (STAT_NOOP);
+		}
+	}
+	mc.end = mc.define_start;
+	return (STAT_BUFFER_FULL);
+}
+
+static void _free_sub(uint32_t onum)		// only called with no frames - nothing reads the buffer
+{
+	for (uint8_t i=0; i<MC_SUBROUTINES; i++) {
+		if (mc.sub[i].onum != onum) { continue;}
+		uint16_t start = mc.sub[i].start;
+		uint16_t length = mc.sub[i].length;
+		memmove(&mc.buf[start], &mc.buf[start + length], mc.end - (start + length));
+		mc.end -= length;
+		mc.subs_end -= length;
+		mc.sub[i].onum = 0;
+		for (uint8_t j=0; j<MC_SUBROUTINES; j++) {
+			if ((mc.sub[j].onum != 0) && (mc.sub[j].start > start)) { mc.sub[j].start -= length;}
+		}
+	}
+}
+
+/*
+ * _call() - start a subroutine with its arguments - p is after the keyword
+ */
+static stat_t _call(char_t *p, uint32_t onum)
+{
+	float arg[MC_CALL_ARGS];
+	uint8_t args = 0;
+	uint8_t i;
+
+	for (i=0; i<MC_SUBROUTINES; i++) {
+		if (mc.sub[i].onum == onum) { break;}
+	}
+	if (i == MC_SUBROUTINES) { return (STAT_INPUT_VALUE_RANGE_ERROR);}	// not defined
+	while (_next(&p) == '[') {
+		if (args >= MC_CALL_ARGS) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+		ritorno(_primary(&p, &arg[args++]));
+	}
+	ritorno(_push(MC_CALL, onum));
+	mcFrame_t *f = &mc.stack[mc.depth-1];
+	f->read = mc.sub[i].start;
+	memcpy(f->saved, &mc.parameter[1], sizeof(f->saved));
+	for (uint8_t a=0; a<args; a++) { mc.parameter[a+1] = arg[a];}
+	return (STAT_NOOP);
+}
+
+/*
+ * _start_loop() - start a repeat or while loop
+ *
+ *	A loop inside a body in memory runs that body in place, from the line after the
+ *	loop line. Otherwise the body is kept as it is received. The while line itself is
+ *	part of the body, as it tests the condition on each pass.
+ */
+static stat_t _start_loop(uint8_t type, uint32_t onum, char_t *line)
+{
+	uint8_t in_buffer = MC_IS_REPLAYING();
+	uint16_t read = (in_buffer == true) ? mc.stack[mc.depth-1].read : 0;
+
+	if ((type == MC_WHILE) && (in_buffer == false) && (_recording() == false)) {
+		ritorno(_record(line));				// not already kept by an outer loop
+	}
+	ritorno(_push(type, onum));
+	mcFrame_t *f = &mc.stack[mc.depth-1];
+	f->in_buffer = in_buffer;
+	f->recording = !in_buffer;
+	f->read = read;
+	if (type == MC_WHILE) {
+		f->start = mc.last;					// the while line - just read or just kept
+	} else {
+		f->start = (in_buffer == true) ? read : mc.end;
+	}
+	return (STAT_OK);
+}
+
+/*
+ * _assign() - run a line of parameter assignments - p is at the first #
+ */
+static stat_t _assign(char_t *p)
+{
+	float index, value;
+	uint8_t parameter;
+
+	while (_next(&p) == '#') {
+		p++;
+		ritorno(_primary(&p, &index));
+		ritorno(_parameter(index, &parameter));
+		if (_next(&p) != '=') { return (STAT_GCODE_INPUT_ERROR);}
+		p++;
+		ritorno(_expression(&p, &value));
+		mc.parameter[parameter] = value;
+	}
+	char_t c = _next(&p);
+	if ((c != NUL) && (c != '(') && (c != ';')) { return (STAT_GCODE_INPUT_ERROR);}
+	return (STAT_NOOP);
+}
+
+/*
+ * _record() - add a line to the end of the buffer
+ */
+static stat_t _record(const char_t *line)
+{
+	uint16_t length = strlen((const char *)line);
+	if ((mc.end + length + 1) > MC_BUFFER_SIZE) { return (STAT_BUFFER_FULL);}
+	mc.buf[mc.end] = (uint8_t)length;
+	memcpy(&mc.buf[mc.end+1], line, length);
+	mc.last = mc.end;
+	mc.end += length + 1;
+	return (STAT_OK);
+}
+
+/*
+ * _push()	- add a frame to the stack
+ * _pop()	- end the top frame - a call restores its arguments, and a loop run in place
+ *			  passes its read position back to the body it is in
+ * _top()	- return the top frame if it is of this type and O-number, else NULL
+ */
+static stat_t _push(uint8_t type, uint32_t onum)
+{
+	if (mc.depth >= MC_STACK_DEPTH) { return (STAT_BUFFER_FULL);}
+	mcFrame_t *f = &mc.stack[mc.depth++];
+	memset(f, 0, sizeof(mcFrame_t));
+	f->type = type;
+	f->onum = onum;
+	return (STAT_OK);
+}
+
+static void _pop()
+{
+	mcFrame_t *f = &mc.stack[--mc.depth];
+	if (f->type == MC_CALL) {
+		memcpy(&mc.parameter[1], f->saved, sizeof(f->saved));
+	} else if (f->in_buffer == true) {
+		mc.stack[mc.depth-1].read = f->read;
+	}
+	if (mc.depth == 0) { mc.end = mc.subs_end;}	// let go of the loop bodies
+}
+
+static mcFrame_t *_top(uint8_t type, uint32_t onum)
+{
+	if (mc.depth == 0) { return (NULL);}
+	mcFrame_t *f = &mc.stack[mc.depth-1];
+	if ((f->type != type) || (f->onum != onum)) { return (NULL);}
+	return (f);
+}
+
+/*
+ * Expressions - recursive descent, each level leaves *p after what it read
+ *
+ *	_expression()	- a sum, optionally compared with another: EQ NE GT GE LT LE
+ *	_sum()			- products added or subtracted
+ *	_product()		- primaries multiplied or divided
+ *	_primary()		- a number, #parameter, [expression], or a negated primary
+ */
+static stat_t _expression(char_t **p, float *value)
+{
+	static const char ops[] = "EQNEGTGELTLE";
+	float rhs;
+	uint8_t op;
+
+	ritorno(_sum(p, value));
+	char_t c = _next(p);
+	if (isalpha((char)c) == false) { return (STAT_OK);}
+	for (op=0; op<6; op++) {
+		if ((ops[op*2] == c) && (ops[op*2+1] == toupper((char)(*p)[1]))) { break;}
+	}
+	if (op == 6) { return (STAT_OK);}
+	*p += 2;
+	ritorno(_sum(p, &rhs));
+	uint8_t result = false;
+	switch (op) {
+		case 0: { result = fp_EQ(*value, rhs); break;}
+		case 1: { result = !fp_EQ(*value, rhs); break;}
+		case 2: { result = (*value > rhs); break;}
+		case 3: { result = (*value >= rhs); break;}
+		case 4: { result = (*value < rhs); break;}
+		case 5: { result = (*value <= rhs); break;}
+	}
+	*value = (result == true) ? 1 : 0;
+	return (STAT_OK);
+}
+
+static stat_t _sum(char_t **p, float *value)
+{
+	float rhs;
+	char_t c;
+
+	ritorno(_product(p, value));
+	while (((c = _next(p)) == '+') || (c == '-')) {
+		(*p)++;
+		ritorno(_product(p, &rhs));
+		*value = (c == '+') ? (*value + rhs) : (*value - rhs);
+	}
+	return (STAT_OK);
+}
+
+static stat_t _product(char_t **p, float *value)
+{
+	float rhs;
+	char_t c;
+
+	ritorno(_primary(p, value));
+	while (((c = _next(p)) == '*') || (c == '/')) {
+		(*p)++;
+		ritorno(_primary(p, &rhs));
+		if (c == '*') {
+			*value *= rhs;
+		} else {
+			if (fp_ZERO(rhs)) { return (STAT_DIVIDE_BY_ZERO);}
+			*value /= rhs;
+		}
+	}
+	return (STAT_OK);
+}
+
+static stat_t _primary(char_t **p, float *value)
+{
+	char_t c = _next(p);
+
+	if (c == '[') {
+		(*p)++;
+		ritorno(_expression(p, value));
+		if (_next(p) != ']') { return (STAT_BAD_NUMBER_FORMAT);}
+		(*p)++;
+		return (STAT_OK);
+	}
+	if (c == '#') {
+		float index;
+		uint8_t parameter;
+		(*p)++;
+		ritorno(_primary(p, &index));
+		ritorno(_parameter(index, &parameter));
+		*value = mc.parameter[parameter];
+		return (STAT_OK);
+	}
+	if (c == '-') {
+		(*p)++;
+		ritorno(_primary(p, value));
+		*value = -*value;
+		return (STAT_OK);
+	}
+	return (_number(p, value));
+}
+
+/*
+ * _number() - read an unsigned decimal number - same digit rules as the Gcode parser
+ */
+static stat_t _number(char_t **p, float *value)
+{
+	uint32_t mantissa = 0;
+	uint8_t digits = 0;
+	uint8_t decimals = 0;
+	uint8_t found = false;
+	uint8_t point = false;
+
+	for (;; (*p)++) {
+		char_t c = **p;
+		if (isdigit((char)c)) {
+			found = true;
+			if ((digits >= 9) || (decimals >= 9)) {
+				if (point == false) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+				continue;							// decimals beyond float precision
+			}
+			mantissa = mantissa * 10 + (c - '0');
+			if (mantissa != 0) { digits++;}
+			if (point == true) { decimals++;}
+		} else if ((c == '.') && (point == false)) {
+			point = true;
+		} else {
+			break;
+		}
+	}
+	if (found == false) { return (STAT_BAD_NUMBER_FORMAT);}
+	*value = (float)mantissa / pow10_float[decimals];
+	return (STAT_OK);
+}
+
+/*
+ * _parameter() - check a parameter number
+ * _next()		- skip white space and return the next character in upper case
+ */
+static stat_t _parameter(float index, uint8_t *parameter)
+{
+	if ((index < 1) || (index > MC_PARAMETERS) || (fp_NOT_ZERO(index - floor(index)))) {
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	*parameter = (uint8_t)index;
+	return (STAT_OK);
+}
+
+static char_t _next(char_t **p)
+{
+	while ((**p == ' ') || (**p == TAB)) { (*p)++;}
+	return ((char_t)toupper((char)**p));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GCODE_MACROS
@@ -0,0 +1,129 @@
+/*
+ * gcode_macro.h - O-word subroutines and loops, and numbered parameters
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Gcode macros are enabled by __GCODE_MACROS in tinyg2.h. They follow the LinuxCNC
+ * O-word forms, numbered the same way, with a line of its own for each O-word:
+ *
+ *	O100 sub				define subroutine 100 - the lines up to the endsub are kept,
+ *	  ...					  not run. Subroutines can't be defined inside a call or loop
+ *	O100 endsub
+ *	O100 call [1.5] [#2]	run subroutine 100 with #1=1.5, #2=the value of #2
+ *	O101 repeat [4]			run the lines up to the endrepeat 4 times
+ *	O101 endrepeat
+ *	O102 while [#1 LT 10]	run the lines up to the endwhile while the condition holds
+ *	O102 endwhile
+ *
+ *	#1 = 5					numbered parameters #1 to #MC_PARAMETERS. A line starting
+ *	#2=[#1*2] #3=#2			with # holds only assignments, which take effect at once
+ *	G1 X[#1+2] Y#2			any word value may be a parameter or an [expression]
+ *
+ * Expressions are in brackets and may use numbers, parameters, nested brackets,
+ * unary minus, + - * / and the comparisons EQ NE GT GE LT LE (1 if true, else 0).
+ * Call arguments set #1, #2 ... and the parameters they replace are restored at the
+ * endsub, so #1 to #MC_CALL_ARGS act as the subroutine's arguments.
+ *
+ * Subroutine bodies are kept in RAM (MC_BUFFER_SIZE) once defined, and the body of a
+ * loop is kept as it runs the first time, so repeats and calls come from memory and
+ * not over USB. Loop bodies are let go once the loop ends. Subroutines are kept until
+ * the same O-number is defined again, or a reset. A queue flush (%) abandons calls
+ * and loops in progress.
+ *
+ * Only Gcode lines (O-words and # lines included) are kept in a body. Other lines - $
+ * settings and JSON - run when they are received and are not repeated. Lines run from
+ * memory are not answered - only an error is reported, and it ends the calls and loops.
+ * The Gcode block queue parses ahead of the moves, so parameters are set and read in
+ * the order of the lines, not at the time the moves run.
+ */
+
+#ifndef GCODE_MACRO_H_ONCE
+#define GCODE_MACRO_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __GCODE_MACROS
+
+#define MC_BUFFER_SIZE 4096				// bytes of subroutine and loop bodies
+#define MC_SUBROUTINES 8				// subroutines that can be defined
+#define MC_STACK_DEPTH 6				// calls and loops that can be nested
+#define MC_PARAMETERS 32				// numbered parameters #1 to #32
+#define MC_CALL_ARGS 8					// parameters saved across a call
+
+enum mcFrameType {
+	MC_CALL = 1,
+	MC_REPEAT,
+	MC_WHILE
+};
+
+typedef struct mcFrame {				// a call or loop in progress
+	uint8_t type;						// see mcFrameType
+	uint8_t recording;					// TRUE while the body is kept as it is received
+	uint8_t in_buffer;					// TRUE if the loop started inside a body in memory
+	uint32_t onum;						// O-number of the call or loop
+	uint32_t count;						// repeats left
+	uint16_t start;						// first line of the body (the while line, for a while)
+	uint16_t read;						// next line to read from memory
+	uint16_t end;						// line after the endwhile, once it is known
+	float saved[MC_CALL_ARGS];			// parameters replaced by the call arguments
+} mcFrame_t;
+
+typedef struct mcSubroutine {
+	uint32_t onum;						// 0 if the slot is free
+	uint16_t start;						// first line of the body
+	uint16_t length;					// bytes of the body, with the endsub line
+} mcSubroutine_t;
+
+typedef struct mcSingleton {
+	uint32_t define;					// O-number of the subroutine being defined, or 0
+	uint32_t skip;						// O-number of the loop being skipped, or 0
+	uint16_t end;						// end of the bodies in the buffer
+	uint16_t subs_end;					// end of the subroutine bodies
+	uint16_t define_start;				// start of the body being defined
+	uint8_t define_full;				// TRUE if the body being defined did not fit
+	uint16_t last;						// last line read from or added to the buffer
+	uint8_t depth;						// frames in the stack
+	float parameter[MC_PARAMETERS+1];	// #1 to #MC_PARAMETERS - [0] is not used
+	mcFrame_t stack[MC_STACK_DEPTH];
+	mcSubroutine_t sub[MC_SUBROUTINES];
+	uint8_t buf[MC_BUFFER_SIZE];		// lines as a length byte and the text
+} mcSingleton_t;
+
+extern mcSingleton_t mc;
+
+void mc_init(void);
+void mc_reset(void);
+stat_t mc_line(char_t *line);
+stat_t mc_eval(char_t **pstr, float *value);
+stat_t mc_read_line(char_t *buffer, uint16_t *index, size_t size);
+int8_t mc_get_nesting(const char_t *line);
+
+#define MC_IS_REPLAYING() ((mc.depth != 0) && (mc.stack[mc.depth-1].recording == false))
+
+#else
+
+#define mc_line(line) (STAT_OK)
+
+#endif // __GCODE_MACROS
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: GCODE_MACRO_H_ONCE
@@ -20,8 +20,11 @@
 #include "config.h"			// #2
 #include "controller.h"
 #include "gcode_parser.h"
+#include "gcode_macro.h"
 #include "canonical_machine.h"
+#include "planner.h"			// PLANNER_BUFFER_HEADROOM
 #include "spindle.h"
+#include "encoder.h"
 #include "util.h"
 #include "xio.h"			// for char definitions
 
@@ -33,63 +36,189 @@ struct gcodeParserSingleton {	 	  // struct to manage globals
 	uint8_t modals[MODAL_GROUP_COUNT];// collects modal groups in a block
 }; struct gcodeParserSingleton gp;
 
+typedef struct gcQueuedBlock {		// a parsed block waiting for the planner
+	stat_t status;					// parser status - the block is only executed if STAT_OK
+	GCodeInput_t gn;				// parsed input values
+	GCodeInput_t gf;				// parsed input flags
+	uint8_t src;					// input device the block was read from
+	uint8_t buffers;				// planner buffers it may queue - see _get_block_buffers()
+	char_t block[INPUT_BUFFER_LEN];	// normalized block - kept for the response
+} gcQueuedBlock_t;
+
+struct gcodeQueueSingleton {		// queue of parsed blocks
+	uint8_t head;					// next block to execute
+	uint8_t tail;					// next free slot
+	uint8_t count;					// blocks in the queue
+	uint8_t motion_mode;			// motion mode in effect after the last queued block
+	gcQueuedBlock_t q[GCODE_QUEUE_SIZE];
+}; struct gcodeQueueSingleton gq;
+
 // local helper functions and macros
-static void _normalize_gcode_block(char_t *cmd, char_t **com, char_t **msg, uint8_t *block_delete_flag);
-static stat_t _get_next_gcode_word(char **pstr, char *letter, float *value);
+static char_t _get_gcode_char(char_t **pstr);
+static stat_t _get_next_gcode_word(char_t **pstr, char_t **wr, char *letter, float *value);
+static stat_t _get_gcode_number(char_t **pstr, char_t **wr, float *value);
 static stat_t _point(float value);
 static stat_t _validate_gcode_block(void);
-static stat_t _parse_gcode_block(char_t *line);	// Parse the block into the GN/GF structs
+static stat_t _parse_gcode_word(char letter, float value);
+static stat_t _parse_gcode_block(char_t *line, uint8_t motion_mode);	// Parse the block into the GN/GF structs
+static stat_t _parse_token_block(const uint8_t *block, uint8_t motion_mode);
 static stat_t _execute_gcode_block(void);		// Execute the gcode block
+static uint8_t _get_block_buffers(void);
 
 #define SET_MODAL(m,parm,val) ({gn.parm=val; gf.parm=1; gp.modals[m]+=1; break;})
 #define SET_NON_MODAL(parm,val) ({gn.parm=val; gf.parm=1; break;})
 #define EXEC_FUNC(f,v) if((uint8_t)gf.v != false) { status = f(gn.v);}
 
+#define GCODE_NUMBER_DIGITS NUMBER_DIGITS	// significant digits kept by _get_gcode_number() (see util.h)
+
 /*
  * gc_gcode_parser() - parse a block (line) of gcode
  *
- *	Top level of gcode parser. Normalizes block and looks for special cases
+ *	Top level of gcode parser. Looks for special cases and parses the block.
+ *	Token blocks (see gcode_parser.h) skip the text parsing.
  */
 
 stat_t gc_gcode_parser(char_t *block)
 {
-	char_t *cmd = block;					// gcode command or NUL string
-	char_t none = NUL;
-	char_t *com = &none;					// gcode comment or NUL string
-	char_t *msg = &none;					// gcode message or NUL string
-	uint8_t block_delete_flag;
-
-	_normalize_gcode_block(cmd, &com, &msg, &block_delete_flag);
-	
+	stat_t status;
+
+	if ((status = mc_line(block)) != STAT_OK) {	// O-words, # lines and macro bodies - see gcode_macro.h
+		return (status);
+	}
 	// Block delete omits the line if a / char is present in the first space
 	// For now this is unconditional and will always delete
-//	if ((block_delete_flag == true) && (cm_get_block_delete_switch() == true)) {
-	if (block_delete_flag == true) {
+//	if ((*block == '/') && (cm_get_block_delete_switch() == true)) {
+	if (*block == '/') {
 		return (STAT_NOOP);
 	}
+	if (GC_IS_TOKEN_BLOCK(block)) {
+		ritorno(_parse_token_block((uint8_t *)block, cm_get_motion_mode(MODEL)));
+		return (_execute_gcode_block());
+	}
 //	if (*msg != NUL) { // +++++ THIS HAS A SERIOUS BUG IN IT SO FOR NOW IT'S DISABLED
 //		(void)cm_message(msg);				// queue the message
 //	}
-	return(_parse_gcode_block(block));
+	ritorno(_parse_gcode_block(block, cm_get_motion_mode(MODEL)));
+	return (_execute_gcode_block());		// if successful execute the block
+}
+
+/*
+ * gc_queue_gcode_block()	- parse a block into the block queue
+ * gc_get_queued_block()	- return the normalized text of the next block to run, or NULL
+ * gc_get_queued_block_src() - return the input device of the next block to run
+ * gc_get_queued_block_buffers() - return the planner buffers the next block may queue
+ * gc_run_queued_block()	- execute the next block in the queue and free it
+ * gc_get_queued_blocks()	- return the number of blocks in the queue
+ * gc_flush_queue()			- discard all queued blocks
+ * gc_flush_queue_internal() - discard queued blocks up to the first one from a host (see DEV_INTERNAL)
+ *
+ *	The queue lets the controller read and parse Gcode blocks while the planner is 
+ *	full. Only the execution step (the cm_* calls) waits for planner headroom, so 
+ *	the parse time is hidden behind the running moves.
+ *
+ *	Blocks are parsed ahead of the model so the motion mode carried into the next 
+ *	block is the one left by the last queued block rather than the one in gm. 
+ *	Parse errors are queued as well and are reported when the block comes up, 
+ *	so responses are always returned in the order the blocks were received.
+ *
+ *	The text of the block returned by gc_get_queued_block() stays valid until the 
+ *	next block is queued, so it can be used for the response after the block is run.
+ *	It is empty for token blocks.
+ */
+
+stat_t gc_queue_gcode_block(char_t *block, uint8_t src)
+{
+	if (gq.count >= GCODE_QUEUE_SIZE) { return (STAT_EAGAIN);}
+	if (gq.count == 0) { gq.motion_mode = cm_get_motion_mode(MODEL);}
+
+	gcQueuedBlock_t *qb = &gq.q[gq.tail];
+	qb->src = src;
+
+	if (GC_IS_TOKEN_BLOCK(block)) {			// pre-parsed - there is no text for the response
+		qb->block[0] = NUL;
+		if ((qb->status = mc_line(block)) == STAT_OK) {
+			qb->status = _parse_token_block((uint8_t *)block, gq.motion_mode);
+		}
+	} else {
+		strncpy((char *)qb->block, (char *)block, INPUT_BUFFER_LEN-1);
+		qb->block[INPUT_BUFFER_LEN-1] = NUL;
+		qb->status = mc_line(qb->block);	// STAT_NOOP if taken by the macro interpreter
+		if (qb->status == STAT_OK) {
+			if (qb->block[0] == '/') {		// block delete - see gc_gcode_parser()
+				qb->status = STAT_NOOP;
+			} else {
+				qb->status = _parse_gcode_block(qb->block, gq.motion_mode);
+			}
+		}
+	}
+	qb->buffers = 0;						// errors and block deletes only respond
+	if (qb->status == STAT_OK) {
+		qb->gn = gn;
+		qb->gf = gf;
+		qb->buffers = _get_block_buffers();
+		gq.motion_mode = gn.motion_mode;
+	}
+	if (++gq.tail >= GCODE_QUEUE_SIZE) { gq.tail = 0;}
+	gq.count++;
+	return (STAT_OK);
+}
+
+char_t *gc_get_queued_block()
+{
+	if (gq.count == 0) { return (NULL);}
+	return (gq.q[gq.head].block);
+}
+
+uint8_t gc_get_queued_block_src() { return (gq.q[gq.head].src);}
+uint8_t gc_get_queued_block_buffers() { return (gq.q[gq.head].buffers);}
+
+stat_t gc_run_queued_block()
+{
+	if (gq.count == 0) { return (STAT_NOOP);}
+
+	gcQueuedBlock_t *qb = &gq.q[gq.head];
+	if (++gq.head >= GCODE_QUEUE_SIZE) { gq.head = 0;}
+	gq.count--;
+
+	if (qb->status != STAT_OK) { return (qb->status);}
+	gn = qb->gn;
+	gf = qb->gf;
+	return (_execute_gcode_block());
+}
+
+uint8_t gc_get_queued_blocks() { return (gq.count);}
+
+void gc_flush_queue()
+{
+	gq.head = 0;
+	gq.tail = 0;
+	gq.count = 0;
+}
+
+void gc_flush_queue_internal()
+{
+	while ((gq.count != 0) && (DEV_INTERNAL(gq.q[gq.head].src))) {
+		if (++gq.head >= GCODE_QUEUE_SIZE) { gq.head = 0;}
+		gq.count--;
+	}
 }
 
 /*
- * _normalize_gcode_block() - normalize a block (line) of gcode in place
+ * _get_gcode_char() - return the next character of the normalized block
  *
- *	Normalization functions:
- *   - convert all letters to upper case
- *	 - remove white space, control and other invalid characters 
- *	 - remove (erroneous) leading zeros that might be taken to mean Octal
- *	 - identify and return start of comments and messages
- *	 - signal if a block-delete character (/) was encountered in the first space
+ *	The block is normalized in place as it is parsed - in the same pass as the words:
+ *	 - all letters are converted to upper case
+ *	 - white space, control and other invalid characters are skipped
+ *	 - leading zeros need no special handling as numbers are not parsed by strtof()
  *
  *	So this: "  g1 x100 Y100 f400" becomes this: "G1X100Y100F400"
  *
- *	Comment and message handling:
+ *	Returns the upper-cased character at *pstr without consuming it, or NUL at the 
+ *	end of the block or at the start of a comment.
+ *
+ *	Comment handling:
  *	 - Comments field start with a '(' char or alternately a semicolon ';' 
- *	 - Comments and messages are not normalized - they are left alone
- *	 - The 'MSG' specifier in comment can have mixed case but cannot cannot have embedded white spaces
- *	 - Normalization returns true if there was a message to display, false otherwise
+ *	 - Comments are not normalized - they are left alone
  *	 - Comments always terminate the block - i.e. leading or embedded comments are not supported
  *	 	- Valid cases (examples)			Notes:
  *		    G0X10							 - command only - no comment
@@ -103,88 +232,105 @@ stat_t gc_gcode_parser(char_t *block)
  *		    N10 (comment) G0X10 			 - embedded comment. G0X10 will be ignored
  *		    (comment) G0X10 				 - leading comment. G0X10 will be ignored
  * 			G0X10 # comment					 - invalid separator
- *
- *	Returns:
- *	 - com points to comment string or to NUL if no comment
- *	 - msg points to message string or to NUL if no comment
- *	 - block_delete_flag is set true if block delete encountered, false otherwise
  */
-static void _normalize_gcode_block(char_t *cmd, char_t **com, char_t **msg, uint8_t *block_delete_flag)
+static char_t _get_gcode_char(char_t **pstr)
 {
-	char_t *rd = cmd;				// read pointer
-	char_t *wr = cmd;				// write pointer
-
-	// Preset comments and messages to NUL string
-	// Not required if com and msg already point to NUL on entry
-//	for (rd = cmd; *rd != NUL; rd++) { if (*rd == NUL) { *com = rd; *msg = rd; rd = cmd;} }
-
-	// mark block deletes
-	if (*rd == '/') { *block_delete_flag = true; } 
-	else { *block_delete_flag = false; }
-	
-	// normalize the command block & find the comment (if any)
-	for (; *wr != NUL; rd++) {
-		if (*rd == NUL) { *wr = NUL; }
-		else if ((*rd == '(') || (*rd == ';')) { *wr = NUL; *com = rd+1; }
-		else if ((isalnum((char)*rd)) || (strchr("-.", *rd))) { // all valid characters
-			*(wr++) = (char_t)toupper((char)*(rd));
-		}
-	}
-	
-	// Perform Octal stripping - remove invalid leading zeros in number strings
-	rd = cmd;
-	while (*rd != NUL) {
-		if (*rd == '.') break;							// don't strip past a decimal point
-		if ((!isdigit(*rd)) && (*(rd+1) == '0') && (isdigit(*(rd+2)))) {
-			wr = rd+1;
-			while (*wr != NUL) { *wr = *(wr+1); wr++;}	// copy forward w/overwrite
-			continue;
-		}
-		rd++;
-	}
-	
-	// process comments and messages
-	if (**com != NUL) {
-		rd = *com;
-		while (isspace(*rd)) { rd++; }		// skip any leading spaces before "msg"
-		if ((tolower(*rd) == 'm') && (tolower(*(rd+1)) == 's') && (tolower(*(rd+2)) == 'g')) {
-			*msg = rd+3;
-		}
-		for (; *rd != NUL; rd++) {	
-			if (*rd == ')') *rd = NUL;		// NUL terminate on trailing parenthesis, if any
-		}
+	char_t c;
+
+	while ((c = **pstr) != NUL) {
+		if ((c == '(') || (c == ';')) { return (NUL);}	// comments terminate the block
+		if ((isalnum((char)c)) || (c == '-') || (c == '.')) { return ((char_t)toupper((char)c));}
+#ifdef __GCODE_MACROS
+		if ((c == '#') || (c == '[')) { return (c);}	// parameter or expression - see _get_gcode_number()
+#endif
+		(*pstr)++;										// strip everything else
 	}
+	return (NUL);
 }
 
 /*
  * _get_next_gcode_word() - get gcode word consisting of a letter and a value
  *
- *	This function requires the Gcode string to be normalized.
- *	Normalization must remove any leading zeros or they will be converted to Octal
- *	G0X... is not interpreted as hexadecimal. This is trapped.
+ *	*pstr is the read pointer and *wr the write pointer for normalizing in place.
+ *	The normalized block is NUL terminated once the last word has been read.
  */
-static stat_t _get_next_gcode_word(char **pstr, char *letter, float *value) 
+static stat_t _get_next_gcode_word(char_t **pstr, char_t **wr, char *letter, float *value) 
 {
-	if (**pstr == NUL) { return (STAT_COMPLETE); }	// no more words
+	char_t c;
 
-	// get letter part
-	if(isupper(**pstr) == false) { return (STAT_EXPECTED_COMMAND_LETTER); }
-	*letter = **pstr;
+	if ((c = _get_gcode_char(pstr)) == NUL) {			// no more words
+		**wr = NUL;
+		return (STAT_COMPLETE);
+	}
+	if (isupper((char)c) == false) { return (STAT_EXPECTED_COMMAND_LETTER);}
+	*letter = (char)c;
+	*(*wr)++ = c;
 	(*pstr)++;
-	
-	// X-axis-becomes-a-hexadecimal-number get-value case, e.g. G0X100 --> G255
-	if ((**pstr == '0') && (*(*pstr+1) == 'X')) {
-		*value = 0;
+	return (_get_gcode_number(pstr, wr, value));		// pointer points to next character after the word
+}
+
+/*
+ * _get_gcode_number() - fixed-digit decimal to float conversion for word values
+ *
+ *	Accepts an optional minus sign, digits and at most one decimal point. Up to 
+ *	GCODE_NUMBER_DIGITS significant digits are accumulated in an integer and scaled 
+ *	by a power of ten once at the end, so a value costs one float multiply or divide.
+ *	Further digits are dropped (they are beyond float precision anyway). There are 
+ *	no exponents, hex or special values as in strtof() - G0X10 is not hexadecimal.
+ */
+static stat_t _get_gcode_number(char_t **pstr, char_t **wr, float *value)
+{
+	uint32_t mantissa = 0;
+	int8_t exponent = 0;				// power of ten to apply to the mantissa
+	uint8_t digits = 0;					// significant digits in the mantissa
+	uint8_t found = false;				// TRUE once any digit has been read
+	uint8_t point = false;				// TRUE once the decimal point has been read
+	uint8_t negative = false;
+	char_t c = _get_gcode_char(pstr);
+
+	if (c == '-') {
+		negative = true;
+		*(*wr)++ = c;
+		(*pstr)++;
+		c = _get_gcode_char(pstr);
+	}
+#ifdef __GCODE_MACROS
+	if ((c == '#') || (c == '[')) {						// see gcode_macro.h
+		char_t *expr = *pstr;
+		ritorno(mc_eval(pstr, value));
+		for (; expr < *pstr; expr++) {					// normalize the expression text
+			if (isspace((char)*expr) == false) { *(*wr)++ = *expr;}
+		}
+		if (negative == true) { *value = -*value;}
+		return (STAT_OK);
+	}
+#endif
+	for (;; c = _get_gcode_char(pstr)) {
+		if (isdigit((char)c)) {
+			found = true;
+			if (digits < GCODE_NUMBER_DIGITS) {
+				mantissa = mantissa * 10 + (c - '0');
+				if (mantissa != 0) { digits++;}		// leading zeros are not significant
+				if (point == true) { exponent--;}
+			} else if (point == false) {
+				exponent++;							// dropped integer digit
+			}
+		} else if ((c == '.') && (point == false)) {
+			point = true;
+		} else {
+			break;
+		}
+		*(*wr)++ = c;
 		(*pstr)++;
-		return (STAT_OK);		// pointer points to X
 	}
+	if (found == false) { return (STAT_BAD_NUMBER_FORMAT);}
 
-	// get-value general case
-	char *end; 
-	*value = strtof(*pstr, &end);
-	if(end == *pstr) { return(STAT_BAD_NUMBER_FORMAT); }	// more robust test then checking for value=0;
-	*pstr = end;
-	return (STAT_OK);			// pointer points to next character after the word
+	*value = (float)mantissa;
+	for (; exponent < -GCODE_NUMBER_DIGITS; exponent += GCODE_NUMBER_DIGITS) { *value /= pow10_float[GCODE_NUMBER_DIGITS];}
+	if (exponent < 0) { *value /= pow10_float[-exponent];}
+	else if (exponent > 0) { *value *= pow10_float[exponent];}
+	if (negative == true) { *value = -*value;}
+	return (STAT_OK);
 }
 
 /*
@@ -220,19 +366,189 @@ static stat_t _validate_gcode_block()
 	return (STAT_OK);
 }
 
+/*
+ * _parse_gcode_word() - load one word into gn and gf - for text and token blocks
+ */
+static stat_t _parse_gcode_word(char letter, float value)
+{
+	stat_t status = STAT_OK;
+
+	switch(letter) {
+		case 'G':
+		switch((uint8_t)value) {
+			case 0:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_STRAIGHT_TRAVERSE);
+			case 1:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_STRAIGHT_FEED);
+			case 2:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_CW_ARC);
+			case 3:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_CCW_ARC);
+			case 4:  SET_NON_MODAL (next_action, NEXT_ACTION_DWELL);
+			case 5: {
+				switch (_point(value)) {
+					case 0: SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_CUBIC_SPLINE);
+					case 1: SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_QUADRATIC_SPLINE);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+			case 10: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_COORD_DATA);
+			case 17: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_XY);
+			case 18: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_XZ);
+			case 19: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_YZ);
+			case 20: SET_MODAL (MODAL_GROUP_G6, units_mode, INCHES);
+			case 21: SET_MODAL (MODAL_GROUP_G6, units_mode, MILLIMETERS);
+			case 28: {
+				switch (_point(value)) {
+					case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_GOTO_G28_POSITION);
+					case 1: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_G28_POSITION);
+					case 2: SET_NON_MODAL (next_action, NEXT_ACTION_SEARCH_HOME);
+					case 3: SET_NON_MODAL (next_action, NEXT_ACTION_SET_ABSOLUTE_ORIGIN);
+					case 4: SET_NON_MODAL (next_action, NEXT_ACTION_HOMING_NO_SET);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+			case 30: {
+				switch (_point(value)) {
+					case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_GOTO_G30_POSITION);
+					case 1: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_G30_POSITION);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+#ifdef __SPINDLE_SYNC
+			case 33: SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_SPINDLE_SYNC);
+#endif
+			case 38: {
+				switch (_point(value)) {
+					case 2: SET_NON_MODAL (next_action, NEXT_ACTION_STRAIGHT_PROBE);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+			case 40: break;	// ignore cancel cutter radius compensation
+			case 43: SET_MODAL (MODAL_GROUP_G8, tool_offset_mode, true);
+			case 49: SET_MODAL (MODAL_GROUP_G8, tool_offset_mode, false);
+#ifdef __COORD_TRANSFORM
+			case 50: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_CANCEL_SCALING);
+			case 51: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_SCALING);
+#endif
+			case 53: SET_NON_MODAL (absolute_override, true);
+			case 54: SET_MODAL (MODAL_GROUP_G12, coord_system, G54);
+			case 55: SET_MODAL (MODAL_GROUP_G12, coord_system, G55);
+			case 56: SET_MODAL (MODAL_GROUP_G12, coord_system, G56);
+			case 57: SET_MODAL (MODAL_GROUP_G12, coord_system, G57);
+			case 58: SET_MODAL (MODAL_GROUP_G12, coord_system, G58);
+			case 59: SET_MODAL (MODAL_GROUP_G12, coord_system, G59);
+			case 61: {
+				switch (_point(value)) {
+					case 0: SET_MODAL (MODAL_GROUP_G13, path_control, PATH_EXACT_PATH);
+					case 1: SET_MODAL (MODAL_GROUP_G13, path_control, PATH_EXACT_STOP);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+			case 64: SET_MODAL (MODAL_GROUP_G13,path_control, PATH_CONTINUOUS);
+#ifdef __COORD_TRANSFORM
+			case 68: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_ROTATION);
+			case 69: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_CANCEL_ROTATION);
+#endif
+			case 73: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANNED_CYCLE_73);
+			case 80: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANCEL_MOTION_MODE);
+			case 81: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANNED_CYCLE_81);
+			case 82: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANNED_CYCLE_82);
+			case 83: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANNED_CYCLE_83);
+#ifdef __SPINDLE_SYNC
+			case 84: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANNED_CYCLE_84);
+#endif
+			case 90: SET_MODAL (MODAL_GROUP_G3, distance_mode, ABSOLUTE_MODE);
+			case 91: SET_MODAL (MODAL_GROUP_G3, distance_mode, INCREMENTAL_MODE);
+			case 92: {
+				switch (_point(value)) {
+					case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_ORIGIN_OFFSETS);
+					case 1: SET_NON_MODAL (next_action, NEXT_ACTION_RESET_ORIGIN_OFFSETS);
+					case 2: SET_NON_MODAL (next_action, NEXT_ACTION_SUSPEND_ORIGIN_OFFSETS);
+					case 3: SET_NON_MODAL (next_action, NEXT_ACTION_RESUME_ORIGIN_OFFSETS);
+					default: status = STAT_UNRECOGNIZED_COMMAND;
+				}
+				break;
+			}
+#ifdef __SPINDLE_CSS
+			case 96: SET_MODAL (MODAL_GROUP_G14, css_mode, true);
+			case 97: SET_MODAL (MODAL_GROUP_G14, css_mode, false);
+#endif
+			case 93: SET_MODAL (MODAL_GROUP_G5, inverse_feed_rate_mode, true);
+			case 94: SET_MODAL (MODAL_GROUP_G5, inverse_feed_rate_mode, false);
+			case 98: SET_MODAL (MODAL_GROUP_G9, retract_mode, RETRACT_INITIAL_LEVEL);
+			case 99: SET_MODAL (MODAL_GROUP_G9, retract_mode, RETRACT_R_PLANE);
+			default: status = STAT_UNRECOGNIZED_COMMAND;
+		}
+		break;
+
+		case 'M':
+		switch((uint8_t)value) {
+			case 0: case 1: case 60:
+					SET_MODAL (MODAL_GROUP_M4, program_flow, PROGRAM_STOP);
+			case 2: case 30:
+					SET_MODAL (MODAL_GROUP_M4, program_flow, PROGRAM_END);
+			case 3: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_CW);
+			case 4: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_CCW);
+			case 5: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_OFF);
+			case 6: SET_NON_MODAL (tool_change, true);
+			case 7: SET_MODAL (MODAL_GROUP_M8, mist_coolant, true);
+			case 8: SET_MODAL (MODAL_GROUP_M8, flood_coolant, true);
+			case 9: SET_MODAL (MODAL_GROUP_M8, flood_coolant, false);
+			case 48: SET_MODAL (MODAL_GROUP_M9, override_enables, true);
+			case 49: SET_MODAL (MODAL_GROUP_M9, override_enables, false);
+			case 50: SET_MODAL (MODAL_GROUP_M9, feed_rate_override_enable, true); // conditionally true
+			case 51: SET_MODAL (MODAL_GROUP_M9, spindle_override_enable, true);	  // conditionally true
+			default: status = STAT_UNRECOGNIZED_COMMAND;
+		}
+		break;
+
+		case 'T': SET_NON_MODAL (tool_select, (uint8_t)trunc(value));
+		case 'H': SET_NON_MODAL (tool_offset_entry, (uint8_t)trunc(value));	// G43 tool table entry
+		case 'F': SET_NON_MODAL (feed_rate, value);
+		case 'P': SET_NON_MODAL (parameter, value);				// used for dwell time, G10 coord select
+		case 'S': SET_NON_MODAL (spindle_speed, value);
+		case 'X': SET_NON_MODAL (target[AXIS_X], value);
+		case 'Y': SET_NON_MODAL (target[AXIS_Y], value);
+		case 'Z': SET_NON_MODAL (target[AXIS_Z], value);
+		case 'A': SET_NON_MODAL (target[AXIS_A], value);
+		case 'B': SET_NON_MODAL (target[AXIS_B], value);
+		case 'C': SET_NON_MODAL (target[AXIS_C], value);
+	//	case 'U': SET_NON_MODAL (target[AXIS_U], value);		// reserved
+	//	case 'V': SET_NON_MODAL (target[AXIS_V], value);		// reserved
+	//	case 'W': SET_NON_MODAL (target[AXIS_W], value);		// reserved
+		case 'I': SET_NON_MODAL (arc_offset[0], value);
+		case 'J': SET_NON_MODAL (arc_offset[1], value);
+		case 'K': SET_NON_MODAL (arc_offset[2], value);
+		case 'R': SET_NON_MODAL (arc_radius, value);			// arc radius or canned cycle R plane
+		case 'Q': SET_NON_MODAL (peck_increment, value);		// canned cycle peck depth
+		case 'N': SET_NON_MODAL (linenum,(uint32_t)value);		// line number
+		case 'L': SET_NON_MODAL (l_word, (uint8_t)value);		// canned cycle repeats
+#ifdef __SPINDLE_CSS
+		case 'D': SET_NON_MODAL (spindle_max, value);			// G96 maximum spindle speed
+#endif
+		default: status = STAT_UNRECOGNIZED_COMMAND;
+	}
+	return (status);
+}
+
 /*
  * _parse_gcode_block() - parses one line of NULL terminated G-Code. 
  *
  *	All the parser does is load the state values in gn (next model state) and set flags
- *	in gf (model state flags). The execute routine applies them. The buffer is assumed to 
- *	contain only uppercase characters and signed floats (no whitespace).
+ *	in gf (model state flags). The execute routine applies them. The buffer is normalized
+ *	in place as the words are read (see _get_gcode_char()), so it is a single pass.
+ *
+ *	motion_mode is the modal motion mode in effect before this block.
  *
  *	A number of implicit things happen when the gn struct is zeroed:
  *	  - inverse feed rate mode is canceled - set back to units_per_minute mode
  */
-static stat_t _parse_gcode_block(char_t *buf) 
+static stat_t _parse_gcode_block(char_t *buf, uint8_t motion_mode) 
 {
-	char *pstr = (char *)buf;		// persistent pointer into gcode block for parsing words
+	char_t *pstr = buf;				// persistent pointer into gcode block for parsing words
+	char_t *wr = buf;				// write pointer for normalizing the block in place
   	char letter;					// parsed letter, eg.g. G or X or Y
 	float value = 0;				// value parsed from letter (e.g. 2 for G2)
 	stat_t status = STAT_OK;
@@ -241,134 +557,139 @@ static stat_t _parse_gcode_block(char_t *buf)
 	memset(&gp, 0, sizeof(gp));		// clear all parser values
 	memset(&gf, 0, sizeof(gf));		// clear all next-state flags
 	memset(&gn, 0, sizeof(gn));		// clear all next-state values
-	gn.motion_mode = cm_get_motion_mode(MODEL);// get motion mode from previous block
+	gn.motion_mode = motion_mode;	// motion mode from previous block
 
 	// extract commands and parameters
-	while((status = _get_next_gcode_word(&pstr, &letter, &value)) == STAT_OK) {
-		switch(letter) {
-			case 'G':
-			switch((uint8_t)value) {
-				case 0:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_STRAIGHT_TRAVERSE);
-				case 1:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_STRAIGHT_FEED);
-				case 2:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_CW_ARC);
-				case 3:  SET_MODAL (MODAL_GROUP_G1, motion_mode, MOTION_MODE_CCW_ARC);
-				case 4:  SET_NON_MODAL (next_action, NEXT_ACTION_DWELL);
-				case 10: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_COORD_DATA);
-				case 17: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_XY);
-				case 18: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_XZ);
-				case 19: SET_MODAL (MODAL_GROUP_G2, select_plane, CANON_PLANE_YZ);
-				case 20: SET_MODAL (MODAL_GROUP_G6, units_mode, INCHES);
-				case 21: SET_MODAL (MODAL_GROUP_G6, units_mode, MILLIMETERS);
-				case 28: {
-					switch (_point(value)) {
-						case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_GOTO_G28_POSITION);
-						case 1: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_G28_POSITION);
-						case 2: SET_NON_MODAL (next_action, NEXT_ACTION_SEARCH_HOME);
-						case 3: SET_NON_MODAL (next_action, NEXT_ACTION_SET_ABSOLUTE_ORIGIN);
-						case 4: SET_NON_MODAL (next_action, NEXT_ACTION_HOMING_NO_SET);
-						default: status = STAT_UNRECOGNIZED_COMMAND;
-					}
-					break;
-				}
-				case 30: {
-					switch (_point(value)) {
-						case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_GOTO_G30_POSITION);
-						case 1: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_G30_POSITION);
-						default: status = STAT_UNRECOGNIZED_COMMAND;
-					}
-					break;
-				}
-				case 38: {
-					switch (_point(value)) {
-						case 2: SET_NON_MODAL (next_action, NEXT_ACTION_STRAIGHT_PROBE);
-						default: status = STAT_UNRECOGNIZED_COMMAND;
-					}
-					break;
-				}
-				case 40: break;	// ignore cancel cutter radius compensation
-				case 49: break;	// ignore cancel tool length offset comp.
-				case 53: SET_NON_MODAL (absolute_override, true);
-				case 54: SET_MODAL (MODAL_GROUP_G12, coord_system, G54);
-				case 55: SET_MODAL (MODAL_GROUP_G12, coord_system, G55);
-				case 56: SET_MODAL (MODAL_GROUP_G12, coord_system, G56);
-				case 57: SET_MODAL (MODAL_GROUP_G12, coord_system, G57);
-				case 58: SET_MODAL (MODAL_GROUP_G12, coord_system, G58);
-				case 59: SET_MODAL (MODAL_GROUP_G12, coord_system, G59);
-				case 61: {
-					switch (_point(value)) {
-						case 0: SET_MODAL (MODAL_GROUP_G13, path_control, PATH_EXACT_PATH);
-						case 1: SET_MODAL (MODAL_GROUP_G13, path_control, PATH_EXACT_STOP);
-						default: status = STAT_UNRECOGNIZED_COMMAND;
-					}
-					break;
-				}
-				case 64: SET_MODAL (MODAL_GROUP_G13,path_control, PATH_CONTINUOUS);
-				case 80: SET_MODAL (MODAL_GROUP_G1, motion_mode,  MOTION_MODE_CANCEL_MOTION_MODE);
-				case 90: SET_MODAL (MODAL_GROUP_G3, distance_mode, ABSOLUTE_MODE);
-				case 91: SET_MODAL (MODAL_GROUP_G3, distance_mode, INCREMENTAL_MODE);
-				case 92: {
-					switch (_point(value)) {
-						case 0: SET_MODAL (MODAL_GROUP_G0, next_action, NEXT_ACTION_SET_ORIGIN_OFFSETS);
-						case 1: SET_NON_MODAL (next_action, NEXT_ACTION_RESET_ORIGIN_OFFSETS);
-						case 2: SET_NON_MODAL (next_action, NEXT_ACTION_SUSPEND_ORIGIN_OFFSETS);
-						case 3: SET_NON_MODAL (next_action, NEXT_ACTION_RESUME_ORIGIN_OFFSETS);
-						default: status = STAT_UNRECOGNIZED_COMMAND;
-					}
-					break;
-				}
-				case 93: SET_MODAL (MODAL_GROUP_G5, inverse_feed_rate_mode, true);
-				case 94: SET_MODAL (MODAL_GROUP_G5, inverse_feed_rate_mode, false);
-				default: status = STAT_UNRECOGNIZED_COMMAND;
-			}
-			break;
+	while((status = _get_next_gcode_word(&pstr, &wr, &letter, &value)) == STAT_OK) {
+		if ((status = _parse_gcode_word(letter, value)) != STAT_OK) break;
+	}
+	if ((status != STAT_OK) && (status != STAT_COMPLETE)) {
+		while ((*wr = _get_gcode_char(&pstr)) != NUL) { wr++; pstr++;}	// finish normalizing the block
+		return (status);
+	}
+	return (_validate_gcode_block());
+}
 
-			case 'M':
-			switch((uint8_t)value) {
-				case 0: case 1: case 60:
-						SET_MODAL (MODAL_GROUP_M4, program_flow, PROGRAM_STOP);
-				case 2: case 30:
-						SET_MODAL (MODAL_GROUP_M4, program_flow, PROGRAM_END);
-				case 3: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_CW);
-				case 4: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_CCW);
-				case 5: SET_MODAL (MODAL_GROUP_M7, spindle_mode, SPINDLE_OFF);
-				case 6: SET_NON_MODAL (tool_change, true);
-				case 7: SET_MODAL (MODAL_GROUP_M8, mist_coolant, true);
-				case 8: SET_MODAL (MODAL_GROUP_M8, flood_coolant, true);
-				case 9: SET_MODAL (MODAL_GROUP_M8, flood_coolant, false);
-				case 48: SET_MODAL (MODAL_GROUP_M9, override_enables, true);
-				case 49: SET_MODAL (MODAL_GROUP_M9, override_enables, false);
-				case 50: SET_MODAL (MODAL_GROUP_M9, feed_rate_override_enable, true); // conditionally true
-				case 51: SET_MODAL (MODAL_GROUP_M9, spindle_override_enable, true);	  // conditionally true
-				default: status = STAT_UNRECOGNIZED_COMMAND;
-			}
-			break;
+/*
+ * gc_tokenize_block()	- convert a text block into a token block - for program store uploads
+ * gc_reset_tokens()	- start decoding token blocks from the top of a program
+ * _parse_token_block()	- load a token block into gn and gf without parsing any text
+ *
+ *	See gcode_parser.h for the format. The tokens buffer must hold INPUT_BUFFER_LEN bytes.
+ *	*last is the encoder's last value for each letter. It is only updated if the block is
+ *	converted, and the decoder keeps the same state for the blocks as they are run, so
+ *	token blocks must be decoded once each, in order, after gc_reset_tokens().
+ *
+ *	gc_tokenize_block() returns STAT_NOOP for a block with no words (blank, comment or %).
+ *	A block delete, a block with macro parameters or expressions (see gcode_macro.h),
+ *	a block that can't be read as words, or one too long as tokens returns
+ *	an error status - it is kept as text, so its error is still reported when it runs.
+ */
+static int32_t _token_last[GC_TOKEN_LETTERS];	// decoder state - last value of each letter
 
-			case 'T': SET_NON_MODAL (tool_select, (uint8_t)trunc(value));
-			case 'F': SET_NON_MODAL (feed_rate, value);
-			case 'P': SET_NON_MODAL (parameter, value);				// used for dwell time, G10 coord select
-			case 'S': SET_NON_MODAL (spindle_speed, value);
-			case 'X': SET_NON_MODAL (target[AXIS_X], value);
-			case 'Y': SET_NON_MODAL (target[AXIS_Y], value);
-			case 'Z': SET_NON_MODAL (target[AXIS_Z], value);
-			case 'A': SET_NON_MODAL (target[AXIS_A], value);
-			case 'B': SET_NON_MODAL (target[AXIS_B], value);
-			case 'C': SET_NON_MODAL (target[AXIS_C], value);
-		//	case 'U': SET_NON_MODAL (target[AXIS_U], value);		// reserved
-		//	case 'V': SET_NON_MODAL (target[AXIS_V], value);		// reserved
-		//	case 'W': SET_NON_MODAL (target[AXIS_W], value);		// reserved
-			case 'I': SET_NON_MODAL (arc_offset[0], value);
-			case 'J': SET_NON_MODAL (arc_offset[1], value);
-			case 'K': SET_NON_MODAL (arc_offset[2], value);
-			case 'R': SET_NON_MODAL (arc_radius, value);
-			case 'N': SET_NON_MODAL (linenum,(uint32_t)value);		// line number
-			case 'L': break;										// not used for anything
-			default: status = STAT_UNRECOGNIZED_COMMAND;
+static inline float _token_value(int32_t fixed) { return ((float)fixed / GC_TOKEN_SCALE);}
+static inline uint8_t _token_opcode(uint8_t encoding, uint8_t letter) { return ((encoding << 5) | letter);}
+
+stat_t gc_tokenize_block(const char_t *block, uint8_t *tokens, int32_t *last)
+{
+	char_t buf[INPUT_BUFFER_LEN];		// words are read from a copy - reading normalizes in place
+	char_t *pstr = buf;
+	char_t *wr = buf;
+	char letter;
+	float value;
+	stat_t status;
+	int32_t next[GC_TOKEN_LETTERS];
+	uint8_t *tok = &tokens[GC_TOKEN_HEADER_LEN];
+	uint8_t *end = &tokens[INPUT_BUFFER_LEN];
+
+	if ((*block == '/') || (GC_IS_TOKEN_BLOCK(block))) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	if (strpbrk((const char *)block, "#[") != NULL) { return (STAT_INPUT_VALUE_UNSUPPORTED);}	// values set when run
+	strncpy((char *)buf, (const char *)block, INPUT_BUFFER_LEN-1);
+	buf[INPUT_BUFFER_LEN-1] = NUL;
+	memcpy(next, last, sizeof(next));
+
+	while ((status = _get_next_gcode_word(&pstr, &wr, &letter, &value)) == STAT_OK) {
+		uint8_t index = letter - 'A';
+		if ((tok + 1 + sizeof(float)) > end) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+
+		int32_t fixed = 0;
+		if (fabs(value) < (GC_TOKEN_FIXED_MAX / GC_TOKEN_SCALE)) { fixed = (int32_t)lrintf(value * GC_TOKEN_SCALE);}
+		if (_token_value(fixed) != value) {				// not exact in thousandths
+			*tok++ = _token_opcode(GC_TOKEN_FLOAT, index);
+			memcpy(tok, &value, sizeof(float));
+			tok += sizeof(float);
+			continue;
+		}
+		int32_t delta = fixed - next[index];
+		next[index] = fixed;
+		if (delta == 0) {
+			*tok++ = _token_opcode(GC_TOKEN_SAME, index);
+		} else if ((delta >= -128) && (delta <= 127)) {
+			*tok++ = _token_opcode(GC_TOKEN_DELTA8, index);
+			*tok++ = (uint8_t)(int8_t)delta;
+		} else if ((delta >= -32768) && (delta <= 32767)) {
+			int16_t delta16 = (int16_t)delta;
+			*tok++ = _token_opcode(GC_TOKEN_DELTA16, index);
+			memcpy(tok, &delta16, sizeof(int16_t));
+			tok += sizeof(int16_t);
+		} else {
+			*tok++ = _token_opcode(GC_TOKEN_FIXED, index);
+			memcpy(tok, &fixed, sizeof(int32_t));
+			tok += sizeof(int32_t);
 		}
-		if(status != STAT_OK) break;
 	}
-	if ((status != STAT_OK) && (status != STAT_COMPLETE)) return (status);
-	ritorno(_validate_gcode_block());
-	return (_execute_gcode_block());		// if successful execute the block
+	if (status != STAT_COMPLETE) { return (status);}
+	if (tok == &tokens[GC_TOKEN_HEADER_LEN]) { return (STAT_NOOP);}
+
+	tokens[0] = GC_TOKEN_BLOCK;
+	tokens[1] = (uint8_t)(tok - &tokens[GC_TOKEN_HEADER_LEN]);
+	memcpy(last, next, sizeof(next));
+	return (STAT_OK);
+}
+
+void gc_reset_tokens() { memset(_token_last, 0, sizeof(_token_last));}
+
+static stat_t _parse_token_block(const uint8_t *block, uint8_t motion_mode)
+{
+	const uint8_t *tok = &block[GC_TOKEN_HEADER_LEN];
+	const uint8_t *end = tok + block[1];
+	stat_t status = STAT_OK;
+
+	memset(&gp, 0, sizeof(gp));		// same initial state as _parse_gcode_block()
+	memset(&gf, 0, sizeof(gf));
+	memset(&gn, 0, sizeof(gn));
+	gn.motion_mode = motion_mode;
+
+	while (tok < end) {				// every token is decoded, even after an error, to keep the letter values
+		uint8_t index = *tok & 0x1F;
+		uint8_t encoding = *tok++ >> 5;
+		int32_t *last = &_token_last[min(index, GC_TOKEN_LETTERS-1)];
+		float value = 0;
+
+		switch (encoding) {
+			case GC_TOKEN_SAME: { break;}
+			case GC_TOKEN_DELTA8: { *last += (int8_t)*tok++; break;}
+			case GC_TOKEN_DELTA16: {
+				int16_t delta16;
+				memcpy(&delta16, tok, sizeof(int16_t));
+				tok += sizeof(int16_t);
+				*last += delta16;
+				break;
+			}
+			case GC_TOKEN_FIXED: { memcpy(last, tok, sizeof(int32_t)); tok += sizeof(int32_t); break;}
+			case GC_TOKEN_FLOAT: { memcpy(&value, tok, sizeof(float)); tok += sizeof(float); break;}
+			default: { return (STAT_INPUT_VALUE_UNSUPPORTED);}	// not a token block
+		}
+		if (encoding != GC_TOKEN_FLOAT) { value = _token_value(*last);}
+		if (status != STAT_OK) { continue;}
+		if (index >= GC_TOKEN_LETTERS) {
+			status = STAT_EXPECTED_COMMAND_LETTER;
+		} else {
+			status = _parse_gcode_word('A' + index, value);
+		}
+	}
+	if (status != STAT_OK) { return (status);}
+	return (_validate_gcode_block());
 }
 
 /*
@@ -403,6 +724,7 @@ static stat_t _parse_gcode_block(char_t *buf)
  *		19a. homing functions (G28.2, G28.3, G28.1, G28, G30)
  *		19b. change coordinate system data (G10)
  *		19c. set axis offsets (G92, G92.1, G92.2, G92.3)
+ *		19d. rotation and scaling (G68, G69, G51, G50)
  *		20. perform motion (G0 to G3, G80-G89) as modified (possibly) by G53
  *		21. stop and end (M0, M1, M2, M30, M60)
  *
@@ -419,6 +741,12 @@ static stat_t _execute_gcode_block()
 	EXEC_FUNC(cm_set_feed_rate, feed_rate);
 	EXEC_FUNC(cm_feed_rate_override_factor, feed_rate_override_factor);
 	EXEC_FUNC(cm_traverse_override_factor, traverse_override_factor);
+#ifdef __SPINDLE_CSS
+	if (gf.css_mode == true) {						// G96 D, G97 - before S, as they change what S is
+		if ((gn.css_mode == true) && (fp_FALSE(gf.spindle_speed))) { return (STAT_GCODE_INPUT_ERROR);}	// G96 needs an S
+		ritorno(cm_set_css_mode(gn.css_mode, gn.spindle_max, gf.spindle_max));
+	}
+#endif
 	EXEC_FUNC(cm_set_spindle_speed, spindle_speed);
 	EXEC_FUNC(cm_spindle_override_factor, spindle_override_factor);
 	EXEC_FUNC(cm_select_tool, tool_select);			// tool_select is where it's written
@@ -437,11 +765,18 @@ static stat_t _execute_gcode_block()
 	EXEC_FUNC(cm_select_plane, select_plane);
 	EXEC_FUNC(cm_set_units_mode, units_mode);
 	//--> cutter radius compensation goes here
-	//--> cutter length compensation goes here
+	if (gf.tool_offset_mode == true) {				// G43 H, or the current tool without an H - G49
+		uint8_t entry = 0;
+		if (gn.tool_offset_mode == true) { entry = (gf.tool_offset_entry == true) ? gn.tool_offset_entry : gmx.modal.tool;}
+		ritorno(cm_set_tool_offset(entry));
+	}
 	EXEC_FUNC(cm_set_coord_system, coord_system);
 	EXEC_FUNC(cm_set_path_control, path_control);
+	if ((gf.path_control == true) && (gn.path_control == PATH_CONTINUOUS)) {
+		ritorno(cm_set_path_tolerance(gn.parameter));	// G64 P<tolerance>, P is zero if absent
+	}
 	EXEC_FUNC(cm_set_distance_mode, distance_mode);
-	//--> set retract mode goes here
+	EXEC_FUNC(cm_set_retract_mode, retract_mode);
 
 	switch (gn.next_action) {
 		case NEXT_ACTION_SET_G28_POSITION:  { status = cm_set_g28_position(); break;}							// G28.1
@@ -460,6 +795,13 @@ static stat_t _execute_gcode_block()
 		case NEXT_ACTION_RESET_ORIGIN_OFFSETS: { status = cm_reset_origin_offsets(); break;}
 		case NEXT_ACTION_SUSPEND_ORIGIN_OFFSETS: { status = cm_suspend_origin_offsets(); break;}
 		case NEXT_ACTION_RESUME_ORIGIN_OFFSETS: { status = cm_resume_origin_offsets(); break;}
+#ifdef __COORD_TRANSFORM
+		case NEXT_ACTION_SET_ROTATION: { status = cm_set_rotation(gn.target, gf.target, gn.arc_radius, gf.arc_radius); break;}	// G68
+		case NEXT_ACTION_CANCEL_ROTATION: { status = cm_cancel_rotation(); break;}												// G69
+		case NEXT_ACTION_SET_SCALING: { status = cm_set_scaling(gn.target, gf.target, gn.arc_offset, gf.arc_offset,
+											gn.parameter, gf.parameter); break;}												// G51
+		case NEXT_ACTION_CANCEL_SCALING: { status = cm_cancel_scaling(); break;}												// G50
+#endif
 
 		case NEXT_ACTION_DEFAULT: { 
 			cm_set_absolute_override(MODEL, gn.absolute_override);	// apply override setting to gm struct
@@ -471,6 +813,20 @@ static stat_t _execute_gcode_block()
 					// gf.radius sets radius mode if radius was collected in gn
 					{ status = cm_arc_feed(gn.target, gf.target, gn.arc_offset[0], gn.arc_offset[1],
 								gn.arc_offset[2], gn.arc_radius, gn.motion_mode); break;}
+				case MOTION_MODE_CANNED_CYCLE_73: case MOTION_MODE_CANNED_CYCLE_81:
+				case MOTION_MODE_CANNED_CYCLE_82: case MOTION_MODE_CANNED_CYCLE_83:
+				case MOTION_MODE_CANNED_CYCLE_84:
+					{ status = cm_canned_cycle(gn.target, gf.target, gn.arc_radius, gf.arc_radius,
+								gn.peck_increment, gf.peck_increment, gn.parameter, gf.parameter,
+								gn.l_word, gn.motion_mode); break;}
+				case MOTION_MODE_CUBIC_SPLINE: case MOTION_MODE_QUADRATIC_SPLINE:
+					{ status = cm_spline_feed(gn.target, gf.target, gn.arc_offset[0], gf.arc_offset[0],
+								gn.arc_offset[1], gf.arc_offset[1], gn.parameter, gf.parameter,
+								gn.peck_increment, gf.peck_increment, gn.motion_mode); break;}
+#ifdef __SPINDLE_SYNC
+				case MOTION_MODE_SPINDLE_SYNC:
+					{ status = cm_spindle_sync_feed(gn.target, gf.target, gn.arc_offset[2], gf.arc_offset[2]); break;}
+#endif
 			}
 		}
 	}
@@ -485,6 +841,83 @@ static stat_t _execute_gcode_block()
 }
 
 
+/*
+ * _get_block_buffers() - planner buffers the parsed block in gn/gf may queue when it runs
+ *
+ *	Counted the way _execute_gcode_block() runs the block, so the block only waits for
+ *	what it needs rather than for PLANNER_BUFFER_HEADROOM. It is an upper bound:
+ *
+ *	  - each word that queues a command counts one. Coolant and S are attached to the
+ *		next move, but take a buffer of their own if the attached ring is full
+ *	  - a G1 counts one and a G0 two with $gtr=1 (dogleg). A rotary axis word counts
+ *		one more, for the wrap command cm_set_model_target() may queue
+ *	  - arcs, splines, canned cycles, G28 and G30, homing and probing are generated by
+ *		callbacks or wait on the planner themselves - they take the old headroom
+ *
+ *	A held G1 run is added when the block comes up - see mp_planner_has_room().
+ */
+
+static uint8_t _get_block_buffers()
+{
+	uint8_t buffers = 0;
+
+	if (fp_TRUE(gf.spindle_speed)) { buffers++;}
+	if (gf.tool_select == true) { buffers++;}
+	if (gf.tool_change == true) { buffers++;}
+	if (gf.spindle_mode == true) { buffers++;}
+	if (gf.mist_coolant == true) { buffers++;}
+	if (gf.flood_coolant == true) { buffers++;}
+	if (gf.tool_offset_mode == true) { buffers++;}
+	if (gf.coord_system == true) { buffers++;}
+	if (gf.program_flow == true) { buffers++;}
+#ifdef __SPINDLE_CSS
+	if (gf.css_mode == true) { buffers++;}
+#endif
+
+	uint8_t axes = false;
+	uint8_t rotary = 0;
+	for (uint8_t axis=AXIS_X; axis<AXES; axis++) {
+		if (fp_TRUE(gf.target[axis])) {
+			axes = true;
+			if (axis >= AXIS_A) { rotary = 1;}
+		}
+	}
+	switch (gn.next_action) {
+		case NEXT_ACTION_DWELL:
+		case NEXT_ACTION_SET_ABSOLUTE_ORIGIN:
+		case NEXT_ACTION_SET_ORIGIN_OFFSETS:
+		case NEXT_ACTION_RESET_ORIGIN_OFFSETS:
+		case NEXT_ACTION_SUSPEND_ORIGIN_OFFSETS:
+		case NEXT_ACTION_RESUME_ORIGIN_OFFSETS: { buffers++; break;}
+
+		case NEXT_ACTION_GOTO_G28_POSITION:
+		case NEXT_ACTION_GOTO_G30_POSITION:
+		case NEXT_ACTION_SEARCH_HOME:
+		case NEXT_ACTION_HOMING_NO_SET:
+		case NEXT_ACTION_STRAIGHT_PROBE: { return (PLANNER_BUFFER_HEADROOM);}
+
+		case NEXT_ACTION_DEFAULT: {
+			if ((axes == false) && (gf.motion_mode == false)) { break;}
+			switch (gn.motion_mode) {
+				case MOTION_MODE_CANCEL_MOTION_MODE: { break;}
+				case MOTION_MODE_STRAIGHT_TRAVERSE: {
+					if (axes == false) { break;}
+					buffers += 1 + rotary + ((cm.rapid_mode == RAPID_DOGLEG) ? 1 : 0);
+					break;
+				}
+				case MOTION_MODE_STRAIGHT_FEED: {
+					if (axes == false) { break;}
+					buffers += 1 + rotary;
+					break;
+				}
+				default: { return (PLANNER_BUFFER_HEADROOM);}
+			}
+			break;
+		}
+	}
+	return (min(buffers, PLANNER_BUFFER_HEADROOM));
+}
+
 /***********************************************************************************
  * CONFIGURATION AND INTERFACE FUNCTIONS
  * Functions to get and set variables from the cfgArray table
@@ -24,10 +24,47 @@
 extern "C"{
 #endif
 
+#define GCODE_QUEUE_SIZE 4			// parsed blocks that can wait for the planner
+
+/*
+ * Token blocks - pre-parsed Gcode blocks for the program store (see program_store.h)
+ *
+ *	A token block is GC_TOKEN_BLOCK, a byte count, then one token per word. The token
+ *	opcode is the word letter (0=A ... 25=Z) in the low 5 bits and the operand encoding 
+ *	in the top 3 bits. Values are kept as fixed point thousandths and each letter is 
+ *	coded as the change from its last value, so repeated and nearby values take 0-2 bytes.
+ *	Values that are not exact in thousandths are carried as floats. Decoding gives the 
+ *	same float as parsing the text, so a token block runs exactly like its text line.
+ */
+#define GC_TOKEN_BLOCK 0x80			// first byte of a token block - never starts a text line
+#define GC_TOKEN_HEADER_LEN 2		// GC_TOKEN_BLOCK, byte count of the tokens
+#define GC_TOKEN_LETTERS 26
+#define GC_TOKEN_SCALE 1000			// fixed point units per unit of value
+#define GC_TOKEN_FIXED_MAX 16777216	// 2^24 - larger fixed values are not exact as floats
+#define GC_IS_TOKEN_BLOCK(b) ((uint8_t)*(b) == GC_TOKEN_BLOCK)
+
+enum gcTokenEncoding {				// operand encoding in the top 3 bits of the opcode
+	GC_TOKEN_SAME = 0,				// no operand - same value as the last one for the letter
+	GC_TOKEN_DELTA8,				// int8 change in thousandths
+	GC_TOKEN_DELTA16,				// int16 change in thousandths
+	GC_TOKEN_FIXED,					// int32 value in thousandths
+	GC_TOKEN_FLOAT					// float value - the last value is not changed
+};
+
 /*
  * Global Scope Functions
  */
 stat_t gc_gcode_parser(char_t *block);
+stat_t gc_queue_gcode_block(char_t *block, uint8_t src);
+char_t *gc_get_queued_block(void);
+uint8_t gc_get_queued_block_src(void);
+uint8_t gc_get_queued_block_buffers(void);
+stat_t gc_run_queued_block(void);
+uint8_t gc_get_queued_blocks(void);
+void gc_flush_queue(void);
+void gc_flush_queue_internal(void);
+stat_t gc_tokenize_block(const char_t *block, uint8_t *tokens, int32_t *last);
+void gc_reset_tokens(void);
 stat_t gc_get_gc(cmdObj_t *cmd);
 stat_t gc_run_gc(cmdObj_t *cmd);
 
@@ -34,8 +34,8 @@
 /////// ARM VERSION ////////
 ////////////////////////////
 
-#include "motatePins.h"
-#include "motateTimers.h" // for Motate::timer_number
+#include "MotatePins.h"
+#include "MotateTimers.h" // for Motate::timer_number
 
 #ifdef __cplusplus
 extern "C"{
@@ -48,6 +48,34 @@ extern "C"{
 #define MILLISECONDS_PER_TICK 1			// MS for system tick (systick * N)
 #define SYS_ID_LEN 12					// length of system ID string from sys_get_id()
 
+/**** DWT cycle counter ****
+ *
+ * Not in this version of the CMSIS headers (core_cm3.h V2.10), so the registers are
+ * defined here. Everything timed in CPU cycles reads HW_DWT_CYCCNT and starts the
+ * counter with hw_start_cycle_counter(). main() starts it before anything is timed.
+ */
+#define HW_DWT_CTRL			(*(volatile uint32_t *)0xE0001000UL)	// DWT control
+#define HW_DWT_CYCCNT		(*(volatile uint32_t *)0xE0001004UL)	// DWT cycle count
+#define HW_DWT_CYCCNTENA	(1UL << 0)								// CTRL - cycle counter enable
+#define HW_DEMCR			(*(volatile uint32_t *)0xE000EDFCUL)	// debug exception and monitor control
+#define HW_DEMCR_TRCENA		(1UL << 24)								// DEMCR - enables the DWT and ITM
+
+static inline void hw_start_cycle_counter(void) { HW_DEMCR |= HW_DEMCR_TRCENA; HW_DWT_CTRL |= HW_DWT_CYCCNTENA;}
+
+/**** Peripheral clocks ****
+ *
+ * libsam is not built, so there is no pmc_enable_periph_clk(). Drivers that don't go
+ * through Motate turn their peripheral clocks on here, the way Motate does.
+ */
+static inline void hw_enable_periph_clk(const uint32_t id)
+{
+	if (id < 32) {
+		PMC->PMC_PCER0 = (1u << id);
+	} else {
+		PMC->PMC_PCER1 = (1u << (id - 32));
+	}
+}
+
 /************************************************************************************
  **** ARM SAM3X8E SPECIFIC HARDWARE *************************************************
  ************************************************************************************/
@@ -75,13 +103,19 @@ extern "C"{
  *	 3	Serial read character interrupt
  *	 4	EXEC software generated interrupt (STIR / SGI)
  *	 5	Serial write character interrupt  
+ *	 6	PIO change interrupts for the axis switches - below the DDA, latch step positions (see switch.cpp)
+ *	 7	DMAC interrupt for the SPI motor driver transfers - below the switches (see spi.h)
+ *
+ * The EXEC runs below everything that preempts it, so its time to finish a segment 
+ * includes theirs. How close that comes to the DDA running dry is measured in the 
+ * ps group ($psnm, $psmar) - see the prep segment ring in stepper.h.
  */
 
 /**** Stepper DDA and dwell timer settings ****/
 
 //#define FREQUENCY_DDA		50000UL
 #define FREQUENCY_DDA		100000UL
-#define FREQUENCY_DWELL		1000UL
+#define FREQUENCY_DWELL		1000UL			// longest dwell timer period - dwells are timed to the microsecond
 #define FREQUENCY_SGI		200000UL		// 200,000 Hz means software interrupts will fire 5 uSec after being called
 
 /**** Motate Definitions ****/
@@ -92,6 +126,13 @@ Motate::timer_number dda_timer_num   = 2;	// stepper pulse generation in stepper
 Motate::timer_number dwell_timer_num = 3;	// dwell timing in stepper.cpp
 Motate::timer_number load_timer_num  = 4;	// request load timer in stepper.cpp
 Motate::timer_number exec_timer_num  = 5;	// request exec timer in stepper.cpp
+#ifdef __ENCODERS
+Motate::timer_number encoder_1_timer_num = 0;	// TC0 quadrature decoder in encoder.cpp - the DDA uses TC0 channel 2
+Motate::timer_number encoder_2_timer_num = 6;	// TC2 quadrature decoder
+#endif
+#ifdef __STEP_CAPTURE
+Motate::timer_number step_capture_timer_num = 1;	// TC0 channel 1 input capture in stepcap.cpp
+#endif
 
 // Pin assignments
 
@@ -108,6 +149,18 @@ Motate::pin_number spi_ss4_pin_num = 48;
 Motate::pin_number spi_ss5_pin_num = 49;
 Motate::pin_number spi_ss6_pin_num = 50;
 Motate::pin_number kinen_sync_pin_num = 53;
+Motate::pin_number spi_miso_pin_num = 74;	// SPI0 on the ICSP header - motor drivers (see spi.h)
+Motate::pin_number spi_mosi_pin_num = 75;
+Motate::pin_number spi_sck_pin_num = 76;
+#ifdef __ENCODERS
+Motate::pin_number encoder_1_a_pin_num = 2;	// TIOA0 - shared with motor 1 step in this pinout (see encoder.h)
+Motate::pin_number encoder_1_b_pin_num = 13;	// TIOB0 - shared with the indicator LED
+Motate::pin_number encoder_2_a_pin_num = 5;	// TIOA6 - shared with motor 1 dir
+Motate::pin_number encoder_2_b_pin_num = 4;	// TIOB6 - shared with motor 3 step
+#endif
+#ifdef __STEP_CAPTURE
+Motate::pin_number step_capture_pin_num = 61;	// TIOA1 - shared with the B max switch (see stepcap.h)
+#endif
 
 // grbl compatibility
 Motate::pin_number grbl_reset_pin_num = 54;
@@ -121,6 +174,10 @@ Motate::pin_number spindle_dir_pin_num	  = 13;
 Motate::pin_number spindle_pwm_pin_num	  = 11;
 Motate::pin_number secondary_pwm_pin_num  = 9;
 Motate::pin_number coolant_enable_pin_num = 57;
+#ifdef __PSO
+Motate::pin_number pso_1_pin_num = 68;		// position synchronized outputs - CANRX, CANTX (see pso.h)
+Motate::pin_number pso_2_pin_num = 69;
+#endif
 
 // axes
 Motate::pin_number axis_X_min_pin_num = 14;
@@ -225,6 +282,17 @@ static Motate::OutputPin<spi_ss4_pin_num> spi_ss4_pin;
 static Motate::OutputPin<spi_ss5_pin_num> spi_ss5_pin;
 static Motate::OutputPin<spi_ss6_pin_num> spi_ss6_pin;
 static Motate::OutputPin<kinen_sync_pin_num> kinen_sync_pin;
+#ifdef __TMC2660
+static Motate::Pin<spi_miso_pin_num> spi_miso_pin(Motate::kPeripheralA);
+static Motate::Pin<spi_mosi_pin_num> spi_mosi_pin(Motate::kPeripheralA);
+static Motate::Pin<spi_sck_pin_num> spi_sck_pin(Motate::kPeripheralA);
+#endif
+#ifdef __ENCODERS
+static Motate::Pin<encoder_1_a_pin_num> encoder_1_a_pin(Motate::kPeripheralB);
+static Motate::Pin<encoder_1_b_pin_num> encoder_1_b_pin(Motate::kPeripheralB);
+static Motate::Pin<encoder_2_a_pin_num> encoder_2_a_pin(Motate::kPeripheralB);
+static Motate::Pin<encoder_2_b_pin_num> encoder_2_b_pin(Motate::kPeripheralB);
+#endif
 
 static Motate::OutputPin<grbl_reset_pin_num> grbl_reset_pin;
 static Motate::OutputPin<grbl_feedhold_pin_num> grbl_feedhold_pin;
@@ -31,6 +31,7 @@
 #include "json_parser.h"
 #include "text_parser.h"
 #include "canonical_machine.h"
+#include "gcode_parser.h"
 #include "report.h"
 #include "util.h"
 #include "xio.h"					// for char definitions
@@ -46,14 +47,19 @@ jsSingleton_t js;
 /**** local scope stuff ****/
 
 static stat_t _json_parser_kernal(char_t *str);
+static stat_t _run_batch(cmdObj_t *cmd);
 static stat_t _get_nv_pair_strict(cmdObj_t *cmd, char_t **pstr, int8_t *depth);
-static stat_t _normalize_json_string(char_t *str, uint16_t size);
+static char_t _get_json_char(char_t **pstr);
+static uint8_t _is_json_word(const char_t *str);
+static uint8_t _is_bare_string(const char_t *str);
+static int16_t _serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size, uint8_t footer);
+static uint8_t _coalesce_ack(stat_t status);
 
 /****************************************************************************
  * json_parser() - exposed part of JSON parser
  * _json_parser_kernal()
- * _normalize_json_string()
  * _get_nv_pair_strict()
+ * _get_json_char()
  *
  *	This is a dumbed down JSON parser to fit in limited memory with no malloc
  *	or practical way to do recursion ("depth" tracks parent/child levels).
@@ -74,12 +80,27 @@ static stat_t _normalize_json_string(char_t *str, uint16_t size);
  *	  - exponentiated numbers are handled OK. 
  *	  - hexadecimal or other non-decimal number bases are not supported
  *
+ *	Relaxed JSON ($ej=2, JSON_MODE_RELAXED) takes names and string values without
+ *	their quotes, e.g. {gc:g1x10y20} or {sr:{posx:t,stat:t}}. A bare string runs to
+ *	the next comma or closing curly outside a Gcode comment. One that starts with a
+ *	digit or '-', or is null, true, false, n, t or f, still needs its quotes. Quoted input
+ *	is still taken. The responses and reports leave the quotes off names, and off
+ *	string values that would read back as the same string - see _serialize(). A '{'
+ *	line leaves relaxed mode on; text mode ('$', '?') ends it.
+ *
  *	The parser:
  *	  - extracts an array of one or more JSON object structs from the input string
  *	  - once the array is built it executes the object(s) in order in the array
+ *	  - several top-level pairs are run as a batch - see _run_batch()
  *	  - passes the executed array to the response handler to generate the response string
  *	  - returns the status and the JSON response string
  *
+ *	Names and values are lower cased, whitespace skipped and strings compacted in the
+ *	one scan that splits the pairs - there is no normalization pass first. Parsing
+ *	starts once read_line() has the whole line, not as its bytes arrive: the pairs are
+ *	parsed into the shared cmdObj list, which status reports and other responses reset
+ *	between controller passes, so a partly parsed line could not be held there.
+ *
  *	Separation of concerns
  *	  json_parser() is the only exposed part. It does parsing, display, and status reports.
  *	  _get_nv_pair() only does parsing and syntax; no semantic validation or group handling
@@ -94,6 +115,111 @@ void json_parser(char_t *str)
 	sr_request_status_report(SR_IMMEDIATE_REQUEST); // generate incremental status report to show any changes
 }
 
+/*
+ * json_gcode_parser() - run a plain Gcode block received in JSON mode
+ * json_gcode_object()	- set up the "gc" response object for a Gcode block
+ * json_gcode_response() - send the response for a Gcode block
+ *
+ *	Gives the same response as if the block had been sent as {"gc":"<block>"}
+ *	without building and parsing that JSON. The "gc" object is set up directly
+ *	and its string points at the block itself, which the Gcode parser normalizes 
+ *	in place - so the block is echoed in its normalized form as before.
+ *
+ *	The object and response are split so blocks run from the Gcode block queue
+ *	can respond the same way. Set up the object before the block is executed.
+ */
+void json_gcode_parser(char_t *str)
+{
+	json_gcode_object(str);
+	json_gcode_response(gc_gcode_parser(str));
+}
+
+void json_gcode_object(char_t *str)
+{
+	cmdObj_t *cmd = cmd_reset_list();
+
+	if (js.gc_index == 0) { js.gc_index = cmd_get_index((const char_t *)"", (const char_t *)"gc");}
+	cmd->index = js.gc_index;
+	strcpy(cmd->token, "gc");
+	cmd->objtype = TYPE_STRING;
+	cmd->stringp = (char_t (*)[])str;
+}
+
+void json_gcode_response(stat_t status)
+{
+	if (_coalesce_ack(status) == false) {
+		cmd_print_list(status, TEXT_NO_PRINT, JSON_RESPONSE_FORMAT);
+	}
+	sr_request_status_report(SR_IMMEDIATE_REQUEST);
+}
+
+/*
+ * Batched acks - answer a run of Gcode lines with one response
+ *
+ *	With $ja above 1 and $jv below JV_LINENUM, a Gcode line that runs OK with nothing
+ *	to say is not answered on its own. It is added to a pending ack, which answers a
+ *	run of consecutive lines with their first and last line numbers and the count:
+ *
+ *		{"r":{"ack":[first,last,count]},"f":[2,0,rx,checksum]}
+ *
+ *	A line that fails or carries a message sends the pending ack and then its own
+ *	response, as does any other JSON response, so responses stay in order. A line
+ *	number is the N word or the autoincremented number if there is none.
+ *
+ *	The pending ack goes out at $ja lines, or as soon as the host may be waiting on
+ *	it - the block queue is empty with no input waiting, or full - or once it has
+ *	been held JSON_ACK_HOLD_MS. The footer gives the line credits at the time it is
+ *	sent, so a host that streams on credits keeps streaming. Only lines from USB are
+ *	batched - a line from a USART port is answered on its own (see xio.cpp).
+ */
+
+static uint8_t _coalesce_ack(stat_t status)
+{
+	if ((js.ack_coalesce < 2) || (js.echo_json_footer == false) || (js.echo_json_linenum == true) ||
+		(xio_get_tx_source() != DEV_STDIN)) {
+		return (false);
+	}
+	if ((status != STAT_OK) && (status != STAT_NOOP)) { return (false);}
+	for (cmdObj_t *cmd = cmd_body; cmd != NULL; cmd = cmd_next(cmd)) {
+		if (cmd_get_type(cmd) == CMD_TYPE_MESSAGE) { return (false);}
+		if (cmd->nx == false) { break;}
+	}
+	uint32_t linenum = cm_get_linenum(MODEL);
+	if (js.ack_count == 0) {
+		js.ack_first = linenum;
+		js.ack_tick = SysTickTimer.getValue();
+	}
+	js.ack_last = linenum;
+	if (++js.ack_count >= js.ack_coalesce) { json_flush_acks();}
+	return (true);
+}
+
+stat_t json_ack_callback()
+{
+	if (js.ack_count == 0) { return (STAT_NOOP);}
+	uint8_t queued = gc_get_queued_blocks();
+	if (((queued == 0) && (xio_get_rx_bufcount() == 0)) || (queued >= GCODE_QUEUE_SIZE) ||
+		((SysTickTimer.getValue() - js.ack_tick) >= JSON_ACK_HOLD_MS)) {
+		json_flush_acks();
+		return (STAT_OK);
+	}
+	return (STAT_NOOP);
+}
+
+void json_flush_acks()
+{
+	char_t buf[80];
+	char_t *str = buf;
+
+	if (js.ack_count == 0) { return;}
+	str += sprintf((char *)str, "{\"r\":{\"ack\":[%lu,%lu,%d]%s\"f\":[%d,%d,%d",
+		(unsigned long)js.ack_first, (unsigned long)js.ack_last, (int)js.ack_count,
+		(js.json_footer_depth == 0) ? "}," : ",", FOOTER_REVISION, STAT_OK, controller_get_rx_lines());
+	str += sprintf((char *)str, ",%d]}%s\n", compute_checksum(buf, str - buf), (js.json_footer_depth == 0) ? "" : "}");
+	js.ack_count = 0;
+	write((uint8_t *)buf, str - buf);
+}
+
 static stat_t _json_parser_kernal(char_t *str)
 {
 	stat_t status;
@@ -101,8 +227,7 @@ static stat_t _json_parser_kernal(char_t *str)
 	cmdObj_t *cmd = cmd_reset_list();				// get a fresh cmdObj list
 	char_t group[CMD_GROUP_LEN+1] = {""};			// group identifier - starts as NUL
 	int8_t i = CMD_BODY_LEN;
-
-	ritorno(_normalize_json_string(str, JSON_OUTPUT_STRING_MAX));	// return if error
+	char_t *start = str;
 
 	// parse the JSON command into the cmd body
 	do {
@@ -110,6 +235,7 @@ static stat_t _json_parser_kernal(char_t *str)
 		if ((status = _get_nv_pair_strict(cmd, &str, &depth)) > STAT_EAGAIN) { // erred out
 			return (status);
 		}
+		if ((str - start) > JSON_OUTPUT_STRING_MAX) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
 		// propagate the group from previous NV pair (if relevant)
 		if (group[0] != NUL) {
 			strncpy(cmd->group, group, CMD_GROUP_LEN);// copy the parent's group to this child
@@ -121,11 +247,14 @@ static stat_t _json_parser_kernal(char_t *str)
 		if ((cmd_index_is_group(cmd->index)) && (cmd_group_is_prefixed(cmd->token))) {
 			strncpy(group, cmd->token, CMD_GROUP_LEN);// record the group ID
 		}
-		if ((cmd = cmd->nx) == NULL) return (STAT_JSON_TOO_MANY_PAIRS);// Not supposed to encounter a NULL
+		if ((cmd = cmd_next(cmd)) == NULL) return (STAT_JSON_TOO_MANY_PAIRS);// Not supposed to encounter a NULL
 	} while (status != STAT_OK);					// breaks when parsing is complete
 
 	// execute the command
 	cmd = cmd_body;
+	if ((cmd_next(cmd)->objtype != TYPE_EMPTY) && (cmd_next(cmd)->depth == cmd->depth)) {
+		return (_run_batch(cmd));					// more than one top-level pair
+	}
 	if (cmd->objtype == TYPE_NULL){					// means GET the value
 		ritorno(cmd_get(cmd));						// ritorno returns w/status on any errors
 	} else {
@@ -136,33 +265,81 @@ static stat_t _json_parser_kernal(char_t *str)
 }
 
 /*
- * _normalize_json_string - normalize a JSON string in place
+ * _run_batch() - execute every top-level name/value pair in the body
+ *
+ *	{"xvm":16000,"yvm":16000,"zvm":1200} runs all three sets in order and returns 
+ *	one response with all three values. Gets and sets can be mixed. Each pair must 
+ *	be a single-valued item - groups and items flagged F_NOBATCH (those that build 
+ *	their own cmd list, like "sr") are refused before anything runs. Execution stops
+ *	at the first error, leaving the pairs before it applied.
  *
- *	Validate string size limits, remove all whitespace and convert 
- *	to lower case, with the exception of gcode comments
+ *	cmd_persist() only queues NVM writes, so the whole batch is programmed to flash 
+ *	together once it's done - see persistence.cpp.
  */
 
-static stat_t _normalize_json_string(char_t *str, uint16_t size)
+static stat_t _run_batch(cmdObj_t *cmd)
 {
-	char_t *wr;								// write pointer
-	uint8_t in_comment = false;
-
-	if (strlen(str) > size) return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
-
-	for (wr = str; *str != NUL; str++) {
-		if (!in_comment) {					// normal processing
-			if (*str == '(') in_comment = true;
-			if ((*str <= ' ') || (*str == DEL)) continue; // toss ctrls, WS & DEL
-			*wr++ = tolower(*str);
-		} else {							// Gcode comment processing	
-			if (*str == ')') in_comment = false;
-			*wr++ = *str;
+	cmdObj_t *first = cmd;
+
+	for (; (cmd != NULL) && (cmd->objtype != TYPE_EMPTY); cmd = cmd_next(cmd)) {
+		if ((cmd->depth != first->depth) || (cmd_index_is_single(cmd->index) == false) ||
+			(GET_TABLE_BYTE(flags) & F_NOBATCH)) {
+			return (STAT_INPUT_VALUE_UNSUPPORTED);
+		}
+	}
+	for (cmd = first; (cmd != NULL) && (cmd->objtype != TYPE_EMPTY); cmd = cmd_next(cmd)) {
+		if (cmd->objtype == TYPE_NULL) {
+			ritorno(cmd_get(cmd));
+		} else {
+			ritorno(cmd_set(cmd));
+			cmd_persist(cmd);
 		}
 	}
-	*wr = NUL;
 	return (STAT_OK);
 }
 
+/*
+ * _get_json_char() - skip whitespace and return the next character in lower case
+ *
+ *	Controls, whitespace and DEL are tossed as they are encountered so the 
+ *	input string no longer needs a separate normalization pass. The pointer 
+ *	is left on the returned character - it is not consumed.
+ */
+
+static char_t _get_json_char(char_t **pstr)
+{
+	while ((**pstr != NUL) && ((**pstr <= ' ') || (**pstr == DEL))) { (*pstr)++;}
+	return (tolower(**pstr));
+}
+
+/*
+ * _is_json_word()	 - TRUE if the string starts with null, true or false (or n, t, f) as a whole word
+ * _is_bare_string() - TRUE if a string value can be sent without quotes in relaxed mode
+ */
+
+static uint8_t _is_json_word(const char_t *str)
+{
+	static const char *const words[] = { "null", "true", "false", "n", "t", "f" };
+
+	for (uint8_t i=0; i<6; i++) {
+		uint8_t len = strlen(words[i]);
+		if ((strncasecmp((const char *)str, words[i], len) == 0) && (isalnum(str[len]) == false)) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+static uint8_t _is_bare_string(const char_t *str)
+{
+	if ((*str == NUL) || (isdigit(*str)) || (*str == '-') || (*str == '.')) { return (false);}
+	if (_is_json_word(str) == true) { return (false);}
+	for (; *str != NUL; str++) {
+		if ((*str <= ' ') || (*str == DEL) || (strchr("\"{}[],:", *str) != NULL)) { return (false);}
+	}
+	return (true);
+}
+
 /*
  * _get_nv_pair_strict() - get the next name-value pair w/strict JSON rules
  *
@@ -176,7 +353,9 @@ static stat_t _normalize_json_string(char_t *str, uint16_t size)
  *	If this were to be extended to track multiple parents or more than two
  *	levels deep it would have to track closing curlies - which it does not.
  *
- *	ASSUMES INPUT STRING HAS FIRST BEEN NORMALIZED BY _normalize_json_string()
+ *	Works directly on the raw input string in a single pass. Whitespace is 
+ *	skipped and names and values are lower cased as they are scanned. String 
+ *	values are compacted in place the same way, except for Gcode comments.
  *
  *	If a group prefix is passed in it will be pre-pended to any name parsed
  *	to form a token string. For example, if "x" is provided as a group and 
@@ -186,59 +365,118 @@ static stat_t _normalize_json_string(char_t *str, uint16_t size)
 static stat_t _get_nv_pair_strict(cmdObj_t *cmd, char_t **pstr, int8_t *depth)
 {
 	char_t *tmp;
+	char_t *wr;									// write pointer for in-place string compaction
 	char_t terminators[] = {"},"};
+	uint8_t in_comment = false;
+	uint8_t i = 0;
+	char_t c;
+
+	uint8_t relaxed = (cfg.comm_mode == JSON_MODE_RELAXED);
 
 	cmd_reset_obj(cmd);							// wipes the object and sets the depth
 
 	// --- Process name part ---
-	// find leading and trailing name quotes and set pointers.
-	if ((*pstr = strchr(*pstr, '\"')) == NULL) { return (STAT_JSON_SYNTAX_ERROR);}
-	if ((tmp = strchr(++(*pstr), '\"')) == NULL) { return (STAT_JSON_SYNTAX_ERROR);}
-	*tmp = NUL;
-	strncpy(cmd->token, *pstr, CMD_TOKEN_LEN);	// copy the string to the token
+	// find the leading name quote and copy the name to the token up to the trailing quote
+	// in relaxed mode a name without quotes is copied up to the colon
+	if (relaxed == true) {
+		while ((**pstr == '{') || (**pstr == '}') || (**pstr == ',') || ((**pstr != NUL) && (**pstr <= ' '))) { (*pstr)++;}
+	}
+	if ((relaxed == true) && (**pstr != '\"')) {
+		for (; **pstr != ':'; (*pstr)++) {
+			if ((**pstr == NUL) || (**pstr == ',') || (**pstr == '}')) { return (STAT_JSON_SYNTAX_ERROR);}
+			if ((**pstr <= ' ') || (**pstr == DEL)) continue;	// toss ctrls, WS & DEL
+			if (i < CMD_TOKEN_LEN) { cmd->token[i++] = tolower(**pstr);}
+		}
+	} else {
+		if ((*pstr = strchr(*pstr, '\"')) == NULL) { return (STAT_JSON_SYNTAX_ERROR);}
+		for ((*pstr)++; **pstr != '\"'; (*pstr)++) {
+			if (**pstr == NUL) { return (STAT_JSON_SYNTAX_ERROR);}
+			if ((**pstr <= ' ') || (**pstr == DEL)) continue;	// toss ctrls, WS & DEL
+			if (i < CMD_TOKEN_LEN) { cmd->token[i++] = tolower(**pstr);}
+		}
+		(*pstr)++;								// past the trailing quote
+	}
+	cmd->token[i] = NUL;
 
 	// --- Process value part ---  (organized from most to least frequently encountered)
-	*pstr = ++tmp;
-	if ((*pstr = strchr(*pstr, ':')) == NULL) return (STAT_JSON_SYNTAX_ERROR);
+	if ((*pstr = strchr(*pstr, ':')) == NULL) return (STAT_JSON_SYNTAX_ERROR);
 	(*pstr)++;									// advance to start of value field
+	c = _get_json_char(pstr);
+
+	// bare strings (relaxed mode) - compacted in place up to the comma or curly that ends them
+	if ((relaxed == true) && (strchr("{[\"-", c) == NULL) && (isdigit(c) == false) &&
+		(_is_json_word(*pstr) == false)) {
+		for (wr = tmp = *pstr; (in_comment == true) || ((*tmp != ',') && (*tmp != '}')); tmp++) {
+			if (*tmp == NUL) { return (STAT_JSON_SYNTAX_ERROR);} // no end to the object
+			if (!in_comment) {
+				if (*tmp == '(') in_comment = true;
+				if ((*tmp <= ' ') || (*tmp == DEL)) continue; // toss ctrls, WS & DEL
+				*wr++ = tolower(*tmp);
+			} else {
+				if (*tmp == ')') in_comment = false;
+				*wr++ = *tmp;
+			}
+		}
+		char_t terminator = *tmp;
+		*wr = NUL;								// may overwrite the terminator - put back below
+		cmd->objtype = TYPE_STRING;
+		stat_t status = cmd_copy_string(cmd, *pstr);
+		*tmp = terminator;
+		*pstr = tmp;
+		ritorno(status);
 
 	// nulls (gets)
-	if ((**pstr == 'n') || ((**pstr == '\"') && (*(*pstr+1) == '\"'))) { // process null value
+	} else if (c == 'n') {						// process null value
 		cmd->objtype = TYPE_NULL;
 		cmd->value = TYPE_NULL;
 	
-	// numbers
-	} else if (isdigit(**pstr) || (**pstr == '-')) {// value is a number
-		cmd->value = strtof(*pstr, &tmp);			// tmp is the end pointer
-		if(tmp == *pstr) { return (STAT_BAD_NUMBER_FORMAT);}
-		cmd->objtype = TYPE_FLOAT;
+	// numbers - an integer is typed as such, so it echoes without decimals if no setter retypes it
+	} else if (isdigit(c) || (c == '-')) {		// value is a number
+		uint8_t type = read_number(*pstr, &tmp, &cmd->value);	// tmp is the end pointer
+		if (type == NUMBER_NONE) { return (STAT_BAD_NUMBER_FORMAT);}
+		cmd->objtype = (type == NUMBER_INTEGER) ? TYPE_INTEGER : TYPE_FLOAT;
+		*pstr = tmp;
 
 	// object parent
-	} else if (**pstr == '{') { 
+	} else if (c == '{') { 
 		cmd->objtype = TYPE_PARENT;
 //		*depth += 1;							// cmd_reset_obj() sets the next object's level so this is redundant
 		(*pstr)++;
 		return(STAT_EAGAIN);					// signal that there is more to parse
 
-	// strings
-	} else if (**pstr == '\"') { 				// value is a string
-		(*pstr)++;
-		cmd->objtype = TYPE_STRING;
-		if ((tmp = strchr(*pstr, '\"')) == NULL) { return (STAT_JSON_SYNTAX_ERROR);} // find the end of the string
-		*tmp = NUL;
-		ritorno(cmd_copy_string(cmd, *pstr));
+	// strings - compact in place up to the closing quote. An empty string is a null (get)
+	} else if (c == '\"') {
+		for (wr = tmp = ++(*pstr); *tmp != '\"'; tmp++) {
+			if (*tmp == NUL) { return (STAT_JSON_SYNTAX_ERROR);} // no end to the string
+			if (!in_comment) {					// normal processing
+				if (*tmp == '(') in_comment = true;
+				if ((*tmp <= ' ') || (*tmp == DEL)) continue; // toss ctrls, WS & DEL
+				*wr++ = tolower(*tmp);
+			} else {							// Gcode comment processing	
+				if (*tmp == ')') in_comment = false;
+				*wr++ = *tmp;
+			}
+		}
+		*wr = NUL;								// may overwrite the closing quote - tmp is already past it
+		if (wr == *pstr) {
+			cmd->objtype = TYPE_NULL;
+			cmd->value = TYPE_NULL;
+		} else {
+			cmd->objtype = TYPE_STRING;
+			ritorno(cmd_copy_string(cmd, *pstr));
+		}
 		*pstr = ++tmp;
 
 	// boolean true/false
-	} else if (**pstr == 't') { 
+	} else if (c == 't') { 
 		cmd->objtype = TYPE_BOOL;
 		cmd->value = true;
-	} else if (**pstr == 'f') { 
+	} else if (c == 'f') { 
 		cmd->objtype = TYPE_BOOL;
 		cmd->value = false;
 
 	// arrays
-	} else if (**pstr == '[') {
+	} else if (c == '[') {
 		cmd->objtype = TYPE_ARRAY;
 		ritorno(cmd_copy_string(cmd, *pstr));	// copy array into string for error displays
 		return (STAT_INPUT_VALUE_UNSUPPORTED);	// return error as the parser doesn't do input arrays yet
@@ -254,7 +492,7 @@ static stat_t _get_nv_pair_strict(cmdObj_t *cmd, char_t **pstr, int8_t *depth)
 		*depth -= 1;							// pop up a nesting level
 		(*pstr)++;								// advance to comma or whatever follows
 	}
-	if (**pstr == ',') { return (STAT_EAGAIN);}	// signal that there is more to parse
+	if (_get_json_char(pstr) == ',') { return (STAT_EAGAIN);}	// signal that there is more to parse
 
 	(*pstr)++;
 	return (STAT_OK);							// signal that parsing is complete
@@ -278,7 +516,7 @@ static stat_t _get_nv_pair_strict(cmdObj_t *cmd, char_t **pstr, int8_t *depth)
  *	  - Assume there can be multiple, independent, non-contiguous JSON objects at a 
  *		given depth value. These are processed correctly - e.g. 0,1,1,0,1,1,0,1,1
  *
- *	  - The list must have a terminating cmdObj where cmd->nx == NULL. 
+ *	  - The list must have a terminating cmdObj where cmd->nx == false. 
  *		The terminating object may or may not have data (empty or not empty).
  *
  *	Returns:
@@ -290,14 +528,26 @@ static stat_t _get_nv_pair_strict(cmdObj_t *cmd, char_t **pstr, int8_t *depth)
  *	  - If a JSON object is empty represent it as {}
  *	    --- OR ---
  *	  - If a JSON object is empty omit the object altogether (no curlies)
+ *
+ *	_serialize() is the serializer. With footer set, the string is checksummed as it
+ *	is written, and the last object - the footer array - has the checksum of all that
+ *	comes before its last comma written as its last element.
  */
 
 #define BUFFER_MARGIN 8			// safety margin to avoid buffer overruns during footer checksum generation
 
 uint16_t json_serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size)
 {
+	return (_serialize(cmd, out_buf, size, false));
+}
+
+static int16_t _serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size, uint8_t footer)
+{
+	uint8_t relaxed = (cfg.comm_mode == JSON_MODE_RELAXED);
 	char_t *str = out_buf;
 	char_t *str_max = out_buf + size - BUFFER_MARGIN;
+	char_t *hashed = out_buf;					// checksummed up to here
+	uint32_t hash = 0;
 	int8_t initial_depth = cmd->depth;
 	int8_t prev_depth = 0;
 	uint8_t need_a_comma = false;
@@ -308,27 +558,32 @@ uint16_t json_serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size)
 		if (cmd->objtype != TYPE_EMPTY) {
 			if (need_a_comma) { *str++ = ',';}
 			need_a_comma = true;
-			str += sprintf((char *)str, "\"%s\":", cmd->token);
+			if (relaxed == false) { *str++ = '"';}	// write the token directly - it's always terminated
+			for (char_t *tok = cmd->token; *tok != NUL; ) { *str++ = *tok++;}
+			if (relaxed == false) { *str++ = '"';}
+			*str++ = ':';
 
 			// check for illegal float values
 			if (cmd->objtype == TYPE_FLOAT) {
-				if (isnan((double)cmd->value) || isinf((double)cmd->value)) { cmd->value = 0;}
+				if (isnan(cmd->value) || isinf(cmd->value)) { cmd->value = 0;}
 			}
 
 			// serialize output value
 			if		(cmd->objtype == TYPE_NULL)		{ str += (char_t)sprintf((char *)str, "\"\"");} // Note that that "" is NOT null.
-			else if (cmd->objtype == TYPE_INTEGER)	{
-				str += (char_t)sprintf((char *)str, "%1.0f", (double)cmd->value);
+			else if (cmd->objtype == TYPE_INTEGER)	{ str += fntoa(str, cmd->value, 0);}
+			else if ((cmd->objtype == TYPE_STRING) && (relaxed == true) && (_is_bare_string(*cmd->stringp) == true)) {
+				str += (char_t)sprintf((char *)str, "%s",(char *)*cmd->stringp);
 			}
 			else if (cmd->objtype == TYPE_STRING)	{ str += (char_t)sprintf((char *)str, "\"%s\"",(char *)*cmd->stringp);}
+			else if ((cmd->objtype == TYPE_ARRAY) && (footer == true) && (cmd->nx == false)) {
+				str += (char_t)sprintf((char *)str, "[%s", (char *)*cmd->stringp);
+				hash = compute_checksum_add(hash, hashed, str - hashed);
+				str += (char_t)sprintf((char *)str, ",%d]", (int)(hash % HASHMASK));
+			}
 			else if (cmd->objtype == TYPE_ARRAY)	{ str += (char_t)sprintf((char *)str, "[%s]",  (char *)*cmd->stringp);}
-			else if (cmd->objtype == TYPE_FLOAT) {
-				if 		(cmd->precision == 0) { str += (char_t)sprintf((char *)str, "%0.0f", (double)cmd->value);}
-				else if (cmd->precision == 1) { str += (char_t)sprintf((char *)str, "%0.1f", (double)cmd->value);}
-				else if (cmd->precision == 2) { str += (char_t)sprintf((char *)str, "%0.2f", (double)cmd->value);}
-				else if (cmd->precision == 3) { str += (char_t)sprintf((char *)str, "%0.3f", (double)cmd->value);}
-				else if (cmd->precision == 4) { str += (char_t)sprintf((char *)str, "%0.4f", (double)cmd->value);}
-				else 						  { str += (char_t)sprintf((char *)str, "%f",    (double)cmd->value);}
+			else if (cmd->objtype == TYPE_FLOAT) {	// precisions outside 0-4 print as "%f" would (6 places)
+				uint8_t precision = ((cmd->precision >= 0) && (cmd->precision <= 4)) ? cmd->precision : 6;
+				str += fntoa(str, cmd->value, precision);
 			}
 			else if (cmd->objtype == TYPE_BOOL) {
 				if (fp_FALSE(cmd->value)) { str += sprintf((char *)str, "false");}
@@ -340,7 +595,11 @@ uint16_t json_serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size)
 			}
 		}
 		if (str >= str_max) { return (-1);}		// signal buffer overrun
-		if ((cmd = cmd->nx) == NULL) { break;}	// end of the list
+		if ((cmd = cmd_next(cmd)) == NULL) { break;}	// end of the list
+		if (footer == true) {
+			hash = compute_checksum_add(hash, hashed, str - hashed);
+			hashed = str;
+		}
 
 		while (cmd->depth < prev_depth--) {		// iterate the closing curlies
 			need_a_comma = true;
@@ -361,7 +620,7 @@ uint16_t json_serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size)
  *
  *	Ignores JSON verbosity settings and everything else - just serializes the list & prints
  *	Useful for reports and other simple output.
- *	Object list should be terminated by cmd->nx == NULL
+ *	Object list should be terminated by cmd->nx == false
  */
 void json_print_object(cmdObj_t *cmd)
 {
@@ -399,12 +658,15 @@ void json_print_list(stat_t status, uint8_t flags)
  *	which you may or may not want to display. This is followed by zero or more displayable objects. 
  *	Then if you want a gcode line number you add that here to the end. Finally, a footer goes 
  *	on all the (non-silent) responses.
+ *
+ *	The response is serialized once, with the footer checksum worked out as the string
+ *	is written, and handed to the TX buffer in a single write.
  */
-#define MAX_TAIL_LEN 8
 
 void json_print_response(uint8_t status)
 {
 	if (js.json_verbosity == JV_SILENT) return;			// silent responses
+	json_flush_acks();									// answer the batched lines first
 
 	// Body processing
 	cmdObj_t *cmd = cmd_body;
@@ -437,40 +699,29 @@ void json_print_response(uint8_t status)
 					cmd->objtype = TYPE_EMPTY;
 				}
 			}
-		} while ((cmd = cmd->nx) != NULL);
+		} while ((cmd = cmd_next(cmd)) != NULL);
 	}
 
 	// Footer processing
 	while(cmd->objtype != TYPE_EMPTY) {						// find a free cmdObj at end of the list...
-		if ((cmd = cmd->nx) == NULL) {						//...or hit the NULL and return w/o a footer
+		if ((cmd = cmd_next(cmd)) == NULL) {						//...or hit the NULL and return w/o a footer
 			json_serialize(cmd_header, cs.out_buf, sizeof(cs.out_buf));
 			return;
 		}
 	}
 	char_t footer_string[CMD_FOOTER_LEN];
-	sprintf((char *)footer_string, "%d,%d,%d,0", FOOTER_REVISION, status, cs.linelen);
-	cs.linelen = 0;										// reset linelen so it's only reported once
+	sprintf((char *)footer_string, "%d,%d,%d", FOOTER_REVISION, status, controller_get_rx_lines());
 
 	cmd_copy_string(cmd, footer_string);				// link string to cmd object
 //	cmd->depth = 0;										// footer 'f' is a peer to response 'r' (hard wired to 0)
 	cmd->depth = js.json_footer_depth;					// 0=footer is peer to response 'r', 1=child of response 'r'
 	cmd->objtype = TYPE_ARRAY;
 	strcpy(cmd->token, "f");							// terminate the list
-	cmd->nx = NULL;
+	cmd->nx = false;
 
-	// do all this to avoid having to serialize it twice
-	int16_t strcount = json_serialize(cmd_header, cs.out_buf, sizeof(cs.out_buf));// make JSON string w/o checksum
+	int16_t strcount = _serialize(cmd_header, cs.out_buf, sizeof(cs.out_buf), true);
 	if (strcount < 0) { return;}						// encountered an overrun during serialization
-	if (strcount > OUTPUT_BUFFER_LEN - MAX_TAIL_LEN) { return;}	// would overrun during checksum generation
-	int16_t strcount2 = strcount;
-	char tail[MAX_TAIL_LEN];
-
-	while (cs.out_buf[strcount] != '0') { strcount--; }	// find end of checksum
-	strcpy(tail, cs.out_buf + strcount + 1);			// save the json termination
-
-	while (cs.out_buf[strcount2] != ',') { strcount2--; }// find start of checksum
-	sprintf((char *)cs.out_buf + strcount2 + 1, "%d%s", compute_checksum(cs.out_buf, strcount2), tail);
-	fprintf(stderr, "%s", cs.out_buf);
+	write((uint8_t *)cs.out_buf, strcount);
 }
 
 /***********************************************************************************
@@ -516,7 +767,7 @@ stat_t json_set_jv(cmdObj_t *cmd)
  * js_print_fs()
  */
 
-static const char fmt_ej[] PROGMEM = "[ej]  enable json mode%13d [0=text,1=JSON]\n";
+static const char fmt_ej[] PROGMEM = "[ej]  enable json mode%13d [0=text,1=JSON,2=relaxed JSON]\n";
 static const char fmt_jv[] PROGMEM = "[jv]  json verbosity%15d [0=silent,1=footer,2=messages,3=configs,4=linenum,5=verbose]\n";
 static const char fmt_fs[] PROGMEM = "[fs]  footer style%17d [0=new,1=old]\n";
 
@@ -595,7 +846,7 @@ static void _test_serialize()
 	cmd = _add_parent(cmd, (char_t *)"r");
 	cmd = _add_empty(cmd);
 	cmd = _add_string(cmd, (char_t *)"f", (char_t *)"[1,0,12,1234]");	// fake out a footer
-	cmd->pv->depth = 0;
+	cmd_prev(cmd)->depth = 0;
 	json_serialize(cmd_array, cs.out_buf, sizeof(cs.out_buf));
 	_printit();
 
@@ -606,7 +857,7 @@ static void _test_serialize()
 	cmd = _add_empty(cmd);
 	cmd = _add_empty(cmd);
 	cmd = _add_string(cmd, (char_t *)"f", (char_t *)"[1,0,12,1234]");	// fake out a footer
-	cmd->pv->depth = 0;
+	cmd_prev(cmd)->depth = 0;
 	json_serialize(cmd_array, cs.out_buf, sizeof(cs.out_buf));
 	_printit();
 
@@ -641,50 +892,50 @@ static cmdObj_t * _reset_array()
 {
 	cmdObj_t *cmd = cmd_array;
 	for (uint8_t i=0; i<ARRAY_LEN; i++) {
-		if (i == 0) { cmd->pv = NULL; } 
-		else { cmd->pv = (cmd-1);}
-		cmd->nx = (cmd+1);
+		if (i == 0) { cmd->pv = false; } 
+		else { cmd->pv = true;}
+		cmd->nx = true;
 		cmd->index = 0;
 		cmd->token[0] = NUL;
 		cmd->depth = 0;
 		cmd->objtype = TYPE_EMPTY;
 		cmd++;
 	}
-	(--cmd)->nx = NULL;				// correct last element
+	(--cmd)->nx = false;				// correct last element
 	return (cmd_array);
 }
 
 static cmdObj_t * _add_parent(cmdObj_t *cmd, char_t *token)
 {
 	strncpy(cmd->token, token, CMD_TOKEN_LEN);
-	cmd->nx->depth = cmd->depth+1;
+	cmd_next(cmd)->depth = cmd->depth+1;
 	cmd->objtype = TYPE_PARENT;
-	return (cmd->nx);
+	return (cmd_next(cmd));
 }
 
 static cmdObj_t * _add_string(cmdObj_t *cmd, char_t *token, char_t *string)
 {
 	strncpy(cmd->token, token, CMD_TOKEN_LEN);
 	cmd_copy_string(cmd, string);
-	if (cmd->depth < cmd->pv->depth) { cmd->depth = cmd->pv->depth;}
+	if (cmd->depth < cmd_prev(cmd)->depth) { cmd->depth = cmd_prev(cmd)->depth;}
 	cmd->objtype = TYPE_STRING;
-	return (cmd->nx);
+	return (cmd_next(cmd));
 }
 
 static cmdObj_t * _add_integer(cmdObj_t *cmd, char_t *token, uint32_t integer)
 {
 	strncpy(cmd->token, token, CMD_TOKEN_LEN);
 	cmd->value = (float)integer;
-	if (cmd->depth < cmd->pv->depth) { cmd->depth = cmd->pv->depth;}
+	if (cmd->depth < cmd_prev(cmd)->depth) { cmd->depth = cmd_prev(cmd)->depth;}
 	cmd->objtype = TYPE_INTEGER;
-	return (cmd->nx);
+	return (cmd_next(cmd));
 }
 
 static cmdObj_t * _add_empty(cmdObj_t *cmd)
 {
-	if (cmd->depth < cmd->pv->depth) { cmd->depth = cmd->pv->depth;}
+	if (cmd->depth < cmd_prev(cmd)->depth) { cmd->depth = cmd_prev(cmd)->depth;}
 	cmd->objtype = TYPE_EMPTY;
-	return (cmd->nx);
+	return (cmd_next(cmd));
 }
 
 static cmdObj_t * _add_array(cmdObj_t *cmd, char_t *array_string)
@@ -692,7 +943,7 @@ static cmdObj_t * _add_array(cmdObj_t *cmd, char_t *array_string)
 	cmd->objtype = TYPE_ARRAY;
 //	strncpy(cmd->string, array_string, CMD_STRING_LEN);
 	cmd_copy_string(cmd, array_string);
-	return (cmd->nx);
+	return (cmd_next(cmd));
 }
 
 static void _test_parser()
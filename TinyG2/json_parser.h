@@ -38,8 +38,9 @@ extern "C"{
 // for now there is only one JSON array in use - the footer
 // if you add these make sure there are no collisions w/present or past numbers
 
-#define FOOTER_REVISION 1
+#define FOOTER_REVISION 2			// 2 = 3rd footer element is RX line credits (was line length)
 #define JSON_OUTPUT_STRING_MAX (OUTPUT_BUFFER_LEN)
+#define JSON_ACK_HOLD_MS 10			// longest a batched ack is held - see json_ack_callback()
 
 enum jsonVerbosity {
 	JV_SILENT = 0,					// no response is provided for any command
@@ -68,8 +69,14 @@ typedef struct jsSingleton {
 	uint8_t echo_json_configs;
 	uint8_t echo_json_linenum;
 	uint8_t echo_json_gcode_block;
+	uint8_t ack_coalesce;			// $ja - most Gcode lines answered by one ack (0 or 1 = one per line)
 
 	/*** runtime values (PRIVATE) ***/
+	index_t gc_index;				// cached index of the "gc" object (0 = not looked up yet)
+	uint8_t ack_count;				// Gcode lines answered by the pending ack
+	uint32_t ack_first;				// line numbers of the first and last of them
+	uint32_t ack_last;
+	uint32_t ack_tick;				// SysTick of the first of them
 
 } jsSingleton_t;
 
@@ -80,6 +87,11 @@ extern jsSingleton_t js;
 /**** Function Prototypes ****/
 
 void json_parser(char_t *str);
+void json_gcode_parser(char_t *str);
+void json_gcode_object(char_t *str);
+void json_gcode_response(stat_t status);
+stat_t json_ack_callback(void);
+void json_flush_acks(void);
 uint16_t json_serialize(cmdObj_t *cmd, char_t *out_buf, uint16_t size);
 void json_print_object(cmdObj_t *cmd);
 void json_print_response(uint8_t status);
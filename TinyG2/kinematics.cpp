@@ -30,12 +30,63 @@
 #include "canonical_machine.h"
 #include "stepper.h"
 #include "kinematics.h"
+#include "text_parser.h"
+#include "util.h"
+#include "settings.h"				// AXES_USED, MOTORS_USED
+#include "hardware.h"				// F_CPU and the DWT cycle counter
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
 
 #ifdef __cplusplus
 extern "C"{
 #endif
 
-//static void _inverse_kinematics(float travel[], float joint[], float microseconds);
+ikSingleton_t ik;
+
+static void _ik_cartesian(const float position[], float joint[]);
+static void _ik_corexy(const float position[], float joint[]);
+static void _ik_hbot(const float position[], float joint[]);
+static void _ik_delta(const float position[], float joint[]);
+static void _ik_rtcp(const float position[], float joint[]);
+static void _ik_sincos(const float degrees, float *s, float *c);
+static void _ik_set_delta_towers(void);
+static void _ik_transform_point(const float position[], float joint[]);
+static float _ik_map_offset(float x, float y);
+
+// kinematics plugins - must line up with the kinKinematics enum
+static void (*const _ik_transform[])(const float position[], float joint[]) = {
+	_ik_cartesian,
+	_ik_corexy,
+	_ik_hbot,
+	_ik_delta,
+	_ik_rtcp
+};
+typedef char _ik_transform_table_check[(sizeof(_ik_transform)/sizeof(_ik_transform[0]) == KINEMATICS_TYPES) ? 1 : -1];
+
+#define _ik_get_cycles() (HW_DWT_CYCCNT)
+#define CYCLES_PER_USEC (F_CPU / 1000000)
+
+/*
+ * ik_init() - start the cycle counter used for time budget instrumentation
+ *
+ *	Kinematics settings are loaded by config_init(), this only sets up the rest.
+ */
+
+void ik_init()
+{
+	hw_start_cycle_counter();
+	ik.max_cycles = 0;
+	ik.max_budget = 0;
+	ik.map_valid = false;
+	for (uint8_t i=0; i<2; i++) {						// A and C at 0
+		ik.rtcp_angle[i] = 0;
+		ik.rtcp_sin[i] = 0;
+		ik.rtcp_cos[i] = 1;
+	}
+	ik_set_motor_map();
+	_ik_set_delta_towers();
+	_ik_transform_point(ik.position, ik.joint);		// prime the joint cache
+}
 
 /*
  * ik_kinematics() - wrapper routine for inverse kinematics
@@ -43,56 +94,362 @@ extern "C"{
  *	Calls kinematics function(s). 
  *	Performs axis mapping & conversion of length units to steps (and deals with inhibited axes)
  *
+ *	Position and target are absolute axis positions at the start and end of the 
+ *	segment; non-linear kinematics need both and not just the difference. The 
+ *	joint position of the target is kept so the start of the next segment does 
+ *	not need to be transformed again. Any change to the position outside the 
+ *	runtime (G28.3, homing) is caught by comparing against the cached position.
+ *	The cache holds uncompensated positions; the surface map is a function of
+ *	position alone so it does not disturb the comparison.
+ *
  *	The reason steps are returned as floats (as opposed to, say, uint32_t) is to accommodate 
  *	fractional DDA steps. The DDA deals with fractional step values as fixed-point binary in 
  *	order to get the smoothest possible operation. Steps are passed to the move prep routine 
  *	as floats and converted to fixed-point binary during queue loading. See stepper.c for details.
+ *
+ *	Time budget: this function is run during the _exec() portion of the cycle and will therefore
+ *	be run once per interpolation segment. The total time for the segment load, including the
+ *	inverse kinematics transformation cannot exceed the segment time, and ideally should be no
+ *	more than 25-50% of the segment time. The worst case time and the worst case fraction of the
+ *	segment time are recorded and reported as $kt and $kb. Set $kt to 0 to restart the record.
  */
 
-void ik_kinematics(float travel[], float steps[], float microseconds)
+void ik_kinematics(const float position[], const float target[], float steps[], float microseconds)
 {
+	uint32_t start = _ik_get_cycles();
 	float joint[AXES];
 
-//	_inverse_kinematics(travel, joint, microseconds);// you can insert inverse kinematics transformations here
-	memcpy(joint, travel, sizeof(float)*AXES);		 //...or just do a memcopy for cartesian machines
-
-	// Map motors to axes and convert length units to steps
-	// Most of the conversion math has already been done in during config in steps_per_unit()
-	// which takes axis travel, step angle and microsteps into account.
+	if (memcmp(position, ik.position, sizeof(ik.position)) != 0) {
+		_ik_transform_point(position, ik.joint);
+	}
+	_ik_transform_point(target, joint);
 	for (uint8_t axis=0; axis<AXES; axis++) {
-		if (cm.a[axis].axis_mode == AXIS_INHIBITED) { joint[axis] = 0;}
-		if (st.m[MOTOR_1].motor_map == axis) { steps[MOTOR_1] = joint[axis] * st.m[MOTOR_1].steps_per_unit;}
-		if (st.m[MOTOR_2].motor_map == axis) { steps[MOTOR_2] = joint[axis] * st.m[MOTOR_2].steps_per_unit;}
-		if (st.m[MOTOR_3].motor_map == axis) { steps[MOTOR_3] = joint[axis] * st.m[MOTOR_3].steps_per_unit;}
-		if (st.m[MOTOR_4].motor_map == axis) { steps[MOTOR_4] = joint[axis] * st.m[MOTOR_4].steps_per_unit;}
-		if (st.m[MOTOR_5].motor_map == axis) { steps[MOTOR_5] = joint[axis] * st.m[MOTOR_5].steps_per_unit;}
-		if (st.m[MOTOR_6].motor_map == axis) { steps[MOTOR_6] = joint[axis] * st.m[MOTOR_6].steps_per_unit;}
-	}	
-	// the above is a loop unrolled version of this:
-	//	for (uint8_t motor=0; motor<MOTORS; motor++) {
-	//		if (st.m[motor].motor_map == axis) { steps[motor] = joint[axis] * st.m[motor].steps_per_unit;}
-	//	}
+		ik.position[axis] = target[axis];
+		if (AXIS_USED(axis) == false) {				// compile-time test when unrolled
+			joint[axis] = 0;
+			continue;
+		}
+		float travel = joint[axis] - ik.joint[axis];
+		ik.joint[axis] = joint[axis];
+		joint[axis] = travel;						// joint now holds the joint move
+	}
+
+	// Map motors to axes and convert length units to steps using the table compiled
+	// by ik_set_motor_map(). Inhibited and unmapped axes have 0 steps per unit.
+	// Motors not in MOTORS_USED are always 0.
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		steps[motor] = MOTOR_USED(motor) ? joint[ik.motor_axis[motor]] * ik.steps_per_unit[motor] : 0;
+	}
+
+	uint32_t cycles = _ik_get_cycles() - start;
+	if (cycles > ik.max_cycles) { ik.max_cycles = cycles;}
+	if (microseconds > EPSILON) {
+		float budget = (100 * (float)cycles) / (microseconds * CYCLES_PER_USEC);
+		if (budget > ik.max_budget) { ik.max_budget = budget;}
+	}
+}
+
+/*
+ * _ik_transform_point() - apply the surface map if it is in use, then the kinematics
+ * _ik_map_offset()      - interpolated map height at X,Y relative to the first point
+ * ik_set_map_valid()    - mark the map filled (or not) and precompute the cell lookup
+ */
+
+static void _ik_transform_point(const float position[], float joint[])
+{
+	if ((ik.map_enable == false) || (ik.map_valid == false)) {
+		_ik_transform[ik.kinematics](position, joint);
+		return;
+	}
+	float compensated[AXES];
+	memcpy(compensated, position, sizeof(compensated));
+	compensated[AXIS_Z] += _ik_map_offset(position[AXIS_X], position[AXIS_Y]);
+	_ik_transform[ik.kinematics](compensated, joint);
+}
+
+static float _ik_map_offset(float x, float y)
+{
+	float fx = (x - ik.map_x) * ik.map_inv_dx;		// position in grid cells
+	float fy = (y - ik.map_y) * ik.map_inv_dy;
+	fx = min(max(fx, 0), (float)(ik.map_cols - 1));	// hold to the edge outside the grid
+	fy = min(max(fy, 0), (float)(ik.map_rows - 1));
+	uint8_t i = min((uint8_t)fx, ik.map_cols - 2);	// cell, so the far edge uses the last one
+	uint8_t j = min((uint8_t)fy, ik.map_rows - 2);
+	fx -= i;
+	fy -= j;
+
+	const float *z = &ik.map_z[j * ik.map_cols + i];
+	float z0 = z[0] + (z[1] - z[0]) * fx;
+	float z1 = z[ik.map_cols] + (z[ik.map_cols + 1] - z[ik.map_cols]) * fx;
+	return (z0 + (z1 - z0) * fy - ik.map_z[0]);
+}
+
+void ik_set_map_valid(uint8_t valid)
+{
+	if (valid == true) {
+		ik.map_inv_dx = 1 / ik.map_dx;
+		ik.map_inv_dy = 1 / ik.map_dy;
+	}
+	ik.map_valid = valid;
+}
+
+/*
+ * ik_set_motor_map() - compile the motor to axis map used by ik_kinematics()
+ *
+ *	Must be called whenever a motor map, steps per unit or axis mode changes. 
+ *	Most of the conversion math has already been done during config in steps_per_unit()
+ *	which takes axis travel, step angle and microsteps into account. The soft limit
+ *	envelope is in steps, so it is recomputed here as well.
+ */
+
+void ik_set_motor_map()
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		uint8_t axis = st.m[motor].motor_map;
+		if ((axis >= AXES) || (cm.a[axis].axis_mode == AXIS_INHIBITED)) {
+			ik.motor_axis[motor] = 0;				// any valid joint - it is multiplied by 0
+			ik.steps_per_unit[motor] = 0;
+		} else {
+			ik.motor_axis[motor] = axis;
+			ik.steps_per_unit[motor] = st.m[motor].steps_per_unit;
+		}
+	}
+	cm_set_soft_limits();
+}
+
+/*
+ * _ik_cartesian() - joints are the axes
+ * _ik_corexy()    - A = X+Y, B = X-Y on the X and Y joints
+ * _ik_hbot()	   - same transform as CoreXY; only the belt routing differs
+ */
+
+static void _ik_cartesian(const float position[], float joint[])
+{
+	memcpy(joint, position, sizeof(float)*AXES);
+}
+
+static void _ik_corexy(const float position[], float joint[])
+{
+	memcpy(joint, position, sizeof(float)*AXES);
+	joint[AXIS_X] = position[AXIS_X] + position[AXIS_Y];
+	joint[AXIS_Y] = position[AXIS_X] - position[AXIS_Y];
+}
+
+static void _ik_hbot(const float position[], float joint[]) { _ik_corexy(position, joint);}
+
+/*
+ * _ik_delta() - linear delta
+ *
+ *	Each tower carriage sits at Z plus the height of its diagonal rod over the 
+ *	effector. A position outside the reachable area would take the square root 
+ *	of a negative number; the rod is held horizontal instead so the steppers 
+ *	are never handed a NaN. Soft limits are the place to keep moves in range.
+ */
+
+static void _ik_delta(const float position[], float joint[])
+{
+	float rod_sq = square(ik.delta_diagonal_rod);
+
+	memcpy(joint, position, sizeof(float)*AXES);
+	for (uint8_t i=0; i<3; i++) {
+		float height_sq = rod_sq - square(ik.tower_x[i] - position[AXIS_X]) - square(ik.tower_y[i] - position[AXIS_Y]);
+		joint[AXIS_X+i] = position[AXIS_Z] + ((height_sq > 0) ? sqrtf(height_sq) : 0);
+	}
+}
+
+static void _ik_set_delta_towers()
+{
+	static const float tower_angle[] = { 210, 330, 90 };	// degrees
+
+	for (uint8_t i=0; i<3; i++) {
+		ik.tower_x[i] = ik.delta_radius * cosf(tower_angle[i] * M_PI_F / 180);
+		ik.tower_y[i] = ik.delta_radius * sinf(tower_angle[i] * M_PI_F / 180);
+	}
 }
 
 /*
- * _inverse_kinematics() - inverse kinematics - example is for a cartesian machine
+ * _ik_rtcp() - table-tilting 5-axis tool center point
  *
- *	You can glue in inverse kinematics here, but be aware of time budget constrants.
- *	This function is run during the _exec() portion of the cycle and will therefore
- *	be run once per interpolation segment. The total time for the segment load, 
- *	including the inverse kinematics transformation cannot exceed the segment time, 
- *	and ideally should be no more than 25-50% of the segment time. Currently segments 
- *	run avery 5 ms, but this might be lowered. To profile this time look at the 
- *	time it takes to complete the mp_exec_move() function.
+ *	The tool tip, relative to the pivot, is turned by C about Z and then tilted
+ *	by A about X, as the table carries it. The sines and cosines are kept for the
+ *	last A and C, so only segments that turn the table pay for them.
  */
+
+static void _ik_rtcp(const float position[], float joint[])
+{
+	static const uint8_t rotary[] = { AXIS_A, AXIS_C };
+
+	memcpy(joint, position, sizeof(float)*AXES);
+	for (uint8_t i=0; i<2; i++) {
+		if (position[rotary[i]] != ik.rtcp_angle[i]) {
+			ik.rtcp_angle[i] = position[rotary[i]];
+			_ik_sincos(ik.rtcp_angle[i], &ik.rtcp_sin[i], &ik.rtcp_cos[i]);
+		}
+	}
+	float dx = position[AXIS_X] - ik.pivot[0];
+	float dy = position[AXIS_Y] - ik.pivot[1];
+	float dz = position[AXIS_Z] - ik.pivot[2];
+
+	float x = ik.rtcp_cos[1] * dx - ik.rtcp_sin[1] * dy;	// C about Z
+	float y = ik.rtcp_sin[1] * dx + ik.rtcp_cos[1] * dy;
+	joint[AXIS_X] = ik.pivot[0] + x;						// A about X
+	joint[AXIS_Y] = ik.pivot[1] + ik.rtcp_cos[0] * y - ik.rtcp_sin[0] * dz;
+	joint[AXIS_Z] = ik.pivot[2] + ik.rtcp_sin[0] * y + ik.rtcp_cos[0] * dz;
+}
+
 /*
-static void _inverse_kinematics(float travel[], float joint[], float microseconds)
+ * _ik_sincos() - sine and cosine of an angle in degrees
+ *
+ *	The angle is reduced to within 45 degrees of a quadrant and the series are
+ *	taken to x^7 and x^8, good to 3e-7 - under 0.1um at 300mm from the pivot.
+ *	That is a few dozen multiplies, against two soft-float libm calls of several
+ *	hundred cycles each.
+ */
+
+static void _ik_sincos(const float degrees, float *s, float *c)
 {
-	for (uint8_t i=0; i<AXES; i++) {
-		joint[i] = travel[i];
-	}	
+	float quadrant = floorf(degrees / 90 + (float)0.5);
+	float x = (degrees - quadrant * 90) * (M_PI_F / 180);
+	float x2 = x * x;
+	float sx = x * (1 - x2/6 * (1 - x2/20 * (1 - x2/42)));
+	float cx = 1 - x2/2 * (1 - x2/12 * (1 - x2/30 * (1 - x2/56)));
+
+	switch ((int32_t)quadrant & 3) {
+		case 0: { *s = sx;  *c = cx;  break;}
+		case 1: { *s = cx;  *c = -sx; break;}
+		case 2: { *s = -sx; *c = -cx; break;}
+		default:{ *s = -cx; *c = sx;  break;}
+	}
 }
-*/
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * ik_set_kn() - select kinematics
+ * ik_set_kd() - set a delta dimension or the RTCP pivot
+ *
+ *	Both force the next segment to re-transform its start position.
+ */
+
+stat_t ik_set_kn(cmdObj_t *cmd)
+{
+	if (cmd->value >= KINEMATICS_TYPES) return (STAT_INPUT_VALUE_UNSUPPORTED);
+	set_ui8(cmd);
+	_ik_transform_point(ik.position, ik.joint);
+	return (STAT_OK);
+}
+
+stat_t ik_set_kd(cmdObj_t *cmd)
+{
+	set_flu(cmd);
+	_ik_set_delta_towers();
+	_ik_transform_point(ik.position, ik.joint);
+	return (STAT_OK);
+}
+
+/*
+ * ik_get_kt() - get worst case kinematics time in microseconds
+ * ik_get_kb() - get worst case kinematics time as a percentage of segment time
+ * ik_set_kt() - any value restarts both records
+ */
+
+stat_t ik_get_kt(cmdObj_t *cmd)
+{
+	cmd->value = (float)ik.max_cycles / CYCLES_PER_USEC;
+	cmd->precision = (int8_t)GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
+}
+
+stat_t ik_get_kb(cmdObj_t *cmd)
+{
+	cmd->value = ik.max_budget;
+	cmd->precision = (int8_t)GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
+}
+
+stat_t ik_set_kt(cmdObj_t *cmd)
+{
+	ik.max_cycles = 0;
+	ik.max_budget = 0;
+	return (STAT_OK);
+}
+
+/*
+ * ik_set_smf() - set a surface map origin or spacing; invalidates the map
+ * ik_set_smn() - set a surface map point count (2 to the grid limit); invalidates the map
+ */
+
+stat_t ik_set_smf(cmdObj_t *cmd)
+{
+	set_flu(cmd);
+	ik_set_map_valid(false);
+	return (STAT_OK);
+}
+
+stat_t ik_set_smn(cmdObj_t *cmd)
+{
+	if ((cmd->value < 2) || (cmd->value > min(SM_MAX_COLS, SM_MAX_ROWS))) {
+		return (STAT_INPUT_VALUE_UNSUPPORTED);
+	}
+	set_ui8(cmd);
+	ik_set_map_valid(false);
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char msg_units0[] PROGMEM = " in";	// used by generic print functions
+static const char msg_units1[] PROGMEM = " mm";
+static const char msg_units2[] PROGMEM = " deg";
+static const char *const msg_units[] PROGMEM = { msg_units0, msg_units1, msg_units2 };
+
+static const char fmt_kn[] PROGMEM = "[kn]  kinematics%21d [0=cartesian,1=CoreXY,2=H-bot,3=delta,4=RTCP]\n";
+static const char fmt_kdl[] PROGMEM = "[kdl] delta diagonal rod%15.3f%s\n";
+static const char fmt_kdr[] PROGMEM = "[kdr] delta radius%21.3f%s\n";
+static const char fmt_kpx[] PROGMEM = "[kpx] RTCP pivot x%21.3f%s\n";
+static const char fmt_kpy[] PROGMEM = "[kpy] RTCP pivot y%21.3f%s\n";
+static const char fmt_kpz[] PROGMEM = "[kpz] RTCP pivot z%21.3f%s\n";
+static const char fmt_kt[] PROGMEM = "[kt]  kinematics worst case time%8.1f uSec\n";
+static const char fmt_kb[] PROGMEM = "[kb]  kinematics worst case budget%6.1f%% of segment\n";
+static const char fmt_sme[] PROGMEM = "[sme] surface map enable%15d [0=off,1=on]\n";
+static const char fmt_smx[] PROGMEM = "[smx] surface map origin x%13.3f%s\n";
+static const char fmt_smy[] PROGMEM = "[smy] surface map origin y%13.3f%s\n";
+static const char fmt_smi[] PROGMEM = "[smi] surface map spacing x%12.3f%s\n";
+static const char fmt_smj[] PROGMEM = "[smj] surface map spacing y%12.3f%s\n";
+static const char fmt_smc[] PROGMEM = "[smc] surface map columns%14d points\n";
+static const char fmt_smr[] PROGMEM = "[smr] surface map rows%17d points\n";
+static const char fmt_smz[] PROGMEM = "[smz] surface map clearance z%10.3f%s\n";
+static const char fmt_smap[] PROGMEM = "Surface map:%27d [0=not mapped,1=mapped]\n";
+
+void ik_print_kn(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_kn);}
+void ik_print_kdl(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_kdl, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_kdr(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_kdr, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_kpx(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_kpx, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_kpy(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_kpy, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_kpz(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_kpz, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_kt(cmdObj_t *cmd) { text_print_flt(cmd, fmt_kt);}
+void ik_print_kb(cmdObj_t *cmd) { text_print_flt(cmd, fmt_kb);}
+void ik_print_sme(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sme);}
+void ik_print_smx(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_smx, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_smy(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_smy, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_smi(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_smi, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_smj(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_smj, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_smc(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_smc);}
+void ik_print_smr(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_smr);}
+void ik_print_smz(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_smz, GET_UNITS(ACTIVE_MODEL));}
+void ik_print_smap(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_smap);}
+
+#endif // __TEXT_MODE
 
 //############## UNIT TESTS ################
 
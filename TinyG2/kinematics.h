@@ -32,11 +32,146 @@
 extern "C"{
 #endif
 
+/*
+ * Kinematics plugins
+ *
+ *	The machine kinematics are selected by $kn. Each plugin converts an absolute
+ *	position in axis space (mm or degrees) to absolute joint positions for the
+ *	same axes. Joint moves are then mapped to motors and converted to steps.
+ *	The linear delta plugin moves the X, Y and Z towers; A, B and C pass through.
+ *	To add a plugin add a kinKinematics value and an entry in _ik_transform[].
+ *
+ * RTCP (rotary tool center point)
+ *
+ *	For a table-tilting 5-axis machine - a C rotary table carried on an A trunnion.
+ *	X, Y and Z are the tool tip in table coordinates, as they are with A and C at 0,
+ *	and the joints are the machine X, Y and Z that put the tool on that point with
+ *	the table turned. The host posts tool tip positions and the runtime works out
+ *	the compensation every segment, so a rotary move is interpolated along the
+ *	part rather than straight between the compensated end points. A and C are
+ *	degrees, positive by the right hand rule about +X and +Z - set the motor
+ *	polarity to match. The C axis must cross the A axis: $kpx, $kpy, $kpz is the
+ *	machine position of that point. A, B and C pass through to their motors.
+ *
+ * Surface map
+ *
+ *	A grid of Z heights probed by the mapping cycle ({"smap":1}, see cycle_probing.cpp)
+ *	can be applied ahead of the kinematics. With {"sme":1} and a valid map every
+ *	position handed to ik_kinematics() has the map height at its X,Y added to Z,
+ *	bilinearly interpolated and relative to the first grid point - set Z zero there.
+ *	Positions outside the grid use the nearest edge. The grid is in machine
+ *	coordinates: smc x smr points from smx,smy spaced smi,smj apart, serpentine
+ *	probed from the origin. Changing the grid invalidates the map, and the map is
+ *	not kept across resets. The first move after the compensation changes takes up
+ *	the difference at its start, so enable it at the origin or with the tool clear.
+ */
+
+#define SM_MAX_COLS				16		// surface map grid limits - 4 bytes per point
+#define SM_MAX_ROWS				16
+
+enum kinKinematics {
+	KINEMATICS_CARTESIAN = 0,		// joints are the axes
+	KINEMATICS_COREXY,				// two motors on a crossed belt drive X and Y
+	KINEMATICS_HBOT,				// single belt H-bot
+	KINEMATICS_DELTA,				// linear delta with towers at 210, 330 and 90 degrees
+	KINEMATICS_RTCP,				// table-tilting 5-axis: tool tip on a C table on an A trunnion
+	KINEMATICS_TYPES				// must be last
+};
+
+typedef struct ikSingleton {
+	uint8_t kinematics;				// selected kinematics - see kinKinematics
+	float delta_diagonal_rod;		// length of the delta diagonal rods
+	float delta_radius;				// horizontal tower to effector distance (at center)
+	float tower_x[3];				// delta tower locations computed from delta_radius
+	float tower_y[3];
+	float pivot[3];					// machine XYZ where the C axis crosses the A axis - $kpx, $kpy, $kpz
+	float rtcp_angle[2];			// last A and C transformed by RTCP...
+	float rtcp_sin[2];				// ...and their sines and cosines
+	float rtcp_cos[2];
+
+	int8_t motor_axis[MOTORS];		// axis each motor is mapped to - compiled from motor_map
+	float steps_per_unit[MOTORS];	// motor steps per unit - 0 if the axis is unmapped or inhibited
+
+	float position[AXES];			// last axis position transformed...
+	float joint[AXES];				// ...and its joint position
+
+	uint8_t map_enable;				// apply the surface map - $sme
+	uint8_t map_valid;				// TRUE once the mapping cycle has filled map_z[]
+	uint8_t map_cols;				// grid points in X - $smc
+	uint8_t map_rows;				// grid points in Y - $smr
+	float map_x;					// machine position of the first grid point - $smx, $smy
+	float map_y;
+	float map_dx;					// grid spacing - $smi, $smj
+	float map_dy;
+	float map_clearance;			// machine Z for moves between points while mapping - $smz
+	float map_inv_dx;				// reciprocal spacings for the cell lookup
+	float map_inv_dy;
+	float map_z[SM_MAX_COLS * SM_MAX_ROWS];	// probed Z heights, row major from the origin
+
+	uint32_t max_cycles;			// worst case ik_kinematics() time in CPU cycles
+	float max_budget;				// worst case ik_kinematics() time as % of segment time
+} ikSingleton_t;
+
+extern ikSingleton_t ik;
+
 /*
  * Global Scope Functions
  */
 
-void ik_kinematics(float travel[], float steps[], float microseconds);
+void ik_init(void);
+void ik_set_motor_map(void);
+void ik_kinematics(const float position[], const float target[], float steps[], float microseconds) HOT_PATH;
+void ik_set_map_valid(uint8_t valid);
+
+stat_t ik_set_kn(cmdObj_t *cmd);
+stat_t ik_set_kd(cmdObj_t *cmd);
+stat_t ik_get_kt(cmdObj_t *cmd);
+stat_t ik_get_kb(cmdObj_t *cmd);
+stat_t ik_set_kt(cmdObj_t *cmd);
+stat_t ik_set_smf(cmdObj_t *cmd);
+stat_t ik_set_smn(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+
+	void ik_print_kn(cmdObj_t *cmd);
+	void ik_print_kdl(cmdObj_t *cmd);
+	void ik_print_kdr(cmdObj_t *cmd);
+	void ik_print_kpx(cmdObj_t *cmd);
+	void ik_print_kpy(cmdObj_t *cmd);
+	void ik_print_kpz(cmdObj_t *cmd);
+	void ik_print_kt(cmdObj_t *cmd);
+	void ik_print_kb(cmdObj_t *cmd);
+	void ik_print_sme(cmdObj_t *cmd);
+	void ik_print_smx(cmdObj_t *cmd);
+	void ik_print_smy(cmdObj_t *cmd);
+	void ik_print_smi(cmdObj_t *cmd);
+	void ik_print_smj(cmdObj_t *cmd);
+	void ik_print_smc(cmdObj_t *cmd);
+	void ik_print_smr(cmdObj_t *cmd);
+	void ik_print_smz(cmdObj_t *cmd);
+	void ik_print_smap(cmdObj_t *cmd);
+
+#else
+
+	#define ik_print_kn tx_print_stub
+	#define ik_print_kdl tx_print_stub
+	#define ik_print_kdr tx_print_stub
+	#define ik_print_kpx tx_print_stub
+	#define ik_print_kpy tx_print_stub
+	#define ik_print_kpz tx_print_stub
+	#define ik_print_kt tx_print_stub
+	#define ik_print_kb tx_print_stub
+	#define ik_print_sme tx_print_stub
+	#define ik_print_smx tx_print_stub
+	#define ik_print_smy tx_print_stub
+	#define ik_print_smi tx_print_stub
+	#define ik_print_smj tx_print_stub
+	#define ik_print_smc tx_print_stub
+	#define ik_print_smr tx_print_stub
+	#define ik_print_smz tx_print_stub
+	#define ik_print_smap tx_print_stub
+
+#endif // __TEXT_MODE
 
 //#ifdef __UNIT_TESTS
 //void ik_unit_tests(void);
@@ -47,4 +182,3 @@ void ik_kinematics(float travel[], float steps[], float microseconds);
 #endif
 
 #endif // End of include Guard: KINEMATICS_H_ONCE
-
@@ -0,0 +1,247 @@
+/*
+ * latency.cpp - firmware timestamped ping and USB throughput tests
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See latency.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "xio.h"
+#include "latency.h"
+
+#ifdef __LATENCY_TEST
+
+using Motate::SysTickTimer;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+ltSingleton_t lt;
+
+static float _usec(const uint32_t cycles) { return ((float)cycles / LT_CYCLES_PER_USEC);}
+static stat_t _ping(cmdObj_t *cmd, const float id);
+static stat_t _start_test(cmdObj_t *cmd, const uint8_t test);
+static void _count(const int16_t count);
+static void _format_result(char_t *buf);
+static void _report(const uint8_t dir);
+
+/*
+ * lt_init() - start the DWT cycle counter
+ */
+
+void lt_init()
+{
+	hw_start_cycle_counter();
+	lt.test = LT_TEST_OFF;
+}
+
+/*
+ * lt_line_received()	 - stamp a line as read_line() completes it
+ * lt_line_released()	 - stamp it as the controller releases it to run
+ * lt_response_written() - stamp the response of a ping once it is in the TX buffer
+ *
+ *	Each is a cycle counter read per line. The counter wraps every ~51 seconds at
+ *	84 MHz - the unsigned subtractions handle the wrap.
+ */
+
+void lt_line_received()
+{
+	lt.line_rx = HW_DWT_CYCCNT;
+	lt.line_ms = SysTickTimer.getValue();
+	lt.line_queue = lt.line_rx;
+}
+
+void lt_line_released() { lt.line_queue = HW_DWT_CYCCNT;}
+
+void lt_response_written()
+{
+	if (lt.ping_pending == false) { return;}
+	lt.ping_pending = false;
+	lt.ping_emit = _usec(HW_DWT_CYCCNT - lt.line_rx);
+}
+
+/*
+ * lt_sink_callback()	- drop host data off the endpoint until the test is done
+ * lt_source_callback() - send test data to the endpoint until the test is done
+ *
+ *	The sink is run from xio_rx_callback(), which leaves the endpoint alone while it
+ *	runs, and lets the tasks below it - the TX buffer in particular - carry on.
+ *	The source is run from xio_tx_callback() once the TX buffer is empty, and
+ *	returns EAGAIN until the test is done so nothing else is written meanwhile.
+ *	A test ends without a report if the host goes away.
+ */
+
+stat_t lt_sink_callback()
+{
+	if (lt.test != LT_TEST_IN) { return (STAT_NOOP);}
+	if (SerialUSB.isConnected() == false) {
+		lt.test = LT_TEST_OFF;
+		return (STAT_OK);
+	}
+	uint16_t size = (lt.remaining < LT_CHUNK_SIZE) ? lt.remaining : LT_CHUNK_SIZE;
+	_count(SerialUSB.readAvailable(lt.buf, size));
+	if (lt.remaining == 0) { _report(0);}
+	return (STAT_OK);
+}
+
+stat_t lt_source_callback()
+{
+	if (lt.test != LT_TEST_OUT) { return (STAT_NOOP);}
+	if (SerialUSB.isConnected() == false) {
+		lt.test = LT_TEST_OFF;
+		return (STAT_OK);
+	}
+	int16_t sent;
+	do {
+		uint16_t offset = lt.bytes % LT_CHUNK_SIZE;		// the buffer holds whole lines
+		uint16_t size = LT_CHUNK_SIZE - offset;
+		if (size > lt.remaining) { size = lt.remaining;}
+		sent = SerialUSB.writeAvailable(&lt.buf[offset], size);
+		_count(sent);
+	} while ((sent > 0) && (lt.remaining != 0));
+
+	if (lt.remaining != 0) { return (STAT_EAGAIN);}
+	_report(1);
+	return (STAT_OK);
+}
+
+/*
+ * _count() - count bytes moved and time them from the first byte
+ *
+ *	Called on every pass of a test, so the cycles are added up long before the
+ *	counter can wrap, however long the test runs.
+ */
+
+static void _count(const int16_t count)
+{
+	uint32_t now = HW_DWT_CYCCNT;
+	if (lt.bytes != 0) { lt.cycles += now - lt.last;}
+	lt.last = now;
+	if (count <= 0) { return;}
+	lt.bytes += count;
+	lt.remaining -= count;
+}
+
+/*
+ * _report() - end a test and send its result - always in JSON format
+ */
+
+static void _report(const uint8_t dir)
+{
+	char_t buf[64];
+
+	lt.test = LT_TEST_OFF;
+	lt.dir = dir;
+	lt.usec = (float)lt.cycles / LT_CYCLES_PER_USEC;
+	_format_result(buf);
+	printf_P(PSTR("{\"tpr\":[%s]}\n"), (char *)buf);
+}
+
+static void _format_result(char_t *buf)
+{
+	float rate = (lt.usec > 0) ? ((float)lt.bytes * 1000000 / lt.usec) : 0;
+	sprintf((char *)buf, "%d,%lu,%0.0f,%0.0f", lt.dir, (unsigned long)lt.bytes, lt.usec, rate);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * lt_get_ping() - {"ping":""} - return the timestamps of this line
+ * lt_set_ping() - {"ping":n} - the same, with n echoed as the first element
+ */
+
+stat_t lt_get_ping(cmdObj_t *cmd) { return (_ping(cmd, 0));}
+stat_t lt_set_ping(cmdObj_t *cmd) { return (_ping(cmd, cmd->value));}
+
+static stat_t _ping(cmdObj_t *cmd, const float id)
+{
+	char_t buf[80];
+	uint32_t now = HW_DWT_CYCCNT;
+
+	sprintf((char *)buf, "%0.0f,%lu,%0.1f,%0.1f,%0.1f", id, (unsigned long)lt.line_ms,
+		_usec(lt.line_queue - lt.line_rx), _usec(now - lt.line_rx), lt.ping_emit);
+	lt.ping_pending = true;
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+/*
+ * lt_set_tpi() - sink n megabytes from the host
+ * lt_set_tpo() - source n megabytes to the host
+ * lt_get_tpr() - return the last result as [dir,bytes,usec,bytes_per_sec]
+ */
+
+stat_t lt_set_tpi(cmdObj_t *cmd) { return (_start_test(cmd, LT_TEST_IN));}
+stat_t lt_set_tpo(cmdObj_t *cmd) { return (_start_test(cmd, LT_TEST_OUT));}
+
+static stat_t _start_test(cmdObj_t *cmd, const uint8_t test)
+{
+	if ((cmd->value <= 0) || (cmd->value > LT_MEGABYTES_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if ((lt.test != LT_TEST_OFF) || (cm.cycle_state != CYCLE_OFF) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	if (test == LT_TEST_OUT) {
+		for (uint16_t i=0; i<LT_CHUNK_SIZE; i++) {
+			uint8_t column = i % LT_PATTERN_LEN;
+			lt.buf[i] = (column == (LT_PATTERN_LEN-1)) ? LF : ('0' + (column % 10));
+		}
+	}
+	lt.remaining = (uint32_t)(cmd->value * 1048576);
+	lt.bytes = 0;
+	lt.cycles = 0;
+	lt.test = test;
+	return (STAT_OK);
+}
+
+stat_t lt_get_tpr(cmdObj_t *cmd)
+{
+	char_t buf[64];
+
+	_format_result(buf);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_ping[] PROGMEM = "[%s%s] %s [n,rx mSec,queue,parse,emit uSec]\n";
+static const char fmt_tpr[] PROGMEM = "[%s%s] %s [dir,bytes,uSec,bytes/sec]\n";
+
+void lt_print_ping(cmdObj_t *cmd) { fprintf_P(stderr, fmt_ping, cmd->group, cmd->token, *cmd->stringp);}
+void lt_print_tpr(cmdObj_t *cmd) { fprintf_P(stderr, fmt_tpr, cmd->group, cmd->token, *cmd->stringp);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __LATENCY_TEST
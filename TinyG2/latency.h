@@ -0,0 +1,134 @@
+/*
+ * latency.h - firmware timestamped ping and USB throughput tests
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The latency tests are enabled by __LATENCY_TEST in tinyg2.h. They split the time
+ * a command takes into the time it spends in the firmware and the time it spends
+ * on USB and in the host, and measure what SerialUSB can move in bulk:
+ *
+ *	{"ping":n}	[n,rx,queue,parse,emit] - n is echoed to match responses to pings
+ *	{"tpi":n}	sink the next n megabytes the host sends, then report
+ *	{"tpo":n}	source n megabytes to the host, then report
+ *	{"tpr":""}	the last throughput result
+ *
+ * Ping: every line read from USB is stamped with the DWT cycle counter as
+ * read_line() completes it, and again when the controller releases it to run - a
+ * line that is not Gcode waits for the Gcode queue and the planner first. A ping
+ * reports:
+ *
+ *	rx		SysTick time the line was received, in ms - to line up with host times
+ *	queue	uSec from reception to release past the Gcode queue and the planner
+ *	parse	uSec from reception to the ping being parsed and run
+ *	emit	uSec from reception to the response being in the USB TX buffer - for the
+ *			previous ping, as a response is not written yet while it is built
+ *
+ * The host's round trip less the emit time is time spent on USB and in the host.
+ *
+ * Throughput: {"tpi":n} sinks the next n * 2^20 bytes that arrive on SerialUSB -
+ * send them once the response is in. They are read straight off the endpoint and
+ * dropped, and are not scanned for !, ~ or %. {"tpo":n} sends n * 2^20 bytes of
+ * LT_PATTERN_LEN byte lines straight to the endpoint once the response has gone
+ * out - count that many bytes off the port. Both are timed from the first byte to
+ * the last and report {"tpr":[dir,bytes,usec,bytes_per_sec]}, dir 0 for in and 1
+ * for out. The machine must be idle to start a test. While a test is sending the
+ * controller runs nothing below the USB tasks, so no report can land in the data.
+ */
+
+#ifndef LATENCY_H_ONCE
+#define LATENCY_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __LATENCY_TEST
+
+#define LT_CYCLES_PER_USEC	(F_CPU/1000000)	// DWT cycle counter ticks
+#define LT_CHUNK_SIZE		512			// bytes moved per endpoint call - one HS bulk packet
+#define LT_PATTERN_LEN		64			// source data is lines of this length, LF included
+#define LT_MEGABYTES_MAX	1024		// largest test
+
+enum ltTest {							// throughput test running
+	LT_TEST_OFF = 0,
+	LT_TEST_IN,							// sinking host data
+	LT_TEST_OUT							// sourcing data to the host
+};
+
+typedef struct ltSingleton {
+	uint32_t line_ms;					// SysTick ms as the current line was received
+	uint32_t line_rx;					// cycle count as the current line was received
+	uint32_t line_queue;				// cycle count as it was released to run
+	uint8_t ping_pending;				// the line was a ping - stamp its response
+	float ping_emit;					// uSec to the response of the last ping
+
+	uint8_t test;						// ltTest - test running
+	uint8_t dir;						// direction of the last result - 0=in, 1=out
+	uint32_t remaining;					// bytes left to move
+	uint32_t bytes;						// bytes moved
+	uint32_t last;						// cycle count at the last chunk
+	uint64_t cycles;					// cycles from the first byte to the last
+	float usec;							// duration of the last result
+	uint8_t buf[LT_CHUNK_SIZE];			// source pattern or sink scratch
+} ltSingleton_t;
+
+extern ltSingleton_t lt;
+
+void lt_init(void);
+void lt_line_received(void);
+void lt_line_released(void);
+void lt_response_written(void);
+stat_t lt_sink_callback(void);
+stat_t lt_source_callback(void);
+
+stat_t lt_get_ping(cmdObj_t *cmd);
+stat_t lt_set_ping(cmdObj_t *cmd);
+stat_t lt_set_tpi(cmdObj_t *cmd);
+stat_t lt_set_tpo(cmdObj_t *cmd);
+stat_t lt_get_tpr(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void lt_print_ping(cmdObj_t *cmd);
+	void lt_print_tpr(cmdObj_t *cmd);
+#else
+	#define lt_print_ping tx_print_stub
+	#define lt_print_tpr tx_print_stub
+#endif
+
+#define LATENCY_RX() lt_line_received()
+#define LATENCY_QUEUE() lt_line_released()
+#define LATENCY_EMIT() lt_response_written()
+#define LATENCY_SINKING() (lt.test == LT_TEST_IN)
+#define LATENCY_SINK() lt_sink_callback()
+#define LATENCY_SOURCE() lt_source_callback()
+
+#else
+
+#define LATENCY_RX()
+#define LATENCY_QUEUE()
+#define LATENCY_EMIT()
+#define LATENCY_SINKING() (false)
+#define LATENCY_SINK()
+#define LATENCY_SOURCE() (STAT_NOOP)
+
+#endif // __LATENCY_TEST
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: LATENCY_H_ONCE
@@ -0,0 +1,175 @@
+/*
+ * machine_profile.cpp - stored machine profiles switched with one command
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See machine_profile.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "stepper.h"
+#include "kinematics.h"
+#include "shaper.h"
+#include "persistence.h"
+#include "machine_profile.h"
+
+#ifdef __MACHINE_PROFILES
+
+#include <stddef.h>						// offsetof()
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define MF_MAGIC 0x4D46					// "MF"
+
+mfSingleton_t mf;
+
+static union {							// profile being saved, padded out to its pages
+	mfProfile_t prof;
+	uint32_t word[MF_PROFILE_SIZE / sizeof(uint32_t)];
+} mf_page;
+
+typedef char mf_profile_size_check[(sizeof(mfProfile_t) <= MF_PROFILE_SIZE) ? 1 : -1];
+
+#define _profile_addr(n) ((const mfProfile_t *)(MF_FLASH_ADDR + (((n) - 1) * MF_PROFILE_SIZE)))
+
+static uint16_t _checksum(const mfProfile_t *prof)
+{
+	const uint16_t *w = (const uint16_t *)&prof->size;
+	uint16_t sum = 0;
+	for (uint16_t i=0; i < ((sizeof(mfProfile_t) - offsetof(mfProfile_t, size)) / sizeof(uint16_t)); i++) { sum += w[i];}
+	return (sum);
+}
+
+static uint8_t _profile_is_valid(const mfProfile_t *prof)
+{
+	if ((prof->magic != MF_MAGIC) || (prof->size != sizeof(mfProfile_t))) return (false);
+	return ((prof->checksum == _checksum(prof)) ? true : false);
+}
+
+static uint8_t _machine_is_idle()
+{
+	return (((cm.cycle_state == CYCLE_OFF) && (mp_get_runtime_busy() == false)) ? true : false);
+}
+
+/*
+ * _load_profile() - put a stored profile in force
+ *
+ *	The settings are copied with interrupts off so the exec and the loader never see
+ *	half of them. What is worked out from the settings is set up after.
+ */
+static stat_t _load_profile(const uint8_t n)
+{
+	const mfProfile_t *prof = _profile_addr(n);
+	if (_profile_is_valid(prof) == false) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+
+	__disable_irq();
+	cm.junction_acceleration = prof->junction_acceleration;
+	cm.chordal_tolerance = prof->chordal_tolerance;
+	memcpy(cm.a, prof->a, sizeof(cm.a));
+	memcpy(&st, &prof->st, sizeof(st));
+	__enable_irq();
+
+	ik_set_motor_map();							// motor map and soft limits in steps
+	st_apply_config();							// microsteps, motor power and step timing
+#ifdef __INPUT_SHAPING
+	sh_set_shapers();
+#endif
+	mf.active = n;
+	return (STAT_OK);
+}
+
+/*
+ * mf_init() - load the boot profile ($mfb), if there is one
+ *
+ *	Runs once the settings and the steppers are set up, so the profile wins over the
+ *	$ values. A boot profile that is not valid leaves the $ values in force.
+ */
+void mf_init()
+{
+	mf.active = 0;
+	if ((mf.boot == 0) || (mf.boot > MF_PROFILES)) { return;}
+	_load_profile(mf.boot);
+}
+
+/*
+ * mf_set_mfs() - save the settings in force to a profile ({"mfs":n})
+ * mf_set_mfl() - load a profile ({"mfl":n})
+ * mf_set_mfb() - set the profile loaded at reset ($mfb)
+ *
+ *	A save holds the main loop while the profile's pages are programmed.
+ */
+stat_t mf_set_mfs(cmdObj_t *cmd)
+{
+	uint8_t n = (uint8_t)cmd->value;
+	if ((cmd->value < 1) || (n > MF_PROFILES)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if (_machine_is_idle() == false) { return (STAT_COMMAND_NOT_ACCEPTED);}
+
+	for (uint16_t i=0; i < (MF_PROFILE_SIZE / sizeof(uint32_t)); i++) { mf_page.word[i] = 0xFFFFFFFF;}
+	mf_page.prof.magic = MF_MAGIC;
+	mf_page.prof.size = sizeof(mfProfile_t);
+	mf_page.prof.junction_acceleration = cm.junction_acceleration;
+	mf_page.prof.chordal_tolerance = cm.chordal_tolerance;
+	memcpy(mf_page.prof.a, cm.a, sizeof(cm.a));
+	memcpy(&mf_page.prof.st, &st, sizeof(st));
+	mf_page.prof.checksum = _checksum(&mf_page.prof);
+
+	uint32_t addr = (uint32_t)_profile_addr(n);
+	for (uint8_t p=0; p < MF_PROFILE_PAGES; p++) {
+		ritorno(write_flash_page(addr + (p * MF_PAGE_SIZE), &mf_page.word[p * (MF_PAGE_SIZE / sizeof(uint32_t))]));
+	}
+	mf.active = n;
+	return (STAT_OK);
+}
+
+stat_t mf_set_mfl(cmdObj_t *cmd)
+{
+	uint8_t n = (uint8_t)cmd->value;
+	if ((cmd->value < 1) || (n > MF_PROFILES)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if (_machine_is_idle() == false) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	return (_load_profile(n));
+}
+
+stat_t mf_set_mfb(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value > MF_PROFILES)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_ui8(cmd));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_mfa[] PROGMEM = "Machine profile:%9d [0=none]\n";
+static const char fmt_mfb[] PROGMEM = "[mfb] boot machine profile%9d [0=none]\n";
+
+void mf_print_mfa(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_mfa);}
+void mf_print_mfb(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_mfb);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MACHINE_PROFILES
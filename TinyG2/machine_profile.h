@@ -0,0 +1,100 @@
+/*
+ * machine_profile.h - stored machine profiles switched with one command
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Machine profiles are enabled by __MACHINE_PROFILES in tinyg2.h. A profile is a copy
+ * of the axis settings (cm.a - velocity, jerk, junction deviation, travel, homing...),
+ * $ja and $ct, and the motor settings (st - including the steps per unit worked out
+ * from them), kept in MF_PROFILES slots of flash bank 1 below the checkpoints. Changing
+ * a material or a head is then one command rather than a few dozen $ settings, and a
+ * job never starts on a mix of the old settings and the new.
+ *
+ *	{"mfs":n}	save the settings in force to profile n (1..MF_PROFILES)
+ *	{"mfl":n}	load profile n - all of it is in force when the command returns
+ *	{"mfa":""}	profile last loaded or saved, 0 if none - settings changed since are not tracked
+ *	$mfb		profile loaded at reset, 0=none
+ *
+ * Profiles are only loaded and saved with the machine idle - no cycle and nothing in the
+ * runtime - else STAT_COMMAND_NOT_ACCEPTED. A load copies the profile over the settings
+ * with interrupts off, then sets up what is worked out from them: the kinematics map
+ * and soft limits, the driver microsteps, motor power and step timing, and the shapers.
+ * Positions are kept in mm, so they carry across a change of steps per unit.
+ *
+ * A load does not persist the settings - the $ values in NVM are left as they were,
+ * and $mfb puts the profile back at the next reset. A profile saved by a build with
+ * other settings (a different size) is not loaded.
+ */
+
+#ifndef MACHINE_PROFILE_H_ONCE
+#define MACHINE_PROFILE_H_ONCE
+
+#include "canonical_machine.h"			// cfgAxis_t
+#include "stepper.h"					// stConfig_t
+#include "persistence.h"				// NVM_FLASH_ADDR
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __MACHINE_PROFILES
+
+#define MF_PROFILES 4					// profiles stored - {"mfl":1} to {"mfl":4}
+#define MF_PAGE_SIZE IFLASH1_PAGE_SIZE	// 256 bytes
+#define MF_PROFILE_PAGES 4				// flash pages per profile
+#define MF_PROFILE_SIZE (MF_PROFILE_PAGES * MF_PAGE_SIZE)
+#define MF_FLASH_SIZE (MF_PROFILES * MF_PROFILE_SIZE)
+#define MF_FLASH_ADDR (NVM_FLASH_ADDR - (128 * 1024UL) - (16 * 1024UL) - MF_FLASH_SIZE)	// below the checkpoints
+
+typedef struct mfProfile {				// one profile - padded out to MF_PROFILE_PAGES
+	uint16_t magic;						// MF_MAGIC
+	uint16_t checksum;					// sum of the words from size on
+	uint32_t size;						// sizeof(mfProfile_t) - another build's profile is not loaded
+	float junction_acceleration;		// $ja
+	float chordal_tolerance;			// $ct
+	cfgAxis_t a[AXES];					// axis settings
+	stConfig_t st;						// motor settings, with steps_per_unit
+} mfProfile_t;
+
+typedef struct mfSingleton {
+	uint8_t active;						// mfa - profile last loaded or saved, 0 if none
+	uint8_t boot;						// mfb - profile loaded at reset, 0 if none
+} mfSingleton_t;
+
+extern mfSingleton_t mf;
+
+void mf_init(void);
+
+stat_t mf_set_mfs(cmdObj_t *cmd);
+stat_t mf_set_mfl(cmdObj_t *cmd);
+stat_t mf_set_mfb(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void mf_print_mfa(cmdObj_t *cmd);
+	void mf_print_mfb(cmdObj_t *cmd);
+#else
+	#define mf_print_mfa tx_print_stub
+	#define mf_print_mfb tx_print_stub
+#endif
+
+#endif // __MACHINE_PROFILES
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: MACHINE_PROFILE_H_ONCE
@@ -28,12 +28,29 @@
 #include "report.h"
 #include "planner.h"
 #include "stepper.h"
+#include "kinematics.h"
 //#include "network.h"
 #include "switch.h"
 //#include "gpio.h"
 //#include "test.h"
 #include "pwm.h"
+#include "tmc2660.h"
+#include "encoder.h"
+#include "adc.h"
+#include "program_store.h"
+#include "checkpoint.h"
+#include "gcode_macro.h"
+#include "shaper.h"
 #include "xio.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "latency.h"
+#include "swo.h"
+#include "uart.h"
+#include "replay.h"
+#include "machine_profile.h"
+#include "memguard.h"
+#include "memory.h"
 
 #include "MotateTimers.h"
 using Motate::delay;
@@ -52,6 +69,7 @@ void __libc_init_array(void);
 #endif // __cplusplus
 
 static void _application_init(void);
+static void _boot_mark(uint8_t phase);
 
 /******************** Application Code ************************/
 
@@ -64,11 +82,21 @@ const Motate::USBSettings_t Motate::USBSettings = {
 };
 	/*gProductVersion   = */ //0.1,
 
+#if defined(__DUAL_USB_CDC)
+Motate::USBDevice< Motate::USBCDC, Motate::USBCDC > usb;
+#elif defined(__BINARY_STREAM)
+Motate::USBDevice< Motate::USBCDC, Motate::USBVendor > usb;
+#else
 Motate::USBDevice< Motate::USBCDC > usb;
-//Motate::USBDevice< Motate::USBCDC, Motate::USBCDC > usb;
+#endif
 
 typeof usb._mixin_0_type::Serial &SerialUSB = usb._mixin_0_type::Serial;
-//typeof usb._mixin_1_type::Serial &SerialUSB1 = usb._mixin_1_type::Serial;
+#ifdef __DUAL_USB_CDC
+typeof usb._mixin_1_type::Serial &SerialUSB1 = usb._mixin_1_type::Serial;
+#endif
+#ifdef __BINARY_STREAM
+typeof usb._mixin_1_type::Vendor &VendorUSB = usb._mixin_1_type::Vendor;
+#endif
 
 MOTATE_SET_USB_VENDOR_STRING( {'S' ,'y', 'n', 't', 'h', 'e', 't', 'o', 's'} )
 MOTATE_SET_USB_PRODUCT_STRING( {'T', 'i', 'n', 'y', 'G', ' ', 'v', '2'} )
@@ -90,11 +118,17 @@ int main(void)
 {
 	// system initialization
 	init();
+#ifdef __ARM
+	hw_start_cycle_counter();						// start the cycle counter for the boot times
+	HW_DWT_CYCCNT = 0;
+#endif
 	delay(1);
 	usb.attach();					// USB setup
-	delay(1000);
+	_boot_mark(BOOT_USB);
 
-	// TinyG application setup
+	// TinyG application setup - runs while USB enumerates. Nothing here reads USB, and
+	// startup messages wait in the TX buffer. The controller sends SYSTEM READY once
+	// the host connects.
 	_application_init();
 
 	// main loop
@@ -111,25 +145,87 @@ static void _application_init(void)
 
 	// do these first
 	hardware_init();				// system hardware setup 			- must be first
+	mem_init();						// paint the stack for its high water mark - must precede mg_init()
+#ifdef __MEMORY_GUARD
+	mg_init();						// MPU stack guard					- must precede the inits that set guards
+#endif
+	_boot_mark(BOOT_HARDWARE);
 	config_init();					// config records from eeprom 		- must be second
+	_boot_mark(BOOT_CONFIG);
 	switch_init();					// switches and other inputs
 	pwm_init();						// pulse width modulation drivers
+#ifdef __TMC2660
+	tmc_init();						// SPI motor drivers				- must follow config_init()
+#endif
+#ifdef __ENCODERS
+	en_init();						// quadrature encoders				- must follow config_init()
+#endif
+#ifdef __ANALOG_INPUTS
+	ad_init();						// analog inputs					- must follow config_init()
+#endif
+#ifdef __UART_DEVICES
+	uart_init();					// USART ports						- must follow config_init() and switch_init()
+#endif
+	_boot_mark(BOOT_DRIVERS);
 
 	// do these next
 	controller_init( DEV_STDIN, DEV_STDOUT, DEV_STDERR );
 	planner_init();					// motion planning subsystem
 	canonical_machine_init();		// canonical machine				- must follow config_init()
+	ik_init();						// kinematics						- must follow config_init()
+#ifdef __INPUT_SHAPING
+	sh_init();						// axis shapers						- must follow planner_init()
+#endif
+	_boot_mark(BOOT_MACHINE);
 
 	// do these last
 	stepper_init();
+#ifdef __MACHINE_PROFILES
+	mf_init();						// load the boot profile				- must follow stepper_init()
+#endif
+#ifdef __GCODE_MACROS
+	mc_init();						// no subroutines defined
+#endif
+#ifdef __PROGRAM_STORE
+	pg_init();						// find the stored program
+#endif
+#ifdef __SEGMENT_REPLAY
+	rp_init();						// sum the firmware, find the segment cache
+#endif
+#ifdef __CHECKPOINT
+	ck_init();						// find the last checkpoint, start the supply monitor
+#endif
+#ifdef __PROFILER
+	pf_init();						// start the cycle counter for the profiler
+#endif
+#ifdef __SWO_TRACE
+	swo_init();						// start the ITM for the SWO trace
+#endif
+#ifdef __LATENCY_TEST
+	lt_init();						// start the cycle counter for the ping timestamps
+#endif
+	_boot_mark(BOOT_LAST);
 
 	// now get started
 //	rpt_print_system_ready_message();// (LAST) announce system is ready
 //	_unit_tests();					// run any unit tests that are enabled
 //	tg_canned_startup();			// run any pre-loaded commands
+#ifdef __PLANNER_BENCHMARK
+	bm_run_benchmark();				// feed the benchmark program to the planner
+#endif
 	return;
 }
 
+/*
+ * _boot_mark() - stamp the end of a boot phase with the cycle count from main()
+ */
+static void _boot_mark(uint8_t phase)
+{
+#ifdef __ARM
+	cs.boot_cycles[phase] = HW_DWT_CYCCNT;
+#endif
+}
+
 void tg_reset(void)			// software hard reset using the watchdog timer
 {
 	//	wdt_enable(WDTO_15MS);
@@ -179,7 +275,7 @@ static const char stat_25[] PROGMEM = "Read-only address";
 static const char stat_26[] PROGMEM = "Initialization failure";
 static const char stat_27[] PROGMEM = "System alarm - shutting down";
 static const char stat_28[] PROGMEM = "Memory fault or corruption";
-static const char stat_29[] PROGMEM = "29";
+static const char stat_29[] PROGMEM = "Checksum match failed";
 static const char stat_30[] PROGMEM = "30";
 static const char stat_31[] PROGMEM = "31";
 static const char stat_32[] PROGMEM = "32";
@@ -226,7 +322,7 @@ static const char stat_70[] PROGMEM = "Arc specification error";
 static const char stat_71[] PROGMEM = "Soft limit exceeded";
 static const char stat_72[] PROGMEM = "Command not accepted";
 static const char stat_73[] PROGMEM = "Probing cycle failed";
-static const char stat_74[] PROGMEM = "74";
+static const char stat_74[] PROGMEM = "Planned move underrun";
 static const char stat_75[] PROGMEM = "75";
 static const char stat_76[] PROGMEM = "76";
 static const char stat_77[] PROGMEM = "77";
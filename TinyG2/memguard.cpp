@@ -0,0 +1,98 @@
+/*
+ * memguard.cpp - MPU guard regions for the core structures and the stack
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See memguard.h for usage */
+
+#include "tinyg2.h"
+#include "memguard.h"
+
+#ifdef __MEMORY_GUARD
+
+#include "MotateTimers.h"			// brings in the CMSIS core definitions for the MPU
+#include <sys/types.h>				// caddr_t
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+extern caddr_t _sbrk(int incr);
+extern uint32_t _estack;			// top of RAM - see gcc_flash.ld
+
+mgSingleton_t mg;
+
+#define MG_RASR_NO_ACCESS	(1UL << 28)	// XN, AP=000 - no access, no execute
+#define MG_RASR_SIZE		(4UL << MPU_RASR_SIZE_Pos)	// 2^(4+1) = MG_GUARD_SIZE
+
+static void _set_region(uint8_t region, uint32_t address)
+{
+	MPU->RBAR = (address & MPU_RBAR_ADDR_Msk) | MPU_RBAR_VALID_Msk | region;
+	MPU->RASR = MG_RASR_NO_ACCESS | MG_RASR_SIZE | MPU_RASR_ENABLE_Msk;
+	__DSB();
+	__ISB();
+}
+
+/*
+ * mg_init() - set the stack guard and turn on the MPU
+ *
+ *	Runs before the other inits, which set their own guards. The rest of the
+ *	memory map is the default map (PRIVDEFENA), so only the guards change.
+ */
+void mg_init()
+{
+	MPU->CTRL = 0;
+	for (uint8_t i=0; i<MG_REGIONS; i++) {
+		MPU->RNR = i;
+		MPU->RASR = 0;
+	}
+	uint32_t guard = ((uint32_t)&_estack - MG_STACK_SIZE) & ~(MG_GUARD_SIZE - 1);
+	if (guard > ((uint32_t)_sbrk(0) + MG_GUARD_SIZE)) {
+		mg.stack_guard = guard;
+		_set_region(MG_STACK, guard);
+	}
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;	// MemManage faults, not hard faults
+	MPU->CTRL = MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk;
+	__DSB();
+	__ISB();
+}
+
+/*
+ * mg_set_guard() - put a region over the guard of a structure
+ */
+void mg_set_guard(uint8_t region, const mgGuard_t *guard)
+{
+	if (region >= MG_REGIONS) { return;}
+	_set_region(region, (uint32_t)guard);
+}
+
+/*
+ * MemManage_Handler() - stop at the fault (replaces the weak __halt alias)
+ */
+void MemManage_Handler(void)
+{
+	mg.fault_status = SCB->CFSR & SCB_CFSR_MEMFAULTSR_Msk;
+	if (mg.fault_status & (1UL << 7)) {			// MMARVALID
+		mg.fault_address = SCB->MMFAR;
+	}
+	while (true);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MEMORY_GUARD
@@ -0,0 +1,91 @@
+/*
+ * memguard.h - MPU guard regions for the core structures and the stack
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Memory guards are enabled by __MEMORY_GUARD in tinyg2.h. They use the Cortex-M3
+ * MPU to make an overrun of the core structures, or of the stack, fault at the
+ * instruction that does it, instead of being found by the magic number assertions
+ * some time later (if the write happened to land on a magic number at all).
+ *
+ * Each guarded structure ends in a MEMORY_GUARD member - MG_GUARD_SIZE bytes,
+ * aligned to their size, which is the smallest region the MPU can protect. Its
+ * init sets an MPU region over the guard with no access, so any read or write of
+ * it is a MemManage fault. The MPU has 8 regions, which are given out in mgRegion.
+ * The stack guard is MG_STACK_SIZE below the top of RAM. The stack grows down and
+ * the heap grows up towards it, so it catches either running into the other. It
+ * is left off (mg.stack_guard is 0) if the heap is already above it.
+ *
+ * A fault stops the processor in MemManage_Handler() with the address that was
+ * accessed in mg.fault_address, for the debugger. The step interrupts can't run
+ * under the handler, so the motors stop. A stack overflow faults as it stacks the
+ * exception, which escalates to the hard fault halt.
+ *
+ * With the guards in place the magic number assertions only run every
+ * MG_ASSERTION_MS, to catch corruption inside a structure, which the guards can't.
+ * Clear a guarded structure with MG_SIZEOF() - a memset() of sizeof() would fault
+ * on the guard.
+ */
+
+#ifndef MEMGUARD_H_ONCE
+#define MEMGUARD_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __MEMORY_GUARD
+
+#define MG_STACK_SIZE		8192		// stack guard is this far below the top of RAM
+#define MG_ASSERTION_MS		1000		// run the magic number assertions this often
+
+enum mgRegion {							// MPU regions - 8 at most
+	MG_STACK = 0,
+	MG_CONTROLLER,						// cs
+	MG_CANONICAL_MACHINE,				// cm
+	MG_CMD_STRING,						// cmdStr
+	MG_PLANNER_BUFFERS,					// mb
+	MG_RUNTIME,							// mr
+	MG_STEPPER_RUN,						// st_run
+	MG_STEPPER_PREP,					// st_prep
+	MG_REGIONS
+};
+
+typedef struct mgSingleton {
+	uint32_t stack_guard;				// address of the stack guard (0 if it's left off)
+	volatile uint32_t fault_address;	// address that faulted, if the MPU had it
+	volatile uint32_t fault_status;		// MemManage fault status (MMFSR)
+} mgSingleton_t;
+
+extern mgSingleton_t mg;
+
+void mg_init(void);
+void mg_set_guard(uint8_t region, const mgGuard_t *guard);
+
+#define MG_SET_GUARD(region, s) mg_set_guard(region, &(s).guard)
+
+#else
+
+#define MG_SET_GUARD(region, s)
+
+#endif // __MEMORY_GUARD
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: MEMGUARD_H_ONCE
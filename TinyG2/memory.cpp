@@ -0,0 +1,90 @@
+/*
+ * memory.cpp - stack high water mark and memory usage report
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See memory.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "planner.h"
+#include "xio.h"
+#include "memguard.h"
+#include "memory.h"
+#include "util.h"
+
+#include <sys/types.h>				// caddr_t
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+memSingleton_t mem;
+
+extern caddr_t _sbrk(int incr);
+extern uint32_t _srelocate;			// start of static data - see gcc_flash.ld
+extern uint32_t _end;				// end of bss, start of the heap
+extern uint32_t _estack;			// top of RAM
+
+static uint32_t *_heap_top() { return ((uint32_t *)(((uint32_t)_sbrk(0) + 3) & ~3));}
+
+/*
+ * mem_init() - paint the free RAM and note the static sizes
+ *
+ *	Run first thing in the application init, from the shallow main() frame, so
+ *	nearly all of the stack is painted. It must precede mg_init(), as the stack
+ *	guard would fault on the paint.
+ */
+void mem_init()
+{
+	uint32_t *top = (uint32_t *)((uint32_t)__builtin_frame_address(0) - MEM_PAINT_MARGIN);
+	for (uint32_t *p = _heap_top(); p < top; p++) { *p = MEM_PAINT;}
+	mem.data = (uint32_t)&_end - (uint32_t)&_srelocate;
+	mem.free_min = 0xFFFFFFFF;
+	mem.planner_pool = sizeof(mb);
+	mem.planner_buffer = sizeof(mpBuf_t) + sizeof(GCodeState_t);
+	mem.cmd_list = CMD_LIST_LEN * sizeof(cmdObj_t);
+	mem.cmd_string = sizeof(cmdStr);
+	mem.xio_buffers = xio_get_buffer_size();
+}
+
+/*
+ * mem_get() - scan the stack and return a memory value
+ *
+ *	The scan starts above the stack guard if there is one, as the stack can't go
+ *	below it without faulting - and reading it would fault too.
+ */
+stat_t mem_get(cmdObj_t *cmd)
+{
+	uint32_t *heap = _heap_top();
+	uint32_t *p = heap;
+	uint32_t guard = 0;
+#ifdef __MEMORY_GUARD
+	if ((mg.stack_guard != 0) && ((uint32_t)p < mg.stack_guard + MG_GUARD_SIZE)) {
+		p = (uint32_t *)(mg.stack_guard + MG_GUARD_SIZE);
+		guard = MG_GUARD_SIZE;
+	}
+#endif
+	while ((p < &_estack) && (*p == MEM_PAINT)) { p++;}
+	mem.stack_used = (uint32_t)&_estack - (uint32_t)p;
+	mem.free_min = min(mem.free_min, (uint32_t)p - (uint32_t)heap - guard);
+	mem.heap = (uint32_t)heap - (uint32_t)&_end;
+	return (get_int(cmd));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+/*
+ * memory.h - stack high water mark and memory usage report
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The memory report tells how close the stack has come to the heap, and where the
+ * RAM has gone, so the planner pool and the buffers can be sized from data. The
+ * free RAM between the top of the heap and the stack is painted with MEM_PAINT
+ * at startup. The lowest word no longer painted is as deep as the stack has gone,
+ * counting the nested interrupts. The values are in bytes, read as {"mem":""}:
+ *
+ *	memst	stack high water mark - deepest the stack has been
+ *	memfr	free RAM - least there has been between the heap and the stack
+ *	memhp	heap in use (newlib stdio and the like)
+ *	memda	static data and bss
+ *	memmb	planner buffer pool (mb)
+ *	membf	bytes per planner buffer - what each PLANNER_BUFFER_POOL_SIZE costs
+ *	memcl	JSON and text cmd list (cmd_list)
+ *	memcs	shared cmd string (cmdStr)
+ *	memxb	USB receive and transmit buffers
+ *
+ * A reading of the stack walks up the painted words from the top of the heap, which
+ * takes a fraction of a millisecond. Heap that has been allocated since startup is
+ * not counted as stack.
+ */
+
+#ifndef MEMORY_H_ONCE
+#define MEMORY_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define MEM_PAINT			0xC5C5C5C5	// pattern in untouched stack
+#define MEM_PAINT_MARGIN	256			// don't paint this far below the startup frame
+
+typedef struct memSingleton {			// all uint32_t - read by get_int()
+	uint32_t stack_used;				// memst
+	uint32_t free_min;					// memfr
+	uint32_t heap;						// memhp
+	uint32_t data;						// memda
+	uint32_t planner_pool;				// memmb
+	uint32_t planner_buffer;			// membf
+	uint32_t cmd_list;					// memcl
+	uint32_t cmd_string;				// memcs
+	uint32_t xio_buffers;				// memxb
+} memSingleton_t;
+
+extern memSingleton_t mem;
+
+void mem_init(void);
+
+stat_t mem_get(cmdObj_t *cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: MEMORY_H_ONCE
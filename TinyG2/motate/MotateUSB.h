@@ -119,13 +119,16 @@ namespace Motate {
 
 		static bool sendDescriptorOrConfig(Setup_t &setup) {
 			const uint8_t type = setup.valueHigh();
+			// The configuration describes the speed we are running at, and the "other speed"
+			// configuration describes the same configuration at the speed we are not.
+			// For a high-speed device otherSpeed means the full-speed endpoint sizes.
 			if (type == kConfigurationDescriptor) {
-				sendConfig(setup.length(), /*other = */ setup.valueLow() == 2);
+				sendConfig(setup.length(), /*other = */ !_hardware_type::isHighSpeed(), kConfigurationDescriptor);
 				return true;
 			}
 			else
 			if (type == kOtherDescriptor) {
-				sendConfig(setup.length(), /*other = */ true);
+				sendConfig(setup.length(), /*other = */ _hardware_type::isHighSpeed(), kOtherDescriptor);
 				return true;
 			}
 			else
@@ -164,8 +167,8 @@ namespace Motate {
 			_this_type::writeToControl(0, (const uint8_t *)(&qualifier), maxLength < length ? maxLength : length);
 		};
 
-		static void sendConfig(uint16_t maxLength, const bool other) {
-			const _config_type config(USBSettings.attributes, USBSettings.powerConsumption, other);
+		static void sendConfig(uint16_t maxLength, const bool other, const uint8_t descriptorType) {
+			const _config_type config(USBSettings.attributes, USBSettings.powerConsumption, other, descriptorType);
 			uint16_t length = sizeof(_config_type);
 			_this_type::writeToControl(0, (const uint8_t *)(&config), maxLength < length ? maxLength : length);
 		};
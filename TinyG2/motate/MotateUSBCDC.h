@@ -290,6 +290,22 @@ namespace Motate {
 			return total_read;
 		};
 
+		// Non-blocking version of read(): returns whatever is in the endpoint bank(s)
+		// right now, up to length. Returns 0 if nothing is available.
+		int16_t readAvailable(uint8_t *buffer, const uint16_t length) {
+			int16_t amount_read = usb.read(read_endpoint, buffer, length);
+			return (amount_read > 0) ? amount_read : 0;
+		};
+
+		// Non-blocking version of write(): sends whatever the endpoint bank(s) can take
+		// right now, up to length, and flushes it. Returns 0 if the endpoint is busy.
+		int16_t writeAvailable(const uint8_t *data, const uint16_t length) {
+			int16_t written = usb.write(write_endpoint, data, length);
+			if (written <= 0) { return 0; }
+			flush();
+			return written;
+		};
+
 		int32_t write(const uint8_t *data, const uint16_t length) {
 			int16_t total_written = 0;
 			int16_t written = 1; // start with a non-zero value
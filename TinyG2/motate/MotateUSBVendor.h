@@ -0,0 +1,266 @@
+/*
+ utility/MotateUSBVendor.h - Library for the Motate system
+ http://tinkerin.gs/
+
+ Copyright (c) 2013 Robert Giseburt
+
+ This file is part of the Motate Library.
+
+ This file ("the software") is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License, version 2 as published by the
+ Free Software Foundation. You should have received a copy of the GNU General Public
+ License, version 2 along with the software. If not, see <http://www.gnu.org/licenses/>.
+
+ As a special exception, you may use this file as part of a software library without
+ restriction. Specifically, if other files instantiate templates or use macros or
+ inline functions from this file, or you compile this file and link it with  other
+ files to produce an executable, this file does not by itself cause the resulting
+ executable to be covered by the GNU General Public License. This exception does not
+ however invalidate any other reasons why the executable file might be covered by the
+ GNU General Public License.
+
+ THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+ */
+
+#ifndef MOTATEUSBVENDOR_ONCE
+#define MOTATEUSBVENDOR_ONCE
+
+#include "utility/MotateUSBHelpers.h"
+
+namespace Motate {
+
+	/* ############################################ */
+	/* #                                          # */
+	/* #         USB Vendor Bulk Interface        # */
+	/* #                                          # */
+	/* ############################################ */
+
+	/* A vendor-specific (class 0xFF) interface with one bulk OUT and one bulk IN endpoint.
+	 * There are no class requests and no line state - the host talks to it with a generic
+	 * driver (libusb, WinUSB) and the content of the stream is up to the application.
+	 *
+	 * Data is only read from the OUT endpoint when the application asks for it, so a
+	 * device that stops reading makes the hardware NAK the host - that is the flow control.
+	 */
+
+#pragma mark USBVendor
+
+	// Placeholder for use in end-code
+	// IOW: USBDevice<USBCDC, USBVendor> usb;
+	// Also, used as the base class for the resulting specialized USBMixin.
+	struct USBVendor {
+		static bool isNull() { return false; };
+		static const uint8_t endpoints_used = 2;
+	};
+
+#pragma mark USBVendor_impl
+
+	//Actual implementation of the vendor interface
+	template <typename usb_parent_type>
+	struct USBVendorBulk {
+		usb_parent_type &usb;
+		const uint8_t read_endpoint;
+		const uint8_t write_endpoint;
+
+		USBVendorBulk(usb_parent_type &usb_parent,
+					  const uint8_t new_endpoint_offset
+					  )
+		: usb(usb_parent),
+		read_endpoint(new_endpoint_offset),
+		write_endpoint(new_endpoint_offset+1)
+		{};
+
+		// Returns whatever is in the endpoint bank(s) right now, up to length. Returns 0 if nothing is available.
+		int16_t readAvailable(uint8_t *buffer, const uint16_t length) {
+			int16_t amount_read = usb.read(read_endpoint, buffer, length);
+			return (amount_read > 0) ? amount_read : 0;
+		};
+
+		// Sends whatever the endpoint bank(s) can take right now, up to length, and flushes it.
+		// Returns 0 if the endpoint is busy.
+		int16_t writeAvailable(const uint8_t *data, const uint16_t length) {
+			int16_t written = usb.write(write_endpoint, data, length);
+			if (written <= 0) { return 0; }
+			usb.flush(write_endpoint);
+			return written;
+		};
+
+		bool isConnected() {
+			return usb.isConfigured();
+		};
+
+		bool handleNonstandardRequest(Setup_t &setup) {
+			return false;
+		};
+
+		const EndpointBufferSettings_t getEndpointSettings(const uint8_t endpoint, const bool otherSpeed) {
+			if (endpoint == read_endpoint)
+			{
+				const EndpointBufferSettings_t _buffer_speed = getBufferSizeFlags(Motate::getEndpointSize(read_endpoint, kEndpointTypeBulk, otherSpeed));
+				return kEndpointBufferOutputFromHost | _buffer_speed | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+			}
+			else if (endpoint == write_endpoint)
+			{
+				const EndpointBufferSettings_t _buffer_speed = getBufferSizeFlags(Motate::getEndpointSize(write_endpoint, kEndpointTypeBulk, otherSpeed));
+				return kEndpointBufferInputToHost | _buffer_speed | kEndpointBufferBlocksUpTo2 | kEndpointBufferTypeBulk;
+			}
+			return kEndpointBufferNull;
+		};
+
+		uint16_t getEndpointSize(const uint8_t &endpoint, const bool otherSpeed) {
+			if ((endpoint == read_endpoint) || (endpoint == write_endpoint))
+			{
+				return Motate::getEndpointSize(endpoint, kEndpointTypeBulk, otherSpeed);
+			}
+			return 0;
+		};
+	};
+
+#pragma mark USBMixin< USBVendor, usbIFB, usbIFC, 0 >
+
+	template <typename usbIFB, typename usbIFC>
+	struct USBMixin< USBVendor, usbIFB, usbIFC, 0 > : USBVendor {
+
+		typedef USBDevice<USBVendor, usbIFB, usbIFC> usb_parent_type;
+		typedef USBMixin< USBVendor, usbIFB, usbIFC, 0 > this_type;
+
+		USBVendorBulk< usb_parent_type > Vendor;
+
+		USBMixin< USBVendor, usbIFB, usbIFC, 0 > (usb_parent_type &usb_parent,
+												  const uint8_t new_endpoint_offset
+												  ) : Vendor(usb_parent, new_endpoint_offset) {};
+
+		static const EndpointBufferSettings_t getEndpointConfigFromMixin(const uint8_t endpoint, const bool other_speed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSettings(endpoint, other_speed);
+		};
+		static bool handleNonstandardRequestInMixin(Setup_t &setup) {
+			return usb_parent_type::_singleton->this_type::Vendor.handleNonstandardRequest(setup);
+		};
+		static uint16_t getEndpointSizeFromMixin(const uint8_t endpoint, const bool otherSpeed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSize(endpoint, otherSpeed);
+		};
+		static bool sendSpecialDescriptorOrConfig(Setup_t &setup) { return false; };
+	};
+
+#pragma mark USBMixin< usbIFA, USBVendor, usbIFC, 1 >
+	template <typename usbIFA, typename usbIFC>
+	struct USBMixin< usbIFA, USBVendor, usbIFC, 1 > : USBVendor {
+
+		typedef USBDevice<usbIFA, USBVendor, usbIFC> usb_parent_type;
+		typedef USBMixin< usbIFA, USBVendor, usbIFC, 1 > this_type;
+
+		USBVendorBulk< usb_parent_type > Vendor;
+
+		USBMixin< usbIFA, USBVendor, usbIFC, 1 > (usb_parent_type &usb_parent,
+												  const uint8_t new_endpoint_offset
+												  ) : Vendor(usb_parent, new_endpoint_offset) {};
+
+		static const EndpointBufferSettings_t getEndpointConfigFromMixin(uint8_t endpoint, const bool other_speed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSettings(endpoint, other_speed);
+		};
+		static bool handleNonstandardRequestInMixin(Setup_t &setup) {
+			return usb_parent_type::_singleton->this_type::Vendor.handleNonstandardRequest(setup);
+		};
+		static uint16_t getEndpointSizeFromMixin(const uint8_t endpoint, const bool otherSpeed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSize(endpoint, otherSpeed);
+		};
+		static bool sendSpecialDescriptorOrConfig(Setup_t &setup) { return false; };
+	};
+
+#pragma mark USBMixin< usbIFA, usbIFB, USBVendor, 2 >
+	template <typename usbIFA, typename usbIFB>
+	struct USBMixin< usbIFA, usbIFB, USBVendor, 2 > : USBVendor {
+
+		typedef USBDevice<usbIFA, usbIFB, USBVendor> usb_parent_type;
+		typedef USBMixin< usbIFA, usbIFB, USBVendor, 2 > this_type;
+
+		USBVendorBulk< usb_parent_type > Vendor;
+
+		USBMixin< usbIFA, usbIFB, USBVendor, 2 > (usb_parent_type &usb_parent,
+												  const uint8_t new_endpoint_offset
+												  ) : Vendor(usb_parent, new_endpoint_offset) {};
+
+		static const EndpointBufferSettings_t getEndpointConfigFromMixin(uint8_t endpoint, const bool other_speed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSettings(endpoint, other_speed);
+		};
+		static bool handleNonstandardRequestInMixin(Setup_t &setup) {
+			return usb_parent_type::_singleton->this_type::Vendor.handleNonstandardRequest(setup);
+		};
+		static uint16_t getEndpointSizeFromMixin(const uint8_t endpoint, const bool otherSpeed) {
+			return usb_parent_type::_singleton->this_type::Vendor.getEndpointSize(endpoint, otherSpeed);
+		};
+		static bool sendSpecialDescriptorOrConfig(Setup_t &setup) { return false; };
+	};
+
+#pragma mark USBConfigMixin< USBVendor, ?, ? >
+
+	// The vendor interface is a single interface, so it needs no IAD, in any position.
+	struct USBVendorConfigMixin_t
+	{
+		static const uint8_t interfaces = 1;
+
+		const USBDescriptorInterface_t Vendor_Interface;
+		const USBDescriptorEndpoint_t  Vendor_DataOutEndpoint;
+		const USBDescriptorEndpoint_t  Vendor_DataInEndpoint;
+
+		USBVendorConfigMixin_t (const uint8_t _first_endpoint_number, const uint8_t _first_interface_number, const bool _other_speed)
+		: Vendor_Interface(
+						   /* _InterfaceNumber   = */ _first_interface_number,
+						   /* _AlternateSetting  = */ 0,
+						   /* _TotalEndpoints    = */ 2,
+
+						   /* _Class             = */ kVendorSpecificClass,
+						   /* _SubClass          = */ kVendorSpecificSubclass,
+						   /* _Protocol          = */ kVendorSpecificProtocol,
+
+						   /* _InterfaceStrIndex = */ 0 // none
+						   ),
+		Vendor_DataOutEndpoint(
+							   /* _otherSpeed        = */ _other_speed,
+							   /* _input             = */ false,
+							   /* _EndpointAddress   = */ _first_endpoint_number,
+							   /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+							   /* _PollingIntervalMS = */ 0x05
+							   ),
+		Vendor_DataInEndpoint(
+							  /* _otherSpeed        = */ _other_speed,
+							  /* _input             = */ true,
+							  /* _EndpointAddress   = */ _first_endpoint_number+1,
+							  /* _Attributes        = */ (kEndpointTypeBulk | kEndpointAttrNoSync | kEndpointUsageData),
+							  /* _PollingIntervalMS = */ 0x05
+							  )
+		{};
+
+		static bool isNull() { return false; };
+	};
+
+	template < typename usbIFB, typename usbIFC >
+	struct USBConfigMixin < USBVendor, usbIFB, usbIFC, 0 > : USBVendorConfigMixin_t {
+		USBConfigMixin(const uint8_t _first_endpoint_number, const uint8_t _first_interface_number, const bool _other_speed) :
+		USBVendorConfigMixin_t(_first_endpoint_number, _first_interface_number, _other_speed)
+		{};
+	};
+
+	template < typename usbIFA, typename usbIFC >
+	struct USBConfigMixin < usbIFA, USBVendor, usbIFC, 1 > : USBVendorConfigMixin_t {
+		USBConfigMixin(const uint8_t _first_endpoint_number, const uint8_t _first_interface_number, const bool _other_speed) :
+		USBVendorConfigMixin_t(_first_endpoint_number, _first_interface_number, _other_speed)
+		{};
+	};
+
+	template < typename usbIFA, typename usbIFB >
+	struct USBConfigMixin < usbIFA, usbIFB, USBVendor, 2 > : USBVendorConfigMixin_t {
+		USBConfigMixin(const uint8_t _first_endpoint_number, const uint8_t _first_interface_number, const bool _other_speed) :
+		USBVendorConfigMixin_t(_first_endpoint_number, _first_interface_number, _other_speed)
+		{};
+	};
+}
+
+#endif
+// MOTATEUSBVENDOR_ONCE
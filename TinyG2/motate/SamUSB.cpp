@@ -128,11 +128,40 @@ namespace Motate {
 		UOTGHS->UOTGHS_DEVEPT |= UOTGHS_DEVEPT_EPEN0 << (endpoint);
 	}
 
+	bool _isHighSpeed() {
+		return (UOTGHS->UOTGHS_SR & UOTGHS_SR_SPEED_Msk) == UOTGHS_SR_SPEED_HIGH_SPEED;
+	}
+
+	// The endpoint banks are allocated one after another from a 4KB DPRAM, in endpoint order.
+	// The hardware doesn't check that they fit, so an endpoint that would overflow is cut to one bank.
+	// At high-speed two double-banked 512 byte CDC interfaces need a little more than the DPRAM holds.
+	static const uint16_t kDPRAMSize = 4096;
+	static uint16_t _dpramUsed = 0;
+
+	static const EndpointBufferSettings_t _enforce_dpram_limit(const uint8_t endpoint, EndpointBufferSettings_t config) {
+		if (endpoint == 0)
+			_dpramUsed = 0;
+
+		if (config == kEndpointBufferNull)
+			return config;
+
+		uint16_t size = 8 << ((config & kEnpointBufferSizeMask) >> UOTGHS_DEVEPTCFG_EPSIZE_Pos);
+		uint16_t banks = ((config & kEndpointBufferBlocksMask) >> UOTGHS_DEVEPTCFG_EPBK_Pos) + 1;
+
+		if ((_dpramUsed + size * banks > kDPRAMSize) && (banks > 1)) {
+			config = (config & ~kEndpointBufferBlocksMask) | kEndpointBufferBlocks1;
+			banks = 1;
+		}
+		_dpramUsed += size * banks;
+
+		return config;
+	}
+
 	void _initEndpoint(uint32_t endpoint, const uint32_t configuration) {
 		endpoint = endpoint & 0xF; // EP range is 0..9, hence mask is 0xF.
 
 //		TRACE_UOTGHS_DEVICE(printf("=> UDD_InitEP : init EP %lu\r\n", ul_ep_nb);)
-		uint32_t configuration_fixed = _enforce_enpoint_limits(endpoint, configuration);
+		uint32_t configuration_fixed = _enforce_dpram_limit(endpoint, _enforce_enpoint_limits(endpoint, configuration));
 
 		// Configure EP
 		// If we get here, and it's a null endpoint, this will disable it.
@@ -322,6 +351,40 @@ namespace Motate {
 		return to_send;
 	}
 
+	/* Endpoints 1 through 7 each have a DMA channel (UOTGHS_DEVDMA[endpoint-1]) that
+	 * moves bytes between the endpoint bank and RAM without the CPU copying them one
+	 * at a time through _endpointBuffer[]. The bank accesses are sequential, just like
+	 * the CPU's, so the DMA and CPU copies can be mixed within a bank.
+	 *
+	 * The channel is used one bank at a time and the bank handshake (FIFOCON, RXOUT,
+	 * TXIN) is still done here, exactly as for a CPU copy. A bank is at most 1024 bytes,
+	 * which the DMA moves in a few microseconds, so completion is polled rather than
+	 * taken as an interrupt - the callers (CDC read/write) return the byte count
+	 * synchronously. Short transfers and buffers that are not in SRAM (the DMA can not
+	 * read flash) are copied by the CPU.
+	 */
+	static const int16_t kDMAMinimumTransfer = 16;
+
+	inline bool _canUseDMA(const uint8_t endpoint, const void *data, const int16_t length) {
+		return ((endpoint >= 1) && (endpoint <= UOTGHSDEVDMA_NUMBER) &&
+				(length >= kDMAMinimumTransfer) &&
+				((uint32_t)data >= IRAM0_ADDR) && ((uint32_t)data < (IRAM1_ADDR + IRAM1_SIZE)));
+	}
+
+	// The direction is set by the endpoint configuration, so the same call reads and writes.
+	void _transferWithDMA(const uint8_t endpoint, const void *data, const int16_t length) {
+		UotghsDevdma *dma = &UOTGHS->UOTGHS_DEVDMA[endpoint - 1];
+
+		(void)dma->UOTGHS_DEVDMASTATUS;								// reading clears stale status
+		dma->UOTGHS_DEVDMAADDRESS = (uint32_t)data;
+		dma->UOTGHS_DEVDMACONTROL = UOTGHS_DEVDMACONTROL_BUFF_LENGTH(length) | UOTGHS_DEVDMACONTROL_CHANN_ENB;
+
+		while (dma->UOTGHS_DEVDMASTATUS & UOTGHS_DEVDMASTATUS_CHANN_ENB)
+			;
+		// Only the CPU copy advances this. Keep it in step in case the bank is finished by the CPU.
+		_endpointBuffer[endpoint] += length;
+	}
+
 	// Returns -1 if nothing was available.
 	int16_t _readByteFromEndpoint(const uint8_t endpoint) {
 		// We use a while in the case where the last read emptied the buffer.
@@ -377,10 +440,15 @@ namespace Motate {
 			}
 
 			int16_t to_read = available < length ? available : length;
-			int16_t i = to_read;
 
-			while (i--) {
-				*ptr_dest++ = *_endpointBuffer[endpoint]++;
+			if (_canUseDMA(endpoint, ptr_dest, to_read)) {
+				_transferWithDMA(endpoint, ptr_dest, to_read);
+				ptr_dest += to_read;
+			} else {
+				int16_t i = to_read;
+				while (i--) {
+					*ptr_dest++ = *_endpointBuffer[endpoint]++;
+				}
 			}
 			available -= to_read;
 			length -= to_read;
@@ -424,8 +492,20 @@ namespace Motate {
 				_resetEndpointBuffer(endpoint);
 			}
 
-			while (_isReadWriteAllowed(endpoint) && length--) {
+			// The room left in the bank is known, so the bank is filled by DMA without
+			// testing RWALL for every byte.
+			int16_t room = endpointSizes[endpoint] - _getEndpointBufferCount(endpoint);
+			int16_t to_send = room < length ? room : length;
+			if ((to_send > 0) && _canUseDMA(endpoint, ptr_src, to_send)) {
+				_transferWithDMA(endpoint, ptr_src, to_send);
+				ptr_src += to_send;
+				length -= to_send;
+				sent += to_send;
+			}
+
+			while (_isReadWriteAllowed(endpoint) && length > 0) {
 				*_endpointBuffer[endpoint]++ = *ptr_src++;
+				length--;
 				sent++;
 			}
 
@@ -643,14 +723,17 @@ namespace Motate {
 
 //						UDD_InitEndpoints(EndPoints, (sizeof(EndPoints) / sizeof(EndPoints[0])));
 
-						// _configuration should be set to 1 for high-speed, and 2 for full-speed
+						// There is one configuration. The endpoint sizes depend on the speed negotiated at
+						// reset: 512 byte bulk packets at high-speed, the "other speed" sizes at full-speed.
 						_configuration = setup.valueLow();
 
+						const bool fullSpeed = !_isHighSpeed();
+						_dpramUsed = endpointSizes[0]; // the endpoints after 0 are allocated again
 						uint8_t first_endpoint, total_endpoints;
 						total_endpoints = USBProxy.getEndpointCount(first_endpoint);
 						for (uint8_t ep = first_endpoint; ep < total_endpoints; ep++) {
-							_initEndpoint(ep, USBProxy.getEndpointConfig(ep, /* otherSpeed = */ _configuration == 2));
-							endpointSizes[ep] = USBProxy.getEndpointSize(ep, /* otherSpeed = */ _configuration == 2);
+							_initEndpoint(ep, USBProxy.getEndpointConfig(ep, /* otherSpeed = */ fullSpeed));
+							endpointSizes[ep] = USBProxy.getEndpointSize(ep, /* otherSpeed = */ fullSpeed);
 						}
 						ok = true;
 
@@ -383,9 +383,11 @@ namespace Motate {
 
 										 uint8_t  _ConfigAttributes,
 
-										 uint16_t  _MaxPowerConsumption
+										 uint16_t  _MaxPowerConsumption,
+
+										 uint8_t  _DescriptorType = kConfigurationDescriptor /* or kOtherDescriptor */
 										)
-		: Header(sizeof(USBDescriptorConfigurationHeader_t), kConfigurationDescriptor),
+		: Header(sizeof(USBDescriptorConfigurationHeader_t), _DescriptorType),
         TotalConfigurationSize(_TotalConfigurationSize),
         TotalInterfaces(_TotalInterfaces),
 
@@ -453,18 +455,21 @@ namespace Motate {
 		USBDescriptorConfiguration_t(
 									 uint8_t _ConfigAttributes,
 									 uint16_t _MaxPowerConsumption,
-									 bool _OtherConfig
+									 bool _OtherConfig,
+									 uint8_t _DescriptorType = kConfigurationDescriptor
 									 ) :
 			USBDescriptorConfigurationHeader_t(
 											   /* _TotalConfigurationSize = */ sizeof(_this_type),
 											   /*        _TotalInterfaces = */ _total_interfaces_used,
 
-											   /*    _ConfigurationNumber = */ _OtherConfig ? 2 : 1,
+											   /*    _ConfigurationNumber = */ 1, /* the same configuration at either speed */
 											   /*  _ConfigurationStrIndex = */ 0, /* Fixme? */
 
 											   /*       _ConfigAttributes = */ _ConfigAttributes,
 
-											   /*    _MaxPowerConsumption = */ _MaxPowerConsumption
+											   /*    _MaxPowerConsumption = */ _MaxPowerConsumption,
+
+											   /*         _DescriptorType = */ _DescriptorType
 											   ),
 			_config_mixin_0_type(_interface_0_first_endpoint, _interface_0_number, _OtherConfig),
 			_config_mixin_1_type(_interface_1_first_endpoint, _interface_1_number, _OtherConfig),
@@ -615,11 +620,15 @@ namespace Motate {
 		uint16_t tempSize = 0;
 		if (USBDeviceSpeed == kUSBDeviceHighSpeed) {
 			// Note that other_speed only applies to high-speed devices
-			if (endpointType == kEndpointTypeIsochronous || endpointType == kEndpointTypeInterrupt) {
-				tempSize = otherSpeed ? 512 : 1024;
+			// and gives the full-speed limits below.
+			if (endpointType == kEndpointTypeIsochronous) {
+				tempSize = otherSpeed ? 1023 : 1024;
+			}
+			else if (endpointType == kEndpointTypeInterrupt) {
+				tempSize = otherSpeed ? 64 : 1024;
 			}
 			else if (endpointType == kEndpointTypeBulk) {
-				tempSize = otherSpeed ? 256 : 512;
+				tempSize = otherSpeed ? 64 : 512; // high-speed bulk endpoints must be exactly 512
 			} else {
 				tempSize = 64; // maximum size for all other full-speed endpoints is 64
 			}
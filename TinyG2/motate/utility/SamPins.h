@@ -64,6 +64,21 @@ namespace Motate {
 		kDebounce       = 1<<5,
 #endif // !MOTATE_AVR_COMPATIBILITY && !MOTATE_SAM_COMPATIBILITY
 	};
+
+	// Pin change interrupts. The PIO has a single interrupt per port, so the
+	// handler (PIOx_Handler) must sort out the pins with Port32::getInterruptStatus()
+	enum PinInterruptOptions {
+		kPinInterruptsOff            = 0,
+		kPinInterruptOnChange        = 1<<0,	// both edges
+		kPinInterruptOnRisingEdge    = 1<<1,
+		kPinInterruptOnFallingEdge   = 1<<2,
+
+		kPinInterruptPriorityHighest = 1<<5,
+		kPinInterruptPriorityHigh    = 1<<6,
+		kPinInterruptPriorityMedium  = 1<<7,
+		kPinInterruptPriorityLow     = 1<<8,
+		kPinInterruptPriorityLowest  = 1<<9,
+	};
 	
 	typedef uint32_t uintPort_t;
 
@@ -110,6 +125,10 @@ namespace Motate {
 			// stub
 			return 0;
 		};
+		uintPort_t getInterruptStatus() {
+			// stub
+			return 0;
+		};
 		
 		/* SAM specific: */
 		void enablePeripheralClock();
@@ -138,6 +157,7 @@ namespace Motate {
 		uint8_t get() { return 0; };
 		uint8_t getInputValue() { return 0; };
 		uint8_t getOutputValue() { return 0; };
+		void setInterrupts(const uint32_t interrupts) {};
 		static uint32_t maskForPort(const uint8_t otherPortLetter) { return 0; };
 		bool isNull() { return true; };
 	};
@@ -290,13 +310,40 @@ namespace Motate {
 				(*PIO ## registerLetter).PIO_ODSR ^= mask;\
 			};\
 			uint8_t get() { /* WARNING: This will fail if the peripheral clock is disabled for this pin!!! Use getOutputValue() instead. */\
-				return (*PIO ## registerLetter).PIO_PDSR & mask;\
+				return ((*PIO ## registerLetter).PIO_PDSR & mask) ? 1 : 0;\
 			};\
-			uint8_t getInputValue() {\
-				return (*PIO ## registerLetter).PIO_PDSR & mask;\
+			uint8_t getInputValue() { /* masks above bit 7 don't fit a uint8_t - return 0 or 1 */\
+				return ((*PIO ## registerLetter).PIO_PDSR & mask) ? 1 : 0;\
 			};\
 			uint8_t getOutputValue() {\
-				return (*PIO ## registerLetter).PIO_OSR & mask;\
+				return ((*PIO ## registerLetter).PIO_OSR & mask) ? 1 : 0;\
+			};\
+			void setInterrupts(const uint32_t interrupts) { /* the port ISR is shared - off only masks this pin */\
+				(*PIO ## registerLetter).PIO_IDR = mask;\
+				if (interrupts == kPinInterruptsOff)\
+					return;\
+				if (interrupts & (kPinInterruptOnRisingEdge | kPinInterruptOnFallingEdge)) {\
+					(*PIO ## registerLetter).PIO_AIMER = mask; /*Additional modes*/\
+					(*PIO ## registerLetter).PIO_ESR = mask; /*Edge, not level*/\
+					if (interrupts & kPinInterruptOnRisingEdge)\
+						(*PIO ## registerLetter).PIO_REHLSR = mask;\
+					else\
+						(*PIO ## registerLetter).PIO_FELLSR = mask;\
+				} else {\
+					(*PIO ## registerLetter).PIO_AIMDR = mask; /*Any change*/\
+				}\
+				if (interrupts & kPinInterruptPriorityHighest)\
+					NVIC_SetPriority(PIO ## registerLetter ## _IRQn, 0);\
+				else if (interrupts & kPinInterruptPriorityHigh)\
+					NVIC_SetPriority(PIO ## registerLetter ## _IRQn, 3);\
+				else if (interrupts & kPinInterruptPriorityMedium)\
+					NVIC_SetPriority(PIO ## registerLetter ## _IRQn, 7);\
+				else if (interrupts & kPinInterruptPriorityLow)\
+					NVIC_SetPriority(PIO ## registerLetter ## _IRQn, 11);\
+				else if (interrupts & kPinInterruptPriorityLowest)\
+					NVIC_SetPriority(PIO ## registerLetter ## _IRQn, 15);\
+				(*PIO ## registerLetter).PIO_IER = mask;\
+				NVIC_EnableIRQ(PIO ## registerLetter ## _IRQn);\
 			};\
 			bool isNull() { return false; };\
 			static uint32_t maskForPort(const uint8_t otherPortLetter) {\
@@ -406,6 +453,9 @@ namespace Motate {
 			uintPort_t getOutputValues(const uintPort_t mask) {\
 				return (*PIO ## registerLetter).PIO_OSR & mask;\
 			};\
+			uintPort_t getInterruptStatus() { /* reading clears the change flags for the whole port */\
+				return (*PIO ## registerLetter).PIO_ISR & (*PIO ## registerLetter).PIO_IMR;\
+			};\
 			Pio* portPtr() {\
 				return (PIO ## registerLetter);\
 			};\
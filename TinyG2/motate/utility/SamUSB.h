@@ -92,8 +92,10 @@ namespace Motate {
 	static const EndpointBufferSettings_t getBufferSizeFlags(const uint16_t speed) {
 		if (speed > 512) {
 			return kEnpointBufferSizeUpTo1024;
-		} else if (speed > 128) {
+		} else if (speed > 256) {
 			return kEnpointBufferSizeUpTo512;
+		} else if (speed > 128) {
+			return kEnpointBufferSizeUpTo256;
 		} else if (speed > 64) {
 			return kEnpointBufferSizeUpTo128;
 		} else if (speed > 32) {
@@ -159,6 +161,7 @@ namespace Motate {
 	extern void _resetEndpointBuffer(const uint8_t endpoint);
 	extern void _freezeUSBClock();
 	extern void _flushEndpoint(uint8_t endpoint);
+	extern bool _isHighSpeed();
 
 	extern uint32_t _inited;
 	extern uint32_t _configuration;
@@ -321,6 +324,17 @@ namespace Motate {
 			return false;
 		};
 
+		// True once the host has completed the high-speed handshake during the bus reset.
+		// The descriptors and endpoint banks describe the speed the device is running at.
+		static bool isHighSpeed() {
+			return _isHighSpeed();
+		};
+
+		// True once the host has selected a configuration - interfaces without a line state use this.
+		static bool isConfigured() {
+			return _configuration != 0;
+		};
+
 		static int16_t availableToRead(const uint8_t endpoint) {
 			return _getEndpointBufferCount(endpoint);
 		}
@@ -25,7 +25,15 @@
  * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 #include "tinyg2.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "hardware.h"
 #include "persistence.h"
+
+#include "MotateTimers.h"
+using Motate::SysTickTimer;
 
 #ifdef __cplusplus
 extern "C"{
@@ -34,22 +42,213 @@ extern "C"{
 /***********************************************************************************
  **** STRUCTURE ALLOCATIONS ********************************************************
  ***********************************************************************************/
+/*
+ *	Flash can only be programmed a page at a time and the page is erased as part of
+ *	the program, so persisted values are kept as a log rather than at fixed addresses:
+ *
+ *	  - Writes are collected in a RAM pending list. A second write to the same index
+ *		replaces the pending value, so a burst of cmd_persist() calls costs one page.
+ *	  - persistence_callback() programs the pending list into the next page of the 
+ *		log once the writes have been quiet for NVM_WRITE_HOLDOFF_MS and the machine 
+ *		is idle. A page program stalls reads from flash bank 1 for several ms, so 
+ *		it's never done while the planner or steppers are running.
+ *	  - The pages are written in turn around the whole area (wear leveling). Any
+ *		still-current records in the page after the one being written are copied 
+ *		into it first, so the page that gets erased next never holds the only 
+ *		copy of a value - even if power fails during the program.
+ *	  - persistence_init() scans the log oldest to newest and builds nvm.loc[], 
+ *		which maps each cfgArray index to its newest record.
+ *
+ *	Each page has a sequence number and a checksum, so a page that was only partly
+ *	programmed is ignored. An index with no record reads as erased NVM (NaN).
+ */
+
+typedef struct nvmRecord {
+	uint16_t index;							// cfgArray index
+	uint16_t check;							// ~index - an erased or torn record fails this
+	float value;
+} nvmRecord_t;
+
+typedef struct nvmPage {
+	uint32_t sequence;						// increments with every page written
+	uint16_t magic;							// NVM_PAGE_MAGIC
+	uint16_t checksum;						// sum of the record words
+	nvmRecord_t rec[NVM_PAGE_RECORDS];
+} nvmPage_t;
+
+#define NVM_PAGE_MAGIC 0x4E56				// "NV"
+#define NVM_EMPTY_INDEX 0xFFFF				// index of an unused (erased) record
+#define NVM_NO_RECORD 0						// nvm.loc[] value for an index with no record
 
+typedef struct nvmSingleton {
+	uint32_t sequence;						// sequence number of the newest page
+	uint8_t head;							// next page to program
+	uint8_t pending_count;					// entries in pending[]
+	uint32_t pending_tick;					// SysTick of the last write into pending[]
+	uint16_t loc[NVM_INDEX_MAX];			// newest record number + 1 for each index
+	nvmRecord_t pending[NVM_PENDING_MAX];	// values waiting to be programmed
+	nvmPage_t page;							// page being assembled for programming
+} nvmSingleton_t;
+
+static nvmSingleton_t nvm;
 
 /***********************************************************************************
  **** GENERIC STATIC FUNCTIONS AND VARIABLES ***************************************
  ***********************************************************************************/
 
+static stat_t _write_page(void);
+
+#define _page_addr(p) ((nvmPage_t *)(NVM_FLASH_ADDR + ((p) * NVM_PAGE_SIZE)))
+#define _record_number(p,r) ((uint16_t)(((p) * NVM_PAGE_RECORDS) + (r) + 1))
+#define _next_page(p) ((uint8_t)(((p) + 1) % NVM_PAGES))
+
+static uint16_t _checksum(const nvmPage_t *page)
+{
+	const uint16_t *w = (const uint16_t *)page->rec;
+	uint16_t sum = 0;
+	for (uint16_t i=0; i < (sizeof(page->rec) / sizeof(uint16_t)); i++) { sum += w[i];}
+	return (sum);
+}
+
+static uint8_t _page_is_valid(const nvmPage_t *page)
+{
+	if (page->magic != NVM_PAGE_MAGIC) return (false);
+	return ((page->checksum == _checksum(page)) ? true : false);
+}
+
+static uint8_t _record_is_valid(const nvmRecord_t *rec)
+{
+	if (rec->index >= NVM_INDEX_MAX) return (false);			// also catches NVM_EMPTY_INDEX
+	return ((rec->check == (uint16_t)~rec->index) ? true : false);
+}
+
+static nvmRecord_t *_find_pending(uint16_t index)
+{
+	for (uint8_t i=0; i<nvm.pending_count; i++) {
+		if (nvm.pending[i].index == index) return (&nvm.pending[i]);
+	}
+	return (NULL);
+}
+
+static uint8_t _machine_is_idle(void)
+{
+	if (cm.cycle_state != CYCLE_OFF) return (false);
+	return ((mp_get_runtime_busy() == true) ? false : true);
+}
+
+/*
+ * write_flash_page() - erase and program one page of flash bank 1
+ * _program_page()	  - program one page of the log from nvm.page
+ *
+ *	Bank 1 is programmed by EFC1 while code runs from bank 0, so interrupts don't
+ *	have to be disabled (this assumes the firmware fits in bank 0). Wait states are
+ *	raised to 6 for the program as the SAM3X errata requires, and restored after.
+ *	write_flash_page() is also used by the program store (see program_store.h).
+ */
+stat_t write_flash_page(const uint32_t address, const uint32_t *data)
+{
+	const int EEFC_FCMD_EWP = 0x03;			// erase page and write page
+	const int EEFC_KEY = 0x5A;
+	volatile uint32_t *dst = (volatile uint32_t *)address;
+	uint32_t fmr = EFC1->EEFC_FMR;
+
+	EFC1->EEFC_FMR = (fmr & ~EEFC_FMR_FWS_Msk) | EEFC_FMR_FWS(6);
+	for (uint8_t i=0; i < (IFLASH1_PAGE_SIZE / sizeof(uint32_t)); i++) {
+		dst[i] = data[i];					// fills the page latch buffer
+	}
+	EFC1->EEFC_FCR = EEFC_FCR_FCMD(EEFC_FCMD_EWP) |
+		EEFC_FCR_FARG((address - IFLASH1_ADDR) / IFLASH1_PAGE_SIZE) |
+		EEFC_FCR_FKEY(EEFC_KEY);
+	uint32_t fsr;
+	while (((fsr = EFC1->EEFC_FSR) & EEFC_FSR_FRDY) == 0);
+	EFC1->EEFC_FMR = fmr;
+
+	if (fsr & (EEFC_FSR_FCMDE | EEFC_FSR_FLOCKE)) return (STAT_ERROR);
+	return (STAT_OK);
+}
+
+static stat_t _program_page(uint8_t p)
+{
+	return (write_flash_page((uint32_t)_page_addr(p), (const uint32_t *)&nvm.page));
+}
+
+/*
+ * _write_page() - program the next page of the log
+ *
+ *	Current records from the page after head are carried forward first, then as 
+ *	much of the pending list as fits. Anything left stays pending for the next page.
+ */
+static stat_t _write_page()
+{
+	uint8_t victim = _next_page(nvm.head);
+	nvmPage_t *vp = _page_addr(victim);
+	uint8_t n = 0;
+	uint8_t moved;
+
+	memset(&nvm.page, 0xFF, sizeof(nvm.page));
+	if (_page_is_valid(vp) == true) {
+		for (uint8_t r=0; r<NVM_PAGE_RECORDS; r++) {
+			nvmRecord_t *rec = &vp->rec[r];
+			if ((_record_is_valid(rec) == false) || (nvm.loc[rec->index] != _record_number(victim, r))) continue;
+			nvm.page.rec[n++] = *rec;
+		}
+	}
+	moved = n;
+	while ((n < NVM_PAGE_RECORDS) && (nvm.pending_count > 0)) {
+		nvm.page.rec[n++] = nvm.pending[--nvm.pending_count];
+	}
+	nvm.page.sequence = nvm.sequence + 1;
+	nvm.page.magic = NVM_PAGE_MAGIC;
+	nvm.page.checksum = _checksum(&nvm.page);
+
+	if (_program_page(nvm.head) != STAT_OK) {	// put the pending writes back and retry later
+		for (uint8_t r=moved; (r<n) && (nvm.pending_count < NVM_PENDING_MAX); r++) {
+			nvm.pending[nvm.pending_count++] = nvm.page.rec[r];
+		}
+		return (STAT_ERROR);
+	}
+	for (uint8_t r=0; r<n; r++) {			// point the index map at the new copies
+		nvm.loc[nvm.page.rec[r].index] = _record_number(nvm.head, r);
+	}
+	nvm.sequence++;
+	nvm.head = _next_page(nvm.head);
+	return (STAT_OK);
+}
 
 /***********************************************************************************
  **** CODE *************************************************************************
  ***********************************************************************************/
 
+/*
+ * persistence_init() - find the newest page and build the index map from the log
+ */
 void persistence_init()
 {
-//	cs.nvm_base_addr = NVM_BASE_ADDR;
-//	cs.nvm_profile_base = cfg.nvm_base_addr;
-	return;	
+	uint8_t newest = 0;
+	uint8_t found = false;
+
+	memset(&nvm, 0, sizeof(nvm));
+	for (uint8_t p=0; p<NVM_PAGES; p++) {
+		nvmPage_t *page = _page_addr(p);
+		if (_page_is_valid(page) == false) continue;
+		if ((found == false) || (page->sequence > nvm.sequence)) {
+			newest = p;
+			nvm.sequence = page->sequence;
+			found = true;
+		}
+	}
+	if (found == false) return;				// blank NVM - start at page 0
+
+	nvm.head = _next_page(newest);
+	for (uint8_t i=0, p=nvm.head; i<NVM_PAGES; i++, p=_next_page(p)) {	// oldest to newest
+		nvmPage_t *page = _page_addr(p);
+		if (_page_is_valid(page) == false) continue;
+		for (uint8_t r=0; r<NVM_PAGE_RECORDS; r++) {
+			if (_record_is_valid(&page->rec[r]) == true) {
+				nvm.loc[page->rec[r].index] = _record_number(p, r);
+			}
+		}
+	}
 }
 
 /* 
@@ -57,32 +256,70 @@ void persistence_init()
  * write_persistent_value() - write to NVM by index, but only if the value has changed
  *
  *	It's the responsibility of the caller to make sure the index does not exceed range
+ *
+ *	Writes go to the pending list and are programmed later by persistence_callback().
+ *	If the list is full the oldest writes are programmed right away - but only if the 
+ *	machine is idle. Otherwise, or if the page can't be programmed, the write is
+ *	refused with STAT_BUFFER_FULL.
  */
 
 stat_t read_persistent_value(cmdObj_t *cmd)
 {
-//	int8_t nvm_byte_array[NVM_VALUE_LEN];
-//	uint16_t nvm_address = cfg.nvm_profile_base + (cmd->index * NVM_VALUE_LEN);
-//	(void)EEPROM_ReadBytes(nvm_address, nvm_byte_array, NVM_VALUE_LEN);
-//	memcpy(&cmd->value, &nvm_byte_array, NVM_VALUE_LEN);
+	if (cmd->index >= NVM_INDEX_MAX) return (STAT_INTERNAL_RANGE_ERROR);
+
+	nvmRecord_t *rec = _find_pending(cmd->index);
+	if (rec == NULL) {
+		uint16_t loc = nvm.loc[cmd->index];
+		if (loc == NVM_NO_RECORD) {
+			uint32_t erased = 0xFFFFFFFF;	// reads the same as erased EEPROM
+			memcpy(&cmd->value, &erased, sizeof(cmd->value));
+			return (STAT_OK);
+		}
+		loc--;
+		rec = &_page_addr(loc / NVM_PAGE_RECORDS)->rec[loc % NVM_PAGE_RECORDS];
+	}
+	cmd->value = rec->value;
 	return (STAT_OK);
 }
 
 stat_t write_persistent_value(cmdObj_t *cmd)
 {
-//	float tmp = cmd->value;
-//	ritorno(cmd_read_NVM_value(cmd));
-//	if (cmd->value != tmp) {		// catches the isnan() case as well
-//		cmd->value = tmp;
-//		int8_t nvm_byte_array[NVM_VALUE_LEN];
-//		memcpy(&nvm_byte_array, &tmp, NVM_VALUE_LEN);
-//		uint16_t nvm_address = cfg.nvm_profile_base + (cmd->index * NVM_VALUE_LEN);
-//		(void)EEPROM_WriteBytes(nvm_address, nvm_byte_array, NVM_VALUE_LEN);
-//	}
+	float tmp = cmd->value;
+	ritorno(read_persistent_value(cmd));
+	if (cmd->value == tmp) { return (STAT_OK);}	// NaN never compares equal, so it's always written
+	cmd->value = tmp;
+
+	nvmRecord_t *rec = _find_pending(cmd->index);
+	if (rec == NULL) {
+		if (nvm.pending_count >= NVM_PENDING_MAX) {
+			if (_machine_is_idle() == false) return (STAT_BUFFER_FULL);
+			_write_page();
+			if (nvm.pending_count >= NVM_PENDING_MAX) return (STAT_BUFFER_FULL);
+		}
+		rec = &nvm.pending[nvm.pending_count++];
+		rec->index = cmd->index;
+		rec->check = (uint16_t)~cmd->index;
+	}
+	rec->value = tmp;
+	nvm.pending_tick = SysTickTimer.getValue();
+	controller_request_task(TASK_PERSISTENCE);
+	return (STAT_OK);
+}
+
+/*
+ * persistence_callback() - program pending writes into flash once the machine is idle
+ *
+ *	Programs at most one page per call so the controller keeps running between pages.
+ */
+stat_t persistence_callback()
+{
+	if (nvm.pending_count == 0) return (STAT_NOOP);
+	if ((SysTickTimer.getValue() - nvm.pending_tick) < NVM_WRITE_HOLDOFF_MS) return (STAT_OK);
+	if (_machine_is_idle() == false) return (STAT_OK);
+	_write_page();
 	return (STAT_OK);
 }
 
 #ifdef __cplusplus
 }
 #endif
-
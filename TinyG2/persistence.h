@@ -33,9 +33,26 @@
 extern "C"{
 #endif 
 
+/*
+ * NVM is kept in the last 16Kb of internal flash (the top lock region of bank 1),
+ * which is taken out of the "rom" region in gcc_flash.ld so the linker can't put
+ * code there. The area is a circular log of pages. Each page holds a header and 
+ * NVM_PAGE_RECORDS records of {index, value}. The newest record for an index wins.
+ * See persistence.cpp for the details.
+ */
+#define NVM_PAGE_SIZE IFLASH1_PAGE_SIZE			// 256 bytes - the smallest unit that can be programmed
+#define NVM_PAGES 64							// pages in the log (must fit in one lock region)
+#define NVM_FLASH_ADDR (IFLASH1_ADDR + IFLASH1_SIZE - (NVM_PAGES * NVM_PAGE_SIZE))
+#define NVM_PAGE_RECORDS 31						// (NVM_PAGE_SIZE - header) / record size
+#define NVM_INDEX_MAX 768						// highest cfgArray index that can be persisted (+1) - checked in config_app.cpp
+#define NVM_PENDING_MAX 64						// writes held in RAM waiting to be programmed
+#define NVM_WRITE_HOLDOFF_MS 250				// program once writes have been quiet this long
+
 void persistence_init(void);
 stat_t read_persistent_value(cmdObj_t *cmd);
 stat_t write_persistent_value(cmdObj_t *cmd);
+stat_t persistence_callback(void);
+stat_t write_flash_page(const uint32_t address, const uint32_t *data);
 
 #ifdef __DEBUG
 void cfg_dump_NVM(const uint16_t start_record, const uint16_t end_record, uint8_t *label);
@@ -23,10 +23,14 @@
 
 #include "tinyg2.h"
 #include "config.h"
+#include "controller.h"
 #include "canonical_machine.h"
 #include "plan_arc.h"
 #include "planner.h"
 #include "util.h"
+#include "benchmark.h"
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
 
 #ifdef __cplusplus
 extern "C"{
@@ -43,6 +47,7 @@ static stat_t _compute_center_arc(void);
 static stat_t _get_arc_radius(void);
 static float _get_arc_time (const float linear_travel, const float angular_travel, const float radius);
 static float _get_theta(const float x, const float y);
+static stat_t _test_arc_soft_limits(float point[]);
 
 static stat_t _setup_arc(const GCodeState_t *gm_arc, 	// gcode model state
 			  const float i, const float j, const float k,
@@ -73,9 +78,10 @@ void cm_arc_init()
 /*
  * cm_arc_feed() - canonical machine entry point for arc
  *
- * Generates an arc by queueing line segments to the move buffer.
- * The arc is approximated by generating a large number of tiny, linear
- * segments.
+ * With __PLANNER_ARC_MOVES the arc is queued to the planner as a single
+ * arc move that is interpolated at runtime (see mp_arc()). Otherwise the 
+ * arc is approximated by generating a large number of tiny, linear
+ * segments that are queued by cm_arc_callback().
  */
 stat_t cm_arc_feed(float target[], float flags[],	// arc endpoints
 				   float i, float j, float k, 		// offsets
@@ -108,7 +114,9 @@ stat_t cm_arc_feed(float target[], float flags[],	// arc endpoints
 
 	cm_set_model_arc_offset(i,j,k);
 	cm_set_model_arc_radius(radius);
-//	ritorno(_test_arc_soft_limits());
+#ifdef __COORD_TRANSFORM
+	ritorno(cm_transform_arc());					// the center and radius follow the endpoints (G68, G51)
+#endif
 
 //	cm_set_work_offsets(&gm);						// capture the fully resolved offsets to the state
 //	cm_cycle_start();								// if not already started
@@ -125,7 +133,9 @@ stat_t cm_arc_feed(float target[], float flags[],	// arc endpoints
 //	}
 
 	// execute the move by calling a bunch of helpers
+	BENCHMARK_ARC_START
 	status = _compute_center_arc();
+	BENCHMARK_ARC_END
 	cm_conditional_set_model_position(status);	// set endpoint position if the move was successful
 	return (status);
 }
@@ -137,20 +147,34 @@ stat_t cm_arc_feed(float target[], float flags[],	// arc endpoints
  *	Each time it's called it queues as many arc segments (lines) as it can 
  *	before it blocks, then returns.
  *
+ *	Each segment point is the previous one rotated about the center by the 
+ *	constant segment angle, which is 4 multiplies instead of a sin and cos. 
+ *	The point is computed exactly every ARC_CORRECTION_SEGMENTS to keep the
+ *	accumulated rounding off the circle (see planner.h).
+ *
  *  Parts of this routine were originally sourced from the grbl project.
  */
 
 stat_t cm_arc_callback() 
 {
 	if (arc.run_state == MOVE_STATE_OFF) { return (STAT_NOOP);}
-	if (mp_get_planner_buffers_available() < PLANNER_BUFFER_HEADROOM) { return (STAT_EAGAIN);}
+	if (mp_planner_has_room(1) == false) { return (STAT_EAGAIN);}	// one segment per pass
 	if (arc.run_state == MOVE_STATE_RUN) {
 		if (--arc.segment_count > 0) {
 			arc.theta += arc.segment_theta;
-			arc.gm.target[arc.axis_1] = arc.center_1 + sin(arc.theta) * arc.radius;
-			arc.gm.target[arc.axis_2] = arc.center_2 + cos(arc.theta) * arc.radius;
+			if (--arc.correction_count == 0) {
+				arc.gm.target[arc.axis_1] = arc.center_1 + sinf(arc.theta) * arc.radius;
+				arc.gm.target[arc.axis_2] = arc.center_2 + cosf(arc.theta) * arc.radius;
+				arc.correction_count = ARC_CORRECTION_SEGMENTS;
+			} else {
+				float r_1 = arc.position[arc.axis_1] - arc.center_1;
+				float r_2 = arc.position[arc.axis_2] - arc.center_2;
+				arc.gm.target[arc.axis_1] = arc.center_1 + r_1 * arc.segment_cos + r_2 * arc.segment_sin;
+				arc.gm.target[arc.axis_2] = arc.center_2 + r_2 * arc.segment_cos - r_1 * arc.segment_sin;
+			}
 			arc.gm.target[arc.axis_linear] += arc.segment_linear_travel;
 			mp_aline(&arc.gm);								// run the line
+			arc.gm.curve_tangent = true;					// the rest continue along the arc
 			copy_axis_vector(arc.position, arc.gm.target);	// update arc current position	
 			return (STAT_EAGAIN);
 		} else {
@@ -179,6 +203,7 @@ void cm_abort_arc()
  * _compute_center_arc() - compute arc from I and J (arc center point)
  * _get_arc_radius() 	 - compute arc center (offset) from radius.
  * _get_arc_time()		 - compute time to complete arc at current feed rate
+ * _test_arc_soft_limits() - test the arc endpoint and extents against the soft limits
  */
 /*
  * _setup_arc() - setup an arc move for runtime
@@ -202,7 +227,7 @@ static stat_t _setup_arc(const GCodeState_t *gm_arc, 	// gcode model state
 	arc.gm.linenum = cm_get_linenum(MODEL);
 
 	// length is the total mm of travel of the helix (or just a planar arc)
-	arc.length = hypot(angular_travel * radius, fabs(linear_travel));
+	arc.length = hypotf(angular_travel * radius, fabsf(linear_travel));
 	if (arc.length < cm.arc_segment_len) return (STAT_MINIMUM_LENGTH_MOVE_ERROR); // too short to draw
 
 	// load the arc controller singleton
@@ -220,12 +245,40 @@ static stat_t _setup_arc(const GCodeState_t *gm_arc, 	// gcode model state
 	arc.axis_linear = axis_linear;
 	arc.angular_travel = angular_travel;
 	arc.linear_travel = linear_travel;
-	
+	arc.center_1 = arc.position[arc.axis_1] - sinf(arc.theta) * arc.radius;
+	arc.center_2 = arc.position[arc.axis_2] - cosf(arc.theta) * arc.radius;
+
+	float point[AXES];								// the endpoint in axis order
+	copy_axis_vector(point, gm_arc->target);
+	point[axis_1] = arc.endpoint[axis_1];
+	point[axis_2] = arc.endpoint[axis_2];
+	point[axis_linear] = arc.endpoint[axis_linear];
+	ritorno(_test_arc_soft_limits(point));
+
+#ifdef __PLANNER_ARC_MOVES
+	// queue the whole arc as one planner move
+	mpArc_t geometry;
+	geometry.center_1 = arc.center_1;
+	geometry.center_2 = arc.center_2;
+	geometry.radius = arc.radius;
+	geometry.theta = arc.theta;
+	geometry.angular_travel = arc.angular_travel;
+	geometry.linear_travel = arc.linear_travel;
+	geometry.length = arc.length;
+	geometry.axis_1 = arc.axis_1;
+	geometry.axis_2 = arc.axis_2;
+	geometry.axis_linear = arc.axis_linear;
+
+	arc.gm.target[axis_1] = arc.endpoint[axis_1];	// put the endpoint back in axis order
+	arc.gm.target[axis_2] = arc.endpoint[axis_2];
+	arc.gm.target[axis_linear] = arc.endpoint[axis_linear];
+	return (mp_arc(&arc.gm, &geometry));			// gm.move_time is the whole arc time
+#else
 	// Find the minimum number of segments that meets these constraints...
-	float segments_required_for_chordal_accuracy = arc.length / sqrt(4*cm.chordal_tolerance * (2 * radius - cm.chordal_tolerance));
+	float segments_required_for_chordal_accuracy = arc.length / sqrtf(4*cm.chordal_tolerance * (2 * radius - cm.chordal_tolerance));
 	float segments_required_for_minimum_distance = arc.length / cm.arc_segment_len;
 	float segments_required_for_minimum_time = arc.arc_time * MICROSECONDS_PER_MINUTE / MIN_ARC_SEGMENT_USEC;
-	arc.segments = floor(min3(segments_required_for_chordal_accuracy,
+	arc.segments = floorf(min3(segments_required_for_chordal_accuracy,
 							  segments_required_for_minimum_distance,
 							  segments_required_for_minimum_time));
 
@@ -235,10 +288,52 @@ static stat_t _setup_arc(const GCodeState_t *gm_arc, 	// gcode model state
 	arc.segment_count = (uint32_t)arc.segments;
 	arc.segment_theta = arc.angular_travel / arc.segments;
 	arc.segment_linear_travel = arc.linear_travel / arc.segments;
-	arc.center_1 = arc.position[arc.axis_1] - sin(arc.theta) * arc.radius;
-	arc.center_2 = arc.position[arc.axis_2] - cos(arc.theta) * arc.radius;
+	arc.segment_sin = sinf(arc.segment_theta);		// once per arc, not per segment
+	arc.segment_cos = cosf(arc.segment_theta);
+	arc.correction_count = ARC_CORRECTION_SEGMENTS;
 	arc.gm.target[arc.axis_linear] = arc.position[arc.axis_linear];
+
+	// The segments run at the centripetal limit of the arc and meet tangent to it -
+	// the chord angle between them is the arc's own curvature, not a corner
+	arc.gm.curve_vmax = sqrtf(arc.radius * cm.junction_acceleration);
+	arc.gm.curve_tangent = false;					// the first segment joins the move before the arc
 	arc.run_state = MOVE_STATE_RUN;
+	controller_request_task(TASK_ARC);
+	return (STAT_OK);
+#endif // __PLANNER_ARC_MOVES
+}
+
+/*
+ * _test_arc_soft_limits() - test the arc endpoint and extents against the soft limits
+ *
+ *	The extents of an arc in its plane are the points where it crosses the quarter
+ *	angles (theta = 0, 90, 180, 270 deg) between its start and end. Each is tested
+ *	with the other axes at the endpoint, which is tested first. The helix axis moves
+ *	linearly, so its endpoints bound it. This is done once for the arc so the segments
+ *	are not tested as they are queued. Called with the arc singleton set up; point[]
+ *	is the endpoint in axis order and is used as scratch.
+ */
+
+static stat_t _test_arc_soft_limits(float point[])
+{
+	ritorno(cm_test_soft_limits(point));
+
+	float start = arc.theta;
+	float end = arc.theta + arc.angular_travel;
+	int32_t first = (int32_t)ceilf(min(start, end) / (M_PI_F/2));
+	int32_t last = (int32_t)floorf(max(start, end) / (M_PI_F/2));
+
+	for (int32_t quarter = first; quarter <= last; quarter++) {
+		point[arc.axis_1] = arc.center_1;
+		point[arc.axis_2] = arc.center_2;
+		switch (((quarter % 4) + 4) % 4) {			// sin(theta) on axis 1, cos(theta) on axis 2
+			case 0: { point[arc.axis_2] += arc.radius; break;}
+			case 1: { point[arc.axis_1] += arc.radius; break;}
+			case 2: { point[arc.axis_2] -= arc.radius; break;}
+			case 3: { point[arc.axis_1] -= arc.radius; break;}
+		}
+		ritorno(cm_test_soft_limits(point));
+	}
 	return (STAT_OK);
 }
 
@@ -272,26 +367,26 @@ static stat_t _compute_center_arc()
 	if(isnan(theta_end) == true) { return (STAT_ARC_SPECIFICATION_ERROR); }
 
 	// ensure that the difference is positive so we have clockwise travel
-	if (theta_end < theta_start) { theta_end += 2*M_PI; }
+	if (theta_end < theta_start) { theta_end += 2*M_PI_F; }
 
 	// compute angular travel and invert if gcode wants a counterclockwise arc
 	// if angular travel is zero interpret it as a full circle
 	float angular_travel = theta_end - theta_start;
 	if (fp_ZERO(angular_travel)) {
 		if (gm.motion_mode == MOTION_MODE_CCW_ARC) {
-			angular_travel -= 2*M_PI;
+			angular_travel -= 2*M_PI_F;
 		} else {
-			angular_travel = 2*M_PI;
+			angular_travel = 2*M_PI_F;
 		}
 	} else {
 		if (gm.motion_mode == MOTION_MODE_CCW_ARC) {
-			angular_travel -= 2*M_PI;
+			angular_travel -= 2*M_PI_F;
 		}
 	}
 
 	// Find the radius, calculate travel in the depth axis of the helix,
 	// and compute the time it should take to perform the move
-	float radius_tmp = hypot(gmx.arc_offset[gmx.plane_axis_0], gmx.arc_offset[gmx.plane_axis_1]);
+	float radius_tmp = hypotf(gmx.arc_offset[gmx.plane_axis_0], gmx.arc_offset[gmx.plane_axis_1]);
 	float linear_travel = gm.target[gmx.plane_axis_2] - gmx.position[gmx.plane_axis_2];
 	gm.move_time = _get_arc_time(linear_travel, angular_travel, radius_tmp);
 
@@ -394,7 +489,7 @@ static stat_t _get_arc_radius()
 	gmx.arc_offset[2] = 0;
 
 	// == -(h * 2 / d)
-	h_x2_div_d = -sqrt(4 * square(gmx.arc_radius) - (square(x) - square(y))) / hypot(x,y);
+	h_x2_div_d = -sqrtf(4 * square(gmx.arc_radius) - (square(x) - square(y))) / hypotf(x,y);
 
 	// If r is smaller than d the arc is now traversing the complex plane beyond
 	// the reach of any real CNC, and thus - for practical reasons - we will 
@@ -436,12 +531,12 @@ static float _get_arc_time (const float linear_travel, 		// in mm
 {
 	float tmp;
 	float move_time=0;	// picks through the times and retains the slowest
-	float planar_travel = fabs(angular_travel * radius);// travel in arc plane
+	float planar_travel = fabsf(angular_travel * radius);// travel in arc plane
 
 	if (gm.inverse_feed_rate_mode == true) {
 		move_time = gmx.inverse_feed_rate;
 	} else {
-		move_time = sqrt(square(planar_travel) + square(linear_travel)) / gm.feed_rate;
+		move_time = sqrtf(square(planar_travel) + square(linear_travel)) / gm.feed_rate;
 	}
 	if ((tmp = planar_travel/cm.a[gmx.plane_axis_0].feedrate_max) > move_time) {
 		move_time = tmp;
@@ -449,7 +544,7 @@ static float _get_arc_time (const float linear_travel, 		// in mm
 	if ((tmp = planar_travel/cm.a[gmx.plane_axis_1].feedrate_max) > move_time) {
 		move_time = tmp;
 	}
-	if ((tmp = fabs(linear_travel/cm.a[gmx.plane_axis_2].feedrate_max)) > move_time) {
+	if ((tmp = fabsf(linear_travel/cm.a[gmx.plane_axis_2].feedrate_max)) > move_time) {
 		move_time = tmp;
 	}
 	return (move_time);
@@ -464,15 +559,15 @@ static float _get_arc_time (const float linear_travel, 		// in mm
 
 static float _get_theta(const float x, const float y)
 {
-	float theta = atan(x/fabs(y));
+	float theta = atanf(x/fabsf(y));
 
 	if (y>0) {
 		return (theta);
 	} else {
 		if (theta>0) {
-			return ( M_PI-theta);
+			return ( M_PI_F-theta);
     	} else {
-			return (-M_PI-theta);
+			return (-M_PI_F-theta);
 		}
 	}
 }
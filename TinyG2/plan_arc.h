@@ -49,6 +49,9 @@ typedef struct arArcSingleton {	// persistent planner and runtime variables
 	float segment_linear_travel;// linear motion per segment
 	float center_1;				// center of circle at axis 1 (typ X)
 	float center_2;				// center of circle at axis 2 (typ Y)
+	float segment_sin;			// sin and cos of segment_theta for the rotation...
+	float segment_cos;			// ...of the radius vector from one segment to the next
+	uint8_t correction_count;	// segments until the next exact arc point
 
 	GCodeState_t gm;			// Gcode state struct is passed for each arc segment. Usage:
 //	uint32_t linenum;			// line number of the arc feed move - same for each segment
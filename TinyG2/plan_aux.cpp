@@ -0,0 +1,295 @@
+/*
+ * plan_aux.cpp - auxiliary motion queue for asynchronous axes
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "tinyg2.h"
+#include "util.h"
+#include "config.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "text_parser.h"
+
+#ifdef __AUX_MOTION
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**** Aux queue singleton structure ****/
+
+typedef struct auxBlock {		// one block of moves for the asynchronous axes
+	uint8_t axes;				// bit per axis moved by the block
+	float target[AXES];			// absolute machine target of each axis moved
+} auxBlock_t;
+
+typedef struct auxAxis {		// jerk limited profile of one axis in the running block
+	float start;				// position at the start of the block
+	float length;				// signed travel
+	float velocity;				// cruise velocity - the peak if there is no cruise
+	float jerk;					// mm/min^3 or deg/min^3
+	float ramp_time;			// minutes to ramp between 0 and the cruise velocity
+	float body_time;			// minutes at the cruise velocity
+	float time;					// minutes run so far
+} auxAxis_t;
+
+struct auxSingleton {
+	auxBlock_t block[AUX_QUEUE_SIZE];	// block ring - written by the main loop
+	uint8_t w;					// next block to write (main loop)
+	volatile uint8_t r;			// next block to run (exec)
+	volatile uint8_t axes;		// axes still moving in the running block, 0=none running
+	float position[AXES];		// runtime position of the asynchronous axes
+	auxAxis_t a[AXES];
+};
+static struct auxSingleton aux;
+
+#define AUX_NEXT(i) (((i)+1) & (AUX_QUEUE_SIZE-1))
+typedef char aux_queue_size_check[((AUX_QUEUE_SIZE & (AUX_QUEUE_SIZE-1)) == 0) ? 1 : -1];	// a power of 2
+
+static void _start_block(void);
+static float _get_ramp_length(const auxAxis_t *a, const float time);
+static float _get_profile_length(const auxAxis_t *a);
+static stat_t _exec_aux_sync(mpBuf_t *bf);
+
+/*****************************************************************************
+ * mp_queue_aux()		- queue the asynchronous axes of a Gcode target
+ * mp_queue_aux_sync()	- queue a planner buffer that waits for the aux queue to empty
+ * mp_prep_aux()		- add the asynchronous axes to a segment - called by st_prep_line()
+ * mp_exec_aux()		- run a segment for the asynchronous axes alone
+ * mp_set_aux_frame()	- align the runtime with a new planner block
+ *
+ *	Axes with $xas set (A, B or C) are asynchronous: Gcode words for them are taken
+ *	out of the coordinated move by cm_set_model_target() and queued here instead, so
+ *	a tool changer carousel or a pallet axis moves while the cut goes on. Each block
+ *	moves its axes independently, each on its own jerk limited S-curve at $xvm and
+ *	$xjm ($xac and F are not applied), and the next block starts when every axis of
+ *	the running one has arrived. A block with only asynchronous words takes no time
+ *	in the planner queue.
+ *
+ *	The aux runtime has no segments of its own. st_prep_line() asks it for the travel
+ *	over each segment the exec prepares - lines, jogs, shaper drains, and dwells while
+ *	the aux queue is running - and adds the steps to the motors of those axes. When
+ *	the exec has nothing else to run mp_exec_move() runs an aux segment instead, so
+ *	the axes carry on through holds, spindle waits and an empty queue.
+ *
+ *	The planner never moves an asynchronous axis. Its position in mm, mr and every
+ *	queued block is the target of the last aux block queued before the block, which
+ *	mp_set_aux_frame() takes up when the exec starts the block. The axis position
+ *	the runtime reports is the aux position.
+ *
+ *	A feedhold and a queue flush do not stop the aux queue. M6 waits for it to empty
+ *	(mp_queue_aux_sync()) so a carousel is in place before the tool change runs.
+ *	Asynchronous axes are not homed, probed or jogged - clear $xas to do that.
+ */
+void mp_queue_aux(const float target[])
+{
+	uint8_t axes = 0;
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if ((AUX_AXIS(axis) == false) || (fp_EQ(target[axis], mm.position[axis]))) { continue;}
+		aux.block[aux.w].target[axis] = target[axis];
+		axes |= 1 << axis;
+	}
+	if (axes == 0) { return;}
+	while (AUX_NEXT(aux.w) == aux.r);					// the exec frees a block every segment
+	aux.block[aux.w].axes = axes;
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if (axes & (1 << axis)) { mp_set_planner_position(axis, target[axis]);}
+	}
+	aux.w = AUX_NEXT(aux.w);
+	st_request_exec_move();
+}
+
+void mp_queue_aux_sync()
+{
+	mpBuf_t *bf;
+
+	mp_end_coalesce();							// keep the wait behind any held G1 run
+	if ((bf = mp_get_write_buffer()) == NULL) return;	// checked upstream, as mp_queue_command()
+	bf->bf_func = _exec_aux_sync;
+	mp_queue_write_buffer(MOVE_TYPE_COMMAND);
+}
+
+static stat_t _exec_aux_sync(mpBuf_t *bf)
+{
+	mp_run_attached(bf);
+	if (mp_exec_aux() != STAT_NOOP) { return (STAT_OK);}	// runs aux segments until it's empty
+	st_prep_null();
+	mp_free_run_buffer();
+	return (STAT_OK);
+}
+
+void mp_prep_aux(float steps[], const float microseconds)
+{
+	if (aux.axes == 0) {
+		if (aux.r == aux.w) { return;}
+		_start_block();
+	}
+	float dt = microseconds / MICROSECONDS_PER_MINUTE;
+	float travel[AXES] = {0,0,0,0,0,0};
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if ((aux.axes & (1 << axis)) == 0) { continue;}
+		auxAxis_t *a = &aux.a[axis];
+		float position;
+		a->time += dt;
+		if (a->time >= (2 * a->ramp_time + a->body_time)) {
+			position = a->start + a->length;			// lands exactly on the target
+			aux.axes &= ~(1 << axis);
+		} else {
+			position = a->start + copysignf(_get_profile_length(a), a->length);
+		}
+		travel[axis] = position - aux.position[axis];
+		aux.position[axis] = position;
+	}
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		steps[motor] += travel[ik.motor_axis[motor]] * ik.steps_per_unit[motor];
+	}
+	if (aux.axes == 0) { aux.r = AUX_NEXT(aux.r);}		// block done - free it
+}
+
+stat_t mp_exec_aux()
+{
+	if ((aux.axes == 0) && (aux.r == aux.w)) { return (STAT_NOOP);}
+	float steps[MOTORS];
+	for (uint8_t motor=0; motor<MOTORS; motor++) { steps[motor] = 0;}
+	return (st_prep_line(steps, NOM_SEGMENT_USEC));	// the aux steps are added there
+}
+
+void mp_set_aux_frame(const mpBuf_t *bf)
+{
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if (AUX_AXIS(axis)) { mr.position[axis] = bf->gm->target[axis];}
+	}
+}
+
+/*
+ * _start_block() - set up the profile of each axis in the next block
+ *
+ *	Each ramp is a jerk limited S-curve from 0 to the cruise velocity (or back) that
+ *	takes ramp_time = 2*sqrt(v/J) and covers v*sqrt(v/J). A move too short to reach
+ *	$xvm peaks at the velocity whose two ramps cover its length: v = cbrt(J*(L/2)^2).
+ */
+static void _start_block()
+{
+	auxBlock_t *b = &aux.block[aux.r];
+	for (uint8_t axis=AXIS_A; axis<=AXIS_C; axis++) {
+		if ((b->axes & (1 << axis)) == 0) { continue;}
+		auxAxis_t *a = &aux.a[axis];
+		a->start = aux.position[axis];
+		a->length = b->target[axis] - a->start;
+		a->jerk = cm.a[axis].jerk_max * JERK_MULTIPLIER;
+		a->velocity = cm.a[axis].velocity_max;
+		float length = fabsf(a->length);
+		if ((2 * a->velocity * sqrtf(a->velocity / a->jerk)) > length) {
+			a->velocity = cbrtf(a->jerk * square(length / 2));
+		}
+		a->ramp_time = 2 * sqrtf(a->velocity / a->jerk);
+		a->body_time = max((length - a->velocity * a->ramp_time) / a->velocity, (float)0);
+		a->time = 0;
+	}
+	aux.axes = b->axes;
+}
+
+/*
+ * _get_ramp_length()	- length covered by a ramp from 0 after time minutes
+ * _get_profile_length() - unsigned length covered by an axis so far in the block
+ */
+static float _get_ramp_length(const auxAxis_t *a, const float time)
+{
+	float half = a->ramp_time / 2;
+	if (time <= half) { return (a->jerk * time * time * time / 6);}
+	float rest = a->ramp_time - time;
+	return (a->velocity * (time - half) + a->jerk * rest * rest * rest / 6);
+}
+
+static float _get_profile_length(const auxAxis_t *a)
+{
+	float length = fabsf(a->length);
+	if (a->time < a->ramp_time) { return (_get_ramp_length(a, a->time));}
+	if (a->time < (a->ramp_time + a->body_time)) {
+		return (a->velocity * a->ramp_time / 2 + a->velocity * (a->time - a->ramp_time));
+	}
+	return (length - _get_ramp_length(a, 2 * a->ramp_time + a->body_time - a->time));
+}
+
+/*
+ * mp_aux_is_running()	 - TRUE while an aux block is running or queued
+ * mp_abort_aux()		 - drop the aux queue without maintaining position
+ * mp_get_aux_position() - runtime position of an asynchronous axis
+ * mp_set_aux_position() - set it (G28.3, homing and config changes)
+ */
+uint8_t mp_aux_is_running() { return ((aux.axes != 0) || (aux.r != aux.w));}
+
+void mp_abort_aux()
+{
+	aux.axes = 0;
+	aux.r = aux.w;
+}
+
+float mp_get_aux_position(const uint8_t axis) { return (aux.position[axis]);}
+void mp_set_aux_position(const uint8_t axis, const float position) { aux.position[axis] = position;}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * mp_set_as() - make an axis asynchronous or coordinated ($aas, $bas, $cas)
+ *
+ *	Only while the machine is stopped with nothing queued. The planner and runtime
+ *	take up the axis from wherever the aux queue left it, and the other way round.
+ */
+stat_t mp_set_as(cmdObj_t *cmd)
+{
+	uint8_t axis = AXIS_A + (cmd->group[0] - 'a');
+	if (cmd->value > 1) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if ((uint8_t)cmd->value == cm.a[axis].async) { return (STAT_OK);}
+	if ((cm.cycle_state != CYCLE_OFF) || (mp_aux_is_running() == true) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	if (cmd->value > 0) {
+		aux.position[axis] = mr.position[axis];
+	} else {
+		mr.position[axis] = aux.position[axis];
+		mm.position[axis] = aux.position[axis];
+	}
+	set_ui8(cmd);
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_Xas[] PROGMEM = "[%s%s] %s axis asynchronous%13d [0=coordinated,1=aux queue]\n";
+
+void mp_print_as(cmdObj_t *cmd) { fprintf_P(stderr, fmt_Xas, cmd->group, cmd->token, cmd->group, (uint8_t)cmd->value);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __AUX_MOTION
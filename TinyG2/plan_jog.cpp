@@ -0,0 +1,266 @@
+/*
+ * plan_jog.cpp - continuous jogging from streamed velocity targets
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "tinyg2.h"
+#include "util.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "gcode_parser.h"
+#include "report.h"
+#include "xio.h"
+#include "pso.h"
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**** Jog singleton structure ****/
+
+enum jgState {
+	JOG_OFF = 0,				// not jogging
+	JOG_RUN,					// the exec is tracking the targets
+	JOG_END						// stopped - waiting for mp_jog_callback() to end the cycle
+};
+
+struct jgJogSingleton {			// persistent jog runtime variables
+	volatile uint8_t state;		// see jgState
+	volatile uint8_t halt;		// TRUE to stop the jog and ignore new targets (feedhold)
+	volatile uint32_t age;		// microseconds run since the last target (exec)
+	float target[AXES];			// target velocities in mm/min or deg/min (machine axes)
+	float velocity[AXES];		// velocity of each axis at the end of the last segment
+	float accel[AXES];			// acceleration of each axis at the end of the last segment
+};
+static struct jgJogSingleton jog;
+static const char jog_axes[] = "XYZABC";
+
+static float _get_axis_velocity(uint8_t axis, float target, float dt);
+static float _get_stop_distance(uint8_t axis);
+
+/*****************************************************************************
+ * mp_run_jog()			- set the jog velocity targets ({"jog":"X1000 Y-500"})
+ * mp_exec_jog()		- run a jog segment from the exec, in place of the planner
+ * mp_jog_callback()	- main loop callback that ends the cycle once the jog stops
+ * mp_jog_is_running()	- TRUE from the first target until the cycle ends
+ * mp_abort_jog()		- stop a jog without maintaining position
+ *
+ *	A jog is a stream of velocity vectors from a pendant or host, 20-50 times a
+ *	second. Each {"jog":...} gives the velocity of each named axis in the current
+ *	units per minute - unnamed axes are stopped, and {"jog":""} stops them all. The
+ *	velocities are limited to $xvm. The first non-zero vector starts a jog cycle if
+ *	the machine is stopped and nothing is queued.
+ *
+ *	The block planner is not used. The exec runs NOM_SEGMENT_USEC segments straight
+ *	from the mr runtime position, and each axis tracks its target with its own jerk
+ *	($xjm) and acceleration ($xac) limits, so a new vector takes effect on the next
+ *	segment and a release stops in one segment plus the deceleration. If no vector
+ *	arrives for JOG_TIMEOUT_USEC of motion the axes are stopped, so a lost pendant
+ *	can't run the machine into the stops. Homed axes with soft limits are stopped
+ *	short of the envelope. A feedhold stops the jog.
+ *
+ *	When all axes are stopped the jog cycle ends and the Gcode model and planner
+ *	are set to the runtime position. Gcode received while jogging is held until
+ *	then. Jog segments are not shaped and assume the axes are independent.
+ */
+stat_t mp_run_jog(cmdObj_t *cmd)
+{
+	if (cmd->objtype != TYPE_STRING) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	const char *src = (const char *)*cmd->stringp;
+	float target[AXES] = {0,0,0,0,0,0};
+	uint8_t moving = false;
+
+	while (*src != NUL) {
+		if (isspace(*src)) { src++; continue;}
+		char_t *letter = strchr(jog_axes, toupper(*src));
+		if (letter == NULL) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+		uint8_t axis = (uint8_t)((char *)letter - jog_axes);
+		char *end;
+		float velocity = strtof(src+1, &end);
+		if (end == src+1) { return (STAT_BAD_NUMBER_FORMAT);}
+		src = end;
+		if ((cm.a[axis].axis_mode == AXIS_DISABLED) || (AUX_AXIS(axis))) { continue;}
+		if ((gmx.modal.units_mode == INCHES) && (axis < AXIS_A)) { velocity *= MM_PER_INCH;}
+		if (velocity > cm.a[axis].velocity_max) { velocity = cm.a[axis].velocity_max;}
+		if (velocity < -cm.a[axis].velocity_max) { velocity = -cm.a[axis].velocity_max;}
+		target[axis] = velocity;
+		if (fp_NOT_ZERO(velocity)) { moving = true;}
+	}
+
+	if (jog.state == JOG_OFF) {
+		if (moving == false) { return (STAT_OK);}
+		if ((cm.machine_state == MACHINE_ALARM) || (cm.cycle_state != CYCLE_OFF) ||
+			(cm.motion_state != MOTION_STOP) || (gc_get_queued_blocks() != 0) ||
+			(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+			return (STAT_COMMAND_NOT_ACCEPTED);
+		}
+		for (uint8_t axis=0; axis<AXES; axis++) {
+			jog.velocity[axis] = 0;
+			jog.accel[axis] = 0;
+		}
+		copy_axis_vector(jog.target, target);
+		jog.age = 0;
+		jog.halt = false;
+		cm.cycle_state = CYCLE_JOG;
+		cm.machine_state = MACHINE_CYCLE;
+		cm_set_motion_state(MOTION_RUN);
+		jog.state = JOG_RUN;
+		st_request_exec_move();
+		return (STAT_OK);
+	}
+	copy_axis_vector(jog.target, target);			// the exec takes it on its next segment
+	jog.age = 0;
+	return (STAT_OK);
+}
+
+/*
+ *	mp_exec_jog() runs at the exec interrupt level and returns STAT_NOOP once the
+ *	axes have stopped, like the planner with nothing to run.
+ */
+stat_t mp_exec_jog()
+{
+	if (jog.state != JOG_RUN) { return (STAT_NOOP);}
+	if (cm.feedhold_requested == true) {			// picked up here as no aline is running
+		cm.feedhold_requested = false;
+		jog.halt = true;
+	}
+	float microseconds = NOM_SEGMENT_USEC;
+	float dt = microseconds / MICROSECONDS_PER_MINUTE;
+	uint8_t stopping = ((jog.halt == true) || (jog.age > JOG_TIMEOUT_USEC));
+	jog.age += (uint32_t)microseconds;
+
+	float target[AXES];
+	float velocity = 0;
+	uint8_t moving = false;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		float start_velocity = jog.velocity[axis];
+		float v = (stopping == true) ? 0 : jog.target[axis];
+
+		// stop short of the soft limits - the stop is started a segment early
+		if ((cm.homed[axis] == true) && (cm.soft_steps[axis] > 0) && (fp_NOT_ZERO(start_velocity))) {
+			float reach = _get_stop_distance(axis) + fabsf(start_velocity) * dt;
+			if (start_velocity > 0) {
+				if ((mr.position[axis] + reach) >= (cm.soft_max[axis] / cm.soft_steps[axis])) { v = min(v, (float)0);}
+			} else {
+				if ((mr.position[axis] - reach) <= (cm.soft_min[axis] / cm.soft_steps[axis])) { v = max(v, (float)0);}
+			}
+		}
+		float end_velocity = _get_axis_velocity(axis, v, dt);
+		target[axis] = mr.position[axis] + (start_velocity + end_velocity) / 2 * dt;
+		velocity += square(end_velocity);
+		if (fp_NOT_ZERO(end_velocity) || fp_NOT_ZERO(start_velocity)) { moving = true;}
+	}
+	if (moving == false) {
+		mr.segment_velocity = 0;
+		jog.state = JOG_END;
+		controller_request_task(TASK_JOG);
+		return (STAT_NOOP);
+	}
+
+	float steps[MOTORS];
+	ik_kinematics(mr.position, target, steps, microseconds);
+	ritorno(st_prep_line(steps, microseconds));
+	PSO_PREP(mr.position, target);
+	copy_axis_vector(mr.position, target);
+	mr.segment_velocity = sqrtf(velocity);
+	mr.job_usec += (uint32_t)microseconds;
+	return (STAT_OK);
+}
+
+stat_t mp_jog_callback()
+{
+	if (jog.state != JOG_END) { return (STAT_NOOP);}
+	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+		mp_set_planner_position(axis, mp_get_runtime_absolute_position(axis));
+		gmx.position[axis] = mp_get_runtime_absolute_position(axis);
+		gm.target[axis] = gmx.position[axis];
+	}
+	jog.state = JOG_OFF;
+	cm.cycle_state = CYCLE_OFF;
+	cm.machine_state = MACHINE_PROGRAM_STOP;
+	cm_set_motion_state(MOTION_STOP);
+	sr_request_status_report(SR_IMMEDIATE_REQUEST);
+	return (STAT_OK);
+}
+
+uint8_t mp_jog_is_running() { return (jog.state != JOG_OFF);}
+
+void mp_abort_jog()
+{
+	if (jog.state == JOG_OFF) { return;}
+	jog.state = JOG_OFF;
+	if (cm.cycle_state == CYCLE_JOG) { cm.cycle_state = CYCLE_OFF;}
+}
+
+/*
+ * _get_axis_velocity() - move an axis velocity toward its target for one segment
+ *
+ *	The acceleration ramps at the jerk limit toward the most that can still be
+ *	ramped out by the time the velocity reaches the target, and is capped at $xac
+ *	if it is set. The velocity is integrated from the acceleration at the start and
+ *	end of the segment, and lands on the target once it would pass it.
+ */
+static float _get_axis_velocity(uint8_t axis, float target, float dt)
+{
+	float jerk = cm.a[axis].jerk_max * JERK_MULTIPLIER;
+	float accel_max = cm.a[axis].accel_max;
+	float velocity = jog.velocity[axis];
+	float accel = jog.accel[axis];
+	float dv = target - velocity;
+
+	if (fp_ZERO(dv) && fp_ZERO(accel)) { return (velocity);}
+	float accel_wanted = copysignf(sqrtf(2 * jerk * fabsf(dv)), dv);
+	if (accel_max > 0) { accel_wanted = max(min(accel_wanted, accel_max), -accel_max);}
+	float accel_step = jerk * dt;
+	float end_accel = accel + max(min(accel_wanted - accel, accel_step), -accel_step);
+	float end_velocity = velocity + (accel + end_accel) / 2 * dt;
+
+	if ((dv > 0) ? (end_velocity >= target) : (end_velocity <= target)) {
+		end_velocity = target;
+		end_accel = 0;
+	}
+	jog.velocity[axis] = end_velocity;
+	jog.accel[axis] = end_accel;
+	return (end_velocity);
+}
+
+/*
+ * _get_stop_distance() - distance a jerk limited stop from the axis velocity takes
+ *
+ *	From zero acceleration - a jerk limited S-curve if $xac is not reached, else
+ *	with a constant acceleration part at $xac.
+ */
+static float _get_stop_distance(uint8_t axis)
+{
+	float jerk = cm.a[axis].jerk_max * JERK_MULTIPLIER;
+	float accel_max = cm.a[axis].accel_max;
+	float velocity = fabsf(jog.velocity[axis]);
+
+	if ((accel_max <= 0) || (velocity <= square(accel_max) / jerk)) {
+		return (velocity * sqrtf(velocity / jerk));
+	}
+	return (velocity / 2 * (velocity / accel_max + accel_max / jerk));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -36,27 +36,86 @@
 #include "stepper.h"
 #include "report.h"
 #include "util.h"
+#include "fast_math.h"
+#include "benchmark.h"
+#include "trace.h"
+#include "spindle.h"
+#include "pwm.h"
+#include "raster.h"
+#include "pso.h"
+#include "shaper.h"
+#include "stepq.h"
+#include "stress.h"
+#include "swo.h"
+#include "replay.h"
+#include "selfbench.h"
+#include "hardware.h"				// DWT cycle counter for the resume latency and HT solver benchmark
+#include "settings.h"				// AXES_USED
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
 
 #ifdef __cplusplus
 extern "C"{
 #endif
+
+#define _get_cycles() (HW_DWT_CYCCNT)
+#define _get_ms() (SysTickTimer.getValue())
+#define CYCLES_PER_USEC (F_CPU / 1000000)
+#define STOP_CYCLES_MS 50000		// stops longer than this are timed in ms - the cycle counter wraps
+#define TRAPEZOID_RUN_AHEAD 3		// blocks from the run buffer on kept planned - see mp_plan_trapezoid()
 
 // aline planner routines / feedhold planning
 static void _plan_block_list(mpBuf_t *bf, uint8_t *mr_flag);
 static void _calculate_trapezoid(mpBuf_t *bf);
 static float _get_target_length(const float Vi, const float Vt, const mpBuf_t *bf);
 static float _get_target_velocity(const float Vi, const float L, const mpBuf_t *bf);
+static float _get_ht_cruise_velocity(const mpBuf_t *bf);
+static void _set_accel_limit(mpBuf_t *bf, const float share[]);
+static float _get_jerk_limit(const float share[]);
+static float _quantize_jerk(const float jerk);
+static float _get_accel_target_length(const float Vi, const float Vt, const mpBuf_t *bf);
+static float _get_accel_target_velocity(const float Vi, const float L, const mpBuf_t *bf);
+static float _get_accel_ht_cruise_velocity(const mpBuf_t *bf);
 //static float _get_intersection_distance(const float Vi_squared, const float Vt_squared, const float L, const mpBuf_t *bf);
-static float _get_junction_vmax(const float a_unit[], const float b_unit[]);
+static float _get_junction_vmax(const mpBuf_t *a, const mpBuf_t *b);
+static void _set_jerk_terms(mpBuf_t *bf);
+static void _plan_and_queue_move(mpBuf_t *bf, const uint8_t move_type);
+static void _set_cruise_limits(mpBuf_t *bf, const float share[]);
+static float _get_cruise_vmax(const mpBuf_t *bf);
+static float _get_cruise_vset(const mpBuf_t *bf);
+static void _set_vmax_limits(mpBuf_t *bf);
+static void _replan_from(mpBuf_t *bp, const float entry_velocity);
 static void _reset_replannable_list(void);
+static uint8_t _plan_hold_mr(mpBuf_t *bp);
+static void _plan_hold_queue(void);
+static void _plan_hold_resume(mpBuf_t *bp);
+static void _set_hold_decel(void);
+static void _freeze_block(mpBuf_t *bp);
+#ifdef __PLANNER_BENCHMARK
+static void _benchmark_block(const mpBuf_t *bf);
+#endif
 
-// execute routines (NB: These are all called from the LO interrupt)
-static stat_t _exec_aline(mpBuf_t *bf);
-static stat_t _exec_aline_head(void);
-static stat_t _exec_aline_body(void);
-static stat_t _exec_aline_tail(void);
-static stat_t _exec_aline_segment(uint8_t correction_flag);
-static void _init_forward_diffs(float t0, float t2);
+// execute routines (NB: These are all called from the LO interrupt, and run from SRAM)
+static stat_t _exec_aline(mpBuf_t *bf) HOT_PATH;
+static stat_t _exec_aline_head(void) HOT_PATH;
+static stat_t _exec_aline_body(void) HOT_PATH;
+static stat_t _exec_aline_tail(void) HOT_PATH;
+static stat_t _exec_aline_segment(uint8_t correction_flag) HOT_PATH;
+static void _segment_kinematics(const float start[], const float end[], float steps[]) HOT_PATH;
+static void _set_move_unit(mpBuf_t *bf) HOT_PATH;
+static void _stage_next_move(mpBuf_t *bf) HOT_PATH;
+#ifdef __PLANNER_ARC_MOVES
+static void _set_arc_target(const float path_distance) HOT_PATH;
+#endif
+static void _init_forward_diffs(float t0, float t2) HOT_PATH;
+static uint8_t _init_accel_section(const float v0, const float v1) HOT_PATH;
+static void _init_accel_constant(void) HOT_PATH;
+static void _init_accel_convex(const float t2) HOT_PATH;
+static float _get_accel_segments(const float time) HOT_PATH;
+static float _get_segment_usec(const float factor) HOT_PATH;
+static float _get_section_segments(const float time, const float factor) HOT_PATH;
+static void _count_job_block(const mpBuf_t *bf) HOT_PATH;
+static void _mark_job_stop(void) HOT_PATH;
 //static float _compute_next_segment_velocity(void);
 
 /* Runtime-specific setters and getters
@@ -65,16 +124,145 @@ static void _init_forward_diffs(float t0, float t2);
  * mp_get_runtime_machine_position() - returns current axis position in machine coordinates
  * mp_get_runtime_work_position() 	- returns current axis position in work coordinates
  *									  that were in effect at move planning time
- * mp_set_runtime_work_offset()
+ * mp_set_runtime_work_offset_set() - set the work offsets of the runtime - see cm_get_work_offset_set()
+ * mp_get_runtime_work_offset_set() - return them
+ * mp_get_runtime_modal_set()		- return the modal state set of the runtime - see cm_get_modal_set()
  * mp_zero_segment_velocity() 		- correct velocity in last segment for reporting purposes
+ * mp_plan_trapezoid()				- set the head, body and tail of a buffer if they are not planned
+ * mp_get_trapezoid()				- copy a buffer with its head, body and tail set, for reports
+ * mp_plan_trapezoid_callback()		- plan the blocks the exec runs next and restart it
+ * mp_get_planned_time()			- returns the planned time of a buffer in minutes
+ * mp_get_job_elapsed_time()		- returns seconds of motion and dwell executed in this job
+ * mp_get_job_remaining_time()		- returns planned seconds left in the queue
+ * mp_end_job_time()				- the next move starts a new job (called at program end)
  */
 
 float mp_get_runtime_velocity(void) { return (mr.segment_velocity);}
+#ifdef __AUX_MOTION
+float mp_get_runtime_absolute_position(uint8_t axis) { return (AUX_AXIS(axis) ? mp_get_aux_position(axis) : mr.position[axis]);}
+#else
 float mp_get_runtime_absolute_position(uint8_t axis) { return (mr.position[axis]);}
-float mp_get_runtime_work_position(uint8_t axis) { return (mr.position[axis] - mr.gm.work_offset[axis]);}
-void mp_set_runtime_work_offset(float offset[]) { copy_axis_vector(mr.gm.work_offset, offset);}
+#endif
+float mp_get_runtime_work_position(uint8_t axis) { return (mp_get_runtime_absolute_position(axis) - cm.work_offset[mr.gm.work_offset_set][axis]);}
+void mp_set_runtime_work_offset_set(uint8_t set) { mr.gm.work_offset_set = set;}
+uint8_t mp_get_runtime_work_offset_set() { return (mr.gm.work_offset_set);}
+uint8_t mp_get_runtime_modal_set() { return (mr.gm.modal_set);}
 void mp_zero_segment_velocity() { mr.segment_velocity = 0;}
 
+/*	The planning passes only settle the entry, cruise and exit velocities of a block and
+ *	clear trapezoid_planned before they change them. The head, body and tail are worked
+ *	out in the main loop only - when the block is frozen (see _freeze_block()) or comes
+ *	within TRAPEZOID_RUN_AHEAD blocks of the runtime. They are calculated on a copy and
+ *	published with the velocities in one go, and trapezoid_planned is set last. The exec
+ *	never calculates a trapezoid - it waits for the flag (see _exec_aline()).
+ *
+ *	A degraded head (H") can lower the exit. The lower exit is carried into the entry
+ *	of the next block while that is still replannable. Once the next block is frozen or
+ *	running the exit is kept and the block ends at its cruise velocity - a velocity step
+ *	up into the next block, as the degraded cases already allow.
+ */
+void mp_plan_trapezoid(mpBuf_t *bf)
+{
+	if (bf->trapezoid_planned == true) { return;}
+	mpBuf_t tz;
+	memcpy(&tz, bf, sizeof(mpBuf_t));
+	_calculate_trapezoid(&tz);
+	if (tz.exit_velocity < bf->exit_velocity) {		// H" - the exit can't be reached
+		mpBuf_t *nx = mp_get_next_buffer(bf);
+		if (nx->replannable == true) {
+			nx->trapezoid_planned = false;
+			nx->entry_velocity = tz.exit_velocity;
+		} else {
+			tz.exit_velocity = bf->exit_velocity;	// the next block was planned from it
+		}
+	}
+	bf->head_length = tz.head_length;
+	bf->body_length = tz.body_length;
+	bf->tail_length = tz.tail_length;
+	bf->entry_velocity = tz.entry_velocity;
+	bf->cruise_velocity = tz.cruise_velocity;
+	bf->exit_velocity = tz.exit_velocity;
+	if (tz.move_state == MOVE_STATE_SKIP) { bf->move_state = MOVE_STATE_SKIP;}
+	__DMB();									// the exec sees the flag only after the rest
+	bf->trapezoid_planned = true;
+}
+
+void mp_get_trapezoid(const mpBuf_t *bf, mpBuf_t *tz)
+{
+	memcpy(tz, bf, sizeof(mpBuf_t));
+	if (tz->trapezoid_planned == false) { _calculate_trapezoid(tz);}
+}
+
+/*	The exec waits on a run buffer whose trapezoid is not planned and requests this.
+ *	The planning passes call it too once they queue or replan, so the exec usually
+ *	finds the next blocks already planned and does not wait at all.
+ */
+stat_t mp_plan_trapezoid_callback()
+{
+	mpBuf_t *bf = mb.r;
+
+	for (uint8_t i=0; i<TRAPEZOID_RUN_AHEAD; i++) {
+		if (bf->buffer_state < MP_BUFFER_QUEUED) break;	// empty or still being written
+		if ((bf->move_type == MOVE_TYPE_ALINE) || (bf->move_type == MOVE_TYPE_ARC)) {
+			mp_plan_trapezoid(bf);
+		}
+		bf = mp_get_next_buffer(bf);
+	}
+	st_request_exec_move();						// restart the exec if it was waiting
+	return (STAT_OK);
+}
+
+/*	The planned time of a block comes from its trapezoid - each section runs at the 
+ *	average of its entry and exit velocities. It changes as the block is replanned.
+ *	The elapsed time is counted from the segments actually run by the exec, so it 
+ *	includes holds and overrides. The job time is kept after a program end until the 
+ *	next move starts, so it can still be reported.
+ */
+static float _get_section_time(const float length, const float v0, const float v1)
+{
+	if ((length < EPSILON) || ((v0 + v1) < EPSILON)) { return (0);}
+	return ((2 * length) / (v0 + v1));
+}
+
+float mp_get_planned_time(const mpBuf_t *bf)
+{
+	if (bf->move_type == MOVE_TYPE_DWELL) { return (bf->gm->move_time / 60);}	// dwells are in seconds
+	if ((bf->move_type != MOVE_TYPE_ALINE) && (bf->move_type != MOVE_TYPE_ARC)) { return (0);}
+	return (_get_section_time(bf->head_length, bf->entry_velocity, bf->cruise_velocity) +
+			_get_section_time(bf->body_length, bf->cruise_velocity, bf->cruise_velocity) +
+			_get_section_time(bf->tail_length, bf->cruise_velocity, bf->exit_velocity));
+}
+
+float mp_get_job_elapsed_time()
+{
+	uint64_t usec;
+	do {										// 64 bits - re-read if the exec changed it mid-read
+		usec = mr.job_usec;
+	} while (usec != *((volatile uint64_t *)&mr.job_usec));
+	return ((float)usec / 1000000);
+}
+
+float mp_get_job_remaining_time()
+{
+	mpBuf_t *bf = mb.r;
+	float minutes = 0;
+
+	for (mpBufCount_t i=0; i < PLANNER_BUFFER_POOL_SIZE; i++) {
+		if (bf->buffer_state < MP_BUFFER_QUEUED) break;	// empty or still being written
+		mpBuf_t tz;
+		mp_get_trapezoid(bf, &tz);
+		minutes += mp_get_planned_time(&tz);
+		bf = mp_get_next_buffer(bf);
+	}
+	float seconds = minutes * 60;
+	if ((mb.r->buffer_state == MP_BUFFER_RUNNING) && (mb.r->move_type != MOVE_TYPE_DWELL)) {
+		seconds -= (float)mr.move_usec / 1000000;	// less the part of the running move already done
+	}
+	return (max(seconds, (float)0));
+}
+
+void mp_end_job_time() { mr.job_ended = true;}
+
 /* 
  * mp_get_runtime_busy() - return TRUE if motion control busy (i.e. robot is moving)
  *
@@ -109,8 +297,9 @@ uint8_t mp_get_runtime_busy()
 stat_t mp_aline(const GCodeState_t *gm_line)
 {
 	mpBuf_t *bf; 						// current move pointer
-	float exact_stop = 0;
-	float junction_velocity;
+
+	if (SQ_RUNNING() || STRESS_ACTIVE() || RP_REPLAYING()) { return (STAT_COMMAND_NOT_ACCEPTED);}	// the motors belong to the step queue, stress test or replay
+	mp_end_coalesce();					// plan any held G1 run first (no-op when called from there)
 
 	// trap error conditions
 	float length = get_axis_vector_length(gm_line->target, mm.position);
@@ -120,69 +309,356 @@ stat_t mp_aline(const GCodeState_t *gm_line)
 	// get a cleared buffer and setup move variables
 	if ((bf = mp_get_write_buffer()) == NULL) { return(cm_alarm(STAT_BUFFER_FULL_FATAL));} // never supposed to fail
 
-	memcpy(&bf->gm, gm_line, sizeof(GCodeState_t));	// copy model state into planner
+	memcpy(bf->gm, gm_line, sizeof(GCodeState_t));	// copy model state into planner
 	bf->bf_func = _exec_aline;					// register the callback to the exec function
 	bf->length = length;
 
-	// compute both the unit vector and the jerk term in the same pass for efficiency
-	float diff = bf->gm.target[AXIS_X] - mm.position[AXIS_X];
+	// compute the unit vector and the junction deviation in the same pass for efficiency
+	float unit[AXES] = {0,0,0,0,0,0};	// planned from the float vector, stored packed
+	float diff = bf->gm->target[AXIS_X] - mm.position[AXIS_X];
 	if (fp_NOT_ZERO(diff)) {
-		bf->unit[AXIS_X] = diff / length;
-		bf->jerk = square(bf->unit[AXIS_X] * cm.a[AXIS_X].jerk_max);
+		unit[AXIS_X] = diff / length;
+		bf->junction_delta = square(unit[AXIS_X] * cm.a[AXIS_X].junction_dev);
+	}
+	if (fp_NOT_ZERO(diff = bf->gm->target[AXIS_Y] - mm.position[AXIS_Y])) {
+		unit[AXIS_Y] = diff / length;
+		bf->junction_delta += square(unit[AXIS_Y] * cm.a[AXIS_Y].junction_dev);
 	}
-	if (fp_NOT_ZERO(diff = bf->gm.target[AXIS_Y] - mm.position[AXIS_Y])) {
-		bf->unit[AXIS_Y] = diff / length;
-		bf->jerk += square(bf->unit[AXIS_Y] * cm.a[AXIS_Y].jerk_max);
+	if (fp_NOT_ZERO(diff = bf->gm->target[AXIS_Z] - mm.position[AXIS_Z])) {
+		unit[AXIS_Z] = diff / length;
+		bf->junction_delta += square(unit[AXIS_Z] * cm.a[AXIS_Z].junction_dev);
 	}
-	if (fp_NOT_ZERO(diff = bf->gm.target[AXIS_Z] - mm.position[AXIS_Z])) {
-		bf->unit[AXIS_Z] = diff / length;
-		bf->jerk += square(bf->unit[AXIS_Z] * cm.a[AXIS_Z].jerk_max);
+	if (fp_NOT_ZERO(diff = bf->gm->target[AXIS_A] - mm.position[AXIS_A])) {
+		unit[AXIS_A] = diff / length;
+		bf->junction_delta += square(unit[AXIS_A] * cm.a[AXIS_A].junction_dev);
 	}
-	if (fp_NOT_ZERO(diff = bf->gm.target[AXIS_A] - mm.position[AXIS_A])) {
-		bf->unit[AXIS_A] = diff / length;
-		bf->jerk += square(bf->unit[AXIS_A] * cm.a[AXIS_A].jerk_max);
+	if (fp_NOT_ZERO(diff = bf->gm->target[AXIS_B] - mm.position[AXIS_B])) {
+		unit[AXIS_B] = diff / length;
+		bf->junction_delta += square(unit[AXIS_B] * cm.a[AXIS_B].junction_dev);
 	}
-	if (fp_NOT_ZERO(diff = bf->gm.target[AXIS_B] - mm.position[AXIS_B])) {
-		bf->unit[AXIS_B] = diff / length;
-		bf->jerk += square(bf->unit[AXIS_B] * cm.a[AXIS_B].jerk_max);
+	if (fp_NOT_ZERO(diff = bf->gm->target[AXIS_C] - mm.position[AXIS_C])) {
+		unit[AXIS_C] = diff / length;
+		bf->junction_delta += square(unit[AXIS_C] * cm.a[AXIS_C].junction_dev);
 	}
-	if (fp_NOT_ZERO(diff = bf->gm.target[AXIS_C] - mm.position[AXIS_C])) {
-		bf->unit[AXIS_C] = diff / length;
-		bf->jerk += square(bf->unit[AXIS_C] * cm.a[AXIS_C].jerk_max);
+	mp_set_unit(bf->unit, unit);
+	bf->jerk = _quantize_jerk(_get_jerk_limit(unit));
+	bf->junction_delta = fm_sqrt(bf->junction_delta);	// kept for this block's exit junction
+	_set_jerk_terms(bf);
+	_set_accel_limit(bf, unit);
+
+	bf->cruise_vset = _get_cruise_vset(bf);				// target velocity requested
+	_set_cruise_limits(bf, unit);
+	if (gm_line->curve_vmax > 0) {						// arc segment - see cm_arc_callback()
+		bf->cruise_vset = min(bf->cruise_vset, gm_line->curve_vmax);
+		bf->cruise_vlimit = min(bf->cruise_vlimit, gm_line->curve_vmax);
 	}
-	bf->jerk = sqrt(bf->jerk) * JERK_MULTIPLIER;
+	_plan_and_queue_move(bf, MOVE_TYPE_ALINE);
+	return (STAT_OK);
+}
 
-	if (fabs(bf->jerk - mm.prev_jerk) < JERK_MATCH_PRECISION) {	// can we re-use jerk terms?
-		bf->cbrt_jerk = mm.prev_cbrt_jerk;
-		bf->recip_jerk = mm.prev_recip_jerk;
-	} else {
-		bf->cbrt_jerk = cbrt(bf->jerk);
-		bf->recip_jerk = 1/bf->jerk;
-		mm.prev_jerk = bf->jerk;
-		mm.prev_cbrt_jerk = bf->cbrt_jerk;
-		mm.prev_recip_jerk = bf->recip_jerk;
+/**************************************************************************
+ * mp_aline_planned() - queue a straight move whose velocities were planned by the host
+ *
+ *	The host sends the length, direction, entry, cruise and exit velocities and 
+ *	jerk of each move, already planned across the moves around it. The move is 
+ *	checked against the machine limits and queued as it is. Neither it nor the 
+ *	moves before it are replanned, so no block list passes are run - only its 
+ *	own head, body and tail are found, by the same trapezoid generator as a line.
+ *
+ *	The move is rejected with STAT_INPUT_VALUE_RANGE_ERROR if:
+ *	  - the unit vector is not of unit length, a velocity is negative, or the 
+ *		entry or exit is above the cruise
+ *	  - the jerk is above the jerk the axis $xjm values give its direction
+ *	  - the cruise is above the lowest axis $xfr allows for its direction
+ *	  - the peak acceleration of the head or tail is above the $xac limit
+ *	  - the head and tail do not fit in the length
+ *	  - it enters slower than the move before it exits
+ *	Limits are tested to within PLANNED_LIMIT_TOLERANCE.
+ *
+ *	The move enters at the exit velocity of the last queued move - the exit of a 
+ *	host planned move, or zero after anything the firmware planned (which always 
+ *	ends at rest). If the host planned a faster entry - the queue was replanned by
+ *	a feedhold, or the move waits for the spindle - it starts from the lower 
+ *	velocity and the trapezoid is degraded to fit, which can only lower its exit.
+ *
+ *	Nothing plans a host move down to a stop at the end of the queue. If one ends 
+ *	at speed without a move queued to continue from it, the steppers stop dead 
+ *	and the exec raises STAT_PLANNED_MOVE_UNDERRUN. The host must end its last 
+ *	move at zero, or keep the queue ahead of the motion. 
+ *
+ *	Feed rate override does not apply to host planned moves. A feedhold replans 
+ *	them like any other move, but never above the velocities the host planned.
+ */
+
+stat_t mp_aline_planned(const GCodeState_t *gm_line, const mpPlannedMove_t *move)
+{
+	mpBuf_t *bf;
+
+	if (SQ_RUNNING() || STRESS_ACTIVE() || RP_REPLAYING()) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	mp_end_coalesce();
+
+	// trap error conditions that don't need the buffer
+	if (move->length < MIN_LENGTH_MOVE) { return (STAT_MINIMUM_LENGTH_MOVE_ERROR);}
+	if ((move->entry_velocity < 0) || (move->exit_velocity < 0) || (move->jerk < EPSILON) ||
+		(move->entry_velocity > move->cruise_velocity) || (move->exit_velocity > move->cruise_velocity) ||
+		(fp_ZERO(move->cruise_velocity))) {
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
 	}
+	float magnitude = 0;
+	for (uint8_t i=0; i<AXES; i++) { magnitude += square(move->unit[i]);}
+	magnitude = fm_sqrt(magnitude);
+	if (fabsf(magnitude - 1) > PLANNED_LIMIT_TOLERANCE) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
 
-	// finish up the current block variables
-	if (cm_get_path_control(MODEL) != PATH_EXACT_STOP) { 	// exact stop cases already zeroed
-		bf->replannable = true;
-		exact_stop = 8675309;								// an arbitrarily large floating point number (Jenny)
+	if ((bf = mp_get_write_buffer()) == NULL) { return(cm_alarm(STAT_BUFFER_FULL_FATAL));} // never supposed to fail
+
+	memcpy(bf->gm, gm_line, sizeof(GCodeState_t));	// copy model state into planner
+	bf->bf_func = _exec_aline;
+	bf->host_planned = true;
+	bf->length = move->length;
+
+	// machine limits for the direction of the move
+	float unit[AXES];
+	float cruise_max = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		unit[i] = move->unit[i] / magnitude;
+		if (fp_ZERO(unit[i])) { continue;}
+		float vmax = cm.a[i].feedrate_max / fabsf(unit[i]);
+		if ((fp_ZERO(cruise_max)) || (vmax < cruise_max)) { cruise_max = vmax;}
 	}
-	bf->cruise_vmax = bf->length / bf->gm.move_time;		// target velocity requested
-	junction_velocity = _get_junction_vmax(bf->pv->unit, bf->unit);
-	bf->entry_vmax = min3(bf->cruise_vmax, junction_velocity, exact_stop);
+	mp_set_unit(bf->unit, unit);
+	float jerk_max = _get_jerk_limit(unit);
+	bf->jerk = move->jerk;
+	_set_jerk_terms(bf);
+	_set_accel_limit(bf, unit);
+
+	float tolerance = 1 + PLANNED_LIMIT_TOLERANCE;
+	float dv_max = move->cruise_velocity - min(move->entry_velocity, move->exit_velocity);
+	float ht_length = _get_target_length(move->entry_velocity, move->cruise_velocity, bf) + 
+					  _get_target_length(move->exit_velocity, move->cruise_velocity, bf);
+	float entry_velocity = 0;							// what the last queued move exits at
+	mpBuf_t *bp = mp_get_prev_buffer(bf);
+	if ((bp->buffer_state >= MP_BUFFER_QUEUED) && (bp->host_planned == true)) {
+		entry_velocity = bp->exit_velocity;
+	}
+	if ((move->jerk > jerk_max * tolerance) || 
+		(move->cruise_velocity > cruise_max * tolerance) ||
+		((bf->accel > 0) && (fm_sqrt(dv_max * bf->jerk) > bf->accel * tolerance)) ||
+		(ht_length > (move->length * tolerance) + TRAPEZOID_LENGTH_FIT_TOLERANCE) ||
+		(move->entry_velocity * tolerance < entry_velocity)) {
+		mp_unget_write_buffer();
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	if (mm.spindle_sync == true) {						// first feed after a spindle change...
+		mm.spindle_sync = false;
+		bf->spindle_sync = true;						// ...starts from rest so it can wait
+		entry_velocity = 0;
+	}
+
+	// the velocities are the host's - the vmax's only bound replanning after a feedhold
+	bf->entry_velocity = entry_velocity;
+	bf->cruise_velocity = move->cruise_velocity;
+	bf->exit_velocity = move->exit_velocity;
+	bf->cruise_vset = move->cruise_velocity;
+	bf->cruise_vlimit = move->cruise_velocity;
+	bf->cruise_vmax = move->cruise_velocity;
+	bf->junction_vmax = entry_velocity;
+	bf->entry_vmax = entry_velocity;
+	bf->exit_vmax = move->exit_velocity;
 	bf->delta_vmax = _get_target_velocity(0, bf->length, bf);
-	bf->exit_vmax = min3(bf->cruise_vmax, (bf->entry_vmax + bf->delta_vmax), exact_stop);
 	bf->braking_velocity = bf->delta_vmax;
+	_calculate_trapezoid(bf);							// not queued yet - the exec can't see it
+	bf->trapezoid_planned = true;
 
-	uint8_t mr_flag = false;
-	_plan_block_list(bf, &mr_flag);							// replan block list and commit current block
-	copy_axis_vector(mm.position, bf->gm.target);			// update planning position
+	copy_axis_vector(mm.position, bf->gm->target);		// update planning position
 	mp_queue_write_buffer(MOVE_TYPE_ALINE);
+	mp_plan_trapezoid_callback();
+	return (STAT_OK);
+}
+
+#ifdef __PLANNER_ARC_MOVES
+/**************************************************************************
+ * mp_arc() - plan an arc or helix with acceleration / deceleration
+ *
+ *	The whole arc is planned as a single block of length arc->length using 
+ *	the same jerk-limited trapezoid as a line. The runtime finds each segment
+ *	target by its distance along the arc (_set_arc_target()), so an arc uses 
+ *	one planner buffer regardless of how finely it is drawn.
+ *
+ *	The caller provides the center, radius, angles, linear travel, axes and 
+ *	length in *arc; the start position is taken from the planning position.
+ *	gm_arc->target must hold the arc endpoint in machine axis order.
+ *
+ *	Planning differences from a line:
+ *	  - the entry junction uses the tangent at the start (bf->unit) and the 
+ *		next block's junction uses the tangent at the end (bf->arc.exit_unit)
+ *	  - the tangent sweeps the arc plane, so either plane axis may carry all of 
+ *		the planar share of the jerk and acceleration, and the junction deviation 
+ *		uses the lower of the two plane axis values
+ *	  - cruise velocity is capped so the centripetal acceleration does not 
+ *		exceed the cornering acceleration used for junctions
+ *	  - A, B and C move in proportion to the distance along the arc but are 
+ *		not included in its length
+ */
+
+stat_t mp_arc(const GCodeState_t *gm_arc, const mpArc_t *arc)
+{
+	mpBuf_t *bf;
+
+	mp_end_coalesce();
+	if (arc->length < MIN_LENGTH_MOVE) { return (STAT_MINIMUM_LENGTH_MOVE_ERROR);}
+	if ((bf = mp_get_write_buffer()) == NULL) { return(cm_alarm(STAT_BUFFER_FULL_FATAL));} // never supposed to fail
+
+	memcpy(bf->gm, gm_arc, sizeof(GCodeState_t));	// copy model state into planner
+	memcpy(&bf->arc, arc, sizeof(mpArc_t));
+	copy_axis_vector(bf->arc.start, mm.position);
+	bf->bf_func = _exec_aline;						// arcs run in the aline exec with their own targets
+	bf->length = arc->length;
+	bf->path_start = 0;
+
+	// entry and exit tangents - the derivative of (sin(theta), cos(theta)) * radius by path distance
+	float planar = arc->angular_travel * arc->radius / arc->length;	// signed planar share of the path
+	float linear = arc->linear_travel / arc->length;
+	float theta_end = arc->theta + arc->angular_travel;
+	float unit[AXES] = {0,0,0,0,0,0};
+	unit[arc->axis_1] = cosf(arc->theta) * planar;
+	unit[arc->axis_2] = -sinf(arc->theta) * planar;
+	unit[arc->axis_linear] = linear;
+	mp_set_unit(bf->unit, unit);
+	unit[arc->axis_1] = cosf(theta_end) * planar;
+	unit[arc->axis_2] = -sinf(theta_end) * planar;
+	mp_set_unit(bf->arc.exit_unit, unit);
+
+	float share[AXES];								// largest share of the path each axis sees
+	for (uint8_t i=0; i<AXES; i++) { share[i] = 0;}
+	share[arc->axis_1] = planar;
+	share[arc->axis_2] = planar;
+	share[arc->axis_linear] = linear;
+
+	float planar_dev = min(cm.a[arc->axis_1].junction_dev, cm.a[arc->axis_2].junction_dev);
+	bf->jerk = _quantize_jerk(_get_jerk_limit(share));
+	bf->junction_delta = fm_sqrt(square(planar * planar_dev) + 
+								 square(linear * cm.a[arc->axis_linear].junction_dev));
+	_set_jerk_terms(bf);
+	_set_accel_limit(bf, share);
+
+	bf->cruise_vset = _get_cruise_vset(bf);
+	_set_cruise_limits(bf, share);
+	float centripetal_vmax = fm_sqrt(arc->radius * cm.junction_acceleration);
+	bf->cruise_vset = min(bf->cruise_vset, centripetal_vmax);
+	bf->cruise_vlimit = min(bf->cruise_vlimit, centripetal_vmax);
+	_plan_and_queue_move(bf, MOVE_TYPE_ARC);
+	return (STAT_OK);
+}
+#endif // __PLANNER_ARC_MOVES
+
+/**************************************************************************
+ * mp_coalesce_line()	  - pre-planner stage that merges near-collinear G1 lines
+ * mp_end_coalesce()	  - plan the held run, if any
+ * mp_coalesce_callback() - plan the held run before the planner runs dry
+ *
+ *	CAM output often breaks straight or nearly straight cuts into many short 
+ *	lines. cm_straight_feed() hands lines to mp_coalesce_line(), which holds 
+ *	the current run in mm.coalesce_gm and extends it with each following line 
+ *	that stays on course. The run is planned by mp_aline() as one block when a 
+ *	line that does not fit arrives, or when anything else is queued (mp_aline, 
+ *	mp_arc, mp_dwell, mp_queue_command), or when the planner is about to run 
+ *	out of moves (mp_coalesce_callback()). The callback also queues any attached 
+ *	commands nothing has followed (see mp_queue_attached_command()).
+ *
+ *	A line joins the run if:
+ *	  - $lca is non-zero, the machine is in a machining cycle in G64 (continuous)
+ *		mode, not inverse time, and feed rate, G64 P tolerance and work offsets 
+ *		are unchanged
+ *	  - its direction is within $lca degrees of the first line of the run
+ *	  - every vertex stays within $lct mm of the merged chord. All lines lie in 
+ *		a cone of half angle a (the widest seen) about the first one, so no
+ *		vertex is further than length * sin(2a) from the chord. That bound is 
+ *		what is tested, so no vertices need to be stored.
+ *
+ *	The merged run reports the line number and move time of its last line, 
+ *	with the move times of all lines summed. Blocks reported executing are 
+ *	therefore never ahead of the motion.
+ */
+
+stat_t mp_coalesce_line(const GCodeState_t *gm_line)
+{
+	float unit[AXES];
+
+	// lines that can't be coalesced go straight to the planner
+	if (gm_line->raster != RASTER_OFF) {				// raster moves keep their own buffers
+		mp_end_coalesce();
+		return (mp_aline(gm_line));
+	}
+	if ((fp_ZERO(cm.coalesce_angle)) || (cm.cycle_state != CYCLE_MACHINING) || 
+		(gm_line->path_control != PATH_CONTINUOUS) || (gm_line->inverse_feed_rate_mode == true)) {
+		return (mp_aline(gm_line));
+	}
+	if (mm.coalesce_pending == true) {
+		if ((fp_NE(gm_line->feed_rate, mm.coalesce_gm.feed_rate)) ||
+			(fp_NE(gm_line->path_tolerance, mm.coalesce_gm.path_tolerance)) ||
+			(gm_line->work_offset_set != mm.coalesce_gm.work_offset_set)) {
+			mp_end_coalesce();
+		}
+	}
+	if (mm.coalesce_pending == false) {					// start a new run with this line
+		float length = get_axis_vector_length(gm_line->target, mm.position);
+		if (length < MIN_LENGTH_MOVE) { return (STAT_MINIMUM_LENGTH_MOVE_ERROR);} // accumulates as usual
+		for (uint8_t i=0; i<AXES; i++) {
+			mm.coalesce_unit[i] = (gm_line->target[i] - mm.position[i]) / length;
+		}
+		memcpy(&mm.coalesce_gm, gm_line, sizeof(GCodeState_t));
+		mm.coalesce_cos_min = 1;
+		mm.coalesce_length = length;
+		mm.coalesce_pending = true;
+		controller_request_task(TASK_COALESCE);
+		return (STAT_OK);
+	}
+	float length = get_axis_vector_length(gm_line->target, mm.coalesce_gm.target);
+	if (length < EPSILON) { return (STAT_OK);}			// nothing to add to the run
+	float costheta = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		unit[i] = (gm_line->target[i] - mm.coalesce_gm.target[i]) / length;
+		costheta += unit[i] * mm.coalesce_unit[i];
+	}
+	float cos_min = min(costheta, mm.coalesce_cos_min);
+	float deviation = (mm.coalesce_length + length) * 2 * cos_min * fm_sqrt(max((float)0, 1 - square(cos_min)));
+	if ((costheta < cosf(cm.coalesce_angle / RADIAN)) || (deviation > cm.coalesce_tolerance)) {
+		mp_end_coalesce();								// off course - plan the run and start over
+		return (mp_coalesce_line(gm_line));
+	}
+	float move_time = mm.coalesce_gm.move_time;		// extend the run to the end of this line
+	float minimum_time = mm.coalesce_gm.minimum_time;
+	memcpy(&mm.coalesce_gm, gm_line, sizeof(GCodeState_t));
+	mm.coalesce_gm.move_time += move_time;
+	mm.coalesce_gm.minimum_time += minimum_time;
+	mm.coalesce_cos_min = cos_min;
+	mm.coalesce_length += length;
+	return (STAT_OK);
+}
+
+stat_t mp_end_coalesce()
+{
+	if (mm.coalesce_pending == false) { return (STAT_NOOP);}
+	mm.coalesce_pending = false;						// must clear before mp_aline() is called
+	return (mp_aline(&mm.coalesce_gm));
+}
+
+stat_t mp_coalesce_callback()
+{
+	if ((mm.coalesce_pending == false) && (mm.attached_pending == 0)) { return (STAT_NOOP);}
+	if (mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE - 1) { return (STAT_OK);}	// not idle - still holding
+	mp_end_coalesce();									// only the running block (if any) is left
+	mp_end_attached();									// ...so queue any attached commands
 	return (STAT_OK);
 }
 
 /***** ALINE HELPERS *****
+ * _set_jerk_terms()
+ * _get_jerk_limit()
+ * _quantize_jerk()
+ * _set_accel_limit()
+ * _set_cruise_limits()
+ * _plan_and_queue_move()
  * _plan_block_list()
  * _calculate_trapezoid()
  * _get_target_length()
@@ -191,6 +667,215 @@ stat_t mp_aline(const GCodeState_t *gm_line)
  * _reset_replannable_list()
  */
 
+/*
+ * _set_jerk_terms() - set the compute-once jerk terms from bf->jerk
+ *
+ *	The cube root and reciprocal are kept for the last JERK_CACHE_SIZE jerks 
+ *	used, most recent first, and re-used when bf->jerk matches one of them. 
+ *	A toolpath that turns between a few directions - a braid or a pocket 
+ *	raster - cycles through a few jerks, so the cube root is rarely taken. 
+ *	A miss drops the least recently used terms.
+ */
+static void _set_jerk_terms(mpBuf_t *bf)
+{
+	mpJerkTerms_t terms;
+	uint8_t i;
+
+	for (i=0; i<JERK_CACHE_SIZE; i++) {
+		if (fabsf(bf->jerk - mm.jerk_cache[i].jerk) < JERK_MATCH_PRECISION) { break;}	// can we re-use jerk terms?
+	}
+	if (i < JERK_CACHE_SIZE) {
+		terms = mm.jerk_cache[i];
+	} else {
+		i = JERK_CACHE_SIZE - 1;
+		terms.jerk = bf->jerk;
+		terms.cbrt_jerk = fm_cbrt(bf->jerk);
+		terms.recip_jerk = 1/bf->jerk;
+	}
+	for (; i>0; i--) { mm.jerk_cache[i] = mm.jerk_cache[i-1];}	// move to the front
+	mm.jerk_cache[0] = terms;
+	bf->cbrt_jerk = terms.cbrt_jerk;
+	bf->recip_jerk = terms.recip_jerk;
+}
+
+/*
+ * _get_jerk_limit() - return the path jerk limit from the axis limits
+ *
+ *	share[] is as for _set_accel_limit(). The limit is the largest path jerk that 
+ *	keeps every moving axis within its own $xjm, so the axis with the least jerk 
+ *	for its share of the move sets it. A rotary axis with a low jerk limits only 
+ *	the moves it takes part in, and by no more than its share of them.
+ */
+static float _get_jerk_limit(const float share[])
+{
+	float jerk = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		if ((cm.a[i].jerk_max > 0) && (fp_NOT_ZERO(share[i]))) {
+			float axis_jerk = cm.a[i].jerk_max / fabsf(share[i]);
+			if ((fp_ZERO(jerk)) || (axis_jerk < jerk)) { jerk = axis_jerk;}
+		}
+	}
+	return (jerk * JERK_MULTIPLIER);
+}
+
+/*
+ * _quantize_jerk() - round a jerk limit down to JERK_QUANTUM_BITS of mantissa
+ *
+ *	The axis limited jerk changes with every direction, so it would never match 
+ *	the jerk cache. Rounded down it takes one of 32 values per octave, and lines 
+ *	in nearby directions share their jerk terms. Only used on limits - a jerk 
+ *	from the host is planned as sent.
+ */
+static float _quantize_jerk(const float jerk)
+{
+	int exponent;
+	float mantissa = frexpf(jerk, &exponent);		// jerk = mantissa * 2^exponent, mantissa in [0.5,1)
+	return (ldexpf(floorf(ldexpf(mantissa, JERK_QUANTUM_BITS)), exponent - JERK_QUANTUM_BITS));
+}
+
+/*
+ * _set_accel_limit() - set the path acceleration limit from the axis limits
+ *
+ *	share[] is the fraction of the path velocity each axis carries (sign ignored).
+ *	The limit is the largest path acceleration that keeps every axis with a 
+ *	non-zero $xac within its own value; axes with $xac of zero do not limit it. 
+ *	bf->accel stays zero if no moving axis is limited, and the move is planned 
+ *	jerk limited only. Must follow _set_jerk_terms().
+ */
+static void _set_accel_limit(mpBuf_t *bf, const float share[])
+{
+	bf->accel = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		if ((cm.a[i].accel_max > 0) && (fp_NOT_ZERO(share[i]))) {
+			float accel = cm.a[i].accel_max / fabsf(share[i]);
+			if ((fp_ZERO(bf->accel)) || (accel < bf->accel)) { bf->accel = accel;}
+		}
+	}
+	bf->accel_dv = square(bf->accel) * bf->recip_jerk;
+}
+
+/*
+ * _set_cruise_limits() - set the feed rate override limits of the move
+ *
+ *	Expects bf->cruise_vset to be set. share[] is the same as for _set_accel_limit().
+ *	Feed rate override applies to feeds in a machining cycle - never to traverses 
+ *	and never to homing, probing or other cycles. An overridden feed may run up to 
+ *	the lowest axis $xfr allows for the move, or the requested velocity if that is 
+ *	already higher.
+ */
+static void _set_cruise_limits(mpBuf_t *bf, const float share[])
+{
+	bf->overridable = ((bf->gm->motion_mode != MOTION_MODE_STRAIGHT_TRAVERSE) && 
+					   (cm.cycle_state == CYCLE_MACHINING));
+	bf->cruise_vlimit = 0;
+	for (uint8_t i=0; i<AXES; i++) {
+		if (fp_NOT_ZERO(share[i])) {
+			float vlimit = cm.a[i].feedrate_max / fabsf(share[i]);
+			if ((fp_ZERO(bf->cruise_vlimit)) || (vlimit < bf->cruise_vlimit)) { bf->cruise_vlimit = vlimit;}
+		}
+	}
+	bf->cruise_vlimit = max(bf->cruise_vlimit, bf->cruise_vset);
+}
+
+/*
+ * _get_cruise_vset() - return the velocity requested by the move time, smoothed in G93 runs
+ *
+ *	Expects bf->length and bf->gm to be set. A run of inverse time (G93) blocks is taken
+ *	as samples of one feed along the path: CAM output for 4 and 5 axis work sets the F of 
+ *	each short block separately, and the velocities it asks for step up and down from one 
+ *	block to the next. Planned as they are, each step is a junction the planner has to 
+ *	slow down for, and the moves never get to run at a steady feed.
+ *
+ *	Within a run each block's velocity is blended with the velocity of the block before 
+ *	it (INVERSE_TIME_SMOOTHING), which the lookahead then plans as gentle changes. The 
+ *	time this gains or loses is carried forward and each block aims to pay it back, so 
+ *	the run keeps to the total time its F words ask for. A block's time is held within 
+ *	INVERSE_TIME_TOLERANCE of its own F. A change larger than INVERSE_TIME_RATIO is 
+ *	taken as meant and starts a new run, as does any move that is not G93.
+ */
+static float _get_cruise_vset(const mpBuf_t *bf)
+{
+	float velocity = bf->length / bf->gm->move_time;
+
+	if (bf->gm->inverse_feed_rate_mode == false) {
+		mm.it_velocity = 0;
+		return (velocity);
+	}
+	if ((mm.it_velocity > 0) && (velocity < (mm.it_velocity * INVERSE_TIME_RATIO)) && 
+		(velocity > (mm.it_velocity / INVERSE_TIME_RATIO))) {
+		float time_min = bf->gm->move_time * (1 - INVERSE_TIME_TOLERANCE);
+		float time_max = bf->gm->move_time * (1 + INVERSE_TIME_TOLERANCE);
+		float time = min(max(bf->gm->move_time - mm.it_time_error, time_min), time_max);
+		velocity = mm.it_velocity + INVERSE_TIME_SMOOTHING * ((bf->length / time) - mm.it_velocity);
+		time = min(max(bf->length / velocity, time_min), time_max);
+		velocity = bf->length / time;
+	} else {
+		mm.it_time_error = 0;
+	}
+	mm.it_time_error += (bf->length / velocity) - bf->gm->move_time;
+	mm.it_velocity = velocity;
+	return (velocity);
+}
+
+/*
+ * _get_cruise_vmax() - return the cruise velocity limit with feed rate override applied
+ *
+ *	The host override and the load-adaptive factor multiply (see mp_set_adaptive_factor()).
+ */
+static float _get_cruise_vmax(const mpBuf_t *bf)
+{
+	if (bf->overridable == false) { return (bf->cruise_vset);}
+	return (min(bf->cruise_vset * mm.feed_override * mm.adaptive_factor, bf->cruise_vlimit));
+}
+
+/*
+ * _set_vmax_limits() - set entry_vmax and exit_vmax from cruise_vmax and the junction limit
+ *
+ *	Expects cruise_vmax, junction_vmax and delta_vmax to be set.
+ */
+static void _set_vmax_limits(mpBuf_t *bf)
+{
+	float exact_stop = 0;
+
+	if (bf->gm->path_control != PATH_EXACT_STOP) {
+		exact_stop = 8675309;								// an arbitrarily large floating point number (Jenny)
+	}
+	bf->entry_vmax = min3(bf->cruise_vmax, bf->junction_vmax, exact_stop);
+	bf->exit_vmax = min3(bf->cruise_vmax, (bf->entry_vmax + bf->delta_vmax), exact_stop);
+}
+
+/*
+ * _plan_and_queue_move() - finish the block variables, replan the list and queue the move
+ *
+ *	Expects bf->length, unit, jerk terms, junction_delta and the cruise limits to be set.
+ */
+static void _plan_and_queue_move(mpBuf_t *bf, const uint8_t move_type)
+{
+	if (cm_get_path_control(MODEL) != PATH_EXACT_STOP) { 	// exact stop cases already zeroed
+		bf->replannable = true;
+	}
+	bf->cruise_vmax = _get_cruise_vmax(bf);
+	if ((mm.spindle_sync == true) && (bf->gm->motion_mode != MOTION_MODE_STRAIGHT_TRAVERSE)) {
+		mm.spindle_sync = false;							// first feed after a spindle change...
+		bf->spindle_sync = true;							// ...starts from rest so it can wait
+	}
+	bf->junction_vmax = (bf->spindle_sync == true) ? 0 : _get_junction_vmax(mp_get_prev_buffer(bf), bf);
+	bf->delta_vmax = _get_target_velocity(0, bf->length, bf);
+	_set_vmax_limits(bf);
+	bf->braking_velocity = bf->delta_vmax;
+
+	uint8_t mr_flag = false;
+	BENCHMARK_PLAN_START
+	_plan_block_list(bf, &mr_flag);							// replan block list and commit current block
+	BENCHMARK_PLAN_END
+#ifdef __PLANNER_BENCHMARK
+	_benchmark_block(bf);
+#endif
+	copy_axis_vector(mm.position, bf->gm->target);			// update planning position
+	mp_queue_write_buffer(move_type);
+	mp_plan_trapezoid_callback();							// the first blocks may have changed
+}
+
 /* _plan_block_list() - plans the entire block list
  *
  *	The block list is the circular buffer of planner buffers (bf's). The block 
@@ -203,7 +888,9 @@ stat_t mp_aline(const GCodeState_t *gm_line)
  *	the first block that is not optimally planned becomes the effective first block.
  *
  *	_plan_block_list() plans all blocks between and including the (effective) first block 
- *	and the bf. It sets entry, exit and cruise v's from vmax's then calls trapezoid generation. 
+ *	and the bf. It sets entry, exit and cruise v's from vmax's and clears trapezoid_planned.
+ *	Trapezoid generation is left until the block is frozen or near the runtime - see
+ *	mp_plan_trapezoid().
  *
  *	Variables that must be provided in the mpBuffers that will be processed:
  *
@@ -231,9 +918,11 @@ stat_t mp_aline(const GCodeState_t *gm_line)
  *	  bf->cruise_velocity	- set during forward planning
  *	  bf->exit_velocity		- set during forward planning
  *
- *	  bf->head_length		- set during trapezoid generation
- *	  bf->body_length		- set during trapezoid generation
- *	  bf->tail_length		- set during trapezoid generation
+ *	  bf->trapezoid_planned	- cleared before the velocities are changed
+ *
+ *	  bf->head_length		- set during trapezoid generation (deferred)
+ *	  bf->body_length		- set during trapezoid generation (deferred)
+ *	  bf->tail_length		- set during trapezoid generation (deferred)
  *
  *	Variables that are ignored but here's what you would expect them to be:
  *	  bf->move_state		- NEW for all blocks but the earliest
@@ -255,45 +944,107 @@ stat_t mp_aline(const GCodeState_t *gm_line)
  *		These routines also set all blocks in the list to be replannable so the 
  *		list can be recomputed regardless of exact stops and previous replanning 
  *		optimizations.
+ *
+ *	[2]	Planning is incremental when called from mp_aline() (mr_flag is false). The 
+ *		backward pass stops at the first block whose braking velocity comes out unchanged,
+ *		as no block behind it can change either. The forward pass starts at that block 
+ *		and only replans blocks whose entry or exit velocity actually changed.
+ *		Feedhold replanning (mr_flag is true) changes lengths and vmax's in the middle of
+ *		the list, so it always gets the full backward and forward passes.
+ *
+ *	[3]	The incremental backward pass is bounded by the braking horizon, not by the
+ *		queue depth. A block's braking velocity grows with the path ahead of it, as
+ *		delta_vmax is computed from its jerk, and it reaches the block's entry_vmax
+ *		once that path is longer than the distance to brake from entry_vmax. From
+ *		there on the block is entered at its limit whatever follows, so once it was
+ *		already past its limit before this line was added nothing behind it can
+ *		change. The pass stops there and forward plans from that block, rather than
+ *		first walking to the block behind it to find it unchanged. Raising the pool
+ *		size adds no planning time per line - it is set by the velocities, lengths
+ *		and jerks of the moves in the horizon.
+ *
+ *	[4]	A block can be replanned on every line queued behind it until it is frozen,
+ *		so the passes do not calculate trapezoids - a line deep in the queue would
+ *		otherwise have its trapezoid worked out again for every line added. The
+ *		exit bound (entry_velocity + delta_vmax) keeps every exit reachable in the
+ *		length, so the trapezoid rarely lowers it later and the next block's entry
+ *		taken from it stays good. Each trapezoid is then calculated once in the main
+ *		loop, when its block is frozen here or comes up to run, whichever comes first.
  */
 static void _plan_block_list(mpBuf_t *bf, uint8_t *mr_flag)
 {
 	mpBuf_t *bp = bf;
+	uint8_t incremental = (*mr_flag == false);		// see Note [2]
+	uint16_t replanned = 1;							// the bf block is always planned
 
 	// Backward planning pass. Find first block and update the braking velocities.
-	// At the end *bp points to the buffer before the first block.
+	// At the end *bp points to the buffer before the first block to forward plan.
 	while ((bp = mp_get_prev_buffer(bp)) != bf) {
 		if (bp->replannable == false) { break; }
-		bp->braking_velocity = min(bp->nx->entry_vmax, bp->nx->braking_velocity) + bp->delta_vmax;
+		mpBuf_t *nx = mp_get_next_buffer(bp);
+		float braking_velocity = min(nx->entry_vmax, nx->braking_velocity) + bp->delta_vmax;
+		if ((incremental) && (fp_EQ(braking_velocity, bp->braking_velocity))) {
+			bp = mp_get_prev_buffer(bp);			// forward plan from the unchanged block
+			break;
+		}
+		uint8_t braked = (bp->braking_velocity >= bp->entry_vmax);
+		bp->braking_velocity = braking_velocity;
+		if ((incremental) && (braked) && (braking_velocity >= bp->entry_vmax)) {
+			bp = mp_get_prev_buffer(bp);			// past the braking horizon - see Note [3]
+			break;
+		}
 	}
 
-	// forward planning pass - recomputes trapezoids in the list from the first block to the bf block.
+	// forward planning pass - sets the velocities in the list from the first block to the bf block. See Note [4]
 	while ((bp = mp_get_next_buffer(bp)) != bf) {
-		if ((bp->pv == bf) || (*mr_flag == true))  {
-			bp->entry_velocity = bp->entry_vmax;		// first block in the list
+		mpBuf_t *pv = mp_get_prev_buffer(bp);
+		mpBuf_t *nx = mp_get_next_buffer(bp);
+		float entry_velocity;
+		if ((pv == bf) || (*mr_flag == true))  {
+			entry_velocity = bp->entry_vmax;			// first block in the list
 			*mr_flag = false;
 		} else {
-			bp->entry_velocity = bp->pv->exit_velocity;	// other blocks in the list
+			entry_velocity = pv->exit_velocity;			// other blocks in the list
+		}
+		float exit_velocity = min4(bp->exit_vmax, nx->braking_velocity, nx->entry_vmax,
+								  (entry_velocity + bp->delta_vmax));
+
+		if ((!incremental) || (fp_NE(entry_velocity, bp->entry_velocity)) || (fp_NE(exit_velocity, bp->exit_velocity))) {
+			bp->trapezoid_planned = false;
+			bp->entry_velocity = entry_velocity;
+			bp->cruise_velocity = bp->cruise_vmax;
+			bp->exit_velocity = exit_velocity;
+			replanned++;
 		}
-		bp->cruise_velocity = bp->cruise_vmax;
-		bp->exit_velocity = min4(bp->exit_vmax, bp->nx->braking_velocity, bp->nx->entry_vmax,
-								(bp->entry_velocity + bp->delta_vmax));
-		_calculate_trapezoid(bp);
 
 		// test for optimally planned trapezoids - only need to check various exit conditions
 		if ( ( (fp_EQ(bp->exit_velocity, bp->exit_vmax)) ||
-			   (fp_EQ(bp->exit_velocity, bp->nx->entry_vmax)) )  ||
-			 ( (bp->pv->replannable == false) &&
+			   (fp_EQ(bp->exit_velocity, nx->entry_vmax)) )  ||
+			 ( (pv->replannable == false) &&
 			   (fp_EQ(bp->exit_velocity, (bp->entry_velocity + bp->delta_vmax))) ) ) {
 
-			bp->replannable = false;
+			_freeze_block(bp);
 		}
 	}
 	// finish up the last block move
-	bp->entry_velocity = bp->pv->exit_velocity;
+	bp->trapezoid_planned = false;
+	bp->entry_velocity = mp_get_prev_buffer(bp)->exit_velocity;
 	bp->cruise_velocity = bp->cruise_vmax;
 	bp->exit_velocity = 0;
-	_calculate_trapezoid(bp);
+	SWO_REPLAN(replanned);
+}
+
+/*
+ *	_freeze_block() - mark a block optimally planned and set its trapezoid
+ *
+ *	No pass replans a frozen block until the list is reset (a hold or an override),
+ *	so its trapezoid is final and is published here. The passes freeze in list order,
+ *	so the block after it is still replannable and takes any lowered exit as its entry.
+ */
+static void _freeze_block(mpBuf_t *bp)
+{
+	bp->replannable = false;
+	mp_plan_trapezoid(bp);
 }
 
 /*
@@ -309,6 +1060,29 @@ static void _reset_replannable_list()
 	} while (((bp = mp_get_next_buffer(bp)) != bf) && (bp->move_state != MOVE_STATE_OFF));
 }
 
+/*
+ *	_replan_from() - replan the list forward from bp entering at entry_velocity
+ *
+ *	Buffers before bp must already be non-replannable. _plan_block_list() finishes 
+ *	the last block from its predecessor's exit, so a lone last block is done here.
+ */	
+static void _replan_from(mpBuf_t *bp, const float entry_velocity)
+{
+	uint8_t mr_flag = true;
+
+	bp->cruise_vmax = max(bp->cruise_vmax, entry_velocity);	// the entry is already committed
+	bp->entry_vmax = entry_velocity;
+	if (bp != mp_get_last_buffer()) {
+		_plan_block_list(mp_get_last_buffer(), &mr_flag);
+	} else {
+		bp->trapezoid_planned = false;
+		bp->entry_velocity = entry_velocity;
+		bp->cruise_velocity = bp->cruise_vmax;
+		bp->exit_velocity = 0;
+	}
+	mp_plan_trapezoid_callback();
+}
+
 /*
  * _calculate_trapezoid() - calculate trapezoid parameters
  *
@@ -445,32 +1219,17 @@ static void _calculate_trapezoid(mpBuf_t *bf)
 	if (bf->length < (bf->head_length + bf->tail_length)) { // it's rate limited
 
 		// Rate-limited HT case (symmetric case)
-		if (fabs(bf->entry_velocity - bf->exit_velocity) < TRAPEZOID_VELOCITY_TOLERANCE) {
+		if (fabsf(bf->entry_velocity - bf->exit_velocity) < TRAPEZOID_VELOCITY_TOLERANCE) {
 			bf->head_length = bf->length/2;
 			bf->tail_length = bf->head_length;
 			bf->cruise_velocity = min(bf->cruise_vmax, _get_target_velocity(bf->entry_velocity, bf->head_length, bf));
 			return;
 		}
 
-		// Rate-limited HT' case (asymmetric) - this is relatively expensive but it's not called very often
-		float computed_velocity = bf->cruise_vmax;
-		uint8_t i=0;
-		do {
-			bf->cruise_velocity = computed_velocity;	// initialize from previous iteration 
-			bf->head_length = _get_target_length(bf->entry_velocity, bf->cruise_velocity, bf);
-			bf->tail_length = _get_target_length(bf->exit_velocity, bf->cruise_velocity, bf);
-			if (bf->head_length > bf->tail_length) {
-				bf->head_length = (bf->head_length / (bf->head_length + bf->tail_length)) * bf->length;
-				computed_velocity = _get_target_velocity(bf->entry_velocity, bf->head_length, bf);
-			} else {
-				bf->tail_length = (bf->tail_length / (bf->head_length + bf->tail_length)) * bf->length;
-				computed_velocity = _get_target_velocity(bf->exit_velocity, bf->tail_length, bf);
-			}
-			if (++i > TRAPEZOID_ITERATION_MAX) { fprintf_P(stderr,PSTR("_calculate_trapezoid() failed to converge"));}
-		} while ((fabs(bf->cruise_velocity - computed_velocity) / computed_velocity) > TRAPEZOID_ITERATION_ERROR_PERCENT);
-
-		// set velocity and clean up any parts that are too short 
-		bf->cruise_velocity = computed_velocity;
+		// Rate-limited HT' case (asymmetric) - solved in closed form, fixed cost
+		bf->cruise_velocity = _get_ht_cruise_velocity(bf);
+
+		// set lengths and clean up any parts that are too short 
 		bf->head_length = _get_target_length(bf->entry_velocity, bf->cruise_velocity, bf);
 		bf->tail_length = bf->length - bf->head_length;
 		if (bf->head_length < MIN_HEAD_LENGTH) {
@@ -558,12 +1317,137 @@ static void _calculate_trapezoid(mpBuf_t *bf)
 
 static float _get_target_length(const float Vi, const float Vt, const mpBuf_t *bf)
 {
-	return (fabs(Vi-Vt) * sqrt(fabs(Vi-Vt) * bf->recip_jerk));
+	if (bf->accel > 0) { return (_get_accel_target_length(Vi, Vt, bf));}
+	return (fabsf(Vi-Vt) * fm_sqrt(fabsf(Vi-Vt) * bf->recip_jerk));
 }
 
 static float _get_target_velocity(const float Vi, const float L, const mpBuf_t *bf)
 {
-	return (pow(L, 0.66666666) * bf->cbrt_jerk + Vi);
+	if (bf->accel > 0) { return (_get_accel_target_velocity(Vi, L, bf));}
+	return (fm_pow23(L) * bf->cbrt_jerk + Vi);
+}
+
+/*
+ * _get_ht_cruise_velocity() - cruise velocity of a rate-limited asymmetric HT move
+ *
+ *	Finds Vc so the head from Ve and the tail to Vx exactly fill the length. With 
+ *	L = dV^(3/2) / sqrt(Jm) from _get_target_length() this is:
+ *
+ *	 a)	(Vc-Vlo)^(3/2) + (Vc-Vhi)^(3/2) = K		where K = L*sqrt(Jm), Vhi = max(Ve,Vx)
+ *
+ *	Substituting w = sqrt(Vc-Vlo), u = sqrt(Vc-Vhi), s = w+u and d = Vhi-Vlo = w^2-u^2 
+ *	turns a) into a quartic in s with no cubic or square terms:
+ *
+ *	 b)	s^4 - 4K*s + 3d^2 = 0
+ *
+ *	Its Ferrari resolvent m^3 - 3d^2*m - 2K^2 = 0 has exactly one real root because 
+ *	a rate-limited move always has K >= d^(3/2). Cardano gives that root as c + d^2/c
+ *	with c = cbrt(K^2 + sqrt(K^4 - d^6)); the second cube root is folded into d^2/c 
+ *	to avoid the cancellation. Factoring b) with m gives the wanted (largest) root:
+ *
+ *	 c)	s = (R + sqrt(8K/R - R^2)) / 2			where R = sqrt(2m)
+ *
+ *	and Vc = Vhi + u^2 with u = (s - d/s)/2. This is one cube root and four square 
+ *	roots regardless of the move, replacing up to TRAPEZOID_ITERATION_MAX passes of 
+ *	the successive approximation, each of which costs two sqrt() and a pow().
+ *	The result is exact to float precision (the iteration stopped within 10%).
+ */
+
+static float _get_ht_cruise_velocity(const mpBuf_t *bf)
+{
+	if (bf->accel > 0) { return (_get_accel_ht_cruise_velocity(bf));}
+
+	float d = fabsf(bf->entry_velocity - bf->exit_velocity);
+	float K = bf->length / fm_sqrt(bf->recip_jerk);
+	float K2 = K*K;
+	float d3 = d*d*d;
+	float c = fm_cbrt(K2 + fm_sqrt(max((float)0, (K2-d3)*(K2+d3))));	// == K^4-d^6 without overflowing
+	float R = fm_sqrt(2 * (c + d*d/c));
+	float s = (R + fm_sqrt(max((float)0, (8*K/R) - R*R))) / 2;
+	float u = (s - d/s) / 2;
+	return (max(bf->entry_velocity, bf->exit_velocity) + u*u);
+}
+
+/*
+ * _get_accel_target_length()	  - accel/decel length for an acceleration limited move
+ * _get_accel_target_velocity()	  - velocity achievable for an acceleration limited move
+ * _get_accel_ht_cruise_velocity() - rate-limited HT' cruise velocity for these moves
+ *
+ *	Used in place of the functions above when bf->accel is non-zero. The velocity 
+ *	change dV = |Vt-Vi| is made in up to 7 segments over the whole trapezoid: jerk 
+ *	up, constant acceleration Am, jerk down for the head, the body, and the same for 
+ *	the tail. A profile that would exceed Am gets a constant acceleration part; one 
+ *	with dV <= Am^2/Jm (bf->accel_dv) never reaches Am and is a plain S-curve.
+ *
+ *	The lengths are the true distances at velocity Vi+ rather than the Vi=0 form 
+ *	above, since the ramp time (and so the peak acceleration) depends on them at 
+ *	runtime. Both parts of the function meet at dV = Am^2/Jm:
+ *
+ *	 a)	L = (Vt+Vi) * sqrt(dV/Jm)				dV <= Am^2/Jm, T = 2*sqrt(dV/Jm)
+ *	 b)	L = (Vt+Vi)/2 * (dV/Am + Am/Jm)		dV >  Am^2/Jm, T = dV/Am + Am/Jm
+ *
+ *	For the velocity, with x = sqrt(dV), a) is the cubic x^3 + 2Vi*x - L*sqrt(Jm) = 0
+ *	which has one real root (Cardano, written without the cancelling difference), 
+ *	and b) is the quadratic dV^2 + dV*(2Vi + Am^2/Jm) + 2Vi*Am^2/Jm - 2L*Am = 0.
+ *
+ *	There is no closed form for the asymmetric HT' case so it is solved by false 
+ *	position (Illinois variant) between max(Ve,Vx) and the cruise velocity. It is 
+ *	only reached by acceleration limited moves that are too short to cruise.
+ */
+
+static float _get_accel_target_length(const float Vi, const float Vt, const mpBuf_t *bf)
+{
+	float dV = fabsf(Vt-Vi);
+	if (dV <= bf->accel_dv) {
+		return ((Vt+Vi) * fm_sqrt(dV * bf->recip_jerk));
+	}
+	return ((Vt+Vi)/2 * (dV/bf->accel + bf->accel * bf->recip_jerk));
+}
+
+static float _get_accel_target_velocity(const float Vi, const float L, const mpBuf_t *bf)
+{
+	if (fp_ZERO(L)) { return (Vi);}
+	if (L < ((2*Vi + bf->accel_dv) * bf->accel * bf->recip_jerk)) {	// does not reach Am
+		float p3 = 2*Vi/3;
+		float q2 = L / fm_sqrt(bf->recip_jerk) / 2;
+		float C = fm_cbrt(q2 + fm_sqrt(q2*q2 + p3*p3*p3));
+		float x = 2*q2 / (C*C + p3 + p3*p3/(C*C));
+		return (Vi + x*x);
+	}
+	float root = fm_sqrt(square(2*Vi - bf->accel_dv) + 8*L*bf->accel);
+	return (Vi + 4*(L*bf->accel - Vi*bf->accel_dv) / (2*Vi + bf->accel_dv + root));
+}
+
+static float _get_accel_ht_cruise_velocity(const mpBuf_t *bf)
+{
+	float v_lo = max(bf->entry_velocity, bf->exit_velocity);
+	float v_hi = bf->cruise_velocity;
+	float f_lo = _get_accel_target_length(bf->entry_velocity, v_lo, bf) + 
+				 _get_accel_target_length(bf->exit_velocity, v_lo, bf) - bf->length;
+	float f_hi = _get_accel_target_length(bf->entry_velocity, v_hi, bf) + 
+				 _get_accel_target_length(bf->exit_velocity, v_hi, bf) - bf->length;
+	float v = v_lo;
+	float f;
+	int8_t side = 0;
+
+	if (f_hi <= 0) { return (v_hi);}
+	if (f_lo >= 0) { return (v_lo);}
+	for (uint8_t i=0; i < TRAPEZOID_ITERATION_MAX; i++) {
+		v = (v_lo*f_hi - v_hi*f_lo) / (f_hi - f_lo);
+		f = _get_accel_target_length(bf->entry_velocity, v, bf) + 
+			_get_accel_target_length(bf->exit_velocity, v, bf) - bf->length;
+		if (fabsf(f) < TRAPEZOID_LENGTH_FIT_TOLERANCE) { break;}
+		if (f > 0) {
+			v_hi = v; f_hi = f;
+			if (side > 0) { f_lo /= 2;}				// same side twice - speed up the other end
+			side = 1;
+		} else {
+			v_lo = v; f_lo = f;
+			if (side < 0) { f_hi /= 2;}
+			side = -1;
+		}
+	}
+	return (v);
 }
 
 /*	
@@ -678,35 +1562,61 @@ static float _get_target_velocity(const float Vi, const float L, const mpBuf_t *
  *	 	U[i]	Unit sum of i'th axis	fabs(unit_a[i]) + fabs(unit_b[i])
  *	 	Usum	Length of sums			Ux + Uy
  *	 	d		Delta of sums			(Dx*Ux+DY*UY)/Usum
+ *
+ *	The fused deviation of each block (sqrt of the sum of its squared per-axis 
+ *	deviations) is computed once by mp_aline() and kept in bf->junction_delta, 
+ *	so each junction only pays for the incoming block's side.
+ *
+ *	The cornering acceleration is cm.junction_acceleration, lowered if needed so 
+ *	that no axis with a $xac limit takes more than that. The velocity change at 
+ *	the corner is along (b - a), so an axis sees the part of the centripetal 
+ *	acceleration given by its share of that vector.
+ *
+ *	G64 P<tolerance> replaces delta with the tolerance. The corner is still 
+ *	traversed as a point - the tolerance sets the speed of the virtual blend arc
+ *	rather than inserting one - and the blend radius is limited by the lengths
+ *	of the adjacent blocks.
+ *
+ *	Lines that continue an arc broken into segments meet on the arc, so the
+ *	junction is only held to the centripetal limit of the arc itself.
  */
-static float _get_junction_vmax(const float a_unit[], const float b_unit[])
-{
-	float costheta = - (a_unit[AXIS_X] * b_unit[AXIS_X]) - (a_unit[AXIS_Y] * b_unit[AXIS_Y]) 
-					 - (a_unit[AXIS_Z] * b_unit[AXIS_Z]) - (a_unit[AXIS_A] * b_unit[AXIS_A]) 
-					 - (a_unit[AXIS_B] * b_unit[AXIS_B]) - (a_unit[AXIS_C] * b_unit[AXIS_C]);
-
-	if (costheta < -0.99) { return (10000000); } 		// straight line cases
-	if (costheta > 0.99)  { return (0); } 				// reversal cases
-
-	// Fuse the junction deviations into a vector sum
-	float a_delta = square(a_unit[AXIS_X] * cm.a[AXIS_X].junction_dev);
-	a_delta += square(a_unit[AXIS_Y] * cm.a[AXIS_Y].junction_dev);
-	a_delta += square(a_unit[AXIS_Z] * cm.a[AXIS_Z].junction_dev);
-	a_delta += square(a_unit[AXIS_A] * cm.a[AXIS_A].junction_dev);
-	a_delta += square(a_unit[AXIS_B] * cm.a[AXIS_B].junction_dev);
-	a_delta += square(a_unit[AXIS_C] * cm.a[AXIS_C].junction_dev);
-
-	float b_delta = square(b_unit[AXIS_X] * cm.a[AXIS_X].junction_dev);
-	b_delta += square(b_unit[AXIS_Y] * cm.a[AXIS_Y].junction_dev);
-	b_delta += square(b_unit[AXIS_Z] * cm.a[AXIS_Z].junction_dev);
-	b_delta += square(b_unit[AXIS_A] * cm.a[AXIS_A].junction_dev);
-	b_delta += square(b_unit[AXIS_B] * cm.a[AXIS_B].junction_dev);
-	b_delta += square(b_unit[AXIS_C] * cm.a[AXIS_C].junction_dev);
-
-	float delta = (sqrt(a_delta) + sqrt(b_delta))/2;
-	float sintheta_over2 = sqrt((1 - costheta)/2);
+static float _get_junction_vmax(const mpBuf_t *a, const mpBuf_t *b)
+{
+	if ((b->gm->curve_tangent == true) && (a->move_type == MOVE_TYPE_ALINE)) {
+		return (b->gm->curve_vmax);
+	}
+	const int16_t *a_unit = a->unit;					// the unit vectors stay packed
+#ifdef __PLANNER_ARC_MOVES
+	if (a->move_type == MOVE_TYPE_ARC) { a_unit = a->arc.exit_unit;}	// arcs leave along their exit tangent
+#endif
+	float costheta = -mp_unit_dot(a_unit, b->unit);
+
+	if (costheta < -0.99f) { return (10000000); } 		// straight line cases
+	if (costheta > 0.99f)  { return (0); } 				// reversal cases
+
+	float delta = (a->junction_delta + b->junction_delta)/2;
+	if (b->gm->path_tolerance > 0) { delta = b->gm->path_tolerance;}	// G64 P blend tolerance
+	float sintheta_over2 = fm_sqrt((1 - costheta)/2);
 	float radius = delta * sintheta_over2 / (1-sintheta_over2);
-	return(sqrt(radius * cm.junction_acceleration));
+
+	// A blend within the G64 P tolerance must also fit in the blocks either side of the 
+	// corner. Its tangent points are radius/tan(theta/2) from the corner; allow half of 
+	// the shorter block so the next corner's blend has room too.
+	if ((b->gm->path_tolerance > 0) && 
+		((a->move_type == MOVE_TYPE_ALINE) || (a->move_type == MOVE_TYPE_ARC))) {
+		float tantheta_over2 = sintheta_over2 / fm_sqrt((1 + costheta)/2);
+		radius = min(radius, tantheta_over2 * min(a->length, b->length) / 2);
+	}
+
+	float accel = cm.junction_acceleration;
+	float turn = fm_sqrt(2 + 2 * costheta);				// |b - a| - costheta is -(a . b)
+	for (uint8_t i=0; i<AXES; i++) {
+		int32_t axis_turn = abs((int32_t)b->unit[i] - a_unit[i]);	// in 1/MP_UNIT_ONE
+		if ((cm.a[i].accel_max > 0) && (axis_turn != 0)) {
+			accel = min(accel, cm.a[i].accel_max * turn * MP_UNIT_ONE / axis_turn);
+		}
+	}
+	return(fm_sqrt(radius * accel));
 }
 
 /*************************************************************************
@@ -721,19 +1631,23 @@ static float _get_junction_vmax(const float a_unit[], const float b_unit[])
  */
 /*	Holds work like this:
  * 
- * 	  - Hold is asserted by calling cm_feedhold() (usually invoked via a ! char)
- *		If hold_state is OFF and motion_state is RUNning it sets 
- *		hold_state to SYNC and motion_state to HOLD.
- *
- *	  - Hold state == SYNC tells the aline exec routine to execute the next aline 
- *		segment then set hold_state to PLAN. This gives the planner sufficient 
- *		time to replan the block list for the hold before the next aline segment 
- *		needs to be processed.
+ * 	  - Hold is requested by cm_request_feedhold() (usually invoked via a switch)
+ *		If hold_state is OFF and motion_state is RUNning the aline exec routine
+ *		picks up the request after its next segment and sets hold_state to SYNC
+ *		and motion_state to HOLD. The main loop does not need to run for this.
+ *
+ *	  - Hold state == SYNC tells the aline exec routine to plan the hold in mr
+ *		if the deceleration fits in the rest of the running move (Case 1). That
+ *		is a fixed amount of math, so it is done right there and hold_state goes
+ *		to DECEL. The replan of the queue after the hold point is left to the
+ *		main loop as those blocks do not run until the hold ends. Otherwise the
+ *		exec sets hold_state to PLAN for the main loop to plan the hold (Case 2).
  *
  *	  - Hold state == PLAN tells the planner to replan the mr buffer, the current
  *		run buffer (bf), and any subsequent bf buffers as necessary to execute a
  *		hold. Hold planning replans the planner buffer queue down to zero and then
- *		back up from zero. Hold state is set to DECEL when planning is complete.
+ *		back up from zero. Only the blocks whose velocities change are replanned -
+ *		see _plan_hold_resume(). Hold state is set to DECEL when planning is complete.
  *
  *	  - Hold state == DECEL persists until the aline execution runs to zero 
  *		velocity, at which point hold state transitions to HOLD.
@@ -746,7 +1660,8 @@ static float _get_junction_vmax(const float a_unit[], const float b_unit[])
  *	  - mp_end_hold() is executed from cm_feedhold_sequencing_callback() once the 
  *		hold state == HOLD and a cycle_start has been requested.This sets the hold 
  *		state to OFF which enables _exec_aline() to continue processing. Move 
- *		execution begins with the first buffer after the hold.
+ *		execution begins with the first buffer after the hold. The time from here
+ *		to the first segment of the resume is kept as the resume latency ($rlat).
  *
  *	Terms used:
  *	 - mr is the runtime buffer. It was initially loaded from the bf buffer
@@ -764,28 +1679,159 @@ static float _get_junction_vmax(const float a_unit[], const float b_unit[])
  *		  code in this module, but the code is so complicated I just left it
  *		  organized for clarity and hoped for the best from compiler optimization. 
  */
-/*
-static float _compute_next_segment_velocity()
+/*
+static float _compute_next_segment_velocity()
+{
+	if (mr.move_state == MOVE_STATE_BODY) { return (mr.segment_velocity);}
+	return (mr.segment_velocity + mr.forward_diff_1);
+}
+*/
+
+/*
+ * _plan_hold_mr() - plan the hold deceleration in mr if it fits in the running move (Case 1)
+ *
+ *	Runs in bounded time - a fixed amount of math and no list traversal - so it is
+ *	safe to call from the exec. Returns true if the hold was planned. The blocks after
+ *	bp+0 still need _plan_hold_queue(). Returns false and leaves mr alone otherwise.
+ */
+static uint8_t _plan_hold_mr(mpBuf_t *bp)
+{
+	float mr_available_length;	// available length left in mr buffer for deceleration
+	float braking_velocity;		// velocity left to shed to brake to zero
+	float braking_length;		// distance required to brake to zero from braking_velocity
+
+	mr_available_length = get_axis_vector_length(mr.endpoint, mr.position);
+#ifdef __PLANNER_ARC_MOVES
+	if (mr.move_type == MOVE_TYPE_ARC) {		// the chord to the endpoint is shorter than the arc
+		mr_available_length = mr.path_end - mr.path_distance;
+	}
+#endif
+	braking_velocity = mr.segment_velocity;		// velocity of the next segment
+	if (mr.move_state != MOVE_STATE_BODY) { braking_velocity +=	mr.forward_diff_1;}
+	braking_length = _get_target_length(braking_velocity, 0, bp); // bp is OK to use here
+
+	// Hack to prevent Case 2 moves for perfect-fit decels. Happens in homing situations
+	// The real fix: The braking_velocity cannot simply be the mr.segment_velocity as this
+	// is the velocity of the last segment, not the one that's going to be executed next.
+	// The braking_velocity needs to be the velocity of the next segment that has not yet
+	// been computed. In the mean time, this hack will work.
+	if ((braking_length > mr_available_length) && (fp_ZERO(bp->exit_velocity))) {
+		braking_length = mr_available_length;
+	}
+	if (braking_length > mr_available_length) { return (false);}
+
+	// set mr to a tail to perform the deceleration
+	mr.exit_velocity = 0;
+	mr.tail_length = braking_length;
+	mr.cruise_velocity = braking_velocity;
+	mr.move_state = MOVE_STATE_TAIL;
+	mr.section_state = MOVE_STATE_NEW;
+
+	// re-use bp+0 to be the hold point and to run the remaining block length
+	bp->length = mr_available_length - braking_length;
+#ifdef __PLANNER_ARC_MOVES
+	if (bp->move_type == MOVE_TYPE_ARC) { bp->path_start = mr.path_end - bp->length;}
+#endif
+	bp->delta_vmax = _get_target_velocity(0, bp->length, bp);
+	bp->entry_vmax = 0;							// set bp+0 as hold point
+	bp->move_state = MOVE_STATE_NEW;			// tell _exec to re-use the bf buffer
+	return (true);
+}
+
+/*
+ * _plan_hold_queue() - replan the queue from bp+0 after the hold has been planned in mr
+ */
+static void _plan_hold_queue()
 {
-	if (mr.move_state == MOVE_STATE_BODY) { return (mr.segment_velocity);}
-	return (mr.segment_velocity + mr.forward_diff_1);
+	mm.hold_replan = false;
+	mpBuf_t *bp = mp_get_run_buffer();
+	if (bp != NULL) { _plan_hold_resume(bp);}	// bp+0 is the hold point
+}
+
+/*
+ * _plan_hold_resume() - plan the blocks from the hold point on, keeping the pre-hold plan
+ *
+ *	Only the hold point itself is changed by hold planning - it now enters at zero.
+ *	The braking velocities of the blocks after it depend only on the blocks after them,
+ *	so they are still good, and so are the replannable flags. The hold point is planned
+ *	up from zero and the list is walked forward only until a block plans to the entry 
+ *	and exit it already had - the rest of the plan is unchanged from there. Usually 
+ *	that is the block after the hold point, so the resume is not held up by a replan 
+ *	of the whole queue.
+ */
+static void _plan_hold_resume(mpBuf_t *bp)
+{
+	mpBuf_t *last = mp_get_last_buffer();
+	float entry_velocity = bp->entry_vmax;		// zero, or the entry already committed
+
+	for (mpBufCount_t i=0; i<PLANNER_BUFFER_POOL_SIZE; i++) {// a safety to avoid wraparound
+		mpBuf_t *nx = mp_get_next_buffer(bp);
+		float exit_velocity = 0;				// the last block plans to zero
+		if (bp != last) {
+			exit_velocity = min4(bp->exit_vmax, nx->braking_velocity, nx->entry_vmax,
+								(entry_velocity + bp->delta_vmax));
+		}
+		if ((i != 0) && (fp_EQ(entry_velocity, bp->entry_velocity)) && (fp_EQ(exit_velocity, bp->exit_velocity))) {
+			break;								// the cached plan holds from here on
+		}
+		bp->trapezoid_planned = false;
+		bp->entry_velocity = entry_velocity;
+		bp->cruise_velocity = bp->cruise_vmax;
+		bp->exit_velocity = exit_velocity;
+		if (bp == last) { break;}
+
+		// same test for optimally planned trapezoids as _plan_block_list()
+		bp->replannable = true;
+		if ((fp_EQ(bp->exit_velocity, bp->exit_vmax)) || (fp_EQ(bp->exit_velocity, nx->entry_vmax)) ||
+			(((i == 0) || (mp_get_prev_buffer(bp)->replannable == false)) && 
+			 (fp_EQ(bp->exit_velocity, (bp->entry_velocity + bp->delta_vmax))))) {
+			_freeze_block(bp);
+		}
+		entry_velocity = bp->exit_velocity;
+		bp = nx;
+	}
+	mp_plan_trapezoid_callback();
+}
+
+/*
+ * _set_hold_decel() - set the hold state to decelerate and record the planning latency
+ */
+static void _set_hold_decel()
+{
+	mm.hold_latency = (float)(_get_cycles() - mm.hold_cycles) / CYCLES_PER_USEC;
+	cm.hold_state = FEEDHOLD_DECEL;
+	SWO_HOLD_STATE();
 }
-*/
 
 stat_t mp_plan_hold_callback()
 {
+	if (mm.hold_replan == true) {				// Case 1 was planned by the exec; finish the queue
+		_plan_hold_queue();
+		return (STAT_OK);
+	}
 	if (cm.hold_state != FEEDHOLD_PLAN) { return (STAT_NOOP);}	// not planning a feedhold
 
 	mpBuf_t *bp; 				// working buffer pointer
 	if ((bp = mp_get_run_buffer()) == NULL) { return (STAT_NOOP);}	// Oops! nothing's running
 
-	uint8_t mr_flag = true;		// used to tell replan to account for mr buffer Vx
 	float mr_available_length;	// available length left in mr buffer for deceleration
 	float braking_velocity;		// velocity left to shed to brake to zero
 	float braking_length;		// distance required to brake to zero from braking_velocity
 
+	// Case 1: deceleration fits entirely into the length remaining in mr buffer
+	if (_plan_hold_mr(bp) == true) {
+		_plan_hold_queue();
+		_set_hold_decel();						// set state to decelerate and exit
+		return (STAT_OK);
+	}
+
 	// examine and process mr buffer
 	mr_available_length = get_axis_vector_length(mr.endpoint, mr.position);
+#ifdef __PLANNER_ARC_MOVES
+	if (mr.move_type == MOVE_TYPE_ARC) {		// the chord to the endpoint is shorter than the arc
+		mr_available_length = mr.path_end - mr.path_distance;
+	}
+#endif
 
 /*	mr_available_length = 
 		(sqrt(square(mr.endpoint[AXIS_X] - mr.position[AXIS_X]) +
@@ -800,38 +1846,6 @@ stat_t mp_plan_hold_callback()
 	// compute next_segment velocity
 	braking_velocity = mr.segment_velocity;
 	if (mr.move_state != MOVE_STATE_BODY) { braking_velocity +=	mr.forward_diff_1;}
-
-	braking_length = _get_target_length(braking_velocity, 0, bp); // bp is OK to use here
-	
-	// Hack to prevent Case 2 moves for perfect-fit decels. Happens in homing situations
-	// The real fix: The braking velocity cannot simply be the mr.segment_velocity as this
-	// is the velocity of the last segment, not the one that's going to be executed next.
-	// The braking_velocity needs to be the velocity of the next segment that has not yet 
-	// been computed. In the mean time, this hack will work. 
-	if ((braking_length > mr_available_length) && (fp_ZERO(bp->exit_velocity))) {
-		braking_length = mr_available_length;
-	}
-
-	// Case 1: deceleration fits entirely into the length remaining in mr buffer
-	if (braking_length <= mr_available_length) {
-		// set mr to a tail to perform the deceleration
-		mr.exit_velocity = 0;
-		mr.tail_length = braking_length;
-		mr.cruise_velocity = braking_velocity;
-		mr.move_state = MOVE_STATE_TAIL;
-		mr.section_state = MOVE_STATE_NEW;
-
-		// re-use bp+0 to be the hold point and to run the remaining block length
-		bp->length = mr_available_length - braking_length;
-		bp->delta_vmax = _get_target_velocity(0, bp->length, bp);
-		bp->entry_vmax = 0;						// set bp+0 as hold point
-		bp->move_state = MOVE_STATE_NEW;		// tell _exec to re-use the bf buffer
-
-		_reset_replannable_list();				// make it replan all the blocks
-		_plan_block_list(mp_get_last_buffer(), &mr_flag);
-		cm.hold_state = FEEDHOLD_DECEL;			// set state to decelerate and exit
-		return (STAT_OK);
-	}
 
 	// Case 2: deceleration exceeds length remaining in mr buffer
 	// First, replan mr to minimum (but non-zero) exit velocity
@@ -845,9 +1859,10 @@ stat_t mp_plan_hold_callback()
 	// Find the point where deceleration reaches zero. This could span multiple buffers.
 	braking_velocity = mr.exit_velocity;		// adjust braking velocity downward
 	bp->move_state = MOVE_STATE_NEW;			// tell _exec to re-use buffer
-	for (uint8_t i=0; i<PLANNER_BUFFER_POOL_SIZE; i++) {// a safety to avoid wraparound
-		mp_copy_buffer(bp, bp->nx);				// copy bp+1 into bp+0 (and onward...)
-		if (bp->move_type != MOVE_TYPE_ALINE) {	// skip any non-move buffers
+	mpBuf_t *decel = bp;						// first block of the deceleration
+	for (mpBufCount_t i=0; i<PLANNER_BUFFER_POOL_SIZE; i++) {// a safety to avoid wraparound
+		mp_copy_buffer(bp, mp_get_next_buffer(bp));	// copy bp+1 into bp+0 (and onward...)
+		if ((bp->move_type != MOVE_TYPE_ALINE) && (bp->move_type != MOVE_TYPE_ARC)) { // skip any non-move buffers
 			bp = mp_get_next_buffer(bp);		// point to next buffer
 			continue;
 		}
@@ -870,12 +1885,24 @@ stat_t mp_plan_hold_callback()
 	bp = mp_get_next_buffer(bp);				// point to the acceleration buffer
 	bp->entry_vmax = 0;
 	bp->length -= braking_length;				// the buffers were identical (and hence their lengths)
+#ifdef __PLANNER_ARC_MOVES
+	if (bp->move_type == MOVE_TYPE_ARC) { bp->path_start += braking_length;}	// accel resumes past the decel
+#endif
 	bp->delta_vmax = _get_target_velocity(0, bp->length, bp);
 	bp->exit_vmax = bp->delta_vmax;
 
-	_reset_replannable_list();					// make it replan all the blocks
-	_plan_block_list(mp_get_last_buffer(), &mr_flag);
-	cm.hold_state = FEEDHOLD_DECEL;				// set state to decelerate and exit
+	// The decel blocks run from their entry down to their exit. Nothing is replanned
+	// into them, so they are planned directly and the rest from the hold point on.
+	for (; decel != bp; decel = mp_get_next_buffer(decel)) {
+		if ((decel->move_type != MOVE_TYPE_ALINE) && (decel->move_type != MOVE_TYPE_ARC)) { continue;}
+		decel->trapezoid_planned = false;
+		decel->entry_velocity = decel->entry_vmax;
+		decel->cruise_velocity = decel->entry_vmax;
+		decel->exit_velocity = decel->exit_vmax;
+		_freeze_block(decel);
+	}
+	_plan_hold_resume(bp);
+	_set_hold_decel();							// set state to decelerate and exit
 	return (STAT_OK);
 }
 
@@ -885,7 +1912,11 @@ stat_t mp_plan_hold_callback()
 stat_t mp_end_hold()
 {
 	if (cm.hold_state == FEEDHOLD_END_HOLD) { 
+		if (mm.hold_replan == true) { _plan_hold_queue();}	// the main loop did not get to it yet
 		cm.hold_state = FEEDHOLD_OFF;
+		SWO_HOLD_STATE();
+		if (SQ_RESUME() == true) { return (STAT_OK);}		// the step queue speeds its clock back up
+		if (RP_RESUME() == true) { return (STAT_OK);}		// and a replay its segments
 		mpBuf_t *bf;
 		if ((bf = mp_get_run_buffer()) == NULL) {	// NULL means nothing's running
 //			cm.motion_state = MOTION_STOP;
@@ -893,11 +1924,140 @@ stat_t mp_end_hold()
 			return (STAT_NOOP);
 		}
 		cm.motion_state = MOTION_RUN;
+		mm.resume_cycles = _get_cycles();		// see _exec_aline() for the resume latency
+		mm.resume_pending = true;
 		st_request_exec_move();					// restart the steppers
 	}
 	return (STAT_OK);
 }
 
+/*************************************************************************
+ * mp_feed_rate_override() 	   - set the feed rate override factor
+ * mp_plan_override_callback() - replan the queue and the running move for the factor
+ *
+ *	The factor scales cruise_vmax of every overridable move (see _set_cruise_limits()),
+ *	queued or yet to be queued. A flag of FALSE cancels the override (factor 1.0).
+ *
+ *	Replanning uses the hold handshake: mp_feed_rate_override() sets override_state 
+ *	to SYNC, the aline exec promotes it to PLAN after the next segment is prepped, 
+ *	and the main loop callback replans from mr the same way mp_plan_hold_callback() 
+ *	does. Overrides wait while a feedhold is in progress.
+ *
+ *	If mr is accelerating or cruising in an overridable move and the change fits in 
+ *	the rest of the move, mr is cut short to a jerk-limited transition to the new 
+ *	cruise velocity and bp+0 is re-used to run the remaining length. mr.endpoint is 
+ *	left alone so a later hold still sees the whole remaining length, and the last 
+ *	segment correction is inhibited since mr no longer ends there. Otherwise mr runs 
+ *	out as planned and the queue is replanned from its exit velocity.
+ */
+
+stat_t mp_feed_rate_override(uint8_t flag, float parameter)
+{
+	float factor = 1;
+
+	if (flag == true) {
+		if (parameter < FEED_OVERRIDE_MIN) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+		if (parameter > FEED_OVERRIDE_MAX) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+		factor = parameter;
+	}
+	if (fp_EQ(factor, mm.feed_override)) { return (STAT_OK);}
+	mm.feed_override = factor;
+	if (mp_get_run_buffer() != NULL) { mm.override_state = OVERRIDE_SYNC;}
+	return (STAT_OK);
+}
+
+/*
+ * mp_set_adaptive_factor() - set the load-adaptive feed factor (see ad_feed_callback())
+ *
+ *	A second override factor owned by the runtime rather than the host. It is 
+ *	replanned through the same handshake, so a change is jerk-limited like $mfo. 
+ *	The factor is not range checked here - the caller clamps it.
+ */
+
+void mp_set_adaptive_factor(const float factor)
+{
+	if (fp_EQ(factor, mm.adaptive_factor)) { return;}
+	mm.adaptive_factor = factor;
+	if (mp_get_run_buffer() != NULL) { mm.override_state = OVERRIDE_SYNC;}
+}
+
+stat_t mp_plan_override_callback()
+{
+	if (mm.override_state != OVERRIDE_PLAN) { return (STAT_NOOP);}	// not planning an override
+	if (cm.hold_state != FEEDHOLD_OFF) { return (STAT_OK);}		// not idle - wait for the hold to finish
+	mm.override_state = OVERRIDE_OFF;
+
+	mpBuf_t *bp; 				// working buffer pointer
+	if ((bp = mp_get_run_buffer()) == NULL) { return (STAT_NOOP);}	// nothing's running
+
+	// rescale every move in the queue, the run buffer included as bp+0 may be re-used
+	mpBuf_t *bf = bp;
+	do {
+		if ((bf->move_type == MOVE_TYPE_ALINE) || (bf->move_type == MOVE_TYPE_ARC)) {
+			bf->cruise_vmax = _get_cruise_vmax(bf);
+			_set_vmax_limits(bf);
+		}
+	} while (((bf = mp_get_next_buffer(bf)) != bp) && (bf->move_state != MOVE_STATE_OFF));
+	_reset_replannable_list();
+
+	// Case 1: change the velocity of the running move
+	if (((mr.move_state == MOVE_STATE_HEAD) || (mr.move_state == MOVE_STATE_BODY)) && 
+		(mr.section_state != MOVE_STATE_NEW) && (bp->move_state == MOVE_STATE_RUN) &&
+		(bp->overridable == true) && (fp_NE(bp->cruise_vmax, mr.cruise_velocity))) {
+
+		float available_length = get_axis_vector_length(mr.endpoint, mr.position);
+#ifdef __PLANNER_ARC_MOVES
+		if (mr.move_type == MOVE_TYPE_ARC) { available_length = mr.path_end - mr.path_distance;}
+#endif
+		float velocity = mr.segment_velocity;	// velocity of the next segment
+		if (mr.move_state != MOVE_STATE_BODY) { velocity += mr.forward_diff_1;}
+		float target = bp->cruise_vmax;
+		float transition_length = max(_get_target_length(velocity, target, bp), 
+									  (MIN_SEGMENT_TIME * (velocity + target)));
+
+		if ((transition_length + _get_target_length(target, bp->exit_velocity, bp)) < available_length) {
+			if (target > velocity) {
+				mr.move_state = MOVE_STATE_HEAD;
+				mr.entry_velocity = velocity;
+				mr.cruise_velocity = target;
+				mr.head_length = transition_length;
+				mr.tail_length = 0;
+			} else {
+				mr.move_state = MOVE_STATE_TAIL;
+				mr.cruise_velocity = velocity;
+				mr.tail_length = transition_length;
+			}
+			mr.exit_velocity = target;
+			mr.body_length = 0;
+			mr.section_state = MOVE_STATE_NEW;
+			mr.correction_inhibit = true;
+
+			// re-use bp+0 to run the remaining block length at the new velocity
+			bp->length = available_length - transition_length;
+#ifdef __PLANNER_ARC_MOVES
+			if (bp->move_type == MOVE_TYPE_ARC) { bp->path_start = mr.path_end - bp->length;}
+#endif
+			bp->delta_vmax = _get_target_velocity(0, bp->length, bp);
+			_set_vmax_limits(bp);
+			bp->move_state = MOVE_STATE_NEW;		// tell _exec to re-use the bf buffer
+			_replan_from(bp, target);
+			return (STAT_OK);
+		}
+	}
+
+	// Case 2: let mr run out and replan the rest of the queue from its exit
+	float entry_velocity = bp->entry_velocity;		// mr is between moves
+	if (mr.move_state != MOVE_STATE_OFF) {
+		entry_velocity = mr.exit_velocity;
+		if (bp->move_state == MOVE_STATE_RUN) {		// otherwise bp+0 was re-used and runs again
+			bp->replannable = false;
+			if ((bp = mp_get_next_buffer(bp))->move_state == MOVE_STATE_OFF) { return (STAT_OK);}
+		}
+	}
+	_replan_from(bp, entry_velocity);
+	return (STAT_OK);
+}
+
 
 /*************************************************************************/
 /**** ALINE EXECUTION ROUTINES *******************************************/
@@ -982,31 +2142,74 @@ static stat_t _exec_aline(mpBuf_t *bf)
 	// start a new move by setting up local context (singleton)
 	if (mr.move_state == MOVE_STATE_OFF) {
 		if (cm.hold_state == FEEDHOLD_HOLD) { return (STAT_NOOP);}// stops here if holding
+		mp_run_attached(bf);							// before any wait - may be a spindle speed
+		if ((bf->spindle_sync == true) && (cm_spindle_wait() == true)) { return (STAT_NOOP);}// ...or until the spindle is at speed
+		bf->replannable = false;						// the passes leave it alone from here...
+		if (bf->trapezoid_planned == false) {			// ...and the main loop publishes its trapezoid
+			controller_request_task(TASK_PLAN_TRAPEZOID);
+			return (STAT_NOOP);
+		}
 
 		// initialization to process the new incoming bf buffer
-		memcpy(&mr.gm, &(bf->gm), sizeof(GCodeState_t));// copy in the gcode model state
-		bf->replannable = false;
+		memcpy(&mr.gm, bf->gm, sizeof(GCodeState_t));// copy in the gcode model state
+		SWO_BLOCK_START(mr.gm.linenum);
+		RP_RECORD_BLOCK();							// see replay.h
+		SR_MODAL_CHANGED();							// new line number and modes to report
+		mr.raster_pending = (bf->gm->raster == RASTER_RUNNING) ? RASTER_OFF : bf->gm->raster;
+		if (bf->gm->raster != RASTER_OFF) { bf->gm->raster = RASTER_RUNNING;}	// once only - not again after a hold
 														// too short lines have already been removed
 		if (fp_ZERO(bf->length)) {						// ...looks for an actual zero here
 			mr.move_state = MOVE_STATE_OFF;				// reset mr buffer
 			mr.section_state = MOVE_STATE_OFF;
-			bf->nx->replannable = false;				// prevent overplanning (Note 2)
+			mp_get_next_buffer(bf)->replannable = false;	// prevent overplanning (Note 2)
 			st_prep_null();								// call this to keep the loader happy
 			mp_free_run_buffer();
 			return (STAT_NOOP);
 		}
+		if ((fp_ZERO(bf->exit_velocity)) && (fp_NOT_ZERO(bf->exit_vmax)) &&	// stopping only because the
+			(mp_get_next_buffer(bf)->buffer_state <= MP_BUFFER_LOADING)) {	// ...queue has nothing after it
+			mps.starved_exits++;
+		}
+		if (mr.job_ended == true) {						// first move of a new job
+			mr.job_usec = 0;
+			mr.job_ended = false;
+			mp_reset_job_stats();
+		}
+		_count_job_block(bf);
+		mr.move_usec = 0;
 		bf->move_state = MOVE_STATE_RUN;
 		mr.move_state = MOVE_STATE_HEAD;
 		mr.section_state = MOVE_STATE_NEW;
 		mr.jerk = bf->jerk;
+		mr.accel = bf->accel;
+		mr.correction_inhibit = false;
 		mr.head_length = bf->head_length;
 		mr.body_length = bf->body_length;
 		mr.tail_length = bf->tail_length;
 		mr.entry_velocity = bf->entry_velocity;
 		mr.cruise_velocity = bf->cruise_velocity;
 		mr.exit_velocity = bf->exit_velocity;
-		copy_axis_vector(mr.unit, bf->unit);
-		copy_axis_vector(mr.endpoint, bf->gm.target);	// save the final target of the move
+		mr.cruise_vmax = bf->cruise_vmax;
+		mr.prev_segment_velocity = bf->entry_velocity;
+		AUX_FRAME(bf);									// asynchronous axes - see plan_aux.cpp
+		_set_move_unit(bf);								// sets mr.endpoint too
+#ifdef __PRESSURE_ADVANCE
+		mr.pa_gain = 0;									// advance moves that extrude along a path
+		float extrude = mr.endpoint[cm.pa_axis] - mr.position[cm.pa_axis];
+		if ((extrude > 0) && (fp_NOT_ZERO(cm.pa_k)) && ((mr.endpoint[AXIS_X] != mr.position[AXIS_X]) ||
+			(mr.endpoint[AXIS_Y] != mr.position[AXIS_Y]) || (mr.endpoint[AXIS_Z] != mr.position[AXIS_Z]))) {
+			mr.pa_gain = cm.pa_k * extrude / (bf->length * 60);	// velocities are per minute
+		}
+#endif
+#ifdef __PLANNER_ARC_MOVES
+		mr.move_type = bf->move_type;
+		if (bf->move_type == MOVE_TYPE_ARC) {
+			memcpy(&mr.arc, &bf->arc, sizeof(mpArc_t));
+			mr.path_distance = bf->path_start;
+			mr.path_end = bf->path_start + bf->length;
+			mr.arc_correction_count = 0;			// first point is always exact
+		}
+#endif
 	}
 	// NB: from this point on the contents of the bf buffer do not affect execution
 
@@ -1020,13 +2223,42 @@ static stat_t _exec_aline(mpBuf_t *bf)
 		default: 				{ return (STAT_INTERNAL_ERROR);}
 	}
 
+	if (status == STAT_EAGAIN) { _stage_next_move(bf);}	// while this move still has segments to run
+
 	// Feedhold processing. Refer to canonical_machine.h for state machine
-	// Catch the feedhold request and start the planning the hold
-	if (cm.hold_state == FEEDHOLD_SYNC) { cm.hold_state = FEEDHOLD_PLAN;}
+	// Catch the feedhold request here so the hold does not wait on the main loop
+	if ((cm.feedhold_requested == true) && (status == STAT_EAGAIN) &&
+		(cm.motion_state == MOTION_RUN) && (cm.hold_state == FEEDHOLD_OFF)) {
+		cm.feedhold_requested = false;
+		cm_set_motion_state(MOTION_HOLD);
+		cm.hold_state = FEEDHOLD_SYNC;
+		SWO_HOLD_STATE();
+	}
+	if ((mm.resume_pending == true) && (cm.hold_state == FEEDHOLD_OFF)) {
+		mm.resume_pending = false;				// first segment prepped since mp_end_hold()
+		mm.resume_latency = (float)(_get_cycles() - mm.resume_cycles) / CYCLES_PER_USEC;
+	}
+	// Plan the hold now if it fits in mr, otherwise start the main loop planning the hold
+	if (cm.hold_state == FEEDHOLD_SYNC) {
+		if ((status == STAT_EAGAIN) && (_plan_hold_mr(bf) == true)) {
+			mm.hold_replan = true;				// the queue is replanned from the main loop
+			_set_hold_decel();
+		} else {
+			cm.hold_state = FEEDHOLD_PLAN;
+			SWO_HOLD_STATE();
+		}
+		controller_request_task(TASK_PLAN_HOLD);
+	}
+	if (mm.override_state == OVERRIDE_SYNC) { 	// same for feed rate override
+		mm.override_state = OVERRIDE_PLAN;
+		controller_request_task(TASK_PLAN_OVERRIDE);
+	}
 
 	// Look for the end of the decel to go into HOLD state
 	if ((cm.hold_state == FEEDHOLD_DECEL) && (status == STAT_OK)) {
+		mm.hold_stop_time = (float)(_get_cycles() - mm.hold_cycles) / CYCLES_PER_USEC;
 		cm.hold_state = FEEDHOLD_HOLD;
+		SWO_HOLD_STATE();
 		cm_set_motion_state(MOTION_HOLD);
 
 //		mp_free_run_buffer();				// free bf and send a status report
@@ -1045,14 +2277,114 @@ static stat_t _exec_aline(mpBuf_t *bf)
 	} else {
 		mr.move_state = MOVE_STATE_OFF;			// reset mr buffer
 		mr.section_state = MOVE_STATE_OFF;
-		bf->nx->replannable = false;			// prevent overplanning (Note 2)
+		SWO_BLOCK_END(mr.gm.linenum);
+		if (fp_ZERO(mr.exit_velocity)) { _mark_job_stop();}
+		mpBuf_t *nx = mp_get_next_buffer(bf);
+		nx->replannable = false;				// prevent overplanning (Note 2)
 		if (bf->move_state == MOVE_STATE_RUN) {
+			if ((bf->host_planned == true) && (fp_NOT_ZERO(mr.exit_velocity)) &&	// nothing continues
+				((nx->buffer_state < MP_BUFFER_QUEUED) ||						// ...from a host 
+				 (nx->entry_velocity * (1 + PLANNED_LIMIT_TOLERANCE) < mr.exit_velocity))) {	// ...planned exit
+				cm_alarm(STAT_PLANNED_MOVE_UNDERRUN);
+			}
 			mp_free_run_buffer();				// free bf if it's actually done
 		}
 	}
 	return (status);
 }
 
+/*
+ * _count_job_block() - count a block the runtime is starting in the job stats
+ * _mark_job_stop()	  - note that the block the runtime finished ended at zero velocity
+ *
+ *	See mp_reset_job_stats(). A stop under STOP_CYCLES_MS is timed with the cycle
+ *	counter. Longer ones - an M0, a tool change - are timed with SysTick.
+ */
+static void _count_job_block(const mpBuf_t *bf)
+{
+	mpj.blocks++;
+	if ((bf->cruise_vmax - bf->cruise_velocity) > EPSILON) {
+		mpj.lookahead_limited++;
+	} else {
+		mpj.feed_limited++;
+	}
+	if ((bf->move_type == MOVE_TYPE_ALINE) &&			// a line an arc was cut into
+		((bf->gm->motion_mode == MOTION_MODE_CW_ARC) || (bf->gm->motion_mode == MOTION_MODE_CCW_ARC))) {
+		mpj.arc_segments++;
+	}
+	if (mpj.stopped == false) { return;}
+	mpj.stopped = false;
+	mpj.stops++;
+	uint32_t ms = _get_ms() - mpj.stop_ms;
+	if (ms < STOP_CYCLES_MS) {
+		mpj.stop_usec += (_get_cycles() - mpj.stop_cycles) / CYCLES_PER_USEC;
+	} else {
+		mpj.stop_usec += (uint64_t)ms * 1000;
+	}
+}
+
+static void _mark_job_stop()
+{
+	mpj.stopped = true;
+	mpj.stop_cycles = _get_cycles();
+	mpj.stop_ms = _get_ms();
+}
+
+/*
+ * _set_move_unit()	   - set the endpoint and unit vector of a move the runtime is starting
+ * _stage_next_move()  - work out the direction of the next move while this one runs
+ *
+ *	The runtime runs a line along the line from its start to its endpoint, not along 
+ *	the packed unit vector in the buffer, so a move ends exactly. Finding that direction
+ *	takes a square root and a divide per axis - in software floating point on this 
+ *	part - which would land on the segment that starts the move, along with the rest of
+ *	the move setup. So once the next block is queued, the direction from the endpoint 
+ *	of this move to its target is worked out on a segment of this move that has time 
+ *	to spare, and taken up when the move starts if it still starts from that endpoint 
+ *	and goes to that target. A hold, override transition or flush that moves either 
+ *	end leaves it to be worked out at the start as before.
+ *
+ *	The rest of the move setup - the head's section times and forward differences - 
+ *	depends on the velocities, which the planner can change until the move starts, so 
+ *	it stays at the start of the move.
+ */
+static void _set_move_unit(mpBuf_t *bf)
+{
+	copy_axis_vector(mr.endpoint, bf->gm->target);	// save the final target of the move
+	if ((mr.staged_bf == bf) &&						// staged by the move before this one
+		(memcmp(mr.staged_start, mr.position, sizeof(mr.position)) == 0) &&
+		(memcmp(mr.staged_target, mr.endpoint, sizeof(mr.endpoint)) == 0)) {
+		copy_axis_vector(mr.unit, mr.staged_unit);
+		mr.staged_bf = NULL;
+		return;
+	}
+	mr.staged_bf = NULL;
+	float length = get_axis_vector_length(mr.endpoint, mr.position);
+	if (length > EPSILON) {							// run along the line itself, not the
+		for (uint8_t i=0; i<AXES; i++) {			// ...packed unit vector, so it ends exactly
+			mr.unit[i] = (mr.endpoint[i] - mr.position[i]) / length;
+		}
+	} else {
+		mp_get_unit(mr.unit, bf->unit);
+	}
+}
+
+static void _stage_next_move(mpBuf_t *bf)
+{
+	mpBuf_t *nx = mp_get_next_buffer(bf);
+	if ((mr.staged_bf == nx) ||						// done already, or not there yet
+		(nx->buffer_state < MP_BUFFER_QUEUED) || (nx->bf_func != _exec_aline)) { return;}
+
+	float length = get_axis_vector_length(nx->gm->target, mr.endpoint);
+	if (length <= EPSILON) { return;}
+	for (uint8_t i=0; i<AXES; i++) {
+		mr.staged_unit[i] = (nx->gm->target[i] - mr.endpoint[i]) / length;
+	}
+	copy_axis_vector(mr.staged_start, mr.endpoint);
+	copy_axis_vector(mr.staged_target, nx->gm->target);
+	mr.staged_bf = nx;
+}
+
 /* Forward difference math explained:
  * 	We're using two quadratic bezier curves end-to-end, forming the concave and convex 
  *	section of the s-curve. For each half we have three points:
@@ -1088,6 +2420,109 @@ static void _init_forward_diffs(float t0, float t2)
 	mr.segment_velocity = t0;
 }
 
+/*
+ * _init_accel_section()  - set up a head or tail that reaches the acceleration limit
+ * _init_accel_constant() - set up the constant acceleration part (MOVE_STATE_RUN3)
+ * _init_accel_convex()	  - set up the last jerk part, ending at zero acceleration
+ * _get_accel_segments()  - segments for a part, none shorter than MIN_SEGMENT_USEC
+ *
+ *	A head or tail of an acceleration limited move (mr.accel non-zero) whose velocity 
+ *	change exceeds Am^2/Jm runs as three parts: jerk up to Am (RUN1), constant 
+ *	acceleration (RUN3) and jerk back down to zero (RUN2). Each jerk part takes 
+ *	Tj = Am/Jm and changes the velocity by Am^2/(2*Jm). The profile is symmetric 
+ *	about the midpoint velocity, so scaling the part times to the section time 
+ *	(mr.gm.move_time) keeps the distance exactly the planned length. The scale is 
+ *	1 unless the planner folded a short body into the section.
+ *
+ *	Parts too short for a minimum segment are not run on their own. A short 
+ *	constant part leaves a plain two-half S (returns false) at a slightly higher 
+ *	peak acceleration. Short jerk parts are dropped and the section runs at constant 
+ *	acceleration for its whole time (mr.jerk_segments == 0). The constant part steps 
+ *	velocity at segment midpoints so it does not bias the distance.
+ */
+static uint8_t _init_accel_section(const float v0, const float v1)
+{
+	float jerk_dV = square(mr.accel) / (2 * mr.jerk);
+	float jerk_time = mr.accel / mr.jerk;
+
+	mr.accel_time = 0;
+	if ((mr.accel <= 0) || (fabsf(v1 - v0) <= (2 * jerk_dV))) { return (false);}	// never reaches Am
+	if (v1 < v0) { jerk_dV = -jerk_dV;}
+
+	float accel_time = fabsf(v1 - v0) / mr.accel - jerk_time;
+	float scale = mr.gm.move_time / (accel_time + 2*jerk_time);	// fit the planned section time
+	accel_time *= scale;
+	jerk_time *= scale;
+	if (uSec(accel_time) < MIN_SEGMENT_USEC) { return (false);}
+
+	if ((mr.jerk_segments = _get_accel_segments(jerk_time)) < 1) {	// jerk parts too short
+		mr.jerk_segments = 0;
+		mr.accel_time = accel_time + 2*jerk_time;
+		mr.accel_velocity = v1;
+		mr.segment_velocity = v0;
+		_init_accel_constant();
+		return (true);
+	}
+	mr.jerk_segment_time = jerk_time / mr.jerk_segments;
+	mr.accel_time = accel_time;
+	mr.accel_velocity = v1 - jerk_dV;
+	mr.segments = mr.jerk_segments;
+	mr.segment_move_time = mr.jerk_segment_time;
+	mr.segment_count = (uint32_t)mr.segments;
+	mr.microseconds = uSec(mr.segment_move_time);
+	_init_forward_diffs(v0, v0 + jerk_dV);
+	return (true);
+}
+
+static void _init_accel_constant()
+{
+	mr.segments = _get_accel_segments(mr.accel_time);
+	mr.segment_move_time = mr.accel_time / mr.segments;
+	mr.segment_count = (uint32_t)mr.segments;
+	mr.microseconds = uSec(mr.segment_move_time);
+	mr.forward_diff_1 = (mr.accel_velocity - mr.segment_velocity) / mr.segments;
+	mr.forward_diff_2 = 0;
+	mr.segment_velocity -= mr.forward_diff_1 / 2;		// first step lands on the segment midpoint
+}
+
+// T[1] == T[2] for the convex part, so A = T[0] - T[2] and B = -2A
+static void _init_accel_convex(const float t2)
+{
+	mr.segments = mr.jerk_segments;
+	mr.segment_move_time = mr.jerk_segment_time;
+	mr.segment_count = (uint32_t)mr.segments;
+	mr.microseconds = uSec(mr.segment_move_time);
+
+	float h = 1/mr.segments;
+	float A = mr.accel_velocity - t2;
+	mr.forward_diff_1 = A*h*h - 2*A*h;
+	mr.forward_diff_2 = 2*A*h*h;
+	mr.segment_velocity = mr.accel_velocity;
+}
+
+static float _get_accel_segments(const float time)
+{
+	return (min(ceilf(uSec(time) / _get_segment_usec(ACCEL_SEGMENT_FACTOR)), floorf(uSec(time) / MIN_SEGMENT_USEC)));
+}
+
+/*
+ * _get_segment_usec()	   - segment time for a section, scaled from the nominal time
+ * _get_section_segments() - segments for a section, none shorter than MIN_SEGMENT_USEC
+ *
+ *	Rounding the count up would leave segments just short of the target time, which
+ *	is MIN_SEGMENT_USEC itself for heads and tails. A section too short for even one
+ *	minimum segment still gets one, and the caller skips the block.
+ */
+static float _get_segment_usec(const float factor)
+{
+	return (min(MAX_SEGMENT_USEC, max(MIN_SEGMENT_USEC, cm.estd_segment_usec * factor)));
+}
+
+static float _get_section_segments(const float time, const float factor)
+{
+	return (max((float)1, min(ceilf(uSec(time) / _get_segment_usec(factor)), floorf(uSec(time) / MIN_SEGMENT_USEC))));
+}
+
 /*
  * _exec_aline_head()
  */
@@ -1100,18 +2535,27 @@ static stat_t _exec_aline_head()
 		}
 		mr.midpoint_velocity = (mr.entry_velocity + mr.cruise_velocity) / 2;
 		mr.gm.move_time = mr.head_length / mr.midpoint_velocity;	// time for entire accel region
-		mr.segments = ceil(uSec(mr.gm.move_time) / (2 * cm.estd_segment_usec)); // # of segments in *each half*
-		mr.segment_move_time = mr.gm.move_time / (2 * mr.segments);
-		mr.segment_count = (uint32_t)mr.segments;
-		if ((mr.microseconds = uSec(mr.segment_move_time)) < MIN_SEGMENT_USEC) {
-			return(STAT_GCODE_BLOCK_SKIPPED);				// exit without advancing position
+		if (_init_accel_section(mr.entry_velocity, mr.cruise_velocity) == true) {	// acceleration limited
+			mr.section_state = (mr.jerk_segments > 0) ? MOVE_STATE_RUN1 : MOVE_STATE_RUN3;
+		} else {
+			mr.segments = _get_section_segments(mr.gm.move_time / 2, ACCEL_SEGMENT_FACTOR); // # of segments in *each half*
+			mr.segment_move_time = mr.gm.move_time / (2 * mr.segments);
+			mr.segment_count = (uint32_t)mr.segments;
+			if ((mr.microseconds = uSec(mr.segment_move_time)) < MIN_SEGMENT_USEC) {
+				return(STAT_GCODE_BLOCK_SKIPPED);			// exit without advancing position
+			}
+			_init_forward_diffs(mr.entry_velocity, mr.midpoint_velocity);
+			mr.section_state = MOVE_STATE_RUN1;
 		}
-		_init_forward_diffs(mr.entry_velocity, mr.midpoint_velocity);
-		mr.section_state = MOVE_STATE_RUN1;
 	}
 	if (mr.section_state == MOVE_STATE_RUN1) {				// concave part of accel curve (period 1)
 		mr.segment_velocity += mr.forward_diff_1;
 		if (_exec_aline_segment(false) == STAT_OK) { 		// set up for second half
+			if (mr.accel_time > 0) {						// acceleration limited: constant part next
+				_init_accel_constant();
+				mr.section_state = MOVE_STATE_RUN3;
+				return(STAT_EAGAIN);
+			}
 			mr.segment_count = (uint32_t)mr.segments;
 			mr.section_state = MOVE_STATE_RUN2;
 
@@ -1123,6 +2567,20 @@ static stat_t _exec_aline_head()
 		}
 		return(STAT_EAGAIN);
 	}
+	if (mr.section_state == MOVE_STATE_RUN3) {				// constant acceleration part (acceleration limited)
+		mr.segment_velocity += mr.forward_diff_1;
+		if (_exec_aline_segment(false) == STAT_OK) {
+			if (mr.jerk_segments > 0) {
+				_init_accel_convex(mr.cruise_velocity);
+				mr.section_state = MOVE_STATE_RUN2;
+				return(STAT_EAGAIN);
+			}
+			if ((fp_ZERO(mr.body_length)) && (fp_ZERO(mr.tail_length))) return(STAT_OK); // ends the move
+			mr.move_state = MOVE_STATE_BODY;
+			mr.section_state = MOVE_STATE_NEW;
+		}
+		return(STAT_EAGAIN);
+	}
 	if (mr.section_state == MOVE_STATE_RUN2) {				// convex part of accel curve (period 2)
 		mr.segment_velocity += mr.forward_diff_1;
 		mr.forward_diff_1 += mr.forward_diff_2;
@@ -1139,7 +2597,8 @@ static stat_t _exec_aline_head()
  * _exec_aline_body()
  *
  *	The body is broken into little segments even though it is a straight line so that 
- *	feedholds can happen in the middle of a line with a minimum of latency
+ *	feedholds can happen in the middle of a line with a minimum of latency. Body 
+ *	segments are longer than head and tail segments as the velocity is constant.
  */
 static stat_t _exec_aline_body()
 {
@@ -1149,7 +2608,7 @@ static stat_t _exec_aline_body()
 			return(_exec_aline_tail());						// skip ahead to tail periods
 		}
 		mr.gm.move_time = mr.body_length / mr.cruise_velocity;
-		mr.segments = ceil(uSec(mr.gm.move_time) / cm.estd_segment_usec);
+		mr.segments = _get_section_segments(mr.gm.move_time, BODY_SEGMENT_FACTOR);
 		mr.segment_move_time = mr.gm.move_time / mr.segments;
 		mr.segment_velocity = mr.cruise_velocity;
 		mr.segment_count = (uint32_t)mr.segments;
@@ -1178,18 +2637,27 @@ static stat_t _exec_aline_tail()
 		if (fp_ZERO(mr.tail_length)) { return(STAT_OK);}		// end the move
 		mr.midpoint_velocity = (mr.cruise_velocity + mr.exit_velocity) / 2;
 		mr.gm.move_time = mr.tail_length / mr.midpoint_velocity;
-		mr.segments = ceil(uSec(mr.gm.move_time) / (2 * cm.estd_segment_usec));// # of segments in *each half*
-		mr.segment_move_time = mr.gm.move_time / (2 * mr.segments);// time to advance for each segment
-		mr.segment_count = (uint32_t)mr.segments;
-		if ((mr.microseconds = uSec(mr.segment_move_time)) < MIN_SEGMENT_USEC) {
-			return(STAT_GCODE_BLOCK_SKIPPED);					// exit without advancing position
+		if (_init_accel_section(mr.cruise_velocity, mr.exit_velocity) == true) {	// acceleration limited
+			mr.section_state = (mr.jerk_segments > 0) ? MOVE_STATE_RUN1 : MOVE_STATE_RUN3;
+		} else {
+			mr.segments = _get_section_segments(mr.gm.move_time / 2, ACCEL_SEGMENT_FACTOR);// # of segments in *each half*
+			mr.segment_move_time = mr.gm.move_time / (2 * mr.segments);// time to advance for each segment
+			mr.segment_count = (uint32_t)mr.segments;
+			if ((mr.microseconds = uSec(mr.segment_move_time)) < MIN_SEGMENT_USEC) {
+				return(STAT_GCODE_BLOCK_SKIPPED);				// exit without advancing position
+			}
+			_init_forward_diffs(mr.cruise_velocity, mr.midpoint_velocity);
+			mr.section_state = MOVE_STATE_RUN1;
 		}
-		_init_forward_diffs(mr.cruise_velocity, mr.midpoint_velocity);
-		mr.section_state = MOVE_STATE_RUN1;
 	}
 	if (mr.section_state == MOVE_STATE_RUN1) {				// convex part (period 4)
 		mr.segment_velocity += mr.forward_diff_1;
 		if (_exec_aline_segment(false) == STAT_OK) {		// set up for second half
+			if (mr.accel_time > 0) {						// acceleration limited: constant part next
+				_init_accel_constant();
+				mr.section_state = MOVE_STATE_RUN3;
+				return(STAT_EAGAIN);
+			}
 			mr.segment_count = (uint32_t)mr.segments;
 			mr.section_state = MOVE_STATE_RUN2;
 
@@ -1201,6 +2669,15 @@ static stat_t _exec_aline_tail()
 		}
 		return(STAT_EAGAIN);
 	}
+	if (mr.section_state == MOVE_STATE_RUN3) {				// constant deceleration part (acceleration limited)
+		mr.segment_velocity += mr.forward_diff_1;
+		if (mr.jerk_segments < 1) { return (_exec_aline_segment(true));}	// ends the move or continues EAGAIN
+		if (_exec_aline_segment(false) == STAT_OK) {
+			_init_accel_convex(mr.exit_velocity);
+			mr.section_state = MOVE_STATE_RUN2;
+		}
+		return(STAT_EAGAIN);
+	}
 	if (mr.section_state == MOVE_STATE_RUN2) {				// concave part (period 5)
 		mr.segment_velocity += mr.forward_diff_1;
 		mr.forward_diff_1 += mr.forward_diff_2;
@@ -1214,39 +2691,34 @@ static stat_t _exec_aline_tail()
  */
 static stat_t _exec_aline_segment(uint8_t correction_flag)
 {
-	float travel[AXES];
 	float steps[MOTORS];
-
+	float intermediate = mr.segment_velocity * mr.segment_move_time;
 
 	// Multiply computed length by the unit vector to get the contribution for each axis. 
 	// Set the target in absolute coords and compute relative steps.
 	// Don't do the endpoint correction if you are going into a hold
-	if ((correction_flag == true) && (mr.segment_count == 1) && 
+	if ((correction_flag == true) && (mr.segment_count == 1) && (mr.correction_inhibit == false) &&
 		(cm.motion_state == MOTION_RUN) && (cm.cycle_state == CYCLE_MACHINING)) {
 		mr.gm.target[AXIS_X] = mr.endpoint[AXIS_X]; // correct any accumulated rounding errors in last segment
 		mr.gm.target[AXIS_Y] = mr.endpoint[AXIS_Y];
 		mr.gm.target[AXIS_Z] = mr.endpoint[AXIS_Z];
-		mr.gm.target[AXIS_A] = mr.endpoint[AXIS_A];
-		mr.gm.target[AXIS_B] = mr.endpoint[AXIS_B];
-		mr.gm.target[AXIS_C] = mr.endpoint[AXIS_C];
+		if (AXIS_USED(AXIS_A)) { mr.gm.target[AXIS_A] = mr.endpoint[AXIS_A];}	// unused axes never move
+		if (AXIS_USED(AXIS_B)) { mr.gm.target[AXIS_B] = mr.endpoint[AXIS_B];}	// (see AXES_USED)
+		if (AXIS_USED(AXIS_C)) { mr.gm.target[AXIS_C] = mr.endpoint[AXIS_C];}
 
+#ifdef __PLANNER_ARC_MOVES
+	} else if (mr.move_type == MOVE_TYPE_ARC) {
+		_set_arc_target(mr.path_distance + intermediate);
+#endif
 	} else {
-		float intermediate = mr.segment_velocity * mr.segment_move_time;
 		mr.gm.target[AXIS_X] = mr.position[AXIS_X] + (mr.unit[AXIS_X] * intermediate);
 		mr.gm.target[AXIS_Y] = mr.position[AXIS_Y] + (mr.unit[AXIS_Y] * intermediate);
 		mr.gm.target[AXIS_Z] = mr.position[AXIS_Z] + (mr.unit[AXIS_Z] * intermediate);
-		mr.gm.target[AXIS_A] = mr.position[AXIS_A] + (mr.unit[AXIS_A] * intermediate);
-		mr.gm.target[AXIS_B] = mr.position[AXIS_B] + (mr.unit[AXIS_B] * intermediate);
-		mr.gm.target[AXIS_C] = mr.position[AXIS_C] + (mr.unit[AXIS_C] * intermediate);
+		if (AXIS_USED(AXIS_A)) { mr.gm.target[AXIS_A] = mr.position[AXIS_A] + (mr.unit[AXIS_A] * intermediate);}
+		if (AXIS_USED(AXIS_B)) { mr.gm.target[AXIS_B] = mr.position[AXIS_B] + (mr.unit[AXIS_B] * intermediate);}
+		if (AXIS_USED(AXIS_C)) { mr.gm.target[AXIS_C] = mr.position[AXIS_C] + (mr.unit[AXIS_C] * intermediate);}
 	}
 
-	travel[AXIS_X] = mr.gm.target[AXIS_X] - mr.position[AXIS_X];
-	travel[AXIS_Y] = mr.gm.target[AXIS_Y] - mr.position[AXIS_Y];
-	travel[AXIS_Z] = mr.gm.target[AXIS_Z] - mr.position[AXIS_Z];
-	travel[AXIS_A] = mr.gm.target[AXIS_A] - mr.position[AXIS_A];
-	travel[AXIS_B] = mr.gm.target[AXIS_B] - mr.position[AXIS_B];
-	travel[AXIS_C] = mr.gm.target[AXIS_C] - mr.position[AXIS_C];
-
 /* The above is a re-arranged and loop unrolled version of this:
 	for (uint8_t i=0; i < AXES; i++) {	// don't do the error correction if you are going into a hold
 		if ((correction_flag == true) && (mr.segment_count == 1) && 
@@ -1255,13 +2727,57 @@ static stat_t _exec_aline_segment(uint8_t correction_flag)
 		} else {
 			mr.gm.target[i] = mr.position[i] + (mr.unit[i] * mr.segment_velocity * mr.segment_move_time);
 		}
-		travel[i] = mr.gm.target[i] - mr.position[i];
 	}
 */
 	// prep the segment for the steppers and adjust the variables for the next iteration
-	ik_kinematics(travel, steps, mr.microseconds);
+#ifdef __INPUT_SHAPING
+	float shaped_start[AXES];						// the motors follow the shaped position (see shaper.h)
+	const float *shaped_end = sh_shape(mr.position, mr.gm.target, mr.microseconds, shaped_start);
+	_segment_kinematics(shaped_start, shaped_end, steps);
+#else
+	_segment_kinematics(mr.position, mr.gm.target, steps);
+#endif
+#ifdef __DDA_RAMPING
+	// ramp from the midpoint with the previous segment to the extrapolated midpoint with the next
+	float velocity_step = (mr.segment_velocity - mr.prev_segment_velocity) / 2;
+	float start_velocity = mr.prev_segment_velocity + velocity_step;
+	float end_velocity = max((float)0, mr.segment_velocity + velocity_step);
+	mr.prev_segment_velocity = mr.segment_velocity;
+	if (st_prep_line_ramped(steps, mr.microseconds, start_velocity, end_velocity) == STAT_OK) {
+#else
 	if (st_prep_line(steps, mr.microseconds) == STAT_OK) {
+#endif
+		TRACE_SEGMENT();								// see trace.h
+#ifdef __INPUT_SHAPING
+		PSO_PREP(shaped_start, shaped_end);				// events the motors cross (see pso.h)
+#else
+		PSO_PREP(mr.position, mr.gm.target);
+#endif
+		if (mr.raster_pending != RASTER_OFF) {			// first segment of a raster move
+			st_prep_raster(mr.raster_pending);
+			mr.raster_pending = RASTER_OFF;
+		}
+		if ((pwm.c[PWM_1].laser_mode == true) && (mr.gm.raster == RASTER_OFF)) {	// power follows the velocity
+			st_prep_spindle_duty(cm_get_laser_pwm(mr.segment_velocity, mr.cruise_vmax, mr.gm.motion_mode));
+		}
+#ifdef __SPINDLE_CSS
+		else if (CSS_ACTIVE()) {						// G96 - the RPM follows the radius
+			st_prep_spindle_duty(cm_get_css_pwm(mr.gm.target[AXIS_X] - cm_get_work_offset(&mr.gm, AXIS_X)));
+		}
+#endif
+		mr.job_usec += (uint32_t)mr.microseconds;		// time actually run - see mp_get_job_elapsed_time()
+		mr.move_usec += (uint32_t)mr.microseconds;
+		mpj.section_usec[mr.move_state - MOVE_STATE_HEAD] += (uint32_t)mr.microseconds;
+#ifdef __PLANNER_ARC_MOVES
+		if (mr.move_type == MOVE_TYPE_ARC) { mpj.arc_segments++;}
+#endif
 		copy_axis_vector(mr.position, mr.gm.target); 	// update runtime position	
+#ifdef __PRESSURE_ADVANCE
+		mr.pa_offset = mr.pa_next;
+#endif
+#ifdef __PLANNER_ARC_MOVES
+		mr.path_distance += intermediate;
+#endif
 /* TRY THIS
 		mr.position[AXIS_X] = mr.gm.target[AXIS_X];
 		mr.position[AXIS_Y] = mr.gm.target[AXIS_Y];
@@ -1275,6 +2791,123 @@ static stat_t _exec_aline_segment(uint8_t correction_flag)
 	return (STAT_EAGAIN);								// this section still has more segments to run
 }
 
+/*
+ * _segment_kinematics() - run the kinematics for a segment, with pressure advance if it is in
+ *
+ *	Pressure advance runs the extruder ($pea) ahead of its planned position by $pek
+ *	times its velocity, so the nozzle pressure builds during acceleration and falls
+ *	during deceleration instead of lagging them. Each segment adds k times the change
+ *	in extruder velocity since the last one. The forward differences make velocity
+ *	smooth, so the added steps are smooth too. Only moves that extrude while X, Y
+ *	or Z moves are advanced, and the advance goes back to 0 on the first segment of
+ *	any other move. Planned and reported positions are unchanged - only the motors
+ *	are offset.
+ */
+static void _segment_kinematics(const float start[], const float end[], float steps[])
+{
+#ifdef __PRESSURE_ADVANCE
+	mr.pa_next = mr.pa_gain * mr.segment_velocity;
+	if ((mr.pa_next != 0) || (mr.pa_offset != 0)) {
+		float pa_start[AXES];
+		float pa_end[AXES];
+		copy_axis_vector(pa_start, start);
+		copy_axis_vector(pa_end, end);
+		pa_start[cm.pa_axis] += mr.pa_offset;
+		pa_end[cm.pa_axis] += mr.pa_next;
+		ik_kinematics(pa_start, pa_end, steps, mr.microseconds);
+		return;
+	}
+#endif
+	ik_kinematics(start, end, steps, mr.microseconds);
+}
+
+#ifdef __PLANNER_ARC_MOVES
+/*
+ * _set_arc_target() - set the segment target from a path distance along the running arc
+ *
+ *	Axes off the arc plane (the linear axis and A, B, C) move in proportion to the 
+ *	path distance; the plane axes are placed on the circle.
+ *
+ *	Rather than sin and cos of the new angle, the plane point is found by rotating
+ *	the current radius vector through the segment angle. Segment angles are small,
+ *	so sin(d) = d - d^3/6 and cos(d) = 1 - d^2/2 are accurate to well below a step. 
+ *	Every ARC_CORRECTION_SEGMENTS the point is computed exactly from its angle.
+ */
+static void _set_arc_target(const float path_distance)
+{
+	float fraction = path_distance / mr.arc.length;
+
+	for (uint8_t i=0; i<AXES; i++) {
+		mr.gm.target[i] = mr.arc.start[i] + fraction * (mr.endpoint[i] - mr.arc.start[i]);
+	}
+	if (mr.arc_correction_count == 0) {
+		float theta = mr.arc.theta + fraction * mr.arc.angular_travel;
+		mr.gm.target[mr.arc.axis_1] = mr.arc.center_1 + sinf(theta) * mr.arc.radius;
+		mr.gm.target[mr.arc.axis_2] = mr.arc.center_2 + cosf(theta) * mr.arc.radius;
+		mr.arc_correction_count = ARC_CORRECTION_SEGMENTS;
+	} else {
+		float d_theta = (path_distance - mr.path_distance) * mr.arc.angular_travel / mr.arc.length;
+		float d_theta_sq = square(d_theta);
+		float cos_d = 1 - d_theta_sq/2;
+		float sin_d = d_theta * (1 - d_theta_sq/6);
+		float r_1 = mr.position[mr.arc.axis_1] - mr.arc.center_1;
+		float r_2 = mr.position[mr.arc.axis_2] - mr.arc.center_2;
+		mr.gm.target[mr.arc.axis_1] = mr.arc.center_1 + r_1 * cos_d + r_2 * sin_d;
+		mr.gm.target[mr.arc.axis_2] = mr.arc.center_2 + r_2 * cos_d - r_1 * sin_d;
+	}
+	mr.arc_correction_count--;
+}
+#endif // __PLANNER_ARC_MOVES
+
+/*
+ * _benchmark_block() - time _calculate_trapezoid() and _get_junction_vmax() on a new block
+ *
+ *	The trapezoid is taken on a copy so the plan is not changed (see benchmark.h).
+ *	The results are read back through a volatile so the calls are not optimized out.
+ */
+#ifdef __PLANNER_BENCHMARK
+static mpBuf_t bm_block;
+static volatile float bm_sink;
+
+static void _benchmark_block(const mpBuf_t *bf)
+{
+	memcpy(&bm_block, bf, sizeof(mpBuf_t));
+	uint32_t start = bm_get_cycles();
+	_calculate_trapezoid(&bm_block);
+	bm_record(BM_TRAPEZOID, bm_get_cycles() - start);
+	bm_sink = bm_block.cruise_velocity;
+
+	start = bm_get_cycles();
+	bm_sink = _get_junction_vmax(mp_get_prev_buffer(bf), bf);
+	bm_record(BM_JUNCTION, bm_get_cycles() - start);
+}
+#endif // __PLANNER_BENCHMARK
+
+/*
+ * mp_bench_block() - time _calculate_trapezoid() and _get_junction_vmax() on the last queued block
+ *
+ *	As _benchmark_block(), for the self benchmark (see selfbench.h). Returns the cycles
+ *	of the trapezoid in cycles[0] and of the junction with the block before in cycles[1].
+ */
+#ifdef __SELF_BENCHMARK
+static mpBuf_t sb_block;
+static volatile float sb_sink;
+
+void mp_bench_block(uint32_t cycles[])
+{
+	mpBuf_t *bf = mp_get_prev_buffer(mb.q);
+	memcpy(&sb_block, bf, sizeof(mpBuf_t));
+	uint32_t start = sb_get_cycles();
+	_calculate_trapezoid(&sb_block);
+	cycles[0] = sb_get_cycles() - start;
+	sb_sink = sb_block.cruise_velocity;
+
+	start = sb_get_cycles();
+	sb_sink = _get_junction_vmax(mp_get_prev_buffer(bf), bf);
+	cycles[1] = sb_get_cycles() - start;
+}
+#endif // __SELF_BENCHMARK
+
 
 /****** UNIT TESTS ******/
 
@@ -1291,10 +2924,12 @@ static void _make_unit_vector(float unit[], float x, float y, float z, float a,
 //static void _set_jerk(const float jerk, mpBuf_t *bf);
 static void _test_get_target_length(void);
 static void _test_get_target_velocity(void);
+static void _test_ht_solver(void);
 
 void mp_unit_tests()
 {
 	_test_get_target_length();
+	_test_ht_solver();
 //	_test_get_target_velocity();
 //	_test_calculate_trapezoid();
 //	_test_get_junction_vmax();
@@ -1356,7 +2991,7 @@ static void _test_trapezoid(float length, float Ve, float Vt, float Vx, mpBuf_t
 	bf->cruise_vmax = Vt;
 	bf->jerk = JERK_TEST_VALUE;
 	bf->recip_jerk = 1/bf->jerk;
-	bf->cbrt_jerk = cbrt(bf->jerk);
+	bf->cbrt_jerk = cbrtf(bf->jerk);
 	_calculate_trapezoid(bf);
 }
 
@@ -1473,9 +3108,85 @@ static void _test_calculate_trapezoid()
 
 }
 
+/*
+ * _test_ht_solver() - benchmark _get_ht_cruise_velocity() against the iteration it replaced
+ *
+ *	Runs the asymmetric rate-limited HT cases of the Mudflap vectors through both
+ *	solvers and reports worst case cycles and largest velocity difference.
+ *	The cycle counter is started by ik_init().
+ */
+
+static float _get_ht_cruise_velocity_iterative(mpBuf_t *bf)
+{
+	float computed_velocity = bf->cruise_vmax;
+	uint8_t i=0;
+	do {
+		bf->cruise_velocity = computed_velocity;	// initialize from previous iteration 
+		bf->head_length = _get_target_length(bf->entry_velocity, bf->cruise_velocity, bf);
+		bf->tail_length = _get_target_length(bf->exit_velocity, bf->cruise_velocity, bf);
+		if (bf->head_length > bf->tail_length) {
+			bf->head_length = (bf->head_length / (bf->head_length + bf->tail_length)) * bf->length;
+			computed_velocity = _get_target_velocity(bf->entry_velocity, bf->head_length, bf);
+		} else {
+			bf->tail_length = (bf->tail_length / (bf->head_length + bf->tail_length)) * bf->length;
+			computed_velocity = _get_target_velocity(bf->exit_velocity, bf->tail_length, bf);
+		}
+		if (++i > TRAPEZOID_ITERATION_MAX) { break;}
+	} while ((fabsf(bf->cruise_velocity - computed_velocity) / computed_velocity) > TRAPEZOID_ITERATION_ERROR_PERCENT);
+	return (computed_velocity);
+}
+
+static void _test_ht_solver()
+{
+	static const float vectors[][4] = {		// L, Ve, Vt, Vx
+		{ 0.8443, 000.000, 805.855, 393.806 },	// line 55'
+		{ 0.7890, 393.806, 955.829, 390.294 },	// line 60'
+		{ 0.9002, 390.294, 833.884, 000.000 },	// line 65
+		{ 0.9002, 390.294, 833.884, 455.925 },	// line 65'
+		{ 0.9735, 455.925, 806.895, 000.000 },	// line 70
+		{ 0.9935, 462.101, 802.363, 000.000 },	// line 75
+		{ 1.0441, 477.729, 843.274, 000.000 },	// line 80
+		{ 1.0441, 802.363, 843.274, 388.515 },	// line 80'
+		{ 0.7658, 388.515, 803.990, 000.000 },	// line 85
+		{ 1.6264, 802.425, 826.209, 266.384 },	// line 100'
+		{ 0.4348, 266.384, 805.517, 000.000 },	// line 105
+		{ 0.7754, 391.765, 939.343, 000.000 },	// line 110
+		{ 0.9158, 683.099, 801.233, 245.375 },	// line 120'
+		{ 0.3843, 617.229, 807.080, 371.854 }	// line 125'
+	};
+	mpBuf_t *bf = mp_get_write_buffer();
+	uint32_t cycles, closed_max = 0, iterative_max = 0;
+	float closed, iterative, error_max = 0;
+
+	for (uint8_t i=0; i<(sizeof(vectors)/sizeof(vectors[0])); i++) {
+		bf->length = vectors[i][0];
+		bf->entry_velocity = vectors[i][1];
+		bf->cruise_vmax = vectors[i][2];
+		bf->exit_velocity = vectors[i][3];
+		bf->jerk = JERK_TEST_VALUE;
+		bf->recip_jerk = 1/bf->jerk;
+		bf->cbrt_jerk = cbrtf(bf->jerk);
+		if (bf->length >= (_get_target_length(bf->entry_velocity, bf->cruise_vmax, bf) +
+						   _get_target_length(bf->exit_velocity, bf->cruise_vmax, bf))) { continue;} // not rate limited
+
+		cycles = _get_cycles();
+		closed = _get_ht_cruise_velocity(bf);
+		cycles = _get_cycles() - cycles;
+		closed_max = max(closed_max, cycles);
+
+		cycles = _get_cycles();
+		iterative = _get_ht_cruise_velocity_iterative(bf);
+		cycles = _get_cycles() - cycles;
+		iterative_max = max(iterative_max, cycles);
+		error_max = max(error_max, (float)fabsf(closed - iterative));
+	}
+	fprintf(stderr, "HT solver: closed form %lu cycles, iterative %lu cycles worst case, max difference %0.3f\n",
+		(unsigned long)closed_max, (unsigned long)iterative_max, (double)error_max);
+}
+
 static void _make_unit_vector(float unit[], float x, float y, float z, float a, float b, float c)
 {
-	float length = sqrt(x*x + y*y + z*z + a*a + b*b + c*c);
+	float length = sqrtf(x*x + y*y + z*z + a*a + b*b + c*c);
 	unit[AXIS_X] = x/length;
 	unit[AXIS_Y] = y/length;
 	unit[AXIS_Z] = z/length;
@@ -0,0 +1,289 @@
+/*
+ * plan_spline.cpp - G5 and G5.1 spline feeds extension to canonical_machine.c
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "tinyg2.h"
+#include "util.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "planner.h"
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/**** Spline singleton structure ****/
+
+struct spSplineSingleton {		// persistent spline generator variables
+	uint8_t run_state;			// MOVE_STATE_RUN while segments are being queued
+	uint8_t tangent_valid;		// TRUE if the last G5 ended where the next one starts
+	float tangent_end[2];		// XY end of the last G5, for the reflected I,J
+	float tangent[2];			// XY of its second control point, as an offset from the end
+
+	float start[AXES];			// spline start and end - in machine coordinates
+	float end[AXES];
+	float c1[2];				// XY polynomial coefficients - B(t) = start + t(c1 + t(c2 + t c3))
+	float c2[2];
+	float c3[2];
+	int32_t segments;			// segments in the spline
+	int32_t segment;			// next segment to queue, from 1
+};
+static struct spSplineSingleton spline;
+
+static stat_t _test_spline_soft_limits(const float p1[], const float p2[]);
+static void _spline_move(void);
+static void _get_offset(const float i, const float j, float offset[]);
+
+#define _to_mm(a) ((gmx.modal.units_mode == INCHES) ? (a * MM_PER_INCH) : a)
+
+/*****************************************************************************
+ * cm_spline_feed()		- G5 cubic and G5.1 quadratic spline feeds
+ * cm_spline_callback()	- main loop callback that queues the segments of the spline
+ * cm_abort_spline()	- stop a spline without maintaining position
+ *
+ *	G5 X Y I J P Q is a cubic Bezier in the XY plane from the current position to
+ *	X,Y. I,J is the first control point as an offset from the start and P,Q is the
+ *	second as an offset from the end. I,J may be left off if the last G5 ended here,
+ *	and the curve then leaves in the direction the last one arrived (I,J = -P,-Q of
+ *	the last one). G5.1 X Y I J is a quadratic spline with one control point, I,J
+ *	from the start. Other axes move in proportion to the curve parameter, and only
+ *	G17 is supported, as in LinuxCNC.
+ *
+ *	The curve is queued as lines by the callback, the same way cm_arc_callback()
+ *	queues arc segments, so one block from the host becomes as many planner lines
+ *	as the curve needs. The segment count is the fewest that keep the chord of every
+ *	segment within $ct of the curve - from the largest second derivative (h^2/8 of
+ *	it for a parameter step h) - but segments are no shorter than the arc segment
+ *	length or MIN_ARC_SEGMENT_USEC. Points are evaluated from the polynomial, so they
+ *	do not drift and the last one is the endpoint. The extents of the curve are
+ *	tested against the soft limits once, before anything is queued.
+ */
+
+stat_t cm_spline_feed(float target[], float flags[],
+					  float i, float i_flag, float j, float j_flag,
+					  float p, float p_flag, float q, float q_flag, uint8_t motion_mode)
+{
+	gm.motion_mode = motion_mode;
+
+	if (gmx.modal.select_plane != CANON_PLANE_XY) { return (STAT_GCODE_INPUT_ERROR);}
+	if ((gm.inverse_feed_rate_mode == false) && (fp_ZERO(gm.feed_rate))) {
+		return (STAT_GCODE_FEEDRATE_ERROR);
+	}
+	if (fp_FALSE(flags[AXIS_X]) && fp_FALSE(flags[AXIS_Y]) && fp_FALSE(i_flag) && fp_FALSE(j_flag)) {
+		return (STAT_OK);							// e.g. an F word by itself
+	}
+#ifdef __COORD_TRANSFORM
+	if ((gmx.transform.active == true) && (fp_NOT_ZERO(gmx.transform.rotation)) &&
+		(gmx.transform.rotation_axis_1 != AXIS_Y)) {
+		return (STAT_GCODE_INPUT_ERROR);			// a G68 out of the XY plane would tilt the curve
+	}
+#endif
+	cm_set_model_target(target, flags);
+	copy_axis_vector(spline.start, gmx.position);
+	copy_axis_vector(spline.end, gm.target);
+
+	// control points, as offsets from the start (p1) and from the end (p2)
+	float p1[2], p2[2];
+	uint8_t reflect = (fp_FALSE(i_flag) && fp_FALSE(j_flag));
+	if (motion_mode == MOTION_MODE_CUBIC_SPLINE) {
+		if (fp_FALSE(p_flag) || fp_FALSE(q_flag)) { return (STAT_GCODE_INPUT_ERROR);}
+		if (reflect == true) {
+			if ((spline.tangent_valid == false) ||
+				(fp_NE(spline.tangent_end[0], spline.start[AXIS_X])) ||
+				(fp_NE(spline.tangent_end[1], spline.start[AXIS_Y]))) {
+				return (STAT_GCODE_INPUT_ERROR);
+			}
+			p1[0] = -spline.tangent[0];
+			p1[1] = -spline.tangent[1];
+		} else {
+			_get_offset(i, j, p1);
+		}
+		_get_offset(p, q, p2);
+	} else {										// G5.1 - raise to a cubic
+		if (reflect == true) { return (STAT_GCODE_INPUT_ERROR);}
+		float control[2];
+		_get_offset(i, j, control);
+		control[0] += spline.start[AXIS_X];
+		control[1] += spline.start[AXIS_Y];
+		p1[0] = (control[0] - spline.start[AXIS_X]) * 2/3;
+		p1[1] = (control[1] - spline.start[AXIS_Y]) * 2/3;
+		p2[0] = (control[0] - spline.end[AXIS_X]) * 2/3;
+		p2[1] = (control[1] - spline.end[AXIS_Y]) * 2/3;
+	}
+	spline.tangent_valid = (motion_mode == MOTION_MODE_CUBIC_SPLINE);
+	spline.tangent_end[0] = spline.end[AXIS_X];
+	spline.tangent_end[1] = spline.end[AXIS_Y];
+	spline.tangent[0] = p2[0];
+	spline.tangent[1] = p2[1];
+
+	// Bezier points P0..P3 to polynomial coefficients, and the curve's size
+	float polygon = 0;
+	float chord = 0;
+	float curvature = 0;
+	float d2_start = 0, d2_end = 0;
+	for (uint8_t k=0; k<2; k++) {
+		float b0 = spline.start[k];
+		float b1 = b0 + p1[k];
+		float b3 = spline.end[k];
+		float b2 = b3 + p2[k];
+		spline.c1[k] = 3 * (b1 - b0);
+		spline.c2[k] = 3 * (b0 - 2*b1 + b2);
+		spline.c3[k] = b3 - b0 + 3 * (b1 - b2);
+		d2_start += square(2 * spline.c2[k]);		// squared second derivative at t=0 and t=1
+		d2_end += square(2 * spline.c2[k] + 6 * spline.c3[k]);
+	}
+	polygon = hypotf(p1[0], p1[1]) + hypotf(p2[0], p2[1]) +
+			  hypotf(spline.end[AXIS_X] + p2[0] - spline.start[AXIS_X] - p1[0],
+					spline.end[AXIS_Y] + p2[1] - spline.start[AXIS_Y] - p1[1]);
+	chord = hypotf(spline.end[AXIS_X] - spline.start[AXIS_X], spline.end[AXIS_Y] - spline.start[AXIS_Y]);
+	curvature = sqrtf(max(d2_start, d2_end));		// the second derivative is linear, so the ends bound it
+
+	float linear = 0;								// travel of the other axes
+	for (uint8_t axis=AXIS_Z; axis<AXES; axis++) { linear += square(spline.end[axis] - spline.start[axis]);}
+	float length = hypotf((polygon + chord) / 2, sqrtf(linear));	// between the chord and the polygon
+	if (length < cm.arc_segment_len) {			// too short to curve - run it as a line
+		spline.segments = 1;
+	} else {
+		float time = (gm.inverse_feed_rate_mode == true) ? gmx.inverse_feed_rate : (length / gm.feed_rate);
+		float segments_required_for_chordal_accuracy = ceilf(sqrtf(curvature / (8 * cm.chordal_tolerance)));
+		float segments_required_for_minimum_distance = floorf(length / cm.arc_segment_len);
+		float segments_required_for_minimum_time = floorf(time * MICROSECONDS_PER_MINUTE / MIN_ARC_SEGMENT_USEC);
+		spline.segments = (int32_t)max(1, min3(segments_required_for_chordal_accuracy,
+											   segments_required_for_minimum_distance,
+											   segments_required_for_minimum_time));
+	}
+	ritorno(_test_spline_soft_limits(p1, p2));
+
+	if (gm.inverse_feed_rate_mode == true) {		// the block time is shared by the segments
+		gmx.inverse_feed_rate /= spline.segments;
+	}
+	spline.segment = 1;
+	spline.run_state = MOVE_STATE_RUN;
+	controller_request_task(TASK_SPLINE);
+	return (STAT_OK);
+}
+
+stat_t cm_spline_callback()
+{
+	if (spline.run_state == MOVE_STATE_OFF) { return (STAT_NOOP);}
+	if (mp_planner_has_room(1) == false) { return (STAT_EAGAIN);}	// one segment per pass
+
+	if (spline.segment >= spline.segments) {		// last segment to the exact endpoint
+		copy_axis_vector(gm.target, spline.end);
+		_spline_move();
+		spline.run_state = MOVE_STATE_OFF;
+		return (STAT_OK);
+	}
+	float t = (float)spline.segment / (float)spline.segments;
+	for (uint8_t axis=AXIS_Z; axis<AXES; axis++) {
+		gm.target[axis] = spline.start[axis] + t * (spline.end[axis] - spline.start[axis]);
+	}
+	for (uint8_t k=0; k<2; k++) {
+		gm.target[k] = spline.start[k] + t * (spline.c1[k] + t * (spline.c2[k] + t * spline.c3[k]));
+	}
+	_spline_move();
+	spline.segment++;
+	return (STAT_EAGAIN);
+}
+
+void cm_abort_spline()
+{
+	spline.run_state = MOVE_STATE_OFF;
+	spline.tangent_valid = false;
+}
+
+/*
+ * _test_spline_soft_limits() - test the box around the spline against the soft limits
+ *
+ *	The XY extents of the curve are at its ends or where the first derivative of an
+ *	axis is zero - the roots of a quadratic. The other axes are bounded by their ends.
+ *	The soft limits are a box, so testing its low and high corners tests everything.
+ */
+
+/*
+ * _get_offset() - a control point offset in mm, turned and scaled as the endpoints are (G68, G51)
+ */
+static void _get_offset(const float i, const float j, float offset[])
+{
+	float v[3] = { _to_mm(i), _to_mm(j), 0 };
+#ifdef __COORD_TRANSFORM
+	if ((gmx.transform.active == true) && (gm.absolute_override == false)) { cm_transform_vector(v);}
+#endif
+	offset[0] = v[0];
+	offset[1] = v[1];
+}
+
+static stat_t _test_spline_soft_limits(const float p1[], const float p2[])
+{
+	float low[AXES], high[AXES];
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		low[axis] = min(spline.start[axis], spline.end[axis]);
+		high[axis] = max(spline.start[axis], spline.end[axis]);
+	}
+	for (uint8_t k=0; k<2; k++) {
+		float a = p1[k];									// B'(t)/3 = (a - 2b + c)t^2 + 2(b - a)t + a
+		float b = (spline.end[k] + p2[k]) - (spline.start[k] + p1[k]);
+		float c = -p2[k];
+		float qa = a - 2*b + c;
+		float qb = 2 * (b - a);
+		float root[2] = { -1, -1 };
+		if (fabsf(qa) < EPSILON) {
+			if (fabsf(qb) > EPSILON) { root[0] = -a / qb;}
+		} else {
+			float discriminant = square(qb) - 4 * qa * a;
+			if (discriminant >= 0) {
+				root[0] = (-qb + sqrtf(discriminant)) / (2 * qa);
+				root[1] = (-qb - sqrtf(discriminant)) / (2 * qa);
+			}
+		}
+		for (uint8_t r=0; r<2; r++) {
+			float t = root[r];
+			if ((t <= 0) || (t >= 1)) { continue;}
+			float value = spline.start[k] + t * (spline.c1[k] + t * (spline.c2[k] + t * spline.c3[k]));
+			low[k] = min(low[k], value);
+			high[k] = max(high[k], value);
+		}
+	}
+	ritorno(cm_test_soft_limits(low));
+	return (cm_test_soft_limits(high));
+}
+
+/*
+ * _spline_move() - queue a segment to gm.target
+ *
+ *	The segment is queued as a G1 so the move times and the runtime see the
+ *	motion they expect, then the model is put back in the spline motion mode.
+ */
+
+static void _spline_move()
+{
+	uint8_t motion_mode = gm.motion_mode;
+	if (vector_equal(gm.target, gmx.position)) { return;}
+	gm.motion_mode = MOTION_MODE_STRAIGHT_FEED;
+	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
+	cm_set_move_times(&gm);						// set move time and minimum time in the state
+	cm_cycle_start();
+	cm_conditional_set_model_position(mp_aline(&gm));
+	gm.motion_mode = motion_mode;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,335 @@
+/*
+ * plan_thread.cpp - spindle synchronized motion - G33 threading and G84 rigid tapping
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "tinyg2.h"
+#include "util.h"
+#include "config.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "spindle.h"
+#include "encoder.h"
+#include "report.h"
+#include "pso.h"
+
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
+#ifdef __SPINDLE_SYNC
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define SYNC_CATCHUP_USEC	50000		// time constant the axes close a position error to the spindle in
+#define SYNC_LEAD_SEGMENTS	2			// a segment runs from one to two segment times after it is prepared
+
+/**** Spindle sync singleton structure ****/
+
+enum ssState {
+	SYNC_INDEX = 0,				// waiting for the spindle to come round to the start angle (G33)
+	SYNC_RUN,					// following the spindle in
+	SYNC_REVERSED				// spindle reversed at depth - following it out (G84)
+};
+
+struct ssSyncSingleton {		// runtime variables of the running sync move
+	uint8_t state;				// see ssState
+	uint8_t tapping;			// TRUE for a G84 tap - in and back out - else a G33 to its end
+	uint8_t spindle_mode;		// spindle direction the move started in
+	float start[AXES];			// start of the move - in machine coordinates
+	float unit[AXES];			// ...and its direction
+	float length;				// G33 length, or G84 depth
+	float mm_per_count;			// path distance per spindle encoder count
+	int32_t reference;			// spindle encoder count at the start of the path
+	float spindle;				// path distance the spindle gave at the last sample
+	float distance;				// path distance of the axes
+	float velocity;				// ...their path velocity
+	float accel;				// ...and acceleration
+	float jerk_max;				// path limits - from the axes that move
+	float accel_max;
+};
+static struct ssSyncSingleton ss;
+
+static stat_t _test_spindle_sync(const float target[], const float pitch);
+static stat_t _exec_spindle_sync(mpBuf_t *bf) HOT_PATH;
+static void _init_spindle_sync(const mpBuf_t *bf, const int32_t count) HOT_PATH;
+static float _get_sync_velocity(const float target, const float dt) HOT_PATH;
+static float _get_sync_stop_distance(void) HOT_PATH;
+
+#define _to_mm(a) ((gmx.modal.units_mode == INCHES) ? (a * MM_PER_INCH) : a)
+
+/*****************************************************************************
+ * cm_spindle_sync_feed()	- G33 spindle synchronized motion
+ * _test_spindle_sync()		- fail a G33 the axes can't follow the spindle on
+ * mp_spindle_sync()		- queue a G33 or G84 sync move
+ *
+ *	G33 X Y Z K moves from the current position to X,Y,Z advancing K (the thread
+ *	pitch) for every turn of the spindle. G84 taps a hole the same way, at a pitch
+ *	of F/S, and runs the tap back out (see cycle_drilling.cpp). The spindle is read
+ *	from a quadrature encoder ($sse, $ssc - see encoder.h) and must be turning; the
+ *	axes are driven from it rather than from a feed rate. K is needed on every G33.
+ *
+ *	A sync move is not planned. It is queued as a buffer of its own, like a dwell,
+ *	so the moves either side of it stop, and the exec runs NOM_SEGMENT_USEC segments
+ *	straight from the mr runtime position as the jog does. Each segment samples the
+ *	encoder and gives the path position the spindle has turned to - extrapolated
+ *	SYNC_LEAD_SEGMENTS ahead for the segment being prepared - and the axes track it
+ *	at the spindle velocity plus the position error over SYNC_CATCHUP_USEC, within
+ *	the jerk ($xjm) and acceleration ($xac) limits of the axes that move. So the
+ *	axes ramp up to the spindle, lock on to it and follow its speed changes.
+ *
+ *	G33 waits for the spindle to come round to a whole number of turns of the
+ *	encoder before it starts, so every pass of a thread starts at the same spindle
+ *	angle, and the axes stop at the end of the move within their limits - a thread
+ *	has that much run-out. There is no index input: the turns are counted from the
+ *	encoder's power-up count, which the decoder holds for as long as it has power.
+ *
+ *	A G84 tap starts at once. When the spindle reaches the depth the exec reverses
+ *	it, and the axes follow it in as it stops - the tap overshoots the depth by the
+ *	spindle's stopping distance - and back out, stopping at the R plane. The spindle
+ *	direction is then restored. No dwell is needed at the bottom, nor a floating tap
+ *	holder. The spindle must be running M3.
+ *
+ *	The Gcode model and planner positions are the end of a G33, or the start of a
+ *	G84. A feedhold is not taken during a sync move - it waits for the next move.
+ */
+
+stat_t cm_spindle_sync_feed(float target[], float flags[], float k, float k_flag)
+{
+	gm.motion_mode = MOTION_MODE_SPINDLE_SYNC;
+
+	cm_set_model_target(target, flags);
+	if (vector_equal(gm.target, gmx.position)) { return (STAT_OK);}
+	if ((fp_FALSE(k_flag)) || (k < EPSILON)) { return (STAT_GCODE_INPUT_ERROR);}
+	float pitch = _to_mm(k);
+	ritorno(_test_spindle_sync(gm.target, pitch));
+	ritorno(cm_test_soft_limits(gm.target));
+
+	cm_set_work_offsets(&gm);					// capture the fully resolved offsets to the state
+	cm_cycle_start();
+	stat_t status = mp_spindle_sync(&gm, pitch);
+	cm_conditional_set_model_position(status);
+	return (status);
+}
+
+static stat_t _test_spindle_sync(const float target[], const float pitch)
+{
+	if ((en.spindle_encoder == 0) || (gm.spindle_mode == SPINDLE_OFF) || (fp_ZERO(gm.spindle_speed))) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	float length = get_axis_vector_length(target, gmx.position);
+	float velocity = pitch * gm.spindle_speed;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		float share = fabsf(target[axis] - gmx.position[axis]) / length;
+		if ((share * velocity) > cm.a[axis].velocity_max) { return (STAT_MAX_SPINDLE_SPEED_EXCEEDED);}
+	}
+	return (STAT_OK);
+}
+
+stat_t mp_spindle_sync(GCodeState_t *gm_in, const float pitch)
+{
+	mpBuf_t *bf;
+
+	mp_end_coalesce();							// after any held G1 run
+	if ((bf = mp_get_write_buffer()) == NULL) { return (cm_alarm(STAT_BUFFER_FULL_FATAL));} // never supposed to fail
+
+	memcpy(bf->gm, gm_in, sizeof(GCodeState_t));	// copy model state into planner
+	bf->bf_func = _exec_spindle_sync;
+	bf->gm->parameter = pitch;					// mm per turn
+	bf->move_state = MOVE_STATE_NEW;
+	if (gm_in->motion_mode != MOTION_MODE_CANNED_CYCLE_84) {	// a tap ends where it started
+		copy_axis_vector(mm.position, gm_in->target);
+	}
+	mp_queue_write_buffer(MOVE_TYPE_SPINDLE_SYNC);
+	return (STAT_OK);
+}
+
+/*
+ * _exec_spindle_sync() - run a segment of a sync move - called from the exec
+ */
+
+static stat_t _exec_spindle_sync(mpBuf_t *bf)
+{
+	float microseconds = NOM_SEGMENT_USEC;
+	float dt = microseconds / MICROSECONDS_PER_MINUTE;
+	int32_t count = en_get_spindle_count();
+
+	if (bf->move_state == MOVE_STATE_NEW) {
+		mp_run_attached(bf);
+		memcpy(&mr.gm, bf->gm, sizeof(GCodeState_t));// copy in the gcode model state
+		SR_MODAL_CHANGED();						// new line number and modes to report
+		if (cm.motion_state == MOTION_STOP) { cm_set_motion_state(MOTION_RUN);}
+		if (mr.job_ended == true) {				// see mp_get_job_elapsed_time()
+			mr.job_usec = 0;
+			mr.job_ended = false;
+			mp_reset_job_stats();
+		}
+		_init_spindle_sync(bf, count);
+		bf->move_state = MOVE_STATE_RUN;
+	}
+	mr.job_usec += (uint32_t)microseconds;
+
+	float spindle = (float)(count - ss.reference) * ss.mm_per_count;
+	float spindle_velocity = (spindle - ss.spindle) / dt;
+	ss.spindle = spindle;
+	if (ss.state == SYNC_INDEX) {
+		if (spindle < 0) {						// not round to the start angle yet
+			st_prep_dwell(microseconds);
+			return (STAT_OK);
+		}
+		ss.state = SYNC_RUN;
+	}
+	if ((ss.tapping == true) && (ss.state == SYNC_RUN) && (spindle >= ss.length)) {
+		cm_exec_spindle_control((ss.spindle_mode == SPINDLE_CW) ? SPINDLE_CCW : SPINDLE_CW);
+		ss.state = SYNC_REVERSED;
+	}
+
+	// track the spindle, and stop at the end of the path - the stop starts a segment early
+	float lead = spindle + spindle_velocity * dt * SYNC_LEAD_SEGMENTS;
+	float velocity = spindle_velocity + (lead - ss.distance) * (MICROSECONDS_PER_MINUTE / SYNC_CATCHUP_USEC);
+	float reach = _get_sync_stop_distance() + fabsf(ss.velocity) * dt;
+	uint8_t ending = false;
+	if (ss.tapping == false) {
+		velocity = max(velocity, (float)0);		// a thread is not cut backwards
+		if ((ss.distance + reach) >= ss.length) {
+			velocity = 0;
+			ending = true;
+		}
+	} else if ((ss.state == SYNC_REVERSED) && (ss.velocity < 0) && ((ss.distance - reach) <= 0)) {
+		velocity = 0;
+		ending = true;
+	}
+	float start_velocity = ss.velocity;
+	float end_velocity = _get_sync_velocity(velocity, dt);
+	ss.distance += (start_velocity + end_velocity) / 2 * dt;
+
+	float target[AXES];
+	uint8_t done = (ending == true) && (fp_ZERO(end_velocity));
+	if (done == true) {							// land exactly on the end
+		copy_axis_vector(target, (ss.tapping == true) ? ss.start : bf->gm->target);
+	} else {
+		if (ss.tapping == false) { ss.distance = min(ss.distance, ss.length);}
+		for (uint8_t axis=0; axis<AXES; axis++) {
+			target[axis] = ss.start[axis] + ss.unit[axis] * ss.distance;
+		}
+	}
+	float steps[MOTORS];
+	ik_kinematics(mr.position, target, steps, microseconds);
+	ritorno(st_prep_line(steps, microseconds));
+	PSO_PREP(mr.position, target);
+	copy_axis_vector(mr.position, target);
+	mr.segment_velocity = fabsf(end_velocity);
+
+	if (done == true) {
+		if (ss.tapping == true) { cm_exec_spindle_control(ss.spindle_mode);}
+		mr.segment_velocity = 0;
+		mp_free_run_buffer();
+	}
+	return (STAT_OK);
+}
+
+/*
+ * _init_spindle_sync() - set up the runtime for a new sync move
+ *
+ *	For G33 the reference is the next whole turn of the encoder in the direction
+ *	the spindle is running, so the path starts from the same spindle angle on
+ *	every pass.
+ */
+
+static void _init_spindle_sync(const mpBuf_t *bf, const int32_t count)
+{
+	copy_axis_vector(ss.start, mr.position);
+	ss.length = get_axis_vector_length(bf->gm->target, ss.start);
+	ss.jerk_max = 0;
+	ss.accel_max = 0;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		ss.unit[axis] = (bf->gm->target[axis] - ss.start[axis]) / ss.length;
+		float share = fabsf(ss.unit[axis]);
+		if (share < EPSILON) { continue;}
+		float jerk = cm.a[axis].jerk_max * JERK_MULTIPLIER / share;
+		if ((ss.jerk_max == 0) || (jerk < ss.jerk_max)) { ss.jerk_max = jerk;}
+		if (cm.a[axis].accel_max > 0) {
+			float accel = cm.a[axis].accel_max / share;
+			if ((ss.accel_max == 0) || (accel < ss.accel_max)) { ss.accel_max = accel;}
+		}
+	}
+	ss.tapping = (bf->gm->motion_mode == MOTION_MODE_CANNED_CYCLE_84);
+	ss.spindle_mode = bf->gm->spindle_mode;
+	float counts = (ss.spindle_mode == SPINDLE_CCW) ? -en.spindle_counts : en.spindle_counts;
+	ss.mm_per_count = bf->gm->parameter / counts;
+
+	if (ss.tapping == true) {
+		ss.reference = count;
+		ss.state = SYNC_RUN;
+	} else {
+		int32_t turn = (int32_t)fabsf(counts);
+		int32_t sign = (counts < 0) ? -1 : 1;
+		int32_t forward = count * sign;
+		int32_t angle = forward % turn;
+		if (angle < 0) { angle += turn;}
+		ss.reference = (forward - angle + turn) * sign;
+		ss.state = SYNC_INDEX;
+	}
+	ss.spindle = (float)(count - ss.reference) * ss.mm_per_count;
+	ss.distance = 0;
+	ss.velocity = 0;
+	ss.accel = 0;
+}
+
+/*
+ * _get_sync_velocity()		 - move the path velocity toward its target for one segment
+ * _get_sync_stop_distance() - distance a jerk limited stop from the path velocity takes
+ *
+ *	The same as the jog's per axis versions (see plan_jog.cpp), along the path.
+ */
+
+static float _get_sync_velocity(const float target, const float dt)
+{
+	float dv = target - ss.velocity;
+
+	if (fp_ZERO(dv) && fp_ZERO(ss.accel)) { return (ss.velocity);}
+	float accel_wanted = copysignf(sqrtf(2 * ss.jerk_max * fabsf(dv)), dv);
+	if (ss.accel_max > 0) { accel_wanted = max(min(accel_wanted, ss.accel_max), -ss.accel_max);}
+	float accel_step = ss.jerk_max * dt;
+	float end_accel = ss.accel + max(min(accel_wanted - ss.accel, accel_step), -accel_step);
+	float end_velocity = ss.velocity + (ss.accel + end_accel) / 2 * dt;
+
+	if ((dv > 0) ? (end_velocity >= target) : (end_velocity <= target)) {
+		end_velocity = target;
+		end_accel = 0;
+	}
+	ss.velocity = end_velocity;
+	ss.accel = end_accel;
+	return (end_velocity);
+}
+
+static float _get_sync_stop_distance()
+{
+	float velocity = fabsf(ss.velocity);
+
+	if ((ss.accel_max <= 0) || (velocity <= square(ss.accel_max) / ss.jerk_max)) {
+		return (velocity * sqrtf(velocity / ss.jerk_max));
+	}
+	return (velocity / 2 * (velocity / ss.accel_max + ss.accel_max / ss.jerk_max));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SPINDLE_SYNC
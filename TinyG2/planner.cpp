@@ -53,14 +53,26 @@
  */
 #include "tinyg2.h"
 #include "config.h"
+#include "controller.h"
 #include "canonical_machine.h"
 #include "plan_arc.h"
 #include "plan_line.h"
 #include "planner.h"
 #include "stepper.h"
 #include "report.h"
+#include "raster.h"
+#include "pso.h"
+#include "memguard.h"
+#include "sync.h"
+#include "shaper.h"
+#include "stepq.h"
+#include "stress.h"
+#include "replay.h"
+#include "settings.h"				// AXES_USED
 #include "util.h"
 
+#pragma GCC diagnostic warning "-Wdouble-promotion"	// float math only - see util.h
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -69,22 +81,28 @@ extern "C"{
 
 mpBufferPool_t mb;				// move buffer queue
 mpMoveMasterSingleton_t mm;		// context for line planning
+mpPlannerStats_t mps;			// planner starvation and underrun counters
+mpJobStats_t mpj;				// per-job motion efficiency counters
 mpMoveRuntimeSingleton_t mr;	// context for line runtime
 
 /*
  * Local Scope Data and Functions
  */
-#define _bump(a) ((a<PLANNER_BUFFER_POOL_SIZE-1)?(a+1):0) // buffer incr & wrap
+
+// compile-time check that the pool is big enough to plan and that mpBufCount_t can count it
+typedef char mp_buffer_pool_size_check[((PLANNER_BUFFER_POOL_SIZE >= (2 * PLANNER_BUFFER_HEADROOM)) &&
+										(PLANNER_BUFFER_POOL_SIZE <= MP_BUFFER_COUNT_MAX)) ? 1 : -1];
+typedef char mp_attached_commands_check[((MP_ATTACHED_COMMANDS & (MP_ATTACHED_COMMANDS-1)) == 0) ? 1 : -1];
 #define spindle_speed move_time	// local alias for spindle_speed to the time variable
-#define value_vector gm.target	// alias for vector of values
-#define flag_vector unit		// alias for vector of flags
+#define value_vector gm->target	// alias for vector of values
+#define flag_bits move_code		// alias for the flags, packed one bit per axis
 
 // execution routines (NB: These are all called from the LO interrupt)
 static stat_t _exec_dwell(mpBuf_t *bf);
 static stat_t _exec_command(mpBuf_t *bf);
 
 #ifdef __DEBUG
-static uint8_t _get_buffer_index(mpBuf_t *bf); 
+static mpBufCount_t _get_buffer_index(mpBuf_t *bf); 
 static void _dump_plan_buffer(mpBuf_t *bf);
 #endif
 
@@ -94,14 +112,94 @@ static void _dump_plan_buffer(mpBuf_t *bf);
 void planner_init()
 {
 // If you can can assume all memory has been zeroed by a hard reset you don;t need these next 2 lines
-	memset(&mr, 0, sizeof(mr));	// clear all values, pointers and status
+	memset(&mr, 0, MG_SIZEOF(mr));	// clear all values, pointers and status
 	memset(&mm, 0, sizeof(mm));	// clear all values, pointers and status
+	mm.feed_override = 1;
+	mm.adaptive_factor = 1;
 
 	mr.magic_start = MAGICNUM;
 	mr.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_RUNTIME, mr);
 	arc.magic_start = MAGICNUM;
 	arc.magic_end = MAGICNUM;
 	mp_init_buffers();
+	mp_reset_stats();
+}
+
+/*
+ * mp_reset_stats() 	 - clear the starvation and underrun counters
+ * mp_run_reset_stats() - clear the counters from the cfgArray ({"psr":1})
+ *
+ *	The counters tell host streaming problems from firmware ones:
+ *	  - starved_exits counts blocks that started executing planned to a stop only 
+ *		because nothing was queued behind them - the host didn't keep up
+ *	  - dda_gaps counts times the steppers ran out of prepared segments while the
+ *		planner still had moves - the exec didn't keep up. Running out in a feedhold
+ *		or after a block that was planned to stop is not a gap
+ *	  - buffers_min is the fewest planner buffers that were ever free
+ *	  - exec_near_misses and exec_margin_min show how close the exec came to a 
+ *		DDA gap - see the prep segment ring in stepper.h. exec_margin_min starts
+ *		at the most the ring can hold
+ *
+ *	They are not cleared by a queue flush.
+ */
+void mp_reset_stats()
+{
+	mps.starved_exits = 0;
+	mps.dda_gaps = 0;
+	mps.buffers_min = mp_get_planner_buffers_available();
+	mps.exec_near_misses = 0;
+	mps.exec_margin_min = (uint32_t)(MAX_SEGMENT_USEC * ST_PREP_SEGMENTS);
+}
+
+stat_t mp_run_reset_stats(cmdObj_t *cmd)
+{
+	mp_reset_stats();
+	return (STAT_OK);
+}
+
+/*
+ * mp_reset_job_stats() - clear the job counters (called by the exec as a job starts)
+ * mp_get_job_seconds() - return one of the job times in seconds
+ *
+ *	The job counters show where the cycle time of a job goes - {"js":""}, and
+ *	reported by itself at M2 and M30 (see rpt_job_report_callback()):
+ *	  - time run in head, body and tail sections. A job mostly in heads and tails
+ *		is bound by jerk
+ *	  - time at zero velocity between blocks, from the exec finishing a block that
+ *		stops to it starting the next. It includes dwells, tool changes and waits on
+ *		the spindle, on a hold and on the host, and runs long by the segments that
+ *		were prepped ahead at the stop
+ *	  - blocks that cruised below their cruise_vmax (limited by their length and
+ *		the lookahead) and blocks that cruised at it (limited by the feed rate or
+ *		the axis velocities). Many of the first with short blocks and few stops
+ *		means the job is bound by lookahead depth, many stops that it is streaming
+ *	  - the chords run along arcs - the lines an arc is cut into, or with runtime
+ *		arcs the segments it is run in
+ *	  - the smallest exec slack, the longest exec and the late segments - see the
+ *		prep segment ring in stepper.h. exec_slack_min starts at the most the ring
+ *		can hold
+ *
+ *	A job starts with the first move or dwell after a program end, like the job
+ *	elapsed time, so the counters can still be read after M2 and M30.
+ */
+void mp_reset_job_stats()
+{
+	memset(&mpj, 0, sizeof(mpj));
+	mpj.exec_slack_min = (uint32_t)(MAX_SEGMENT_USEC * ST_PREP_SEGMENTS);
+}
+
+stat_t mp_get_job_seconds(cmdObj_t *cmd)
+{
+	volatile uint64_t *target = (volatile uint64_t *)GET_TABLE_WORD(target);
+	uint64_t usec;
+	do {										// 64 bits - re-read if the exec changed it mid-read
+		usec = *target;
+	} while (usec != *target);
+	cmd->value = (float)usec / 1000000;
+	cmd->precision = GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
 }
 
 /*
@@ -126,7 +224,33 @@ stat_t mp_assertions()
 void mp_flush_planner()
 {
 	cm_abort_arc();
-	mp_init_buffers();
+	cm_abort_canned_cycle();
+	cm_abort_spline();
+	mp_abort_jog();
+	mm.coalesce_pending = false;				// discard any held G1 run
+	mm.it_velocity = 0;							// a G93 run starts over
+	mm.override_state = OVERRIDE_OFF;			// nothing left to replan
+	mm.hold_replan = false;
+	mm.attached_pending = 0;					// discard any commands waiting for a move
+#ifdef __RASTER
+	rs_reset();									// discard any rows waiting for the DDA
+#endif
+#ifdef __PSO
+	ps_reset();									// discard any events waiting for the DDA
+#endif
+#ifdef __STEP_QUEUE
+	sq_reset();									// drop the step queues and end the run
+#endif
+#ifdef __STRESS_TEST
+	sx_reset();									// end the stress test without a result
+#endif
+#ifdef __SEGMENT_REPLAY
+	rp_reset();									// end a replay where it stopped, give up a recording
+#endif
+#ifdef __SEGMENT_SYNC
+	sy_reset();									// the boards are aligned at a stop
+#endif
+	mp_reset_buffers();
 	cm_set_motion_state(MOTION_STOP);
 }
 
@@ -149,12 +273,16 @@ void mp_flush_planner()
 
 void mp_set_planner_position(uint8_t axis, const float position)
 {
+	mp_end_coalesce();							// a held G1 run starts from the old position
 	mm.position[axis] = position;
 }
 
 void mp_set_runtime_position(uint8_t axis, const float position)
 {
 	mr.position[axis] = position;
+#ifdef __AUX_MOTION
+	mp_set_aux_position(axis, position);		// an asynchronous axis reports the aux position
+#endif
 }
 
 /*************************************************************************
@@ -162,17 +290,38 @@ void mp_set_runtime_position(uint8_t axis, const float position)
  *
  *	Dequeues the buffer queue and executes the move continuations.
  *	Manages run buffers and other details
+ *
+ *	Whenever the queue has nothing to prep the asynchronous axes get a segment of 
+ *	their own, so they carry on through holds, waits and an empty queue (see plan_aux.cpp).
  */
 
+static stat_t _exec_move(void) HOT_PATH;
+
 stat_t mp_exec_move()
 {
-	mpBuf_t *bf;
+	stat_t status = _exec_move();
+	if (status == STAT_NOOP) { status = AUX_EXEC();}
+	return (status);
+}
 
-	if ((bf = mp_get_run_buffer()) == NULL) return (STAT_NOOP);	// NULL means nothing's running
+static stat_t _exec_move()
+{
+	mpBuf_t *bf = mp_get_run_buffer();
+
+	// let the shaped axes settle before stopping or running anything but motion (see shaper.h)
+	if (SH_SETTLING() && ((bf == NULL) || (cm.hold_state == FEEDHOLD_HOLD) ||
+		((bf->move_type != MOVE_TYPE_ALINE) && (bf->move_type != MOVE_TYPE_ARC)))) {
+		return (sh_exec_drain());
+	}
+	if (mp_jog_is_running() == true) { return (mp_exec_jog());}	// the planner is held while jogging
+	if (SQ_RUNNING()) { return (SQ_EXEC());}	// and while host step schedules run
+	if (STRESS_ACTIVE()) { return (STRESS_EXEC());}	// and for the stress test
+	if (RP_REPLAYING()) { return (RP_EXEC());}		// and while the segment cache replays
+	if (bf == NULL) return (STAT_NOOP);					// NULL means nothing's running
 
 	// Manage cycle and motion state transitions
-	// Cycle auto-start for lines only
-	if (bf->move_type == MOVE_TYPE_ALINE) {
+	// Cycle auto-start for lines and arcs only
+	if ((bf->move_type == MOVE_TYPE_ALINE) || (bf->move_type == MOVE_TYPE_ARC)) {
 		if (cm.cycle_state == CYCLE_OFF) cm_cycle_start();
 		if (cm.motion_state == MOTION_STOP) cm_set_motion_state(MOTION_RUN);
 	}
@@ -193,15 +342,24 @@ stat_t mp_exec_move()
  *	  - ...which passes the saved parameters to the callback function
  *	  - To finish up _exec_command() needs to run a null pre and free the planner buffer
  *
+ *	The values are kept in the buffer's Gcode state target. The flags are kept as one
+ *	bit per axis, so the callback gets each one back as 0 or 1 - only test them as flags.
+ *
  *	Doing it this way instead of synchronizing on queue empty simplifies the
  *	handling of feedholds, feed overrides, buffer flushes, and thread blocking,
  *	and makes keeping the queue full much easier - therefore avoiding Q starvation
+ *
+ *	A queued command is a buffer the planner can't plan through, so the moves 
+ *	either side of it stop. Commands that take no time (coolant, spindle speed) 
+ *	use mp_queue_attached_command() instead - see below.
  */
 
 void mp_queue_command(void(*cm_exec)(float[], float[]), float *value, float *flag)
 {
 	mpBuf_t *bf;
 
+	mp_end_coalesce();							// keep the command in order behind any held G1 run
+
 	// this error is not reported as buffer availability was checked upstream in the controller
 	if ((bf = mp_get_write_buffer()) == NULL) return;
 
@@ -211,17 +369,91 @@ void mp_queue_command(void(*cm_exec)(float[], float[]), float *value, float *fla
 
 	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
 		bf->value_vector[axis] = value[axis];
-		bf->flag_vector[axis] = flag[axis];
+		if (fp_TRUE(flag[axis])) { bf->flag_bits |= (1 << axis);}
 	}
 	mp_queue_write_buffer(MOVE_TYPE_COMMAND);
 }
 
 static stat_t _exec_command(mpBuf_t *bf)
 {
-	bf->cm_func(bf->value_vector, bf->flag_vector);	// 2 vectors used by callbacks
+	float flag[AXES];								// flags come back as 0 or 1
+	mp_run_attached(bf);							// any attached commands were queued first
+	if (bf->cm_func != NULL) {						// NULL if only carrying attached commands
+		for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+			flag[axis] = (bf->flag_bits & (1 << axis)) ? 1 : 0;
+		}
+		RP_RECORD_COMMAND(bf->cm_func, bf->value_vector, bf->flag_bits);	// see replay.h
+		bf->cm_func(bf->value_vector, flag);		// 2 vectors used by callbacks
+	}
+	SR_MODAL_CHANGED();								// the command may have changed a mode
 	st_prep_null();									// Must call a null prep to keep the loader happy. 
 	mp_free_run_buffer();
 	return (STAT_OK);
+}
+
+/************************************************************************************
+ * mp_queue_attached_command() - queue a zero-time command on the next planner buffer
+ * mp_end_attached()		   - queue a buffer to carry the pending commands, if any
+ * mp_run_attached()		   - run the commands attached to a buffer as it starts
+ *
+ *	Coolant and spindle speed changes take no time, so they need not stop the 
+ *	motion the way a queued command does. Instead the command is held in the 
+ *	mb.attached[] ring and counted in mm.attached_pending. The next buffer queued 
+ *	(usually the next move) takes the pending count in mp_queue_write_buffer(), 
+ *	and its exec runs the commands as the buffer starts. Running them at the 
+ *	start of the next move is the same as at the end of the last one, and the 
+ *	moves are planned through without a stop.
+ *
+ *	Only value[0] is passed. The callback gets zero for the rest and all flags.
+ *
+ *	If nothing follows, mp_coalesce_callback() calls mp_end_attached() once the 
+ *	planner is down to the running block, and a command buffer carries them. If 
+ *	the ring is full the command is queued with mp_queue_command() as before. 
+ *	Either way the commands keep their order with the rest of the queue.
+ *
+ *	attached_w is written by the main loop, attached_r only by the exec.
+ */
+
+void mp_queue_attached_command(void(*cm_exec)(float[], float[]), float value)
+{
+	mp_end_coalesce();							// keep the command behind any held G1 run
+
+	if ((uint8_t)(mb.attached_w - mb.attached_r) >= MP_ATTACHED_COMMANDS) {	// ring is full
+		float vector[AXES] = { value, 0,0,0,0,0 };
+		mp_queue_command(cm_exec, vector, vector);
+		return;
+	}
+	mpAttached_t *a = &mb.attached[mb.attached_w & (MP_ATTACHED_COMMANDS-1)];
+	a->cm_func = cm_exec;
+	a->value = value;
+	mb.attached_w++;
+	mm.attached_pending++;
+	controller_request_task(TASK_COALESCE);		// in case nothing follows
+}
+
+void mp_end_attached()
+{
+	mpBuf_t *bf;
+
+	if (mm.attached_pending == 0) return;
+	if ((bf = mp_get_write_buffer()) == NULL) return;	// try again on the next callback
+	bf->bf_func = _exec_command;				// cm_func is NULL - runs only the attached commands
+	mp_queue_write_buffer(MOVE_TYPE_COMMAND);	// takes the pending commands
+}
+
+void mp_run_attached(mpBuf_t *bf)
+{
+	if (bf->attached == 0) return;
+	float vector[AXES] = { 0,0,0,0,0,0 };
+	float flag[AXES] = { 0,0,0,0,0,0 };
+	for (; bf->attached > 0; bf->attached--) {	// once only - not again after a hold
+		mpAttached_t *a = &mb.attached[mb.attached_r & (MP_ATTACHED_COMMANDS-1)];
+		vector[0] = a->value;
+		RP_RECORD_COMMAND(a->cm_func, vector, 0);
+		a->cm_func(vector, flag);
+		mb.attached_r++;
+	}
+	SR_MODAL_CHANGED();							// the commands may have changed a mode
 }
 
 /*************************************************************************
@@ -231,16 +463,20 @@ static stat_t _exec_command(mpBuf_t *bf)
  * Dwells are performed by passing a dwell move to the stepper drivers.
  * When the stepper driver sees a dwell it times the dwell on a separate 
  * timer than the stepper pulse timer.
+ *
+ * While the aux queue is running the dwell is timed on the DDA instead, as
+ * segments of no coordinated motion, so the asynchronous axes keep moving.
  */
 stat_t mp_dwell(float seconds)
 {
 	mpBuf_t *bf;
 
+	mp_end_coalesce();							// dwell after any held G1 run
 	if ((bf = mp_get_write_buffer()) == NULL) {	// get write buffer or fail
 		return (STAT_BUFFER_FULL_FATAL);		// (not ever supposed to fail)
 	}
 	bf->bf_func = _exec_dwell;					// register callback to dwell start
-	bf->gm.move_time = seconds;					// in seconds, not minutes
+	bf->gm->move_time = seconds;					// in seconds, not minutes
 	bf->move_state = MOVE_STATE_NEW;
 	mp_queue_write_buffer(MOVE_TYPE_DWELL);
 	return (STAT_OK);
@@ -248,7 +484,35 @@ stat_t mp_dwell(float seconds)
 
 static stat_t _exec_dwell(mpBuf_t *bf)
 {
-	st_prep_dwell((uint32_t)(bf->gm.move_time * 1000000));// convert seconds to uSec
+	uint32_t usec = (uint32_t)(bf->gm->move_time * 1000000);// convert seconds to uSec
+
+	if (bf->move_state == MOVE_STATE_NEW) {
+		mp_run_attached(bf);
+		if (mr.job_ended == true) {				// see mp_get_job_elapsed_time()
+			mr.job_usec = 0;
+			mr.job_ended = false;
+			mp_reset_job_stats();
+		}
+		mr.job_usec += usec;
+#ifdef __AUX_MOTION
+		mr.dwell_usec = usec;
+#endif
+		bf->move_state = MOVE_STATE_RUN;
+	}
+#ifdef __AUX_MOTION
+	usec = mr.dwell_usec;						// bf->gm->move_time is left for mp_free_run_buffer()
+	if ((mp_aux_is_running() == true) && (usec > 0)) {
+		float steps[MOTORS];
+		for (uint8_t motor=0; motor<MOTORS; motor++) { steps[motor] = 0;}
+		uint32_t microseconds = min(usec, (uint32_t)NOM_SEGMENT_USEC);
+		ritorno(st_prep_line(steps, (float)microseconds));	// the aux steps are added there
+		mr.dwell_usec -= microseconds;
+		if (mr.dwell_usec > 0) { return (STAT_OK);}
+		mp_free_run_buffer();
+		return (STAT_OK);
+	}
+#endif
+	st_prep_dwell(usec);
 	mp_free_run_buffer();
 	return (STAT_OK);
 }
@@ -276,10 +540,18 @@ static stat_t _exec_dwell(mpBuf_t *bf)
  * 
  * mp_get_planner_buffers_available()   Returns # of available planner buffers
  *
- * mp_init_buffers()		Initializes or resets buffers
+ * mp_get_planner_time_in_queue()	Returns ms of motion and dwell in the queue
+ *
+ * mp_get_planner_starving()	Returns TRUE if a running cycle has less than 
+ *								PLANNER_STARVATION_MS queued
+ *
+ * mp_init_buffers()		Initializes buffers
+ *
+ * mp_reset_buffers()		Empties the queue without touching the queued buffers
  *
  * mp_get_write_buffer()	Get pointer to next available write buffer
  *							Returns pointer or NULL if no buffer available.
+ *							The buffer was cleared when it was freed.
  *
  * mp_unget_write_buffer()	Free write buffer if you decide not to queue it.
  *
@@ -294,67 +566,136 @@ static stat_t _exec_dwell(mpBuf_t *bf)
  *
  * mp_free_run_buffer()		Release the run buffer & return to buffer pool.
  *
- * mp_get_prev_buffer(bf)	Returns pointer to prev buffer in linked list
- * mp_get_next_buffer(bf)	Returns pointer to next buffer in linked list 
+ * mp_get_prev_buffer(bf)	Returns pointer to prev buffer in the ring
+ * mp_get_next_buffer(bf)	Returns pointer to next buffer in the ring
  * mp_get_first_buffer(bf)	Returns pointer to first buffer, i.e. the running block
  * mp_get_last_buffer(bf)	Returns pointer to last buffer, i.e. last block (zero)
  * mp_clear_buffer(bf)		Zeroes the contents of the buffer
  * mp_copy_buffer(bf,bp)	Copies the contents of bp into bf - preserves links
  */
 
-uint8_t mp_get_planner_buffers_available(void) { return (mb.buffers_available);}
+/*	The buffers available are found from two running counts - the buffers taken by the 
+ *	main loop and the buffers freed by the exec - rather than one count both of them 
+ *	add to and take from. Each count is only written from one context, so a buffer can
+ *	be taken while the exec interrupt frees one without masking interrupts, and the 
+ *	unsigned difference stays correct when they wrap. The buffer states hand each 
+ *	buffer between the loop and the exec as before.
+ */
+mpBufCount_t mp_get_planner_buffers_available(void)
+{
+	return (PLANNER_BUFFER_POOL_SIZE - (mpBufCount_t)(mb.buffers_taken - mb.buffers_freed));
+}
+
+/*	mp_planner_has_room() is the admission test for anything that queues buffers - TRUE
+ *	if that many can be taken now. A G1 run held by mp_coalesce_line() is planned into
+ *	a buffer of its own by whatever is queued next, so it is counted on top. It is also
+ *	FALSE while the queued blocks are using up the work offset sets, until the runtime
+ *	frees some - see cm_get_work_offset_set().
+ */
+uint8_t mp_planner_has_room(uint8_t buffers)
+{
+	if (mm.coalesce_pending == true) { buffers++;}
+	if ((cm_get_work_offset_sets_free() < CM_WORK_OFFSET_SETS_HEADROOM) &&
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (false);
+	}
+	return (mp_get_planner_buffers_available() >= buffers);
+}
+
+/*	Queue time is the nominal time of each buffer as it was queued (gm->move_time), so 
+ *	it ignores replanning and feed rate override. The running move counts until it's 
+ *	freed. Each total is only written from one context so neither needs locking, and 
+ *	the unsigned difference stays correct when they wrap.
+ */
+static uint32_t _get_buffer_usec(mpBuf_t *bf)
+{
+	if ((bf->move_type == MOVE_TYPE_ALINE) || (bf->move_type == MOVE_TYPE_ARC)) {
+		return ((uint32_t)(bf->gm->move_time * MICROSECONDS_PER_MINUTE));
+	}
+	if (bf->move_type == MOVE_TYPE_DWELL) {		// dwell time is in seconds
+		return ((uint32_t)(bf->gm->move_time * 1000000));
+	}
+	return (0);
+}
+
+float mp_get_planner_time_in_queue(void) { return ((float)(mb.usec_queued - mb.usec_freed) / 1000);}
+
+uint8_t mp_get_planner_starving(void)
+{
+	if (cm.cycle_state == CYCLE_OFF) return (false);
+	return ((mp_get_planner_time_in_queue() < PLANNER_STARVATION_MS) ? true : false);
+}
 
 void mp_init_buffers(void)
 {
-	mpBuf_t *pv;
-	uint8_t i;
+	mpBufCount_t i;
 
-	memset(&mb, 0, sizeof(mb));		// clear all values, pointers and status
+	memset(&mb, 0, MG_SIZEOF(mb));	// clear all values, pointers and status (not the guard)
 	mb.magic_start = MAGICNUM;
 	mb.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_PLANNER_BUFFERS, mb);
 
 	mb.w = &mb.bf[0];				// init write and read buffer pointers
 	mb.q = &mb.bf[0];
 	mb.r = &mb.bf[0];
-	pv = &mb.bf[PLANNER_BUFFER_POOL_SIZE-1];
-	for (i=0; i < PLANNER_BUFFER_POOL_SIZE; i++) { // setup ring pointers
-		mb.bf[i].nx = &mb.bf[_bump(i)];
-		mb.bf[i].pv = pv;
-		pv = &mb.bf[i];
+	for (i=0; i < PLANNER_BUFFER_POOL_SIZE; i++) {
+		mb.bf[i].gm = &mb.gm[i];	// bind the buffer to its Gcode state
+	}								// the memset makes all buffers available
+}
+
+/*	A flush restarts the queue at the write buffer and leaves the other buffers as they
+ *	were - clearing the whole pool was a pause before the next job could stream. The
+ *	buffers left over are stale by their generation, and each is cleared when the write
+ *	pointer reaches it. That keeps the write buffer clean and EMPTY, so the queue always 
+ *	ends on a clean buffer. The buffer behind the run buffer must also be clean, as the 
+ *	planner reads it to plan from rest. Only those two are cleared here.
+ */
+void mp_reset_buffers(void)
+{
+	if (++mb.generation == 0) {					// wrapped - a stale buffer could look current
+		mp_init_buffers();
+		return;
 	}
-	mb.buffers_available = PLANNER_BUFFER_POOL_SIZE;
+	mp_clear_buffer(mb.w);
+	mp_clear_buffer(mp_get_prev_buffer(mb.w));
+	mb.q = mb.w;
+	mb.r = mb.w;
+	mb.attached_r = mb.attached_w;				// attached commands went with their buffers
+	mb.buffers_taken = mb.buffers_freed;		// all buffers available
+	mb.usec_queued = 0;
+	mb.usec_freed = 0;
 }
 
-mpBuf_t * mp_get_write_buffer() 				// get & clear a buffer
+mpBuf_t * mp_get_write_buffer() 				// get a buffer - cleared when it was freed
 {
 	if (mb.w->buffer_state == MP_BUFFER_EMPTY) {
 		mpBuf_t *w = mb.w;
-		mpBuf_t *nx = mb.w->nx;					// save pointers
-		mpBuf_t *pv = mb.w->pv;
-		memset(mb.w, 0, sizeof(mpBuf_t));
-		w->nx = nx;								// restore pointers
-		w->pv = pv;
 		w->buffer_state = MP_BUFFER_LOADING;
-		mb.buffers_available--;
-		mb.w = w->nx;
+		mb.buffers_taken++;
+		mpBufCount_t available = mp_get_planner_buffers_available();
+		if (available < mps.buffers_min) { mps.buffers_min = available;}
+		mb.w = mp_get_next_buffer(w);
+		if (mb.w->generation != mb.generation) { mp_clear_buffer(mb.w);}	// left over from a flush
 		return (w);
 	}
 	return (NULL);
 }
-/* NOT USED
 void mp_unget_write_buffer()
 {
-	mb.w = mb.w->pv;							// queued --> write
-	mb.w->buffer_state = MP_BUFFER_EMPTY; 		// not loading anymore
-	mb.buffers_available++;
+	mb.w = mp_get_prev_buffer(mb.w);			// queued --> write
+	mp_clear_buffer(mb.w);						// not loading anymore - may have been partly written
+	mb.buffers_taken--;
 }
-*/
+
 void mp_queue_write_buffer(const uint8_t move_type)
 {
 	mb.q->move_type = move_type;
 	mb.q->move_state = MOVE_STATE_NEW;
+	mb.q->attached = mm.attached_pending;		// zero-time commands run as this buffer starts
+	mm.attached_pending = 0;
 	mb.q->buffer_state = MP_BUFFER_QUEUED;
-	mb.q = mb.q->nx;							// advance the queued buffer pointer
+	mb.usec_queued += _get_buffer_usec(mb.q);
+	mb.q = mp_get_next_buffer(mb.q);			// advance the queued buffer pointer
 	st_request_exec_move();						// request a move exec if not busy
 	qr_request_queue_report(+1);				// add to the "added buffers" count
 }
@@ -375,14 +716,19 @@ mpBuf_t * mp_get_run_buffer()
 
 void mp_free_run_buffer()						// EMPTY current run buf & adv to next
 {
+	uint32_t linenum = mb.r->gm->linenum;		// before the clear, for the line event
+	mb.usec_freed += _get_buffer_usec(mb.r);	// before the clear wipes the move time
 	mp_clear_buffer(mb.r);						// clear it out (& reset replannable)
 //	mb.r->buffer_state = MP_BUFFER_EMPTY;		// redundant after the clear, above
-	mb.r = mb.r->nx;							// advance to next run buffer
+	mb.r = mp_get_next_buffer(mb.r);			// advance to next run buffer
 	if (mb.r->buffer_state == MP_BUFFER_QUEUED) {// only if queued...
 		mb.r->buffer_state = MP_BUFFER_PENDING;	// pend next buffer
 	}
+	if (LE_ARMED() && ((mb.r->buffer_state < MP_BUFFER_QUEUED) || (mb.r->gm->linenum != linenum))) {
+		le_line_finished(linenum);				// the last buffer of its line - see report.h
+	}
 	if (mb.w == mb.r) cm_cycle_end();			// end the cycle if the queue empties
-	mb.buffers_available++;
+	mb.buffers_freed++;							// last - the buffer is clear for the main loop
 	qr_request_queue_report(-1);				// add to the "removed buffers" count
 }
 
@@ -399,7 +745,8 @@ mpBuf_t * mp_get_last_buffer(void)
 	if (bf == NULL) { return(NULL);}
 
 	do {
-		if ((bp->nx->move_state == MOVE_STATE_OFF) || (bp->nx == bf)) { 
+		mpBuf_t *nx = mp_get_next_buffer(bp);
+		if ((nx->move_state == MOVE_STATE_OFF) || (nx == bf)) { 
 			return (bp); 
 		}
 	} while ((bp = mp_get_next_buffer(bp)) != bf);
@@ -407,39 +754,79 @@ mpBuf_t * mp_get_last_buffer(void)
 }
 
 // Use the macro instead
-//mpBuf_t * mp_get_prev_buffer(const mpBuf_t *bf) { return (bf->pv);}
-//mpBuf_t * mp_get_next_buffer(const mpBuf_t *bf) { return (bf->nx);}
+//mpBuf_t * mp_get_prev_buffer(const mpBuf_t *bf);
+//mpBuf_t * mp_get_next_buffer(const mpBuf_t *bf);
 
 void mp_clear_buffer(mpBuf_t *bf) 
 {
-	mpBuf_t *nx = bf->nx;			// save pointers
-	mpBuf_t *pv = bf->pv;
+	GCodeState_t *gm = bf->gm;		// save the static pointer
 	memset(bf, 0, sizeof(mpBuf_t));
-	bf->nx = nx;					// restore pointers
-	bf->pv = pv;
+	memset(gm, 0, sizeof(GCodeState_t));
+	bf->gm = gm;
+	bf->generation = mb.generation;	// clean as of the last flush
 }
 
 void mp_copy_buffer(mpBuf_t *bf, const mpBuf_t *bp)
 {
-	mpBuf_t *nx = bf->nx;			// save pointers
-	mpBuf_t *pv = bf->pv;
+	GCodeState_t *gm = bf->gm;		// save the static pointer
  	memcpy(bf, bp, sizeof(mpBuf_t));
-	bf->nx = nx;					// restore pointers
-	bf->pv = pv;
+	memcpy(gm, bp->gm, sizeof(GCodeState_t));
+	bf->gm = gm;
+	bf->generation = mb.generation;
 }
 
-#ifdef __DEBUG	// currently this routine is only used by debug routines
-uint8_t mp_get_buffer_index(mpBuf_t *bf) 
+/*
+ * mp_set_unit() - pack a unit vector into Q15 for a planner buffer
+ * mp_get_unit() - unpack it
+ * mp_unit_dot() - dot product of two packed unit vectors
+ *
+ *	Rounded to the nearest step of 1/MP_UNIT_ONE, so a component of 1.0 packs back to 1.0.
+ *
+ *	mp_unit_dot() multiplies the Q15 components as integers rather than unpacking 
+ *	them to float. With the DSP extension (Cortex-M4) it takes the components two at
+ *	a time with SMLAD, a dual 16 bit multiply-accumulate - half the multiplies and 
+ *	loads. Elsewhere it is a plain integer multiply-accumulate over the axes in use.
+ *	The Q30 sum can't overflow - the dot product of unit vectors is within +/-1.0.
+ */
+void mp_set_unit(int16_t packed[], const float unit[])
 {
-	mpBuf_t *b = bf;				// temp buffer pointer
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		packed[axis] = (int16_t)lroundf(unit[axis] * MP_UNIT_ONE);
+	}
+}
 
-	for (uint8_t i=0; i < PLANNER_BUFFER_POOL_SIZE; i++) {
-		if (b->pv > b) {
-			return (i);
-		}
-		b = b->pv;
+void mp_get_unit(float unit[], const int16_t packed[])
+{
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		unit[axis] = (float)packed[axis] * (1.0f / MP_UNIT_ONE);
+	}
+}
+
+float mp_unit_dot(const int16_t a[], const int16_t b[])
+{
+	int32_t sum = 0;
+#if defined(__ARM_FEATURE_DSP) && ((AXES % 2) == 0)
+	for (uint8_t axis=0; axis<AXES; axis+=2) {
+		uint32_t a2, b2;
+		memcpy(&a2, &a[axis], sizeof(a2));		// a pair of components - not always word aligned
+		memcpy(&b2, &b[axis], sizeof(b2));
+		__asm__ ("smlad %0, %1, %2, %0" : "+r" (sum) : "r" (a2), "r" (b2));
+	}
+#else
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		if (AXIS_USED(axis)) { sum += (int32_t)a[axis] * b[axis];}	// compile-time test
+	}
+#endif
+	return ((float)sum * (1.0f / ((float)MP_UNIT_ONE * MP_UNIT_ONE)));
+}
+
+#ifdef __DEBUG	// currently this routine is only used by debug routines
+mpBufCount_t mp_get_buffer_index(mpBuf_t *bf) 
+{
+	if ((bf < &mb.bf[0]) || (bf > &mb.bf[PLANNER_BUFFER_POOL_SIZE-1])) {
+		return(cm_alarm(PLANNER_BUFFER_POOL_SIZE));	// should never happen
 	}
-	return(cm_alarm(PLANNER_BUFFER_POOL_SIZE));	// should never happen
+	return ((mpBufCount_t)(bf - &mb.bf[0]));
 }
 #endif
 
@@ -451,10 +838,12 @@ uint8_t mp_get_buffer_index(mpBuf_t *bf)
 
 #ifdef __DEBUG
 void mp_dump_running_plan_buffer() { _dump_plan_buffer(mb.r);}
-void mp_dump_plan_buffer_by_index(uint8_t index) { _dump_plan_buffer(&mb.bf[index]);	}
+void mp_dump_plan_buffer_by_index(mpBufCount_t index) { _dump_plan_buffer(&mb.bf[index]);	}
 
 static void _dump_plan_buffer(mpBuf_t *bf)
 {
+	float unit[AXES];
+	mp_get_unit(unit, bf->unit);
 	fprintf_P(stderr, PSTR("***Runtime Buffer[%d] bstate:%d  mtype:%d  mstate:%d  replan:%d\n"),
 			_get_buffer_index(bf),
 			bf->buffer_state,
@@ -465,7 +854,7 @@ static void _dump_plan_buffer(mpBuf_t *bf)
 	print_scalar(PSTR("line number:     "), bf->linenum);
 	print_vector(PSTR("position:        "), mm.position, AXES);
 	print_vector(PSTR("target:          "), bf->target, AXES);
-	print_vector(PSTR("unit:            "), bf->unit, AXES);
+	print_vector(PSTR("unit:            "), unit, AXES);
 	print_scalar(PSTR("jerk:            "), bf->jerk);
 	print_scalar(PSTR("time:            "), bf->time);
 	print_scalar(PSTR("length:          "), bf->length);
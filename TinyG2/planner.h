@@ -38,12 +38,14 @@ extern "C"{
 enum moveType {				// bf->move_type values 
 	MOVE_TYPE_NULL = 0,		// null move - does a no-op
 	MOVE_TYPE_ALINE,		// acceleration planned line
+	MOVE_TYPE_ARC,			// acceleration planned arc or helix (__PLANNER_ARC_MOVES)
 	MOVE_TYPE_DWELL,		// delay with no movement
 	MOVE_TYPE_COMMAND,		// general command
 	MOVE_TYPE_TOOL,			// T command
 	MOVE_TYPE_SPINDLE_SPEED,// S command
 	MOVE_TYPE_STOP,			// program stop
-	MOVE_TYPE_END			// program end
+	MOVE_TYPE_END,			// program end
+	MOVE_TYPE_SPINDLE_SYNC	// G33 or G84 move that follows the spindle (__SPINDLE_SYNC)
 };
 
 enum moveState {
@@ -51,6 +53,7 @@ enum moveState {
 	MOVE_STATE_NEW,			// general value if you need an initialization
 	MOVE_STATE_RUN,			// general run state (for non-acceleration moves) 
 	MOVE_STATE_RUN2,		// used for sub-states
+	MOVE_STATE_RUN3,		// sub-state for the constant acceleration part of a head or tail
 	MOVE_STATE_HEAD,		// aline() acceleration portions
 	MOVE_STATE_BODY,		// aline() cruise portions
 	MOVE_STATE_TAIL,		// aline() deceleration portions
@@ -59,6 +62,12 @@ enum moveState {
 };
 #define MOVE_STATE_RUN1 MOVE_STATE_RUN // a convenience
 
+enum mpOverrideState {		// feed rate override replanning (see mp_feed_rate_override())
+	OVERRIDE_OFF = 0,		// nothing to do
+	OVERRIDE_SYNC,			// new factor set; waiting for the next aline segment to be prepped
+	OVERRIDE_PLAN			// replan the queue and the running move from the main loop
+};
+
 /*** Most of these factors are the result of a lot of tweaking. Change with caution.***/
 
 /* The following must apply:
@@ -72,19 +81,53 @@ enum moveState {
 #define MIN_SEGMENT_LENGTH 		((float)0.05)		// Smallest accel/decel segment (mm). Set to produce ~10 ms segments (0.01)
 #define MIN_LENGTH_MOVE 		((float)0.001)		// millimeters
 
+/* ARC_CORRECTION_SEGMENTS
+ *	Arc segment points are found by rotating the previous point about the center 
+ *	with small angle approximations of sin and cos. Every N segments the point is
+ *	computed exactly from its angle to stop rounding errors accumulating.
+ */
+#define ARC_CORRECTION_SEGMENTS	12
+
 #define JERK_MULTIPLIER			((float)1000000)
 #define JERK_MATCH_PRECISION	((float)1000)		// precision to which jerk must match to be considered effectively the same
+#define JERK_CACHE_SIZE			4					// jerk terms kept for re-use - see _set_jerk_terms()
+#define JERK_QUANTUM_BITS		6					// mantissa bits kept of a line's jerk limit - at most 1/32 below it
+#define PLANNED_LIMIT_TOLERANCE	((float)0.001)		// fraction a host planned move may exceed the machine limits by (rounding)
+
+#define INVERSE_TIME_SMOOTHING	((float)0.5)		// weight of a G93 block's own velocity against the run before it
+#define INVERSE_TIME_RATIO		((float)1.5)		// G93 velocity change that starts a new run - see _get_cruise_vset()
+#define INVERSE_TIME_TOLERANCE	((float)0.1)		// fraction a smoothed G93 block's time may differ from its F word
+
+#define FEED_OVERRIDE_MIN		((float)0.05)		// lowest feed rate override factor accepted
+#define FEED_OVERRIDE_MAX		((float)2.0)		// highest feed rate override factor accepted
 
 /* ESTD_SEGMENT_USEC	 Microseconds per planning segment
  *	Should be experimentally adjusted if the MIN_SEGMENT_LENGTH is changed
  */
 #define NOM_SEGMENT_USEC 		((float)5000)		// nominal segment time
 #define MIN_SEGMENT_USEC 		((float)2500)		// minimum segment time
+#define MAX_SEGMENT_USEC 		((float)40000)		// maximum segment time (see below)
 #define MIN_ARC_SEGMENT_USEC	((float)10000)		// minimum arc segment time
+#define JOG_TIMEOUT_USEC		200000UL			// jog axes stop if no target arrives for this long (see plan_jog.cpp)
+#define AUX_QUEUE_SIZE			8					// blocks queued for the asynchronous axes - power of 2 (see plan_aux.cpp)
 #define NOM_SEGMENT_TIME 		(MIN_SEGMENT_USEC / MICROSECONDS_PER_MINUTE)
 #define MIN_SEGMENT_TIME 		(MIN_SEGMENT_USEC / MICROSECONDS_PER_MINUTE)
 #define MIN_ARC_SEGMENT_TIME 	(MIN_ARC_SEGMENT_USEC / MICROSECONDS_PER_MINUTE)
 #define MIN_TIME_MOVE  			(MIN_SEGMENT_TIME) 	// minimum time a move can be is one segment
+
+/* Variable segment time
+ *	The runtime scales the nominal segment time ($ms) by section. Head and tail 
+ *	(jerk-limited acceleration) use shorter segments so the velocity steps stay 
+ *	small; bodies run at constant velocity and use longer segments to save exec 
+ *	time. Results are clamped to MIN_SEGMENT_USEC and MAX_SEGMENT_USEC.
+ *
+ *	The stepper runtime takes segments of several seconds (see DDA_SUBSTEP_SHIFT_MAX)
+ *	so MAX_SEGMENT_USEC is not a DDA limit. It bounds the extra latency a feedhold 
+ *	sees when it arrives at the start of a body segment, as that segment and those
+ *	prepared behind it run out first - 80 ms at most (see ST_PREP_AHEAD_USEC).
+ */
+#define ACCEL_SEGMENT_FACTOR	((float)0.5)		// head and tail segment time as a fraction of nominal
+#define BODY_SEGMENT_FACTOR		((float)8.0)		// body segment time as a multiple of nominal
 //#define MIN_LENGTH_MOVE 		(EPSILON)
 //#define MIN_TIME_MOVE  			((float)0.0000001)
 
@@ -99,14 +142,29 @@ enum moveState {
 /* PLANNER_BUFFER_POOL_SIZE
  *	Should be at least the number of buffers requires to support optimal 
  *	planning in the case of very short lines or arc segments. 
- *	Suggest 12 min. Limit is 255
+ *	Suggest 12 min. Limit is MP_BUFFER_COUNT_MAX (checked at compile time in planner.cpp)
+ *
+ *	Builds with SRAM to spare can size the pool from a memory budget instead of a count.
+ *	Define PLANNER_BUFFER_MEMORY_BUDGET (bytes) on the command line, e.g. -DPLANNER_BUFFER_MEMORY_BUDGET=32768
+ *	and the pool will be as many buffers as fit in the budget. Or define PLANNER_BUFFER_POOL_SIZE directly.
  */
-#define PLANNER_BUFFER_POOL_SIZE 28
-#define PLANNER_BUFFER_HEADROOM 4			// buffers to reserve in planner before processing new input line
+#if defined(PLANNER_BUFFER_MEMORY_BUDGET)
+#define PLANNER_BUFFER_POOL_SIZE (PLANNER_BUFFER_MEMORY_BUDGET / (sizeof(mpBuf_t) + sizeof(GCodeState_t)))
+#elif !defined(PLANNER_BUFFER_POOL_SIZE)
+#define PLANNER_BUFFER_POOL_SIZE 35		// the SRAM 29 took before the buffers were packed - see mpBuf_t
+#endif
+#define PLANNER_BUFFER_HEADROOM 4			// buffers to reserve before running a line the parser has not sized - see gc_get_queued_block_buffers()
+#define PLANNER_STARVATION_MS 100			// a running cycle with less queued time than this is about to starve
+#define MP_ATTACHED_COMMANDS 8				// zero-time commands held for motion blocks - a power of 2 (see mp_queue_attached_command())
+
+typedef uint16_t mpBufCount_t;				// type used for buffer counts and indexes
+#define MP_BUFFER_COUNT_MAX 0xFFFF			// must agree with mpBufCount_t
 
 /* Some parameters for _generate_trapezoid()
- * TRAPEZOID_ITERATION_MAX	 				Max iterations for convergence in the HT asymmetric case.
- * TRAPEZOID_ITERATION_ERROR_PERCENT		Error percentage for iteration convergence. As percent - 0.01 = 1%
+ * TRAPEZOID_ITERATION_MAX	 				Max iterations for the HT asymmetric case iterative solver...
+ * TRAPEZOID_ITERATION_ERROR_PERCENT		...and its convergence error as percent - 0.01 = 1%. The error is
+ *											only used by the reference solver in the planner unit tests. The 
+ *											max also bounds the acceleration limited HT' solver
  * TRAPEZOID_LENGTH_FIT_TOLERANCE			Tolerance for "exact fit" for H and T cases
  * TRAPEZOID_VELOCITY_TOLERANCE				Adaptive velocity tolerance term
  */
@@ -121,6 +179,11 @@ enum moveState {
 
 typedef void (*cm_exec)(float[], float[]);	// callback to canonical_machine execution function
 
+typedef struct mpAttached {	// zero-time command run as a motion block starts
+	cm_exec cm_func;			// callback to canonical machine execution function
+	float value;				// passed to the callback as value[0]
+} mpAttached_t;
+
 /*
  *	Planner structures
  */
@@ -135,19 +198,70 @@ enum mpBufferState {			// bf->buffer_state values
 	MP_BUFFER_RUNNING			// current running buffer
 };
 
+/* mpArc_t - arc geometry carried by a MOVE_TYPE_ARC buffer
+ *
+ *	Positions along the arc are found from the distance travelled from the start 
+ *	of the whole arc (path distance). Feedholds can split an arc across buffers,
+ *	so each buffer also records the path distance it starts at (bf->path_start).
+ *	The total length is kept here as bf->length only covers the buffer's part.
+ */
+typedef struct mpArc {
+	float start[AXES];			// position at the start of the arc
+	int16_t exit_unit[AXES];	// tangent at the end of the arc (bf->unit is the entry tangent)
+	float center_1;				// center of circle at axis 1 (typ X)
+	float center_2;				// center of circle at axis 2 (typ Y)
+	float radius;
+	float theta;				// starting angle
+	float angular_travel;		// radians along arc (+CW, -CCW)
+	float linear_travel;		// travel along linear axis of arc
+	float length;				// total length of the arc or helix in mm
+	uint8_t axis_1;				// arc plane axis
+	uint8_t axis_2;				// arc plane axis
+	uint8_t axis_linear;		// transverse axis (helical)
+} mpArc_t;
+
+/*
+ * mpPlannedMove_t - a straight move planned by the host - see mp_aline_planned()
+ */
+typedef struct mpPlannedMove {
+	float length;				// mm
+	float unit[AXES];			// direction in machine axes - normalised by the planner
+	float entry_velocity;		// mm/min
+	float cruise_velocity;		// mm/min - the highest velocity of the move
+	float exit_velocity;		// mm/min
+	float jerk;					// mm/min^3 (not scaled by JERK_MULTIPLIER)
+} mpPlannedMove_t;
+
+/*
+ * mpBuf_t - a planner buffer
+ *
+ *	The buffers are kept compact so more of them fit in the same SRAM:
+ *	  - the buffers before and after a buffer are its neighbours in mb.bf[], found
+ *		by mp_get_prev_buffer() and mp_get_next_buffer() rather than stored pointers
+ *	  - unit vectors are Q15 fixed point (MP_UNIT_ONE is 1.0), good to 3e-5, which is
+ *		ample for junctions and axis limits. The runtime takes the direction of a
+ *		line from its endpoints, so the path does not depend on it
+ *	  - the Gcode state holds the index of its set of work offsets rather than the
+ *		offsets - see cm_get_work_offset_set()
+ */
+#define MP_UNIT_ONE 32767		// unit vector component of 1.0 - see mp_set_unit()
+
 typedef struct mpBuffer {		// See Planning Velocity Notes for variable usage
-	struct mpBuffer *pv;		// static pointer to previous buffer
-	struct mpBuffer *nx;		// static pointer to next buffer
 	stat_t (*bf_func)(struct mpBuffer *bf); // callback to buffer exec function
 	cm_exec cm_func;			// callback to canonical machine execution function
+	uint16_t generation;		// mb.generation when last cleared - stale if it differs (see mp_reset_buffers())
+	int16_t unit[AXES];			// unit vector for axis scaling & planning - Q15
 
 	uint8_t buffer_state;		// used to manage queueing/dequeueing
 	uint8_t move_type;			// used to dispatch to run routine
 	uint8_t move_code;			// byte that can be used by used exec functions
 	uint8_t move_state;			// move state machine sequence
 	uint8_t replannable;		// TRUE if move can be replanned
-
-	float unit[AXES];			// unit vector for axis scaling & planning
+	volatile uint8_t trapezoid_planned;// TRUE once the head, body and tail are published for the velocities - see mp_plan_trapezoid()
+	uint8_t spindle_sync;		// TRUE if the move starts from rest and waits for the spindle to reach speed
+	uint8_t host_planned;		// TRUE if the velocities were planned by the host - see mp_aline_planned()
+	uint8_t overridable;		// TRUE if feed rate override applies to this move
+	uint8_t attached;			// commands in mb.attached[] to run as the move starts
 
 	float length;				// total length of line or helix in mm
 	float head_length;
@@ -167,27 +281,71 @@ typedef struct mpBuffer {		// See Planning Velocity Notes for variable usage
 	float jerk;					// maximum linear jerk term for this move
 	float recip_jerk;			// 1/Jm used for planning (compute-once)
 	float cbrt_jerk;			// cube root of Jm used for planning (compute-once)
+	float junction_delta;		// fused junction deviation of the move (compute-once)
+	float accel;				// path acceleration limit from the axis $xac values (0 = jerk limited only)
+	float accel_dv;				// velocity change at which the acceleration limit is reached: accel^2/Jm
+	float junction_vmax;		// entry junction velocity limit (kept for replanning)
+	float cruise_vset;			// cruise velocity requested by the Gcode, before feed rate override
+	float cruise_vlimit;		// highest cruise velocity the feed rate override may give the move
+
+#ifdef __PLANNER_ARC_MOVES
+	float path_start;			// path distance along the arc where this buffer starts
+	mpArc_t arc;				// arc geometry - only valid for MOVE_TYPE_ARC
+#endif
 
-	GCodeState_t gm;			// Gode model state - passed from model, used by planner and runtime
-
+	GCodeState_t *gm;			// Gode model state - passed from model, used by planner and runtime
+								// Points into mb.gm[] - see mpBufferPool_t. Static
 } mpBuf_t;
 
 typedef struct mpBufferPool {	// ring buffer for sub-moves
 	magic_t magic_start;		// magic number to test memory integrity
-	uint8_t buffers_available;	// running count of available buffers
+	mpBufCount_t buffers_taken;	// running count of buffers taken for writing (written by main loop only)
+	volatile mpBufCount_t buffers_freed;// running count of run buffers freed (written by exec only)
+	uint16_t generation;		// bumped by each flush - buffers from before it are stale
+	uint32_t usec_queued;		// running total of nominal move time queued (written by main loop only)
+	uint32_t usec_freed;		// running total of nominal move time freed (written by exec only)
 	mpBuf_t *w;					// get_write_buffer pointer
 	mpBuf_t *q;					// queue_write_buffer pointer
 	mpBuf_t *r;					// get/end_run_buffer pointer
-	mpBuf_t bf[PLANNER_BUFFER_POOL_SIZE];// buffer storage
+	mpBuf_t bf[PLANNER_BUFFER_POOL_SIZE];// buffer storage - hot data walked by the planning passes
+	GCodeState_t gm[PLANNER_BUFFER_POOL_SIZE];// Gcode state for each buffer - cold data, not used in planning
+	mpAttached_t attached[MP_ATTACHED_COMMANDS];// ring of attached commands - see mp_queue_attached_command()
+	uint8_t attached_w;			// next entry to write (written by main loop only)
+	volatile uint8_t attached_r;// next entry to run (written by exec only)
 	magic_t magic_end;
+	MEMORY_GUARD
 } mpBufferPool_t;
 
+typedef struct mpJerkTerms {	// compute-once jerk terms kept for re-use
+	float jerk;
+	float recip_jerk;
+	float cbrt_jerk;
+} mpJerkTerms_t;
+
 typedef struct mpMoveMasterSingleton {	// common variables for planning (move master)
 	float position[AXES];		// final move position for planning purposes
-//	float ms_in_queue;			// UNUSED - total ms of movement & dwell in planner queue
-	float prev_jerk;			// jerk values cached from previous move
-	float prev_recip_jerk;
-	float prev_cbrt_jerk;
+	mpJerkTerms_t jerk_cache[JERK_CACHE_SIZE];// most recently used first
+
+	uint8_t hold_replan;		// TRUE if the exec planned a hold and the queue still needs replanning
+	uint32_t hold_cycles;		// cycle count at the last hold request
+	float hold_latency;			// uSec from the last hold request to its decel being planned ($hlat)
+	float hold_stop_time;		// uSec from the last hold request to zero velocity ($hstp)
+	uint8_t resume_pending;		// TRUE from the end of a hold until the first segment of the resume
+	uint32_t resume_cycles;		// cycle count at the end of the hold
+	float resume_latency;		// uSec from the end of the last hold to its first segment ($rlat)
+
+	float feed_override;		// feed rate override factor applied to planned moves (1.0 = none)
+	float adaptive_factor;		// load-adaptive feed factor - multiplies feed_override (1.0 = none)
+	uint8_t override_state;		// see mpOverrideState
+	uint8_t spindle_sync;		// TRUE if the next feed move must wait for the spindle (see spindle.cpp)
+	float it_velocity;			// velocity of the last G93 block planned - 0 if the last move was not G93
+	float it_time_error;		// minutes the G93 run has been planned longer than its F words asked
+	uint8_t coalesce_pending;	// TRUE if a G1 run is being held by mp_coalesce_line()
+	float coalesce_unit[AXES];	// direction of the first line in the run
+	float coalesce_cos_min;		// smallest cosine of any line in the run to coalesce_unit
+	float coalesce_length;		// path length of the run
+	GCodeState_t coalesce_gm;	// Gcode state of the run - target is the end of the last line
+	uint8_t attached_pending;	// commands written to mb.attached[] waiting for the next motion block
 #ifdef __UNIT_TEST_PLANNER
 	float test_case;
 	float test_velocity;
@@ -206,16 +364,29 @@ typedef struct mpMoveRuntimeSingleton {	// persistent runtime variables
 	float position[AXES];		// current move position
 	float unit[AXES];			// unit vector for axis scaling & planning
 
+	const mpBuf_t *staged_bf;	// next block, whose direction is staged - see _stage_next_move()
+	float staged_start[AXES];	// ...the position it was staged from (this move's endpoint)
+	float staged_target[AXES];	// ...and to
+	float staged_unit[AXES];	// ...its unit vector
+
 	float head_length;			// copies of bf variables of same name
 	float body_length;
 	float tail_length;
 	float entry_velocity;
 	float cruise_velocity;
 	float exit_velocity;
+	float cruise_vmax;			// requested cruise velocity - the laser mode power reference
 
 	float length;				// length of line in mm
 	float midpoint_velocity;	// velocity at accel/decel midpoint
 	float jerk;					// max linear jerk
+	float accel;				// acceleration limit (0 = jerk limited only)
+	float accel_time;			// time of the constant acceleration part of this section (0 if none)
+	float accel_velocity;		// velocity at the end of the constant acceleration part
+	float jerk_segments;		// segments in each jerk part of an acceleration limited section
+	float jerk_segment_time;	// segment time for the jerk parts
+	uint8_t correction_inhibit;	// TRUE if mr stops short of mr.endpoint (feed rate override transition)
+	uint8_t raster_pending;		// raster event for the first segment of the move (see raster.h)
 
 	float segments;				// number of segments in arc or blend
 	uint32_t segment_count;		// count of running segments
@@ -223,18 +394,66 @@ typedef struct mpMoveRuntimeSingleton {	// persistent runtime variables
 	float microseconds;			// line or segment time in microseconds
 	float segment_length;		// computed length for aline segment
 	float segment_velocity;		// computed velocity for aline segment
+	float prev_segment_velocity;// velocity of the previous segment (used by __DDA_RAMPING)
 	float forward_diff_1;		// forward difference level 1 (Acceleration)
 	float forward_diff_2;		// forward difference level 2 (Jerk - constant)
+#ifdef __PRESSURE_ADVANCE
+	float pa_gain;				// extruder advance per unit of segment velocity in this move
+	float pa_offset;			// extruder advance the motors have been run to...
+	float pa_next;				// ...and will be at the end of the segment being prepped
+#endif
+
+	uint64_t job_usec;			// motion and dwell time executed since the job started
+	uint32_t move_usec;			// time executed in the running move
+	uint8_t job_ended;			// TRUE after a program end - the next move starts a new job
+#ifdef __AUX_MOTION
+	uint32_t dwell_usec;		// dwell time still to run while it is timed on the DDA
+#endif
+
+#ifdef __PLANNER_ARC_MOVES
+	uint8_t move_type;			// MOVE_TYPE_ALINE or MOVE_TYPE_ARC
+	float path_distance;		// current path distance along the arc
+	float path_end;				// path distance at the end of the bf buffer
+	uint8_t arc_correction_count;// segments until the next exact arc point
+	mpArc_t arc;				// copy of the running arc geometry
+#endif
 
 	GCodeState_t gm;			// gocode model state currently executing
 
 	magic_t magic_end;
+	MEMORY_GUARD
 } mpMoveRuntimeSingleton_t;
 
+typedef struct mpPlannerStats {	// starvation and underrun counters - see mp_reset_stats()
+	uint32_t starved_exits;		// blocks that started with a zero exit because no next block was queued
+	uint32_t dda_gaps;			// loads that found no prepared segment while the planner had moves
+	uint32_t buffers_min;		// fewest planner buffers available since the last reset
+	uint32_t exec_near_misses;	// segments the exec finished with little of the running segment left
+	uint32_t exec_margin_min;	// smallest motion left when the exec finished a segment (usec)
+} mpPlannerStats_t;
+
+typedef struct mpJobStats {		// where the time of a job goes - see mp_reset_job_stats()
+	uint64_t section_usec[3];	// time run in head, body and tail sections (by move_state)
+	uint64_t stop_usec;			// time at zero velocity between blocks
+	uint32_t blocks;			// blocks run
+	uint32_t stops;				// blocks started from a stop
+	uint32_t lookahead_limited;	// blocks that cruised below their cruise_vmax
+	uint32_t feed_limited;		// blocks that cruised at their cruise_vmax
+	uint32_t arc_segments;		// chords run along arcs
+	uint32_t exec_slack_min;	// smallest motion left when the exec finished, less its time (usec)
+	uint32_t exec_usec_max;		// longest the exec took to prepare a segment (usec)
+	uint32_t exec_late;			// segments finished with less than $esl of slack
+	uint8_t stopped;			// TRUE once a block has ended at zero velocity
+	uint32_t stop_cycles;		// cycle count at that stop
+	uint32_t stop_ms;			// SysTick at that stop
+} mpJobStats_t;
+
 // Reference global scope structures
 extern mpBufferPool_t mb;				// move buffer queue
 extern mpMoveMasterSingleton_t mm;		// context for line planning
 extern mpMoveRuntimeSingleton_t mr;		// context for line runtime
+extern mpPlannerStats_t mps;			// planner starvation and underrun counters
+extern mpJobStats_t mpj;				// per-job motion efficiency counters
 
 /*
  * Global Scope Functions
@@ -242,48 +461,128 @@ extern mpMoveRuntimeSingleton_t mr;		// context for line runtime
 
 void planner_init(void);
 stat_t mp_assertions(void);
+void mp_reset_stats(void);
+stat_t mp_run_reset_stats(cmdObj_t *cmd);
+void mp_reset_job_stats(void);
+stat_t mp_get_job_seconds(cmdObj_t *cmd);
 
 void mp_flush_planner(void);
 void mp_set_planner_position(uint8_t axis, const float position);
 void mp_set_runtime_position(uint8_t axis, const float position);
 
-stat_t mp_exec_move(void);
+stat_t mp_exec_move(void) HOT_PATH;
 void mp_queue_command(void(*cm_exec)(float[], float[]), float *value, float *flag);
+void mp_queue_attached_command(void(*cm_exec)(float[], float[]), float value);
+void mp_end_attached(void);
+void mp_run_attached(mpBuf_t *bf);
 
 stat_t mp_dwell(const float seconds);
 void mp_end_dwell(void);
 
 stat_t mp_aline(const GCodeState_t *gm_line);
+stat_t mp_coalesce_line(const GCodeState_t *gm_line);
+stat_t mp_end_coalesce(void);
+stat_t mp_coalesce_callback(void);
+stat_t mp_aline_planned(const GCodeState_t *gm_line, const mpPlannedMove_t *move);
+#ifdef __SELF_BENCHMARK
+void mp_bench_block(uint32_t cycles[]);
+#endif
+#ifdef __PLANNER_ARC_MOVES
+stat_t mp_arc(const GCodeState_t *gm_arc, const mpArc_t *arc);
+#endif
 
 stat_t mp_plan_hold_callback(void);
 stat_t mp_end_hold(void);
 stat_t mp_feed_rate_override(uint8_t flag, float parameter);
+void mp_set_adaptive_factor(const float factor);
+stat_t mp_plan_override_callback(void);
 
 // planner buffer handlers
 void mp_init_buffers(void);
-uint8_t mp_get_planner_buffers_available(void);
+void mp_reset_buffers(void);
+mpBufCount_t mp_get_planner_buffers_available(void);
+uint8_t mp_planner_has_room(uint8_t buffers);
+float mp_get_planner_time_in_queue(void);
+uint8_t mp_get_planner_starving(void);
 void mp_clear_buffer(mpBuf_t *bf); 
 void mp_copy_buffer(mpBuf_t *bf, const mpBuf_t *bp);
 void mp_queue_write_buffer(const uint8_t move_type);
 void mp_free_run_buffer(void);
 mpBuf_t * mp_get_write_buffer(void); 
+void mp_unget_write_buffer(void);
 mpBuf_t * mp_get_run_buffer(void);
 mpBuf_t * mp_get_first_buffer(void);
 mpBuf_t * mp_get_last_buffer(void);
-#define mp_get_prev_buffer(b) ((mpBuf_t *)(b->pv))
-#define mp_get_next_buffer(b) ((mpBuf_t *)(b->nx))
+#define mp_get_prev_buffer(b) ((mpBuf_t *)(((b) == &mb.bf[0]) ? &mb.bf[PLANNER_BUFFER_POOL_SIZE-1] : ((b)-1)))
+#define mp_get_next_buffer(b) ((mpBuf_t *)(((b) == &mb.bf[PLANNER_BUFFER_POOL_SIZE-1]) ? &mb.bf[0] : ((b)+1)))
+void mp_set_unit(int16_t packed[], const float unit[]);
+void mp_get_unit(float unit[], const int16_t packed[]);
+float mp_unit_dot(const int16_t a[], const int16_t b[]);
 
 // plan_line.c functions
 float mp_get_runtime_velocity(void);
 float mp_get_runtime_work_position(uint8_t axis);
 float mp_get_runtime_absolute_position(uint8_t axis);
-void mp_set_runtime_work_offset(float offset[]);
+void mp_set_runtime_work_offset_set(uint8_t set);
+uint8_t mp_get_runtime_work_offset_set(void);
+uint8_t mp_get_runtime_modal_set(void);
 void mp_zero_segment_velocity(void);
 uint8_t mp_get_runtime_busy(void);
+void mp_plan_trapezoid(mpBuf_t *bf);
+void mp_get_trapezoid(const mpBuf_t *bf, mpBuf_t *tz);
+stat_t mp_plan_trapezoid_callback(void);
+float mp_get_planned_time(const mpBuf_t *bf);
+float mp_get_job_elapsed_time(void);
+float mp_get_job_remaining_time(void);
+void mp_end_job_time(void);
+
+// plan_jog.c functions
+stat_t mp_run_jog(cmdObj_t *cmd);
+stat_t mp_exec_jog(void) HOT_PATH;
+stat_t mp_jog_callback(void);
+uint8_t mp_jog_is_running(void);
+void mp_abort_jog(void);
+
+// plan_aux.c functions
+#ifdef __AUX_MOTION
+void mp_queue_aux(const float target[]);
+void mp_queue_aux_sync(void);
+void mp_prep_aux(float steps[], const float microseconds) HOT_PATH;
+stat_t mp_exec_aux(void) HOT_PATH;
+void mp_set_aux_frame(const mpBuf_t *bf) HOT_PATH;
+uint8_t mp_aux_is_running(void);
+void mp_abort_aux(void);
+float mp_get_aux_position(const uint8_t axis);
+void mp_set_aux_position(const uint8_t axis, const float position);
+stat_t mp_set_as(cmdObj_t *cmd);
+#ifdef __TEXT_MODE
+	void mp_print_as(cmdObj_t *cmd);
+#else
+	#define mp_print_as tx_print_stub
+#endif
+#define AUX_AXIS(axis) (cm.a[axis].async == true)
+#define AUX_QUEUE(target) mp_queue_aux(target)
+#define AUX_SYNC() mp_queue_aux_sync()
+#define AUX_PREP(steps, usec) mp_prep_aux(steps, usec)
+#define AUX_EXEC() mp_exec_aux()
+#define AUX_FRAME(bf) mp_set_aux_frame(bf)
+#else
+#define AUX_AXIS(axis) (false)
+#define AUX_QUEUE(target)
+#define AUX_SYNC()
+#define AUX_PREP(steps, usec)
+#define AUX_EXEC() (STAT_NOOP)
+#define AUX_FRAME(bf)
+#endif
+
+// plan_thread.c functions
+#ifdef __SPINDLE_SYNC
+stat_t mp_spindle_sync(GCodeState_t *gm_in, const float pitch);
+#endif
 
 #ifdef __DEBUG
 void mp_dump_running_plan_buffer(void);
-void mp_dump_plan_buffer_by_index(uint8_t index);
+void mp_dump_plan_buffer_by_index(mpBufCount_t index);
 void mp_dump_runtime_state(void);
 #endif
 
@@ -103,4 +103,4 @@ VARIANT=arduino_due_x
 CFLAGS   += -D__$(CHIP)__ -D$(VARIANT)
 CPPFLAGS += -D__$(CHIP)__ -D$(VARIANT)
 
-ASFLAGS  += -mcpu=cortex-m3 -mthumb 
+ASFLAGS  += $(CPU_FLAGS) 
@@ -116,7 +116,7 @@ extern int _read(int file, char *ptr, int len)
 
 extern int _write( int file, char *ptr, int len )
 {
-	return SerialUSB.write((const uint8_t *)ptr, len);
+	return write((uint8_t *)ptr, len);		// xio write() - goes to the current output port
 
 /*
     int iIndex ;
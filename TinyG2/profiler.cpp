@@ -0,0 +1,131 @@
+/*
+ * profiler.cpp - main loop and interrupt latency profiler
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See profiler.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "profiler.h"
+
+#ifdef __PROFILER
+
+#include "hardware.h"				// DWT cycle counter
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+pfSingleton_t pf;
+
+/*
+ * pf_init()  - start the DWT cycle counter and clear all profile points
+ * pf_reset() - clear all profile points
+ */
+
+void pf_init()
+{
+	hw_start_cycle_counter();
+	pf_reset();
+}
+
+void pf_reset()
+{
+	for (uint8_t i=0; i<PF_COUNT; i++) {
+		pf.point[i].count = 0;
+		pf.point[i].min = 0xFFFFFFFF;
+		pf.point[i].max = 0;
+		pf.point[i].total = 0;
+	}
+}
+
+/*
+ * pf_get_cycles() - return the free-running DWT cycle counter
+ * pf_record()	   - record one sample that started at <start> cycles
+ *
+ *	Each point is only recorded from one context (the main loop or one interrupt),
+ *	so pf_record() does not need to be atomic. The counter wraps every ~51 seconds
+ *	at 84 MHz - the unsigned subtraction handles the wrap.
+ */
+
+uint32_t pf_get_cycles() { return (HW_DWT_CYCCNT);}
+
+void pf_record(uint8_t point, uint32_t start)
+{
+	uint32_t cycles = HW_DWT_CYCCNT - start;
+	pfPointStats_t *p = &pf.point[point];
+
+	p->count++;
+	p->total += cycles;
+	if (cycles < p->min) p->min = cycles;
+	if (cycles > p->max) p->max = cycles;
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * pf_get_point() - return a profile point as [count,min,avg,max] in cycles
+ * pf_run_reset() - reset all profile points
+ *
+ *	The cfgArray target is the pfPointStats_t for the point. The stats are copied
+ *	with interrupts off so an ISR point can't change half way through the read.
+ */
+
+stat_t pf_get_point(cmdObj_t *cmd)
+{
+	pfPointStats_t p;
+	char_t buf[48];
+
+	__disable_irq();
+	p = *((pfPointStats_t *)GET_TABLE_WORD(target));
+	__enable_irq();
+
+	if (p.count == 0) { p.min = 0;}
+	sprintf((char *)buf, "%lu,%lu,%lu,%lu", (unsigned long)p.count, (unsigned long)p.min,
+		(unsigned long)((p.count == 0) ? 0 : (p.total / p.count)), (unsigned long)p.max);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+stat_t pf_run_reset(cmdObj_t *cmd)
+{
+	pf_reset();
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_pf[] PROGMEM = "[%s%s] %s cycles [count,min,avg,max]\n";
+
+void pf_print_point(cmdObj_t *cmd) { fprintf_P(stderr, fmt_pf, cmd->group, cmd->token, *cmd->stringp);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PROFILER
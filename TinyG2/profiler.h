@@ -0,0 +1,134 @@
+/*
+ * profiler.h - main loop and interrupt latency profiler
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The profiler is enabled by __PROFILER in tinyg2.h. When enabled every task the
+ * controller dispatches, the whole controller pass, and the DDA, exec, load, dwell
+ * and switch interrupts are timed with the Cortex-M3 DWT cycle counter (F_CPU ticks per
+ * second). Each profile point keeps a count and the min, total and max cycles.
+ *
+ * Read the results with {"pf":""} - each point is reported as [count,min,avg,max]
+ * in cycles. {"pfr":1} resets all points. Times for an interrupt include any
+ * higher priority interrupts that preempted it, and a sample that is in flight
+ * during a reset may be recorded against the new counts.
+ *
+ * When __PROFILER is not defined the macros compile to the plain function calls.
+ */
+
+#ifndef PROFILER_H_ONCE
+#define PROFILER_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __PROFILER
+
+enum pfPoint {						// profile points - must agree with the "pf" group in cfgArray
+	PF_HSM = 0,						// one complete pass of _controller_HSM()
+	PF_HARD_RESET,					// controller tasks in dispatch order...
+	PF_EXCEPTION,
+	PF_ALARM,
+	PF_LIMIT,
+	PF_RX,
+	PF_TX,
+	PF_FEEDHOLD,
+	PF_PLAN_HOLD,
+	PF_PLAN_OVERRIDE,
+	PF_PLAN_TRAPEZOID,
+	PF_ASSERTIONS,
+	PF_MOTOR_POWER,
+	PF_SPINDLE,
+	PF_CHECKPOINT,
+	PF_LOAD_FEED,
+	PF_MOTOR_DRIVERS,
+	PF_STATUS_REPORT,
+	PF_QUEUE_REPORT,
+	PF_JOB_REPORT,
+	PF_PLAN_DUMP,
+	PF_LINE_EVENT,
+	PF_COALESCE,
+	PF_ARC,
+	PF_CANNED_CYCLE,
+	PF_SPLINE,
+	PF_JOG,
+	PF_STRESS,
+	PF_REPLAY,
+	PF_SELF_BENCH,
+	PF_HOMING,
+	PF_PROBE,
+	PF_PERSISTENCE,
+	PF_SYNC_TX,
+	PF_GCODE_QUEUE,
+	PF_BINARY_STREAM,
+	PF_COMMAND,
+	PF_IDLER,
+	PF_DDA_ISR,						// interrupts
+	PF_EXEC_ISR,
+	PF_LOAD_ISR,
+	PF_DWELL_ISR,
+	PF_SWITCH_ISR,					// PIO change interrupts for the axis switches
+	PF_COUNT						// must be last
+};
+
+typedef struct pfPointStats {
+	uint32_t count;					// samples recorded
+	uint32_t min;					// shortest sample (cycles)
+	uint32_t max;					// longest sample (cycles)
+	uint64_t total;					// sum of all samples (cycles)
+} pfPointStats_t;
+
+typedef struct pfSingleton {
+	pfPointStats_t point[PF_COUNT];
+} pfSingleton_t;
+
+extern pfSingleton_t pf;
+
+void pf_init(void);
+void pf_reset(void);
+uint32_t pf_get_cycles(void);
+void pf_record(uint8_t point, uint32_t start);
+
+stat_t pf_get_point(cmdObj_t *cmd);
+stat_t pf_run_reset(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void pf_print_point(cmdObj_t *cmd);
+#else
+	#define pf_print_point tx_print_stub
+#endif
+
+// PROFILE() evaluates to the value returned by func, so it can be used inside DISPATCH()
+#define PROFILE(point,func) ({ uint32_t _pf_start = pf_get_cycles(); stat_t _pf_status = func;\
+							   pf_record(point, _pf_start); _pf_status; })
+#define PROFILE_START uint32_t _pf_start = pf_get_cycles();
+#define PROFILE_END(point) pf_record(point, _pf_start);
+
+#else
+
+#define PROFILE(point,func) (func)
+#define PROFILE_START
+#define PROFILE_END(point)
+
+#endif // __PROFILER
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: PROFILER_H_ONCE
@@ -0,0 +1,291 @@
+/*
+ * program_store.cpp - Gcode programs stored in flash and run from memory
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See program_store.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "controller.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "gcode_macro.h"
+#include "persistence.h"
+#include "util.h"
+#include "xio.h"
+#include "program_store.h"
+#include "replay.h"
+
+#ifdef __PROGRAM_STORE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+pgSingleton_t pg;
+
+#define _header() ((const pgHeader_t *)PG_FLASH_ADDR)
+#define _program() ((const uint8_t *)PG_PROGRAM_ADDR)
+
+static stat_t _store_line(void);
+static stat_t _store_bytes(const uint8_t *data, const uint16_t count);
+static stat_t _flush_page(void);
+static stat_t _write_header(const uint32_t magic);
+
+/*
+ * pg_init() - find the stored program, if any
+ */
+void pg_init(void)
+{
+	const pgHeader_t *h = _header();
+	pg.state = PG_EMPTY;
+	pg.length = 0;
+	if ((h->magic == PG_MAGIC) && (h->check == ~h->length) && (h->length <= PG_PROGRAM_MAX)) {
+		pg.state = PG_STORED;
+		pg.length = h->length;
+	}
+}
+
+/*
+ * pg_load_begin()	- start an upload - the stored program is discarded
+ * pg_load_data()	- add the next bytes of the program text
+ * pg_load_end()	- check the upload and keep the program if it is good
+ *
+ *	Text is collected a line at a time and each line is stored as it ends (see
+ *	_store_line()). The store is assembled a page at a time in pg.page and programmed 
+ *	as each page fills. The header is cleared first and written last, so the store 
+ *	never holds a header for a program that was not completely written.
+ */
+stat_t pg_load_begin(void)
+{
+	if ((pg.state == PG_RUNNING) || (cm_get_runtime_busy() == true)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	pg.state = PG_EMPTY;
+	pg.length = 0;
+	pg.stored_sum = 0;
+	pg.received = 0;
+	pg.checksum = 0;
+	pg.linelen = 0;
+	pg.nesting = 0;
+	memset(pg.token_last, 0, sizeof(pg.token_last));
+	ritorno(_write_header(0));
+	pg.state = PG_LOADING;
+	return (STAT_OK);
+}
+
+stat_t pg_load_data(const uint32_t offset, const uint8_t *data, const uint8_t count)
+{
+	if (pg.state != PG_LOADING) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	if (offset != pg.received) { return (STAT_INPUT_VALUE_RANGE_ERROR);}	// a frame was lost
+
+	stat_t status = STAT_OK;
+	for (uint8_t i=0; (i<count) && (status == STAT_OK); i++) {
+		char_t c = (char_t)data[i];
+		pg.received++;
+		pg.checksum += data[i];
+		if ((c == LF) || (c == CR)) {
+			status = _store_line();
+		} else if (pg.linelen >= (INPUT_BUFFER_LEN-1)) {
+			status = STAT_INPUT_EXCEEDS_MAX_LENGTH;
+		} else {
+			pg.line[pg.linelen++] = c;
+		}
+	}
+	if (status != STAT_OK) { pg.state = PG_EMPTY;}		// the upload can't be completed
+	return (status);
+}
+
+stat_t pg_load_end(const uint32_t length, const uint32_t checksum)
+{
+	if (pg.state != PG_LOADING) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	pg.state = PG_EMPTY;
+	ritorno(_store_line());												// a last line with no line end
+	if ((pg.length % PG_PAGE_SIZE) != 0) { ritorno(_flush_page());}	// the partial last page
+	if ((length != pg.received) || (checksum != pg.checksum)) { return (STAT_CHECKSUM_MATCH_FAILED);}
+
+	uint32_t sum = 0;									// read back what was programmed
+	for (uint32_t i=0; i<pg.length; i++) { sum += _program()[i];}
+	if (sum != pg.stored_sum) { return (STAT_CHECKSUM_MATCH_FAILED);}
+
+	ritorno(_write_header(PG_MAGIC));
+	pg.state = PG_STORED;
+	return (STAT_OK);
+}
+
+/*
+ * _store_line() - store the line received as a token block, or as text
+ *
+ *	The lines of a subroutine or loop body and its O-word lines are stored as text, as
+ *	the macro buffer keeps lines as text (see gcode_macro.h).
+ */
+static stat_t _store_line()
+{
+	if (pg.linelen == 0) { return (STAT_OK);}			// blank line, or the LF of a CR LF
+	pg.line[pg.linelen] = NUL;
+	uint16_t length = pg.linelen;
+	pg.linelen = 0;
+
+	if (GC_IS_TOKEN_BLOCK(pg.line)) { return (STAT_INPUT_VALUE_UNSUPPORTED);}	// would read as tokens
+	uint8_t tokenize = controller_is_gcode_line(pg.line);
+#ifdef __GCODE_MACROS
+	int8_t change = mc_get_nesting(pg.line);			// macro bodies are kept as text
+	if ((pg.nesting != 0) || (change != 0)) { tokenize = false;}
+	pg.nesting += change;
+#endif
+	if (tokenize == true) {
+		stat_t status = gc_tokenize_block(pg.line, pg.tokens, pg.token_last);
+		if (status == STAT_NOOP) { return (STAT_OK);}	// nothing to run
+		if (status == STAT_OK) { return (_store_bytes(pg.tokens, GC_TOKEN_HEADER_LEN + pg.tokens[1]));}
+	}
+	pg.line[length] = LF;
+	return (_store_bytes((uint8_t *)pg.line, length+1));
+}
+
+/*
+ * _store_bytes() - add bytes to the store, programming each page as it fills
+ */
+static stat_t _store_bytes(const uint8_t *data, const uint16_t count)
+{
+	if ((pg.length + count) > PG_PROGRAM_MAX) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+
+	uint8_t *page = (uint8_t *)pg.page;
+	for (uint16_t i=0; i<count; i++) {
+		page[pg.length % PG_PAGE_SIZE] = data[i];
+		pg.stored_sum += data[i];
+		if ((++pg.length % PG_PAGE_SIZE) == 0) { ritorno(_flush_page());}
+	}
+	return (STAT_OK);
+}
+
+/*
+ * _flush_page() - program the page that holds the last byte stored
+ *
+ *	A partial page is padded with LFs, which read as blank lines if they are ever read.
+ */
+static stat_t _flush_page()
+{
+	uint32_t page_start = ((pg.length - 1) / PG_PAGE_SIZE) * PG_PAGE_SIZE;
+	uint8_t *page = (uint8_t *)pg.page;
+	for (uint32_t i = pg.length - page_start; i < PG_PAGE_SIZE; i++) { page[i] = LF;}
+	return (write_flash_page(PG_PROGRAM_ADDR + page_start, pg.page));
+}
+
+static stat_t _write_header(const uint32_t magic)
+{
+	memset(pg.page, 0, sizeof(pg.page));
+	pgHeader_t *h = (pgHeader_t *)pg.page;
+	h->magic = magic;
+	h->length = pg.length;
+	h->checksum = pg.stored_sum;
+	h->check = ~pg.length;
+	return (write_flash_page(PG_FLASH_ADDR, pg.page));
+}
+
+/*
+ * pg_read_line() - read the next line of the running program - for _command_dispatch()
+ *
+ *	Same line rules as read_line() for text lines. The text is always there, so a line
+ *	is complete in one call unless it is too long for the buffer. A token block is
+ *	returned as it is - it is not NUL terminated (see gcode_parser.h). At the end of
+ *	the program the run ends and STAT_EOF is returned.
+ */
+stat_t pg_read_line(uint8_t *buffer, uint16_t *index, size_t size)
+{
+	if (pg.state != PG_RUNNING) { return (STAT_EOF);}
+	if (*index >= size) { return (STAT_FILE_SIZE_EXCEEDED);}
+
+	if ((*index == 0) && (pg.read < pg.length) && (GC_IS_TOKEN_BLOCK(&_program()[pg.read]))) {
+		uint16_t length = GC_TOKEN_HEADER_LEN + _program()[pg.read+1];
+		if (length > size) { return (STAT_BUFFER_FULL);}
+		memcpy(buffer, &_program()[pg.read], length);
+		pg.read += length;
+		*index = length;
+		return (STAT_OK);
+	}
+
+	if (pg.read < pg.length) { RP_ABANDON();}		// text lines are not run by a replay (see replay.h)
+	while (*index < size) {
+		if (pg.read >= pg.length) {
+			if (*index != 0) {
+				buffer[*index] = NUL;
+				return (STAT_OK);
+			}
+			pg.state = PG_STORED;
+			return (STAT_EOF);
+		}
+		char_t c = _program()[pg.read++];
+		if ((c == LF) || (c == CR)) {
+			buffer[*index] = NUL;
+			return (STAT_OK);
+		}
+		buffer[(*index)++] = c;
+	}
+	return (STAT_BUFFER_FULL);
+}
+
+/*
+ * pg_stop() - end a run - OK to call if no program is running
+ */
+void pg_stop()
+{
+	if (pg.state == PG_RUNNING) { pg.state = PG_STORED;}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+stat_t pg_run_pgr(cmdObj_t *cmd)			// 1 = run the stored program, 0 = stop it
+{
+	if (fp_ZERO(cmd->value)) {
+		pg_stop();
+		RP_STOP();
+		return (STAT_OK);
+	}
+	if ((pg.state != PG_STORED) || (cm_get_machine_state() == MACHINE_ALARM) || RP_REPLAYING()) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	if (RP_START() == true) { return (STAT_OK);}	// the recording of the program replays in its place
+	pg.read = 0;
+	gc_reset_tokens();
+	pg.state = PG_RUNNING;
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_pgs[] PROGMEM = "Program store state:%15.0f [0=empty,1=stored,2=loading,3=running]\n";
+static const char fmt_pgl[] PROGMEM = "Program store length:%14.0f bytes\n";
+
+void pg_print_pgs(cmdObj_t *cmd) { text_print_flt(cmd, fmt_pgs);}
+void pg_print_pgl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_pgl);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PROGRAM_STORE
@@ -0,0 +1,137 @@
+/*
+ * program_store.h - Gcode programs stored in flash and run from memory
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The program store is enabled by __PROGRAM_STORE in tinyg2.h, and needs the binary
+ * stream (__BINARY_STREAM) for the upload. One program of up to PG_PROGRAM_MAX bytes
+ * of text is kept in the 128Kb of flash bank 1 below the NVM log - gcc_flash.ld leaves
+ * that region out of "rom" with the NVM. The program survives resets and power cycles.
+ *
+ * Upload - binary stream frames (see binary_stream.h), with the machine idle:
+ *
+ *	BS_STORE_BEGIN	no payload - discards the stored program
+ *	BS_STORE_DATA	uint32 offset, then 1 to BS_STORE_DATA_MAX bytes of the program
+ *					text. Frames must come in order - the offset is the bytes sent so far
+ *	BS_STORE_END	uint32 length, uint32 checksum (sum of the program bytes). The
+ *					program is only kept if both match what was received, and the
+ *					store reads back as written
+ *
+ * BS_STORE_END is always answered with a BS_STATUS frame carrying the length and the
+ * status code. The others are answered only if they are rejected. Each page of the
+ * store is programmed as it fills, which holds the main loop for a few ms.
+ *
+ * The text is converted line by line as it arrives. Gcode lines are stored as token
+ * blocks (see gcode_parser.h) so they are not parsed again each time the program runs,
+ * and take a half to a quarter of the space. Blank and comment-only lines are dropped. Other lines -
+ * $ settings, JSON, Gcode that does not convert (block delete, errors, macro parameters)
+ * and the lines of macro bodies - are stored as text ended by a LF. A line may be up to INPUT_BUFFER_LEN-1 characters long.
+ *
+ * Run - {"pgr":1} (or $pgr=1) starts the program from the top. The controller then
+ * reads its lines from the store in place of the serial port, as fast as the Gcode
+ * block queue takes them, until the end of the program, an error, or {"pgr":0}. A
+ * queue flush (%) also ends the run. Feedhold and cycle start work as usual. Gcode
+ * blocks from the store are not answered - only an error is reported, and it stops
+ * the program. Other lines in the program ($ settings and JSON) are answered.
+ * Serial input that arrives during the run is read once the program has ended.
+ * With __SEGMENT_REPLAY and $rpm=1 a run may replay a recording of the last one in
+ * place of reading the program (see replay.h).
+ *
+ * {"pgs":""} reads the state (0=empty, 1=stored, 2=loading, 3=running) and
+ * {"pgl":""} the bytes of store in use.
+ */
+
+#ifndef PROGRAM_STORE_H_ONCE
+#define PROGRAM_STORE_H_ONCE
+
+#include "controller.h"					// INPUT_BUFFER_LEN
+#include "gcode_parser.h"				// token blocks
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __PROGRAM_STORE
+
+#if !defined(__BINARY_STREAM)
+#error "__PROGRAM_STORE is loaded through the binary stream - enable __BINARY_STREAM"
+#endif
+
+#define PG_PAGE_SIZE IFLASH1_PAGE_SIZE	// 256 bytes
+#define PG_FLASH_SIZE (128 * 1024UL)	// header page plus the program text
+#define PG_FLASH_ADDR (NVM_FLASH_ADDR - PG_FLASH_SIZE)
+#define PG_PROGRAM_ADDR (PG_FLASH_ADDR + PG_PAGE_SIZE)
+#define PG_PROGRAM_MAX (PG_FLASH_SIZE - PG_PAGE_SIZE)	// bytes of store - text and token blocks
+#define PG_MAGIC 0x50474D31				// "PGM1"
+
+enum pgState {
+	PG_EMPTY = 0,						// no valid program in the store
+	PG_STORED,							// a program is stored and can be run
+	PG_LOADING,							// an upload is in progress
+	PG_RUNNING							// the controller is reading from the store
+};
+
+typedef struct pgHeader {				// first page of the store - written last
+	uint32_t magic;						// PG_MAGIC
+	uint32_t length;					// bytes of store in use
+	uint32_t checksum;					// sum of the stored bytes
+	uint32_t check;						// ~length - an erased or torn header fails this
+} pgHeader_t;
+
+typedef struct pgSingleton {
+	uint8_t state;						// $pgs - see pgState
+	uint32_t length;					// $pgl - bytes of store in use, or stored so far
+	uint32_t stored_sum;				// sum of the bytes stored
+	uint32_t received;					// bytes of text received by the upload
+	uint32_t checksum;					// sum of the bytes received
+	uint32_t read;						// next byte to read while running
+	uint16_t linelen;					// characters in line
+	int8_t nesting;						// macro bodies open at the line - see _store_line()
+	char_t line[INPUT_BUFFER_LEN];		// line being received
+	uint8_t tokens[INPUT_BUFFER_LEN];	// token block of the line
+	int32_t token_last[GC_TOKEN_LETTERS];	// token encoder state - see gc_tokenize_block()
+	uint32_t page[PG_PAGE_SIZE / sizeof(uint32_t)];	// page being assembled for programming
+} pgSingleton_t;
+
+extern pgSingleton_t pg;
+
+void pg_init(void);
+stat_t pg_load_begin(void);
+stat_t pg_load_data(const uint32_t offset, const uint8_t *data, const uint8_t count);
+stat_t pg_load_end(const uint32_t length, const uint32_t checksum);
+stat_t pg_read_line(uint8_t *buffer, uint16_t *index, size_t size);
+void pg_stop(void);
+
+stat_t pg_run_pgr(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void pg_print_pgs(cmdObj_t *cmd);
+	void pg_print_pgl(cmdObj_t *cmd);
+#else
+	#define pg_print_pgs tx_print_stub
+	#define pg_print_pgl tx_print_stub
+#endif
+
+#define PG_IS_RUNNING() (pg.state == PG_RUNNING)
+
+#endif // __PROGRAM_STORE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: PROGRAM_STORE_H_ONCE
@@ -0,0 +1,281 @@
+/*
+ * pso.cpp - position synchronized outputs fired by the DDA
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See pso.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "stepper.h"
+#include "hardware.h"
+#include "util.h"
+#include "xio.h"
+#include "pso.h"
+
+#ifdef __PSO
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+psSingleton_t ps;
+
+static Motate::OutputPin<pso_1_pin_num> pso_1_pin;
+static Motate::OutputPin<pso_2_pin_num> pso_2_pin;
+
+static void _set_output(uint8_t output, uint8_t state);
+static void _fire_event(psEvent_t *e);
+
+#define _next_event(i) (((i) + 1) % PSO_EVENTS)
+static const char axis_letters[] = "XYZABC";
+
+/*
+ * ps_reset() - discard all events and end any pulse
+ *
+ *	Called from mp_flush_planner(). Outputs that were turned on stay on, as they
+ *	would after an M-code - only pulses are ended.
+ */
+void ps_reset()
+{
+	ps.armed = 0;
+	ps.head = 0;
+	ps.prep = 0;
+	ps.tail = 0;
+	ps_idle();
+}
+
+/*
+ * ps_events_available() - events free to fill
+ */
+uint8_t ps_events_available()
+{
+	return ((ps.tail + PSO_EVENTS - ps.head - 1) % PSO_EVENTS);
+}
+
+/*
+ * ps_run_event() - parse an event and queue it for the DDA
+ *
+ *	The position is taken in the Gcode model's units and work coordinates, as for an
+ *	axis word, and kept as a step count of machine position.
+ */
+stat_t ps_run_event(cmdObj_t *cmd)
+{
+	if (cmd->objtype != TYPE_STRING) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	const char *src = (const char *)*cmd->stringp;
+	char_t *letter = (*src != NUL) ? strchr(axis_letters, toupper(*src)) : NULL;
+	if (letter == NULL) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	uint8_t axis = (uint8_t)((char *)letter - axis_letters);
+
+	char *end;
+	float position = strtof(src+1, &end);
+	if (end == src+1) { return (STAT_BAD_NUMBER_FORMAT);}
+	src = end;
+	long output = strtol(src, &end, 10);
+	if (end == src) { return (STAT_BAD_NUMBER_FORMAT);}
+	src = end;
+	long action = strtol(src, &end, 10);
+	if (end == src) { return (STAT_BAD_NUMBER_FORMAT);}
+	if ((output < 1) || (output > PSO_OUTPUTS) || (action < 0) || (action >= PSO_ACTIONS)) {
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	if (ps_events_available() == 0) { return (STAT_BUFFER_FULL);}	// PSO_HOLD() should prevent this
+
+	uint8_t motor = MOTORS;
+	for (uint8_t m=0; m<MOTORS; m++) {
+		if (st.m[m].motor_map == axis) { motor = m; break;}
+	}
+	if (motor == MOTORS) { return (STAT_INPUT_VALUE_UNSUPPORTED);}	// no motor drives the axis
+
+	if ((gmx.modal.units_mode == INCHES) && (axis < AXIS_A)) { position *= MM_PER_INCH;}
+	position += cm_get_active_coord_offset(axis);
+
+	psEvent_t *e = &ps.event[ps.head];
+	e->axis = axis;
+	e->output = (uint8_t)(output - 1);
+	e->action = (uint8_t)action;
+	e->steps_per_unit = st.m[motor].steps_per_unit;
+	e->position = (int32_t)lrintf(position * e->steps_per_unit);
+	ps.head = _next_event(ps.head);
+
+	cmd->value = PSO_EVENTS - 1 - ps_events_available();	// report the events waiting
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+/*
+ * ps_prep_segment() - schedule the events a prepared segment crosses
+ *
+ *	Called by the exec after st_prep_line() with the axis positions the segment runs
+ *	between (see PSO_PREP()). Each crossed event gets the tick of its segment at which
+ *	the axis reaches its step count. An event on the end of one segment fires with it,
+ *	and one the axis stands on fires on the first tick of the move off it.
+ */
+void ps_prep_segment(const float start[], const float end[])
+{
+	uint32_t dda_ticks = st_get_prep_segment()->dda_ticks;
+	uint8_t events = 0;
+
+	while ((ps.prep != ps.head) && (events < 255)) {
+		psEvent_t *e = &ps.event[ps.prep];
+		float from = start[e->axis] * e->steps_per_unit;
+		float to = end[e->axis] * e->steps_per_unit;
+		float position = (float)e->position;
+		float travel = to - from;
+
+		if (fp_ZERO(travel)) { break;}
+		if (travel > 0) {
+			if ((position < from) || (position > to)) { break;}
+		} else {
+			if ((position > from) || (position < to)) { break;}
+		}
+		uint32_t tick = (uint32_t)ceil((position - from) / travel * dda_ticks);
+		e->tick = min(max(tick, (uint32_t)1), dda_ticks);
+		ps.prep = _next_event(ps.prep);
+		events++;
+	}
+	st_prep_pso(events);
+}
+
+/*
+ * ps_load_segment() - arm the events of a segment as it loads
+ *
+ *	Called from _load_move() in the loader interrupt, just before the DDA starts the
+ *	segment. Events of the previous segment that have not fired (the segment ended on
+ *	a rounding remainder, under a tick early) are fired now.
+ */
+void ps_load_segment(uint8_t events)
+{
+	while (ps.armed != 0) {
+		_fire_event(&ps.event[ps.tail]);
+		ps.tail = _next_event(ps.tail);
+		ps.armed--;
+	}
+	ps.ticks = 0;
+	ps.armed = events;
+}
+
+/*
+ * ps_tick() - run the pulses and fire the events due on this DDA tick
+ *
+ *	Called from the DDA interrupt after the motors have stepped (see PSO_TICK()).
+ *	Pulses are counted down before the events fire, so a pulse started on this tick
+ *	runs its full width.
+ */
+void ps_tick()
+{
+	if (ps.pulsing == true) {
+		ps.pulsing = false;
+		uint32_t ticks = 1 << st_get_dda_clock_shift();	// pulses are timed in FREQUENCY_DDA ticks
+		for (uint8_t output=0; output<PSO_OUTPUTS; output++) {
+			if (ps.pulse_downcount[output] == 0) { continue;}
+			if (ps.pulse_downcount[output] <= ticks) {
+				ps.pulse_downcount[output] = 0;
+				_set_output(output, false);
+			} else {
+				ps.pulse_downcount[output] -= ticks;
+				ps.pulsing = true;
+			}
+		}
+	}
+	if (ps.armed == 0) { return;}
+	ps.ticks++;
+	while ((ps.armed != 0) && (ps.ticks >= ps.event[ps.tail].tick)) {
+		_fire_event(&ps.event[ps.tail]);
+		ps.tail = _next_event(ps.tail);
+		ps.armed--;
+	}
+}
+
+/*
+ * ps_idle() - end the pulses when the DDA stops
+ *
+ *	Called from _load_move() when no segment is prepared, as nothing times the
+ *	pulses while the DDA timer is stopped.
+ */
+void ps_idle()
+{
+	ps.pulsing = false;
+	for (uint8_t output=0; output<PSO_OUTPUTS; output++) {
+		if (ps.pulse_downcount[output] != 0) {
+			ps.pulse_downcount[output] = 0;
+			_set_output(output, false);
+		}
+	}
+}
+
+/*
+ * _fire_event() - carry out the action of an event
+ * _set_output() - set an output pin
+ */
+static void _fire_event(psEvent_t *e)
+{
+	if (e->action == PSO_PULSE) {
+		_set_output(e->output, true);
+		ps.pulse_downcount[e->output] = ps.pulse_ticks;
+		ps.pulsing = true;
+	} else {
+		ps.pulse_downcount[e->output] = 0;			// a level ends a pulse in progress
+		_set_output(e->output, (e->action == PSO_ON));
+	}
+}
+
+static void _set_output(uint8_t output, uint8_t state)
+{
+	if (output == 0) {
+		if (state == true) { pso_1_pin.set();} else { pso_1_pin.clear();}
+	} else {
+		if (state == true) { pso_2_pin.set();} else { pso_2_pin.clear();}
+	}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * ps_set_psw() - set the pulse width, at least one DDA tick
+ */
+stat_t ps_set_psw(cmdObj_t *cmd)
+{
+	if (cmd->value < 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_flt(cmd);
+	ps.pulse_ticks = (uint32_t)(ps.pulse_width * FREQUENCY_DDA / 1000000 + 0.5);
+	if (ps.pulse_ticks == 0) { ps.pulse_ticks = 1;}
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_psw[] PROGMEM = "[psw] pso pulse width%18.0f uSec\n";
+
+void ps_print_psw(cmdObj_t *cmd) { text_print_flt(cmd, fmt_psw);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __PSO
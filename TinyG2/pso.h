@@ -0,0 +1,132 @@
+/*
+ * pso.h - position synchronized outputs fired by the DDA
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Position synchronized outputs (PSO) are enabled by __PSO in tinyg2.h. An event sets
+ * an output as an axis crosses a position, timed by the DDA so it fires at full speed
+ * without splitting the moves around it:
+ *
+ *	{"pso":"X12.5 1 2"}	pulse output 1 as X crosses 12.5
+ *
+ * The fields are the axis letter and position (in the current units and work
+ * coordinates, like a Gcode word), the output (1 or 2) and the action: 0=off, 1=on,
+ * 2=pulse. A pulse turns the output on for $psw microseconds. The command returns the
+ * events waiting to fire. Queue the events before or along with the moves that cross
+ * them - a dispense valve (on, then off) or a camera trigger (pulse) every so far.
+ *
+ * Events are kept in a ring of PSO_EVENTS and fire in the order they were queued, in
+ * either direction of travel. The position is converted to a step count of the first
+ * motor mapped to the axis. As the exec prepares each segment it tests the next
+ * events against the step counts at the start and end of the segment, and each one
+ * crossed is given the DDA tick at which the segment crosses it (ps_prep_segment()).
+ * When the segment loads the DDA counts its ticks and fires the events at theirs
+ * (PSO_TICK()), so an output lands within a DDA tick of its position at any
+ * velocity, including the ramps of a feedhold. An event that is never crossed holds
+ * the events behind it.
+ *
+ * When the ring is full the controller holds the next pso line in the input buffer
+ * (PSO_HOLD()), so the host streams events with normal flow control. The ring is
+ * emptied when the planner is flushed. Pulses in progress end when the steppers run
+ * out of moves, as the DDA no longer times them.
+ *
+ * Events assume cartesian kinematics, and the ticks assume constant velocity within
+ * a segment (with __DDA_RAMPING they may fire a few ticks early or late).
+ */
+
+#ifndef PSO_H_ONCE
+#define PSO_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+enum psAction {							// action of an event
+	PSO_OFF = 0,						// turn the output off
+	PSO_ON,								// turn the output on
+	PSO_PULSE,							// turn the output on for $psw microseconds
+	PSO_ACTIONS
+};
+
+#ifdef __PSO
+
+#define PSO_EVENTS			32			// events held for the DDA
+#define PSO_OUTPUTS			2			// outputs 1 and 2 - see hardware.h
+
+typedef struct psEvent {				// one position compare event
+	uint8_t axis;						// axis that crosses the position
+	uint8_t output;						// output to set - 0 or 1
+	uint8_t action;						// see psAction
+	float steps_per_unit;				// of the motor driving the axis
+	int32_t position;					// step count of the axis at the event (machine position)
+	uint32_t tick;						// DDA tick of its segment at which it fires (set by the exec)
+} psEvent_t;
+
+typedef struct psSingleton {
+	float pulse_width;					// $psw - pulse width in microseconds
+	uint32_t pulse_ticks;				// pulse width in DDA ticks
+
+	volatile uint8_t head;				// next event to fill (written by ps_run_event() only)
+	volatile uint8_t prep;				// next event to schedule (written by the exec only)
+	volatile uint8_t tail;				// next event to fire (written by the DDA only)
+	volatile uint8_t armed;				// events of the running segment still to fire
+	volatile uint8_t pulsing;			// TRUE while a pulse is running
+	uint32_t ticks;						// DDA ticks into the running segment
+	uint32_t pulse_downcount[PSO_OUTPUTS];	// FREQUENCY_DDA ticks left of each output's pulse
+	psEvent_t event[PSO_EVENTS];
+} psSingleton_t;
+
+extern psSingleton_t ps;
+
+void ps_reset(void);
+uint8_t ps_events_available(void);
+void ps_prep_segment(const float start[], const float end[]) HOT_PATH;
+void ps_load_segment(uint8_t events) HOT_PATH;
+void ps_tick(void) HOT_PATH;
+void ps_idle(void);
+
+stat_t ps_run_event(cmdObj_t *cmd);
+stat_t ps_set_psw(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void ps_print_psw(cmdObj_t *cmd);
+#else
+	#define ps_print_psw tx_print_stub
+#endif
+
+// PSO_TICK() costs one test in the DDA interrupt when no event or pulse is running
+#define PSO_PREP(start, end) if (ps.prep != ps.head) { ps_prep_segment(start, end);}
+#define PSO_TICK() if ((ps.armed | ps.pulsing) != 0) { ps_tick();}
+#define PSO_IDLE() if (ps.pulsing == true) { ps_idle();}
+#define PSO_HOLD(line) ((ps_events_available() == 0) && (strstr((char *)line, "pso") != NULL))
+#define PSO_BUSY() (((ps.armed | ps.pulsing) != 0) || (ps.tail != ps.head))
+
+#else
+
+#define PSO_PREP(start, end)
+#define PSO_TICK()
+#define PSO_IDLE()
+#define PSO_HOLD(line) (false)
+#define PSO_BUSY() (false)
+
+#endif // __PSO
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: PSO_H_ONCE
@@ -183,6 +183,24 @@ stat_t pwm_set_duty(uint8_t chan, float duty)
 	return (STAT_OK);
 }
 
+/*
+ * pwm_set_vref() - set the Vref PWM duty that sets a motor's driver current
+ *
+ *	motor	- motor number (MOTOR_1...)
+ *	level	- fraction of full driver current [0..1]
+ *
+ *	The Vref pins are in hardware.h. Like the spindle channel the Due timer setup 
+ *	is not written yet, so the level is range checked and the duty is left for the
+ *	timer code. Called from st_set_motor_power() only when the level changes.
+ */
+
+stat_t pwm_set_vref(uint8_t motor, float level)
+{
+	if (level < 0.0) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (level > 1.0) { return (STAT_INPUT_VALUE_TOO_LARGE);}
+	return (STAT_OK);
+}
+
 
 /***********************************************************************************
  * CONFIGURATION AND INTERFACE FUNCTIONS
@@ -209,6 +227,8 @@ static const char fmt_p1wsh[] PROGMEM = "[p1wsh] pwm ccw speed hi%15.3f RPM\n";
 static const char fmt_p1wpl[] PROGMEM = "[p1wpl] pwm ccw phase lo%15.3f [0..1]\n";
 static const char fmt_p1wph[] PROGMEM = "[p1wph] pwm ccw phase hi%15.3f [0..1]\n";
 static const char fmt_p1pof[] PROGMEM = "[p1pof] pwm phase off   %15.3f [0..1]\n";
+static const char fmt_p1lm[] PROGMEM = "[p1lm]  pwm laser mode  %12d [0=off,1=scale with velocity]\n";
+static const char fmt_p1acc[] PROGMEM = "[p1acc] spindle accel   %15.3f RPM/sec [0=no wait]\n";
 
 void pwm_print_p1frq(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1frq);}
 void pwm_print_p1csl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1csl);}
@@ -220,6 +240,8 @@ void pwm_print_p1wsh(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1wsh);}
 void pwm_print_p1wpl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1wpl);}
 void pwm_print_p1wph(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1wph);}
 void pwm_print_p1pof(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1pof);}
+void pwm_print_p1lm(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_p1lm);}
+void pwm_print_p1acc(cmdObj_t *cmd) { text_print_flt(cmd, fmt_p1acc);}
 
 #endif //__TEXT_MODE 
 
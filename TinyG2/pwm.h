@@ -43,6 +43,8 @@ typedef struct pwmConfigChannel {
 	float ccw_phase_lo;				// pwm phase at minimum CCW spindle speed, clamped [0..1]
 	float ccw_phase_hi;				// pwm phase at maximum CCW spindle speed, clamped
 	float phase_off;				// pwm phase when spindle is disabled
+	uint8_t laser_mode;				// 1 = scale the phase with velocity every segment (see spindle.cpp)
+	float spindle_accel;			// RPM per second for the spindle-at-speed estimate, 0 = instant
 } pwmConfigChannel_t;
 
 typedef struct pwmChannel {
@@ -62,6 +64,7 @@ extern pwmSingleton_t pwm;
 void pwm_init(void);
 stat_t pwm_set_freq(uint8_t channel, float freq);
 stat_t pwm_set_duty(uint8_t channel, float duty);
+stat_t pwm_set_vref(uint8_t motor, float level);
 
 #ifdef __TEXT_MODE
 
@@ -75,6 +78,8 @@ stat_t pwm_set_duty(uint8_t channel, float duty);
 	void pwm_print_p1wpl(cmdObj_t *cmd);
 	void pwm_print_p1wph(cmdObj_t *cmd);
 	void pwm_print_p1pof(cmdObj_t *cmd);
+	void pwm_print_p1lm(cmdObj_t *cmd);
+	void pwm_print_p1acc(cmdObj_t *cmd);
 
 #else
 
@@ -88,6 +93,8 @@ stat_t pwm_set_duty(uint8_t channel, float duty);
 	#define pwm_print_p1wpl tx_print_stub
 	#define pwm_print_p1wph tx_print_stub
 	#define pwm_print_p1pof tx_print_stub
+	#define pwm_print_p1lm tx_print_stub
+	#define pwm_print_p1acc tx_print_stub
 
 #endif // __TEXT_MODE
 
@@ -0,0 +1,247 @@
+/*
+ * raster.cpp - raster engraving with step synchronised laser intensity
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See raster.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "stepper.h"
+#include "pwm.h"
+#include "util.h"
+#include "xio.h"
+#include "raster.h"
+
+#ifdef __RASTER
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+rsSingleton_t rs;
+
+
+#define _next_row(i) (((i) + 1) % RASTER_ROWS)
+
+/*
+ * rs_reset() - discard all rows and turn the laser off if a row was being burned
+ *
+ *	Called from mp_flush_planner(). The phase is only touched if a row is active so a
+ *	flush during ordinary spindle work (e.g. homing) leaves the spindle alone.
+ */
+void rs_reset()
+{
+	if (rs.active == true) {
+		rs.active = false;
+		pwm_set_duty(PWM_1, rs.row[rs.tail].phase_off);
+	}
+	rs.head = 0;
+	rs.tail = 0;
+}
+
+/*
+ * rs_rows_available() - rows free to fill
+ */
+uint8_t rs_rows_available()
+{
+	return ((rs.tail + RASTER_ROWS - rs.head - 1) % RASTER_ROWS);
+}
+
+/*
+ * rs_run_row() - decode a row and queue its lead-in, row and lead-out moves
+ *
+ *	The moves are run in millimeters and incremental mode at the sweep velocity. The
+ *	Gcode model units, distance mode and feed rate are restored afterwards, as in
+ *	the homing cycle. The row slot is claimed before the row move is queued because
+ *	the loader can reach the move before this function returns.
+ */
+stat_t rs_run_row(cmdObj_t *cmd)
+{
+	if (cmd->objtype != TYPE_STRING) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	const char *src = (const char *)*cmd->stringp;
+	float direction;
+	if (src[0] == '+') { direction = 1;}
+	else if (src[0] == '-') { direction = -1;}
+	else { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+
+	if ((fp_ZERO(rs.pitch)) || (fp_ZERO(rs.velocity))) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (rs_rows_available() == 0) { return (STAT_BUFFER_FULL);}	// RASTER_HOLD() should prevent this
+
+	uint8_t motor = MOTORS;
+	for (uint8_t m=0; m<MOTORS; m++) {
+		if (st.m[m].motor_map == rs.axis) { motor = m; break;}
+	}
+	if (motor == MOTORS) { return (STAT_INPUT_VALUE_UNSUPPORTED);}	// no motor drives the raster axis
+
+	rsRow_t *row = &rs.row[rs.head];
+	ritorno(decode_base64((const char_t *)&src[1], row->pixel, RASTER_ROW_LEN, &row->length));
+	if (row->length == 0) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	row->motor = motor;
+	row->steps_per_pixel = rs.pitch * st.m[motor].steps_per_unit;
+	row->phase_off = pwm.c[PWM_1].phase_off;
+	row->phase_scale = (pwm.c[PWM_1].cw_phase_hi - row->phase_off) / 255;
+
+	// save the model state and set up the sweep
+	uint8_t saved_units_mode = gmx.modal.units_mode;
+	uint8_t saved_distance_mode = gmx.modal.distance_mode;
+	uint8_t saved_inverse_feed_rate_mode = gm.inverse_feed_rate_mode;
+	float saved_feed_rate = gm.feed_rate;
+	cm_set_units_mode(MILLIMETERS);
+	cm_set_distance_mode(INCREMENTAL_MODE);
+	gm.inverse_feed_rate_mode = false;
+	cm_set_feed_rate(rs.velocity);
+
+	float vect[] = {0,0,0,0,0,0};
+	float flags[] = {false, false, false, false, false, false};
+	flags[rs.axis] = true;
+	stat_t status = STAT_OK;
+
+	if (fp_NOT_ZERO(rs.overscan)) {					// lead-in
+		gm.raster = RASTER_DARK;
+		vect[rs.axis] = direction * rs.overscan;
+		status = cm_straight_feed(vect, flags);
+	}
+	if (status == STAT_OK) {						// the row
+		uint8_t head = rs.head;
+		rs.head = _next_row(head);
+		gm.raster = RASTER_ROW;
+		vect[rs.axis] = direction * row->length * rs.pitch;
+		if ((status = cm_straight_feed(vect, flags)) != STAT_OK) { rs.head = head;}
+	}
+	if ((status == STAT_OK) && (fp_NOT_ZERO(rs.overscan))) {	// lead-out
+		gm.raster = RASTER_DARK;
+		vect[rs.axis] = direction * rs.overscan;
+		status = cm_straight_feed(vect, flags);
+	}
+	gm.raster = RASTER_OFF;
+
+	cm_set_units_mode(saved_units_mode);
+	cm_set_distance_mode(saved_distance_mode);
+	gm.inverse_feed_rate_mode = saved_inverse_feed_rate_mode;
+	gm.feed_rate = saved_feed_rate;
+
+	cmd->value = row->length;						// report the pixels queued, not the row
+	cmd->objtype = TYPE_INTEGER;
+	return (status);
+}
+
+/*
+ * rs_load_segment() - start or end a row as the first segment of a raster move loads
+ *
+ *	Called from _load_move() in the loader interrupt, just before the DDA starts the
+ *	segment, so the step position captured here is the start of the move. A row that
+ *	is still active was not finished by its own steps - that is a rounding remainder
+ *	with no lead-out - and is ended here.
+ */
+void rs_load_segment(uint8_t raster)
+{
+	if (rs.active == true) {
+		rs.active = false;
+		pwm_set_duty(PWM_1, rs.row[rs.tail].phase_off);
+		rs.tail = _next_row(rs.tail);
+	}
+	if ((raster != RASTER_ROW) || (rs.tail == rs.head)) { return;}
+
+	rsRow_t *row = &rs.row[rs.tail];
+	rs.start_position = st_get_step_position(row->motor);
+	rs.pixel = 0;
+	rs.next_step = (int32_t)(row->steps_per_pixel + 0.5);
+	pwm_set_duty(PWM_1, row->phase_off + row->phase_scale * row->pixel[0]);
+	rs.active = true;
+}
+
+/*
+ * rs_step() - set the phase as the raster motor crosses into the next pixel
+ *
+ *	Called from the DDA interrupt after the motors have stepped (see RASTER_STEP()).
+ *	Pixels narrower than a step are skipped. The row is freed after its last pixel.
+ */
+void rs_step()
+{
+	rsRow_t *row = &rs.row[rs.tail];
+	int32_t steps = st_get_step_position(row->motor) - rs.start_position;
+	if (steps < 0) { steps = -steps;}
+	if (steps < rs.next_step) { return;}
+
+	do {
+		if (++rs.pixel >= row->length) {			// past the last pixel
+			rs.active = false;
+			pwm_set_duty(PWM_1, row->phase_off);
+			rs.tail = _next_row(rs.tail);
+			return;
+		}
+		rs.next_step = (int32_t)((rs.pixel + 1) * row->steps_per_pixel + 0.5);
+	} while (steps >= rs.next_step);
+	pwm_set_duty(PWM_1, row->phase_off + row->phase_scale * row->pixel[rs.pixel]);
+}
+
+/*
+ * rs_idle() - turn the laser off while the steppers have nothing to run
+ *
+ *	Called from _load_move() when no segment is prepared. The row stays active and
+ *	the phase is set again as the motor reaches the next pixel.
+ */
+void rs_idle()
+{
+	pwm_set_duty(PWM_1, rs.row[rs.tail].phase_off);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * rs_set_rsa() - set the raster axis
+ */
+stat_t rs_set_rsa(cmdObj_t *cmd)
+{
+	if (cmd->value >= AXES) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_ui8(cmd));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char msg_units0[] PROGMEM = " in";	// used by generic print functions
+static const char msg_units1[] PROGMEM = " mm";
+static const char msg_units2[] PROGMEM = " deg";
+static const char *const msg_units[] PROGMEM = { msg_units0, msg_units1, msg_units2 };
+
+static const char fmt_rsa[] PROGMEM = "[rsa] raster axis%22d [0=X,1=Y,2=Z,3=A,4=B,5=C]\n";
+static const char fmt_rsp[] PROGMEM = "[rsp] raster pixel pitch%15.3f%s\n";
+static const char fmt_rsv[] PROGMEM = "[rsv] raster sweep velocity%12.3f%s/min\n";
+static const char fmt_rso[] PROGMEM = "[rso] raster overscan%18.3f%s\n";
+
+void rs_print_rsa(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_rsa);}
+void rs_print_rsp(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_rsp, GET_UNITS(ACTIVE_MODEL));}
+void rs_print_rsv(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_rsv, GET_UNITS(ACTIVE_MODEL));}
+void rs_print_rso(cmdObj_t *cmd) { text_print_flt_units(cmd, fmt_rso, GET_UNITS(ACTIVE_MODEL));}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RASTER
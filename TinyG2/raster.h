@@ -0,0 +1,140 @@
+/*
+ * raster.h - raster engraving with step synchronised laser intensity
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Raster engraving is enabled by __RASTER in tinyg2.h. A raster row is one command
+ * carrying a direction and a line of intensity bytes, instead of a G1 S-word move
+ * for every pixel:
+ *
+ *	{"rst":"+<base64>"}	engrave a row in the positive direction of the raster axis
+ *	{"rst":"-<base64>"}	engrave a row in the negative direction
+ *
+ * Each decoded byte is one pixel, 0 = off to 255 = full power. Full power is the PWM
+ * phase set for the maximum CW spindle speed ($p1cph), off is $p1pof. A row is up to
+ * RASTER_ROW_LEN pixels (240 base64 characters), which fits the 255 character input
+ * line. Longer rows are sent as consecutive commands with the same direction.
+ *
+ * The row starts from the current position and is queued as three moves along the
+ * raster axis ($rsa) at the sweep velocity ($rsv): a dark lead-in of $rso, the row
+ * itself of pixels x $rsp, and a dark lead-out of $rso. The overscan lets the axis
+ * reach the sweep velocity before the first pixel and run past the last one, so the
+ * row is burned at constant velocity. Move to the start of the next row with
+ * ordinary Gcode. The laser must be enabled with M3 - the raster only sets the phase.
+ *
+ * The pixels are timed by the DDA, not by the planner. As the row move loads, the
+ * loader arms the row (rs_load_segment()). From then on the DDA interrupt counts
+ * the steps of the raster axis motor and sets the phase of each pixel as the motor
+ * crosses into it (RASTER_STEP()), so intensity stays locked to position at any
+ * velocity, including the ramps of a feedhold. The phase is turned off after the
+ * last pixel and when the planner is flushed, and held off while the steppers run
+ * out of moves (a feedhold) until the next pixel is reached.
+ *
+ * Rows are held in a ring of RASTER_ROWS until their last pixel is burned. When
+ * the ring is full the controller holds the next raster line in the input buffer
+ * (RASTER_HOLD()), so the host streams rows with normal flow control.
+ *
+ * Raster rows assume cartesian kinematics and are not coalesced. The simulation
+ * build has no DDA, so raster support is not compiled into it.
+ */
+
+#ifndef RASTER_H_ONCE
+#define RASTER_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+enum rsMoveType {						// gm.raster, and the raster event of a prep segment
+	RASTER_OFF = 0,						// not a raster move
+	RASTER_DARK,						// lead-in or lead-out - laser off
+	RASTER_ROW,							// the row - pixels timed by the DDA
+	RASTER_RUNNING						// move already started - no event when it resumes from a hold
+};
+
+#ifdef __RASTER
+
+#define RASTER_ROWS				4		// rows held for the DDA
+#define RASTER_ROW_LEN			180		// pixels per row - 240 base64 characters
+
+typedef struct rsRow {					// one row of pixels
+	uint8_t motor;						// motor that drives the raster axis
+	uint16_t length;					// pixels in the row
+	float steps_per_pixel;				// steps of the raster motor per pixel
+	float phase_off;					// pwm phase of a 0 pixel
+	float phase_scale;					// pwm phase per pixel count
+	uint8_t pixel[RASTER_ROW_LEN];
+} rsRow_t;
+
+typedef struct rsSingleton {
+	uint8_t axis;						// $rsa - raster axis
+	float pitch;						// $rsp - pixel pitch (mm)
+	float velocity;						// $rsv - sweep velocity (mm/min)
+	float overscan;						// $rso - lead-in and lead-out length (mm)
+
+	volatile uint8_t head;				// next row to fill (written by rs_run_row() only)
+	volatile uint8_t tail;				// row being burned or next to burn (written by the DDA only)
+	volatile uint8_t active;			// TRUE while the DDA is burning the tail row
+	uint16_t pixel;						// pixel being burned
+	int32_t start_position;				// step position of the raster motor at the start of the row
+	int32_t next_step;					// steps from the start to the next pixel
+	rsRow_t row[RASTER_ROWS];
+} rsSingleton_t;
+
+extern rsSingleton_t rs;
+
+void rs_reset(void);
+uint8_t rs_rows_available(void);
+void rs_load_segment(uint8_t raster);
+void rs_step(void) HOT_PATH;
+void rs_idle(void);
+
+stat_t rs_run_row(cmdObj_t *cmd);
+stat_t rs_set_rsa(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void rs_print_rsa(cmdObj_t *cmd);
+	void rs_print_rsp(cmdObj_t *cmd);
+	void rs_print_rsv(cmdObj_t *cmd);
+	void rs_print_rso(cmdObj_t *cmd);
+#else
+	#define rs_print_rsa tx_print_stub
+	#define rs_print_rsp tx_print_stub
+	#define rs_print_rsv tx_print_stub
+	#define rs_print_rso tx_print_stub
+#endif
+
+// RASTER_STEP() costs one test in the DDA interrupt when no row is being burned
+#define RASTER_STEP() if (rs.active == true) { rs_step();}
+#define RASTER_IDLE() if (rs.active == true) { rs_idle();}
+#define RASTER_HOLD(line) ((rs_rows_available() == 0) && (strstr((char *)line, "rst") != NULL))
+#define RASTER_BUSY() ((rs.active == true) || (rs_rows_available() < RASTER_ROWS))
+
+#else
+
+#define RASTER_STEP()
+#define RASTER_IDLE()
+#define RASTER_HOLD(line) (false)
+#define RASTER_BUSY() (false)
+
+#endif // __RASTER
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: RASTER_H_ONCE
@@ -0,0 +1,668 @@
+/*
+ * replay.cpp - segment cache of the stored program, replayed without the planner
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See replay.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "persistence.h"
+#include "report.h"
+#include "util.h"
+#include "program_store.h"
+#include "replay.h"
+#include "swo.h"
+
+#ifdef __SEGMENT_REPLAY
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+rpSingleton_t rp;
+
+extern uint32_t _sfixed;						// the firmware image - see gcc_flash.ld
+extern uint32_t _etext;
+
+#define _header() ((const rpHeader_t *)RP_FLASH_ADDR)
+#define _stream() ((const uint8_t *)RP_STREAM_ADDR)
+#define _ram() ((uint8_t *)rp.ram)
+
+static uint8_t _header_is_valid(void);
+static uint8_t _header_matches(const uint32_t config);
+static uint32_t _config_sum(void);
+static void _get_start(rpStart_t *start);
+static void _start_recording(const uint32_t config);
+static void _start_replay(void);
+static stat_t _write_page(const uint32_t page);
+static stat_t _write_header(const uint8_t too_long);
+static void _finish_recording(void);
+static void _end_replay(void);
+static void _run_command(void);
+static void _start_block(void);
+static void _update_runtime(const float steps[], const float microseconds);
+
+static inline uint32_t _float_bits(const float value) { uint32_t bits; memcpy(&bits, &value, sizeof(bits)); return (bits);}
+static inline float _bits_float(const uint32_t bits) { float value; memcpy(&value, &bits, sizeof(value)); return (value);}
+
+/*
+ * rp_init() - sum the firmware image and find the cache, if any
+ */
+void rp_init()
+{
+	uint32_t sum = 0;
+	for (const uint32_t *word = &_sfixed; word < &_etext; word++) { sum += *word;}
+	rp.firmware = sum;
+	rp.state = RP_OFF;
+	rp.length = 0;
+	if ((_header_is_valid() == true) && (_header()->too_long == false)) { rp.length = _header()->length;}
+}
+
+static uint8_t _header_is_valid()
+{
+	const rpHeader_t *h = _header();
+	return ((h->magic == RP_MAGIC) && (h->check == ~h->length) && (h->length <= RP_STREAM_MAX));
+}
+
+/*
+ * _header_matches() - TRUE if the cache is of the stored program, firmware and settings
+ */
+static uint8_t _header_matches(const uint32_t config)
+{
+	const rpHeader_t *h = _header();
+	const pgHeader_t *ph = (const pgHeader_t *)PG_FLASH_ADDR;
+	return ((_header_is_valid() == true) && (h->program_length == pg.length) &&
+			(h->program_checksum == ph->checksum) && (h->firmware == rp.firmware) && (h->config == config));
+}
+
+/*
+ * _config_sum() - sum the persisted settings, as config_init() would load them
+ */
+static uint32_t _config_sum()
+{
+	cmdObj_t obj;
+	cmdObj_t *cmd = &obj;
+	uint32_t sum = 0;
+
+	memset(cmd, 0, sizeof(cmdObj_t));
+	for (cmd->index=0; cmd_index_is_single(cmd->index); cmd->index++) {
+		if ((GET_TABLE_BYTE(flags) & F_INITIALIZE) == 0) { continue;}
+		cmd->value = 0;
+		cmd_get(cmd);
+		sum = ((sum << 1) | (sum >> 31)) + _float_bits(cmd->value);
+	}
+	return (sum);
+}
+
+/*
+ * _get_start() - the state a run starts from, as kept in the header
+ */
+static void _get_start(rpStart_t *start)
+{
+	memset(start, 0, sizeof(rpStart_t));			// starts are compared with memcmp()
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		start->position[axis] = mp_get_runtime_absolute_position(axis);
+		start->origin_offset[axis] = gmx.origin_offset[axis];
+	}
+	memcpy(&start->modal, &gmx.modal, sizeof(GCodeModal_t));
+	start->feed_rate = gm.feed_rate;
+	start->feed_rate_override_factor = gmx.feed_rate_override_factor;
+	start->traverse_override_factor = gmx.traverse_override_factor;
+	start->motion_mode = gm.motion_mode;
+	start->path_control = gm.path_control;
+	start->inverse_feed_rate_mode = gm.inverse_feed_rate_mode;
+	start->origin_offset_enable = gmx.origin_offset_enable;
+	start->feed_rate_override_enable = gmx.feed_rate_override_enable;
+	start->traverse_override_enable = gmx.traverse_override_enable;
+}
+
+/*
+ * rp_start() - replay the stored program, or record the run about to start
+ *
+ *	Called by pg_run_pgr() before it starts reading the program. Returns TRUE if the
+ *	cache is replayed, in which case the program is not read at all. A run that is
+ *	not started with the machine stopped and nothing queued is neither recorded nor
+ *	replayed, as its segments depend on what ran before it.
+ */
+uint8_t rp_start()
+{
+	rp.state = RP_OFF;
+	if ((rp.mode == 0) || (ik.kinematics != KINEMATICS_CARTESIAN) || (ik.map_enable == true)) { return (false);}
+	if ((cm.cycle_state != CYCLE_OFF) || (cm.motion_state != MOTION_STOP) || (gc_get_queued_blocks() != 0) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (false);
+	}
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		rp.axis_motor[axis] = -1;
+		for (uint8_t motor=0; motor<MOTORS; motor++) {
+			if ((st.m[motor].motor_map == axis) && (fp_NOT_ZERO(st.m[motor].steps_per_unit))) {
+				rp.axis_motor[axis] = motor;
+				break;
+			}
+		}
+	}
+	uint32_t config = _config_sum();
+	_get_start(&rp.start);
+	if (_header_matches(config) == true) {
+		if (_header()->too_long == true) { return (false);}	// runs live, and is not recorded again
+		if (memcmp(&_header()->start, &rp.start, sizeof(rpStart_t)) == 0) {
+			_start_replay();
+			return (true);
+		}
+	}
+	_start_recording(config);
+	return (false);
+}
+
+/*
+ * rp_stop()	- end a replay at the next block - for {"pgr":0}
+ * rp_resume()	- speed a held replay back up. Returns FALSE if no replay is on
+ * rp_reset()	- end a replay or recording - called from mp_flush_planner()
+ *
+ *	The runtime position is kept by the replay as it goes, so a flush leaves the
+ *	machine where the motors stopped and cm_queue_flush() sets the model from it.
+ */
+void rp_stop()
+{
+	if (rp.state == RP_REPLAY) { rp.stop = true;}
+}
+
+uint8_t rp_resume()
+{
+	if (rp.state != RP_REPLAY) { return (false);}
+	cm_set_motion_state(MOTION_RUN);
+	st_request_exec_move();
+	return (true);
+}
+
+void rp_reset()
+{
+	if (rp.state == RP_RECORD) { rp.state = RP_ABANDON;}
+	if (RP_REPLAYING() == false) { return;}
+	rp.state = RP_OFF;
+	if (cm.cycle_state == CYCLE_REPLAY) { cm.cycle_state = CYCLE_OFF;}
+}
+
+/*
+ * rp_abandon() - give up the recording - the run carries on live (see RP_ABANDON())
+ */
+void rp_abandon()
+{
+	rp.state = RP_ABANDON;
+}
+
+/***********************************************************************************
+ * RECORDING
+ *
+ *	The exec writes the records into rp.ram, a ring of RP_RAM_PAGES pages, and the
+ *	callback programs each page to flash as it fills. A record is only started if it
+ *	can't run into a page that has not been programmed yet.
+ ***********************************************************************************/
+
+static void _start_recording(const uint32_t config)
+{
+	memset(rp.ram, 0, RP_PAGE_SIZE);
+	if (write_flash_page(RP_FLASH_ADDR, rp.ram) != STAT_OK) { return;}	// the old cache is gone from here on
+	rp.length = 0;
+	rp.written = 0;
+	rp.too_long = false;
+	rp.cycled = false;
+	rp.config = config;
+	rp.gaps = mps.dda_gaps;
+	memset(rp.line_bits, 0, sizeof(rp.line_bits));
+	memset(rp.value_bits, 0, sizeof(rp.value_bits));
+	memset(rp.position_bits, 0, sizeof(rp.position_bits));
+	rp.state = RP_RECORD;
+}
+
+static uint8_t _record_fits()
+{
+	if (rp.length + RP_RECORD_MAX > RP_STREAM_MAX) {
+		rp.too_long = true;
+		rp.state = RP_ABANDON;
+		return (false);
+	}
+	if (((rp.length + RP_RECORD_MAX - 1) / RP_PAGE_SIZE) - rp.written >= RP_RAM_PAGES) {
+		rp.state = RP_ABANDON;						// the page writes are behind
+		return (false);
+	}
+	return (true);
+}
+
+static void _put_byte(const uint8_t byte)
+{
+	_ram()[rp.length & (sizeof(rp.ram)-1)] = byte;
+	rp.length++;
+}
+
+static void _put_varint(uint32_t value)
+{
+	while (value >= 0x80) {
+		_put_byte((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	_put_byte((uint8_t)value);
+}
+
+static void _put_floats(uint32_t last[], const float value[], const uint8_t count)
+{
+	uint32_t diff[MOTORS+1];
+	uint8_t mask = 0;
+
+	for (uint8_t i=0; i<count; i++) {
+		uint32_t bits = _float_bits(value[i]);
+		diff[i] = bits ^ last[i];
+		last[i] = bits;
+		if (diff[i] != 0) { mask |= (1 << i);}
+	}
+	_put_byte(mask);
+	for (uint8_t i=0; i<count; i++) {
+		if (mask & (1 << i)) { _put_varint(diff[i]);}
+	}
+}
+
+/*
+ * rp_record_line()	   - record a line segment - from st_prep_line()
+ * rp_record_dwell()   - record a dwell - from st_prep_dwell()
+ * rp_record_command() - record a queued or attached command as it runs
+ * rp_record_block()   - record the start of a block - its line number and position
+ *
+ *	All run at the exec interrupt level. Use the RP_RECORD_ macros, which only call
+ *	them while recording.
+ */
+void rp_record_line(const float steps[], const float microseconds)
+{
+	if (_record_fits() == false) { return;}
+	float value[MOTORS+1];
+	value[0] = microseconds;
+	for (uint8_t motor=0; motor<MOTORS; motor++) { value[motor+1] = steps[motor];}
+	_put_byte(RP_LINE);
+	_put_floats(rp.line_bits, value, MOTORS+1);
+}
+
+void rp_record_dwell(const float microseconds)
+{
+	if (_record_fits() == false) { return;}
+	_put_byte(RP_DWELL);
+	_put_varint((uint32_t)lroundf(microseconds));	// as st_prep_dwell() rounds it
+}
+
+void rp_record_command(const cm_exec func, const float value[], const uint8_t flag_bits)
+{
+	if (_record_fits() == false) { return;}
+	uint32_t address = (uint32_t)func;				// the firmware is the same when it is replayed
+	_put_byte(RP_COMMAND);
+	for (uint8_t i=0; i<4; i++) { _put_byte((uint8_t)(address >> (i*8)));}
+	_put_byte(flag_bits);
+	_put_floats(rp.value_bits, value, AXES);
+}
+
+void rp_record_block()
+{
+	if (_record_fits() == false) { return;}
+	_put_byte(RP_BLOCK);
+	_put_varint(mr.gm.linenum);
+	_put_floats(rp.position_bits, mr.position, AXES);
+}
+
+/*
+ * rp_callback() - program recorded pages, finish or give up a recording, end a replay
+ *
+ *	A page is programmed per pass, which holds the main loop for a few ms - the
+ *	planner queue covers it. The recording is finished once the program has been read
+ *	to its end and everything it queued has stepped out, and given up if the run was
+ *	held, stopped part way or ran out of segments, or the settings were changed.
+ */
+stat_t rp_callback()
+{
+	if (rp.state == RP_END) {
+		if (stepper_isbusy() == true) { return (STAT_NOOP);}
+		_end_replay();
+		return (STAT_OK);
+	}
+	if (rp.state == RP_ABANDON) {
+		if (rp.too_long == true) { _write_header(true);}
+		rp.state = RP_OFF;
+		rp.length = 0;
+		return (STAT_OK);
+	}
+	if (rp.state != RP_RECORD) { return (STAT_NOOP);}
+
+	if (cm.cycle_state != CYCLE_OFF) { rp.cycled = true;}
+	if ((cm.hold_state != FEEDHOLD_OFF) || (cm.machine_state == MACHINE_ALARM) || (mps.dda_gaps != rp.gaps) ||
+		((cm.cycle_state != CYCLE_OFF) && (cm.cycle_state != CYCLE_MACHINING)) ||		// homing or probing
+		((PG_IS_RUNNING() == true) && (rp.cycled == true) && (cm.cycle_state == CYCLE_OFF)) ||	// M0, M1 or ran dry
+		((PG_IS_RUNNING() == false) && (pg.read < pg.length))) {						// {"pgr":0} or an error
+		rp_abandon();
+		return (STAT_OK);
+	}
+	if (rp.written < (rp.length / RP_PAGE_SIZE)) {
+		if (_write_page(rp.written) != STAT_OK) { rp_abandon();}
+		else { rp.written++;}
+		return (STAT_OK);
+	}
+	if ((PG_IS_RUNNING() == true) || (gc_get_queued_blocks() != 0) ||
+		(mp_get_runtime_busy() == true) || (stepper_isbusy() == true)) {
+		return (STAT_NOOP);
+	}
+	_finish_recording();
+	return (STAT_OK);
+}
+
+static stat_t _write_page(const uint32_t page)
+{
+	const uint32_t *data = &rp.ram[(page & (RP_RAM_PAGES-1)) * (RP_PAGE_SIZE / sizeof(uint32_t))];
+	return (write_flash_page(RP_STREAM_ADDR + page * RP_PAGE_SIZE, data));
+}
+
+/*
+ * _write_header() - write the header from the run just recorded
+ *
+ *	The pages of the ring are all programmed by now, so the header is assembled in
+ *	them. The page with the magic number is written last.
+ */
+static stat_t _write_header(const uint8_t too_long)
+{
+	memset(rp.ram, 0, RP_HEADER_PAGES * RP_PAGE_SIZE);
+	rpHeader_t *h = (rpHeader_t *)rp.ram;
+	h->magic = RP_MAGIC;
+	h->length = (too_long == true) ? 0 : rp.length;
+	h->check = ~h->length;
+	h->too_long = too_long;
+	h->program_length = pg.length;
+	h->program_checksum = ((const pgHeader_t *)PG_FLASH_ADDR)->checksum;
+	h->firmware = rp.firmware;
+	h->config = rp.config;
+	memcpy(&h->start, &rp.start, sizeof(rpStart_t));
+	for (uint8_t axis=0; axis<AXES; axis++) { h->end_position[axis] = mp_get_runtime_absolute_position(axis);}
+	memcpy(&h->gm, &gm, sizeof(GCodeState_t));
+	memcpy(&h->gmx, &gmx, sizeof(GCodeStateX_t));
+
+	for (uint8_t page=RP_HEADER_PAGES; page>0; page--) {
+		ritorno(write_flash_page(RP_FLASH_ADDR + (page-1) * RP_PAGE_SIZE, &rp.ram[(page-1) * (RP_PAGE_SIZE / sizeof(uint32_t))]));
+	}
+	return (STAT_OK);
+}
+
+static void _finish_recording()
+{
+	rp.state = RP_OFF;
+	if (_config_sum() != rp.config) {				// set from serial once the program was read
+		rp.length = 0;
+		return;
+	}
+	if (((rp.length % RP_PAGE_SIZE) != 0) && (_write_page(rp.written) != STAT_OK)) {
+		rp.length = 0;
+		return;
+	}
+	if (_write_header(false) != STAT_OK) { rp.length = 0;}
+}
+
+/***********************************************************************************
+ * REPLAY
+ ***********************************************************************************/
+
+static void _start_replay()
+{
+	rp.length = _header()->length;
+	rp.read = 0;
+	rp.stop = false;
+	rp.usec_left = 0;
+	rp.rate = 1;
+	memset(rp.line_bits, 0, sizeof(rp.line_bits));
+	memset(rp.value_bits, 0, sizeof(rp.value_bits));
+	memset(rp.position_bits, 0, sizeof(rp.position_bits));
+	copy_axis_vector(rp.block_position, rp.start.position);
+	for (uint8_t motor=0; motor<MOTORS; motor++) { rp.block_steps[motor] = 0;}
+
+	cm.cycle_state = CYCLE_REPLAY;
+	cm.machine_state = MACHINE_CYCLE;
+	cm_set_motion_state(MOTION_RUN);
+	rp.state = RP_REPLAY;
+	st_request_exec_move();
+}
+
+static inline uint8_t _get_byte() { return (_stream()[rp.read++]);}
+
+static uint32_t _get_varint()
+{
+	uint32_t value = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+	do {
+		byte = _get_byte();
+		value |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return (value);
+}
+
+static void _get_floats(uint32_t last[], float value[], const uint8_t count)
+{
+	uint8_t mask = _get_byte();
+	for (uint8_t i=0; i<count; i++) {
+		if (mask & (1 << i)) { last[i] ^= _get_varint();}
+		value[i] = _bits_float(last[i]);
+	}
+}
+
+/*
+ * rp_exec() - replay a segment from the exec, in place of the planner
+ *
+ *	Runs at the exec interrupt level and returns STAT_NOOP once the last record is
+ *	replayed, like the planner with nothing to run. Commands and block starts are run
+ *	as they are read, up to the next line or dwell.
+ *
+ *	A recorded segment runs as it was recorded unless the replay rate is ramping for
+ *	a feedhold. Then each segment takes the time of the recorded one and runs as much
+ *	of it as the average rate over it allows, so the motors slow as the rate does and
+ *	a recorded segment can be spread over several. The steps follow the fraction run.
+ */
+stat_t rp_exec()
+{
+	if (rp.state != RP_REPLAY) { return (STAT_NOOP);}
+	if (cm.feedhold_requested == true) {			// picked up here as no aline is running
+		cm.feedhold_requested = false;
+		if (cm.hold_state == FEEDHOLD_OFF) {
+			cm_set_motion_state(MOTION_HOLD);
+			cm.hold_state = FEEDHOLD_DECEL;
+			SWO_HOLD_STATE();
+		}
+	}
+	if (cm.hold_state == FEEDHOLD_HOLD) { return (STAT_NOOP);}
+
+	while (rp.usec_left <= 0) {
+		if (rp.read >= rp.length) {
+			rp.state = RP_END;
+			return (STAT_NOOP);
+		}
+		switch (_get_byte()) {
+			case RP_LINE: {
+				float value[MOTORS+1];
+				_get_floats(rp.line_bits, value, MOTORS+1);
+				rp.microseconds = value[0];
+				for (uint8_t motor=0; motor<MOTORS; motor++) { rp.steps[motor] = value[motor+1];}
+				rp.usec_left = rp.microseconds;
+				break;
+			}
+			case RP_DWELL: {
+				st_prep_dwell((float)_get_varint());
+				return (STAT_OK);
+			}
+			case RP_COMMAND: { _run_command(); break;}
+			case RP_BLOCK: {
+				_start_block();
+				if (rp.stop == true) {
+					rp.state = RP_END;
+					return (STAT_NOOP);
+				}
+				break;
+			}
+			default: {
+				rp.state = RP_END;
+				return (cm_alarm(STAT_INTERNAL_ERROR));	// the header checked out, so this is a bad read
+			}
+		}
+	}
+
+	float microseconds = rp.usec_left;
+	float run = rp.usec_left;						// recorded microseconds run by the segment
+	if ((cm.hold_state == FEEDHOLD_DECEL) || (rp.rate < 1)) {
+		float rate_step = rp.microseconds / (max(rp.hold_time, EPSILON) * 1000000);
+		float rate = (cm.hold_state == FEEDHOLD_DECEL) ? max(rp.rate - rate_step, (float)0) : min(rp.rate + rate_step, (float)1);
+		float average = (rp.rate + rate) / 2;
+		if (average < EPSILON) {
+			rp.rate = 0;
+			cm.hold_state = FEEDHOLD_HOLD;
+			SWO_HOLD_STATE();
+			sr_request_status_report(SR_IMMEDIATE_REQUEST);
+			return (STAT_NOOP);
+		}
+		run = min(average * rp.microseconds, rp.usec_left);
+		microseconds = run / average;
+		rp.rate = rate;
+	}
+	float steps[MOTORS];
+	float fraction = run / rp.microseconds;
+	for (uint8_t motor=0; motor<MOTORS; motor++) { steps[motor] = rp.steps[motor] * fraction;}
+	ritorno(st_prep_line(steps, microseconds));
+	rp.usec_left -= run;
+	_update_runtime(steps, microseconds);
+	mr.job_usec += (uint32_t)microseconds;
+	return (STAT_OK);
+}
+
+static void _run_command()
+{
+	uint32_t address = 0;
+	for (uint8_t i=0; i<4; i++) { address |= (uint32_t)_get_byte() << (i*8);}
+	uint8_t flag_bits = _get_byte();
+	float value[AXES];
+	float flag[AXES];
+	_get_floats(rp.value_bits, value, AXES);
+	for (uint8_t axis=0; axis<AXES; axis++) { flag[axis] = (flag_bits & (1 << axis)) ? 1 : 0;}
+	((cm_exec)address)(value, flag);
+	SR_MODAL_CHANGED();								// the command may have changed a mode
+}
+
+static void _start_block()
+{
+	mr.gm.linenum = _get_varint();
+	_get_floats(rp.position_bits, rp.block_position, AXES);
+	for (uint8_t axis=0; axis<AXES; axis++) { mp_set_runtime_position(axis, rp.block_position[axis]);}
+	for (uint8_t motor=0; motor<MOTORS; motor++) { rp.block_steps[motor] = 0;}
+	SR_MODAL_CHANGED();								// new line number to report
+}
+
+/*
+ * _update_runtime() - set the runtime position and velocity from the steps replayed
+ *
+ *	Each axis follows the first motor mapped to it, from the position of the block.
+ */
+static void _update_runtime(const float steps[], const float microseconds)
+{
+	float distance = 0;
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) { rp.block_steps[motor] += steps[motor];}
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		int8_t motor = rp.axis_motor[axis];
+		if (motor < 0) { continue;}
+		float position = rp.block_position[axis] + rp.block_steps[motor] / st.m[motor].steps_per_unit;
+		distance += square(position - mr.position[axis]);
+		mp_set_runtime_position(axis, position);
+	}
+	mr.segment_velocity = sqrt(distance) / (microseconds / MICROSECONDS_PER_MINUTE);
+	sr_request_status_report(SR_TIMED_REQUEST);
+}
+
+/*
+ * _end_replay() - set the model and the planner once the last segment has stepped out
+ *
+ *	A replay that ran to the end leaves the Gcode model as the recorded run did. One
+ *	stopped part way leaves the model's modes as they were, at the position reached.
+ */
+static void _end_replay()
+{
+	if (rp.read >= rp.length) {
+		const rpHeader_t *h = _header();
+		memcpy(&gm, &h->gm, sizeof(GCodeState_t));
+		memcpy(&gmx, &h->gmx, sizeof(GCodeStateX_t));
+		cm_set_work_offsets(MODEL);					// the model's sets are not the ones it was recorded with
+		for (uint8_t axis=0; axis<AXES; axis++) { mp_set_runtime_position(axis, h->end_position[axis]);}
+	}
+	for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+		mp_set_planner_position(axis, mp_get_runtime_absolute_position(axis));
+		gmx.position[axis] = mp_get_runtime_absolute_position(axis);
+		gm.target[axis] = gmx.position[axis];
+	}
+	rp.state = RP_OFF;
+	rp.length = _header()->length;
+	if (cm.cycle_state == CYCLE_REPLAY) { cm.cycle_state = CYCLE_OFF;}
+	if (cm.machine_state == MACHINE_CYCLE) { cm.machine_state = MACHINE_PROGRAM_STOP;}	// M2 and M30 set their own
+	cm_set_motion_state(MOTION_STOP);
+	sr_request_status_report(SR_IMMEDIATE_REQUEST);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * rp_get_rps() - cache state - see rpCache
+ */
+stat_t rp_get_rps(cmdObj_t *cmd)
+{
+	if (rp.state == RP_RECORD) { cmd->value = RP_CACHE_RECORDING;}
+	else if (RP_REPLAYING() == true) { cmd->value = RP_CACHE_REPLAYING;}
+	else if (_header_matches(_config_sum()) == false) { cmd->value = RP_CACHE_NONE;}
+	else if (_header()->too_long == true) { cmd->value = RP_CACHE_TOO_LONG;}
+	else { cmd->value = RP_CACHE_VALID;}
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_rpm[] PROGMEM = "[rpm] segment cache mode%15d [0=run live,1=record and replay]\n";
+static const char fmt_rph[] PROGMEM = "[rph] segment cache hold time%10.2f sec\n";
+static const char fmt_rps[] PROGMEM = "Segment cache state:%15.0f [0=none,1=cached,2=recording,3=replaying,4=too long]\n";
+static const char fmt_rpl[] PROGMEM = "Segment cache length:%14.0f bytes\n";
+
+void rp_print_rpm(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_rpm);}
+void rp_print_rph(cmdObj_t *cmd) { text_print_flt(cmd, fmt_rph);}
+void rp_print_rps(cmdObj_t *cmd) { text_print_flt(cmd, fmt_rps);}
+void rp_print_rpl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_rpl);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SEGMENT_REPLAY
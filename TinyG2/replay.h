@@ -0,0 +1,240 @@
+/*
+ * replay.h - segment cache of the stored program, replayed without the planner
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The segment cache is compiled in by __SEGMENT_REPLAY in tinyg2.h, and needs the
+ * program store (__PROGRAM_STORE). With $rpm=1 the first {"pgr":1} run of the stored
+ * program records what the exec hands the steppers - the steps and microseconds of
+ * each st_prep_line() segment, the dwells, and the queued and attached commands as they
+ * run - to the bottom RP_FLASH_SIZE of flash bank 1. Later runs replay the recording
+ * in place of the planner, as the jog does: nothing is read, parsed or planned, so the
+ * segments are the same every run and the exec's share is decoding a record.
+ *
+ * A recording is only replayed if the run would be the same. The header keeps:
+ *
+ *	- the length and checksum of the stored program
+ *	- a sum of the firmware image and of every persisted setting ($ values and offsets)
+ *	- the runtime position, G92 offsets and Gcode modes the run started from
+ *
+ * and a run that does not match them all runs live, and records over the cache. The
+ * header is written last, once the run has ended at the end of the program, so the
+ * cache is never part of a run. Recording is given up, and the run carries on live, if:
+ *
+ *	- the run is held, stopped (M0, M1, {"pgr":0}), flushed or alarmed
+ *	- the steppers run out of segments (see {"psgap":""}) - a replay would not wait
+ *	  for a spindle, an input or the host where the live run did
+ *	- a line of the program is not a Gcode token block ($ settings, JSON, macros)
+ *	- a segment is rastered, fires PSO events, sets the laser duty or is DDA ramped,
+ *	  which are not recorded
+ *	- the stream outgrows the flash, or the page writes fall RP_RAM_PAGES behind. A
+ *	  program too long to cache is marked so it is not recorded again
+ *
+ * The replay sets the line number and the position in the runtime as it goes, so
+ * status reports read as they do live. At the end the Gcode model is set to what the
+ * recorded run left. Positions are found from the motor steps, so the cache is only
+ * used with cartesian kinematics ($kn=0) and no surface map.
+ *
+ * A feedhold during a replay slows the segments to a stop over $rph seconds, as the
+ * step queue does - the steps are not replanned, so the path is kept and a cycle start
+ * speeds them back up. A queue flush in the hold ends the replay where it stopped, as
+ * does {"pgr":0} at the next block. The live planner takes over from there.
+ *
+ *	$rpm		1 to record and replay the stored program, 0 to always run it live
+ *	$rph		seconds a feedhold takes to stop a replay
+ *	{"rps":""}	0=no cache, 1=cached, 2=recording, 3=replaying, 4=too long to cache
+ *	{"rpl":""}	bytes of recording in the cache
+ *
+ * The records are a type byte followed by varints. Floats are sent as their bits
+ * XORed with the last value of the same field, so a cruise segment, which repeats the
+ * steps and time of the one before, takes two bytes.
+ */
+
+#ifndef REPLAY_H_ONCE
+#define REPLAY_H_ONCE
+
+#include "canonical_machine.h"			// GCodeState_t
+#include "planner.h"					// cm_exec
+#include "program_store.h"				// __PROGRAM_STORE is dropped without flash
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifndef __PROGRAM_STORE
+#undef __SEGMENT_REPLAY					// the cache is of the stored program
+#endif
+
+#ifdef __SEGMENT_REPLAY
+
+#define RP_PAGE_SIZE IFLASH1_PAGE_SIZE	// 256 bytes
+#define RP_FLASH_SIZE (92 * 1024UL)		// header pages plus the recording
+#define RP_FLASH_ADDR IFLASH1_ADDR		// the rest of bank 1 - below the machine profiles, checkpoints, program store and NVM
+#define RP_HEADER_PAGES 2
+#define RP_STREAM_ADDR (RP_FLASH_ADDR + RP_HEADER_PAGES * RP_PAGE_SIZE)
+#define RP_STREAM_MAX (RP_FLASH_SIZE - RP_HEADER_PAGES * RP_PAGE_SIZE)
+#define RP_RAM_PAGES 8					// recorded pages waiting to be programmed (power of 2)
+#define RP_RECORD_MAX (3 + (MOTORS+1) * 5)	// longest record - a line or a command
+#define RP_MAGIC 0x52504C31				// "RPL1"
+
+enum rpCache {							// {"rps":""}
+	RP_CACHE_NONE = 0,					// no recording of the stored program
+	RP_CACHE_VALID,						// a recording matches the program, firmware and settings
+	RP_CACHE_RECORDING,					// the run is being recorded
+	RP_CACHE_REPLAYING,					// the recording is being replayed
+	RP_CACHE_TOO_LONG					// the program does not fit - it is run live
+};
+
+enum rpState {
+	RP_OFF = 0,
+	RP_RECORD,							// the exec is recording
+	RP_ABANDON,							// recording given up - the callback tidies up
+	RP_REPLAY,							// the exec is replaying
+	RP_END								// the last record is replayed - end once it has stepped out
+};
+
+enum rpRecord {							// record types
+	RP_LINE = 1,						// mask, then the XORed microseconds and steps in the mask
+	RP_DWELL,							// microseconds
+	RP_COMMAND,							// function, flag bits, mask, then the XORed values in the mask
+	RP_BLOCK							// line number, mask, then the XORed runtime position in the mask
+};
+
+typedef struct rpStart {				// state a recording was made from
+	float position[AXES];				// runtime position
+	float origin_offset[AXES];			// G92 offsets
+	GCodeModal_t modal;					// plane, units, coordinate system, distance, tool, coolant
+	float feed_rate;
+	float feed_rate_override_factor;
+	float traverse_override_factor;
+	uint8_t motion_mode;
+	uint8_t path_control;
+	uint8_t inverse_feed_rate_mode;
+	uint8_t origin_offset_enable;
+	uint8_t feed_rate_override_enable;
+	uint8_t traverse_override_enable;
+} rpStart_t;
+
+typedef struct rpHeader {				// first pages of the cache - written last
+	uint32_t magic;						// RP_MAGIC
+	uint32_t length;					// bytes of recording
+	uint32_t check;						// ~length - an erased or torn header fails this
+	uint32_t too_long;					// TRUE if the program was too long to record
+	uint32_t program_length;			// the stored program recorded - see pgHeader_t
+	uint32_t program_checksum;
+	uint32_t firmware;					// sum of the firmware image
+	uint32_t config;					// sum of the persisted settings
+	rpStart_t start;
+	float end_position[AXES];			// runtime position at the end
+	GCodeState_t gm;					// Gcode model at the end
+	GCodeStateX_t gmx;
+} rpHeader_t;
+
+typedef struct rpSingleton {
+	uint8_t mode;						// rpm - 1 to record and replay
+	float hold_time;					// rph - seconds a feedhold takes to stop a replay
+	volatile uint8_t state;				// rpState
+	uint8_t stop;						// TRUE to end the replay at the next block
+	uint8_t too_long;					// TRUE if the recording was given up for want of flash
+	uint8_t cycled;						// TRUE once the recorded run has started its cycle
+	uint32_t firmware;					// sum of the firmware image - found once by rp_init()
+	uint32_t config;					// sum of the persisted settings as the recording started
+	uint32_t length;					// rpl - bytes recorded or cached
+	uint32_t read;						// next byte to replay
+	volatile uint32_t written;			// recorded pages programmed (written by the callback only)
+	uint32_t gaps;						// mps.dda_gaps as the recording started
+	rpStart_t start;					// state the run started from
+
+	uint32_t line_bits[MOTORS+1];		// last values of the XORed fields - microseconds, then steps
+	uint32_t value_bits[AXES];
+	uint32_t position_bits[AXES];
+
+	float microseconds;					// recorded segment being replayed
+	float steps[MOTORS];
+	float usec_left;					// recorded microseconds of it not yet run
+	float rate;							// replay rate - 1 running, 0 held
+	float block_position[AXES];			// runtime position at the start of the block
+	float block_steps[MOTORS];			// steps replayed since the start of the block
+	int8_t axis_motor[AXES];			// first motor of each axis, -1 if none
+
+	uint32_t ram[RP_RAM_PAGES * RP_PAGE_SIZE / sizeof(uint32_t)];	// recorded pages waiting to be programmed
+} rpSingleton_t;
+
+extern rpSingleton_t rp;
+
+void rp_init(void);
+void rp_reset(void);
+uint8_t rp_start(void);
+void rp_stop(void);
+uint8_t rp_resume(void);
+void rp_abandon(void);
+stat_t rp_exec(void) HOT_PATH;
+stat_t rp_callback(void);
+void rp_record_line(const float steps[], const float microseconds) HOT_PATH;
+void rp_record_dwell(const float microseconds);
+void rp_record_command(const cm_exec func, const float value[], const uint8_t flag_bits);
+void rp_record_block(void);
+
+stat_t rp_get_rps(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void rp_print_rpm(cmdObj_t *cmd);
+	void rp_print_rph(cmdObj_t *cmd);
+	void rp_print_rps(cmdObj_t *cmd);
+	void rp_print_rpl(cmdObj_t *cmd);
+#else
+	#define rp_print_rpm tx_print_stub
+	#define rp_print_rph tx_print_stub
+	#define rp_print_rps tx_print_stub
+	#define rp_print_rpl tx_print_stub
+#endif
+
+#define RP_REPLAYING() (rp.state >= RP_REPLAY)
+#define RP_RUNNING() (rp.state == RP_REPLAY)
+#define RP_EXEC() rp_exec()
+#define RP_CALLBACK() rp_callback()
+#define RP_START() rp_start()
+#define RP_STOP() rp_stop()
+#define RP_RESUME() rp_resume()
+#define RP_RECORD_LINE(steps, usec) if (rp.state == RP_RECORD) { rp_record_line(steps, usec);}
+#define RP_RECORD_DWELL(usec) if (rp.state == RP_RECORD) { rp_record_dwell(usec);}
+#define RP_RECORD_COMMAND(func, value, bits) if (rp.state == RP_RECORD) { rp_record_command(func, value, bits);}
+#define RP_RECORD_BLOCK() if (rp.state == RP_RECORD) { rp_record_block();}
+#define RP_ABANDON() if (rp.state == RP_RECORD) { rp_abandon();}
+
+#else
+
+#define RP_REPLAYING() (false)
+#define RP_RUNNING() (false)
+#define RP_EXEC() (STAT_NOOP)
+#define RP_CALLBACK() (STAT_NOOP)
+#define RP_START() (false)
+#define RP_STOP()
+#define RP_RESUME() (false)
+#define RP_RECORD_LINE(steps, usec)
+#define RP_RECORD_DWELL(usec)
+#define RP_RECORD_COMMAND(func, value, bits)
+#define RP_RECORD_BLOCK()
+#define RP_ABANDON()
+
+#endif // __SEGMENT_REPLAY
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: REPLAY_H_ONCE
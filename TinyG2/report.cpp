@@ -27,10 +27,13 @@
 
 #include "tinyg2.h"
 #include "config.h"
+#include "controller.h"
+#include "hardware.h"
 #include "report.h"
 #include "json_parser.h"
 #include "text_parser.h"
 #include "planner.h"
+#include "canonical_machine.h"
 #include "settings.h"
 #include "util.h"
 #include "xio.h"
@@ -43,15 +46,56 @@ extern "C"{
 
 srSingleton_t sr;
 qrSingleton_t qr;
+erSingleton_t er;
+leSingleton_t le;
+
+static struct pqSingleton {		// state of a planner queue dump - see pq_get()
+	uint8_t request;			// TRUE while a dump is being sent
+	uint16_t rows;				// rows sent so far
+	mpBuf_t *bf;				// next buffer to send
+} pq;
 
 /**** Exception Messages ************************************************************
- * rpt_exception() - generate an exception message - always in JSON format
- * rpt_er()		   - send a bogus exception report for testing purposes (it's not real)
+ * rpt_exception()			- queue an exception message - may be called from interrupts
+ * rpt_exception_callback() - send the oldest exception message - always in JSON format
+ * rpt_er()					- send a bogus exception report for testing purposes (it's not real)
+ *
+ *	See report.h for the ring. The throttle is not waited on in alarm, as the alarm
+ *	idler stops the TX callback that would drain it - the write sends it instead.
  */
 void rpt_exception(uint8_t status)
 {
-	printf_P(PSTR("{\"er\":{\"fb\":%0.2f,\"st\":%d,\"msg\":\"%s\"}}\n"),
-		TINYG_FIRMWARE_BUILD, status, get_status_message(status));
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	erEntry_t *last = &er.ring[(er.head + ER_RING_SIZE - 1) % ER_RING_SIZE];
+	if ((er.head != er.tail) && (last->status == status)) {
+		if (last->count < UINT16_MAX) { last->count++;}
+	} else if (((er.head + 1) % ER_RING_SIZE) == er.tail) {
+		er.lost++;
+	} else {
+		er.ring[er.head].status = status;
+		er.ring[er.head].count = 1;
+		er.ring[er.head].ms = SysTickTimer.getValue();
+		er.head = (er.head + 1) % ER_RING_SIZE;
+	}
+	__set_PRIMASK(primask);
+	controller_request_task(TASK_EXCEPTION);
+}
+
+stat_t rpt_exception_callback()
+{
+	if (er.head == er.tail) { return (STAT_NOOP);}
+	if ((SysTickTimer.getValue() - er.report_ms) < ER_REPORT_MS) { return (STAT_OK);}
+	if ((cm_get_machine_state() != MACHINE_ALARM) && (xio_tx_throttled() == true)) { return (STAT_OK);}
+
+	__disable_irq();
+	erEntry_t e = er.ring[er.tail];						// copied first, so it can still be counted
+	er.tail = (er.tail + 1) % ER_RING_SIZE;
+	__enable_irq();
+	er.report_ms = SysTickTimer.getValue();
+	printf_P(PSTR("{\"er\":{\"fb\":%0.2f,\"st\":%d,\"msg\":\"%s\",\"n\":%u,\"t\":%lu}}\n"),
+		TINYG_FIRMWARE_BUILD, e.status, get_status_message(e.status), e.count, (unsigned long)e.ms);
+	return (STAT_OK);
 }
 
 stat_t rpt_er(cmdObj_t *cmd)
@@ -68,7 +112,7 @@ stat_t rpt_er(cmdObj_t *cmd)
  *	These messages are always in JSON format to allow UIs to sync
  */
 
-void _startup_helper(stat_t status, const char *msg)
+void _startup_helper(stat_t status, const char *msg, uint8_t boot)
 {
 #ifndef __SUPPRESS_STARTUP_MESSAGES
 	js.json_footer_depth = JSON_FOOTER_DEPTH;	//++++ temporary until changeover is complete
@@ -78,6 +122,7 @@ void _startup_helper(stat_t status, const char *msg)
 	cmd_add_object((const char_t *)"hp");		// hardware platform
 	cmd_add_object((const char_t *)"hv");		// hardware version
 //	cmd_add_object((const char_t *)"id");		// hardware ID
+	if (boot == true) { cmd_add_object((const char_t *)"boot");}	// boot phase times
 	cmd_add_string((const char_t *)"msg", (const char_t *)msg);	// startup message
 	json_print_response(status);
 #endif
@@ -85,20 +130,39 @@ void _startup_helper(stat_t status, const char *msg)
 
 void rpt_print_initializing_message(void)
 {
-	_startup_helper(STAT_INITIALIZING, PSTR(INIT_MESSAGE));
+	_startup_helper(STAT_INITIALIZING, PSTR(INIT_MESSAGE), false);
 }
 
 void rpt_print_loading_configs_message(void)
 {
-	_startup_helper(STAT_INITIALIZING, PSTR("Loading configs from EEPROM"));
+	_startup_helper(STAT_INITIALIZING, PSTR("Loading configs from EEPROM"), false);
 }
 
 void rpt_print_system_ready_message(void)
 {
-	_startup_helper(STAT_OK, PSTR("SYSTEM READY"));
+	_startup_helper(STAT_OK, PSTR("SYSTEM READY"), true);
 	if (cfg.comm_mode == TEXT_MODE) { text_response(STAT_OK, (char_t *)"");}// prompt
 }
 
+/*
+ * rpt_get_boot() - return the boot phase times as [usb,hw,cfg,drv,mach,last,ready]
+ *
+ *	Each is the ms from the start of main() to the end of the phase (see csBootPhase).
+ *	Ready is when the host connected and SYSTEM READY went out, timed by SysTick.
+ */
+stat_t rpt_get_boot(cmdObj_t *cmd)
+{
+	char_t buf[80];
+	char_t *ptr = buf;
+
+	for (uint8_t i=0; i<BOOT_PHASES; i++) {
+		ptr += sprintf((char *)ptr, "%0.1f,", (float)cs.boot_cycles[i] / (F_CPU / 1000));
+	}
+	sprintf((char *)ptr, "%lu", (unsigned long)cs.boot_ready_ms);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
 /*****************************************************************************
  * Status Reports
  *
@@ -163,6 +227,7 @@ void sr_init_status_report()
 		cmd_persist(cmd);								// conditionally persist - automatic by cmd_persis()
 		cmd->index++;									// increment SR NVM index
 	}
+	sr_compile_status_report();
 }
 
 /* 
@@ -176,7 +241,7 @@ stat_t sr_set_status_report(cmdObj_t *cmd)
 	index_t sr_start = cmd_get_index((const char_t *)"",(const char_t *)"se00");// set first SR persistence index
 
 	for (uint8_t i=0; i<CMD_STATUS_REPORT_LEN; i++) {
-		if (((cmd = cmd->nx) == NULL) || (cmd->objtype == TYPE_EMPTY)) { break;}
+		if (((cmd = cmd_next(cmd)) == NULL) || (cmd->objtype == TYPE_EMPTY)) { break;}
 		if ((cmd->objtype == TYPE_BOOL) && (fp_TRUE(cmd->value))) {
 			status_report_list[i] = cmd->index;
 			cmd->value = cmd->index;					// persist the index as the value
@@ -189,10 +254,69 @@ stat_t sr_set_status_report(cmdObj_t *cmd)
 	}
 	if (elements == 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
 	memcpy(sr.status_report_list, status_report_list, sizeof(status_report_list));
+	sr_compile_status_report();
 	sr_populate_unfiltered_status_report();			// return current values
 	return (STAT_OK);
 }
 
+/* 
+ * sr_compile_status_report() - build the SR element descriptors from the SR list
+ *
+ *	Call this any time sr.status_report_list changes. Resolves the tokens, groups and 
+ *	precision for each element once so the report functions only have to fetch the 
+ *	values. Also invalidates the filtered report values so the next report is complete.
+ *
+ *	Elements read by the modal getters below are marked modal - see 
+ *	sr_populate_filtered_status_report().
+ */
+static uint8_t _is_modal(const fptrCmd get)
+{
+	return ((get == cm_get_line)  || (get == cm_get_mline) || (get == cm_get_unit) || 
+			(get == cm_get_coor)  || (get == cm_get_momo)  || (get == cm_get_plan) ||
+			(get == cm_get_path)  || (get == cm_get_dist)  || (get == cm_get_frmo) ||
+			(get == cm_get_ofs));
+}
+
+static void _compile_item(srItem_t *item, const index_t index)
+{
+	item->index = index;
+	item->precision = (int8_t)cfgArray[index].precision;
+	item->modal = _is_modal((fptrCmd)cfgArray[index].get);
+	item->listed = false;
+	strcpy_P(item->token, cfgArray[index].token);	// full token - same result as flattening the group
+	if (cfgArray[index].flags & F_NOSTRIP) {
+		item->group[0] = NUL;
+	} else {
+		strcpy_P(item->group, cfgArray[index].group);
+	}
+}
+
+static void _mark_listed_items(srGroup_t *g)
+{
+	for (uint8_t i=0; i<g->items; i++) {
+		g->item[i].listed = false;
+		for (uint8_t j=0; j<sr.status_report_items; j++) {
+			if (sr.status_report_item[j].index == g->item[i].index) { g->item[i].listed = true;}
+		}
+	}
+}
+
+void sr_compile_status_report()
+{
+	sr.status_report_index = cmd_get_index((const char_t *)"", (const char_t *)"sr");
+	sr.status_report_items = 0;
+
+	for (uint8_t i=0; i < CMD_STATUS_REPORT_LEN; i++) {
+		index_t index = sr.status_report_list[i];
+		if ((index == 0) || (index >= cmd_index_max())) { break;}
+
+		_compile_item(&sr.status_report_item[sr.status_report_items++], index);
+		sr.status_report_value[i] = -1234567;			// force the element into the next filtered report
+	}
+	for (uint8_t g=0; g<SR_GROUPS; g++) { _mark_listed_items(&sr.group[g]);}
+	SR_MODAL_CHANGED();
+}
+
 /* 
  * sr_request_status_report()	- request a status report to run after minimum interval
  * sr_status_report_callback()	- main loop callback to send a report if one is ready
@@ -210,32 +334,75 @@ stat_t sr_request_status_report(uint8_t request_type)
 	if (request_type == SR_IMMEDIATE_REQUEST) {
 //		sr.status_report_systick = SysTickTimer_getValue();
 		sr.status_report_systick = SysTickTimer.getValue();
+		SR_MODAL_CHANGED();						// a state change - cycle end, command, hold...
 	}
 	if ((request_type == SR_TIMED_REQUEST) && (sr.status_report_requested == false)) {
 //		sr.status_report_systick = SysTickTimer_getValue() + sr.status_report_interval;
-		sr.status_report_systick = SysTickTimer.getValue() + sr.status_report_interval;
+		sr.status_report_systick = SysTickTimer.getValue() + sr.status_report_stretch;
 	}
 	sr.status_report_requested = true;
+	controller_request_task(TASK_STATUS_REPORT);
 	return (STAT_OK);
 }
 
+/*
+ * _adapt_interval() - stretch the timed interval while the parser is behind, else relax it
+ */
+static void _adapt_interval()
+{
+	uint32_t interval_max = max(sr.status_report_interval_max, sr.status_report_interval);
+
+	if ((cm.motion_state == MOTION_RUN) &&
+		(mp_get_planner_buffers_available() > (PLANNER_BUFFER_POOL_SIZE / 2)) &&
+		(xio_get_rx_bufcount() >= SR_PRESSURE_RX_CHARS)) {
+		sr.status_report_stretch = min(sr.status_report_stretch * 2, interval_max);
+	} else {
+		sr.status_report_stretch = max(sr.status_report_stretch / 2, sr.status_report_interval);
+	}
+}
+
+static uint8_t _groups_due(uint32_t now)
+{
+	uint8_t due = 0;
+	for (uint8_t g=0; g<SR_GROUPS; g++) {
+		if ((sr.group[g].interval != 0) && (sr.group[g].items != 0) && (now >= sr.group[g].systick)) {
+			due |= (1 << g);
+		}
+	}
+	return (due);
+}
+
 stat_t sr_status_report_callback() 		// called by controller dispatcher
 {
 	if (sr.status_report_verbosity == SR_OFF) return (STAT_NOOP);
 	if (sr.status_report_requested == false) return (STAT_NOOP);
 //	if (SysTickTimer_getValue() < sr.status_report_systick) return (STAT_NOOP);
-	if (SysTickTimer.getValue() < sr.status_report_systick) return (STAT_NOOP);
+	uint32_t now = SysTickTimer.getValue();
+	uint8_t groups_due = (sr.status_report_verbosity == SR_FILTERED) ? _groups_due(now) : 0;
+	if ((now < sr.status_report_systick) && (groups_due == 0)) return (STAT_OK);	// not idle - waiting to report
+	if (xio_tx_throttled() == true) return (STAT_OK);	// hold the report until output drains
+
+	xio_set_tx_port(XIO_PORT_TELEMETRY);	// reports go to the telemetry port if there is one
 
+	if (now < sr.status_report_systick) {	// only subscription groups are due
+		if (sr_populate_group_report(groups_due) == true) {
+			cmd_print_list(STAT_OK, TEXT_INLINE_PAIRS, JSON_OBJECT_FORMAT);
+		}
+		xio_set_tx_port(XIO_PORT_PRIMARY);
+		return (STAT_OK);
+	}
 	sr.status_report_requested = false;		// disable reports until requested again
+	_adapt_interval();
 
-	if (sr.status_report_verbosity == SR_VERBOSE) {
+	if (sr.status_report_verbosity == SR_BINARY) {
+		sr_run_binary_status_report();
+	} else if (sr.status_report_verbosity == SR_VERBOSE) {
 		sr_populate_unfiltered_status_report();
-	} else {
-		if (sr_populate_filtered_status_report() == false) {	// no new data
-			return (STAT_OK);
-		}
+		cmd_print_list(STAT_OK, TEXT_INLINE_PAIRS, JSON_OBJECT_FORMAT);
+	} else if (sr_populate_filtered_status_report() == true) {	// only if there is new data
+		cmd_print_list(STAT_OK, TEXT_INLINE_PAIRS, JSON_OBJECT_FORMAT);
 	}
-	cmd_print_list(STAT_OK, TEXT_INLINE_PAIRS, JSON_OBJECT_FORMAT);
+	xio_set_tx_port(XIO_PORT_PRIMARY);
 	return (STAT_OK);
 }
 
@@ -249,30 +416,40 @@ stat_t sr_run_text_status_report()
 	return (STAT_OK);
 }
 
+/*
+ * _sr_get_element() - load a cmdObj from a compiled SR descriptor and get its value
+ */
+static void _sr_get_element(cmdObj_t *cmd, const srItem_t *item)
+{
+	cmd->objtype = TYPE_EMPTY;
+	cmd->index = item->index;
+	cmd->value = 0;
+	cmd->precision = item->precision;
+	cmd->stringp = NULL;
+	memcpy(cmd->token, item->token, sizeof(item->token));
+	memcpy(cmd->group, item->group, sizeof(item->group));
+	((fptrCmd)cfgArray[item->index].get)(cmd);	// populate the value
+}
+
 /*
  * sr_populate_unfiltered_status_report() - populate cmdObj body with status values
  *
  *	Designed to be run as a response; i.e. have a "r" header and a footer.
+ *	Uses the SR descriptors compiled by sr_compile_status_report()
  */
 
 stat_t sr_populate_unfiltered_status_report()
 {
-	const char_t sr_str[] = "sr";
-	char_t tmp[CMD_TOKEN_LEN+1];
 	cmdObj_t *cmd = cmd_reset_list();		// sets *cmd to the start of the body
 
 	cmd->objtype = TYPE_PARENT; 			// setup the parent object
-	strcpy(cmd->token, sr_str);
-	cmd->index = cmd_get_index((const char_t *)"", sr_str);// set the index - may be needed by calling function
-	cmd = cmd->nx;							// no need to check for NULL as list has just been reset
+	strcpy(cmd->token, "sr");
+	cmd->index = sr.status_report_index;	// set the index - may be needed by calling function
+	cmd = cmd_next(cmd);							// no need to check for NULL as list has just been reset
 
-	for (uint8_t i=0; i<CMD_STATUS_REPORT_LEN; i++) {
-		if ((cmd->index = sr.status_report_list[i]) == 0) { break;}
-		cmd_get_cmdObj(cmd);
-		strcpy(tmp, cmd->group);			// concatenate groups and tokens
-		strcat(tmp, cmd->token);
-		strcpy(cmd->token, tmp);
-		if ((cmd = cmd->nx) == NULL) 
+	for (uint8_t i=0; i<sr.status_report_items; i++) {
+		_sr_get_element(cmd, &sr.status_report_item[i]);
+		if ((cmd = cmd_next(cmd)) == NULL) 
 			return (cm_alarm(STAT_BUFFER_FULL_FATAL));	// should never be NULL unless SR length exceeds available buffer array
 	}
 	return (STAT_OK);
@@ -284,50 +461,135 @@ stat_t sr_populate_unfiltered_status_report()
  *	Designed to be displayed as a JSON object; i;e; no footer or header
  *	Returns 'true' if the report has new data, 'false' if there is nothing to report.
  *
- *	NOTE: Unlike sr_populate_unfiltered_status_report(), this function does NOT set 
- *	the SR index, which is a relatively expensive operation. In current use this 
- *	doesn't matter, but if the caller assumes its set it may lead to a side-effect (bug)
+ *	Values are compared against the values sent in the previous report. Elements 
+ *	that have not changed re-use the same cmdObj for the next element.
  *
- *	NOTE: Room for improvement - look up the SR index initially and cache it, use the 
- *		  cached value for all remaining reports.
+ *	The modal elements - line number, units, coordinate system, motion mode and the 
+ *	like - change only with an input line, a block or command starting in the runtime, 
+ *	a motion state change or an immediate report request, which all call 
+ *	SR_MODAL_CHANGED(). They are not fetched at all unless it was called since the last
+ *	report, so the timed reports during a move fetch little more than the positions, 
+ *	velocity and states. The flag is cleared before the values are fetched, so a change
+ *	while the report is built is in this report or the next.
+ *
+ *	The subscription groups are checked with the list, leaving out their elements that
+ *	are in it. Once the cmd list is full the elements left over keep their old values,
+ *	so they are sent in the next report.
  */
-uint8_t sr_populate_filtered_status_report()
+static cmdObj_t *_sr_start_report()
 {
-	const char_t sr_str[] = "sr";
-	uint8_t has_data = false;
-	char_t tmp[CMD_TOKEN_LEN+1];
 	cmdObj_t *cmd = cmd_reset_list();		// sets cmd to the start of the body
 
 	cmd->objtype = TYPE_PARENT; 			// setup the parent object
-	strcpy(cmd->token, sr_str);
-//	cmd->index = cmd_get_index((const char_t *)"", sr_str);// OMITTED - set the index - may be needed by calling function
-	cmd = cmd->nx;							// no need to check for NULL as list has just been reset
+	strcpy(cmd->token, "sr");
+	cmd->index = sr.status_report_index;
+	return (cmd_next(cmd));					// no need to check for NULL as list has just been reset
+}
 
-	for (uint8_t i=0; i<CMD_STATUS_REPORT_LEN; i++) {
-		if ((cmd->index = sr.status_report_list[i]) == 0) { break;}
+static uint8_t _sr_add_changed(cmdObj_t **cmd, const srItem_t *item, float *value, uint8_t items,
+							   uint8_t modal_changed, uint8_t with_list)
+{
+	uint8_t has_data = false;
 
-		cmd_get_cmdObj(cmd);
-		if (fp_EQ(cmd->value, sr.status_report_value[i])) {
-			cmd->objtype = TYPE_EMPTY;
+	for (uint8_t i=0; (i<items) && (*cmd != NULL); i++) {
+		if ((item[i].modal == true) && (modal_changed == false)) { continue;}
+		if ((item[i].listed == true) && (with_list == true)) { continue;}
+		_sr_get_element(*cmd, &item[i]);
+		if (fp_EQ((*cmd)->value, value[i])) {
+			(*cmd)->objtype = TYPE_EMPTY;
 			continue;
-		} else {
-			strcpy(tmp, cmd->group);		// flatten out groups
-			strcat(tmp, cmd->token);
-			strcpy(cmd->token, tmp);
-			sr.status_report_value[i] = cmd->value;
-			if ((cmd = cmd->nx) == NULL) return (false); // should never be NULL unless SR length exceeds available buffer array
-			has_data = true;
 		}
+		value[i] = (*cmd)->value;
+		*cmd = cmd_next(*cmd);				// NULL if the list is full
+		has_data = true;
+	}
+	return (has_data);
+}
+
+uint8_t sr_populate_filtered_status_report()
+{
+	uint8_t has_data = false;
+	uint8_t modal_changed = sr.modal_changed;
+	sr.modal_changed = false;
+	uint32_t now = SysTickTimer.getValue();
+	cmdObj_t *cmd = _sr_start_report();
+
+	has_data |= _sr_add_changed(&cmd, sr.status_report_item, sr.status_report_value,
+								sr.status_report_items, modal_changed, false);
+	for (uint8_t g=0; g<SR_GROUPS; g++) {
+		srGroup_t *group = &sr.group[g];
+		group->systick = now + group->interval;
+		has_data |= _sr_add_changed(&cmd, group->item, group->value, group->items, modal_changed, true);
 	}
 	return (has_data);
 }
 
+/*
+ * sr_populate_group_report() - populate cmdObj body with the subscription groups that are due
+ *
+ *	Run between reports of the sr list. The modal elements are left to the next report
+ *	of the list, which is the one that takes SR_MODAL_CHANGED().
+ */
+uint8_t sr_populate_group_report(uint8_t groups)
+{
+	uint8_t has_data = false;
+	uint32_t now = SysTickTimer.getValue();
+	cmdObj_t *cmd = _sr_start_report();
+
+	for (uint8_t g=0; g<SR_GROUPS; g++) {
+		if ((groups & (1 << g)) == 0) { continue;}
+		srGroup_t *group = &sr.group[g];
+		group->systick = now + group->interval;
+		has_data |= _sr_add_changed(&cmd, group->item, group->value, group->items, false, false);
+	}
+	return (has_data);
+}
+
+/* 
+ * sr_run_binary_status_report() - send the SR list as a binary frame (see report.h)
+ *
+ *	Values are fetched straight from the compiled SR descriptors into a scratch cmdObj;
+ *	the cmd list is not touched. The whole frame goes out in a single USB write.
+ */
+stat_t sr_run_binary_status_report()
+{
+	uint8_t frame[SR_BINARY_FRAME_MAX];
+	uint8_t *ptr = &frame[SR_BINARY_HEADER_LEN];
+	cmdObj_t cmd;
+
+	cmd.pv = false;
+	cmd.nx = false;
+	cmd.depth = 1;
+	for (uint8_t i=0; i<sr.status_report_items; i++) {
+		_sr_get_element(&cmd, &sr.status_report_item[i]);
+		memcpy(ptr, &cmd.value, sizeof(float));	// the ARM is little-endian
+		ptr += sizeof(float);
+	}
+	sr.status_report_sequence++;
+	frame[0] = SR_BINARY_SYNC;
+	frame[1] = (uint8_t)((ptr + 2) - &frame[2]);		// sequence through checksum
+	frame[2] = (uint8_t)(sr.status_report_sequence & 0xFF);
+	frame[3] = (uint8_t)(sr.status_report_sequence >> 8);
+	frame[4] = sr.status_report_items;
+
+	uint16_t checksum = compute_fletcher16(&frame[2], ptr - &frame[2]);
+	*ptr++ = (uint8_t)(checksum & 0xFF);
+	*ptr++ = (uint8_t)(checksum >> 8);
+
+	write(frame, ptr - frame);
+	return (STAT_OK);
+}
+
 /* 
  * Wrappers and Setters - for calling from cmdArray table
  *
  * sr_get()		- run status report
  * sr_set()		- set status report elements
  * sr_set_si()	- set status report interval
+ * sr_set_sv()	- set status report verbosity
+ *
+ *	The minimum interval is lower in binary mode as those reports are cheap to generate.
+ *	Leaving binary mode pulls the interval back up to the normal minimum.
  */
 
 stat_t sr_get(cmdObj_t *cmd) { return (sr_populate_unfiltered_status_report());}
@@ -335,15 +597,96 @@ stat_t sr_set(cmdObj_t *cmd) { return (sr_set_status_report(cmd));}
 
 stat_t sr_set_si(cmdObj_t *cmd)
 {
-	if (cmd->value < STATUS_REPORT_MIN_MS) { cmd->value = STATUS_REPORT_MIN_MS;}
+	float min_ms = (sr.status_report_verbosity == SR_BINARY) ? STATUS_REPORT_BINARY_MIN_MS : STATUS_REPORT_MIN_MS;
+	if (cmd->value < min_ms) { cmd->value = min_ms;}
 	sr.status_report_interval = (uint32_t)cmd->value;
+	sr.status_report_stretch = sr.status_report_interval;
+	return(STAT_OK);
+}
+
+stat_t sr_set_sim(cmdObj_t *cmd)
+{
+	set_int(cmd);
+	sr.status_report_stretch = sr.status_report_interval;
 	return(STAT_OK);
 }
 
+stat_t sr_set_sv(cmdObj_t *cmd)
+{
+	if (cmd->value > SR_BINARY) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	sr.status_report_verbosity = (uint8_t)cmd->value;
+	cmd->objtype = TYPE_INTEGER;
+	if ((sr.status_report_verbosity != SR_BINARY) && (sr.status_report_interval < STATUS_REPORT_MIN_MS)) {
+		sr.status_report_interval = STATUS_REPORT_MIN_MS;
+	}
+	sr.status_report_stretch = sr.status_report_interval;
+	return (STAT_OK);
+}
+
+/*
+ * sr_get_sg()	- report the elements of a subscription group and their values
+ * sr_set_sg()	- set the elements of a subscription group, and report them
+ * sr_set_sgi()	- set the interval of a subscription group (0 = on change)
+ *
+ *	The group is the digit in the token - sg1 to sg3, sg1i to sg3i.
+ */
+
+stat_t sr_get_sg(cmdObj_t *cmd)
+{
+	srGroup_t *group = &sr.group[cmd->token[2] - '1'];
+	char_t token[CMD_TOKEN_LEN+1];
+	index_t index = cmd->index;
+
+	strcpy(token, cmd->token);
+	cmd = cmd_reset_list();
+	cmd->objtype = TYPE_PARENT;
+	strcpy(cmd->token, token);
+	cmd->index = index;
+	for (uint8_t i=0; i<group->items; i++) {
+		if ((cmd = cmd_next(cmd)) == NULL) { return (STAT_BUFFER_FULL);}
+		_sr_get_element(cmd, &group->item[i]);
+	}
+	return (STAT_OK);
+}
+
+stat_t sr_set_sg(cmdObj_t *cmd)
+{
+	srGroup_t *group = &sr.group[cmd->token[2] - '1'];
+	index_t list[SR_GROUP_ITEMS];
+	uint8_t items = 0;
+	cmdObj_t *parent = cmd;
+
+	while (((cmd = cmd_next(cmd)) != NULL) && (cmd->objtype != TYPE_EMPTY)) {
+		if (cmd->objtype != TYPE_BOOL) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+		if (fp_FALSE(cmd->value)) { continue;}
+		if (items == SR_GROUP_ITEMS) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+		list[items++] = cmd->index;
+	}
+	for (uint8_t i=0; i<items; i++) {
+		_compile_item(&group->item[i], list[i]);
+		group->value[i] = -1234567;					// force the element into the next report
+	}
+	group->items = items;
+	group->systick = SysTickTimer.getValue();
+	_mark_listed_items(group);
+	return (sr_get_sg(parent));						// return current values
+}
+
+stat_t sr_set_sgi(cmdObj_t *cmd)
+{
+	if (cmd->value < 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if ((cmd->value > 0) && (cmd->value < STATUS_REPORT_GROUP_MIN_MS)) { cmd->value = STATUS_REPORT_GROUP_MIN_MS;}
+	sr.group[cmd->token[2] - '1'].interval = (uint32_t)cmd->value;
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
 /*****************************************************************************
  * Queue Reports
  *
  * qr_get() 					- run a queue report (as data)
+ * qr_get_qt()					- get ms of motion queued in the planner
+ * qr_get_qs()					- get the planner starvation flag
  * qr_clear_queue_report()		- wipe stored values
  * qr_request_queue_report()	- request a queue report with current values
  * qr_queue_report_callback()	- run the queue report w/stored values
@@ -356,6 +699,20 @@ stat_t qr_get(cmdObj_t *cmd)
 	return (STAT_OK);
 }
 
+stat_t qr_get_qt(cmdObj_t *cmd) 
+{
+	cmd->value = mp_get_planner_time_in_queue();
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+stat_t qr_get_qs(cmdObj_t *cmd) 
+{
+	cmd->value = (float)mp_get_planner_starving();
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
 void qr_clear_queue_report()
 {
 	qr.request = false;
@@ -368,6 +725,8 @@ void qr_request_queue_report(int8_t buffers)
 	if (qr.queue_report_verbosity == QR_OFF) return;
 
 	qr.buffers_available = mp_get_planner_buffers_available();
+	qr.time_in_queue = mp_get_planner_time_in_queue();
+	qr.starving = mp_get_planner_starving();
 
 	if (buffers > 0) {
 		qr.buffers_added += buffers;
@@ -376,12 +735,15 @@ void qr_request_queue_report(int8_t buffers)
 	}
 	qr.prev_available = qr.buffers_available;
 	qr.request = true;
+	controller_request_task(TASK_QUEUE_REPORT);
 }
 
 uint8_t qr_queue_report_callback()
 {
 	if (qr.request == false) { return (STAT_NOOP);}
+	if (xio_tx_throttled() == true) { return (STAT_OK);}	// hold the report until output drains
 	qr.request = false;
+	xio_set_tx_port(XIO_PORT_TELEMETRY);	// reports go to the telemetry port if there is one
 
 	if (cfg.comm_mode == TEXT_MODE) {
 		if (qr.queue_report_verbosity == QR_SINGLE) {
@@ -389,6 +751,9 @@ uint8_t qr_queue_report_callback()
 		} else  {
 			if (qr.queue_report_verbosity == QR_TRIPLE) {
 				fprintf(stderr, "qr:%d,added:%d,removed:%d\n", qr.buffers_available, qr.buffers_added,qr.buffers_removed);
+			} else if (qr.queue_report_verbosity == QR_TIMED) {
+				fprintf(stderr, "qr:%d,added:%d,removed:%d,ms:%lu,starving:%d\n", qr.buffers_available, 
+					qr.buffers_added, qr.buffers_removed, (unsigned long)qr.time_in_queue, qr.starving);
 			}
 		}
 	} else {
@@ -398,9 +763,14 @@ uint8_t qr_queue_report_callback()
 			if (qr.queue_report_verbosity == QR_TRIPLE) {
 				fprintf(stderr, "{\"qr\":[%d,%d,%d]}\n", qr.buffers_available, qr.buffers_added,qr.buffers_removed);
 				qr_clear_queue_report();
+			} else if (qr.queue_report_verbosity == QR_TIMED) {
+				fprintf(stderr, "{\"qr\":[%d,%d,%d,%lu,%d]}\n", qr.buffers_available, qr.buffers_added,
+					qr.buffers_removed, (unsigned long)qr.time_in_queue, qr.starving);
+				qr_clear_queue_report();
 			}
 		}
 	}
+	xio_set_tx_port(XIO_PORT_PRIMARY);
 	return (STAT_OK);
 }
 /* Alternate Formulation - using cmdObj list
@@ -409,7 +779,7 @@ uint8_t qr_queue_report_callback()
 //	cmdObj_t *cmd = cmd_reset_list();		// normally you do a list reset but the following is more time efficient
 	cmdObj_t *cmd = cmd_body;
 	cmd_reset_obj(cmd);
-	cmd->nx = NULL;							// terminate the list
+	cmd->nx = false;							// terminate the list
 
 	// make a qr object and print it
 	sprintf_P(cmd->token, PSTR("qr"));
@@ -419,6 +789,184 @@ uint8_t qr_queue_report_callback()
 	return (STAT_OK);
 */
 
+/*****************************************************************************
+ * Line Events
+ *
+ * le_line_finished()		- queue an event for a finished line - called from the exec
+ * le_line_event_callback()	- send the queued events
+ * le_get_lef()				- get the number of flagged lines waiting
+ * le_set_lef()				- flag a line, or clear the flags with 0
+ *
+ *	See report.h. The ring has one writer at each end - the exec fills it and the
+ *	callback drains it - so neither side needs interrupts off. The flags are set with
+ *	interrupts off, as the exec clears them.
+ */
+
+void le_line_finished(uint32_t linenum)
+{
+	if ((linenum == 0) || (linenum == le.last)) { return;}
+
+	uint8_t send = ((le.interval != 0) && ((linenum % le.interval) == 0));
+	for (uint8_t i=0; (i<LE_FLAGS) && (le.flagged != 0); i++) {
+		if (le.flag[i] == linenum) {
+			le.flag[i] = 0;
+			le.flagged--;
+			send = true;
+		}
+	}
+	if (send == false) { return;}
+
+	le.last = linenum;
+	uint8_t next = (le.head + 1) % LE_RING_SIZE;
+	if (next == le.tail) {
+		le.lost++;
+		return;
+	}
+	le.ring[le.head] = linenum;
+	le.head = next;
+	controller_request_task(TASK_LINE_EVENT);
+}
+
+stat_t le_line_event_callback()
+{
+	if (le.head == le.tail) { return (STAT_NOOP);}
+	if (xio_tx_throttled() == true) { return (STAT_OK);}	// hold the events until output drains
+	xio_set_tx_port(XIO_PORT_TELEMETRY);	// reports go to the telemetry port if there is one
+
+	while (le.tail != le.head) {
+		unsigned long linenum = (unsigned long)le.ring[le.tail];
+		le.tail = (le.tail + 1) % LE_RING_SIZE;
+		if (cfg.comm_mode == TEXT_MODE) {
+			fprintf(stderr, "le:%lu\n", linenum);
+		} else {
+			fprintf(stderr, "{\"le\":%lu}\n", linenum);
+		}
+	}
+	xio_set_tx_port(XIO_PORT_PRIMARY);
+	return (STAT_OK);
+}
+
+stat_t le_get_lef(cmdObj_t *cmd)
+{
+	cmd->value = (float)le.flagged;
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+stat_t le_set_lef(cmdObj_t *cmd)
+{
+	if (cmd->value < 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	uint32_t linenum = (uint32_t)cmd->value;
+	stat_t status = STAT_OK;
+
+	__disable_irq();
+	if (linenum == 0) {
+		for (uint8_t i=0; i<LE_FLAGS; i++) { le.flag[i] = 0;}
+		le.flagged = 0;
+	} else {
+		uint8_t slot = LE_FLAGS;
+		for (uint8_t i=0; i<LE_FLAGS; i++) {
+			if (le.flag[i] == linenum) { slot = i; break;}		// already flagged
+			if ((le.flag[i] == 0) && (slot == LE_FLAGS)) { slot = i;}
+		}
+		if (slot == LE_FLAGS) {
+			status = STAT_BUFFER_FULL;
+		} else if (le.flag[slot] == 0) {
+			le.flag[slot] = linenum;
+			le.flagged++;
+		}
+	}
+	__enable_irq();
+	return (status);
+}
+
+/*****************************************************************************
+ * Planner Queue Dumps
+ *
+ * pq_get()			  - start a dump of the planner queue, return the buffers queued
+ * pq_dump_callback() - send the next PQ_ROWS_PER_PASS rows of the dump
+ *
+ *	The rows are the buffers as mp_dump_plan_buffer_by_index() shows them under
+ *	__DEBUG, cut down to what a host needs to draw the plan. They are read live as
+ *	they are sent, not snapshotted, so a dump shows each buffer as it was planned
+ *	when its row went out - the planner may have replanned the earlier ones since.
+ *	Buffers that run and are freed during a dump are skipped and the dump carries
+ *	on from the running buffer. It ends at the first buffer not yet queued, and
+ *	never sends more than a full pool of rows. A new {"pq":""} restarts it.
+ */
+
+stat_t pq_get(cmdObj_t *cmd)
+{
+	pq.bf = mb.r;
+	pq.rows = 0;
+	pq.request = true;
+	controller_request_task(TASK_PLAN_DUMP);
+	cmd->value = (float)(PLANNER_BUFFER_POOL_SIZE - mp_get_planner_buffers_available());
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+stat_t pq_dump_callback()
+{
+	if (pq.request == false) { return (STAT_NOOP);}
+	if (xio_tx_throttled() == true) { return (STAT_OK);}	// hold the dump until output drains
+	xio_set_tx_port(XIO_PORT_TELEMETRY);
+
+	for (uint8_t i=0; i<PQ_ROWS_PER_PASS; i++) {
+		mpBuf_t *bf = pq.bf;
+		if (bf->buffer_state == MP_BUFFER_EMPTY) { bf = mb.r;}	// run since the last pass
+		if ((bf->buffer_state < MP_BUFFER_QUEUED) || (pq.rows >= PLANNER_BUFFER_POOL_SIZE)) {
+			if (cfg.comm_mode == TEXT_MODE) {
+				fprintf(stderr, "pqe:%d\n", pq.rows);
+			} else {
+				fprintf(stderr, "{\"pqe\":%d}\n", pq.rows);
+			}
+			pq.request = false;
+			break;
+		}
+		mpBuf_t tz;									// lengths may not be planned yet
+		mp_get_trapezoid(bf, &tz);
+		const char *fmt = (cfg.comm_mode == TEXT_MODE) ?
+			"pqr:%d,%lu,%d,%0.3f,%0.1f,%0.1f,%0.1f,%0.3f,%0.3f,%0.3f,%d\n" :
+			"{\"pqr\":[%d,%lu,%d,%0.3f,%0.1f,%0.1f,%0.1f,%0.3f,%0.3f,%0.3f,%d]}\n";
+		fprintf(stderr, fmt, pq.rows, (unsigned long)bf->gm->linenum, bf->move_type, bf->length,
+			tz.entry_velocity, tz.cruise_velocity, tz.exit_velocity,
+			tz.head_length, tz.body_length, tz.tail_length, bf->replannable);
+		pq.rows++;
+		pq.bf = mp_get_next_buffer(bf);
+	}
+	xio_set_tx_port(XIO_PORT_PRIMARY);
+	return (STAT_OK);
+}
+
+/*****************************************************************************
+ * Job Reports
+ *
+ * rpt_request_job_report()	 - request a job report (called by the exec at M2 and M30)
+ * rpt_job_report_callback() - send the job counters as {"js":{...}} - see mp_reset_job_stats()
+ */
+
+static volatile uint8_t job_report_requested;
+
+void rpt_request_job_report()
+{
+	job_report_requested = true;
+	controller_request_task(TASK_JOB_REPORT);
+}
+
+stat_t rpt_job_report_callback()
+{
+	if (job_report_requested == false) { return (STAT_NOOP);}
+	if (xio_tx_throttled() == true) { return (STAT_OK);}	// hold the report until output drains
+	job_report_requested = false;
+	xio_set_tx_port(XIO_PORT_TELEMETRY);	// reports go to the telemetry port if there is one
+	cmd_reset_list();
+	cmd_add_object((const char_t *)"js");
+	cmd_print_list(STAT_OK, TEXT_MULTILINE_FORMATTED, JSON_OBJECT_FORMAT);
+	xio_set_tx_port(XIO_PORT_PRIMARY);
+	return (STAT_OK);
+}
+
 /***********************************************************************************
  * TEXT MODE SUPPORT
  * Functions to print variables from the cfgArray table
@@ -429,21 +977,36 @@ uint8_t qr_queue_report_callback()
  * sr_print_sr() - produce SR text output
  */
 static const char fmt_si[] PROGMEM = "[si]  status interval%14.0f ms\n";
-static const char fmt_sv[] PROGMEM = "[sv]  status report verbosity%6d [0=off,1=filtered,2=verbose]\n";
+static const char fmt_sim[] PROGMEM = "[sim] status interval max%10.0f ms [0=fixed]\n";
+static const char fmt_sv[] PROGMEM = "[sv]  status report verbosity%6d [0=off,1=filtered,2=verbose,3=binary]\n";
 
 void sr_print_sr(cmdObj_t *cmd) { sr_populate_unfiltered_status_report();}
 void sr_print_si(cmdObj_t *cmd) { text_print_flt(cmd, fmt_si);}
+void sr_print_sim(cmdObj_t *cmd) { text_print_flt(cmd, fmt_sim);}
 void sr_print_sv(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sv);}
 
 /*
  * qr_print_qr() - produce QR text output
  */
 static const char fmt_qr[] PROGMEM = "qr:%d\n";
-static const char fmt_qv[] PROGMEM = "[qv]  queue report verbosity%7d [0=off,1=filtered,2=verbose]\n";
+static const char fmt_qt[] PROGMEM = "qt:%lu ms\n";
+static const char fmt_qs[] PROGMEM = "qs:%lu\n";
+static const char fmt_qv[] PROGMEM = "[qv]  queue report verbosity%7d [0=off,1=filtered,2=verbose,3=timed]\n";
 
 void qr_print_qr(cmdObj_t *cmd) { text_print_int(cmd, fmt_qr);}
+void qr_print_qt(cmdObj_t *cmd) { text_print_int(cmd, fmt_qt);}
+void qr_print_qs(cmdObj_t *cmd) { text_print_int(cmd, fmt_qs);}
 void qr_print_qv(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_qv);}
 
+static const char fmt_pq[] PROGMEM = "pq:%lu buffers queued\n";
+void pq_print_pq(cmdObj_t *cmd) { text_print_int(cmd, fmt_pq);}
+
+static const char fmt_lei[] PROGMEM = "[lei] line event interval%10lu lines [0=flagged lines only]\n";
+void le_print_lei(cmdObj_t *cmd) { text_print_int(cmd, fmt_lei);}
+
+static const char fmt_boot[] PROGMEM = "Boot times: %s [usb,hw,cfg,drv,mach,last,ready mSec]\n";
+void rpt_print_boot(cmdObj_t *cmd) { fprintf_P(stderr, fmt_boot, *cmd->stringp);}
+
 #endif // __TEXT_MODE
 
 /****************************************************************************
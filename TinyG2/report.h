@@ -41,9 +41,95 @@ extern "C"{
 enum srVerbosity {								// status report enable and verbosity
 	SR_OFF = 0,									// no reports
 	SR_FILTERED,								// reports only values that have changed from the last report
-	SR_VERBOSE									// reports all values specified
+	SR_VERBOSE,									// reports all values specified
+	SR_BINARY									// reports all values specified as a binary frame
 };
 
+/* Planner queue dumps - {"pq":""} answers with the number of buffers queued, then
+ * sends one row per buffer from the running one onward, a few per controller pass:
+ *
+ *	  {"pqr":[n,line,type,length,entry_v,cruise_v,exit_v,head,body,tail,replannable]}
+ *
+ * and ends with {"pqe":rows}. Text mode sends the same values as pqr:... and pqe:...
+ */
+#define PQ_ROWS_PER_PASS		4				// rows sent per pass of the controller loop
+
+/* Binary status report frame - all multi-byte fields are little-endian
+ *
+ *	  [SYNC][length][sequence(2)][count][value(4)]...[value(4)][checksum(2)]
+ *
+ *	  SYNC		STX (0x02) - marks the start of a binary frame in the output stream
+ *	  length	number of bytes from sequence through checksum, inclusive
+ *	  sequence	uint16 incremented for every frame sent. Detects dropped frames
+ *	  count		number of values that follow, in SR list order ($sr)
+ *	  value		IEEE-754 single precision float for each SR element
+ *	  checksum	Fletcher-16 over sequence through the last value. Low byte is sum1
+ */
+#define SR_BINARY_SYNC			0x02			// ASCII STX
+#define SR_BINARY_HEADER_LEN	5				// sync, length, sequence, count
+#define SR_BINARY_FRAME_MAX		(SR_BINARY_HEADER_LEN + (CMD_STATUS_REPORT_LEN * sizeof(float)) + 2)
+
+/* Exception reports - rpt_exception() records the status in a ring and the controller
+ * sends it from rpt_exception_callback(), at most one report every ER_REPORT_MS. Raising
+ * an exception is a few stores with interrupts off, so it is safe from the exec and the
+ * loader, and a burst of them can't hold up the main loop on USB. An exception that
+ * repeats the last one still waiting is counted in it, not queued again. One that finds
+ * the ring full is counted in {"erl":""}. The report is:
+ *
+ *	{"er":{"fb":<build>,"st":<status>,"msg":"<message>","n":<times raised>,"t":<ms>}}
+ *
+ * where t is the SysTick time it was first raised.
+ */
+#define ER_RING_SIZE			8				// exceptions waiting to be sent
+#define ER_REPORT_MS			20				// least time between exception reports
+
+typedef struct erEntry {
+	uint8_t status;
+	uint16_t count;								// times raised while it waited
+	uint32_t ms;								// SysTick time it was first raised
+} erEntry_t;
+
+typedef struct erSingleton {
+	volatile uint8_t head;						// next entry to fill
+	volatile uint8_t tail;						// next entry to send
+	uint32_t lost;								// erl - exceptions dropped with the ring full
+	uint32_t report_ms;							// SysTick time of the last report
+	erEntry_t ring[ER_RING_SIZE];
+} erSingleton_t;
+
+/* Line events - {"le":n} is sent as the runtime finishes line n, so a host can wait on a
+ * line having run - to fire a camera, change a part or move on in a job - without polling
+ * the status report for it. A line is finished when mp_free_run_buffer() retires its last
+ * planner buffer and the next buffer is another line's or the queue is empty. The event
+ * is recorded there, at exec level, and sent from le_line_event_callback() on the
+ * telemetry port. Text mode sends le:n.
+ *
+ *	$lei		send an event for every line number that is a multiple of N, 0=off
+ *	{"lef":n}	send an event when line n finishes, whatever $lei is. Up to LE_FLAGS
+ *				lines may be flagged, each is cleared as its event is sent. {"lef":0}
+ *				clears them all, {"lef":""} returns how many are waiting
+ *	{"lel":""}	events lost with the ring full
+ *
+ * Line 0 - blocks with no N word - never sends an event, and a line is not sent twice in
+ * a row. The retired buffer's moves have all been handed to the steppers, but its last
+ * segment is still stepping as the event is sent - a few ms. An arc or spline that the
+ * planner outruns retires its buffers early, so a line made of many buffers can finish
+ * before all of it is queued - its event is sent then, and not again.
+ */
+#define LE_RING_SIZE			16				// events waiting to be sent
+#define LE_FLAGS				4				// lines that may be flagged with {"lef":n}
+
+typedef struct leSingleton {
+	uint32_t interval;							// lei - send every Nth line, 0 = flagged lines only
+	volatile uint32_t flag[LE_FLAGS];			// lef - flagged lines, 0 = free (cleared by the exec)
+	volatile uint8_t flagged;					// number of flagged lines
+	uint32_t last;								// last line sent (written by the exec only)
+	uint32_t lost;								// lel - events dropped with the ring full
+	volatile uint8_t head;						// next entry to fill (written by the exec only)
+	volatile uint8_t tail;						// next entry to send (written by the callback only)
+	uint32_t ring[LE_RING_SIZE];
+} leSingleton_t;
+
 enum cmStatusReportRequest {
 	SR_TIMED_REQUEST = 0,						// request a status report at next timer interval
 	SR_IMMEDIATE_REQUEST						// request a status report ASAP
@@ -52,20 +138,71 @@ enum cmStatusReportRequest {
 enum qrVerbosity {								// planner queue enable and verbosity
 	QR_OFF = 0,									// no response is provided
 	QR_SINGLE,									// queue depth reported
-	QR_TRIPLE									// queue depth reported for buffers, buffers added, buffered removed
+	QR_TRIPLE,									// queue depth reported for buffers, buffers added, buffered removed
+	QR_TIMED									// as triple, plus ms of motion queued and the starvation flag
 };
 
+typedef struct srItem {							// compiled status report element - see sr_compile_status_report()
+	index_t index;								// cfgArray index of the element
+	int8_t precision;							// display precision from cfgArray
+	uint8_t modal;								// TRUE if it only changes when SR_MODAL_CHANGED() is called
+	uint8_t listed;								// TRUE if a group element is also in the sr list
+	char_t token[CMD_TOKEN_LEN+1];				// full (flattened) token
+	char_t group[CMD_GROUP_LEN+1];				// group as cmd_get_cmdObj() would leave it
+} srItem_t;
+
+/* Subscription groups - {"sg1":{"posx":true,"posy":true}} to {"sg3":{...}} each pick up to
+ * SR_GROUP_ITEMS elements with their own rate, {"sg1i":20} in ms. A group at 0 is sent on
+ * change: it is checked with the sr list, at $si and on each state change. A group with a
+ * rate is also checked at that rate while reports run, so an HMI can have the positions at
+ * 50Hz and the line, state and coolant only as they change, without the formatting and the
+ * bytes of the whole list at the fastest rate.
+ *
+ * Groups work with filtered reports ($sv=1) and keep their own last values, so an element is
+ * sent when it has changed since its group last sent it. The groups that are due go out in
+ * the same {"sr":{...}} object as the sr list, and an element in both the list and a group is
+ * sent once. A group is cleared by setting it with no true elements. The groups are not
+ * persisted - the host subscribes when it connects.
+ */
+#define SR_GROUPS				3				// subscription groups, sg1 to sg3
+#define SR_GROUP_ITEMS			8				// elements per subscription group
+
+typedef struct srGroup {
+	uint32_t interval;							// sgNi - ms between checks, 0 = only with the sr list
+	uint32_t systick;							// SysTick value for the next check
+	uint8_t items;								// number of compiled elements below
+	srItem_t item[SR_GROUP_ITEMS];
+	float value[SR_GROUP_ITEMS];				// values last sent by this group
+} srGroup_t;
+
+/* Adaptive interval - timed reports are sent at $si until the parser is the bottleneck:
+ * the machine is moving, the planner is less than half full and at least SR_PRESSURE_RX_CHARS
+ * of input are waiting to be parsed. Each timed report sent under that pressure doubles the
+ * interval, up to $sim ms, and each one sent without it halves it back towards $si. Reports
+ * asked for ({"sr":""}, ?) and state changes are still sent at once, and subscription groups
+ * keep their own rates. $sim at or below $si keeps the interval fixed.
+ */
+#define SR_PRESSURE_RX_CHARS	64				// input waiting that counts as a backlog
+
 typedef struct srSingleton {
 
 	/*** config values (PUBLIC) ***/
 	uint8_t status_report_verbosity;
 	uint32_t status_report_interval;					// in milliseconds
+	uint32_t status_report_interval_max;				// sim - ms the interval may stretch to under load
 
 	/*** runtime values (PRIVATE) ***/
 	uint8_t status_report_requested;					// flag that SR has been requested
+	volatile uint8_t modal_changed;						// a modal element may have changed - see SR_MODAL_CHANGED()
 	uint32_t status_report_systick;						// SysTick value for next status report
+	uint32_t status_report_stretch;						// timed interval in force - $si to $sim
 	index_t status_report_list[CMD_STATUS_REPORT_LEN];	// status report elements to report
 	float status_report_value[CMD_STATUS_REPORT_LEN];	// previous values for filtered reporting
+	index_t status_report_index;						// cached index of the "sr" token
+	uint16_t status_report_sequence;					// binary status report frame sequence number
+	uint8_t status_report_items;						// number of compiled elements in the list below
+	srItem_t status_report_item[CMD_STATUS_REPORT_LEN];	// compiled status report list
+	srGroup_t group[SR_GROUPS];							// subscription groups
 
 } srSingleton_t;
 
@@ -76,10 +213,12 @@ typedef struct qrSingleton {		// data for queue reports
 
 	/*** runtime values (PRIVATE) ***/
 	uint8_t request;				// set to true to request a report
-	uint8_t buffers_available;		// stored value used by callback
-	uint8_t prev_available;			// used to filter reports
-	uint8_t buffers_added;			// buffers added since last report
-	uint8_t buffers_removed;		// buffers removed since last report
+	uint16_t buffers_available;		// stored value used by callback
+	uint16_t prev_available;		// used to filter reports
+	uint16_t buffers_added;			// buffers added since last report
+	uint16_t buffers_removed;		// buffers removed since last report
+	float time_in_queue;			// stored value used by callback - ms of motion queued
+	uint8_t starving;				// stored value used by callback - see mp_get_planner_starving()
 
 } qrSingleton_t;
 
@@ -87,51 +226,94 @@ typedef struct qrSingleton {		// data for queue reports
 
 extern srSingleton_t sr;
 extern qrSingleton_t qr;
+extern erSingleton_t er;
+extern leSingleton_t le;
 
 /**** Function Prototypes ****/
 
 void rpt_print_message(char *msg);
 void rpt_exception(uint8_t status);
+stat_t rpt_exception_callback(void);
 
 stat_t rpt_er(cmdObj_t *cmd);
 void rpt_print_loading_configs_message(void);
 void rpt_print_initializing_message(void);
 void rpt_print_system_ready_message(void);
+stat_t rpt_get_boot(cmdObj_t *cmd);
+void rpt_request_job_report(void);
+stat_t rpt_job_report_callback(void);
 
 void sr_init_status_report(void);
+void sr_compile_status_report(void);
 
 stat_t sr_set_status_report(cmdObj_t *cmd);
 stat_t sr_request_status_report(uint8_t request_type);
 stat_t sr_status_report_callback(void);
 stat_t sr_run_text_status_report(void);
+stat_t sr_run_binary_status_report(void);
 stat_t sr_populate_unfiltered_status_report(void);
 uint8_t sr_populate_filtered_status_report(void);
+uint8_t sr_populate_group_report(uint8_t groups);
+
+// Marks the modal elements (line, unit, coor, momo...) for the next filtered report. Called 
+// for each input line, each block or command the runtime starts and each motion state change
+#define SR_MODAL_CHANGED() (sr.modal_changed = true)
 
 stat_t sr_get(cmdObj_t *cmd);
 stat_t sr_set(cmdObj_t *cmd);
 stat_t sr_set_si(cmdObj_t *cmd);
+stat_t sr_set_sim(cmdObj_t *cmd);
+stat_t sr_set_sv(cmdObj_t *cmd);
+stat_t sr_get_sg(cmdObj_t *cmd);
+stat_t sr_set_sg(cmdObj_t *cmd);
+stat_t sr_set_sgi(cmdObj_t *cmd);
 //void sr_print_sr(cmdObj_t *cmd);
 
 stat_t qr_get(cmdObj_t *cmd);
+stat_t qr_get_qt(cmdObj_t *cmd);
+stat_t qr_get_qs(cmdObj_t *cmd);
 void qr_clear_queue_report(void);
 void qr_request_queue_report(int8_t buffers);
 stat_t qr_queue_report_callback(void);
 
+stat_t pq_get(cmdObj_t *cmd);
+stat_t pq_dump_callback(void);
+
+void le_line_finished(uint32_t linenum);
+stat_t le_line_event_callback(void);
+stat_t le_get_lef(cmdObj_t *cmd);
+stat_t le_set_lef(cmdObj_t *cmd);
+
+// TRUE if any line could send an event - tested by the exec before it looks at the next buffer
+#define LE_ARMED() ((le.interval != 0) || (le.flagged != 0))
+
 #ifdef __TEXT_MODE
 
 	void sr_print_sr(cmdObj_t *cmd);
 	void sr_print_si(cmdObj_t *cmd);
+	void sr_print_sim(cmdObj_t *cmd);
 	void sr_print_sv(cmdObj_t *cmd);
 	void qr_print_qv(cmdObj_t *cmd);
 	void qr_print_qr(cmdObj_t *cmd);
+	void qr_print_qt(cmdObj_t *cmd);
+	void qr_print_qs(cmdObj_t *cmd);
+	void pq_print_pq(cmdObj_t *cmd);
+	void le_print_lei(cmdObj_t *cmd);
+	void rpt_print_boot(cmdObj_t *cmd);
 
 #else
 
 	#define sr_print_sr tx_print_stub
 	#define sr_print_si tx_print_stub
+	#define sr_print_sim tx_print_stub
 	#define sr_print_sv tx_print_stub
 	#define qr_print_qv tx_print_stub
 	#define qr_print_qr tx_print_stub
+	#define qr_print_qt tx_print_stub
+	#define qr_print_qs tx_print_stub
+	#define pq_print_pq tx_print_stub
+	#define le_print_lei tx_print_stub
+	#define rpt_print_boot tx_print_stub
 
 #endif // __TEXT_MODE
 
@@ -0,0 +1,247 @@
+/*
+ * selfbench.cpp - on-target microbenchmarks of the planner, parser and reports
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See selfbench.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "controller.h"
+#include "text_parser.h"
+#include "json_parser.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "planner.h"
+#include "report.h"
+#include "util.h"
+#include "selfbench.h"
+
+#ifdef __SELF_BENCHMARK
+
+#include "hardware.h"				// DWT cycle counter
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+sbSingleton_t sb;
+
+static const char *const sb_lines[SB_LINES] = {	// the first moves of gcode_braid2d.h as increments
+	"G1X0.327Y-0.002", "X0.327Y-0.005", "X0.326Y-0.008", "X0.324Y-0.012",
+	"X0.322Y-0.016", "X0.320Y-0.018", "X0.316Y-0.022", "X0.312Y-0.026"
+};
+
+static float sb_position[AXES];		// planning position the run started from
+
+static void _format_result(char_t *buf);
+
+/*
+ * sb_get_cycles() - return the free-running DWT cycle counter
+ * _record() - accumulate one measurement of a timed function
+ */
+uint32_t sb_get_cycles() { return (HW_DWT_CYCCNT);}
+
+static void _record(uint8_t timer, uint32_t cycles)
+{
+	sb.count[timer]++;
+	sb.cycles[timer] += cycles;
+}
+
+/*
+ * _flush() - discard the blocks queued by the run once the planner is near full
+ *
+ *	The model and planning positions go back to where the run started, so the moves
+ *	stay short whatever the number of repeats.
+ */
+static void _flush(uint8_t force)
+{
+	if ((force == false) && (mp_planner_has_room(PLANNER_BUFFER_HEADROOM) == true)) { return;}
+	mp_flush_planner();
+	copy_axis_vector(mm.position, sb_position);
+	copy_axis_vector(gmx.position, sb_position);
+}
+
+/*
+ * _time_aline() - time mp_aline() on a zigzag in XY, and the trapezoid and junction of each block
+ * _time_parse() - time gc_gcode_parser() on the sample lines, in G91
+ * _time_serialize() - time json_serialize() on a full status report
+ * _time_index() - time cmd_get_index() on every token in the config table
+ */
+static void _time_aline(uint16_t repeats)
+{
+	gm.motion_mode = MOTION_MODE_STRAIGHT_FEED;
+	gm.inverse_feed_rate_mode = false;
+	gm.feed_rate = 600;
+	for (uint16_t i=0; i<repeats; i++) {
+		_flush(false);
+		copy_axis_vector(gm.target, gmx.position);
+		gm.target[AXIS_X] += SB_ALINE_STEP;
+		gm.target[AXIS_Y] += (i & 1) ? -SB_ALINE_STEP : SB_ALINE_STEP;
+		cm_set_move_times(&gm);
+
+		uint32_t start = sb_get_cycles();
+		stat_t status = mp_aline(&gm);
+		_record(SB_ALINE, sb_get_cycles() - start);
+		if (status != STAT_OK) { continue;}
+		copy_axis_vector(gmx.position, gm.target);
+
+		uint32_t cycles[2];
+		mp_bench_block(cycles);
+		_record(SB_TRAPEZOID, cycles[0]);
+		if (i != 0) { _record(SB_JUNCTION, cycles[1]);}	// the first block has none before it
+	}
+	_flush(true);
+}
+
+static void _time_parse(uint16_t repeats)
+{
+	char_t line[24];
+
+	gmx.modal.distance_mode = INCREMENTAL_MODE;
+	for (uint16_t i=0; i<repeats; i++) {
+		for (uint8_t j=0; j<SB_LINES; j++) {
+			_flush(false);
+			strncpy((char *)line, sb_lines[j], sizeof(line));	// the parser works in place
+			uint32_t start = sb_get_cycles();
+			gc_gcode_parser(line);
+			_record(SB_PARSE, sb_get_cycles() - start);
+		}
+	}
+	_flush(true);
+}
+
+static void _time_serialize(uint16_t repeats)
+{
+	sr_populate_unfiltered_status_report();
+	for (uint16_t i=0; i<repeats; i++) {
+		uint32_t start = sb_get_cycles();
+		json_serialize(cmd_header, cs.out_buf, sizeof(cs.out_buf));
+		_record(SB_SERIALIZE, sb_get_cycles() - start);
+	}
+	cmd_reset_list();
+}
+
+static void _time_index()
+{
+	char_t token[CMD_TOKEN_LEN+1];
+
+	for (index_t i=0; i<cmd_index_max(); i++) {
+		strcpy_P(token, cfgArray[i].token);			// always terminated
+		if (token[0] == '\0') continue;
+		uint32_t start = sb_get_cycles();
+		cmd_get_index((const char_t *)"", token);
+		_record(SB_INDEX, sb_get_cycles() - start);
+	}
+}
+
+/*
+ * sb_callback() - run the benchmarks asked for by {"bench":n} and send the result
+ *
+ *	The exec is held for the whole run, and the Gcode model, planning position and
+ *	cycle state are saved around it. The index is timed once - it is every token.
+ */
+stat_t sb_callback()
+{
+	if (sb.requested == 0) { return (STAT_NOOP);}
+	uint16_t repeats = sb.requested;
+	sb.requested = 0;
+
+	GCodeState_t gm_saved = gm;
+	GCodeStateX_t gmx_saved = gmx;
+	uint8_t machine_state = cm.machine_state;
+	uint8_t cycle_state = cm.cycle_state;
+	copy_axis_vector(sb_position, mm.position);
+
+	hw_start_cycle_counter();
+	memset(sb.count, 0, sizeof(sb.count));
+	memset(sb.cycles, 0, sizeof(sb.cycles));
+
+	sb.running = true;
+	_time_aline(repeats);
+	_time_parse(repeats);
+	_time_serialize(repeats);
+	_time_index();
+	sb.running = false;
+
+	gm = gm_saved;
+	gmx = gmx_saved;
+	cm.machine_state = machine_state;
+	cm.cycle_state = cycle_state;
+
+	sb.result_mhz = SystemCoreClock / 1000000;
+	sb.result_fws = (EFC0->EEFC_FMR & EEFC_FMR_FWS_Msk) >> EEFC_FMR_FWS_Pos;
+	for (uint8_t t=0; t<SB_TIMERS; t++) {
+		sb.result[t] = (sb.count[t] == 0) ? 0 : (uint32_t)(sb.cycles[t] / sb.count[t]);
+	}
+	char_t buf[96];
+	_format_result(buf);
+	printf_P(PSTR("{\"bench\":[%s]}\n"), (char *)buf);
+	return (STAT_OK);
+}
+
+static void _format_result(char_t *buf)
+{
+	sprintf((char *)buf, "%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu",
+		(unsigned long)sb.result_mhz, (unsigned long)sb.result_fws,
+		(unsigned long)sb.result[SB_TRAPEZOID], (unsigned long)sb.result[SB_JUNCTION],
+		(unsigned long)sb.result[SB_ALINE], (unsigned long)sb.result[SB_SERIALIZE],
+		(unsigned long)sb.result[SB_INDEX], (unsigned long)sb.result[SB_PARSE]);
+}
+
+/*
+ * sb_set_bench() - run the benchmarks n times ({"bench":n})
+ * sb_get_bench() - return the last result as [mhz,fws,trapezoid,junction,aline,json,index,parse]
+ */
+stat_t sb_set_bench(cmdObj_t *cmd)
+{
+	if ((cmd->value < 1) || (cmd->value > SB_REPEATS_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if ((cm.machine_state == MACHINE_ALARM) || (cm.cycle_state != CYCLE_OFF) ||
+		(cm.motion_state != MOTION_STOP) || (gc_get_queued_blocks() != 0) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	sb.requested = (uint16_t)cmd->value;
+	return (STAT_OK);
+}
+
+stat_t sb_get_bench(cmdObj_t *cmd)
+{
+	char_t buf[96];
+
+	_format_result(buf);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_bench[] PROGMEM = "[%s%s] %s [mhz,fws,trapezoid,junction,aline,json,index,parse cycles]\n";
+
+void sb_print_bench(cmdObj_t *cmd) { fprintf_P(stderr, fmt_bench, cmd->group, cmd->token, *cmd->stringp);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SELF_BENCHMARK
@@ -0,0 +1,108 @@
+/*
+ * selfbench.h - on-target microbenchmarks of the planner, parser and reports
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The self benchmark is compiled in by __SELF_BENCHMARK in tinyg2.h. Unlike the startup
+ * benchmark (see benchmark.h) it is part of a working build - the machine runs as usual
+ * and {"bench":n} times the hot functions in place, so two builds, or one build at other
+ * flash wait states or clock settings, can be compared on the board in a few minutes:
+ *
+ *	{"bench":n}		run each benchmark n times - the machine must be idle
+ *	{"bench":""}	the last result - also sent as the run ends
+ *
+ *	{"bench":[mhz,fws,trapezoid,junction,aline,json,index,parse]}
+ *
+ *	mhz			core clock in MHz (SystemCoreClock)
+ *	fws			flash wait states of bank 0, where the code runs
+ *	trapezoid	_calculate_trapezoid() on a copy of each block planned by aline
+ *	junction	_get_junction_vmax() between each of those blocks and the one before
+ *	aline		mp_aline() on a synthetic G1 - a zigzag of short moves in XY
+ *	json		json_serialize() of the full status report
+ *	index		cmd_get_index() on every token in the config table
+ *	parse		gc_gcode_parser() on SB_LINES lines of gcode_braid2d.h, run in G91
+ *
+ * The last six are the average DWT cycles per call. The run is made from the controller
+ * on the pass after the command, as json_serialize() needs the command list. The exec is
+ * held for the whole run (see st_request_exec_move()), so the blocks that aline and the
+ * parser queue never move the machine - the planner is flushed as it fills, and the Gcode
+ * model, the planning position and the cycle state are put back at the end. Queue reports
+ * and the planner statistics see the blocks come and go.
+ */
+
+#ifndef SELFBENCH_H_ONCE
+#define SELFBENCH_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __SELF_BENCHMARK
+
+#define SB_REPEATS_MAX		1000		// longest run - {"bench":1000}
+#define SB_LINES			8			// sample Gcode lines parsed
+#define SB_ALINE_STEP		0.5			// mm per synthetic aline move
+
+enum sbTimer {							// functions timed - in result order
+	SB_TRAPEZOID = 0,
+	SB_JUNCTION,
+	SB_ALINE,
+	SB_SERIALIZE,
+	SB_INDEX,
+	SB_PARSE,
+	SB_TIMERS
+};
+
+typedef struct sbSingleton {
+	uint16_t requested;					// repeats asked for by {"bench":n}, 0 = none waiting
+	volatile uint8_t running;			// TRUE while the exec is held for the run
+	uint32_t count[SB_TIMERS];			// calls timed in the run
+	uint64_t cycles[SB_TIMERS];			// cycles spent in them
+	uint32_t result_mhz;				// bench - the last result
+	uint32_t result_fws;
+	uint32_t result[SB_TIMERS];			// average cycles per call
+} sbSingleton_t;
+
+extern sbSingleton_t sb;
+
+stat_t sb_callback(void);
+uint32_t sb_get_cycles(void);
+
+stat_t sb_set_bench(cmdObj_t *cmd);
+stat_t sb_get_bench(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void sb_print_bench(cmdObj_t *cmd);
+#else
+	#define sb_print_bench tx_print_stub
+#endif
+
+#define SB_RUNNING() (sb.running == true)
+#define SB_CALLBACK() sb_callback()
+
+#else
+
+#define SB_RUNNING() (false)
+#define SB_CALLBACK() (STAT_NOOP)
+
+#endif // __SELF_BENCHMARK
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: SELFBENCH_H_ONCE
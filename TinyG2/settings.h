@@ -42,8 +42,50 @@
 
 // Machine configuration settings
 #define CHORDAL_TOLERANCE 			0.001			// chord accuracy for arc drawing
+#define COALESCE_ANGLE				0.5				// max direction change (degrees) for merging G1 lines. 0 disables
+#define COALESCE_TOLERANCE			0.005			// max deviation (mm) of merged G1 lines from their chord
+#define PROBE_TOUCHES				2				// G38.2 slow retouches averaged after the fast approach. 0=none
+#define PRESSURE_ADVANCE_AXIS		AXIS_A			// extruder axis for pressure advance
+#define PRESSURE_ADVANCE_K			0				// pressure advance in seconds. 0 disables
 #define SWITCH_TYPE 				SW_NORMALLY_OPEN// one of: SW_NORMALLY_OPEN, SW_NORMALLY_CLOSED
 #define MOTOR_IDLE_TIMEOUT			2.00			// motor power timeout in seconds
+#define STEP_CORRECTION				0				// 1=correct lost DDA steps on the first move after idle
+#define STEP_DIR_SETUP				0				// microseconds from a dir change to the next step (0=one DDA tick)
+#define STEP_PULSE_HIGH				2.5				// step pulse width in microseconds
+#define STEP_PULSE_LOW				0				// minimum microseconds between step pulses to one motor
+#define EXEC_SLACK_LATE				1000			// exec slack in microseconds under which a segment counts as late
+#define MICROSTEP_MORPH_RATE		20000			// steps per second above which motors morph to $1mo microsteps
+#define KINEMATICS					KINEMATICS_CARTESIAN // see kinKinematics in kinematics.h
+#define DELTA_DIAGONAL_ROD			250.0			// delta diagonal rod length in mm
+#define DELTA_RADIUS				125.0			// delta tower to effector distance in mm
+#define RTCP_PIVOT_X				0.0				// machine position where the C axis crosses the A axis
+#define RTCP_PIVOT_Y				0.0
+#define RTCP_PIVOT_Z				0.0
+#define SURFACE_MAP_ENABLE			0				// 1=apply the probed surface map to Z
+#define SURFACE_MAP_X				0				// machine position of the first probe point in mm
+#define SURFACE_MAP_Y				0
+#define SURFACE_MAP_SPACING_X		10				// probe point spacing in mm
+#define SURFACE_MAP_SPACING_Y		10
+#define SURFACE_MAP_COLS			3				// probe points in X and Y (2 to SM_MAX_COLS/ROWS)
+#define SURFACE_MAP_ROWS			3
+#define SURFACE_MAP_CLEARANCE		0				// machine Z for moves between probe points in mm
+#define RASTER_AXIS					AXIS_X			// axis swept by raster rows
+#define RASTER_PITCH				0.1				// raster pixel pitch in mm
+#define RASTER_VELOCITY				3000			// raster sweep velocity in mm/min
+#define RASTER_OVERSCAN				5				// dark lead-in and lead-out of each row in mm
+#define SHAPER_TYPE					SHAPER_ZVD		// input shaper: SHAPER_ZV, SHAPER_ZVD, SHAPER_EI
+#define PSO_PULSE_WIDTH				20				// position synchronized output pulse in microseconds
+#define STEP_QUEUE_HOLD_TIME		0.2				// seconds a feedhold takes to stop a step queue run
+#define STRESS_STEP_RATE			50000			// steps per second per motor in the stress test (see stress.h)
+#define STRESS_LOAD					0				// stress test load: 1 = input lines, 2 = status reports, 3 = both
+#define SWO_PORTS_ON				0				// SWO trace ports to send, bit 0 is port 1 (see swo.h)
+#define SWO_BAUD					0				// SWO baud rate, 0 = set up by the debug probe
+#define SYNC_MODE					SYNC_OFF		// segment sync: SYNC_OFF, SYNC_MASTER, SYNC_SLAVE
+#define CHECKPOINT_INTERVAL			1.0				// seconds between job checkpoints (0=off)
+#define CHECKPOINT_REHOME_MARGIN	0				// mm short of the switch a fast re-home stops (0=off)
+#define SEGMENT_REPLAY_MODE			0				// 1 = record the stored program's segments and replay them (see replay.h)
+#define SEGMENT_REPLAY_HOLD_TIME	0.5				// seconds a feedhold takes to stop a replay
+#define MACHINE_PROFILE_BOOT		0				// machine profile loaded at reset (0=none, see machine_profile.h)
 
 // Communications and reporting settings
 #define COMM_MODE					TEXT_MODE		// one of: TEXT_MODE, JSON_MODE
@@ -53,13 +95,23 @@
 #define JSON_VERBOSITY				JV_VERBOSE		// one of: JV_SILENT, JV_FOOTER, JV_CONFIGS, JV_MESSAGES, JV_LINENUM, JV_VERBOSE
 #define JSON_FOOTER_DEPTH			0				// 0 = new style, 1 = old style
 //#define JSON_FOOTER_DEPTH			1				// 0 = new style, 1 = old style
+#define JSON_ACK_COALESCE			0				// Gcode lines per batched ack (0 = one response per line)
+#define LINE_FRAMING_MODE			0				// lfm - 1 = lines from USB carry a sequence number and checksum (see frame.h)
+#define UART1_MODE					0				// u1m - pendant port: 0=off, 1=RS-232, 2=RS-485 (see uart.h)
+#define UART1_BAUD					115200			// u1b
+#define UART2_MODE					0				// u2m - PLC port: 0=off, 1=RS-232
+#define UART2_BAUD					115200			// u2b
 
-#define SR_VERBOSITY				SR_FILTERED		// one of: SR_OFF, SR_FILTERED, SR_VERBOSE
+#define SR_VERBOSITY				SR_FILTERED		// one of: SR_OFF, SR_FILTERED, SR_VERBOSE, SR_BINARY
 #define STATUS_REPORT_MIN_MS		50				// milliseconds - enforces a viable minimum
+#define STATUS_REPORT_BINARY_MIN_MS	5				// milliseconds - minimum for binary status reports
+#define STATUS_REPORT_GROUP_MIN_MS	10				// milliseconds - minimum for subscription groups ($sg1i...)
 #define STATUS_REPORT_INTERVAL_MS	250				// milliseconds - set $SV=0 to disable
+#define STATUS_REPORT_INTERVAL_MAX_MS 1000			// milliseconds timed reports may stretch to while the parser is behind
 #define SR_DEFAULTS "line","posx","posy","posz","posa","feed","vel","unit","coor","dist","frmo","momo","stat"
 
-#define QR_VERBOSITY				QR_OFF			// one of: QR_OFF, QR_SINGLE, QR_TRIPLE
+#define QR_VERBOSITY				QR_OFF			// one of: QR_OFF, QR_SINGLE, QR_TRIPLE, QR_TIMED
+#define LINE_EVENT_INTERVAL			0				// lei - send {"le":n} for every Nth line, 0 = flagged lines only
 
 // Gcode startup defaults
 #define GCODE_DEFAULT_UNITS			MILLIMETERS		// MILLIMETERS or INCHES
@@ -67,6 +119,7 @@
 #define GCODE_DEFAULT_COORD_SYSTEM	G54				// G54, G55, G56, G57, G58 or G59
 #define GCODE_DEFAULT_PATH_CONTROL 	PATH_CONTINUOUS
 #define GCODE_DEFAULT_DISTANCE_MODE ABSOLUTE_MODE
+#define RAPID_MODE					RAPID_COORDINATED	// gtr - RAPID_COORDINATED or RAPID_DOGLEG (see cm_straight_traverse())
 
 // Comm mode and echo levels
 #define COM_IGNORE_CRLF				IGNORE_OFF		// 0=accept either CR or LF, 1=ignore CR, 2=ignoreLF
@@ -92,6 +145,374 @@
 
 /*** Handle optional modules that may not be in every machine ***/
 
+// Axes and motors the machine has - bit 0 is X (motor 1). The segment execution, 
+// junction, kinematics and stepper code drop the others at compile time, so an 
+// unused axis must be disabled ($xam=0) and an unused motor must not be mapped.
+#ifndef AXES_USED
+#define AXES_USED						0x3F				// X Y Z A B C
+#endif
+#ifndef MOTORS_USED
+#define MOTORS_USED						0x3F				// motors 1-6
+#endif
+#if ((AXES_USED & 0x07) != 0x07)
+#error "AXES_USED must include X, Y and Z"
+#endif
+#define AXIS_USED(axis) ((AXES_USED >> (axis)) & 1)
+#define MOTOR_USED(motor) ((MOTORS_USED >> (motor)) & 1)
+
+// If acceleration limits are not set the planner is jerk limited only
+#ifndef X_ACCEL_MAX
+#define X_ACCEL_MAX						0					// xac		mm/min^2
+#endif
+#ifndef Y_ACCEL_MAX
+#define Y_ACCEL_MAX						0
+#endif
+#ifndef Z_ACCEL_MAX
+#define Z_ACCEL_MAX						0
+#endif
+#ifndef A_ACCEL_MAX
+#define A_ACCEL_MAX						0					// aac		deg/min^2
+#endif
+#ifndef B_ACCEL_MAX
+#define B_ACCEL_MAX						0
+#endif
+#ifndef C_ACCEL_MAX
+#define C_ACCEL_MAX						0
+#endif
+
+// If homing groups are not set each axis is homed on its own
+#ifndef X_HOMING_GROUP
+#define X_HOMING_GROUP					0					// xhg		0=alone, else homed with same group
+#endif
+#ifndef Y_HOMING_GROUP
+#define Y_HOMING_GROUP					0
+#endif
+#ifndef Z_HOMING_GROUP
+#define Z_HOMING_GROUP					0
+#endif
+#ifndef A_HOMING_GROUP
+#define A_HOMING_GROUP					0
+#endif
+#ifndef B_HOMING_GROUP
+#define B_HOMING_GROUP					0
+#endif
+#ifndef C_HOMING_GROUP
+#define C_HOMING_GROUP					0
+#endif
+
+// If squaring switches are not set no axis is squared while homing
+#ifndef X_SQUARING_SWITCH
+#define X_SQUARING_SWITCH				0					// xsq		0=off, else 1 + switch of the 2nd motor
+#endif
+#ifndef Y_SQUARING_SWITCH
+#define Y_SQUARING_SWITCH				0
+#endif
+#ifndef Z_SQUARING_SWITCH
+#define Z_SQUARING_SWITCH				0
+#endif
+#ifndef A_SQUARING_SWITCH
+#define A_SQUARING_SWITCH				0
+#endif
+#ifndef B_SQUARING_SWITCH
+#define B_SQUARING_SWITCH				0
+#endif
+#ifndef C_SQUARING_SWITCH
+#define C_SQUARING_SWITCH				0
+#endif
+
+// If backlash is not set no axis is compensated
+#ifndef X_BACKLASH
+#define X_BACKLASH						0					// xbl		mm or deg taken up on a reversal
+#endif
+#ifndef Y_BACKLASH
+#define Y_BACKLASH						0
+#endif
+#ifndef Z_BACKLASH
+#define Z_BACKLASH						0
+#endif
+#ifndef A_BACKLASH
+#define A_BACKLASH						0
+#endif
+#ifndef B_BACKLASH
+#define B_BACKLASH						0
+#endif
+#ifndef C_BACKLASH
+#define C_BACKLASH						0
+#endif
+
+// If shaper frequencies are not set no axis is shaped
+#ifndef X_SHAPER_FREQ
+#define X_SHAPER_FREQ					0					// xif		Hz, 0=off
+#endif
+#ifndef Y_SHAPER_FREQ
+#define Y_SHAPER_FREQ					0
+#endif
+#ifndef Z_SHAPER_FREQ
+#define Z_SHAPER_FREQ					0
+#endif
+#ifndef A_SHAPER_FREQ
+#define A_SHAPER_FREQ					0
+#endif
+#ifndef B_SHAPER_FREQ
+#define B_SHAPER_FREQ					0
+#endif
+#ifndef C_SHAPER_FREQ
+#define C_SHAPER_FREQ					0
+#endif
+#ifndef X_SHAPER_DAMPING
+#define X_SHAPER_DAMPING				0.1					// xiz		damping ratio [0..1)
+#endif
+#ifndef Y_SHAPER_DAMPING
+#define Y_SHAPER_DAMPING				0.1
+#endif
+#ifndef Z_SHAPER_DAMPING
+#define Z_SHAPER_DAMPING				0.1
+#endif
+#ifndef A_SHAPER_DAMPING
+#define A_SHAPER_DAMPING				0.1
+#endif
+#ifndef B_SHAPER_DAMPING
+#define B_SHAPER_DAMPING				0.1
+#endif
+#ifndef C_SHAPER_DAMPING
+#define C_SHAPER_DAMPING				0.1
+#endif
+#ifndef A_ASYNC
+#define A_ASYNC							0					// aas		1=run by the aux queue
+#endif
+#ifndef B_ASYNC
+#define B_ASYNC							0
+#endif
+#ifndef C_ASYNC
+#define C_ASYNC							0
+#endif
+
+// If motor power levels are not set motors run at full Vref power and idle at a quarter
+#ifndef M1_POWER_LEVEL
+#define M1_POWER_LEVEL					1.0					// 1pl		Vref power running [0..1]
+#endif
+#ifndef M1_POWER_IDLE
+#define M1_POWER_IDLE					0.25				// 1pi		Vref power idle (power modes 2,3)
+#endif
+#ifndef M2_POWER_LEVEL
+#define M2_POWER_LEVEL					1.0
+#endif
+#ifndef M2_POWER_IDLE
+#define M2_POWER_IDLE					0.25
+#endif
+#ifndef M3_POWER_LEVEL
+#define M3_POWER_LEVEL					1.0
+#endif
+#ifndef M3_POWER_IDLE
+#define M3_POWER_IDLE					0.25
+#endif
+#ifndef M4_POWER_LEVEL
+#define M4_POWER_LEVEL					1.0
+#endif
+#ifndef M4_POWER_IDLE
+#define M4_POWER_IDLE					0.25
+#endif
+#ifndef M5_POWER_LEVEL
+#define M5_POWER_LEVEL					1.0
+#endif
+#ifndef M5_POWER_IDLE
+#define M5_POWER_IDLE					0.25
+#endif
+#ifndef M6_POWER_LEVEL
+#define M6_POWER_LEVEL					1.0
+#endif
+#ifndef M6_POWER_IDLE
+#define M6_POWER_IDLE					0.25
+#endif
+
+// Microstep morphing (see stepper.h) - no motor morphs
+#ifndef M1_MORPH_MICROSTEPS
+#define M1_MORPH_MICROSTEPS			0					// 1mo		microsteps above $msr, 0=off
+#endif
+#ifndef M2_MORPH_MICROSTEPS
+#define M2_MORPH_MICROSTEPS			0
+#endif
+#ifndef M3_MORPH_MICROSTEPS
+#define M3_MORPH_MICROSTEPS			0
+#endif
+#ifndef M4_MORPH_MICROSTEPS
+#define M4_MORPH_MICROSTEPS			0
+#endif
+#ifndef M5_MORPH_MICROSTEPS
+#define M5_MORPH_MICROSTEPS			0
+#endif
+#ifndef M6_MORPH_MICROSTEPS
+#define M6_MORPH_MICROSTEPS			0
+#endif
+
+// SPI motor drivers (see tmc2660.h) - CHOPCONF, SMARTEN and DRVCONF are written as is,
+// the stall switches are off and the stall thresholds are mid-range
+#ifndef TMC_CHOPPER_CONFIG
+#define TMC_CHOPPER_CONFIG				0x101B4				// spreadCycle, TBL=2 HDEC=0 HEND=3 HSTRT=3 TOFF=4
+#endif
+#ifndef TMC_SMART_ENERGY
+#define TMC_SMART_ENERGY				0x00000				// coolStep off
+#endif
+#ifndef TMC_DRIVER_CONFIG
+#define TMC_DRIVER_CONFIG				0x0F000				// full slope control, VSENSE=0 (RDSEL is set by tmc2660.cpp)
+#endif
+#ifndef M1_STALL_THRESHOLD
+#define M1_STALL_THRESHOLD				0					// 1sgt	stallGuard threshold [-64..63]
+#endif
+#ifndef M1_STALL_SWITCH
+#define M1_STALL_SWITCH					0					// 1ssw	switch closed by a stall, 0=none
+#endif
+#ifndef M2_STALL_THRESHOLD
+#define M2_STALL_THRESHOLD				0
+#endif
+#ifndef M2_STALL_SWITCH
+#define M2_STALL_SWITCH					0
+#endif
+#ifndef M3_STALL_THRESHOLD
+#define M3_STALL_THRESHOLD				0
+#endif
+#ifndef M3_STALL_SWITCH
+#define M3_STALL_SWITCH					0
+#endif
+#ifndef M4_STALL_THRESHOLD
+#define M4_STALL_THRESHOLD				0
+#endif
+#ifndef M4_STALL_SWITCH
+#define M4_STALL_SWITCH					0
+#endif
+#ifndef M5_STALL_THRESHOLD
+#define M5_STALL_THRESHOLD				0
+#endif
+#ifndef M5_STALL_SWITCH
+#define M5_STALL_SWITCH					0
+#endif
+#ifndef M6_STALL_THRESHOLD
+#define M6_STALL_THRESHOLD				0
+#endif
+#ifndef M6_STALL_SWITCH
+#define M6_STALL_SWITCH					0
+#endif
+
+// Quadrature encoders (see encoder.h) - no encoders, one count per step, no correction
+#ifndef M1_ENCODER
+#define M1_ENCODER						0					// 1enc	encoder on the motor, 0=none
+#endif
+#ifndef M1_ENCODER_COUNTS
+#define M1_ENCODER_COUNTS				1.0					// 1ecs	encoder counts per motor step
+#endif
+#ifndef M1_ENCODER_CORRECTION
+#define M1_ENCODER_CORRECTION			0					// 1ecm	most steps corrected per segment, 0=off
+#endif
+#ifndef M2_ENCODER
+#define M2_ENCODER						0
+#endif
+#ifndef M2_ENCODER_COUNTS
+#define M2_ENCODER_COUNTS				1.0
+#endif
+#ifndef M2_ENCODER_CORRECTION
+#define M2_ENCODER_CORRECTION			0
+#endif
+#ifndef M3_ENCODER
+#define M3_ENCODER						0
+#endif
+#ifndef M3_ENCODER_COUNTS
+#define M3_ENCODER_COUNTS				1.0
+#endif
+#ifndef M3_ENCODER_CORRECTION
+#define M3_ENCODER_CORRECTION			0
+#endif
+#ifndef M4_ENCODER
+#define M4_ENCODER						0
+#endif
+#ifndef M4_ENCODER_COUNTS
+#define M4_ENCODER_COUNTS				1.0
+#endif
+#ifndef M4_ENCODER_CORRECTION
+#define M4_ENCODER_CORRECTION			0
+#endif
+#ifndef M5_ENCODER
+#define M5_ENCODER						0
+#endif
+#ifndef M5_ENCODER_COUNTS
+#define M5_ENCODER_COUNTS				1.0
+#endif
+#ifndef M5_ENCODER_CORRECTION
+#define M5_ENCODER_CORRECTION			0
+#endif
+#ifndef M6_ENCODER
+#define M6_ENCODER						0
+#endif
+#ifndef M6_ENCODER_COUNTS
+#define M6_ENCODER_COUNTS				1.0
+#endif
+#ifndef M6_ENCODER_CORRECTION
+#define M6_ENCODER_CORRECTION			0
+#endif
+
+// Spindle encoder (see encoder.h) - none
+#ifndef SPINDLE_ENCODER
+#define SPINDLE_ENCODER					0					// sse	encoder on the spindle, 0=none
+#endif
+#ifndef SPINDLE_ENCODER_COUNTS
+#define SPINDLE_ENCODER_COUNTS			4096				// ssc	encoder counts per spindle revolution
+#endif
+
+// Analog inputs (see adc.h) - all off, readings in volts at the pin
+#ifndef ANALOG_FILTER
+#define ANALOG_FILTER					20					// anf	low pass time constant in ms, 0=off
+#endif
+#ifndef AN1_CHANNEL
+#define AN1_CHANNEL					0					// an1c	ADC channel + 1, 0=off
+#endif
+#ifndef AN1_SCALE
+#define AN1_SCALE						3.3				// an1s	reading at full scale
+#endif
+#ifndef AN1_OFFSET
+#define AN1_OFFSET						0					// an1o	reading at 0 counts
+#endif
+#ifndef AN2_CHANNEL
+#define AN2_CHANNEL					0
+#endif
+#ifndef AN2_SCALE
+#define AN2_SCALE						3.3
+#endif
+#ifndef AN2_OFFSET
+#define AN2_OFFSET						0
+#endif
+#ifndef AN3_CHANNEL
+#define AN3_CHANNEL					0
+#endif
+#ifndef AN3_SCALE
+#define AN3_SCALE						3.3
+#endif
+#ifndef AN3_OFFSET
+#define AN3_OFFSET						0
+#endif
+#ifndef AN4_CHANNEL
+#define AN4_CHANNEL					0
+#endif
+#ifndef AN4_SCALE
+#define AN4_SCALE						3.3
+#endif
+#ifndef AN4_OFFSET
+#define AN4_OFFSET						0
+#endif
+#ifndef LOAD_FEED_INPUT
+#define LOAD_FEED_INPUT				0					// ldi	analog input read as spindle load, 0=off
+#endif
+#ifndef LOAD_FEED_SETPOINT
+#define LOAD_FEED_SETPOINT				1.0				// lds	load to hold, in the input's units
+#endif
+#ifndef LOAD_FEED_GAIN
+#define LOAD_FEED_GAIN					0.5				// ldg	factor change per update at 100% load error
+#endif
+#ifndef LOAD_FEED_MIN
+#define LOAD_FEED_MIN					0.5				// ldn	lowest factor
+#endif
+#ifndef LOAD_FEED_MAX
+#define LOAD_FEED_MAX					1.0				// ldx	highest factor - above 1 speeds up light cuts
+#endif
+
 // If PWM_1 is not defined fill it with default values
 #ifndef	P1_PWM_FREQUENCY
 
@@ -106,5 +527,14 @@
 #define P1_CCW_PHASE_HI                 0.2
 #define P1_PWM_PHASE_OFF                0.1
 #endif//P1_PWM_FREQUENCY
+#ifndef TOOL_LENGTH_OFFSET
+#define TOOL_LENGTH_OFFSET				0					// tof1-tof8 tool table Z offsets for G43 H, in mm
+#endif
+#ifndef P1_LASER_MODE
+#define P1_LASER_MODE					0					// 1=scale PWM with velocity per segment
+#endif
+#ifndef P1_SPINDLE_ACCEL
+#define P1_SPINDLE_ACCEL				0					// RPM/sec - 0=feed moves don't wait for the spindle
+#endif
 
 #endif // End of include guard: SETTINGS_H_ONCE
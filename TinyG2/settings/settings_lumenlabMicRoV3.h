@@ -44,6 +44,9 @@
 #define JUNCTION_DEVIATION		0.05		// default value, in mm
 #define JUNCTION_ACCELERATION	200000		// centripetal acceleration around corners
 
+#define AXES_USED				0x07		// X Y Z - see settings.h
+#define MOTORS_USED				0x0F		// motors 1-4
+
 // *** motor settings ***
 
 #define M1_MOTOR_MAP 			AXIS_X		// 1ma
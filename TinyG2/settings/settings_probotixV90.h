@@ -46,6 +46,9 @@
 
 // **** settings.h overrides ****
 
+#define AXES_USED				0x0F		// X Y Z A
+#define MOTORS_USED				0x0F		// motors 1-4
+
 // *** motor settings ***
 
 #define M1_MOTOR_MAP 			AXIS_X		// 1ma
@@ -0,0 +1,309 @@
+/*
+ * shaper.cpp - input shaping of the segment runtime
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See shaper.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "util.h"
+#include "xio.h"
+#include "shaper.h"
+#include "pso.h"
+
+#ifdef __INPUT_SHAPING
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+shSingleton_t sh;
+
+static void _apply_shapers(void);
+static void _reset_history(const float position[]);
+static void _push_history(const float position[], float microseconds);
+static float _shaped_axis(uint8_t axis);
+
+#define _prev_entry(i) (((i) == 0) ? (SH_HISTORY-1) : ((i) - 1))
+#define _next_entry(i) (((i) + 1) % SH_HISTORY)
+
+/*
+ * sh_init() - apply the configured shapers and start the history at the runtime position
+ *
+ *	Must follow config_init() and planner_init().
+ */
+void sh_init()
+{
+	_apply_shapers();
+	_reset_history(mr.position);
+}
+
+/*
+ * sh_set_shapers() - take new shaper settings once the axes have settled
+ *
+ *	Settings are changed from the main loop while the exec interrupt may be using
+ *	the impulses, so they are only marked here and applied by the runtime.
+ */
+void sh_set_shapers()
+{
+	sh.pending = true;
+}
+
+/*
+ * _apply_shapers() - compute the impulses of each axis from its frequency and damping
+ *
+ *	With K = exp(-z*pi/sqrt(1-z^2)) and the damped period Td = 1/(f*sqrt(1-z^2)):
+ *	  ZV	1, K			at 0, Td/2
+ *	  ZVD	1, 2K, K^2		at 0, Td/2, Td
+ *	  EI	(1+V)/4, (1-V)K/2, (1+V)K^2/4	at 0, Td/2, Td
+ *	each normalized to a sum of 1.
+ */
+static void _apply_shapers()
+{
+	sh.pending = false;
+	sh.enabled = false;
+	sh.lag = 0;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		shAxis_t *s = &sh.a[axis];
+		float frequency = cm.a[axis].shaper_freq;
+		float damping = cm.a[axis].shaper_damping;
+
+		s->impulses = 0;
+		if ((frequency < SH_MIN_FREQUENCY) || (cm.a[axis].axis_mode == AXIS_DISABLED)) { continue;}
+
+		float root = sqrt(1 - square(damping));
+		float k = exp(-damping * M_PI / root);
+		float period = MICROSECONDS_PER_MINUTE / (60 * frequency * root);	// damped period in usec
+
+		s->delay[0] = 0;
+		s->delay[1] = period / 2;
+		s->delay[2] = period;
+		if (sh.type == SHAPER_ZV) {
+			s->impulses = 2;
+			s->amplitude[0] = 1;
+			s->amplitude[1] = k;
+		} else if (sh.type == SHAPER_ZVD) {
+			s->impulses = 3;
+			s->amplitude[0] = 1;
+			s->amplitude[1] = 2 * k;
+			s->amplitude[2] = square(k);
+		} else {
+			s->impulses = 3;
+			s->amplitude[0] = 0.25 * (1 + SH_EI_VTOL);
+			s->amplitude[1] = 0.5 * (1 - SH_EI_VTOL) * k;
+			s->amplitude[2] = 0.25 * (1 + SH_EI_VTOL) * square(k);
+		}
+		float sum = 0;
+		for (uint8_t i=0; i<s->impulses; i++) { sum += s->amplitude[i];}
+		for (uint8_t i=0; i<s->impulses; i++) { s->amplitude[i] /= sum;}
+
+		float lag = s->delay[s->impulses-1];
+		if (lag > sh.lag) { sh.lag = lag;}
+		sh.enabled = true;
+	}
+}
+
+/*
+ * _reset_history() - forget the history and stand still at a position
+ * _push_history()	- add the commanded position at the end of a segment
+ */
+static void _reset_history(const float position[])
+{
+	sh.head = 0;
+	sh.count = 1;
+	sh.time[0] = sh.clock;
+	copy_axis_vector(sh.history[0], position);
+	copy_axis_vector(sh.position, position);
+	sh.settle = 0;
+}
+
+static void _push_history(const float position[], float microseconds)
+{
+	uint8_t last = sh.head;
+	sh.head = _next_entry(sh.head);
+	sh.clock += (uint32_t)(microseconds + 0.5);
+	sh.time[sh.head] = sh.clock;
+	copy_axis_vector(sh.history[sh.head], position);
+	if (sh.count < SH_HISTORY) { sh.count++;}
+	if (sh.time[sh.head] == sh.time[last]) { sh.time[sh.head]++;}	// keep the ages distinct
+}
+
+/*
+ * _shaped_axis() - impulse weighted sum of the commanded positions of an axis
+ *
+ *	The commanded position is linear within a segment, so the position at each delay
+ *	is interpolated between the two entries around it. The delays increase, so one
+ *	walk back through the history serves all the impulses. Delays older than the
+ *	history take the oldest entry - the axis was standing there.
+ */
+static float _shaped_axis(uint8_t axis)
+{
+	shAxis_t *s = &sh.a[axis];
+	uint8_t newer = sh.head;
+	uint8_t entries = 1;
+	float newer_age = 0;
+	float position = 0;
+
+	for (uint8_t i=0; i<s->impulses; i++) {
+		float delay = s->delay[i];
+		while (true) {
+			if (entries >= sh.count) {
+				position += s->amplitude[i] * sh.history[newer][axis];
+				break;
+			}
+			uint8_t older = _prev_entry(newer);
+			float older_age = (float)(sh.clock - sh.time[older]);
+			if (older_age >= delay) {
+				float fraction = (older_age - delay) / (older_age - newer_age);
+				position += s->amplitude[i] * (sh.history[older][axis] +
+							fraction * (sh.history[newer][axis] - sh.history[older][axis]));
+				break;
+			}
+			newer = older;
+			newer_age = older_age;
+			entries++;
+		}
+	}
+	return (position);
+}
+
+/*
+ * sh_shape() - shape the target of a runtime segment
+ *
+ *	Returns the shaped end of the segment and sets start[] to the shaped start, to
+ *	pass to ik_kinematics(). Position is the commanded start of the segment - if it
+ *	is not the last commanded position the runtime position was set (G28.3, homing)
+ *	and the history starts over from there.
+ */
+const float *sh_shape(const float position[], const float target[], float microseconds, float start[])
+{
+	if ((sh.pending == true) && (sh.settle <= 0)) { _apply_shapers();}
+	if (memcmp(position, sh.history[sh.head], sizeof(sh.position)) != 0) {
+		_reset_history(position);
+	}
+	copy_axis_vector(start, sh.position);
+
+	if ((sh.enabled == false) || (cm.cycle_state != CYCLE_MACHINING)) {
+		_reset_history(target);
+		return (sh.position);
+	}
+	_push_history(target, microseconds);
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		sh.position[axis] = (sh.a[axis].impulses == 0) ? target[axis] : _shaped_axis(axis);
+	}
+	sh.settle = sh.lag;
+	return (sh.position);
+}
+
+/*
+ * sh_exec_drain() - run a segment to bring the shaped axes onto the commanded position
+ *
+ *	Called by mp_exec_move() in place of the run buffer while the axes settle.
+ *	Returns STAT_NOOP once they have. The last segment ends exactly on the commanded
+ *	position, and no segment is shorter than MIN_SEGMENT_USEC.
+ */
+stat_t sh_exec_drain()
+{
+	if (sh.settle <= 0) { return (STAT_NOOP);}
+
+	float steps[MOTORS];
+	float start[AXES];
+	float microseconds = NOM_SEGMENT_USEC;
+	if (sh.settle < (NOM_SEGMENT_USEC + MIN_SEGMENT_USEC)) {
+		microseconds = max(sh.settle, MIN_SEGMENT_USEC);
+	}
+	sh.settle -= microseconds;
+
+	copy_axis_vector(start, sh.position);
+	_push_history(sh.history[sh.head], microseconds);	// standing at the commanded position
+	if (sh.settle <= 0) {
+		sh.settle = 0;
+		copy_axis_vector(sh.position, sh.history[sh.head]);
+	} else {
+		for (uint8_t axis=0; axis<AXES; axis++) {
+			if (sh.a[axis].impulses != 0) { sh.position[axis] = _shaped_axis(axis);}
+		}
+	}
+	ik_kinematics(start, sh.position, steps, microseconds);
+	ritorno(st_prep_line(steps, microseconds));
+	PSO_PREP(start, sh.position);
+	return (STAT_OK);
+}
+
+/*
+ * sh_set_if() - set the resonant frequency of an axis ($xif)
+ * sh_set_iz() - set the damping ratio of an axis ($xiz)
+ * sh_set_ist() - set the shaper type
+ */
+stat_t sh_set_if(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || ((cmd->value > EPSILON) && (cmd->value < SH_MIN_FREQUENCY))) {
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	set_flt(cmd);
+	sh_set_shapers();
+	return (STAT_OK);
+}
+
+stat_t sh_set_iz(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= 1)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_flt(cmd);
+	sh_set_shapers();
+	return (STAT_OK);
+}
+
+stat_t sh_set_ist(cmdObj_t *cmd)
+{
+	if (cmd->value >= SHAPER_TYPES) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_ui8(cmd);
+	sh_set_shapers();
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_Xif[] PROGMEM = "[%s%s] %s shaper frequency%15.2f Hz (0=off)\n";
+static const char fmt_Xiz[] PROGMEM = "[%s%s] %s shaper damping%17.3f\n";
+static const char fmt_ist[] PROGMEM = "[ist] input shaper%21d [0=ZV,1=ZVD,2=EI]\n";
+
+static void _print_axis(cmdObj_t *cmd, const char *format)
+{
+	fprintf_P(stderr, format, cmd->group, cmd->token, cmd->group, cmd->value);
+}
+
+void sh_print_if(cmdObj_t *cmd) { _print_axis(cmd, fmt_Xif);}
+void sh_print_iz(cmdObj_t *cmd) { _print_axis(cmd, fmt_Xiz);}
+void sh_print_ist(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_ist);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __INPUT_SHAPING
@@ -0,0 +1,126 @@
+/*
+ * shaper.h - input shaping of the segment runtime
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Input shaping is enabled by __INPUT_SHAPING in tinyg2.h. It cancels the ringing of
+ * an axis at its resonant frequency by sending the motors the commanded position
+ * convolved with a few impulses, timed so the vibration each one starts is cancelled
+ * by the next:
+ *
+ *	$xif	resonant frequency of the X axis in Hz (0 = not shaped, the default)
+ *	$xiz	damping ratio of the X axis resonance (0.05 - 0.15 is usual for gantries)
+ *	$ist	shaper: 0=ZV (2 impulses over half a period), 1=ZVD (3 impulses over a
+ *			period), 2=EI (3 impulses over a period, least sensitive to a wrong $xif)
+ *
+ * The same settings exist for each axis. Measure the ringing frequency (e.g. from the
+ * spacing of the ripple left by a fast move) and set it with the damping. Longer
+ * shapers are more tolerant of frequency error but add more lag: ZV delays the
+ * motion by about a quarter period, ZVD and EI by half a period.
+ *
+ * The shaper sits between the segment runtime and the kinematics. Each segment's
+ * commanded axis position is kept in a time stamped history (SH_HISTORY segments)
+ * and the position sent to ik_kinematics() is the impulse weighted sum of the
+ * history at the impulse delays. The impulses are positive, so the shaped path never
+ * leaves the commanded one by more than the corners it rounds - soft limits still
+ * hold. Corners are rounded by up to about velocity x the shaper lag.
+ *
+ * The shaped position trails the commanded one, so after the last move of a run, and
+ * before any queued command, dwell or feedhold stop, mp_exec_move() runs extra
+ * segments (sh_exec_drain()) until the axes settle on the commanded position. Homing,
+ * probing and jogging are not shaped. New settings take effect once the axes settle.
+ * The lowest frequency that fits the history is SH_MIN_FREQUENCY. With __DDA_RAMPING
+ * the ramps within a segment follow the commanded velocity, not the shaped one.
+ */
+
+#ifndef SHAPER_H_ONCE
+#define SHAPER_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+enum shType {							// $ist values
+	SHAPER_ZV = 0,						// zero vibration - 2 impulses
+	SHAPER_ZVD,							// zero vibration and derivative - 3 impulses
+	SHAPER_EI,							// extra insensitive - 3 impulses
+	SHAPER_TYPES
+};
+
+#ifdef __INPUT_SHAPING
+
+#define SH_IMPULSES			3			// most impulses of any shaper
+#define SH_HISTORY			48			// segments of commanded position kept (>= 120 ms)
+#define SH_MIN_FREQUENCY	10			// Hz - a ZVD at 10 Hz spans 100 ms of the history
+#define SH_EI_VTOL			0.05		// vibration tolerance of the EI shaper
+
+typedef struct shAxis {					// shaper of one axis
+	uint8_t impulses;					// 0 if the axis is not shaped
+	float amplitude[SH_IMPULSES];		// impulse weights - they sum to 1
+	float delay[SH_IMPULSES];			// impulse delays in microseconds, increasing
+} shAxis_t;
+
+typedef struct shSingleton {
+	uint8_t type;						// $ist - see shType
+	uint8_t enabled;					// TRUE if any axis is shaped
+	uint8_t pending;					// TRUE if settings changed - applied once settled
+	float lag;							// longest impulse delay in microseconds
+	float settle;						// microseconds until the shaped position is the commanded one
+	uint32_t clock;						// runtime microseconds at the newest history entry
+	uint8_t head;						// newest history entry
+	uint8_t count;						// history entries in use
+	uint32_t time[SH_HISTORY];			// clock at the end of each segment
+	float history[SH_HISTORY][AXES];	// commanded position at the end of each segment
+	float position[AXES];				// shaped position at the end of the last segment
+	shAxis_t a[AXES];
+} shSingleton_t;
+
+extern shSingleton_t sh;
+
+void sh_init(void);
+void sh_set_shapers(void);
+const float *sh_shape(const float position[], const float target[], float microseconds, float start[]) HOT_PATH;
+stat_t sh_exec_drain(void) HOT_PATH;
+
+stat_t sh_set_if(cmdObj_t *cmd);
+stat_t sh_set_iz(cmdObj_t *cmd);
+stat_t sh_set_ist(cmdObj_t *cmd);
+
+#define SH_SETTLING() (sh.settle > 0)
+
+#ifdef __TEXT_MODE
+	void sh_print_if(cmdObj_t *cmd);
+	void sh_print_iz(cmdObj_t *cmd);
+	void sh_print_ist(cmdObj_t *cmd);
+#else
+	#define sh_print_if tx_print_stub
+	#define sh_print_iz tx_print_stub
+	#define sh_print_ist tx_print_stub
+#endif
+
+#else
+
+#define SH_SETTLING() (false)
+#define sh_exec_drain() (STAT_NOOP)
+
+#endif // __INPUT_SHAPING
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: SHAPER_H_ONCE
@@ -0,0 +1,36 @@
+/*
+ * gcode_text.cpp - print a program from gcode/ as text, for the simulation corpus
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The programs in gcode/ are C strings, so the firmware can run them without a host
+ * (see BENCHMARK_GCODE_FILE in benchmark.h). sim/Makefile builds this once for each
+ * job in its corpus, with SIM_GCODE_FILE and SIM_GCODE_NAME naming the file and the
+ * string, and runs it to write the job the simulation reads.
+ */
+
+#include <stdio.h>
+
+#define PROGMEM							// as in tinyg2.h
+
+#include SIM_GCODE_FILE
+
+int main()
+{
+	fputs(SIM_GCODE_NAME, stdout);
+	return (0);
+}
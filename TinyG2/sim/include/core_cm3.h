@@ -0,0 +1,103 @@
+/*
+ * core_cm3.h - Cortex-M3 core header for the host simulation build
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The CMSIS core intrinsics (core_cmInstr.h, core_cmFunc.h) are ARM assembly. The
+ * simulation build finds this header ahead of the CMSIS one, defines host versions
+ * of the intrinsics under the CMSIS include guards, then includes the CMSIS header,
+ * so the register definitions are the real ones. There are no interrupts on the
+ * host: the code always runs in thread mode with interrupts enabled, and barriers,
+ * sleeps and the exclusive monitor do nothing. See sim/Makefile.
+ */
+
+#ifndef SIM_CORE_CM3_H_ONCE
+#define SIM_CORE_CM3_H_ONCE
+
+#include <stdint.h>
+
+#define __CORE_CMINSTR_H				// replaced by the host versions below
+#define __CORE_CMFUNC_H
+
+/**** core_cmInstr.h ****/
+
+static inline void __NOP(void) {}
+static inline void __WFI(void) {}
+static inline void __WFE(void) {}
+static inline void __SEV(void) {}
+static inline void __ISB(void) {}
+static inline void __DSB(void) {}
+static inline void __DMB(void) {}
+
+static inline uint32_t __REV(uint32_t value) { return (__builtin_bswap32(value));}
+static inline uint32_t __REV16(uint32_t value) { return (((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8));}
+static inline int32_t __REVSH(int32_t value) { return ((int16_t)(((value & 0xFF00) >> 8) | ((value & 0x00FF) << 8)));}
+static inline uint32_t __RBIT(uint32_t value)
+{
+	uint32_t result = 0;
+	for (uint8_t i=0; i<32; i++) { result = (result << 1) | ((value >> i) & 1);}
+	return (result);
+}
+static inline uint8_t __CLZ(uint32_t value) { return ((value == 0) ? 32 : __builtin_clz(value));}
+
+static inline uint8_t __LDREXB(volatile uint8_t *addr) { return (*addr);}
+static inline uint16_t __LDREXH(volatile uint16_t *addr) { return (*addr);}
+static inline uint32_t __LDREXW(volatile uint32_t *addr) { return (*addr);}
+static inline uint32_t __STREXB(uint8_t value, volatile uint8_t *addr) { *addr = value; return (0);}
+static inline uint32_t __STREXH(uint16_t value, volatile uint16_t *addr) { *addr = value; return (0);}
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr) { *addr = value; return (0);}
+static inline void __CLREX(void) {}
+
+static inline int32_t __sim_ssat(int32_t value, uint32_t bits)
+{
+	int32_t max = (int32_t)((1UL << (bits - 1)) - 1);
+	return ((value > max) ? max : (value < -max - 1) ? (-max - 1) : value);
+}
+static inline uint32_t __sim_usat(int32_t value, uint32_t bits)
+{
+	int32_t max = (int32_t)((1UL << bits) - 1);
+	return ((value > max) ? (uint32_t)max : (value < 0) ? 0 : (uint32_t)value);
+}
+#define __SSAT(ARG1,ARG2) __sim_ssat((ARG1), (ARG2))
+#define __USAT(ARG1,ARG2) __sim_usat((ARG1), (ARG2))
+
+/**** core_cmFunc.h ****/
+
+static inline void __enable_irq(void) {}
+static inline void __disable_irq(void) {}
+static inline void __enable_fault_irq(void) {}
+static inline void __disable_fault_irq(void) {}
+
+static inline uint32_t __get_CONTROL(void) { return (0);}
+static inline void __set_CONTROL(uint32_t control) { (void)control;}
+static inline uint32_t __get_IPSR(void) { return (0);}	// thread mode
+static inline uint32_t __get_APSR(void) { return (0);}
+static inline uint32_t __get_xPSR(void) { return (0);}
+static inline uint32_t __get_PSP(void) { return (0);}
+static inline void __set_PSP(uint32_t topOfProcStack) { (void)topOfProcStack;}
+static inline uint32_t __get_MSP(void) { return (0);}
+static inline void __set_MSP(uint32_t topOfMainStack) { (void)topOfMainStack;}
+static inline uint32_t __get_PRIMASK(void) { return (0);}
+static inline void __set_PRIMASK(uint32_t priMask) { (void)priMask;}
+static inline uint32_t __get_BASEPRI(void) { return (0);}
+static inline void __set_BASEPRI(uint32_t value) { (void)value;}
+static inline uint32_t __get_FAULTMASK(void) { return (0);}
+static inline void __set_FAULTMASK(uint32_t faultMask) { (void)faultMask;}
+
+#include_next <core_cm3.h>
+
+#endif // End of include guard: SIM_CORE_CM3_H_ONCE
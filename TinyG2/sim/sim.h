@@ -0,0 +1,61 @@
+/*
+ * sim.h - host simulation of the planner, canonical machine and Gcode parser
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The simulation is the firmware built for the host (x86/Linux) by sim/Makefile. A
+ * job runs through the Gcode parser, canonical machine and planner as it does on the
+ * board, and the exec is run in place of the exec interrupt. The stepper prep is
+ * replaced by a stub that records every segment (see stepper_sim.cpp), so a job of
+ * hours runs in seconds and its cycle time is known exactly.
+ *
+ *	tinyg2_sim [-s segments.csv] [-S summary.txt] [-g golden.txt] [file]
+ *
+ * The job is read from file, or stdin if there is none. Gcode blocks go to the
+ * Gcode parser and $ and JSON lines to the text and JSON parsers, as the controller
+ * would send them. The settings are the firmware defaults (see settings.h).
+ *
+ *	-s	write every segment to a file
+ *	-S	write the velocity profile summary of the job to a file
+ *	-g	compare the summary with a golden one
+ *
+ * See stepper_sim.cpp for the files. The job is reported on stderr, and the exit
+ * status is 1 if the job stalls or regresses against the golden summary.
+ *
+ * Everything else in the firmware is built unchanged. The peripheral address space
+ * is ordinary memory on the host, so register writes land there and do nothing
+ * (see sim_main.cpp), and the CMSIS core intrinsics have host versions (see
+ * include/core_cm3.h). There are no interrupts: SysTick is advanced by the time of
+ * the segments run, and the motion tasks run between execs as they do while the
+ * controller waits on output (see controller_yield()).
+ *
+ * "make check" in sim/ runs the jobs in CORPUS (programs from gcode/) and compares
+ * each with its golden summary in sim/golden/. "make golden" writes the golden
+ * summaries again - do that for a planner change that is meant to change the
+ * profiles, and check them in with it.
+ */
+
+#ifndef SIM_H_ONCE
+#define SIM_H_ONCE
+
+#define SIM_LINE_MAX 256				// longest line read from a job
+
+void sim_open(const char *segment_file, const char *summary_file, const char *golden_file);
+uint8_t sim_close(void);
+void sim_advance_time(float microseconds);
+
+#endif // End of include guard: SIM_H_ONCE
@@ -0,0 +1,242 @@
+/*
+ * sim_main.cpp - host simulation driver
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See sim.h for a description of how the simulation is run */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../tinyg2.h"
+#include "../config.h"
+#include "../hardware.h"
+#include "../controller.h"
+#include "../canonical_machine.h"
+#include "../gcode_parser.h"
+#include "../text_parser.h"
+#include "../json_parser.h"
+#include "../planner.h"
+#include "../stepper.h"
+#include "../kinematics.h"
+#include "../switch.h"
+#include "../shaper.h"
+#include "../plan_arc.h"
+#include "../util.h"
+#include "sim.h"
+
+#ifndef __MOTION_YIELD
+#error the simulation runs the motion tasks with controller_yield() - see __MOTION_YIELD in tinyg2.h
+#endif
+
+#define SIM_STALL_PASSES 100000			// passes without a segment before the job is called stalled
+
+/**** The SAM3X8E address space ****
+ *
+ *	The flash (where the settings are persisted), the peripherals and the Cortex-M3
+ *	system space are mapped as ordinary memory before any constructor runs, so the
+ *	firmware reads and writes its registers as it would on the board. Flash reads
+ *	erased. The clocks read locked and the EFC ready, so the waits on them end at once,
+ *	and the switches read open.
+ */
+
+static const struct simRegion {
+	uintptr_t address;
+	size_t size;
+	uint8_t fill;
+} sim_regions[] = {
+	{ IFLASH0_ADDR, IFLASH_SIZE, 0xFF },		// both flash banks
+	{ 0x40000000, 0x00100000, 0x00 },			// peripherals
+	{ 0xE0000000, 0x00100000, 0x00 }			// ITM, DWT and the system control space
+};
+
+extern "C" {
+uint32_t SystemCoreClock = F_CPU;
+uint32_t _estack;						// the linker script symbols memory.cpp reads
+uint32_t _srelocate;
+caddr_t _sbrk(int incr) { return ((caddr_t)sbrk(incr));}
+void SystemInit() {}					// the board's startup - the host has run its own
+void __libc_init_array() {}
+}
+
+static void __attribute__((constructor(101))) _sim_map_address_space()
+{
+	for (uint8_t i=0; i<(sizeof(sim_regions) / sizeof(sim_regions[0])); i++) {
+		const simRegion *r = &sim_regions[i];
+		if (mmap((void *)r->address, r->size, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void *)r->address) {
+			fprintf(stderr, "sim: unable to map 0x%08lx\n", (unsigned long)r->address);
+			_exit(2);
+		}
+		memset((void *)r->address, r->fill, r->size);
+	}
+	PMC->PMC_SR = PMC_SR_MOSCXTS | PMC_SR_LOCKA | PMC_SR_MCKRDY | PMC_SR_LOCKU | PMC_SR_MOSCSELS | PMC_SR_MOSCRCS;
+	EFC0->EEFC_FSR = EEFC_FSR_FRDY;
+	EFC1->EEFC_FSR = EEFC_FSR_FRDY;
+	PIOA->PIO_PDSR = 0xFFFFFFFF;				// inputs read high, as the pull-ups hold them
+	PIOB->PIO_PDSR = 0xFFFFFFFF;
+	PIOC->PIO_PDSR = 0xFFFFFFFF;
+	PIOD->PIO_PDSR = 0xFFFFFFFF;
+}
+
+/**** Time ****
+ *
+ * sim_advance_time() - run SysTick for the time of a segment
+ *
+ *	Called by the stepper stub for each segment prepared. SysTick fires once per
+ *	whole millisecond run, so the timers the firmware polls see job time.
+ */
+
+static float sim_microseconds;			// time run since the last SysTick
+
+void sim_advance_time(float microseconds)
+{
+	for (sim_microseconds += microseconds; sim_microseconds >= 1000; sim_microseconds -= 1000) {
+		SysTick_Handler();
+	}
+}
+
+/**** The job ****/
+
+static void _sim_init(void);
+static uint8_t _sim_exec_until(mpBufCount_t available);
+static uint8_t _sim_generating(void);
+static void _sim_dispatch(char_t *line, uint32_t linenum);
+
+int main(int argc, char *argv[])
+{
+	const char *segment_file = NULL;
+	const char *summary_file = NULL;
+	const char *golden_file = NULL;
+	FILE *job = stdin;
+	char_t line[SIM_LINE_MAX];
+	uint32_t linenum = 0;
+	uint8_t stalled = false;
+	int option;
+
+	while ((option = getopt(argc, argv, "s:S:g:")) != -1) {
+		switch (option) {
+			case 's': { segment_file = optarg; break;}
+			case 'S': { summary_file = optarg; break;}
+			case 'g': { golden_file = optarg; break;}
+			default: {
+				fprintf(stderr, "usage: %s [-s segments.csv] [-S summary.txt] [-g golden.txt] [file]\n", argv[0]);
+				return (2);
+			}
+		}
+	}
+	if ((optind < argc) && ((job = fopen(argv[optind], "r")) == NULL)) {
+		fprintf(stderr, "sim: unable to open %s\n", argv[optind]);
+		return (2);
+	}
+	_sim_init();
+	sim_open(segment_file, summary_file, golden_file);
+
+	while ((stalled == false) && (fgets(line, sizeof(line), job) != NULL)) {
+		linenum++;
+		line[strcspn(line, "\r\n")] = '\0';
+		if ((stalled = !_sim_exec_until(PLANNER_BUFFER_HEADROOM)) == true) { break;}	// as the controller waits
+		_sim_dispatch(line, linenum);
+		while ((stalled == false) && (_sim_generating() == true)) {	// arcs, cycles and splines
+			stalled = !_sim_exec_until(PLANNER_BUFFER_HEADROOM);		// run behind the parser
+		}
+	}
+	if (stalled == false) {
+		stalled = !_sim_exec_until(PLANNER_BUFFER_POOL_SIZE);	// drain the planner completely
+	}
+	if (stalled == true) {
+		fprintf(stderr, "sim: stalled at line %lu\n", (unsigned long)linenum);
+	}
+	if (job != stdin) { fclose(job);}
+	if (sim_close() != 0) { return (1);}
+	return ((stalled == true) ? 1 : 0);
+}
+
+/*
+ * _sim_init() - initialize the firmware as _application_init() does, less the drivers
+ */
+
+static void _sim_init()
+{
+	config_init();
+	switch_init();
+	controller_init(DEV_STDIN, DEV_STDOUT, DEV_STDERR);
+	planner_init();
+	canonical_machine_init();
+	ik_init();
+#ifdef __INPUT_SHAPING
+	sh_init();
+#endif
+	stepper_init();
+}
+
+/*
+ * _sim_exec_until() - run the exec until N planner buffers are free
+ *
+ *	The motion tasks run before each exec, as the main loop would run them between
+ *	exec interrupts. Returns false if no segment runs in SIM_STALL_PASSES - a job
+ *	waiting on a switch, a probe or a feedhold that never ends.
+ */
+
+static uint8_t _sim_exec_until(mpBufCount_t available)
+{
+	uint32_t passes = 0;
+
+	for (;;) {
+		controller_yield();						// a held line is queued once the planner idles
+		if (mp_get_planner_buffers_available() >= available) { return (true);}
+		if (mp_exec_move() != STAT_NOOP) {
+			passes = 0;
+		} else if (++passes > SIM_STALL_PASSES) {
+			return (false);
+		}
+	}
+}
+
+/*
+ * _sim_generating() - run the generators behind the parser. True while one has more to queue
+ *
+ *	The controller reads no line while one of these returns STAT_EAGAIN.
+ */
+
+static uint8_t _sim_generating()
+{
+	if (cm_arc_callback() == STAT_EAGAIN) { return (true);}
+	if (cm_canned_cycle_callback() == STAT_EAGAIN) { return (true);}
+	if (cm_spline_callback() == STAT_EAGAIN) { return (true);}
+	return (false);
+}
+
+/*
+ * _sim_dispatch() - send a line to its parser as the controller would
+ *
+ *	Responses are not sent - errors are reported to stderr with the job line.
+ */
+
+static void _sim_dispatch(char_t *line, uint32_t linenum)
+{
+	stat_t status = STAT_OK;
+
+	switch (toupper(line[0])) {
+		case '\0': { break;}
+		case '$': case '?': { status = text_parser(line); break;}
+		case '{': { json_parser(line); break;}
+		default: { status = gc_gcode_parser(line);}
+	}
+	if ((status != STAT_OK) && (status != STAT_NOOP) && (status != STAT_COMPLETE)) {
+		fprintf(stderr, "sim: line %lu: %s\n", (unsigned long)linenum, get_status_message(status));
+	}
+}
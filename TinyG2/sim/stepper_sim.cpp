@@ -0,0 +1,269 @@
+/*
+ * stepper_sim.cpp - recording stepper prep for the host simulation
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The simulation links the real stepper.cpp, less the functions the exec calls to
+ * hand a segment to the loader - sim/Makefile renames those in stepper.cpp and they
+ * are defined here instead. The steppers never run: a segment is recorded when it is
+ * prepared, and the simulation runs the exec itself, so st_request_exec_move() does
+ * nothing. Every other stepper function (and the config) is the real one.
+ *
+ * Each segment is written to the segment file (-s) as a line of comma separated
+ * values - the segment time and the steps of each motor:
+ *
+ *	L,<microseconds>,<steps 1>,<steps 2>,<steps 3>,<steps 4>,<steps 5>,<steps 6>
+ *	D,<microseconds>
+ *
+ * Summing the microseconds column gives the cycle time of the job.
+ *
+ * The velocity profile of the job is summarized in the summary file (-S) - a line
+ * for each block run, and the totals last:
+ *
+ *	B,<block>,<line number>,<peak velocity>,<exit velocity>
+ *	T,<seconds>,<segments>,<blocks>,<blocks planned to zero>
+ *
+ * The peak is the fastest segment velocity of the block in mm/min, and a block
+ * planned to zero is one that stops at its end. The summary of a job from a known
+ * good build is its golden summary (-g) - sim/golden/ holds them for the jobs "make
+ * check" runs. The blocks are compared in order, and sim_close() reports and returns
+ * the regressions: a longer cycle time (by SIM_TIME_TOLERANCE), more blocks planned
+ * to zero, and blocks that peak slower (by SIM_VELOCITY_TOLERANCE). A change in the
+ * number of blocks or segments is reported, but is not a regression by itself.
+ * Segments run with no block (a jog, or the shaper settling) are only counted in
+ * the totals.
+ */
+
+#include "../tinyg2.h"
+#include "../config.h"
+#include "../stepper.h"
+#include "../planner.h"
+#include "../util.h"
+#include "sim.h"
+
+#define SIM_TIME_TOLERANCE 0.001		// fraction the cycle time can grow before it is a regression
+#define SIM_VELOCITY_TOLERANCE 0.01		// fraction a block's peak velocity can drop before it is
+
+static struct simSingleton {
+	FILE *segment_file;				// segment recording file, or NULL
+	FILE *summary_file;				// velocity profile summary, or NULL
+	FILE *golden_file;				// summary to compare against, or NULL
+	uint32_t segments;				// segments recorded
+	double microseconds;			// total time of the segments
+	const mpBuf_t *block;			// block the exec is running, or NULL
+	uint32_t linenum;				// ...its line number
+	float peak_velocity;			// ...its fastest segment so far
+	float exit_velocity;			// ...its planned exit velocity
+	uint32_t blocks;				// blocks run
+	uint32_t stops;					// blocks planned to zero
+	uint32_t slower_blocks;			// blocks that peak slower than in the golden summary
+	uint8_t regressions;			// regressions found against the golden summary
+} sim;
+
+static FILE *_sim_open_file(const char *name, const char *mode);
+static void _sim_track_block(void);
+static void _sim_end_block(void);
+static void _sim_compare_totals(void);
+
+/*
+ * sim_open()  - open the output and golden files (NULL for those not wanted)
+ * sim_close() - report the job and close the files. Returns the regressions found
+ */
+
+void sim_open(const char *segment_file, const char *summary_file, const char *golden_file)
+{
+	memset(&sim, 0, sizeof(sim));
+	sim.segment_file = _sim_open_file(segment_file, "w");
+	sim.summary_file = _sim_open_file(summary_file, "w");
+	sim.golden_file = _sim_open_file(golden_file, "r");
+}
+
+uint8_t sim_close()
+{
+	_sim_end_block();
+	if (sim.segment_file != NULL) {
+		fclose(sim.segment_file);
+		sim.segment_file = NULL;
+	}
+	fprintf(stderr, "sim: %lu segments, %0.3f seconds, %lu blocks, %lu planned to zero\n",
+		(unsigned long)sim.segments, sim.microseconds / 1000000,
+		(unsigned long)sim.blocks, (unsigned long)sim.stops);
+	if (sim.summary_file != NULL) {
+		fprintf(sim.summary_file, "T,%0.6f,%lu,%lu,%lu\n", sim.microseconds / 1000000,
+			(unsigned long)sim.segments, (unsigned long)sim.blocks, (unsigned long)sim.stops);
+		fclose(sim.summary_file);
+		sim.summary_file = NULL;
+	}
+	if (sim.golden_file != NULL) {
+		_sim_compare_totals();
+		fclose(sim.golden_file);
+		sim.golden_file = NULL;
+		fprintf(stderr, "sim: %u regression%s against the golden summary\n",
+			sim.regressions, (sim.regressions == 1) ? "" : "s");
+	}
+	return (sim.regressions);
+}
+
+static FILE *_sim_open_file(const char *name, const char *mode)
+{
+	FILE *file;
+
+	if (name == NULL) { return (NULL);}
+	if ((file = fopen(name, mode)) == NULL) {
+		fprintf(stderr, "sim: unable to open %s\n", name);
+		if (mode[0] == 'r') { sim.regressions++;}	// a missing golden summary fails the check
+	}
+	return (file);
+}
+
+/*
+ * _sim_track_block() - follow the block a line segment belongs to
+ * _sim_end_block()   - summarize the block that has run and compare it to the golden one
+ *
+ *	The run buffer changes when the exec starts the next block. The exit velocity
+ *	is read each segment as a feedhold can replan the block while it runs.
+ */
+
+static void _sim_track_block()
+{
+	const mpBuf_t *bf = mp_get_run_buffer();
+
+	if (bf != sim.block) {
+		_sim_end_block();
+		sim.block = bf;
+		sim.peak_velocity = 0;
+		if (bf != NULL) { sim.linenum = bf->gm->linenum;}
+	}
+	if (bf == NULL) { return;}
+	sim.exit_velocity = bf->exit_velocity;
+	if (mr.segment_velocity > sim.peak_velocity) { sim.peak_velocity = mr.segment_velocity;}
+}
+
+static void _sim_end_block()
+{
+	if (sim.block == NULL) { return;}
+	sim.block = NULL;
+	sim.blocks++;
+	if (sim.exit_velocity < EPSILON) { sim.stops++;}
+	if (sim.summary_file != NULL) {
+		fprintf(sim.summary_file, "B,%lu,%lu,%0.3f,%0.3f\n", (unsigned long)sim.blocks,
+			(unsigned long)sim.linenum, (double)sim.peak_velocity, (double)sim.exit_velocity);
+	}
+	if (sim.golden_file == NULL) { return;}
+
+	unsigned long block, linenum;
+	double peak, exit_velocity;
+	long position = ftell(sim.golden_file);
+	if (fscanf(sim.golden_file, " B,%lu,%lu,%lf,%lf", &block, &linenum, &peak, &exit_velocity) != 4) {
+		fseek(sim.golden_file, position, SEEK_SET);	// past its last block - leave the totals
+		return;
+	}
+	if (sim.peak_velocity < peak * (1 - SIM_VELOCITY_TOLERANCE)) {
+		if (sim.slower_blocks++ == 0) {				// report the first and count the rest
+			fprintf(stderr, "sim: block %lu (line %lu) peaks at %0.1f, was %0.1f\n",
+				(unsigned long)sim.blocks, (unsigned long)sim.linenum, (double)sim.peak_velocity, peak);
+		}
+	}
+}
+
+/*
+ * _sim_compare_totals() - compare the job totals with the golden summary
+ */
+
+static void _sim_compare_totals()
+{
+	char line[80];
+	double seconds = 0;
+	unsigned long segments = 0, blocks = 0, stops = 0;
+	uint8_t found = false;
+
+	while (fgets(line, sizeof(line), sim.golden_file) != NULL) {
+		if (sscanf(line, "T,%lf,%lu,%lu,%lu", &seconds, &segments, &blocks, &stops) == 4) {
+			found = true;
+			break;
+		}
+	}
+	if (found == false) {
+		fprintf(stderr, "sim: the golden summary has no totals\n");
+		sim.regressions++;
+		return;
+	}
+	double now = sim.microseconds / 1000000;
+	if (now > seconds * (1 + SIM_TIME_TOLERANCE)) {
+		fprintf(stderr, "sim: cycle time %0.3f seconds, was %0.3f\n", now, seconds);
+		sim.regressions++;
+	}
+	if (sim.stops > stops) {
+		fprintf(stderr, "sim: %lu blocks planned to zero, was %lu\n", (unsigned long)sim.stops, stops);
+		sim.regressions++;
+	}
+	if (sim.slower_blocks != 0) {
+		fprintf(stderr, "sim: %lu blocks peak slower\n", (unsigned long)sim.slower_blocks);
+		sim.regressions++;
+	}
+	if ((sim.blocks != blocks) || (sim.segments != segments)) {	// a change, not a regression
+		fprintf(stderr, "sim: %lu blocks, %lu segments, was %lu and %lu\n",
+			(unsigned long)sim.blocks, (unsigned long)sim.segments, blocks, segments);
+	}
+}
+
+/*
+ * st_request_exec_move() - nothing to do: the simulation runs the exec (see sim_main.cpp)
+ * st_prep_dwell() 		  - record a dwell
+ * st_prep_line() 		  - record a line segment
+ * st_prep_line_ramped()  - record a line segment (the ramp is the loader's business)
+ *
+ *	Lines are checked as the real st_prep_line() checks them.
+ */
+
+void st_request_exec_move() {}
+
+void st_prep_dwell(float microseconds)
+{
+	sim.segments++;
+	sim.microseconds += microseconds;
+	if (sim.segment_file != NULL) {
+		fprintf(sim.segment_file, "D,%0.3f\n", (double)microseconds);
+	}
+	sim_advance_time(microseconds);
+}
+
+stat_t st_prep_line(float steps[], float microseconds)
+{
+	if (isfinite(microseconds) == false) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
+	} else if (microseconds < EPSILON) { return (STAT_MINIMUM_TIME_MOVE_ERROR);
+	}
+	sim.segments++;
+	sim.microseconds += microseconds;
+	_sim_track_block();
+	if (sim.segment_file != NULL) {
+		fprintf(sim.segment_file, "L,%0.3f", (double)microseconds);
+		for (uint8_t i=0; i<MOTORS; i++) {
+			fprintf(sim.segment_file, ",%0.4f", (double)steps[i]);
+		}
+		fprintf(sim.segment_file, "\n");
+	}
+	sim_advance_time(microseconds);
+	return (STAT_OK);
+}
+
+#ifdef __DDA_RAMPING
+stat_t st_prep_line_ramped(float steps[], float microseconds, float start_velocity, float end_velocity)
+{
+	return (st_prep_line(steps, microseconds));
+}
+#endif
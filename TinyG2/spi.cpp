@@ -0,0 +1,186 @@
+/*
+ * spi.cpp - SPI transfer queue for the motor drivers
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See spi.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "tmc2660.h"
+#include "spi.h"
+
+#ifdef __TMC2660
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+spiSingleton_t spi;
+
+#define SPI0_TX_HW_ID		1				// DMAC hardware handshaking interface of SPI0 transmit
+#define SPI0_RX_HW_ID		2				// ...and of SPI0 receive
+
+#define _next_xfer(i) (((i) + 1) % SPI_QUEUE_SIZE)
+
+static void _select(const uint8_t cs, const uint8_t on);
+static void _start_xfer(spiXfer_t *x);
+
+/*
+ * spi_init() - set up SPI0 as master, the DMAC channels and the chip selects
+ *
+ *	The SPI0 hardware chip select is not used - the motor chip selects are GPIO - so
+ *	the transfers run on a fixed NPCS0 with 8 bit mode 3 framing (CPOL=1, NCPHA=0).
+ */
+void spi_init(void)
+{
+	spi.head = 0;
+	spi.tail = 0;
+	spi.busy = false;
+
+	for (uint8_t cs=1; cs<=MOTORS; cs++) { _select(cs, false);}
+
+	hw_enable_periph_clk(ID_SPI0);
+	SPI0->SPI_CR = SPI_CR_SPIDIS;
+	SPI0->SPI_CR = SPI_CR_SWRST;
+	SPI0->SPI_MR = SPI_MR_MSTR | SPI_MR_MODFDIS | SPI_MR_PCS(0x0E);
+	SPI0->SPI_CSR[0] = SPI_CSR_CPOL | SPI_CSR_BITS_8_BIT | SPI_CSR_SCBR(F_CPU / SPI_BAUD_RATE);
+	SPI0->SPI_CR = SPI_CR_SPIEN;
+
+	hw_enable_periph_clk(ID_DMAC);
+	DMAC->DMAC_EN = 0;
+	DMAC->DMAC_GCFG = DMAC_GCFG_ARB_CFG_FIXED;
+	DMAC->DMAC_EN = DMAC_EN_ENABLE;
+	DMAC->DMAC_EBCIER = (DMAC_EBCIER_BTC0 << SPI_DMAC_RX_CH);	// the receive channel ends the transfer
+
+	NVIC_SetPriority(DMAC_IRQn, SPI_ISR_PRIORITY);
+	NVIC_EnableIRQ(DMAC_IRQn);
+}
+
+/*
+ * spi_queue() - copy a transfer into the ring and start it if the bus is idle
+ *
+ *	Returns STAT_BUFFER_FULL if the ring is full - the transfer is not queued and
+ *	the caller tries again later. The ring is shared with the DMAC interrupt, so it
+ *	is updated with interrupts up to SPI_ISR_PRIORITY held off.
+ */
+stat_t spi_queue(const spiXfer_t *x)
+{
+	if ((x->length == 0) || (x->length > SPI_XFER_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+
+	uint32_t basepri = __get_BASEPRI();
+	__set_BASEPRI(SPI_ISR_PRIORITY << (8 - __NVIC_PRIO_BITS));
+	uint8_t head = spi.head;
+	if (_next_xfer(head) == spi.tail) {
+		spi.overruns++;
+		__set_BASEPRI(basepri);
+		return (STAT_BUFFER_FULL);
+	}
+	memcpy(&spi.q[head], x, sizeof(spiXfer_t));
+	spi.head = _next_xfer(head);
+	if (spi.busy == false) {
+		spi.busy = true;
+		_start_xfer(&spi.q[spi.tail]);
+	}
+	__set_BASEPRI(basepri);
+	return (STAT_OK);
+}
+
+/*
+ * spi_queue_space() - transfers that can be queued before the ring is full
+ */
+uint8_t spi_queue_space(void)
+{
+	return ((spi.tail + SPI_QUEUE_SIZE - spi.head - 1) % SPI_QUEUE_SIZE);
+}
+
+/*
+ * _start_xfer() - select the device and start both DMAC channels on a transfer
+ *
+ *	The receive channel is armed first so no byte is missed. The transmit channel
+ *	then writes TDR once per byte as SPI0 empties it.
+ */
+static void _start_xfer(spiXfer_t *x)
+{
+	_select(x->cs, true);
+	(void)SPI0->SPI_RDR;					// discard anything left from before
+
+	DmacCh_num *rx = &DMAC->DMAC_CH_NUM[SPI_DMAC_RX_CH];
+	rx->DMAC_SADDR = (uint32_t)&SPI0->SPI_RDR;
+	rx->DMAC_DADDR = (uint32_t)x->rx;
+	rx->DMAC_DSCR = 0;
+	rx->DMAC_CTRLA = x->length | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+	rx->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_PER2MEM_DMA_FC |
+					 DMAC_CTRLB_SRC_INCR_FIXED | DMAC_CTRLB_DST_INCR_INCREMENTING;
+	rx->DMAC_CFG = DMAC_CFG_SRC_PER(SPI0_RX_HW_ID) | DMAC_CFG_SRC_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ASAP_CFG;
+
+	DmacCh_num *tx = &DMAC->DMAC_CH_NUM[SPI_DMAC_TX_CH];
+	tx->DMAC_SADDR = (uint32_t)x->tx;
+	tx->DMAC_DADDR = (uint32_t)&SPI0->SPI_TDR;
+	tx->DMAC_DSCR = 0;
+	tx->DMAC_CTRLA = x->length | DMAC_CTRLA_SRC_WIDTH_BYTE | DMAC_CTRLA_DST_WIDTH_BYTE;
+	tx->DMAC_CTRLB = DMAC_CTRLB_SRC_DSCR | DMAC_CTRLB_DST_DSCR | DMAC_CTRLB_FC_MEM2PER_DMA_FC |
+					 DMAC_CTRLB_SRC_INCR_INCREMENTING | DMAC_CTRLB_DST_INCR_FIXED;
+	tx->DMAC_CFG = DMAC_CFG_DST_PER(SPI0_TX_HW_ID) | DMAC_CFG_DST_H2SEL | DMAC_CFG_SOD | DMAC_CFG_FIFOCFG_ALAP_CFG;
+
+	DMAC->DMAC_CHER = (DMAC_CHER_ENA0 << SPI_DMAC_RX_CH) | (DMAC_CHER_ENA0 << SPI_DMAC_TX_CH);
+}
+
+/*
+ * DMAC_Handler() - end the transfer at the tail and start the next
+ *
+ *	The receive channel completes after the last bit is clocked in, so the chip
+ *	select can be released here - the drivers latch the datagram on that edge.
+ */
+void DMAC_Handler(void)
+{
+	uint32_t status = DMAC->DMAC_EBCISR;	// reading clears the flags
+	if ((status & (DMAC_EBCISR_BTC0 << SPI_DMAC_RX_CH)) == 0) { return;}
+
+	spiXfer_t *x = &spi.q[spi.tail];
+	_select(x->cs, false);
+	spi.transfers++;
+	if (x->done != NULL) { x->done(x);}
+
+	spi.tail = _next_xfer(spi.tail);
+	if (spi.tail != spi.head) {
+		_start_xfer(&spi.q[spi.tail]);
+	} else {
+		spi.busy = false;
+	}
+}
+
+/*
+ * _select() - drive a motor chip select - active low
+ */
+static void _select(const uint8_t cs, const uint8_t on)
+{
+	switch (cs) {
+		case 1: { if (on) spi_ss1_pin.clear(); else spi_ss1_pin.set(); break;}
+		case 2: { if (on) spi_ss2_pin.clear(); else spi_ss2_pin.set(); break;}
+		case 3: { if (on) spi_ss3_pin.clear(); else spi_ss3_pin.set(); break;}
+		case 4: { if (on) spi_ss4_pin.clear(); else spi_ss4_pin.set(); break;}
+		case 5: { if (on) spi_ss5_pin.clear(); else spi_ss5_pin.set(); break;}
+		case 6: { if (on) spi_ss6_pin.clear(); else spi_ss6_pin.set(); break;}
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TMC2660
@@ -0,0 +1,82 @@
+/*
+ * spi.h - SPI transfer queue for the motor drivers
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The SPI queue runs the transfers of the SPI motor drivers (see tmc2660.h) on SPI0
+ * without waiting for them. A transfer is copied into a ring by spi_queue(), which
+ * returns at once. The transfers are run in turn by two DMAC channels - one feeds
+ * the transmit register, the other empties the receive register - and the DMAC
+ * interrupt ends each transfer, calls its done callback with the received bytes,
+ * and starts the next. Nothing waits on the SPI in the main loop or in the stepper
+ * interrupts.
+ *
+ * The chip selects are the spi_ss1..6 GPIO pins in hardware.h, one per motor, and
+ * are driven by the queue around each transfer. All devices on the bus share one
+ * clock and mode (SPI_BAUD_RATE, SPI mode 3).
+ *
+ * spi_queue() can be called from the main loop or from any interrupt at or below
+ * SPI_ISR_PRIORITY. The done callbacks run in the DMAC interrupt and must be short.
+ */
+
+#ifndef SPI_H_ONCE
+#define SPI_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __TMC2660							// the motor drivers are the only SPI devices
+
+#define SPI_QUEUE_SIZE			16			// transfers held in the ring
+#define SPI_XFER_MAX			4			// bytes in one transfer
+#define SPI_BAUD_RATE			2000000UL	// SCK frequency - TMC2660 allows up to 4 MHz
+#define SPI_ISR_PRIORITY		7			// NVIC priority of the DMAC interrupt - below the switches
+#define SPI_DMAC_TX_CH			0			// DMAC channel feeding SPI0_TDR
+#define SPI_DMAC_RX_CH			1			// DMAC channel emptying SPI0_RDR
+
+typedef struct spiXfer {
+	uint8_t cs;								// chip select - 1..6 for spi_ss1..6
+	uint8_t length;							// bytes to transfer [1..SPI_XFER_MAX]
+	uint8_t tag;							// free for the caller - passed back in the callback
+	uint8_t tx[SPI_XFER_MAX];				// bytes sent, MSB first
+	uint8_t rx[SPI_XFER_MAX];				// bytes received - valid in the callback
+	void (*done)(struct spiXfer *x);		// called from the DMAC ISR when the transfer ends, or NULL
+} spiXfer_t;
+
+typedef struct spiSingleton {
+	volatile uint8_t head;					// next free slot in the ring
+	volatile uint8_t tail;					// transfer running, or next to run
+	volatile uint8_t busy;					// TRUE while the DMAC is running the tail
+	uint32_t transfers;						// transfers completed
+	uint32_t overruns;						// transfers refused because the ring was full
+	spiXfer_t q[SPI_QUEUE_SIZE];
+} spiSingleton_t;
+
+extern spiSingleton_t spi;
+
+void spi_init(void);
+stat_t spi_queue(const spiXfer_t *x);
+uint8_t spi_queue_space(void);
+
+#endif // __TMC2660
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: SPI_H_ONCE
@@ -27,11 +27,16 @@
 
 #include "tinyg2.h"		// #1
 #include "config.h"		// #2
+#include "controller.h"
 #include "spindle.h"
 //#include "gpio.h"
 #include "planner.h"
+#include "stepper.h"
 #include "hardware.h"
 #include "pwm.h"
+#include "util.h"
+
+using Motate::SysTickTimer;
 
 #ifdef __cplusplus
 extern "C"{
@@ -39,6 +44,27 @@ extern "C"{
 
 static void _exec_spindle_control(float *value, float *flag);
 static void _exec_spindle_speed(float *value, float *flag);
+static float _get_spindle_phase(uint8_t spindle_mode, float *speed);
+static float _get_spindle_estimate(uint32_t tick);
+static void _start_spindle_ramp(void);
+#ifdef __SPINDLE_CSS
+static void _exec_css_mode(float *value, float *flag);
+static void _exec_css_speed(float *value, float *flag);
+
+#define CSS_MM_PER_METER 1000				// G96 S in G21 is m/min
+#define CSS_MM_PER_FOOT (12 * MM_PER_INCH)	// and in G20 ft/min
+#endif
+
+static float spindle_pwm;			// phase set by the last spindle command - used by laser mode
+
+typedef struct spRamp {				// spindle-at-speed estimate (see cm_spindle_wait())
+	float start_speed;				// estimated speed when the ramp started (RPM, CCW is negative)
+	float target_speed;				// speed commanded
+	uint32_t start_tick;			// SysTick at the start of the ramp
+	uint32_t ready_tick;			// SysTick when the spindle should be at speed
+	volatile uint8_t waiting;		// TRUE while a feed move is held for the spindle
+} spRamp_t;
+static spRamp_t ramp;
 
 /* 
  * cm_spindle_init()
@@ -48,14 +74,21 @@ void cm_spindle_init()
 	if( pwm.c[PWM_1].frequency < 0 )
 		pwm.c[PWM_1].frequency = 0;
 
+	spindle_pwm = pwm.c[PWM_1].phase_off;
     pwm_set_freq(PWM_1, pwm.c[PWM_1].frequency);
-    pwm_set_duty(PWM_1, pwm.c[PWM_1].phase_off);
+    pwm_set_duty(PWM_1, spindle_pwm);
 }
 
 /*
  * cm_get_spindle_pwm() - return PWM phase (duty cycle) for dir and speed
+ * _get_spindle_phase() - the same for any speed, which is clamped to the $p1 range in place
  */
 float cm_get_spindle_pwm( uint8_t spindle_mode )
+{
+	return (_get_spindle_phase(spindle_mode, &gm.spindle_speed));
+}
+
+static float _get_spindle_phase(uint8_t spindle_mode, float *spindle_speed)
 {
 	float speed_lo=0, speed_hi=0, phase_lo=0, phase_hi=0;
 	if (spindle_mode == SPINDLE_CW ) {
@@ -72,11 +105,11 @@ float cm_get_spindle_pwm( uint8_t spindle_mode )
 		
 	if (spindle_mode==SPINDLE_CW || spindle_mode==SPINDLE_CCW ) {
 		// clamp spindle speed to lo/hi range
-		if( gm.spindle_speed < speed_lo ) gm.spindle_speed = speed_lo;
-		if( gm.spindle_speed > speed_hi ) gm.spindle_speed = speed_hi;
+		if( *spindle_speed < speed_lo ) *spindle_speed = speed_lo;
+		if( *spindle_speed > speed_hi ) *spindle_speed = speed_hi;
 
 		// normalize speed to [0..1]
-		float speed = (gm.spindle_speed - speed_lo) / (speed_hi - speed_lo);
+		float speed = (*spindle_speed - speed_lo) / (speed_hi - speed_lo);
 		return (speed * (phase_hi - phase_lo)) + phase_lo;
 	} else {
 		return pwm.c[PWM_1].phase_off;
@@ -91,15 +124,25 @@ float cm_get_spindle_pwm( uint8_t spindle_mode )
 stat_t cm_spindle_control(uint8_t spindle_mode)
 {
 	float value[AXES] = { (float)spindle_mode, 0,0,0,0,0 };
+	if (pwm.c[PWM_1].spindle_accel > 0) { mm.spindle_sync = true;}	// the next feed waits for the spindle
 	mp_queue_command(_exec_spindle_control, value, value);
 	return(STAT_OK);
 }
 
+void cm_exec_spindle_control(uint8_t spindle_mode)
+{
+	float value[AXES] = { (float)spindle_mode, 0,0,0,0,0 };
+	_exec_spindle_control(value, value);
+}
+
 //static void _exec_spindle_control(uint8_t spindle_mode, float f, float *vector, float *flag)
 static void _exec_spindle_control(float *value, float *flag)
 {
 	uint8_t spindle_mode = (uint8_t)value[0];
 	cm_set_spindle_mode(MODEL, spindle_mode);
+#ifdef __SPINDLE_CSS
+	css.spindle_mode = spindle_mode;					// the direction G96 runs in
+#endif
 
  #ifdef __AVR
 	if (spindle_mode == SPINDLE_CW) {
@@ -125,7 +168,9 @@ static void _exec_spindle_control(float *value, float *flag)
 #endif // __ARM
 
 	// PWM spindle control
-	pwm_set_duty(PWM_1, cm_get_spindle_pwm(spindle_mode) );
+	spindle_pwm = cm_get_spindle_pwm(spindle_mode);
+	pwm_set_duty(PWM_1, spindle_pwm);
+	_start_spindle_ramp();
 }
 
 /*
@@ -136,8 +181,15 @@ static void _exec_spindle_control(float *value, float *flag)
 stat_t cm_set_spindle_speed(float speed)
 {
 //	if (speed > cfg.max_spindle speed) { return (STAT_MAX_SPINDLE_SPEED_EXCEEDED);}
-	float value[AXES] = { speed, 0,0,0,0,0 };
-	mp_queue_command(_exec_spindle_speed, value, value);
+#ifdef __SPINDLE_CSS
+	if (css.mode == true) {								// G96 - a surface speed, and no wait
+		if (speed < 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+		mp_queue_attached_command(_exec_css_speed, speed * ((gmx.modal.units_mode == INCHES) ? CSS_MM_PER_FOOT : CSS_MM_PER_METER));
+		return (STAT_OK);
+	}
+#endif
+	if (pwm.c[PWM_1].spindle_accel > 0) { mm.spindle_sync = true;}	// the next feed stops to wait anyway
+	mp_queue_attached_command(_exec_spindle_speed, speed);
 	return (STAT_OK);
 }
 
@@ -149,7 +201,157 @@ void cm_exec_spindle_speed(float speed)
 static void _exec_spindle_speed(float *value, float *flag)
 {
 	cm_set_spindle_speed_parameter(MODEL, value[0]);
-	pwm_set_duty(PWM_1, cm_get_spindle_pwm(gm.spindle_mode) ); // update spindle speed if we're running
+	spindle_pwm = cm_get_spindle_pwm(gm.spindle_mode);
+	pwm_set_duty(PWM_1, spindle_pwm);					// update spindle speed if we're running
+	_start_spindle_ramp();
+}
+
+/*
+ * cm_spindle_wait()	  - TRUE if a feed move must wait for the spindle to reach speed
+ * cm_spindle_callback() - restart the exec once the spindle is at speed
+ * _start_spindle_ramp() - start the estimate from the speed the spindle has now
+ * _get_spindle_estimate() - estimated spindle speed at a SysTick
+ *
+ *	Spindles take time to spin up, and a fixed G4 dwell has to allow for the worst 
+ *	case. With $p1acc set the spindle commands start an estimate that ramps from the
+ *	speed the spindle had at that moment to the new speed at $p1acc RPM per second
+ *	(a reversal ramps through zero). The estimate stands in for an at-speed signal -
+ *	a spindle encoder (see encoder.h) is only used for spindle synchronized motion.
+ *
+ *	Queuing a spindle command makes the next feed move start from rest (see 
+ *	_plan_and_queue_move()) - traverses are not held. When the exec reaches that 
+ *	move it calls cm_spindle_wait() and holds it, with the move before it stopped,
+ *	until the estimate reaches the commanded speed. The spindle task polls once a
+ *	millisecond and restarts the exec, so only the feed waits and only as long as 
+ *	the spindle needs rather than for a dwell in the queue.
+ */
+
+uint8_t cm_spindle_wait()
+{
+	if ((int32_t)(SysTickTimer.getValue() - ramp.ready_tick) >= 0) { return (false);}
+	ramp.waiting = true;
+	controller_request_task(TASK_SPINDLE);
+	return (true);
+}
+
+stat_t cm_spindle_callback()
+{
+	if (ramp.waiting == false) { return (STAT_NOOP);}
+	if ((int32_t)(SysTickTimer.getValue() - ramp.ready_tick) < 0) { return (STAT_OK);}	// still spinning up
+	ramp.waiting = false;
+	st_request_exec_move();
+	return (STAT_NOOP);
+}
+
+static void _start_spindle_ramp()
+{
+	uint32_t tick = SysTickTimer.getValue();
+	float speed = _get_spindle_estimate(tick);
+	float accel = pwm.c[PWM_1].spindle_accel;
+
+	ramp.start_speed = speed;
+	ramp.start_tick = tick;
+	if (gm.spindle_mode == SPINDLE_CW) { ramp.target_speed = gm.spindle_speed;}
+	else if (gm.spindle_mode == SPINDLE_CCW) { ramp.target_speed = -gm.spindle_speed;}
+	else { ramp.target_speed = 0;}
+	ramp.ready_tick = tick;
+	if (accel > 0) { ramp.ready_tick += (uint32_t)(fabs(ramp.target_speed - speed) * 1000 / accel);}
+}
+
+static float _get_spindle_estimate(uint32_t tick)
+{
+	if ((int32_t)(tick - ramp.ready_tick) >= 0) { return (ramp.target_speed);}
+	float change = pwm.c[PWM_1].spindle_accel * (tick - ramp.start_tick) / 1000;
+	if (ramp.target_speed < ramp.start_speed) { return (ramp.start_speed - change);}
+	return (ramp.start_speed + change);
+}
+
+/*
+ * cm_set_css_mode() - G96 D, G97 - see spindle.h
+ * cm_cancel_css()	 - back to G97 in the runtime (exec, at program end)
+ * cm_get_css_pwm()	 - PWM phase for one segment in G96
+ *
+ *	cm_set_css_mode() sets the model, and the exec only reads and writes the runtime
+ *	- css and the spindle phase. cm_get_css_pwm() is called from the exec interrupt
+ *	with the radius of the segment end. The RPM is held at D within D's surface speed
+ *	of the center - the radius would go to zero there.
+ */
+#ifdef __SPINDLE_CSS
+spCss_t css;
+
+stat_t cm_set_css_mode(uint8_t mode, float rpm_max, float rpm_max_flag)
+{
+	float value[AXES] = { (float)mode, 0,0,0,0,0 };
+
+	if (mode == true) {
+		if (fp_TRUE(rpm_max_flag)) {
+			if (rpm_max <= 0) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+			value[1] = rpm_max;
+		} else {
+			value[1] = max(pwm.c[PWM_1].cw_speed_hi, pwm.c[PWM_1].ccw_speed_hi);
+		}
+	}
+	css.mode = mode;
+	mp_queue_command(_exec_css_mode, value, value);
+	return (STAT_OK);
+}
+
+static void _exec_css_mode(float *value, float *flag)
+{
+	if ((uint8_t)value[0] == true) {
+		css.rpm_max = value[1];
+		css.rpm = fabsf(ramp.target_speed);			// the speed last commanded to the spindle
+		css.run_mode = true;
+		return;
+	}
+	if (css.run_mode == false) { return;}
+	css.run_mode = false;								// G97 - hold the speed the spindle has
+	spindle_pwm = _get_spindle_phase(css.spindle_mode, &css.rpm);
+	pwm_set_duty(PWM_1, spindle_pwm);
+}
+
+static void _exec_css_speed(float *value, float *flag)
+{
+	css.surface = value[0];
+}
+
+void cm_cancel_css()
+{
+	float value[AXES] = { (float)false, 0,0,0,0,0 };
+	_exec_css_mode(value, value);
+}
+
+float cm_get_css_pwm(float radius)
+{
+	float rpm = css.rpm_max;
+	float circumference = 2 * M_PI_F * fabsf(radius);
+
+	if ((circumference * rpm) > css.surface) { rpm = css.surface / circumference;}
+	css.rpm = rpm;
+	return (_get_spindle_phase(css.spindle_mode, &css.rpm));
+}
+#endif // __SPINDLE_CSS
+
+/*
+ * cm_get_laser_pwm() - PWM phase for one segment in laser mode ($p1lm=1)
+ *
+ *	Laser power has to follow the velocity the machine is actually running at, or
+ *	the beam dwells and burns wherever the move slows down for a corner. The exec
+ *	calls this for every segment and the phase is set as the loader starts the
+ *	segment (see st_prep_spindle_duty()), so the power changes in step with the
+ *	motion. The phase set by the spindle commands is scaled from phase off by
+ *	the segment velocity as a fraction of the requested velocity of the move.
+ *	Traverses run with the phase off. Called from the exec interrupt.
+ */
+
+float cm_get_laser_pwm(float velocity, float cruise_vmax, uint8_t motion_mode)
+{
+	float phase_off = pwm.c[PWM_1].phase_off;
+	if ((motion_mode == MOTION_MODE_STRAIGHT_TRAVERSE) || (cruise_vmax < EPSILON)) {
+		return (phase_off);
+	}
+	float fraction = min(velocity / cruise_vmax, (float)1);
+	return (phase_off + (spindle_pwm - phase_off) * fraction);
 }
 
 #ifdef __cplusplus
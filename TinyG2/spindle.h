@@ -44,6 +44,46 @@ void cm_exec_spindle_speed(float speed);			// callback for above
 stat_t cm_spindle_control(uint8_t spindle_mode);	// M3, M4, M5 integrated spindle control
 void cm_exec_spindle_control(uint8_t spindle_mode);	// callback for above
 
+float cm_get_laser_pwm(float velocity, float cruise_vmax, uint8_t motion_mode);	// per segment - see spindle.cpp
+
+/*
+ * Constant surface speed is enabled by __SPINDLE_CSS in tinyg2.h. For lathe work the
+ * spindle has to speed up as the tool moves in toward the center, or a facing pass
+ * cuts slower and slower. Rather than the host sending an S word on every block - each
+ * one a queued command and a stop for the spindle - the exec works out the RPM from
+ * the radius of every segment and sets the PWM phase as the loader starts it, as it
+ * does for laser mode (see cm_get_laser_pwm()):
+ *
+ *	G96 S D		S is the surface speed from here on - m/min in G21, ft/min in G20 - and
+ *				D the most RPM the spindle is run at. D defaults to the highest $p1 speed
+ *	G97			S is RPM again. The spindle holds the speed it had until the next S
+ *
+ * The radius is X in the work coordinates of the segment, so X0 must be the spindle
+ * center. The RPM is clamped to D, and then to the $p1 speed range by the PWM mapping.
+ * S words in G96 are attached to the next move like S is, and do not stop the feed to
+ * wait for the spindle ($p1acc). Laser mode takes precedence. M2 and M30 go back to G97.
+ */
+#ifdef __SPINDLE_CSS
+typedef struct spCss {
+	uint8_t mode;						// G96 in the model - S words are surface speeds
+	volatile uint8_t run_mode;			// G96 in the runtime - the exec sets the RPM every segment
+	float surface;						// runtime surface speed in mm/min
+	float rpm_max;						// runtime RPM limit - G96 D
+	float rpm;							// RPM set for the last segment
+	uint8_t spindle_mode;				// runtime spindle direction - set as the exec runs M3, M4, M5
+} spCss_t;
+extern spCss_t css;
+
+stat_t cm_set_css_mode(uint8_t mode, float rpm_max, float rpm_max_flag);	// G96, G97
+void cm_cancel_css(void);
+float cm_get_css_pwm(float radius);				// per segment - see spindle.cpp
+
+#define CSS_ACTIVE() (css.run_mode == true)
+#endif
+
+uint8_t cm_spindle_wait(void);						// exec: hold a feed move until the spindle is at speed
+stat_t cm_spindle_callback(void);					// controller task for the above
+
 #ifdef __cplusplus
 }
 #endif
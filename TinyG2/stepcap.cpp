@@ -0,0 +1,195 @@
+/*
+ * stepcap.cpp - step pulse timing capture self test
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See stepcap.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "stepper.h"
+#include "util.h"
+#include "stepcap.h"
+
+#ifdef __STEP_CAPTURE
+
+using namespace Motate;
+
+static Timer<step_capture_timer_num> capture_timer;
+static Pin<step_capture_pin_num> capture_pin;
+
+/*
+ * capture interrupt - measure the jitter of a step from the one before it
+ *
+ *	The jitter is the interval less the nearest whole number of DDA periods, so
+ *	it is signed - a step set later than the one before it is positive.
+ */
+namespace Motate {
+MOTATE_TIMER_INTERRUPT(step_capture_timer_num)
+{
+	uint32_t status = capture_timer.tcChan()->TC_SR;	// clears the flags
+	if (status & TC_SR_LOVRS) { sc.missed++;}
+	if ((status & TC_SR_LDRAS) == 0) { return;}
+
+	uint32_t capture = capture_timer.tcChan()->TC_RA;
+	uint32_t interval = capture - sc.last;				// the counter wraps cleanly
+	sc.last = capture;
+	if ((sc.started == false) || (interval > (SC_GAP_USEC * SC_COUNTS_PER_USEC))) {
+		sc.started = true;
+		return;
+	}
+	uint32_t period = st_get_dda_period();
+	int32_t jitter = (int32_t)(interval % period);
+	if (jitter > (int32_t)(period / 2)) { jitter -= (int32_t)period;}
+
+	if ((sc.count == 0) || (jitter < sc.min)) { sc.min = jitter;}
+	if ((sc.count == 0) || (jitter > sc.max)) { sc.max = jitter;}
+	sc.sum += jitter;
+	sc.sum_sq += (uint64_t)((int64_t)jitter * jitter);
+	uint32_t bin = (uint32_t)abs(jitter) * 1000 / (SC_COUNTS_PER_USEC * SC_BIN_NSEC);
+	sc.bin[min(bin, (uint32_t)(SC_BINS-1))]++;
+	sc.count++;
+}
+} // namespace Motate
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+scSingleton_t sc;
+
+static void _clear_results(void);
+
+/*
+ * sc_set_mode() - start or stop the capture
+ *
+ *	The channel is put in capture mode, clocked at MCK/2, with RA loaded on each
+ *	rising edge of TIOA1. The capture interrupt is at the high level, below the DDA,
+ *	so taking the timestamps doesn't add to the jitter being measured.
+ */
+stat_t sc_set_mode(cmdObj_t *cmd)
+{
+	if (cmd->value > 1) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	NVIC_DisableIRQ(capture_timer.tcIRQ());
+	sc.mode = (uint8_t)cmd->value;
+	if (sc.mode == 0) {
+		capture_timer.tcChan()->TC_CCR = TC_CCR_CLKDIS;
+		capture_pin.setMode(kInput);					// back to the switch
+		return (STAT_OK);
+	}
+	_clear_results();
+	capture_pin.setMode(kPeripheralA);
+	capture_timer.enablePeripheralClock();
+	capture_timer.tcChan()->TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_LDRA_RISING;
+	capture_timer.tcChan()->TC_IDR = 0xFFFFFFFF;
+	capture_timer.tcChan()->TC_IER = TC_IER_LDRAS;
+	capture_timer.tcChan()->TC_SR;						// clear any flags
+	capture_timer.tcChan()->TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+	NVIC_SetPriority(capture_timer.tcIRQ(), 3);
+	NVIC_EnableIRQ(capture_timer.tcIRQ());
+	return (STAT_OK);
+}
+
+static void _clear_results()
+{
+	sc.started = false;
+	sc.count = 0;
+	sc.missed = 0;
+	sc.min = 0;
+	sc.max = 0;
+	sc.sum = 0;
+	sc.sum_sq = 0;
+	for (uint8_t i=0; i<SC_BINS; i++) { sc.bin[i] = 0;}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * sc_get_jitter()    - return [count,min,max,mean,stddev,missed] in nanoseconds
+ * sc_get_histogram() - return the histogram bins
+ *
+ *	The results are copied with interrupts off so a capture can't change them half
+ *	way through the read. Capturing can go on while they are read.
+ */
+#define _nsec(counts) ((counts) * 1000 / SC_COUNTS_PER_USEC)
+
+stat_t sc_get_jitter(cmdObj_t *cmd)
+{
+	char_t buf[80];
+
+	__disable_irq();
+	uint32_t count = sc.count;
+	uint32_t missed = sc.missed;
+	int32_t jitter_min = sc.min;
+	int32_t jitter_max = sc.max;
+	double sum = (double)sc.sum;
+	double sum_sq = (double)sc.sum_sq;
+	__enable_irq();
+
+	double mean = 0, stddev = 0;
+	if (count != 0) {
+		mean = sum / count;
+		double variance = sum_sq / count - mean * mean;
+		if (variance > 0) { stddev = sqrt(variance);}
+	}
+	sprintf((char *)buf, "%lu,%ld,%ld,%0.0f,%0.0f,%lu", (unsigned long)count,
+		(long)_nsec(jitter_min), (long)_nsec(jitter_max), _nsec(mean), _nsec(stddev), (unsigned long)missed);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+stat_t sc_get_histogram(cmdObj_t *cmd)
+{
+	uint32_t bin[SC_BINS];
+	char_t buf[SC_BINS * 11];
+	char_t *ptr = buf;
+
+	__disable_irq();
+	for (uint8_t i=0; i<SC_BINS; i++) { bin[i] = sc.bin[i];}
+	__enable_irq();
+
+	for (uint8_t i=0; i<SC_BINS; i++) {
+		ptr += sprintf((char *)ptr, (i == 0) ? "%lu" : ",%lu", (unsigned long)bin[i]);
+	}
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_scj[] PROGMEM = "[scj] step jitter %s nSec [count,min,max,mean,stddev,missed]\n";
+static const char fmt_sch[] PROGMEM = "[sch] step jitter histogram %s [steps per 100 nSec]\n";
+
+void sc_print_scj(cmdObj_t *cmd) { fprintf_P(stderr, fmt_scj, *cmd->stringp);}
+void sc_print_sch(cmdObj_t *cmd) { fprintf_P(stderr, fmt_sch, *cmd->stringp);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __STEP_CAPTURE
@@ -0,0 +1,97 @@
+/*
+ * stepcap.h - step pulse timing capture self test
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Step timing capture is enabled by __STEP_CAPTURE in tinyg2.h. It measures the
+ * jitter of the step pulses the DDA puts out, without a logic analyzer. Loop the
+ * step pin of the motor under test back to the capture input - TIOA1, Due A7, which
+ * is the B max switch input in this pinout, so disable that switch ($bsx=0) - then:
+ *
+ *	{"sce":1}	start capturing (clears the results)
+ *	...run a test move
+ *	{"scj":""}	jitter as [count,min,max,mean,stddev,missed] in nanoseconds
+ *	{"sch":""}	jitter histogram - steps per SC_BIN_NSEC of jitter, the last bin is the rest
+ *	{"sce":0}	stop capturing and give the pin back to the switch
+ *
+ * TC0 channel 1 runs at MCK/2, the DDA timer's clock, and latches the counter on
+ * each rising edge of the input in hardware, so the timestamps don't depend on the
+ * capture interrupt. Step pulses are only put out on DDA ticks, so the interval
+ * between two steps is a whole number of DDA periods, give or take the difference
+ * in how late the DDA interrupt set the two pulses. That difference is the jitter -
+ * the DDA interrupt being held off by another interrupt of the same or higher
+ * priority, or by code that masks interrupts, or taking a longer path on one tick.
+ *
+ * An interval longer than SC_GAP_USEC starts over, as the DDA timer restarts after
+ * the motors stop. A step in a segment with a new DDA clock shift is measured
+ * against the new period, so expect a little "jitter" where the clock changes.
+ * Missed counts the steps that came before the last capture was read, which should
+ * only happen with steps a few microseconds apart.
+ */
+
+#ifndef STEPCAP_H_ONCE
+#define STEPCAP_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __STEP_CAPTURE
+
+#ifdef __ENCODERS
+#error "__STEP_CAPTURE uses TC0 channel 1, which the encoder 1 decoder takes - see encoder.h"
+#endif
+
+#define SC_COUNTS_PER_USEC	(F_CPU/2/1000000)	// capture timer counts - MCK/2
+#define SC_GAP_USEC			100000		// an interval longer than this starts over
+#define SC_BINS				12			// histogram bins
+#define SC_BIN_NSEC			100			// jitter per bin
+
+typedef struct scSingleton {
+	uint8_t mode;						// $sce - 0=off, 1=capturing
+	uint8_t started;					// TRUE once a first step has been captured
+	uint32_t last;						// capture of the previous step
+	volatile uint32_t count;			// intervals measured
+	volatile uint32_t missed;			// steps whose capture was overwritten
+	int32_t min;						// least and most jitter in capture counts
+	int32_t max;
+	int64_t sum;						// sum of the jitter and of its square, for the mean
+	uint64_t sum_sq;					// ...and standard deviation
+	uint32_t bin[SC_BINS];				// histogram of the jitter magnitude
+} scSingleton_t;
+
+extern scSingleton_t sc;
+
+stat_t sc_set_mode(cmdObj_t *cmd);
+stat_t sc_get_jitter(cmdObj_t *cmd);
+stat_t sc_get_histogram(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void sc_print_scj(cmdObj_t *cmd);
+	void sc_print_sch(cmdObj_t *cmd);
+#else
+	#define sc_print_scj tx_print_stub
+	#define sc_print_sch tx_print_stub
+#endif
+
+#endif // __STEP_CAPTURE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: STEPCAP_H_ONCE
@@ -42,9 +42,24 @@
 #include "config.h"
 #include "stepper.h"
 #include "planner.h"
+#include "canonical_machine.h"
 #include "hardware.h"
+#include "kinematics.h"
 #include "text_parser.h"
 #include "util.h"
+#include "profiler.h"
+#include "pwm.h"
+#include "raster.h"
+#include "pso.h"
+#include "sync.h"
+#include "tmc2660.h"
+#include "encoder.h"
+#include "memguard.h"
+#include "stress.h"
+#include "swo.h"
+#include "replay.h"
+#include "selfbench.h"
+#include "settings.h"			// MOTORS_USED
 
 //#define ENABLE_DIAGNOSTICS
 #ifdef ENABLE_DIAGNOSTICS
@@ -53,6 +68,27 @@
 #define INCREMENT_DIAGNOSTIC_COUNTER(motor)	// choose this one to disable counters
 #endif
 
+// Steps actually emitted are counted in the DDA so they can be compared with the
+// substeps loaded into it. See st_get_se() and st_prep_line().
+#define _COUNT_STEP(motor) st_run.m[motor].step_position += st_run.m[motor].step_sign;
+
+// An inhibited motor drops its steps. They are taken off the commanded substeps so
+// they are not seen as lost steps and put back by step correction.
+#define _INHIBIT_STEP(motor) st_run.m[motor].commanded_substeps -= (int64_t)st_run.m[motor].step_sign * DDA_SUBSTEPS;
+
+#ifdef __DDA_RAMPING
+#define _RAMP_INCREMENT(motor) if (MOTOR_USED(motor)) { st_run.m[motor].phase_increment += st_run.m[motor].phase_delta;}
+#else
+#define _RAMP_INCREMENT(motor)
+#endif
+
+#define __STEP_PORT_BATCHING	// collect step bits per PIO port and write each port once per tick
+//#define __STEP_SINGLE_INTERRUPT	// one DDA interrupt per tick; pulses are ended by the next tick
+
+#ifdef __STEP_SINGLE_INTERRUPT
+#undef __TIMED_STEPS			// timed steps end their pulses on the match compare
+#endif
+
 /**** Allocate structures ****/
 
 stConfig_t st;
@@ -61,12 +97,37 @@ static stPrepSingleton_t st_prep;
 
 /**** Setup local functions ****/
 
-static void _load_move(void);
-static void _request_load_move(void);
+static void _load_move(void) HOT_PATH;
+static void _step_lines_off(void);
+static void _request_load_move(void) HOT_PATH;
+static void _check_exec_margin(const uint32_t deadline, const uint32_t cycles) HOT_PATH;
+static uint32_t _get_motion_left(void) HOT_PATH;
+static uint32_t _get_ticks_left(void) HOT_PATH;
+static uint32_t _get_ticks_prepared(void) HOT_PATH;
+static uint8_t _prep_is_ahead(void) HOT_PATH;
+static void _set_dda_clock(const stPrepSegment_t *sp) HOT_PATH;
+#ifdef __TIMED_STEPS
+static void _prep_timed_steps(stPrepSegment_t *sp, const float ticks) HOT_PATH;
+#endif
+#ifdef __MICROSTEP_MORPHING
+static void _prep_morph(stPrepSegment_t *sp, const float steps[], const float microseconds) HOT_PATH;
+static void _set_morph_shift(const uint8_t motor);
+#endif
 static void _clear_diagnostic_counters(void);
+static void _correct_step_error(void);
+static void _set_step_timing(void);
+static float _get_dynamic_power(const uint8_t motor, const float steps, const float microseconds);
+static void _request_motor_power(const uint8_t motor);
+static float _get_backlash_takeup(const uint8_t motor, const float steps) HOT_PATH;
 
-// handy macro
+// handy macros
 #define _f_to_period(f) (uint16_t)((float)F_CPU / (float)f)
+#define _prep_next(i) (((i)+1 == ST_PREP_SEGMENTS) ? 0 : (i)+1)
+#define _prep_is_full() (_prep_next(st_prep.head) == st_prep.tail)
+#define DDA_TICKS_PER_USEC ((float)FREQUENCY_DDA / (float)1000000)
+#define DWELL_USEC_PER_PERIOD (1000000UL / FREQUENCY_DWELL)
+#define _get_cycles() (HW_DWT_CYCCNT)			// enabled at boot - see main.cpp
+#define CYCLES_PER_USEC (F_CPU / 1000000)
 
 /**** Setup motate ****/
 
@@ -142,6 +203,33 @@ Stepper<motor_6_step_pin_num,
 		motor_6_microstep_1_pin_num,
 		motor_6_vref_pin_num> motor_6;
 
+/* Port-batched step pulses
+ *
+ *	With __STEP_PORT_BATCHING the DDA ISR ORs each stepping motor's step bit into
+ *	a set mask for its PIO port, then writes each port with a single SODR store.
+ *	Pulses are ended with one CODR store per port. The port of each step pin is 
+ *	known at compile time from the Motate pin templates, so maskForPort() folds 
+ *	to a constant and ports with no step pins drop out of the compiled code.
+ */
+#ifdef __STEP_PORT_BATCHING
+
+Port32<'A'> step_port_a;
+Port32<'B'> step_port_b;
+Port32<'C'> step_port_c;
+Port32<'D'> step_port_d;
+
+#define _STEP_PORT_MASK(p) (motor_1.step.maskForPort(p) | motor_2.step.maskForPort(p) | \
+							motor_3.step.maskForPort(p) | motor_4.step.maskForPort(p) | \
+							motor_5.step.maskForPort(p) | motor_6.step.maskForPort(p))
+
+#define _STEP_ON(motor) { step_bits_a |= motor.step.maskForPort('A'); \
+						  step_bits_b |= motor.step.maskForPort('B'); \
+						  step_bits_c |= motor.step.maskForPort('C'); \
+						  step_bits_d |= motor.step.maskForPort('D'); }
+#else
+#define _STEP_ON(motor) motor.step.set();
+#endif // __STEP_PORT_BATCHING
+
 /************************************************************************************
  **** CODE **************************************************************************
  ************************************************************************************/
@@ -157,14 +245,25 @@ Stepper<motor_6_step_pin_num,
 
 void stepper_init()
 {
-	memset(&st_run, 0, sizeof(st_run));		// clear all values, pointers and status
+	memset(&st_run, 0, MG_SIZEOF(st_run));	// clear all values, pointers and status
 	st_run.magic_start = MAGICNUM;
+	st_run.dda_top = dda_timer.getTopValue();	// period at FREQUENCY_DDA - see DDA_CLOCK_SHIFT_MAX
+	st_run.dda_top_base = st_run.dda_top;
+	st_run.dwell_top = dwell_timer.getTopValue();	// longest dwell period - see _set_dwell_period()
 	st_prep.magic_start = MAGICNUM;
+	st_prep.magic_end = MAGICNUM;
+	MG_SET_GUARD(MG_STEPPER_RUN, st_run);
+	MG_SET_GUARD(MG_STEPPER_PREP, st_prep);
 	_clear_diagnostic_counters();
+	st_run.power_changed = (1 << MOTORS) - 1;	// apply the power levels on the first callback
 
 	// setup DDA timer (see FOOTNOTE)
+#ifdef __STEP_SINGLE_INTERRUPT
+	dda_timer.setInterrupts(kInterruptOnOverflow | kInterruptPriorityHighest);
+#else
 	dda_timer.setInterrupts(kInterruptOnOverflow | kInterruptOnMatchA | kInterruptPriorityHighest);
-	dda_timer.setDutyCycleA(0.25);
+#endif
+	_set_step_timing();							// pulse width and dir setup from $sph and $sds
 
 	// setup DWELL timer
 	dwell_timer.setInterrupts(kInterruptOnOverflow | kInterruptPriorityHighest);
@@ -175,7 +274,16 @@ void stepper_init()
 	// setup EXEC timer
 	exec_timer.setInterrupts(kInterruptOnSoftwareTrigger | kInterruptPriorityLowest);
 
-	st_prep.exec_state = PREP_BUFFER_OWNED_BY_EXEC;		// initial condition
+	st_prep.head = 0;									// initial condition - ring is empty
+	st_prep.tail = 0;
+	for (uint8_t i=0; i<ST_PREP_SEGMENTS; i++) {
+		st_prep.seg[i].buffer_state = PREP_BUFFER_OWNED_BY_EXEC;
+		st_prep.seg[i].move_type = MOVE_TYPE_NULL;
+	}
+	for (uint8_t i=0; i<MOTORS; i++) {
+		st_prep.substep_residual[i] = 0;
+		st_run.m[i].dir = DIR_UNKNOWN;
+	}
 }
 /*	FOOTNOTE: This is the bare code that the Motate timer calls replace.
 	NB: requires: #include <component_tc.h>
@@ -206,6 +314,7 @@ stat_t st_assertions()
 {
 	if (st_run.magic_start  != MAGICNUM) return (STAT_MEMORY_FAULT);
 	if (st_prep.magic_start != MAGICNUM) return (STAT_MEMORY_FAULT);
+	if (st_prep.magic_end   != MAGICNUM) return (STAT_MEMORY_FAULT);
 	return (STAT_OK);
 }
 
@@ -242,6 +351,7 @@ static void _energize_motor(const uint8_t motor)
 	if (!motor_6.enable.isNull()) if (motor == MOTOR_6) motor_6.enable.clear();
 
 	st_run.m[motor].power_state = MOTOR_START_IDLE_TIMEOUT;
+	_request_motor_power(motor);
 }
 
 static void _deenergize_motor(const uint8_t motor)
@@ -255,9 +365,39 @@ static void _deenergize_motor(const uint8_t motor)
 	if (!motor_6.enable.isNull()) if (motor == MOTOR_6) motor_6.enable.set();
 
 	st_run.m[motor].power_state = MOTOR_OFF;
+	_request_motor_power(motor);
 }
 
-void st_set_motor_power(const uint8_t motor) { }	// code for PWM driven Vref goes here
+/*
+ * st_set_motor_power() - set the Vref power of a motor from its power mode and state
+ *
+ *	MOTOR_POWER_REDUCED_WHEN_IDLE runs at $1pl and drops to $1pi once the motor has
+ *	been stopped for the idle timeout ($mt). DYNAMIC_MOTOR_POWER also drops to $1pi, 
+ *	and while running takes the level computed for the loaded segment - see 
+ *	_get_dynamic_power(). Stopped but not yet idle motors hold at $1pl. Other modes
+ *	run at $1pl and only use the enable line. The Vref PWM is written only when the
+ *	level changes. Called from st_motor_power_callback() as the motor is sequenced.
+ */
+void st_set_motor_power(const uint8_t motor)
+{
+	float level = st.m[motor].power_level;
+
+	if (st.m[motor].power_mode >= MOTOR_POWER_REDUCED_WHEN_IDLE) {
+		if (st_run.m[motor].power_state == MOTOR_IDLE) {
+			level = st.m[motor].power_idle;
+		} else if ((st.m[motor].power_mode == DYNAMIC_MOTOR_POWER) && (st_run.m[motor].power_state == MOTOR_RUNNING)) {
+			level = st_run.m[motor].power_level;
+		}
+	}
+	if (fp_NE(level, st_run.m[motor].power_applied)) {
+		st_run.m[motor].power_applied = level;
+#ifdef __TMC2660
+		tmc_set_current(motor, level);			// SPI drivers take the current as a register
+#else
+		pwm_set_vref(motor, level);
+#endif
+	}
+}
 
 void st_energize_motors()
 {
@@ -275,6 +415,9 @@ void st_energize_motors()
 	st_run.m[MOTOR_4].power_state = MOTOR_START_IDLE_TIMEOUT;
 	st_run.m[MOTOR_5].power_state = MOTOR_START_IDLE_TIMEOUT;
 	st_run.m[MOTOR_6].power_state = MOTOR_START_IDLE_TIMEOUT;
+	__disable_irq();
+	st_run.power_changed = (1 << MOTORS) - 1;
+	__enable_irq();
 }
 
 void st_deenergize_motors()
@@ -288,53 +431,77 @@ void st_deenergize_motors()
 	common_enable.set();			// disable gShield common enable
 }
 
+/*
+ * st_motor_power_callback() - sequence the motors whose power state is due to change
+ *
+ *	Motors are only sequenced when something has happened to them - the loader or
+ *	an energize has changed their state (power_changed), the steppers have stopped
+ *	under a reduced or dynamic power motor (power_running), or the first of the idle
+ *	timeouts is due (power_due). Otherwise this is a couple of tests a millisecond.
+ */
+static void _request_motor_power(const uint8_t motor)
+{
+	__disable_irq();						// the loader sets power_changed from its interrupt
+	st_run.power_changed |= (1 << motor);
+	__enable_irq();
+}
+
+static void _sequence_motor_power(const uint8_t motor, const uint32_t now)
+{
+	uint8_t mode = st.m[motor].power_mode;
+	stRunMotor_t *run = &st_run.m[motor];
+
+	if ((run->power_state == MOTOR_RUNNING) && 
+		(mode != MOTOR_ENERGIZED_DURING_CYCLE) && (mode != MOTOR_IDLE_WHEN_STOPPED)) {
+		if (stepper_isbusy() == true) {
+			st_run.power_running |= (1 << motor);
+		} else {
+			run->power_state = MOTOR_START_IDLE_TIMEOUT;
+		}
+	}
+	if (run->power_state == MOTOR_START_IDLE_TIMEOUT) {
+		float timeout = (mode == MOTOR_IDLE_WHEN_STOPPED) ? IDLE_TIMEOUT_SECONDS : st.motor_idle_timeout;
+		run->power_systick = now + (uint32_t)(timeout * 1000);
+		run->power_state = MOTOR_TIME_IDLE_TIMEOUT;
+	}
+	if (run->power_state == MOTOR_TIME_IDLE_TIMEOUT) {
+		if ((int32_t)(now - run->power_systick) < 0) {
+			st_run.power_timing |= (1 << motor);
+		} else if ((mode == MOTOR_ENERGIZED_DURING_CYCLE) || (mode == MOTOR_IDLE_WHEN_STOPPED)) {
+			_deenergize_motor(motor);
+		} else {
+			run->power_state = MOTOR_IDLE;		// reduced or dynamic power - drop to idle power
+		}
+	}
+	st_set_motor_power(motor);
+}
+
 stat_t st_motor_power_callback() 	// called by controller
 {
-	// manage power for each motor individually - facilitates advanced features
+	uint32_t now = SysTickTimer.getValue();
+	uint8_t stopped = ((st_run.power_running != 0) && (stepper_isbusy() == false));
+	uint8_t due = ((st_run.power_timing != 0) && ((int32_t)(now - st_run.power_due) >= 0));
+
+	if ((st_run.power_changed == 0) && (stopped == false) && (due == false)) { return (STAT_NOOP);}
+
+	__disable_irq();
+	uint8_t motors = st_run.power_changed;
+	st_run.power_changed = 0;
+	__enable_irq();
+	if (stopped == true) { motors |= st_run.power_running;}
+	if (due == true) { motors |= st_run.power_timing;}
+	st_run.power_running &= ~motors;
+	st_run.power_timing &= ~motors;
+
 	for (uint8_t motor = MOTOR_1; motor < MOTORS; motor++) {
-
-		if (st.m[motor].power_mode == MOTOR_ENERGIZED_DURING_CYCLE) {
-
-			switch (st_run.m[motor].power_state) {
-				case (MOTOR_START_IDLE_TIMEOUT): {
-//					st_run.m[motor].power_systick = SysTickTimer_getValue() + (uint32_t)(st.motor_idle_timeout * 1000);
-					st_run.m[motor].power_systick = SysTickTimer.getValue() + (uint32_t)(st.motor_idle_timeout * 1000);
-					st_run.m[motor].power_state = MOTOR_TIME_IDLE_TIMEOUT;
-					break;
-				}
-
-				case (MOTOR_TIME_IDLE_TIMEOUT): {
-//					if (SysTickTimer_getValue() > st_run.m[motor].power_systick ) {
-					if (SysTickTimer.getValue() > st_run.m[motor].power_systick ) {
-						st_run.m[motor].power_state = MOTOR_IDLE;
-						_deenergize_motor(motor);
-					}
-					break;
-				}
-			}
-			} else if(st.m[motor].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-			switch (st_run.m[motor].power_state) {
-				case (MOTOR_START_IDLE_TIMEOUT): {
-//					st_run.m[motor].power_systick = SysTickTimer_getValue() + (uint32_t)(IDLE_TIMEOUT_SECONDS * 1000);
-					st_run.m[motor].power_systick = SysTickTimer.getValue() + (uint32_t)(IDLE_TIMEOUT_SECONDS * 1000);
-					st_run.m[motor].power_state = MOTOR_TIME_IDLE_TIMEOUT;
-					break;
-				}
-
-				case (MOTOR_TIME_IDLE_TIMEOUT): {
-//					if (SysTickTimer_getValue() > st_run.m[motor].power_systick ) {
-					if (SysTickTimer.getValue() > st_run.m[motor].power_systick ) {
-						st_run.m[motor].power_state = MOTOR_IDLE;
-						_deenergize_motor(motor);
-					}
-					break;
-				}
-			}
-
-//		} else if(st_run.m[motor].power_mode == MOTOR_POWER_REDUCED_WHEN_IDLE) {	// future
-			
-//		} else if(st_run.m[motor].power_mode == DYNAMIC_MOTOR_POWER) {				// future
-			
+		if (motors & (1 << motor)) { _sequence_motor_power(motor, now);}
+	}
+	uint8_t first = true;
+	for (uint8_t motor = MOTOR_1; motor < MOTORS; motor++) {	// find the next timeout to end
+		if ((st_run.power_timing & (1 << motor)) == 0) { continue;}
+		if ((first == true) || ((int32_t)(st_run.m[motor].power_systick - st_run.power_due) < 0)) {
+			st_run.power_due = st_run.m[motor].power_systick;
+			first = false;
 		}
 	}
 	return (STAT_OK);
@@ -346,15 +513,35 @@ stat_t st_motor_power_callback() 	// called by controller
 
 /*
  * Dwell timer interrupt
+ * _set_dwell_period() - time the next period of the dwell
+ *
+ *	A dwell counts down its microseconds (dda_ticks_downcount) in timer periods of 
+ *	up to 1/FREQUENCY_DWELL. The last period is cut to what is left, so a dwell runs 
+ *	its exact microsecond count rather than being rounded up to whole periods. The 
+ *	timer counts at MCK/2, so a period is set to 1/42 microsecond.
  */
+static void _set_dwell_period()
+{
+	st_run.dwell_period_usec = min((uint32_t)st_run.dda_ticks_downcount, DWELL_USEC_PER_PERIOD);
+	dwell_timer.setTop((st_run.dwell_period_usec * st_run.dwell_top) / DWELL_USEC_PER_PERIOD);
+}
+
 namespace Motate {			// Must define timer interrupts inside the Motate namespace
 MOTATE_TIMER_INTERRUPT(dwell_timer_num) 
 {
+	PROFILE_START;
+	SWO_ISR_ENTER(SWO_ISR_DWELL);
 	dwell_timer.getInterruptCause(); // read SR to clear interrupt condition
-	if (--st_run.dda_ticks_downcount == 0) {
+	st_run.dda_ticks_downcount -= st_run.dwell_period_usec;
+	if (st_run.dda_ticks_downcount <= 0) {
+		st_run.dda_ticks_downcount = 0;
 		dwell_timer.stop();
 		_load_move();
+	} else {
+		_set_dwell_period();
 	}
+	SWO_ISR_EXIT(SWO_ISR_DWELL);
+	PROFILE_END(PF_DWELL_ISR);
 }
 } // namespace Motate
 
@@ -365,57 +552,143 @@ MOTATE_TIMER_INTERRUPT(dwell_timer_num)
  *	Overflow interrupts are used to set step pins, match interrupts clear step pins.
  *	This way the duty cycle of the stepper pulse can be controlled by setting the match value.
  *
- *	Note that the motor_N.step.isNull() tests are compile-time tests, not run-time tests. 
- *	If motor_N is not defined that if{} clause (i.e. that motor) drops out of the complied code.
+ *	With __STEP_SINGLE_INTERRUPT there is no match interrupt. Each overflow first ends
+ *	the pulses raised on the previous tick, so pulses are one DDA period wide. Since the
+ *	DDA spreads steps evenly a motor running below FREQUENCY_DDA/2 never steps on two 
+ *	consecutive ticks, so the low time is also at least one period. At the end of a 
+ *	move the timer runs one trailing tick to end the last pulse, unless _load_move() 
+ *	has loaded a following line, in which case stepping continues without a gap.
+ *
+ *	Note that the motor_N.step.isNull() and MOTOR_USED() tests are compile-time tests, not 
+ *	run-time tests. If motor_N is not defined, or is not in MOTORS_USED, that if{} clause 
+ *	(i.e. that motor) drops out of the complied code.
  */
 namespace Motate {			// Must define timer interrupts inside the Motate namespace
-MOTATE_TIMER_INTERRUPT(dda_timer_num)
+HOT_TIMER_INTERRUPT(dda_timer_num)
 {
+	PROFILE_START;
+	SWO_DDA(1);
 	uint32_t interrupt_cause = dda_timer.getInterruptCause();	// also clears interrupt condition
 
 	if (interrupt_cause == kInterruptOnOverflow) {
 		dda_debug_pin1 = 1;
+#ifdef __STEP_PORT_BATCHING
+		uint32_t step_bits_a = 0, step_bits_b = 0, step_bits_c = 0, step_bits_d = 0;
+#endif
+#ifdef __STEP_SINGLE_INTERRUPT
+		_step_lines_off();							// end the pulses from the previous tick
+		if (st_run.dda_pulse_trailer == true) {		// trailing tick only ends the last pulse
+			st_run.dda_pulse_trailer = false;
+			dda_timer.stop();
+			dda_debug_pin1 = 0;
+			SWO_DDA(0);
+			PROFILE_END(PF_DDA_ISR);
+			return;
+		}
+#endif
+		if (st_run.dda_hold_ticks != 0) {			// dir setup time after a dir change
+			st_run.dda_hold_ticks--;
+			dda_debug_pin1 = 0;
+			SWO_DDA(0);
+			PROFILE_END(PF_DDA_ISR);
+			return;
+		}
+#ifdef __TIMED_STEPS
+		if (st_run.timed_steps != 0) {				// time the next step of a timed segment
+			uint32_t period = st_run.timed_period;
+			if ((st_run.timed_residual += st_run.timed_remainder) >= st_run.timed_steps) {
+				st_run.timed_residual -= st_run.timed_steps;
+				period++;
+			}
+			dda_timer.setTop(period);
+		}
+#endif
 
-		if (!motor_1.step.isNull() && (st_run.m[MOTOR_1].phase_accumulator += st_run.m[MOTOR_1].phase_increment) > 0) {
+		if (MOTOR_USED(MOTOR_1) && !motor_1.step.isNull() && (st_run.m[MOTOR_1].phase_accumulator += st_run.m[MOTOR_1].phase_increment) > 0) {
 			st_run.m[MOTOR_1].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_1.step.set();		// turn step bit on
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_1);
+			if (st_run.m[MOTOR_1].inhibit == false) {
+				_STEP_ON(motor_1);		// turn step bit on
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_1);
+				_COUNT_STEP(MOTOR_1);
+			} else {
+				_INHIBIT_STEP(MOTOR_1);
+			}
 		}
-		if (!motor_2.step.isNull() && (st_run.m[MOTOR_2].phase_accumulator += st_run.m[MOTOR_2].phase_increment) > 0) {
+		_RAMP_INCREMENT(MOTOR_1);
+		if (MOTOR_USED(MOTOR_2) && !motor_2.step.isNull() && (st_run.m[MOTOR_2].phase_accumulator += st_run.m[MOTOR_2].phase_increment) > 0) {
 			st_run.m[MOTOR_2].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_2.step.set();
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_2);
+			if (st_run.m[MOTOR_2].inhibit == false) {
+				_STEP_ON(motor_2);
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_2);
+				_COUNT_STEP(MOTOR_2);
+			} else {
+				_INHIBIT_STEP(MOTOR_2);
+			}
 		}
-		if (!motor_3.step.isNull() && (st_run.m[MOTOR_3].phase_accumulator += st_run.m[MOTOR_3].phase_increment) > 0) {
+		_RAMP_INCREMENT(MOTOR_2);
+		if (MOTOR_USED(MOTOR_3) && !motor_3.step.isNull() && (st_run.m[MOTOR_3].phase_accumulator += st_run.m[MOTOR_3].phase_increment) > 0) {
 			st_run.m[MOTOR_3].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_3.step.set();
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_3);
+			if (st_run.m[MOTOR_3].inhibit == false) {
+				_STEP_ON(motor_3);
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_3);
+				_COUNT_STEP(MOTOR_3);
+			} else {
+				_INHIBIT_STEP(MOTOR_3);
+			}
 		}
-		if (!motor_4.step.isNull() && (st_run.m[MOTOR_4].phase_accumulator += st_run.m[MOTOR_4].phase_increment) > 0) {
+		_RAMP_INCREMENT(MOTOR_3);
+		if (MOTOR_USED(MOTOR_4) && !motor_4.step.isNull() && (st_run.m[MOTOR_4].phase_accumulator += st_run.m[MOTOR_4].phase_increment) > 0) {
 			st_run.m[MOTOR_4].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_4.step.set();
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_4);
+			if (st_run.m[MOTOR_4].inhibit == false) {
+				_STEP_ON(motor_4);
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_4);
+				_COUNT_STEP(MOTOR_4);
+			} else {
+				_INHIBIT_STEP(MOTOR_4);
+			}
 		}
-		if (!motor_5.step.isNull() && (st_run.m[MOTOR_5].phase_accumulator += st_run.m[MOTOR_5].phase_increment) > 0) {
+		_RAMP_INCREMENT(MOTOR_4);
+		if (MOTOR_USED(MOTOR_5) && !motor_5.step.isNull() && (st_run.m[MOTOR_5].phase_accumulator += st_run.m[MOTOR_5].phase_increment) > 0) {
 			st_run.m[MOTOR_5].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_5.step.set();
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_5);
+			if (st_run.m[MOTOR_5].inhibit == false) {
+				_STEP_ON(motor_5);
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_5);
+				_COUNT_STEP(MOTOR_5);
+			} else {
+				_INHIBIT_STEP(MOTOR_5);
+			}
 		}
-		if (!motor_6.step.isNull() && (st_run.m[MOTOR_6].phase_accumulator += st_run.m[MOTOR_6].phase_increment) > 0) {
+		_RAMP_INCREMENT(MOTOR_5);
+		if (MOTOR_USED(MOTOR_6) && !motor_6.step.isNull() && (st_run.m[MOTOR_6].phase_accumulator += st_run.m[MOTOR_6].phase_increment) > 0) {
 			st_run.m[MOTOR_6].phase_accumulator -= st_run.dda_ticks_X_substeps;
-			motor_6.step.set();
-			INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_6);
+			if (st_run.m[MOTOR_6].inhibit == false) {
+				_STEP_ON(motor_6);
+				INCREMENT_DIAGNOSTIC_COUNTER(MOTOR_6);
+				_COUNT_STEP(MOTOR_6);
+			} else {
+				_INHIBIT_STEP(MOTOR_6);
+			}
 		}
+		_RAMP_INCREMENT(MOTOR_6);
+#ifdef __STEP_PORT_BATCHING
+		if (_STEP_PORT_MASK('A') != 0) step_port_a.set(step_bits_a);	// compile-time tests
+		if (_STEP_PORT_MASK('B') != 0) step_port_b.set(step_bits_b);
+		if (_STEP_PORT_MASK('C') != 0) step_port_c.set(step_bits_c);
+		if (_STEP_PORT_MASK('D') != 0) step_port_d.set(step_bits_d);
+#endif
+		RASTER_STEP();								// raster pixels follow the step count (see raster.h)
+		PSO_TICK();									// position synchronized outputs (see pso.h)
+#ifdef __STEP_SINGLE_INTERRUPT
+		if (--st_run.dda_ticks_downcount == 0) {	// process end of move
+			st_run.dda_pulse_trailer = true;		// run a trailing tick to end the pulses...
+			_load_move();							// ...unless a following line gets loaded
+		}
+#endif
 		dda_debug_pin1 = 0;
 
-	} else if (interrupt_cause == kInterruptOnMatchA) { // dda_timer.getInterruptCause() == kInterruptOnMatchA
+	} else if ((interrupt_cause == kInterruptOnMatchA) && (st_run.dda_hold_ticks == 0)) { // no pulses to end while holding
 		dda_debug_pin2 = 1;
-		motor_1.step.clear();		// turn step bits off
-		motor_2.step.clear();
-		motor_3.step.clear();
-		motor_4.step.clear();
-		motor_5.step.clear();
-		motor_6.step.clear();
+		_step_lines_off();							// turn step bits off
 
 		if (--st_run.dda_ticks_downcount == 0) {	// process end of move
 			dda_timer.stop();						// turn it off or it will keep stepping out the last segment
@@ -423,9 +696,31 @@ MOTATE_TIMER_INTERRUPT(dda_timer_num)
 		}
 		dda_debug_pin2 = 0;
 	}
+	SWO_DDA(0);
+	PROFILE_END(PF_DDA_ISR);
 }
 } // namespace Motate
 
+/*
+ * _step_lines_off() - clear all step pins
+ */
+static inline void _step_lines_off()
+{
+#ifdef __STEP_PORT_BATCHING
+	if (_STEP_PORT_MASK('A') != 0) step_port_a.clear(_STEP_PORT_MASK('A'));	// compile-time tests
+	if (_STEP_PORT_MASK('B') != 0) step_port_b.clear(_STEP_PORT_MASK('B'));
+	if (_STEP_PORT_MASK('C') != 0) step_port_c.clear(_STEP_PORT_MASK('C'));
+	if (_STEP_PORT_MASK('D') != 0) step_port_d.clear(_STEP_PORT_MASK('D'));
+#else
+	motor_1.step.clear();
+	motor_2.step.clear();
+	motor_3.step.clear();
+	motor_4.step.clear();
+	motor_5.step.clear();
+	motor_6.step.clear();
+#endif
+}
+
 /****************************************************************************************
  * Exec sequencing code - computes and prepares next load segment
  * st_request_exec_move()	- SW interrupt to request to execute a move
@@ -433,33 +728,150 @@ MOTATE_TIMER_INTERRUPT(dda_timer_num)
  */
 void st_request_exec_move()
 {
-	if (st_prep.exec_state == PREP_BUFFER_OWNED_BY_EXEC) {	// bother interrupting
+#ifdef __PLANNER_BENCHMARK
+	return;									// the benchmark calls the exec function directly
+#endif
+	if (SB_RUNNING()) { return;}				// the self benchmark's blocks are flushed, never run
+	if (!_prep_is_full()) {						// bother interrupting
 		exec_timer.setInterruptPending();
 	}
 }
 
 namespace Motate {	// Define timer inside Motate namespace
-MOTATE_TIMER_INTERRUPT(exec_timer_num)			// exec move SW interrupt
+HOT_TIMER_INTERRUPT(exec_timer_num)			// exec move SW interrupt
 {
+	PROFILE_START;
+	SWO_ISR_ENTER(SWO_ISR_EXEC);
 	exec_timer.getInterruptCause();				// clears the interrupt condition
-   	if (st_prep.exec_state == PREP_BUFFER_OWNED_BY_EXEC) {
+	if (!_prep_is_full() && !_prep_is_ahead()) {	// the next load asks again (see ST_PREP_AHEAD_USEC)
+		uint32_t deadline = _get_motion_left();		// when the loader needs the segment
+		uint32_t start = _get_cycles();
 		if (mp_exec_move() != STAT_NOOP) {
-			st_prep.exec_state = PREP_BUFFER_OWNED_BY_LOADER; // flip it back
+			_check_exec_margin(deadline, _get_cycles() - start);
+			st_prep.seg[st_prep.head].buffer_state = PREP_BUFFER_OWNED_BY_LOADER;
+			st_prep.head = _prep_next(st_prep.head);	// hand the segment to the loader
 			_request_load_move();
+			st_request_exec_move();					// keep filling the ring
 		}
 	}
+	SWO_ISR_EXIT(SWO_ISR_EXEC);
+	PROFILE_END(PF_EXEC_ISR);
 }
 
 } // namespace Motate
 
+/*
+ * _check_exec_margin() - record how much motion was left when the exec finished a segment
+ *
+ *	The margin is the DDA ticks left in the running segment plus the ticks of the 
+ *	lines prepared ahead of the new segment. It is only measured while a line is 
+ *	running - the first segment after a stop has nothing to race. The downcount is
+ *	read before the ring so a load that interrupts the count can only make the 
+ *	margin smaller, never hide a near miss.
+ *
+ *	The deadline is the same motion taken as the exec started, and cycles the time
+ *	the exec took to prepare the segment. What is left of the deadline is the slack
+ *	kept for the job (see mpj) - it includes the time the exec was preempted by the
+ *	loader and the DDA, as that is time the segment was not ready.
+ */
+static void _check_exec_margin(const uint32_t deadline, const uint32_t cycles)
+{
+	uint32_t margin = _get_motion_left();
+	if (margin == 0) { return;}
+	if ((margin * EXEC_NEAR_MISS_FRACTION) < st_run.segment_ticks) {
+		mps.exec_near_misses++;
+	}
+	uint32_t usec = (uint32_t)(margin / DDA_TICKS_PER_USEC);
+	if (usec < mps.exec_margin_min) { mps.exec_margin_min = usec;}
+
+	if (deadline == 0) { return;}
+	uint32_t exec_usec = cycles / CYCLES_PER_USEC;
+	uint32_t deadline_usec = (uint32_t)(deadline / DDA_TICKS_PER_USEC);
+	uint32_t slack = (exec_usec < deadline_usec) ? (deadline_usec - exec_usec) : 0;
+	if (exec_usec > mpj.exec_usec_max) { mpj.exec_usec_max = exec_usec;}
+	if (slack < mpj.exec_slack_min) { mpj.exec_slack_min = slack;}
+	if (slack < st.exec_slack_late) { mpj.exec_late++;}
+}
+
+/*
+ * _get_motion_left() - FREQUENCY_DDA ticks left before the steppers run dry
+ *
+ *	The rest of the running line segment and the lines prepared behind it. Zero if
+ *	no line is running.
+ */
+static uint32_t _get_motion_left()
+{
+	uint32_t ticks = _get_ticks_left();
+	if ((ticks == 0) || (st_run.segment_ticks == 0)) { return (0);}
+	return (ticks + _get_ticks_prepared());
+}
+
+/*
+ * _get_ticks_prepared() - FREQUENCY_DDA ticks of the line segments waiting to load
+ */
+static uint32_t _get_ticks_prepared()
+{
+	uint32_t ticks = 0;
+	for (uint8_t i = st_prep.tail; i != st_prep.head; i = _prep_next(i)) {
+		if (st_prep.seg[i].move_type == MOVE_TYPE_ALINE) {
+			ticks += st_prep.seg[i].segment_ticks;
+		}
+	}
+	return (ticks);
+}
+
+/*
+ * _prep_is_ahead() - true if the exec should wait for a load before preparing more
+ *
+ *	The running segment stands in for the next one, as body segments are all the
+ *	same length. A segment is always prepared if none is waiting, so the steppers
+ *	are never left to run dry by the cap (see ST_PREP_AHEAD_USEC).
+ */
+static uint8_t _prep_is_ahead()
+{
+	uint32_t ticks = _get_ticks_prepared();
+	if (ticks == 0) { return (false);}
+	return ((ticks + st_run.segment_ticks) > (uint32_t)(ST_PREP_AHEAD_USEC * DDA_TICKS_PER_USEC));
+}
+
+/*
+ * _get_ticks_left() - FREQUENCY_DDA ticks left in the running line segment
+ *
+ *	A timed segment counts down steps, each of them a timed period long.
+ */
+static uint32_t _get_ticks_left()
+{
+#ifdef __TIMED_STEPS
+	if (st_run.timed_steps != 0) {
+		return ((uint32_t)(((uint64_t)st_run.dda_ticks_downcount * st_run.timed_period) / st_run.dda_top));
+	}
+#endif
+	return (st_run.dda_ticks_downcount << st_run.dda_clock_shift);
+}
+
+/*
+ * st_benchmark_exec_move() - run the exec function without the steppers
+ *
+ *	The segment is prepared but never handed to the loader, so it is discarded.
+ */
+#ifdef __PLANNER_BENCHMARK
+stat_t st_benchmark_exec_move()
+{
+	return (mp_exec_move());
+}
+#endif
+
 /****************************************************************************************
  * Load sequencing code
  *
+ * st_request_load_move() - request a load from outside the stepper module (sync edges)
  * _request_load()		- fires a software interrupt (timer) to request to load a move
  *  load_mode interrupt	- interrupt handler for running the loader
  * _load_move() 		- load a move into steppers, load a dwell, or process a Null move
  */
 
+void st_request_load_move() { _request_load_move();}
+
 static void _request_load_move()
 {
 	if (st_run.dda_ticks_downcount == 0) {	// bother interrupting
@@ -469,13 +881,132 @@ static void _request_load_move()
 }
 
 namespace Motate {	// Define timer inside Motate namespace
-MOTATE_TIMER_INTERRUPT(load_timer_num)		// load steppers SW interrupt
+HOT_TIMER_INTERRUPT(load_timer_num)			// load steppers SW interrupt
 {
+	PROFILE_START;
+	SWO_ISR_ENTER(SWO_ISR_LOAD);
 	load_timer.getInterruptCause();			// read SR to clear interrupt condition
 	_load_move();
+	SWO_ISR_EXIT(SWO_ISR_LOAD);
+	PROFILE_END(PF_LOAD_ISR);
 }
 } // namespace Motate
 
+#ifdef __MICROSTEP_MORPHING
+/*
+ * _set_ms_pins() - set a driver's microsteps on its MS pins (1,2,4,8)
+ */
+template<typename stepper_t>
+static inline void _set_ms_pins(stepper_t &motor, const uint8_t microsteps)
+{
+	if ((microsteps & 0x0A) != 0) { motor.ms0.set();} else { motor.ms0.clear();}	// 8 and 2
+	if ((microsteps & 0x0C) != 0) { motor.ms1.set();} else { motor.ms1.clear();}	// 8 and 4
+}
+
+/*
+ * _load_morph() - switch a motor's microsteps as its segment loads
+ *
+ *	Returns the phase increment of the segment in the pulses the motor runs it at.
+ *	The driver is only switched on a full step. Off one, the steps to the next full
+ *	step are added to the segment, if the DDA can take them, and lent to the prep
+ *	(see Microstep morphing in stepper.h). A motor the segment doesn't move waits.
+ */
+template<typename stepper_t>
+static inline uint32_t _load_morph(stepper_t &motor, const uint8_t m, const stPrepSegment_t *sp)
+{
+	uint8_t shift = st_run.m[m].morph_shift;
+	uint8_t want = (sp->m[m].morph_want == true) ? st.m[m].morph_shift : 0;
+	if ((want == shift) || (motor.ms0.isNull() && motor.ms1.isNull())) {	// compile-time test
+		return (sp->m[m].phase_increment >> shift);
+	}
+	int32_t microsteps = st.m[m].microsteps;
+	int32_t offset = st_run.m[m].step_position & (microsteps-1);	// steps past the last full step
+	if (offset == 0) {
+		_set_ms_pins(motor, microsteps >> want);
+		st_run.m[m].morph_shift = want;
+		return (sp->m[m].phase_increment >> want);
+	}
+	if (sp->m[m].phase_increment != 0) {
+		int32_t lend = (sp->m[m].substeps < 0) ? offset : (microsteps - offset);
+		uint32_t step_increment = sp->dda_ticks_X_substeps / sp->dda_ticks;	// one step, in either engine
+		uint32_t increment = (sp->m[m].phase_increment + (uint32_t)lend * step_increment) >> shift;
+		if (increment <= sp->dda_ticks_X_substeps) {		// at most one pulse a tick
+			if (sp->m[m].substeps < 0) { lend = -lend;}
+			st_run.m[m].morph_lent += lend;
+			st_run.m[m].commanded_substeps += (int64_t)lend * DDA_SUBSTEPS;
+			return (increment);
+		}
+	}
+	return (sp->m[m].phase_increment >> shift);
+}
+#endif
+
+/*
+ * _load_motor() - load one motor from the prep segment into the runtime
+ *
+ *	Instantiated once per Stepper<> type, so the pin accesses resolve at compile 
+ *	time and motors that are not on the board (Null pins) or not on the machine 
+ *	(MOTORS_USED) drop out entirely. 
+ *	Adding a motor is one Stepper<> declaration and one call in _load_move().
+ */
+template<typename stepper_t>
+static inline void _load_motor(stepper_t &motor, const uint8_t m, const stPrepSegment_t *sp)
+{
+	if (motor.step.isNull() || (MOTOR_USED(m) == false)) return;	// compile-time tests
+
+	uint8_t phase_shift = sp->substep_shift + sp->dda_clock_shift;
+#ifdef __TIMED_STEPS
+	if ((sp->timed_steps | st_run.timed_steps) != 0) {	// whole steps of the dominant motor - start mid-step
+		st_run.m[m].phase_accumulator = -(int32_t)(sp->dda_ticks_X_substeps >> 1);
+		phase_shift = st_run.phase_shift;			// nothing to carry
+	}
+#endif
+	if (phase_shift != st_run.phase_shift) {		// carry the phase into the new units
+		int64_t phase = ((int64_t)st_run.m[m].phase_accumulator << st_run.phase_shift) >> phase_shift;
+		st_run.m[m].phase_accumulator = (int32_t)max(phase, -(int64_t)sp->dda_ticks_X_substeps);
+	}
+#ifdef __MICROSTEP_MORPHING
+	st_run.m[m].phase_increment = _load_morph(motor, m, sp);	// may switch the microsteps
+	st_run.m[m].commanded_substeps += sp->m[m].substeps;
+	int32_t pulse_steps = 1 << st_run.m[m].morph_shift;		// steps a pulse moves the motor
+	st_run.m[m].step_sign = (sp->m[m].substeps < 0) ? -pulse_steps : pulse_steps;
+#else
+	st_run.m[m].phase_increment = sp->m[m].phase_increment;
+	st_run.m[m].commanded_substeps += sp->m[m].substeps;
+	st_run.m[m].step_sign = (sp->m[m].substeps < 0) ? -1 : 1;
+#endif
+#ifdef __DDA_RAMPING
+	st_run.m[m].phase_delta = sp->m[m].phase_delta;
+#endif
+	if (sp->reset_flag == true) {					// compensate for pulse phasing
+		st_run.m[m].phase_accumulator = -(st_run.dda_ticks_downcount);
+	}
+#ifdef __DDA_RAMPING
+	st_run.m[m].phase_accumulator += sp->m[m].phase_residual;
+#endif
+	if (st_run.m[m].phase_increment != 0) {			// motor is in this move
+		if (sp->m[m].dir != st_run.m[m].dir) {		// direction change - hold off for the dir setup
+			if (sp->m[m].dir == 0) {
+				motor.dir.clear();					// clear the bit for clockwise motion 
+			} else {
+				motor.dir.set();					// set the bit for CCW motion
+			}
+			st_run.m[m].dir = sp->m[m].dir;
+			st_run.dda_hold_ticks = st_run.dir_setup_ticks >> sp->dda_clock_shift;
+		}
+		motor.enable.clear();						// enable the motor (clear the ~Enable line)
+		if ((st_run.m[m].power_state != MOTOR_RUNNING) || (st_run.m[m].power_level != sp->m[m].power_level)) {
+			st_run.power_changed |= (1 << m);		// see st_motor_power_callback()
+		}
+		st_run.m[m].power_state = MOTOR_RUNNING;
+		st_run.m[m].power_level = sp->m[m].power_level;
+	} else if (st.m[m].power_mode != MOTOR_ENERGIZED_DURING_CYCLE) {	// motor is not in this move
+		motor.enable.clear();						// energize motor
+		st_run.m[m].power_state = MOTOR_START_IDLE_TIMEOUT;	// restarts the idle timeout
+		st_run.power_changed |= (1 << m);
+	}
+}
+
 /*
  * _load_move() - Dequeue move and load into stepper struct
  *
@@ -491,118 +1022,100 @@ MOTATE_TIMER_INTERRUPT(load_timer_num)		// load steppers SW interrupt
 
 void _load_move()
 {
-	// handle aline() loads first (most common case)  NB: there are no more lines, only alines()
-	if (st_prep.move_type == MOVE_TYPE_ALINE) {
-		st_run.dda_ticks_downcount = st_prep.dda_ticks;
-		st_run.dda_ticks_X_substeps = st_prep.dda_ticks_X_substeps;
- 
-		st_run.m[MOTOR_1].phase_increment = st_prep.m[MOTOR_1].phase_increment;
-		if (st_prep.reset_flag == true) {           // compensate for pulse phasing
-			st_run.m[MOTOR_1].phase_accumulator = -(st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_1].phase_increment != 0) {	// motor is in this move
-			if (st_prep.m[MOTOR_1].dir == 0) {
-				motor_1.dir.clear();			// clear the bit for clockwise motion 
-			} else {
-				motor_1.dir.set();				// set the bit for CCW motion
-			}
-			motor_1.enable.clear();				// enable the motor (clear the ~Enable line)
-			st_run.m[MOTOR_1].power_state = MOTOR_RUNNING;
-		} else {								// motor is not in this move
-			if (st.m[MOTOR_1].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_1.enable.clear();			// energize motor
-				st_run.m[MOTOR_1].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}			
-		}
-
-		st_run.m[MOTOR_2].phase_increment = st_prep.m[MOTOR_2].phase_increment;
-		if (st_prep.reset_flag == true) {
-			st_run.m[MOTOR_2].phase_accumulator = -(st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_2].phase_increment != 0) {
-			if (st_prep.m[MOTOR_2].dir == 0) motor_2.dir.clear(); else motor_2.dir.set();
-			motor_2.enable.clear();
-			st_run.m[MOTOR_2].power_state = MOTOR_RUNNING;
-		} else {
-			if (st.m[MOTOR_2].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_2.enable.clear();
-				st_run.m[MOTOR_2].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}
-		}
-
-		st_run.m[MOTOR_3].phase_increment = st_prep.m[MOTOR_3].phase_increment;
-		if (st_prep.reset_flag == true) {
-			st_run.m[MOTOR_3].phase_accumulator = -(st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_3].phase_increment != 0) {
-			if (st_prep.m[MOTOR_3].dir == 0) motor_3.dir.clear(); else motor_3.dir.set();
-			motor_3.enable.clear();
-			st_run.m[MOTOR_3].power_state = MOTOR_RUNNING;
-		} else {
-			if (st.m[MOTOR_3].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_3.enable.clear();
-				st_run.m[MOTOR_3].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}
-		}
-
-		st_run.m[MOTOR_4].phase_increment = st_prep.m[MOTOR_4].phase_increment;
-		if (st_prep.reset_flag == true) {
-			st_run.m[MOTOR_4].phase_accumulator = (st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_4].phase_increment != 0) {
-			if (st_prep.m[MOTOR_4].dir == 0) motor_4.dir.clear(); else motor_4.dir.set();
-			motor_4.enable.clear();
-			st_run.m[MOTOR_4].power_state = MOTOR_RUNNING;
-		} else {
-			if (st.m[MOTOR_4].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_4.enable.clear();
-				st_run.m[MOTOR_4].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}
-		}
-
-		st_run.m[MOTOR_5].phase_increment = st_prep.m[MOTOR_5].phase_increment;
-		if (st_prep.reset_flag == true) {
-			st_run.m[MOTOR_5].phase_accumulator = (st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_5].phase_increment != 0) {
-			if (st_prep.m[MOTOR_5].dir == 0) motor_5.dir.clear(); else motor_5.dir.set();
-			motor_5.enable.clear();
-			st_run.m[MOTOR_5].power_state = MOTOR_RUNNING;
-		} else {
-			if (st.m[MOTOR_5].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_5.enable.clear();
-				st_run.m[MOTOR_5].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}
+	stPrepSegment_t *sp = &st_prep.seg[st_prep.tail];
+	if ((st_prep.tail == st_prep.head) ||				// nothing prepared, or not yet handed
+		(sp->buffer_state != PREP_BUFFER_OWNED_BY_LOADER)) {	// over (exec is late or
+		if ((cm.hold_state == FEEDHOLD_OFF) &&			// ...a feedhold draining the segments or
+			(STRESS_RUNNING() || RP_RUNNING() ||		// a planned stop is not a gap - the stress
+			 ((mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE) && (mpj.stopped == false)))) {
+			mps.dda_gaps++;								// test, replay or planner has moves: exec is late
 		}
+		st_run.segment_ticks = 0;
+		RASTER_IDLE();									// no laser while the axes are stopped
+		PSO_IDLE();										// nothing times a pulse while the DDA is stopped
+		st_request_exec_move();							// there are no moves left)
+		return;
+	}
 
-		st_run.m[MOTOR_6].phase_increment = st_prep.m[MOTOR_6].phase_increment;
-		if (st_prep.reset_flag == true) {
-			st_run.m[MOTOR_6].phase_accumulator = (st_run.dda_ticks_downcount);
-		}
-		if (st_run.m[MOTOR_6].phase_increment != 0) {
-			if (st_prep.m[MOTOR_6].dir == 0) motor_6.dir.clear(); else motor_6.dir.set();
-			motor_6.enable.clear();
-			st_run.m[MOTOR_6].power_state = MOTOR_RUNNING;
-		} else {
-			if (st.m[MOTOR_6].power_mode == MOTOR_IDLE_WHEN_STOPPED) {
-				motor_6.enable.clear();
-				st_run.m[MOTOR_6].power_state = MOTOR_START_IDLE_TIMEOUT;
-			}
+	// handle aline() loads first (most common case)  NB: there are no more lines, only alines()
+	if (sp->move_type == MOVE_TYPE_ALINE) {
+		if (SYNC_LOAD()) {						// a slave waits for the master's edge (see sync.h)
+			st_run.segment_ticks = 0;
+			return;
 		}
+#ifdef __STEP_SINGLE_INTERRUPT
+		st_run.dda_pulse_trailer = false;		// the new line ends the previous pulses
+#endif
+		st_run.dda_ticks_downcount = sp->dda_ticks;
+		st_run.dda_ticks_X_substeps = sp->dda_ticks_X_substeps;
+		st_run.segment_ticks = sp->segment_ticks;
+		st_run.dda_hold_ticks = 0;				// set by _load_motor() if a dir changes
+		SWO_SEGMENT(sp->segment_ticks);
+ 
+		_load_motor(motor_1, MOTOR_1, sp);
+		_load_motor(motor_2, MOTOR_2, sp);
+		_load_motor(motor_3, MOTOR_3, sp);
+		_load_motor(motor_4, MOTOR_4, sp);
+		_load_motor(motor_5, MOTOR_5, sp);
+		_load_motor(motor_6, MOTOR_6, sp);
+		st_run.phase_shift = sp->substep_shift + sp->dda_clock_shift;
+		_set_dda_clock(sp);
 		dda_timer.start();		// start the DDA timer if not already running
+		if (sp->spindle_duty >= 0) { pwm_set_duty(PWM_1, sp->spindle_duty);}
+#ifdef __RASTER
+		if (sp->raster != RASTER_OFF) { rs_load_segment(sp->raster);}
+#endif
+#ifdef __PSO
+		if ((sp->pso_events | ps.armed) != 0) { ps_load_segment(sp->pso_events);}
+#endif
 
 	// handle dwells
-	} else if (st_prep.move_type == MOVE_TYPE_DWELL) {
-		st_run.dda_ticks_downcount = st_prep.dda_ticks;
+	} else if ((sp->move_type == MOVE_TYPE_DWELL) && (sp->dda_ticks != 0)) {
+		st_run.dda_ticks_downcount = sp->dda_ticks;		// microseconds, not DDA ticks
+		st_run.segment_ticks = 0;
+		_set_dwell_period();
 		dwell_timer.start();
 	}
 
 	// all cases drop to here - such as Null moves queued by MCodes
-	st_prep_null();										// needed to shut off timers if no moves left
-	st_prep.exec_state = PREP_BUFFER_OWNED_BY_EXEC;		// flip it back
+	sp->move_type = MOVE_TYPE_NULL;						// consumed - never loaded again
+	sp->buffer_state = PREP_BUFFER_OWNED_BY_EXEC;
+	st_prep.tail = _prep_next(st_prep.tail);			// free the segment for the exec
 	st_request_exec_move();								// compute and prepare the next move
 }
 
+/*
+ * _set_dda_clock() - set the timer period for the segment being loaded
+ *
+ *	A DDA segment sets the period of its clock shift, if it changed. A timed segment
+ *	sets the time to its first step, which also waits out the dir setup if a dir
+ *	changed, and the ISR sets each period after that. ST_TIMED_CLOCK makes the next
+ *	DDA segment set its period again.
+ */
+static void _set_dda_clock(const stPrepSegment_t *sp)
+{
+#ifdef __TIMED_STEPS
+	st_run.timed_steps = sp->timed_steps;
+	if (sp->timed_steps != 0) {
+		uint32_t period = sp->timed_period;
+		if (st_run.dda_hold_ticks != 0) {
+			period = max(period, (st_run.dir_setup_ticks + 1) * st_run.dda_top);
+			st_run.dda_hold_ticks = 0;
+		}
+		st_run.timed_period = sp->timed_period;
+		st_run.timed_remainder = sp->timed_remainder;
+		st_run.timed_residual = 0;
+		st_run.dda_clock_shift = ST_TIMED_CLOCK;
+		dda_timer.setTop(period);
+		return;
+	}
+#endif
+	if (sp->dda_clock_shift != st_run.dda_clock_shift) {	// see DDA_CLOCK_SHIFT_MAX
+		dda_timer.setTop(st_run.dda_top << sp->dda_clock_shift);
+		st_run.dda_clock_shift = sp->dda_clock_shift;
+	}
+}
+
 /* 
  * st_prep_null() - Keeps the loader happy. Otherwise performs no action
  *
@@ -610,7 +1123,7 @@ void _load_move()
  */
 void st_prep_null()
 {
-	st_prep.move_type = MOVE_TYPE_NULL;
+	st_prep.seg[st_prep.head].move_type = MOVE_TYPE_NULL;
 }
 
 /* 
@@ -619,9 +1132,12 @@ void st_prep_null()
 
 void st_prep_dwell(float microseconds)
 {
-	st_prep.move_type = MOVE_TYPE_DWELL;
-	st_prep.dda_ticks = (uint32_t)((microseconds/1000000) * FREQUENCY_DWELL); // ARM code
-//	st_prep.dda_period = _f_to_period(F_DWELL);	// AVR code
+	stPrepSegment_t *sp = &st_prep.seg[st_prep.head];
+
+	RP_RECORD_DWELL(microseconds);
+	sp->move_type = MOVE_TYPE_DWELL;
+	sp->dda_ticks = (uint32_t)lroundf(microseconds);	// the dwell timer counts microseconds - see _set_dwell_period()
+//	sp->dda_period = _f_to_period(F_DWELL);	// AVR code
 }
 
 /***********************************************************************************
@@ -636,48 +1152,439 @@ void st_prep_dwell(float microseconds)
  * Args:
  *	steps[] are signed relative motion in steps (can be non-integer values)
  *	Microseconds - how many microseconds the segment should run 
+ *
+ *	Backlash is taken up here, below the planner: when a motor reverses, the 
+ *	backlash of its axis ($xbl) is added to its steps over the next segments 
+ *	(see _get_backlash_takeup()). No blocks are queued for it and the runtime 
+ *	position does not include it.
+ *
+ *	The asynchronous axes are added here too - the aux runtime is asked for their
+ *	travel over the segment time (see plan_aux.cpp).
+ *
+ *	A segment whose fastest motor steps faster than ST_TIMED_STEP_RATE is rounded
+ *	to whole steps and timed per step, if the drivers can take the rate (see
+ *	__TIMED_STEPS in stepper.h and _prep_timed_steps()).
+ *
+ *	With __MICROSTEP_MORPHING a motor that may run the segment at its coarse
+ *	microsteps is rounded to whole coarse steps, and the step rate that sets the
+ *	DDA clock is counted in pulses (see _prep_morph()).
  */
 
 stat_t st_prep_line(float steps[], float microseconds)
 {
+	stPrepSegment_t *sp = &st_prep.seg[st_prep.head];
+
 	// *** defensive programming ***
 	// trap conditions that would prevent queuing the line
-	if (st_prep.exec_state != PREP_BUFFER_OWNED_BY_EXEC) { return (STAT_INTERNAL_ERROR);
+	if (_prep_is_full()) { return (STAT_INTERNAL_ERROR);
 	} else if (isfinite(microseconds) == false) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);
 	} else if (microseconds < EPSILON) { return (STAT_MINIMUM_TIME_MOVE_ERROR);
 	}
-	st_prep.reset_flag = false;         // initialize accumulator reset flag for this move.
+	RP_RECORD_LINE(steps, microseconds);	// the segment cache records what it is given (see replay.h)
+	AUX_PREP(steps, microseconds);
+	sp->reset_flag = false;         // initialize accumulator reset flag for this move.
 
-	// setup motor parameters
-	for (uint8_t i=0; i<MOTORS; i++) {
-		st_prep.m[i].dir = ((steps[i] < 0) ? 1 : 0) ^ st.m[i].polarity;
-		st_prep.m[i].phase_increment = (uint32_t)fabs(steps[i] * DDA_SUBSTEPS);
+	// fold any whole steps lost by the DDA back into the first move after an idle
+	if ((st.step_correction == true) && (st_prep.tail == st_prep.head) && (st_run.dda_ticks_downcount == 0)) {
+		_correct_step_error();
 	}
-	st_prep.dda_ticks = (uint32_t)((microseconds/1000000) * FREQUENCY_DDA);
-	st_prep.dda_ticks_X_substeps = st_prep.dda_ticks * DDA_SUBSTEPS;
+#ifdef __ENCODERS
+	en_sample(st_prep.substep_residual, DDA_SUBSTEPS);	// encoder corrections ride on the residual too
+#endif
+
+	// run the DDA as slow as the fastest motor allows, carrying the ticks the shift 
+	// drops into the next segment so the segment times still add up
+	float ticks = microseconds * DDA_TICKS_PER_USEC + st_prep.tick_residual;	// one multiply, no divide
+	float steps_max = 0;
+#ifdef __MICROSTEP_MORPHING
+	_prep_morph(sp, steps, microseconds);
+	for (uint8_t i=0; i<MOTORS; i++) { steps_max = max(steps_max, (float)fabs(steps[i]) / (1 << st_prep.pulse_shift[i]));}
+#else
+	for (uint8_t i=0; i<MOTORS; i++) { steps_max = max(steps_max, (float)fabs(steps[i]));}
+#endif
+#ifdef __TIMED_STEPS
+	uint8_t timed = ((steps_max * 1000000) > (ST_TIMED_STEP_RATE * microseconds)) &&
+					(RASTER_BUSY() == false) && (PSO_BUSY() == false);
+	sp->timed_steps = 0;
+#endif
+	sp->dda_clock_shift = 0;
+	while ((sp->dda_clock_shift < DDA_CLOCK_SHIFT_MAX) && 
+		   (ticks >= ((steps_max + 1) * DDA_MIN_TICKS_PER_STEP * (2 << sp->dda_clock_shift)))) {
+		sp->dda_clock_shift++;
+	}
+	sp->dda_ticks = (uint32_t)ticks >> sp->dda_clock_shift;
+	st_prep.tick_residual = ticks - (float)(sp->dda_ticks << sp->dda_clock_shift);
+	sp->substep_shift = 0;
+	while (sp->dda_ticks > (DDA_SUBSTEP_TICKS_MAX << sp->substep_shift)) {	// see DDA_SUBSTEP_SHIFT_MAX
+		if (++sp->substep_shift > DDA_SUBSTEP_SHIFT_MAX) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+	}
+	sp->dda_ticks_X_substeps = sp->dda_ticks * (DDA_SUBSTEPS >> sp->substep_shift);
+	int32_t substep_unit = 1 << sp->substep_shift;
+#ifdef __TIMED_STEPS
+	if (timed) { substep_unit = DDA_SUBSTEPS;}	// whole steps, which either engine can run
+#endif
 
 	// FOOTNOTE: The above expression was previously computed as below but floating
 	// point rounding errors caused subtle and nasty accumulated position errors:
 	// sp.dda_ticks_X_substeps = (uint32_t)((microseconds/1000000) * f_dda * dda_substeps);
 
+	// setup motor parameters
+	// Substeps are rounded to the nearest unit and the rounding remainder is 
+	// carried into the next segment, so truncation can't accumulate into drift.
+	// Direction and magnitude are then taken from the integer, not the float.
+	for (uint8_t i=0; i<MOTORS; i++) {
+		float substeps = (steps[i] + _get_backlash_takeup(i, steps[i])) * DDA_SUBSTEPS + st_prep.substep_residual[i];
+#ifdef __MICROSTEP_MORPHING
+		int32_t unit = (sp->m[i].morph_shift == 0) ? substep_unit : (DDA_SUBSTEPS << sp->m[i].morph_shift);
+		int32_t isubsteps = (int32_t)lrintf(substeps / unit) * unit;
+#else
+		int32_t isubsteps = (int32_t)lrintf(substeps / substep_unit) * substep_unit;
+#endif
+		st_prep.substep_residual[i] = substeps - isubsteps;
+		sp->m[i].substeps = isubsteps;
+		if (st.m[i].power_mode == DYNAMIC_MOTOR_POWER) {
+			sp->m[i].power_level = _get_dynamic_power(i, steps[i], microseconds);
+		}
+		if (isubsteps < 0) {
+			sp->m[i].dir = 1 ^ st.m[i].polarity;
+			sp->m[i].phase_increment = (uint32_t)(-isubsteps) >> sp->substep_shift;
+		} else {
+			sp->m[i].dir = st.m[i].polarity;
+			sp->m[i].phase_increment = (uint32_t)isubsteps >> sp->substep_shift;
+		}
+	}
+
+	sp->segment_ticks = sp->dda_ticks << sp->dda_clock_shift;
+#ifdef __TIMED_STEPS
+	if (timed) { _prep_timed_steps(sp, ticks);}
+#endif
+
 	// anti-stall measure in case change in velocity between segments is too great 
-	if ((st_prep.dda_ticks * ACCUMULATOR_RESET_FACTOR) < st_prep.prev_ticks) {  // NB: uint32_t math
-		st_prep.reset_flag = true;
+	if ((sp->segment_ticks * ACCUMULATOR_RESET_FACTOR) < st_prep.prev_ticks) {  // NB: uint32_t math
+		sp->reset_flag = true;
 	}
-	st_prep.prev_ticks = st_prep.dda_ticks;
-	st_prep.move_type = MOVE_TYPE_ALINE;
+	st_prep.prev_ticks = sp->segment_ticks;
+	sp->spindle_duty = -1;
+	sp->raster = RASTER_OFF;
+	sp->pso_events = 0;
+	sp->move_type = MOVE_TYPE_ALINE;
 	return (STAT_OK);
 }
 
+/*
+ * _prep_timed_steps() - time a segment per step of its dominant motor
+ *
+ *	The substeps are whole steps by now. The dominant motor's steps stand in for
+ *	the DDA ticks, and every motor's steps for its phase increment, so the DDA
+ *	accumulators do the Bresenham. The segment's time in timer counts is divided
+ *	over the steps. If that is too short a period for the drivers, or there are no
+ *	steps, the segment is left as the DDA prepared it - its whole steps run there too.
+ */
+#ifdef __TIMED_STEPS
+static void _prep_timed_steps(stPrepSegment_t *sp, const float ticks)
+{
+	uint32_t steps = 0;
+	for (uint8_t i=0; i<MOTORS; i++) {
+#ifdef __MICROSTEP_MORPHING
+		steps = max(steps, (uint32_t)(labs(sp->m[i].substeps) / DDA_SUBSTEPS) >> st_prep.pulse_shift[i]);
+#else
+		steps = max(steps, (uint32_t)(labs(sp->m[i].substeps) / DDA_SUBSTEPS));
+#endif
+	}
+	uint32_t counts = (uint32_t)(ticks * st_run.dda_top);
+	if ((steps == 0) || ((counts / steps) < st_run.timed_period_min)) { return;}
+
+	sp->timed_steps = steps;
+	sp->timed_period = counts / steps;
+	sp->timed_remainder = counts % steps;
+	sp->dda_ticks = steps;
+	sp->dda_ticks_X_substeps = steps;
+	sp->segment_ticks = (uint32_t)ticks;
+	st_prep.tick_residual = ticks - ((float)counts / st_run.dda_top);
+	for (uint8_t i=0; i<MOTORS; i++) {
+		sp->m[i].phase_increment = labs(sp->m[i].substeps) / DDA_SUBSTEPS;
+	}
+}
+#endif
+
+/*
+ * _prep_morph() - pick the microsteps each motor runs a segment at
+ *
+ *	A motor wants its coarse microsteps above $msr, until it drops below
+ *	MORPH_EXIT_FACTOR of it. It is rounded to whole coarse steps if it wants them,
+ *	or if the driver is coarse or a segment waiting to load may make it so. Its
+ *	steps are counted in pulses only if the driver is coarse and no waiting segment
+ *	wants it fine. The waiting segments are read before the runtime, so a segment
+ *	that loads in between can only make the tests more careful. Steps the loader
+ *	added to reach a full step are taken off here (see _load_morph()).
+ */
+#ifdef __MICROSTEP_MORPHING
+static void _prep_morph(stPrepSegment_t *sp, const float steps[], const float microseconds)
+{
+	uint8_t waiting_coarse = 0;					// motors a waiting segment wants coarse, and fine
+	uint8_t waiting_fine = 0;
+	for (uint8_t s = st_prep.tail; s != st_prep.head; s = _prep_next(s)) {
+		if (st_prep.seg[s].move_type != MOVE_TYPE_ALINE) { continue;}
+		for (uint8_t i=0; i<MOTORS; i++) {
+			if (st_prep.seg[s].m[i].morph_want == true) { waiting_coarse |= (1 << i);}
+			else { waiting_fine |= (1 << i);}
+		}
+	}
+	uint8_t fine_only = RASTER_BUSY() || PSO_BUSY();	// these count steps
+	for (uint8_t i=0; i<MOTORS; i++) {
+		uint8_t shift = st.m[i].morph_shift;
+		uint8_t running = st_run.m[i].morph_shift;
+		int32_t lent = st_run.m[i].morph_lent;
+		st_prep.substep_residual[i] -= (float)(lent - st_prep.morph_repaid[i]) * DDA_SUBSTEPS;
+		st_prep.morph_repaid[i] = lent;
+
+		float rate = (st_prep.morph_want[i] == true) ? (st.morph_rate * MORPH_EXIT_FACTOR) : st.morph_rate;
+		uint8_t want = (shift != 0) && (fine_only == false) && ((fabs(steps[i]) * 1000000) > (rate * microseconds));
+		uint8_t coarse = want || (running != 0) || ((waiting_coarse & (1 << i)) != 0);
+		sp->m[i].morph_want = want;
+		sp->m[i].morph_shift = (coarse == true) ? max(shift, running) : 0;
+		st_prep.pulse_shift[i] = (want && (running == shift) && ((waiting_fine & (1 << i)) == 0)) ? shift : 0;
+		st_prep.morph_want[i] = want;
+	}
+}
+#endif
+
+/*
+ * _get_dynamic_power() - Vref power for a motor running a segment (DYNAMIC_MOTOR_POWER)
+ *
+ *	Scales from $1pi at rest to $1pl at the maximum velocity of the axis the motor is
+ *	mapped to ($xvm). Driver current is only spent where the motor needs torque to 
+ *	keep up with its back EMF.
+ */
+static float _get_dynamic_power(const uint8_t motor, const float steps, const float microseconds)
+{
+	float vmax = cm.a[st.m[motor].motor_map].velocity_max * st.m[motor].steps_per_unit;	// steps per minute
+	if (vmax < EPSILON) { return (st.m[motor].power_level);}
+	float fraction = min(fabs(steps) * 60000000 / (microseconds * vmax), (float)1);
+	return (st.m[motor].power_idle + (st.m[motor].power_level - st.m[motor].power_idle) * fraction);
+}
+
+/*
+ * _get_backlash_takeup() - steps to add to a motor's segment to take up backlash
+ *
+ *	A reversal makes the motor owe the backlash of its axis, less what is still
+ *	owed from the last reversal (the gap was not all crossed). The steps are paid
+ *	in the direction of travel, at most 1/BACKLASH_TAKEUP_SEGMENTS of the backlash
+ *	per segment, so the takeup rides on the move instead of jerking the motor. The
+ *	first move after reset is assumed to start with the gap already taken up.
+ */
+static float _get_backlash_takeup(const uint8_t motor, const float steps)
+{
+	int8_t dir = (steps > EPSILON) ? 1 : ((steps < -EPSILON) ? -1 : 0);
+	if (dir == 0) { return (0);}
+	if (dir != st_prep.backlash_dir[motor]) {
+		if (st_prep.backlash_dir[motor] != 0) {
+			float backlash = fabs(cm.a[st.m[motor].motor_map].backlash * st.m[motor].steps_per_unit);
+			st_prep.backlash_pending[motor] = max(backlash - st_prep.backlash_pending[motor], (float)0);
+			st_prep.backlash_takeup[motor] = backlash / BACKLASH_TAKEUP_SEGMENTS;
+		}
+		st_prep.backlash_dir[motor] = dir;
+	}
+	if (st_prep.backlash_pending[motor] < EPSILON) { return (0);}
+	float takeup = min(st_prep.backlash_pending[motor], st_prep.backlash_takeup[motor]);
+	st_prep.backlash_pending[motor] -= takeup;
+	return (takeup * dir);
+}
+
+/*
+ * st_prep_spindle_duty() - set the PWM duty when the prepared line segment loads
+ *
+ *	Call after st_prep_line() and before the exec hands the segment over. Used by
+ *	laser mode so the power changes with the segment it was computed for.
+ */
+void st_prep_spindle_duty(float duty)
+{
+	st_prep.seg[st_prep.head].spindle_duty = duty;
+	RP_ABANDON();								// not recorded (see replay.h)
+}
+
+/*
+ * st_prep_raster() - start or end a raster row when the prepared line segment loads
+ *
+ *	Call after st_prep_line() for the first segment of a raster move (see raster.h).
+ */
+void st_prep_raster(uint8_t raster)
+{
+	st_prep.seg[st_prep.head].raster = raster;
+	RP_ABANDON();
+}
+
+/*
+ * st_prep_pso() - set the position synchronized output events the prepared segment fires
+ *
+ *	Called by ps_prep_segment() after st_prep_line() (see pso.h).
+ */
+void st_prep_pso(uint8_t events)
+{
+	st_prep.seg[st_prep.head].pso_events = events;
+	if (events != 0) { RP_ABANDON();}
+}
+
+/*
+ * st_get_prep_segment() - the segment being prepared (read-only, for diagnostics)
+ *
+ *	Valid from the exec after st_prep_line() returns, until the exec hands the 
+ *	segment to the loader.
+ */
+const stPrepSegment_t *st_get_prep_segment() { return (&st_prep.seg[st_prep.head]);}
+
+/*
+ * st_get_dda_clock_shift() - clock shift of the segment the DDA is running
+ */
+uint8_t st_get_dda_clock_shift() { return (st_run.dda_clock_shift);}
+
+/*
+ * st_get_dda_period() - DDA tick of the running segment in timer counts (MCK/2)
+ *
+ *	For a timed segment this is the step period, give or take a count.
+ */
+uint32_t st_get_dda_period()
+{
+#ifdef __TIMED_STEPS
+	if (st_run.timed_steps != 0) { return (st_run.timed_period);}
+#endif
+	return (st_run.dda_top << st_run.dda_clock_shift);
+}
+
+/*
+ * st_trim_dda_clock() - shorten the DDA period by a few timer counts
+ *
+ *	Runs the segments slightly fast, so a synchronized slave ends each segment just
+ *	before the master's next edge rather than just after it (see sync.h). 0 restores
+ *	FREQUENCY_DDA. Set it while the motors are stopped.
+ */
+void st_trim_dda_clock(uint8_t counts)
+{
+	st_run.dda_top = st_run.dda_top_base - counts;
+	if (st_run.dda_clock_shift != ST_TIMED_CLOCK) {		// else the next DDA segment sets it
+		dda_timer.setTop(st_run.dda_top << st_run.dda_clock_shift);
+	}
+	_set_step_timing();
+}
+
+/*
+ * st_get_step_position() - steps emitted by the DDA for a motor
+ *
+ *	A single word read, so it is safe from any interrupt. The count is signed in
+ *	the direction of travel (not motor polarity) and is never reset.
+ */
+int32_t st_get_step_position(uint8_t motor) { return (st_run.m[motor].step_position);}
+
+/*
+ * st_set_motor_inhibit()    - stop or restart step pulses to one motor
+ * st_clear_motor_inhibits() - restart all motors
+ *
+ *	The DDA keeps running the inhibited motor's phase accumulator but sends no
+ *	pulses, so the other motors on the same axis carry on. Used to square a gantry
+ *	while homing. Each motor has its own flag so it can be set from any interrupt.
+ */
+void st_set_motor_inhibit(uint8_t motor, uint8_t inhibit) { st_run.m[motor].inhibit = inhibit;}
+
+void st_clear_motor_inhibits()
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) { st_run.m[motor].inhibit = false;}
+}
+
+/*
+ * _get_step_error()     - return substeps loaded into the DDA but not yet emitted
+ * _correct_step_error() - fold whole steps of error into the substep residual
+ *
+ *	The fractional part of the error is the phase the DDA is holding between 
+ *	steps and is not lost, so only whole steps are corrected. The correction 
+ *	rides on the next segment's substeps, so it costs no extra segments. 
+ *	Only valid when the DDA is idle and the prep ring is empty, otherwise the 
+ *	loaded segment is still being stepped out.
+ */
+
+static int64_t _get_step_error(const uint8_t motor)
+{
+	return (st_run.m[motor].commanded_substeps - ((int64_t)st_run.m[motor].step_position * DDA_SUBSTEPS));
+}
+
+static void _correct_step_error()
+{
+	for (uint8_t i=0; i<MOTORS; i++) {
+		int32_t lost_steps = (int32_t)(_get_step_error(i) / DDA_SUBSTEPS);	// truncates toward zero
+		st_prep.substep_residual[i] += (float)lost_steps * DDA_SUBSTEPS;
+		st_run.m[i].commanded_substeps -= (int64_t)lost_steps * DDA_SUBSTEPS;	// re-commanded below
+	}
+}
+
+/*
+ * st_prep_line_ramped() - prepare a segment whose velocity ramps linearly
+ *
+ *	Same as st_prep_line() but the per-tick phase increment moves linearly from 
+ *	a start value to an end value in the ratio of start_velocity to end_velocity.
+ *	The increments over the segment sum to exactly the same substeps as the flat
+ *	segment would; the residue left by integer rounding is added on load.
+ *	The start increment is kept non-zero so the loader sees the motor as moving.
+ */
+#ifdef __DDA_RAMPING
+stat_t st_prep_line_ramped(float steps[], float microseconds, float start_velocity, float end_velocity)
+{
+	RP_ABANDON();								// the ramp is not recorded (see replay.h)
+	ritorno(st_prep_line(steps, microseconds));
+
+	stPrepSegment_t *sp = &st_prep.seg[st_prep.head];
+	int64_t ticks = sp->dda_ticks;
+	float velocity_sum = start_velocity + end_velocity;
+
+	for (uint8_t i=0; i<MOTORS; i++) {
+		sp->m[i].phase_delta = 0;
+		sp->m[i].phase_residual = 0;
+		if ((ticks < 2) || (velocity_sum < EPSILON) || (sp->m[i].phase_increment == 0)) { continue;}
+#ifdef __TIMED_STEPS
+		if (sp->timed_steps != 0) { continue;}		// timed segments run flat
+#endif
+#ifdef __MICROSTEP_MORPHING
+		if (sp->m[i].morph_shift != 0) { continue;}	// may run coarse - the loader shifts flat increments only
+#endif
+
+		int64_t flat = sp->m[i].phase_increment;		// flat per-tick increment
+		int64_t ramp_span = ticks * (ticks-1) / 2;		// sum of k for k = 0..ticks-1
+		float ramp = (2 * flat * (end_velocity - start_velocity)) / velocity_sum;	// end - start
+		int64_t delta = (int64_t)(ramp / (ticks-1));
+		int64_t start = flat - (delta * (ticks-1)) / 2;
+		if (start < 1) { start = 1;}
+		sp->m[i].phase_increment = (uint32_t)start;
+		sp->m[i].phase_delta = (int32_t)delta;
+		sp->m[i].phase_residual = (int32_t)((flat * ticks) - (start * ticks) - (delta * ramp_span));
+	}
+	return (STAT_OK);
+}
+#endif
+
 /*
  * _set_hw_microsteps() - set microsteps in hardware
  *
- *	For now the microstep_mode is the same as the microsteps (1,2,4,8)
- *	This may change if microstep morphing is implemented.
+ *	For now the microstep_mode is the same as the microsteps (1,2,4,8). SPI drivers
+ *	take the microsteps as a register write, queued by the driver task (see tmc2660.h).
+ *	With __MICROSTEP_MORPHING the MS pins are written, and the loader switches them
+ *	between $1mi and $1mo as the motor morphs (see _load_morph()).
  */
 
 static void _set_hw_microsteps(const uint8_t motor, const uint8_t microstep_mode)
 {
+#ifdef __TMC2660
+	if (motor < MOTORS) { tmc_set_microsteps(motor, microstep_mode);}
+#endif
+#ifdef __MICROSTEP_MORPHING						// the MS pins are switched by the loader too
+	switch (motor) {
+		case MOTOR_1: { _set_ms_pins(motor_1, microstep_mode); break;}
+		case MOTOR_2: { _set_ms_pins(motor_2, microstep_mode); break;}
+		case MOTOR_3: { _set_ms_pins(motor_3, microstep_mode); break;}
+		case MOTOR_4: { _set_ms_pins(motor_4, microstep_mode); break;}
+		case MOTOR_5: { _set_ms_pins(motor_5, microstep_mode); break;}
+		case MOTOR_6: { _set_ms_pins(motor_6, microstep_mode); break;}
+		default: { return;}
+	}
+	st_run.m[motor].morph_shift = 0;
+#endif
 /*
 	if (microstep_mode == 8) {
 		hw.st_port[motor]->OUTSET = MICROSTEP_BIT_0_bm;
@@ -707,7 +1614,7 @@ static void _set_hw_microsteps(const uint8_t motor, const uint8_t microstep_mode
 static int8_t _get_motor(const index_t index)
 {
 	char_t *ptr;
-	char_t motors[] = {"1234"};
+	char_t motors[] = {"123456"};
 	char_t tmp[CMD_TOKEN_LEN+1];
 
 	strcpy_P(tmp, cfgArray[index].group);
@@ -719,13 +1626,21 @@ static int8_t _get_motor(const index_t index)
 
 /*
  * _set_motor_steps_per_unit() - what it says
- * This function will need to be rethought if microstep morphing is implemented
+ * Always in $1mi microsteps - a morphed motor counts each pulse as several steps
  */
 
 static void _set_motor_steps_per_unit(cmdObj_t *cmd) 
 {
 	uint8_t m = _get_motor(cmd->index);
 	st.m[m].steps_per_unit = (360 / (st.m[m].step_angle / st.m[m].microsteps) / st.m[m].travel_rev);
+	ik_set_motor_map();
+}
+
+stat_t st_set_ma(cmdObj_t *cmd)			// motor map to axis
+{
+	set_ui8(cmd);
+	ik_set_motor_map();
+	return (STAT_OK);
 }
 
 stat_t st_set_sa(cmdObj_t *cmd)			// motor step angle
@@ -750,18 +1665,54 @@ stat_t st_set_mi(cmdObj_t *cmd)			// motor microsteps
 	set_ui8(cmd);							// set it anyway, even if it's unsupported
 	_set_motor_steps_per_unit(cmd);
 	_set_hw_microsteps(_get_motor(cmd->index), (uint8_t)cmd->value);
+#ifdef __MICROSTEP_MORPHING
+	_set_morph_shift(_get_motor(cmd->index));
+#endif
+	return (STAT_OK);
+}
+
+/*
+ * st_set_mo() - set the microsteps a motor morphs to above $msr
+ * _set_morph_shift() - find the shift from $1mi to $1mo, or 0 if the motor can't morph
+ */
+#ifdef __MICROSTEP_MORPHING
+stat_t st_set_mo(cmdObj_t *cmd)
+{
+	if (fp_NE(cmd->value,0) && fp_NE(cmd->value,1) && fp_NE(cmd->value,2) && fp_NE(cmd->value,4)) {
+		return (STAT_INPUT_VALUE_RANGE_ERROR);
+	}
+	set_ui8(cmd);
+	_set_morph_shift(_get_motor(cmd->index));
 	return (STAT_OK);
 }
 
+static void _set_morph_shift(const uint8_t motor)
+{
+	cfgMotor_t *m = &st.m[motor];
+	m->morph_shift = 0;
+	if ((m->morph_microsteps == 0) || ((m->microsteps & (m->microsteps-1)) != 0)) { return;}	// powers of 2 only
+	while ((m->morph_microsteps << m->morph_shift) < m->microsteps) { m->morph_shift++;}
+}
+#endif
+
 stat_t st_set_pm(cmdObj_t *cmd)			// motor power mode
 { 
-	ritorno (set_01(cmd));
-	if (fp_ZERO(cmd->value)) { // people asked this setting take effect immediately, hence:
+	if (cmd->value > DYNAMIC_MOTOR_POWER) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_ui8(cmd);
+	if (fp_EQ(cmd->value, MOTOR_IDLE_WHEN_STOPPED)) { // people asked this setting take effect immediately, hence:
+		_deenergize_motor(_get_motor(cmd->index));
+	} else {
 		_energize_motor(_get_motor(cmd->index));
-	} else {
-		_deenergize_motor(_get_motor(cmd->index));
 	}
 	return (STAT_OK);
+}
+
+stat_t st_set_pw(cmdObj_t *cmd)			// motor running and idle power levels
+{
+	if ((cmd->value < 0) || (cmd->value > 1)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_flt(cmd);
+	_request_motor_power(_get_motor(cmd->index));	// apply the new level
+	return (STAT_OK);
 }
 
 stat_t st_set_mt(cmdObj_t *cmd)
@@ -770,6 +1721,84 @@ stat_t st_set_mt(cmdObj_t *cmd)
 	return (STAT_OK);
 }
 
+/*
+ * st_set_sds() - set dir setup time
+ * st_set_sph() - set step pulse high time
+ * st_set_spl() - set step pulse low time
+ * _set_step_timing() - load the step timing into the DDA
+ *
+ *	With the match interrupt the pulse ends at the match compare and the shortest low
+ *	time is the rest of the period. With __STEP_SINGLE_INTERRUPT the pulses and the
+ *	gaps between them are both one period, so each time just has to fit in one.
+ */
+static stat_t _check_step_timing(const float high, const float low)
+{
+	float period = 1000000 / (float)FREQUENCY_DDA;		// microseconds
+	if ((high < 0) || (low < 0)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+#ifdef __STEP_SINGLE_INTERRUPT
+	if ((high > period) || (low > period)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+#else
+	if ((high >= period) || ((high + low) > period)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+#endif
+	return (STAT_OK);
+}
+
+stat_t st_set_sds(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value * DDA_TICKS_PER_USEC > 0xFFFF)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	set_flt(cmd);
+	_set_step_timing();
+	return (STAT_OK);
+}
+
+stat_t st_set_sph(cmdObj_t *cmd)
+{
+	ritorno(_check_step_timing(cmd->value, st.pulse_low));
+	set_flt(cmd);
+	_set_step_timing();
+	return (STAT_OK);
+}
+
+stat_t st_set_spl(cmdObj_t *cmd)
+{
+	ritorno(_check_step_timing(st.pulse_high, cmd->value));
+	return (set_flt(cmd));								// low time is a limit only - nothing to load
+}
+
+/*
+ * st_apply_config() - set up everything worked out from the motor settings
+ *
+ *	For settings changed as a block (see machine_profile.h) rather than through their
+ *	setters. Call with the motors stopped.
+ */
+void st_apply_config()
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		_set_hw_microsteps(motor, st.m[motor].microsteps);
+#ifdef __MICROSTEP_MORPHING
+		_set_morph_shift(motor);
+#endif
+		_request_motor_power(motor);
+	}
+	_set_step_timing();
+}
+
+static void _set_step_timing()
+{
+#ifndef __STEP_SINGLE_INTERRUPT	// in timer counts, so the pulse width holds at any clock shift
+	float duty = max(st.pulse_high * DDA_TICKS_PER_USEC, (float)STEP_PULSE_DUTY_MIN);
+	dda_timer.setExactDutyCycleA((uint32_t)(st_run.dda_top * duty));
+#endif
+#ifdef __TIMED_STEPS			// a timed step has to fit the pulse, the low time and the ISR
+	float counts_per_usec = st_run.dda_top * DDA_TICKS_PER_USEC;
+	st_run.timed_period_min = (uint32_t)max((st_run.dda_top * duty) + (st.pulse_low * counts_per_usec),
+											(ST_TIMED_USEC_MIN * counts_per_usec));
+#endif
+	// the first step can come one tick after the dir pins are written, so hold the rest
+	uint32_t ticks = (uint32_t)ceil(st.dir_setup * DDA_TICKS_PER_USEC);
+	st_run.dir_setup_ticks = (ticks > 1) ? (ticks - 1) : 0;
+}
+
 stat_t st_set_md(cmdObj_t *cmd)	// Make sure this function is not part of initialization --> f00
 {
 	st_deenergize_motors();
@@ -782,6 +1811,22 @@ stat_t st_set_me(cmdObj_t *cmd)	// Make sure this function is not part of initia
 	return (STAT_OK);
 }
 
+/*
+ * st_get_se() - get motor step error
+ *
+ *	Steps loaded into the DDA less steps it actually emitted. While a move is 
+ *	running this includes the part of the loaded segment not yet stepped out; 
+ *	once stopped anything of magnitude one step or more is real error.
+ */
+
+stat_t st_get_se(cmdObj_t *cmd)
+{
+	cmd->value = (float)_get_step_error(_get_motor(cmd->index)) / DDA_SUBSTEPS;
+	cmd->precision = (int8_t)GET_TABLE_WORD(precision);
+	cmd->objtype = TYPE_FLOAT;
+	return (STAT_OK);
+}
+
 
 /***********************************************************************************
  * TEXT MODE SUPPORT
@@ -804,11 +1849,27 @@ static const char fmt_0sa[] PROGMEM = "[%s%s] m%s step angle%20.3f%s\n";
 static const char fmt_0tr[] PROGMEM = "[%s%s] m%s travel per revolution%9.3f%s\n";
 static const char fmt_0mi[] PROGMEM = "[%s%s] m%s microsteps%16d [1,2,4,8]\n";
 static const char fmt_0po[] PROGMEM = "[%s%s] m%s polarity%18d [0=normal,1=reverse]\n";
-static const char fmt_0pm[] PROGMEM = "[%s%s] m%s power management%10d [0=remain powered,1=power down when idle]\n";
+static const char fmt_0pm[] PROGMEM = "[%s%s] m%s power management%10d [0=remain powered,1=power down when idle,2=reduce when idle,3=scale with velocity]\n";
+static const char fmt_0pl[] PROGMEM = "[%s%s] m%s power level%19.3f [0..1]\n";
+static const char fmt_0pi[] PROGMEM = "[%s%s] m%s idle power level%14.3f [0..1]\n";
+static const char fmt_0se[] PROGMEM = "[%s%s] m%s step error%20.3f steps\n";
+static const char fmt_sc[] PROGMEM = "[sc]  step error correction%11d [0=off,1=correct after idle]\n";
+static const char fmt_sds[] PROGMEM = "[sds] step dir setup time%15.2f uSec\n";
+static const char fmt_sph[] PROGMEM = "[sph] step pulse high time%14.2f uSec\n";
+static const char fmt_spl[] PROGMEM = "[spl] step pulse low time%15.2f uSec\n";
+static const char fmt_esl[] PROGMEM = "[esl] exec slack late%19.0f uSec\n";
+static const char fmt_0mo[] PROGMEM = "[%s%s] m%s morph microsteps%10d [0=off,1,2,4]\n";
+static const char fmt_msr[] PROGMEM = "[msr] microstep morph rate%14.0f steps/sec\n";
 
 void st_print_mt(cmdObj_t *cmd) { text_print_flt(cmd, fmt_mt);}
 void st_print_me(cmdObj_t *cmd) { text_print_nul(cmd, fmt_me);}
 void st_print_md(cmdObj_t *cmd) { text_print_nul(cmd, fmt_md);}
+void st_print_sc(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sc);}
+void st_print_sds(cmdObj_t *cmd) { text_print_flt(cmd, fmt_sds);}
+void st_print_sph(cmdObj_t *cmd) { text_print_flt(cmd, fmt_sph);}
+void st_print_spl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_spl);}
+void st_print_esl(cmdObj_t *cmd) { text_print_flt(cmd, fmt_esl);}
+void st_print_msr(cmdObj_t *cmd) { text_print_flt(cmd, fmt_msr);}
 
 static void _print_motor_ui8(cmdObj_t *cmd, const char *format)
 {
@@ -826,5 +1887,9 @@ void st_print_tr(cmdObj_t *cmd) { _print_motor_flt_units(cmd, fmt_0tr, cm_get_un
 void st_print_mi(cmdObj_t *cmd) { _print_motor_ui8(cmd, fmt_0mi);}
 void st_print_po(cmdObj_t *cmd) { _print_motor_ui8(cmd, fmt_0po);}
 void st_print_pm(cmdObj_t *cmd) { _print_motor_ui8(cmd, fmt_0pm);}
+void st_print_pl(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0pl, cmd->group, cmd->token, cmd->group, cmd->value);}
+void st_print_pi(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0pi, cmd->group, cmd->token, cmd->group, cmd->value);}
+void st_print_se(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0se, cmd->group, cmd->token, cmd->group, cmd->value);}
+void st_print_mo(cmdObj_t *cmd) { _print_motor_ui8(cmd, fmt_0mo);}
 
 #endif // __TEXT_MODE
@@ -62,6 +62,15 @@
  *		segment. To this end as much as possible about that move is pre-computed during 
  *		move execution. Also, all moves are loaded from the interrupt level, avoiding 
  *		the need for mutual exclusion locking or volatiles (which slow things down).
+ *
+ *    - Step timing is set for the drivers rather than by padding the DDA rate. The
+ *		pulse high time ($sph) sets the match compare that ends the pulses. $spl is the
+ *		shortest low time the drivers take, so $sph + $spl must fit in one DDA period -
+ *		the closest two pulses to one motor can be. When a segment changes the direction
+ *		of any of its motors the DDA holds off stepping for whole ticks until the dir
+ *		setup time ($sds) has passed since the dir pins were written. A segment that
+ *		keeps its directions loads with no hold, so the setup costs nothing on a
+ *		continuous path.
  */
 /**** Line planning and execution ****
  *
@@ -197,14 +206,52 @@ enum motorPowerState {				// used w/start and stop flags to sequence motor power
 enum cmStepperPowerMode {
 	MOTOR_ENERGIZED_DURING_CYCLE=0,	// motor is fully powered during cycles
 	MOTOR_IDLE_WHEN_STOPPED,		// idle motor shortly after it's stopped - even in cycle
-	MOTOR_POWER_REDUCED_WHEN_IDLE,	// enable Vref current reduction (not implemented yet)
-	DYNAMIC_MOTOR_POWER				// adjust motor current with velocity (not implemented yet)
+	MOTOR_POWER_REDUCED_WHEN_IDLE,	// full Vref power when running, idle power after the idle timeout
+	DYNAMIC_MOTOR_POWER				// Vref power scaled with motor velocity, idle power after the timeout
 };
 
-enum prepBufferState {
-	PREP_BUFFER_OWNED_BY_LOADER = 0,// staging buffer is ready for load
-	PREP_BUFFER_OWNED_BY_EXEC		// staging buffer is being loaded
-};
+/* Prep segment ring
+ *	Prepared segments are passed from the exec (MED ISR) to the loader (HI ISR) 
+ *	through a single-producer single-consumer ring. Only the exec writes the head
+ *	and only the loader writes the tail, so no locking is required. One slot is 
+ *	always left empty, giving ST_PREP_SEGMENTS-1 segments of slack (~5 ms each)
+ *	to absorb a late exec before the steppers run dry. Deeper rings add latency
+ *	to feedholds as the prepared segments still run out.
+ *
+ *	The motion in the ring is also capped. Body segments run up to MAX_SEGMENT_USEC,
+ *	so a full ring of them would put 160 ms ahead of a feedhold before it could
+ *	start to decelerate. The exec stops preparing once the segments waiting plus
+ *	the running one would pass ST_PREP_AHEAD_USEC, which bounds the motion ahead
+ *	of a hold to ST_PREP_AHEAD_USEC plus one segment - 80 ms, as it was with
+ *	shorter body segments. Short head and tail segments still fill the ring.
+ *
+ *	Each segment also carries its owner. The exec hands a segment over by setting
+ *	it OWNED_BY_LOADER before it advances the head, and the loader only loads a
+ *	segment it owns. Once loaded the segment is nulled and given back to the exec
+ *	before the tail advances, so a slot the exec passes over without preparing
+ *	can never step a stale segment twice.
+ *
+ *	Each time the exec hands over a segment the motion still left to run - the 
+ *	rest of the running segment and the segments waiting to load - is its margin.
+ *	A margin under 1/EXEC_NEAR_MISS_FRACTION of the running segment is counted as 
+ *	a near miss ($psnm), and the smallest margin is kept in $psmar (see mps).
+ *
+ *	The motion left as the exec starts is also the deadline of the segment it
+ *	prepares - the loader needs it when that motion has run. The exec time is
+ *	measured against it and the smallest slack of a job is kept in $jsslk, the
+ *	longest exec in $jsexm, and segments with less slack than $esl in $jslat (see
+ *	mpj). Slack well clear of $esl over a job is the room there is to shorten the
+ *	segments or add heavier kinematics.
+ */
+#define ST_PREP_SEGMENTS 4			// ring depth; must be at least 2
+#define ST_PREP_AHEAD_USEC MAX_SEGMENT_USEC	// motion the ring is filled to, running segment included
+#define EXEC_NEAR_MISS_FRACTION 4	// near miss if less than 1/4 of the running segment is left
+#define BACKLASH_TAKEUP_SEGMENTS 4	// segments a backlash takeup is spread over (see st_prep_line())
+
+enum prepBufferState {
+	PREP_BUFFER_OWNED_BY_EXEC = 0,	// segment is free, or being prepared by the exec
+	PREP_BUFFER_OWNED_BY_LOADER		// segment is prepared and waiting to load
+};
 
 // Stepper power management settings
 // Min/Max timeouts allowed for motor disable. Allow for inertial stop; must be non-zero
@@ -221,6 +268,98 @@ enum prepBufferState {
  */
 #define DDA_SUBSTEPS 100000		// 100,000 accumulates substeps to 6 decimal places
 
+/* Long segments
+ *	The DDA counts a segment in dda_ticks * DDA_SUBSTEPS, which must fit an int32 - 
+ *	about 21,400 ticks (214 ms at 100 KHz). Longer segments count substeps in units of 
+ *	2^shift (the substep shift), chosen per segment, so the range grows 32 times at
+ *	the most while the DDA stays on 32 bit math. The substeps of a shifted segment are 
+ *	rounded to whole units and the remainder carried into the next segment as usual,
+ *	so position is still kept to the substep. DDA_SUBSTEPS >> shift must be exact.
+ */
+#define DDA_SUBSTEP_TICKS_MAX (0x7FFFFFFFUL / DDA_SUBSTEPS)	// longest segment counted in single substeps
+#define DDA_SUBSTEP_SHIFT_MAX 5		// 100,000 = 2^5 * 3125
+
+/* DDA clock scaling
+ *	A segment whose fastest motor steps slowly runs the DDA at FREQUENCY_DDA / 2^shift
+ *	(the clock shift) - the lowest rate that still gives that motor DDA_MIN_TICKS_PER_STEP
+ *	ticks per step - so slow moves don't cost 200,000 interrupts a second. The loader 
+ *	sets the timer period as the segment loads. The step pulse is set in timer counts 
+ *	so its width doesn't change, and the dir setup hold is converted to the segment's
+ *	ticks. Set DDA_CLOCK_SHIFT_MAX to 0 to always run at FREQUENCY_DDA.
+ */
+#define DDA_MIN_TICKS_PER_STEP 16	// ticks per step of the fastest motor at a slowed clock
+#define DDA_CLOCK_SHIFT_MAX 4		// slowest DDA clock is FREQUENCY_DDA / 16
+
+/* Step timing
+ *	The match compare that ends the pulses is kept a little clear of the overflow
+ *	that starts them, so a very short $sph still gives a pulse. DIR_UNKNOWN makes
+ *	the first segment after reset write every motor's dir pin.
+ */
+#define STEP_PULSE_DUTY_MIN 0.05	// shortest pulse as a fraction of the DDA period
+#define DIR_UNKNOWN 0xFF
+
+/* DDA velocity ramping
+ *	With __DDA_RAMPING each segment is prepared with start and end phase increments
+ *	and the DDA adds a fixed-point delta to the increment every tick, so velocity
+ *	changes linearly inside a segment instead of as a staircase of flat segments.
+ *	The total substeps for the segment are preserved exactly; the rounding residue 
+ *	is added to the accumulator at load time. The end increment may be up to 2x 
+ *	the flat increment, so the largest segment that fits the int32 runtime is 
+ *	about 10,700 steps (vs. 21,400 without ramping).
+ */
+//#define __DDA_RAMPING				// uncomment to enable linear velocity ramps within segments
+
+/* Per-step timing
+ *	The DDA can step a motor at most once per tick, so no motor runs faster than 
+ *	FREQUENCY_DDA, and each step lands on a tick - up to one tick early or late. With 
+ *	__TIMED_STEPS a segment whose fastest motor steps faster than ST_TIMED_STEP_RATE 
+ *	is run by the DDA timer step by step instead: the timer period is the time to the 
+ *	next step of that motor (the dominant motor), so each of its steps is taken on 
+ *	the RC compare with no tick to wait for. The other motors follow it by Bresenham 
+ *	over the dominant motor's steps, in the DDA's own accumulators - the same ISR 
+ *	runs both engines. st_prep_line() picks the engine for each segment.
+ *
+ *	A timed segment is rounded to whole steps, the remainder carried as substeps into
+ *	the next segment. Its time is divided over the dominant steps with the remainder 
+ *	spread Bresenham-fashion, so the segment runs its exact time in MCK/2 counts. The
+ *	planner's segments carry the acceleration, so each runs at one rate, as the DDA 
+ *	segments do. A segment whose steps would come closer than the pulse, the low time
+ *	and ST_TIMED_USEC_MIN allow is left to the DDA. Segments that run raster rows or 
+ *	position synchronized outputs, which count DDA ticks, always use the DDA.
+ */
+//#define __TIMED_STEPS				// uncomment to time the steps of fast segments on the timer compare
+
+#define ST_TIMED_STEP_RATE (float)(FREQUENCY_DDA/4)	// steps/sec above which a segment is timed per step
+#define ST_TIMED_USEC_MIN 2.5		// shortest step period - the ISR has to fit in it
+#define ST_TIMED_CLOCK 0xFF			// dda_clock_shift while the timer runs per-step periods
+
+/* Microstep morphing
+ *	With __MICROSTEP_MORPHING in tinyg2.h a motor with $1mo set switches its driver
+ *	to $1mo microsteps while it steps faster than $msr (steps/sec at $1mi), and back
+ *	to $1mi once it is below MORPH_EXIT_FACTOR of that. Each pulse then moves the
+ *	motor $1mi/$1mo microsteps, so rapids run at a fraction of the step rate and
+ *	slow moves keep the full resolution. The planner, steps_per_unit and the step
+ *	counts all stay in $1mi microsteps - only the pulses are coarse.
+ *
+ *	st_prep_line() decides each segment from its step rate, and rounds the segment
+ *	to whole coarse steps whenever the motor may be coarse while it runs. Whole step
+ *	segments emit an exact number of pulses. The loader writes the MS pins, and only
+ *	when the motor is on a full step - the emitted step count is a multiple of $1mi -
+ *	so the driver's microstep table stays in phase. The count starts with the driver
+ *	at its home position, a full step, at reset. Off a full step the loader adds the
+ *	pulses to the next one, in the direction of travel, to the segment it is loading,
+ *	and switches on the next segment. st_prep_line() takes the added steps off a later
+ *	segment, so the position is unchanged. A segment is counted in coarse pulses for
+ *	the DDA clock and timed steps only when the motor is already coarse and nothing
+ *	ahead of it can change that, so the DDA never sees more steps than it was set up for.
+ *
+ *	Only motors with MS pins are switched. SPI drivers (__TMC2660) take the microsteps
+ *	as a queued register write that can't be lined up with the steps, so they don't
+ *	morph. $1mi and $1mo must be powers of 2. Raster and PSO segments, which count
+ *	steps, and DDA ramped segments run fine.
+ */
+#define MORPH_EXIT_FACTOR 0.75		// back to $1mi microsteps below this fraction of $msr
+
 /* Accumulator resets
  * 	You want to reset the DDA accumulators if the new ticks value is way less 
  *	than previous value, but otherwise you should leave the accumulators alone.
@@ -255,10 +394,24 @@ typedef struct cfgMotor {			// per-motor configs
 	float step_angle;				// degrees per whole step (ex: 1.8)
 	float travel_rev;				// mm or deg of travel per motor revolution
 	float steps_per_unit;			// steps (usteps)/mm or deg of travel
+	float power_level;				// Vref power when running [0..1] (power modes 2 and 3)
+	float power_idle;				// Vref power when idle, and at rest in DYNAMIC_MOTOR_POWER [0..1]
+#ifdef __MICROSTEP_MORPHING
+	uint8_t morph_microsteps;		// microsteps above the morph rate, 0 = don't morph
+	uint8_t morph_shift;			// log2 of microsteps / morph_microsteps, 0 if the motor doesn't morph
+#endif
 } cfgMotor_t;
 
 typedef struct stConfig {			// stepper configs
 	float motor_idle_timeout;		// seconds before setting motors to idle current (currently this is OFF)
+	uint8_t step_correction;		// TRUE to fold accumulated step error into the next move after idle
+	float dir_setup;				// microseconds from a dir change to the next step pulse
+	float pulse_high;				// step pulse width in microseconds
+	float pulse_low;				// minimum time between step pulses in microseconds
+	float exec_slack_late;			// exec slack in microseconds under which a segment counts as late
+#ifdef __MICROSTEP_MORPHING
+	float morph_rate;				// steps/sec (at $1mi microsteps) above which a motor morphs
+#endif
 	cfgMotor_t m[MOTORS];			// settings for motors 1-4
 } stConfig_t;
 
@@ -267,38 +420,111 @@ typedef struct stConfig {			// stepper configs
 typedef struct stRunMotor { 		// one per controlled motor
 	int32_t phase_increment;		// total steps in axis times substeps factor
 	int32_t phase_accumulator;		// DDA phase angle accumulator for axis
+#ifdef __DDA_RAMPING
+	int32_t phase_delta;			// change in phase increment per tick
+#endif
 	uint8_t power_state;			// state machine for managing motor power
 	uint32_t power_systick;			// sys_tick for next state transition
-	uint32_t power_level;			// power level for this segment (FUTURE)
+	float power_level;				// Vref power for the loaded segment (DYNAMIC_MOTOR_POWER)
+	float power_applied;			// Vref power last set by st_set_motor_power()
 	uint8_t step_count_diagnostic;	// step count diagnostic
+	int32_t step_sign;				// +1 or -1 - direction of the loaded segment (ignores polarity)
+	int32_t step_position;			// steps actually emitted by the DDA (signed, never reset)
+	int64_t commanded_substeps;		// substeps of all segments loaded into the DDA
+	volatile uint8_t inhibit;		// TRUE to drop the motor's step pulses (see st_set_motor_inhibit())
+	uint8_t dir;					// direction last written to the dir pin, or DIR_UNKNOWN
+#ifdef __MICROSTEP_MORPHING
+	volatile uint8_t morph_shift;	// microsteps the driver is set to are $1mi >> shift (written by the loader only)
+	volatile int32_t morph_lent;	// steps added to segments to reach a full step (written by the loader only)
+#endif
 } stRunMotor_t;
 
 typedef struct stRunSingleton {		// Stepper static values and axis parameters
 	uint16_t magic_start;			// magic number to test memory integrity	
 	int32_t dda_ticks_downcount;	// tick down-counter (unscaled)
 	int32_t dda_ticks_X_substeps;	// ticks multiplied by scaling factor
+	uint8_t phase_shift;			// substep plus clock shift of the loaded segment - units of the accumulators
+	uint8_t dda_clock_shift;		// DDA clock of the loaded segment is FREQUENCY_DDA >> shift
+	uint32_t dda_top;				// DDA timer period at FREQUENCY_DDA (timer counts)
+	uint32_t dda_top_base;			// ...before st_trim_dda_clock()
+	uint8_t dda_pulse_trailer;		// TRUE if the next DDA tick only ends the last pulses
+	uint32_t segment_ticks;			// FREQUENCY_DDA ticks of the running line segment (0 if none is running)
+	uint32_t dwell_top;				// dwell timer counts in a FREQUENCY_DWELL period
+	uint32_t dwell_period_usec;		// microseconds of the running dwell timer period
+	uint16_t dir_setup_ticks;		// DDA ticks to hold off stepping after a dir change
+	uint16_t dda_hold_ticks;		// DDA ticks left before the loaded segment starts stepping
+	volatile uint8_t power_changed;	// motors to sequence on the next power callback (bit per motor)
+	uint8_t power_running;			// reduced and dynamic power motors waiting for the steppers to stop
+	uint8_t power_timing;			// motors running an idle timeout
+	uint32_t power_due;				// SysTick the first of those timeouts ends
+#ifdef __TIMED_STEPS
+	uint32_t timed_steps;			// steps of the dominant motor in the loaded segment, 0 for a DDA segment
+	uint32_t timed_period;			// timer counts per step, less the remainder
+	uint32_t timed_remainder;		// counts of the segment left over by timed_period
+	uint32_t timed_residual;		// remainder spread so far (Bresenham)
+	uint32_t timed_period_min;		// shortest timed period - see _set_step_timing()
+#endif
 	stRunMotor_t m[MOTORS];			// runtime motor structures
+	MEMORY_GUARD
 } stRunSingleton_t;
 
-// Prep-time structure. Used by exec/prep ISR (MED) and read-only during load
+// Prep-time structures. Written by exec/prep ISR (MED) and read-only during load
 // Must be careful about volatiles in this one
 
 typedef struct stPrepMotor {
  	uint32_t phase_increment; 		// total steps in axis times substep factor
+	int32_t substeps;				// signed substeps commanded for the segment
 	int8_t dir;						// direction
+	float power_level;				// Vref power for the segment - see st_set_motor_power()
+#ifdef __DDA_RAMPING
+	int32_t phase_delta;			// change in phase increment per tick
+	int32_t phase_residual;			// substeps to add to the accumulator on load
+#endif
+#ifdef __MICROSTEP_MORPHING
+	uint8_t morph_want;				// TRUE if the segment is above the morph rate
+	uint8_t morph_shift;			// substeps are whole coarse steps of $1mi >> shift, 0 if not
+#endif
 } stPrepMotor_t;
 
-typedef struct stPrepSingleton {
-	uint16_t magic_start;			// magic number to test memory integrity	
+typedef struct stPrepSegment {
+	volatile uint8_t buffer_state;	// prepBufferState - who owns the segment
 	uint8_t move_type;				// move type
-	volatile uint8_t exec_state;	// move execution state 
-	volatile uint8_t reset_flag;	// TRUE if accumulator should be reset
-	uint32_t prev_ticks;			// tick count from previous move
-	uint16_t dda_period;			// DDA or dwell clock period setting
-	uint32_t dda_ticks;				// DDA or dwell ticks for the move
+	uint8_t reset_flag;				// TRUE if accumulator should be reset
+	uint32_t dda_ticks;				// DDA ticks for the move, or microseconds for a dwell
 	uint32_t dda_ticks_X_substeps;	// DDA ticks scaled by substep factor
+	uint8_t substep_shift;			// phase_increment and dda_ticks_X_substeps count 2^shift substeps
+	uint8_t dda_clock_shift;		// dda_ticks are FREQUENCY_DDA >> shift ticks (see DDA_CLOCK_SHIFT_MAX)
+	uint32_t segment_ticks;			// FREQUENCY_DDA ticks the line runs, whichever engine runs it
+#ifdef __TIMED_STEPS
+	uint32_t timed_steps;			// dominant motor steps if timed per step - dda_ticks is the same count
+	uint32_t timed_period;			// timer counts per step, less the remainder
+	uint32_t timed_remainder;		// counts left over by timed_period
+#endif
 //	float segment_velocity;			// record segment velocity for diagnostics
+	float spindle_duty;				// PWM duty set as the segment loads, or -1 to leave it
+	uint8_t raster;					// raster event as the segment loads - see raster.h
+	uint8_t pso_events;				// position synchronized output events the segment fires - see pso.h
 	stPrepMotor_t m[MOTORS];		// per-motor structs
+} stPrepSegment_t;
+
+typedef struct stPrepSingleton {
+	uint16_t magic_start;			// magic number to test memory integrity	
+	volatile uint8_t head;			// next segment to prepare (written by exec only)
+	volatile uint8_t tail;			// next segment to load (written by loader only)
+	uint32_t prev_ticks;			// tick count from previous move (FREQUENCY_DDA ticks)
+	float tick_residual;			// FREQUENCY_DDA ticks left over by the last segment's clock shift
+	float substep_residual[MOTORS];	// rounding remainder carried to the next segment
+	float backlash_pending[MOTORS];	// backlash steps still to take up in backlash_dir
+	float backlash_takeup[MOTORS];	// backlash steps taken up per segment
+	int8_t backlash_dir[MOTORS];	// direction of the last move of the motor, 0 = none yet
+#ifdef __MICROSTEP_MORPHING
+	uint8_t morph_want[MOTORS];		// morph_want of the last segment prepared (hysteresis)
+	uint8_t pulse_shift[MOTORS];	// shift of the motors sure to run the segment coarse
+	int32_t morph_repaid[MOTORS];	// morph_lent steps taken off segments so far
+#endif
+	stPrepSegment_t seg[ST_PREP_SEGMENTS];	// prepared segment ring
+	uint16_t magic_end;
+	MEMORY_GUARD
 } stPrepSingleton_t;
 
 extern stConfig_t st;
@@ -317,15 +543,43 @@ stat_t st_motor_power_callback(void);
 void st_request_exec_move(void);
 void st_prep_null(void);
 void st_prep_dwell(float microseconds);
-stat_t st_prep_line(float steps[], float microseconds);
+stat_t st_prep_line(float steps[], float microseconds) HOT_PATH;
+void st_prep_spindle_duty(float duty);
+void st_prep_raster(uint8_t raster);
+void st_prep_pso(uint8_t events);
+const stPrepSegment_t *st_get_prep_segment(void);
+uint8_t st_get_dda_clock_shift(void) HOT_PATH;
+uint32_t st_get_dda_period(void) HOT_PATH;
+void st_trim_dda_clock(uint8_t counts);
+void st_request_load_move(void) HOT_PATH;
+int32_t st_get_step_position(uint8_t motor);
+void st_set_motor_inhibit(uint8_t motor, uint8_t inhibit);
+void st_clear_motor_inhibits(void);
+void st_apply_config(void);
+#ifdef __DDA_RAMPING
+stat_t st_prep_line_ramped(float steps[], float microseconds, float start_velocity, float end_velocity) HOT_PATH;
+#endif
+
+#ifdef __PLANNER_BENCHMARK
+stat_t st_benchmark_exec_move(void);
+#endif
 
+stat_t st_set_ma(cmdObj_t *cmd);
 stat_t st_set_sa(cmdObj_t *cmd);
 stat_t st_set_tr(cmdObj_t *cmd);
 stat_t st_set_mi(cmdObj_t *cmd);
 stat_t st_set_pm(cmdObj_t *cmd);
+stat_t st_set_pw(cmdObj_t *cmd);
 stat_t st_set_mt(cmdObj_t *cmd);
+stat_t st_set_sds(cmdObj_t *cmd);
+stat_t st_set_sph(cmdObj_t *cmd);
+stat_t st_set_spl(cmdObj_t *cmd);
 stat_t st_set_md(cmdObj_t *cmd);
 stat_t st_set_me(cmdObj_t *cmd);
+stat_t st_get_se(cmdObj_t *cmd);
+#ifdef __MICROSTEP_MORPHING
+stat_t st_set_mo(cmdObj_t *cmd);
+#endif
 
 #ifdef __TEXT_MODE
 
@@ -338,6 +592,16 @@ stat_t st_set_me(cmdObj_t *cmd);
 	void st_print_mi(cmdObj_t *cmd);
 	void st_print_po(cmdObj_t *cmd);
 	void st_print_pm(cmdObj_t *cmd);
+	void st_print_pl(cmdObj_t *cmd);
+	void st_print_pi(cmdObj_t *cmd);
+	void st_print_se(cmdObj_t *cmd);
+	void st_print_sc(cmdObj_t *cmd);
+	void st_print_sds(cmdObj_t *cmd);
+	void st_print_sph(cmdObj_t *cmd);
+	void st_print_spl(cmdObj_t *cmd);
+	void st_print_esl(cmdObj_t *cmd);
+	void st_print_mo(cmdObj_t *cmd);
+	void st_print_msr(cmdObj_t *cmd);
 
 #else
 
@@ -350,6 +614,16 @@ stat_t st_set_me(cmdObj_t *cmd);
 	#define st_print_mi tx_print_stub
 	#define st_print_po tx_print_stub
 	#define st_print_pm tx_print_stub
+	#define st_print_pl tx_print_stub
+	#define st_print_pi tx_print_stub
+	#define st_print_se tx_print_stub
+	#define st_print_sc tx_print_stub
+	#define st_print_sds tx_print_stub
+	#define st_print_sph tx_print_stub
+	#define st_print_spl tx_print_stub
+	#define st_print_esl tx_print_stub
+	#define st_print_mo tx_print_stub
+	#define st_print_msr tx_print_stub
 
 #endif // __TEXT_MODE
 
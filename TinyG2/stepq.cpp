@@ -0,0 +1,417 @@
+/*
+ * stepq.cpp - step schedules generated by the host, run without the planner
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See stepq.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "planner.h"
+#include "kinematics.h"
+#include "stepper.h"
+#include "report.h"
+#include "util.h"
+#include "xio.h"
+#include "stepq.h"
+#include "swo.h"
+
+#ifdef __STEP_QUEUE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+sqSingleton_t sq;
+
+static int32_t _run_motor(sqMotor_t *m, const uint32_t start, const uint32_t end) HOT_PATH;
+static uint8_t _is_idle(void);
+static void _stop_clock(void);
+static void _drop_queues(void);
+static void _end_run(void);
+
+#define _next_move(i) (((i) + 1) % SQ_MOVES)
+
+/*
+ * sq_reset() - drop the queues and end the run
+ *
+ *	Called from mp_flush_planner(), which is only done with the motors stopped. The
+ *	runtime position is set from the steps that ran, and cm_queue_flush() sets the
+ *	model and the planner from it.
+ */
+void sq_reset()
+{
+	if (sq.mode == 0) { return;}
+	_drop_queues();
+	_end_run();
+}
+
+/*
+ * sq_hold() - TRUE to hold a line in the input buffer (see SQ_HOLD())
+ *
+ *	A {"sq":...} line waits for its motor to have room for a full line of moves, and
+ *	{"sqm":...} waits for the queues to run out, so the run ends where the host expects.
+ */
+uint8_t sq_hold(const char_t *line)
+{
+	if (sq.mode == 0) { return (false);}
+	const char_t *key = strstr(line, "sq");
+	if (key == NULL) { return (false);}
+	if (key[2] == 'm') { return ((_is_idle() == false) || (stepper_isbusy() == true));}
+	if (key[2] != '"') { return (false);}
+	const char_t *value = strchr(key+3, '"');
+	if (value == NULL) { return (false);}
+	uint8_t motor = (uint8_t)(value[1] - '1');
+	if (motor >= MOTORS) { return (false);}			// sq_run_moves() rejects it
+	return (sq_moves_available(motor) < SQ_LINE_MOVES);
+}
+
+/*
+ * sq_resume() - restart the clock at the end of a feedhold. Returns FALSE if no run is on
+ */
+uint8_t sq_resume()
+{
+	if (sq.mode == 0) { return (false);}
+	cm_set_motion_state(MOTION_RUN);
+	st_request_exec_move();
+	return (true);
+}
+
+/*
+ * sq_moves_available() - moves free to fill for a motor
+ * sq_queue_move()		- queue a move for a motor
+ *
+ *	The caller requests an exec once its moves are queued (st_request_exec_move()).
+ */
+uint8_t sq_moves_available(const uint8_t motor)
+{
+	return ((sq.m[motor].tail + SQ_MOVES - sq.m[motor].head - 1) % SQ_MOVES);
+}
+
+stat_t sq_queue_move(const uint8_t motor, const uint32_t interval, const int16_t count, const int16_t add)
+{
+	if (sq.mode == 0) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	if (motor >= MOTORS) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if (interval == 0) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (sq_moves_available(motor) == 0) { return (STAT_BUFFER_FULL);}
+
+	sqMotor_t *m = &sq.m[motor];
+	sqMove_t *move = &m->move[m->head];
+	move->interval = interval;
+	move->count = count;
+	move->add = add;
+	m->head = _next_move(m->head);
+	return (STAT_OK);
+}
+
+/*
+ * sq_exec() - run a segment of the queues from the exec, in place of the planner
+ *
+ *	Runs at the exec interrupt level and returns STAT_NOOP when there is nothing to
+ *	run, like the planner. The clock advances by the segment time at the clock rate,
+ *	which a feedhold ramps to 0 and a cycle start back to 1. The rate is averaged over
+ *	the segment, so the motors slow as the clock does and not in steps.
+ */
+stat_t sq_exec()
+{
+	if (sq.mode == 0) { return (STAT_NOOP);}
+	if (cm.feedhold_requested == true) {			// picked up here as no aline is running
+		cm.feedhold_requested = false;
+		if (cm.hold_state == FEEDHOLD_OFF) {
+			cm_set_motion_state(MOTION_HOLD);
+			cm.hold_state = FEEDHOLD_DECEL;
+			SWO_HOLD_STATE();
+		}
+	}
+	if (cm.hold_state == FEEDHOLD_HOLD) { return (STAT_NOOP);}
+
+	float microseconds = SQ_SEGMENT_USEC;
+	float rate_step = microseconds / (max(sq.hold_time, EPSILON) * 1000000);
+	float rate;
+	if (cm.hold_state == FEEDHOLD_DECEL) {
+		if ((sq.rate <= 0) || (_is_idle() == true)) {
+			sq.rate = 0;
+			cm.hold_state = FEEDHOLD_HOLD;
+			SWO_HOLD_STATE();
+			sr_request_status_report(SR_IMMEDIATE_REQUEST);
+			return (STAT_NOOP);
+		}
+		rate = max(sq.rate - rate_step, (float)0);
+	} else {
+		if (_is_idle() == true) {
+			_stop_clock();
+			return (STAT_NOOP);
+		}
+		rate = min(sq.rate + rate_step, (float)1);
+	}
+
+	float span = (sq.rate + rate) / 2 * microseconds * SQ_COUNTS_PER_USEC + sq.residual;
+	uint32_t counts = (uint32_t)span;
+	uint32_t end = sq.clock + counts;
+	int32_t counted[MOTORS];
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		counted[motor] = _run_motor(&sq.m[motor], sq.clock, end);
+	}
+
+	// hold homed axes to the soft limits - see cm_set_soft_limits()
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		if ((sq.soft_axes & (1 << axis)) == 0) { continue;}
+		uint8_t motor = sq.axis_motor[axis];
+		int32_t position = sq.axis_start[axis] + sq.m[motor].steps + counted[motor];
+		if ((position < cm.soft_min[axis]) || (position > cm.soft_max[axis])) {
+			_drop_queues();
+			return (cm_alarm(STAT_SOFT_LIMIT_EXCEEDED));
+		}
+	}
+
+	float steps[MOTORS];
+	for (uint8_t motor=0; motor<MOTORS; motor++) { steps[motor] = (float)counted[motor];}
+	ritorno(st_prep_line(steps, microseconds));
+	for (uint8_t motor=0; motor<MOTORS; motor++) { sq.m[motor].steps += counted[motor];}
+	sq.residual = span - counts;
+	sq.clock = end;
+	sq.rate = rate;
+	mr.job_usec += (uint32_t)microseconds;
+	return (STAT_OK);
+}
+
+/*
+ * _run_motor() - count the steps of a motor from its clock start to end
+ *
+ *	Loads the motor's next moves as the last ones run out, but not one that reverses
+ *	it once it has stepped in the segment - the reversal waits for the next segment.
+ */
+static int32_t _run_motor(sqMotor_t *m, const uint32_t start, const uint32_t end)
+{
+	int32_t steps = 0;
+
+	for (;;) {
+		if (m->count == 0) {
+			if (m->tail == m->head) { break;}
+			sqMove_t *move = &m->move[m->tail];
+			int8_t direction = (move->count < 0) ? -1 : 1;
+			if ((steps != 0) && (direction != m->direction)) { break;}
+			m->tail = _next_move(m->tail);
+			if (move->count == 0) {					// a wait
+				m->last += move->interval;
+				continue;
+			}
+			m->direction = direction;
+			m->count = (uint16_t)abs(move->count);
+			m->interval = move->interval;
+			m->add = move->add;
+			m->next = m->last + m->interval;
+		}
+		if ((int32_t)(m->next - end) >= 0) { break;}
+		if ((int32_t)(m->next - start) < 0) { sq.late++;}
+		steps++;
+		m->last = m->next;
+		if (--m->count != 0) {
+			m->interval += m->add;
+			m->next += m->interval;
+		}
+	}
+	return (steps * m->direction);
+}
+
+/*
+ * _is_idle()		- TRUE if every queue has run out
+ * _stop_clock()	- hold the clock at the latest step while the queues are dry
+ * _drop_queues()	- discard the moves of every motor
+ * _end_run()		- move the runtime position by the steps that ran and end the cycle
+ *
+ *	The clock is only ever moved back by _stop_clock(), so a wait queued after the
+ *	last step is still waited out once the next moves arrive.
+ */
+static uint8_t _is_idle()
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		if ((sq.m[motor].count != 0) || (sq.m[motor].tail != sq.m[motor].head)) { return (false);}
+	}
+	return (true);
+}
+
+static void _stop_clock()
+{
+	uint32_t latest = sq.m[0].last;
+	for (uint8_t motor=1; motor<MOTORS; motor++) {
+		if ((int32_t)(sq.m[motor].last - latest) > 0) { latest = sq.m[motor].last;}
+	}
+	if ((int32_t)(latest - sq.clock) < 0) { sq.clock = latest;}
+	sq.residual = 0;
+}
+
+static void _drop_queues()
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		sq.m[motor].count = 0;
+		sq.m[motor].tail = sq.m[motor].head;
+	}
+}
+
+static void _end_run()
+{
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		int8_t motor = sq.axis_motor[axis];
+		if ((motor < 0) || (fp_ZERO(st.m[motor].steps_per_unit))) { continue;}
+		mp_set_runtime_position(axis, mr.position[axis] + sq.m[motor].steps / st.m[motor].steps_per_unit);
+	}
+	sq.mode = 0;
+	if (cm.cycle_state == CYCLE_STEP_QUEUE) { cm.cycle_state = CYCLE_OFF;}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * sq_run_moves() - queue the moves of a {"sq":...} line
+ *
+ *	The line is checked in full before any of it is queued.
+ */
+stat_t sq_run_moves(cmdObj_t *cmd)
+{
+	if (cmd->objtype != TYPE_STRING) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	if (sq.mode == 0) { return (STAT_COMMAND_NOT_ACCEPTED);}
+	const char *src = (const char *)*cmd->stringp;
+	char *end;
+
+	long motor = strtol(src, &end, 10) - 1;
+	if (end == src) { return (STAT_BAD_NUMBER_FORMAT);}
+	if ((motor < 0) || (motor >= MOTORS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	src = end;
+
+	sqMove_t moves[SQ_LINE_MOVES];
+	uint8_t count = 0;
+	while (*src != NUL) {
+		if (count == SQ_LINE_MOVES) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+		long value[3];
+		for (uint8_t i=0; i<3; i++) {
+			if (*src != ',') { return (STAT_BAD_NUMBER_FORMAT);}
+			value[i] = strtol(src+1, &end, 10);
+			if (end == src+1) { return (STAT_BAD_NUMBER_FORMAT);}
+			src = end;
+		}
+		if ((value[0] <= 0) || (value[1] < INT16_MIN) || (value[1] > INT16_MAX) ||
+			(value[2] < INT16_MIN) || (value[2] > INT16_MAX)) {
+			return (STAT_INPUT_VALUE_RANGE_ERROR);
+		}
+		moves[count].interval = (uint32_t)value[0];
+		moves[count].count = (int16_t)value[1];
+		moves[count].add = (int16_t)value[2];
+		count++;
+	}
+	if (count == 0) { return (STAT_INPUT_VALUE_TOO_SMALL);}
+	if (sq_moves_available((uint8_t)motor) < count) { return (STAT_BUFFER_FULL);}	// SQ_HOLD() should prevent this
+
+	for (uint8_t i=0; i<count; i++) {
+		sq_queue_move((uint8_t)motor, moves[i].interval, moves[i].count, moves[i].add);
+	}
+	st_request_exec_move();
+	cmd->value = count;								// report the moves queued, not the line
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+/*
+ * sq_set_sqm() - start or end a run
+ *
+ *	A run starts under the same conditions as a jog. It ends as a jog does: the Gcode
+ *	model and the planner are set to the runtime position (see mp_jog_callback()).
+ */
+stat_t sq_set_sqm(cmdObj_t *cmd)
+{
+	if (fp_ZERO(cmd->value)) {
+		if (sq.mode == 0) { return (STAT_OK);}
+		_end_run();
+		for (uint8_t axis = AXIS_X; axis < AXES; axis++) {
+			mp_set_planner_position(axis, mp_get_runtime_absolute_position(axis));
+			gmx.position[axis] = mp_get_runtime_absolute_position(axis);
+			gm.target[axis] = gmx.position[axis];
+		}
+		cm.machine_state = MACHINE_PROGRAM_STOP;
+		cm_set_motion_state(MOTION_STOP);
+		sr_request_status_report(SR_IMMEDIATE_REQUEST);
+		return (STAT_OK);
+	}
+	if (sq.mode != 0) { return (STAT_OK);}
+	if ((ik.kinematics != KINEMATICS_CARTESIAN) || (ik.map_enable == true)) {
+		return (STAT_INPUT_VALUE_UNSUPPORTED);		// the end position could not be found
+	}
+	if ((cm.machine_state == MACHINE_ALARM) || (cm.cycle_state != CYCLE_OFF) ||
+		(cm.motion_state != MOTION_STOP) || (gc_get_queued_blocks() != 0) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		sqMotor_t *m = &sq.m[motor];
+		m->head = 0;
+		m->tail = 0;
+		m->count = 0;
+		m->direction = 1;
+		m->last = 0;
+		m->steps = 0;
+	}
+	sq.clock = 0;
+	sq.rate = 1;
+	sq.residual = 0;
+	sq.soft_axes = 0;
+	for (uint8_t axis=0; axis<AXES; axis++) {
+		sq.axis_motor[axis] = -1;
+		for (uint8_t motor=0; motor<MOTORS; motor++) {
+			if (st.m[motor].motor_map == axis) {
+				sq.axis_motor[axis] = motor;
+				break;
+			}
+		}
+		if ((sq.axis_motor[axis] < 0) || (cm.homed[axis] == false) || fp_ZERO(cm.soft_steps[axis]) ||
+			(cm.a[axis].axis_mode == AXIS_WRAP)) {
+			continue;
+		}
+		sq.soft_axes |= (1 << axis);
+		sq.axis_start[axis] = (int32_t)lrintf(mr.position[axis] * cm.soft_steps[axis]);
+	}
+	cm.cycle_state = CYCLE_STEP_QUEUE;
+	cm.machine_state = MACHINE_CYCLE;
+	cm_set_motion_state(MOTION_RUN);
+	sq.mode = 1;
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_sqh[] PROGMEM = "[sqh] step queue hold time%13.3f sec\n";
+
+void sq_print_sqh(cmdObj_t *cmd) { text_print_flt(cmd, fmt_sqh);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __STEP_QUEUE
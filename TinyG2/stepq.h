@@ -0,0 +1,150 @@
+/*
+ * stepq.h - step schedules generated by the host, run without the planner
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The step queue is compiled in by __STEP_QUEUE in tinyg2.h. A host that generates
+ * its own trajectories sends the steps of each motor as compressed schedules, and
+ * they run without the block planner or the move runtime:
+ *
+ *	{"sqm":1}	start a run - the machine must be stopped with nothing queued
+ *	{"sq":"<motor>,<interval>,<count>,<add>[,<interval>,<count>,<add>...]"}
+ *				queue up to SQ_LINE_MOVES moves for motor 1 to 6
+ *	{"sqm":0}	end the run once the queues have run out
+ *
+ * A move is the step times of one motor as an arithmetic series:
+ *
+ *	interval	timer counts (MCK/2, 42 per microsecond) from the motor's last step
+ *				to the first step of the move
+ *	count		steps in the move, negative to step in reverse. 0 is a wait of interval
+ *	add			counts added to the interval after each step
+ *
+ * so each move is a constant step acceleration, as hosts that compress their step
+ * times send them (Klipper's queue_step). Each motor's times run on from its own last
+ * step, so the host's timeline carries across moves and queues.
+ *
+ * The exec runs SQ_SEGMENT_USEC segments in place of the planner, as the jog does.
+ * A segment counts the steps of each motor whose times fall in it and hands them to
+ * st_prep_line(), so the DDA spreads them over the segment - a step lands up to a
+ * segment early or late, as it does from the planner. A motor that changes direction
+ * does so at the start of a segment. The exec's share is a compare and an add per step.
+ *
+ * The host keeps the queues ahead of the motors. Steps whose time has passed when they
+ * are loaded are run at once, and counted in {"sqe":""}. If every queue runs dry the
+ * clock is stopped at the latest step and runs on from there with the next moves, so
+ * the host can pause between moves. Each motor holds SQ_MOVES moves; a {"sq":...} line
+ * is held in the input buffer until its motor has room for SQ_LINE_MOVES, so the host
+ * streams with normal flow control. With __BINARY_STREAM the BS_STEPS frame queues the
+ * same moves (see binary_stream.h).
+ *
+ * The firmware still keeps the machine:
+ *
+ *	- A feedhold slows the clock to a stop over $sqh seconds. Every motor slows with
+ *	  it, so the path is kept. A cycle start speeds it back up, and a queue flush in
+ *	  the hold drops the queues and ends the run.
+ *	- Homed axes are held to their soft limits. A segment that would cross one is not
+ *	  run, the queues are dropped and the machine is alarmed.
+ *
+ * {"sqm":0} waits in the input buffer for the queues to run out, then sets the Gcode
+ * model and the planner to the position the motors stepped to. That position is only
+ * known with cartesian kinematics, so a run needs $kn=0 and no surface map. Gcode sent
+ * during a run waits for it to end, and moves sent other ways are refused.
+ */
+
+#ifndef STEPQ_H_ONCE
+#define STEPQ_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __STEP_QUEUE
+
+#define SQ_MOVES				32		// moves held per motor
+#define SQ_LINE_MOVES			16		// most moves in a {"sq":...} line
+#define SQ_SEGMENT_USEC			MIN_SEGMENT_USEC				// time of each exec segment
+#define SQ_COUNTS_PER_USEC		((float)(F_CPU/2) / 1000000)	// clock of the step times (MCK/2)
+
+typedef struct sqMove {					// one move as queued
+	uint32_t interval;
+	int16_t count;
+	int16_t add;
+} sqMove_t;
+
+typedef struct sqMotor {
+	volatile uint8_t head;				// next move to fill (written by sq_queue_move() only)
+	volatile uint8_t tail;				// next move to load (written by the exec only)
+	int8_t direction;					// direction of the loaded move, 1 or -1
+	uint16_t count;						// steps left in the loaded move - 0 once it has run
+	uint32_t interval;					// counts from the last step to the next
+	int32_t add;
+	uint32_t next;						// clock of the next step
+	uint32_t last;						// clock of the last step
+	int32_t steps;						// steps run since the run started
+	sqMove_t move[SQ_MOVES];
+} sqMotor_t;
+
+typedef struct sqSingleton {
+	uint8_t mode;						// sqm - 1 while a run is on
+	float hold_time;					// sqh - seconds a feedhold takes to stop the clock
+	uint32_t late;						// sqe - steps run after their time
+	float rate;							// clock counts per timer count - 1 running, 0 held
+	float residual;						// fraction of a clock count carried to the next segment
+	uint32_t clock;						// clock at the start of the next segment
+	uint8_t soft_axes;					// axes held to their soft limits, one bit per axis
+	int8_t axis_motor[AXES];			// first motor of each axis, -1 if none
+	int32_t axis_start[AXES];			// soft limit position of each axis as the run started
+	sqMotor_t m[MOTORS];
+} sqSingleton_t;
+
+extern sqSingleton_t sq;
+
+void sq_reset(void);
+uint8_t sq_hold(const char_t *line);
+uint8_t sq_resume(void);
+uint8_t sq_moves_available(const uint8_t motor);
+stat_t sq_queue_move(const uint8_t motor, const uint32_t interval, const int16_t count, const int16_t add);
+stat_t sq_exec(void) HOT_PATH;
+
+stat_t sq_run_moves(cmdObj_t *cmd);
+stat_t sq_set_sqm(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void sq_print_sqh(cmdObj_t *cmd);
+#else
+	#define sq_print_sqh tx_print_stub
+#endif
+
+#define SQ_RUNNING() (sq.mode != 0)
+#define SQ_EXEC() sq_exec()
+#define SQ_HOLD(line) sq_hold(line)
+#define SQ_RESUME() sq_resume()
+
+#else
+
+#define SQ_RUNNING() (false)
+#define SQ_EXEC() (STAT_NOOP)
+#define SQ_HOLD(line) (false)
+#define SQ_RESUME() (false)
+
+#endif // __STEP_QUEUE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: STEPQ_H_ONCE
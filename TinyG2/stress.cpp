@@ -0,0 +1,251 @@
+/*
+ * stress.cpp - synthetic step load to measure stepper interrupt headroom
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See stress.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "canonical_machine.h"
+#include "gcode_parser.h"
+#include "planner.h"
+#include "stepper.h"
+#include "hardware.h"
+#include "report.h"
+#include "profiler.h"
+#include "settings.h"				// STATUS_REPORT_MIN_MS
+#include "util.h"
+#include "xio.h"
+#include "stress.h"
+
+#ifdef __STRESS_TEST
+
+#include "MotateTimers.h"
+using Motate::SysTickTimer;
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+sxSingleton_t sx;
+
+static void _end_test(void);
+static void _format_result(char_t *buf);
+
+#ifdef __PROFILER
+static const uint8_t _isr_point[SX_ISRS] = { PF_DDA_ISR, PF_EXEC_ISR, PF_LOAD_ISR };
+
+static void _get_isr_cycles(uint64_t cycles[])
+{
+	__disable_irq();								// see pf_get_point()
+	for (uint8_t i=0; i<SX_ISRS; i++) { cycles[i] = pf.point[_isr_point[i]].total;}
+	__enable_irq();
+}
+#endif
+
+/*
+ * sx_reset() - end the test without a result
+ *
+ *	Called from mp_flush_planner(), which is only done with the motors stopped.
+ *	No motion is left to undo, as the segments already run come in reversing pairs.
+ */
+void sx_reset()
+{
+	if (sx.state == SX_OFF) { return;}
+	sx.state = SX_OFF;
+	mps.exec_margin_min = min(mps.exec_margin_min, sx.margin_min);
+	if (cm.cycle_state == CYCLE_STRESS_TEST) { cm.cycle_state = CYCLE_OFF;}
+}
+
+/*
+ * sx_exec() - prepare a segment of the test from the exec, in place of the planner
+ *
+ *	Runs at the exec interrupt level and returns STAT_NOOP once the last segment is
+ *	prepared, like the planner with nothing to run. A feedhold runs one more segment
+ *	if that is needed to bring the motors back, then ends the test.
+ */
+stat_t sx_exec()
+{
+	if (sx.state != SX_RUN) { return (STAT_NOOP);}
+	if (cm.feedhold_requested == true) {			// picked up here as no aline is running
+		cm.feedhold_requested = false;
+		sx.segments_left = sx.segments & 1;
+	}
+	if (sx.segments_left == 0) {
+		sx.state = SX_END;
+		return (STAT_NOOP);
+	}
+	float steps[MOTORS];
+	for (uint8_t motor=0; motor<MOTORS; motor++) { steps[motor] = sx.steps;}
+	ritorno(st_prep_line(steps, SX_SEGMENT_USEC));
+	sx.steps = -sx.steps;
+	sx.segments++;
+	sx.segments_left--;
+	return (STAT_OK);
+}
+
+/*
+ * sx_callback() - add the test load and report once the last segment has stepped out
+ *
+ *	The simulated input line is only fed in once the input buffer has taken the last
+ *	one, so it never backs up behind the controller.
+ */
+stat_t sx_callback()
+{
+	if (sx.state == SX_OFF) { return (STAT_NOOP);}
+	if (sx.state == SX_END) {
+		if (stepper_isbusy() == true) { return (STAT_NOOP);}
+		_end_test();
+		return (STAT_OK);
+	}
+	uint32_t now = SysTickTimer.getValue();
+	if ((sx.load & SX_LOAD_RX) && ((now - sx.rx_ms) >= SX_RX_MS) && (xio_get_rx_bufcount() == 0)) {
+		sx.rx_ms = now;
+		xio_rx_inject((const char_t *)SX_RX_LINE);
+	}
+	if ((sx.load & SX_LOAD_SR) && ((now - sx.sr_ms) >= STATUS_REPORT_MIN_MS)) {
+		sx.sr_ms = now;
+		sr_request_status_report(SR_IMMEDIATE_REQUEST);
+	}
+	return (STAT_OK);
+}
+
+/*
+ * _end_test() - take the result from the counters and return the machine to idle
+ */
+static void _end_test()
+{
+	float ms = (float)(SysTickTimer.getValue() - sx.start_ms);
+
+	sx.result_sec = ms / 1000;
+	sx.result_segments = sx.segments;
+	sx.result_gaps = mps.dda_gaps - sx.gaps;
+	sx.result_near_misses = mps.exec_near_misses - sx.near_misses;
+	sx.result_margin = mps.exec_margin_min;
+	mps.exec_margin_min = min(mps.exec_margin_min, sx.margin_min);
+#ifdef __PROFILER
+	uint64_t cycles[SX_ISRS];
+	_get_isr_cycles(cycles);
+	for (uint8_t i=0; i<SX_ISRS; i++) {
+		sx.result_isr[i] = (ms > 0) ? ((float)(cycles[i] - sx.isr_cycles[i]) * 100 / (ms * (F_CPU/1000))) : 0;
+	}
+#else
+	for (uint8_t i=0; i<SX_ISRS; i++) { sx.result_isr[i] = -1;}
+#endif
+	sx.state = SX_OFF;
+	cm.cycle_state = CYCLE_OFF;
+	cm.machine_state = MACHINE_PROGRAM_STOP;
+	cm_set_motion_state(MOTION_STOP);
+	sr_request_status_report(SR_IMMEDIATE_REQUEST);
+
+	char_t buf[96];
+	_format_result(buf);
+	printf_P(PSTR("{\"sxs\":[%s]}\n"), (char *)buf);
+}
+
+static void _format_result(char_t *buf)
+{
+	sprintf((char *)buf, "%0.3f,%lu,%lu,%lu,%lu,%0.2f,%0.2f,%0.2f", sx.result_sec,
+		(unsigned long)sx.result_segments, (unsigned long)sx.result_gaps,
+		(unsigned long)sx.result_near_misses, (unsigned long)sx.result_margin,
+		sx.result_isr[SX_ISR_DDA], sx.result_isr[SX_ISR_EXEC], sx.result_isr[SX_ISR_LOAD]);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * sx_set_sxr() - set the step rate
+ * sx_set_sxt() - run the test for n seconds
+ * sx_get_sxs() - return the last result as [sec,segments,gaps,near,margin,dda,exec,load]
+ *
+ *	The test starts under the same conditions as a jog. The counters are read as it
+ *	starts rather than reset, so {"ps":""} and {"pf":""} still add up over the session.
+ *	exec_margin_min is the one exception - it is restarted for the test and the lower
+ *	of the two is put back at the end.
+ */
+stat_t sx_set_sxr(cmdObj_t *cmd)
+{
+	if ((cmd->value <= 0) || (cmd->value > SX_STEP_RATE_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	return (set_flt(cmd));
+}
+
+stat_t sx_set_sxt(cmdObj_t *cmd)
+{
+	if ((cmd->value <= 0) || (cmd->value > SX_SECONDS_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if ((sx.state != SX_OFF) || (cm.machine_state == MACHINE_ALARM) || (cm.cycle_state != CYCLE_OFF) ||
+		(cm.motion_state != MOTION_STOP) || (gc_get_queued_blocks() != 0) ||
+		(mp_get_planner_buffers_available() < PLANNER_BUFFER_POOL_SIZE)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	uint32_t pairs = (uint32_t)ceil(cmd->value * 1000000 / (SX_SEGMENT_USEC * 2));
+	sx.segments_left = pairs * 2;
+	sx.segments = 0;
+	sx.steps = sx.step_rate * SX_SEGMENT_USEC / 1000000;
+	sx.gaps = mps.dda_gaps;
+	sx.near_misses = mps.exec_near_misses;
+	sx.margin_min = mps.exec_margin_min;
+	mps.exec_margin_min = (uint32_t)(MAX_SEGMENT_USEC * ST_PREP_SEGMENTS);	// see mp_reset_stats()
+#ifdef __PROFILER
+	_get_isr_cycles(sx.isr_cycles);
+#endif
+	sx.start_ms = SysTickTimer.getValue();
+	sx.rx_ms = sx.start_ms;
+	sx.sr_ms = sx.start_ms;
+
+	cm.cycle_state = CYCLE_STRESS_TEST;
+	cm.machine_state = MACHINE_CYCLE;
+	cm_set_motion_state(MOTION_RUN);
+	sx.state = SX_RUN;
+	st_request_exec_move();
+	return (STAT_OK);
+}
+
+stat_t sx_get_sxs(cmdObj_t *cmd)
+{
+	char_t buf[96];
+
+	_format_result(buf);
+	cmd->objtype = TYPE_ARRAY;
+	return (cmd_copy_string(cmd, buf));
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_sxr[] PROGMEM = "[sxr] stress test step rate%12.0f steps/sec\n";
+static const char fmt_sxl[] PROGMEM = "[sxl] stress test load%17d [1=input lines,2=status reports]\n";
+static const char fmt_sxs[] PROGMEM = "[%s%s] %s [sec,segments,gaps,near,margin uSec,dda%%,exec%%,load%%]\n";
+
+void sx_print_sxr(cmdObj_t *cmd) { text_print_flt(cmd, fmt_sxr);}
+void sx_print_sxl(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sxl);}
+void sx_print_sxs(cmdObj_t *cmd) { fprintf_P(stderr, fmt_sxs, cmd->group, cmd->token, *cmd->stringp);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __STRESS_TEST
@@ -0,0 +1,153 @@
+/*
+ * stress.h - synthetic step load to measure stepper interrupt headroom
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The stress test is compiled in by __STRESS_TEST in tinyg2.h. It drives every motor
+ * at a set step rate for a set time, so the headroom of the stepper interrupts can be
+ * measured before FREQUENCY_DDA is raised or motors are added:
+ *
+ *	$sxr		steps per second each motor is driven at, up to FREQUENCY_DDA/2
+ *	$sxl		load added while the test runs, bits may be combined:
+ *				  1	 a query line is fed through the input every SX_RX_MS, as if from USB
+ *				  2	 a status report is requested every STATUS_REPORT_MIN_MS
+ *	{"sxt":n}	run the test for n seconds - the machine must be idle
+ *	{"sxs":""}	the last result - also sent as the test ends
+ *
+ * The exec runs SX_SEGMENT_USEC segments in place of the planner, as the jog does, and
+ * hands each to st_prep_line(), so the steps take the same path through _load_move()
+ * and the DDA as any move. Segments are the shortest the planner makes, so the exec and
+ * load interrupts run as often as they ever do. Every segment reverses the motors and
+ * the test always runs an even number of them, so there is no net motion and the
+ * position is unchanged - but the motors are stepped hard back and forth. Run it with
+ * the motors disconnected or the drivers disabled. With __TIMED_STEPS a rate above
+ * ST_TIMED_STEP_RATE is run by timed steps, as a real move would be.
+ *
+ * The simulated input line is parsed and answered as a host line would be, so its
+ * responses come back to the host. It goes in the same buffer as USB input - send
+ * nothing but signals while a test with $sxl bit 1 runs.
+ *
+ * A feedhold ends the test early, and a queue flush or alarm ends it without a result.
+ * Gcode waits for the test to end. The result is:
+ *
+ *	{"sxs":[sec,segments,gaps,near,margin,dda,exec,load]}
+ *
+ *	sec		time the test ran
+ *	segments	segments prepared
+ *	gaps	segment deadlines missed - loads that found nothing prepared (see {"psgap":""})
+ *	near	segments the exec finished with little of the running one left ({"psnm":""})
+ *	margin	least time left in the running segment as the exec finished one, in uSec
+ *	dda, exec, load
+ *			percent of the CPU spent in the DDA, exec and load interrupts. These need
+ *			__PROFILER and are -1 without it
+ */
+
+#ifndef STRESS_H_ONCE
+#define STRESS_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __STRESS_TEST
+
+#define SX_SEGMENT_USEC		MIN_SEGMENT_USEC		// time of each exec segment
+#define SX_STEP_RATE_MAX	(FREQUENCY_DDA/2)		// a pulse takes one DDA tick on and one off
+#define SX_SECONDS_MAX		600						// longest test
+#define SX_RX_MS			2						// ms between simulated input lines
+#define SX_RX_LINE			"{\"posx\":\"\",\"posy\":\"\",\"posz\":\"\",\"vel\":\"\"}\n"
+
+enum sxLoad {							// $sxl bits
+	SX_LOAD_RX = 0x01,					// simulated input lines
+	SX_LOAD_SR = 0x02					// status reports at the minimum interval
+};
+
+enum sxState {
+	SX_OFF = 0,
+	SX_RUN,								// the exec is preparing segments
+	SX_END								// the last segment is prepared - report once it has stepped out
+};
+
+enum sxIsr {							// interrupts timed by the profiler
+	SX_ISR_DDA = 0,
+	SX_ISR_EXEC,
+	SX_ISR_LOAD,
+	SX_ISRS
+};
+
+typedef struct sxSingleton {
+	float step_rate;					// sxr - steps per second per motor
+	uint8_t load;						// sxl - sxLoad bits
+	volatile uint8_t state;				// sxState
+	uint32_t segments_left;				// segments still to prepare (written by the exec only)
+	uint32_t segments;					// segments prepared
+	float steps;						// steps per motor per segment, signed by direction
+	uint32_t start_ms;					// SysTick time the test started
+	uint32_t rx_ms;						// SysTick time of the last simulated input line
+	uint32_t sr_ms;						// SysTick time of the last status report request
+	uint32_t gaps;						// mps counters as the test started
+	uint32_t near_misses;
+	uint32_t margin_min;				// mps.exec_margin_min as the test started - restored at the end
+	uint64_t isr_cycles[SX_ISRS];		// profiler totals as the test started
+
+	float result_sec;					// sxs - the last result
+	uint32_t result_segments;
+	uint32_t result_gaps;
+	uint32_t result_near_misses;
+	uint32_t result_margin;
+	float result_isr[SX_ISRS];			// percent of the CPU, -1 if not measured
+} sxSingleton_t;
+
+extern sxSingleton_t sx;
+
+void sx_reset(void);
+stat_t sx_exec(void) HOT_PATH;
+stat_t sx_callback(void);
+
+stat_t sx_set_sxr(cmdObj_t *cmd);
+stat_t sx_set_sxt(cmdObj_t *cmd);
+stat_t sx_get_sxs(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void sx_print_sxr(cmdObj_t *cmd);
+	void sx_print_sxl(cmdObj_t *cmd);
+	void sx_print_sxs(cmdObj_t *cmd);
+#else
+	#define sx_print_sxr tx_print_stub
+	#define sx_print_sxl tx_print_stub
+	#define sx_print_sxs tx_print_stub
+#endif
+
+#define STRESS_RUNNING() (sx.state == SX_RUN)
+#define STRESS_ACTIVE() (sx.state != SX_OFF)
+#define STRESS_EXEC() sx_exec()
+#define STRESS_CALLBACK() sx_callback()
+
+#else
+
+#define STRESS_RUNNING() (false)
+#define STRESS_ACTIVE() (false)
+#define STRESS_EXEC() (STAT_NOOP)
+#define STRESS_CALLBACK() (STAT_NOOP)
+
+#endif // __STRESS_TEST
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: STRESS_H_ONCE
@@ -45,14 +45,142 @@
 #include "switch.h"
 #include "hardware.h"
 #include "canonical_machine.h"
+#include "planner.h"
+#include "stepper.h"
+#include "profiler.h"
+#include "tmc2660.h"
 #include "text_parser.h"
+#include "sync.h"
 
 #include "MotateTimers.h"
 using Motate::SysTickTimer;
 
+static void _switch_edge(switch_t *s, uint8_t state, uint32_t now);
+
 // Allocate switch array structure
 switches_t sw;
 
+// Port and mask of each switch pin, used to build the switch banks
+typedef struct swPin {
+	uint8_t port;					// Motate port letter
+	uint32_t mask;					// pin bit in the port
+} swPin_t;
+
+static const swPin_t sw_pin[SW_PAIRS][SW_POSITIONS] = {
+	{{ axis_X_min_pin.portLetter, axis_X_min_pin.mask }, { axis_X_max_pin.portLetter, axis_X_max_pin.mask }},
+	{{ axis_Y_min_pin.portLetter, axis_Y_min_pin.mask }, { axis_Y_max_pin.portLetter, axis_Y_max_pin.mask }},
+	{{ axis_Z_min_pin.portLetter, axis_Z_min_pin.mask }, { axis_Z_max_pin.portLetter, axis_Z_max_pin.mask }},
+	{{ axis_A_min_pin.portLetter, axis_A_min_pin.mask }, { axis_A_max_pin.portLetter, axis_A_max_pin.mask }},
+	{{ axis_B_min_pin.portLetter, axis_B_min_pin.mask }, { axis_B_max_pin.portLetter, axis_B_max_pin.mask }},
+	{{ axis_C_min_pin.portLetter, axis_C_min_pin.mask }, { axis_C_max_pin.portLetter, axis_C_max_pin.mask }}
+};
+
+// The switch pins of a port, resolved at compile time from the Motate pin templates.
+// Unassigned pins are Motate null pins (port 0, mask 0) and drop out.
+#define _SW_PIN(pin_num, letter) ((Motate::Pin<pin_num>::portLetter == (letter)) ? Motate::Pin<pin_num>::mask : 0)
+#define _SW_PORT_PINS(letter) (\
+	_SW_PIN(axis_X_min_pin_num, letter) | _SW_PIN(axis_X_max_pin_num, letter) |\
+	_SW_PIN(axis_Y_min_pin_num, letter) | _SW_PIN(axis_Y_max_pin_num, letter) |\
+	_SW_PIN(axis_Z_min_pin_num, letter) | _SW_PIN(axis_Z_max_pin_num, letter) |\
+	_SW_PIN(axis_A_min_pin_num, letter) | _SW_PIN(axis_A_max_pin_num, letter) |\
+	_SW_PIN(axis_B_min_pin_num, letter) | _SW_PIN(axis_B_max_pin_num, letter) |\
+	_SW_PIN(axis_C_min_pin_num, letter) | _SW_PIN(axis_C_max_pin_num, letter))
+
+/*
+ * swBank - the switches on one PIO port
+ *
+ *	A bank keeps the switch states of its port as bit masks in pin order, so a port
+ *	is read once and only the pins that changed are visited (via count trailing zeros).
+ *	Closed bits are the raw pins XORed with the NO mask: a NO switch is closed when
+ *	its pin reads 0, an NC switch when its pin reads 1.
+ *
+ *	  isr()      - called from the PIO change interrupt for the port
+ *	  resample() - called from SysTick for switches that changed during their lockout
+ */
+template <class Port>
+struct swBank {
+	static const uint32_t pins = _SW_PORT_PINS(Port::letter);	// switch pins on the port
+
+	Port port;
+	uint32_t invert;				// pins of NO switches
+	uint32_t enabled;				// pins of switches that are not disabled
+	uint32_t closed;				// debounced switch states - 1 = closed
+	volatile uint32_t pending;		// pins that changed during lockout - resample when it ends
+	uint8_t sw_num[32];				// switch number of each pin in the port
+
+	void init()
+	{
+		invert = 0;
+		enabled = 0;
+		closed = 0;
+		for (uint8_t n=0; n<(SW_PAIRS * SW_POSITIONS); n++) {
+			const swPin_t *p = &sw_pin[n/SW_POSITIONS][n%SW_POSITIONS];
+			if ((pins == 0) || (p->port != Port::letter) || (p->mask == 0)) { continue;}
+			switch_t *s = &sw.s[n/SW_POSITIONS][n%SW_POSITIONS];
+			sw_num[__builtin_ctz(p->mask)] = n;
+			if (s->mode != SW_MODE_DISABLED) { enabled |= p->mask;}
+			if (s->type == SW_NORMALLY_OPEN) { invert |= p->mask;}
+		}
+		pending = enabled;					// take the initial states on the next SysTick
+	}
+
+	void isr()
+	{
+		port.getInterruptStatus();			// clears the change flags - the states below are what count
+		if (pins == 0) { return;}
+		uint32_t changed = ((port.getInputValues(pins) ^ invert) ^ closed) & enabled;
+		if (changed == 0) { return;}		// bounced back, or a disabled switch
+
+		uint32_t now = SysTickTimer.getValue();
+		do {
+			uint8_t bit = __builtin_ctz(changed);
+			changed &= changed - 1;
+			switch_t *s = &sw.s[sw_num[bit]/SW_POSITIONS][sw_num[bit]%SW_POSITIONS];
+			if (s->debounce_timeout > now) {
+				pending |= (1u << bit);
+				continue;
+			}
+			closed ^= (1u << bit);
+			_switch_edge(s, (closed >> bit) & 1, now);
+		} while (changed != 0);
+	}
+
+	void resample(uint32_t now)
+	{
+		uint32_t due = pending;
+		if (due == 0) { return;}
+
+		uint32_t changed = ((port.getInputValues(pins) ^ invert) ^ closed);
+		do {
+			uint8_t bit = __builtin_ctz(due);
+			due &= due - 1;
+			switch_t *s = &sw.s[sw_num[bit]/SW_POSITIONS][sw_num[bit]%SW_POSITIONS];
+			if (s->debounce_timeout > now) { continue;}
+			pending &= ~(1u << bit);
+			if (changed & (1u << bit)) {
+				closed ^= (1u << bit);
+				_switch_edge(s, (closed >> bit) & 1, now);
+			} else {
+				s->edge = SW_NO_EDGE;
+				if (s->state == SW_OPEN) {
+					s->when_open(s);
+				} else {
+					s->when_closed(s);
+				}
+			}
+		} while (due != 0);
+	}
+};
+
+static swBank<Motate::PortA> sw_bank_A;
+static swBank<Motate::PortB> sw_bank_B;
+#ifdef PIOC
+static swBank<Motate::PortC> sw_bank_C;
+#endif
+#ifdef PIOD
+static swBank<Motate::PortD> sw_bank_D;
+#endif
+
 //static void _no_action(switch_t *s);
 //static void _led_on(switch_t *s);
 //static void _led_off(switch_t *s);
@@ -87,8 +215,14 @@ void switch_init(void)
 //			s->mode = SW_MODE_DISABLED;		// set from config			
 			s->state = false;
 			s->edge = SW_NO_EDGE;
+			s->axis = axis;
 			s->debounce_ticks = SW_LOCKOUT_TICKS;
 			s->debounce_timeout = 0;
+			s->edge_tick = 0;
+			s->edge_position = 0;
+			s->latch_edge = SW_NO_EDGE;
+			s->latched = false;
+			s->latch_inhibit = -1;
 
 			// functions bound to each switch
 			s->when_open = _no_action;
@@ -101,66 +235,114 @@ void switch_init(void)
 	// <none>
 	// sw.s[AXIS_X][SW_MIN].when_open = _led_off;
 	// sw.s[AXIS_X][SW_MIN].when_closed = _led_on;
+
+	// The banks are rebuilt with the PIO interrupts held off, as a config change can
+	// arrive while the switches are live
+	__set_BASEPRI(SW_ISR_PRIORITY << (8 - __NVIC_PRIO_BITS));
+	sw_bank_A.init();
+	sw_bank_B.init();
+#ifdef PIOC
+	sw_bank_C.init();
+#endif
+#ifdef PIOD
+	sw_bank_D.init();
+#endif
+	__set_BASEPRI(0);
+
+	// Pin change interrupts run just below the DDA so step positions are latched
+	// promptly. Re-enabling on a config change is harmless.
+	const uint32_t interrupts = Motate::kPinInterruptOnChange | Motate::kPinInterruptPriorityHigh;
+	axis_X_min_pin.setInterrupts(interrupts);
+	axis_X_max_pin.setInterrupts(interrupts);
+	axis_Y_min_pin.setInterrupts(interrupts);
+	axis_Y_max_pin.setInterrupts(interrupts);
+	axis_Z_min_pin.setInterrupts(interrupts);
+	axis_Z_max_pin.setInterrupts(interrupts);
+	axis_A_min_pin.setInterrupts(interrupts);
+	axis_A_max_pin.setInterrupts(interrupts);
+	axis_B_min_pin.setInterrupts(interrupts);
+	axis_B_max_pin.setInterrupts(interrupts);
+	axis_C_min_pin.setInterrupts(interrupts);
+	axis_C_max_pin.setInterrupts(interrupts);
 }
 
 /*
- * poll_switches() - run a polling cycle on all switches
+ * Switch interrupts
+ *
+ * PIOx_Handler()		- PIO change interrupts, one bank per port
+ * SysTick interrupt	- resample switches that changed during their lockout
+ *
+ *	The resample raises BASEPRI to hold off the PIO ISRs so the two never update
+ *	a bank at once. The DDA is not held off. With nothing pending the SysTick
+ *	costs one test per bank. SysTick also queues the SPI driver polls (TMC_TICK()).
  */
-stat_t poll_switches()
+extern "C" {
+void PIOA_Handler(void) { PROFILE_START sw_bank_A.isr(); SYNC_PIN_CHANGE('A'); PROFILE_END(PF_SWITCH_ISR)}
+void PIOB_Handler(void) { PROFILE_START sw_bank_B.isr(); SYNC_PIN_CHANGE('B'); PROFILE_END(PF_SWITCH_ISR)}
+#ifdef PIOC
+void PIOC_Handler(void) { PROFILE_START sw_bank_C.isr(); SYNC_PIN_CHANGE('C'); PROFILE_END(PF_SWITCH_ISR)}
+#endif
+#ifdef PIOD
+void PIOD_Handler(void) { PROFILE_START sw_bank_D.isr(); SYNC_PIN_CHANGE('D'); PROFILE_END(PF_SWITCH_ISR)}
+#endif
+}
+
+namespace Motate {			// Must define timer interrupts inside the Motate namespace
+void Timer<SysTickTimerNum>::interrupt()
 {
-	read_switch(&sw.s[AXIS_X][SW_MIN], axis_X_min_pin);
-	read_switch(&sw.s[AXIS_X][SW_MAX], axis_X_max_pin);
-	read_switch(&sw.s[AXIS_Y][SW_MIN], axis_Y_min_pin);
-	read_switch(&sw.s[AXIS_Y][SW_MAX], axis_Y_max_pin);
-	read_switch(&sw.s[AXIS_Z][SW_MIN], axis_Z_min_pin);
-	read_switch(&sw.s[AXIS_Z][SW_MAX], axis_Z_max_pin);
-	read_switch(&sw.s[AXIS_A][SW_MIN], axis_A_min_pin);
-	read_switch(&sw.s[AXIS_A][SW_MAX], axis_A_max_pin);
-	read_switch(&sw.s[AXIS_B][SW_MIN], axis_B_min_pin);
-	read_switch(&sw.s[AXIS_B][SW_MAX], axis_B_max_pin);
-	read_switch(&sw.s[AXIS_C][SW_MIN], axis_C_min_pin);
-	read_switch(&sw.s[AXIS_C][SW_MAX], axis_C_max_pin);
-	return (STAT_OK);
+	TMC_TICK();
+	if ((sw_bank_A.pending | sw_bank_B.pending
+#ifdef PIOC
+		| sw_bank_C.pending
+#endif
+#ifdef PIOD
+		| sw_bank_D.pending
+#endif
+		) == 0) { return;}
+
+	uint32_t now = SysTickTimer.getValue();
+	__set_BASEPRI(SW_ISR_PRIORITY << (8 - __NVIC_PRIO_BITS));
+	sw_bank_A.resample(now);
+	sw_bank_B.resample(now);
+#ifdef PIOC
+	sw_bank_C.resample(now);
+#endif
+#ifdef PIOD
+	sw_bank_D.resample(now);
+#endif
+	__set_BASEPRI(0);
 }
+} // namespace Motate
 
 /*
- * read_switch() - read switch with NO/NC, debouncing and edge detection
+ * _switch_edge() - record and process a debounced change of switch state
  *
- *	Returns true if switch state changed - e.g. leading or falling edge detected
- *	Assumes pin_value input = 1 means open, 0 is closed. Pin sense is adjusted to mean:
- *	  0 = open for both NO and NC switches
- *	  1 = closed for both NO and NC switches
+ *	Called from the banks with the new state - SW_OPEN or SW_CLOSED - and the
+ *	SysTick time the change was seen. Starts the lockout.
  */
-uint8_t read_switch(switch_t *s, uint8_t pin_value)
+static void _switch_edge(switch_t *s, uint8_t state, uint32_t now)
 {
-	// instant return conditions: switch disabled or in a lockout period
-	if (s->mode == SW_MODE_DISABLED) {
-		return (false); 
-	}
-	if (s->debounce_timeout > SysTickTimer.getValue()) {
-		return (false);
-	}
-	// return if no change in state
-	uint8_t pin_sense_corrected = (pin_value ^ (s->type ^ 1));	// correct for NO or NC mode
-  	if ( s->state == pin_sense_corrected) { 
-		s->edge = SW_NO_EDGE;
-		if (s->state == SW_OPEN) { 
-			s->when_open(s);
-		} else {
-			s->when_closed(s);
+	s->edge_tick = now;
+	s->edge_position = mp_get_runtime_absolute_position(s->axis);
+	if ((s->latch_edge != SW_NO_EDGE) &&
+		(s->latch_edge == ((state == SW_OPEN) ? SW_TRAILING : SW_LEADING))) {
+		if (s->latch_inhibit >= 0) {
+			st_set_motor_inhibit(s->latch_inhibit, true);
+		}
+		for (uint8_t motor=0; motor<MOTORS; motor++) {
+			s->latch_steps[motor] = st_get_step_position(motor);
 		}
-		return (false);
+		s->latch_edge = SW_NO_EDGE;
+		s->latched = true;
 	}
-	// the switch legitimately changed state - process edges
-	if ((s->state = pin_sense_corrected) == SW_OPEN) {
+	if ((s->state = state) == SW_OPEN) {
 			s->edge = SW_TRAILING;
 			s->on_trailing(s);
 		} else {
 			s->edge = SW_LEADING;
 			s->on_leading(s);
 	}
-	s->debounce_timeout = (SysTickTimer.getValue() + s->debounce_ticks);
-	return (true);
+	s->debounce_timeout = (now + s->debounce_ticks);
 }
 
 static void _trigger_feedhold(switch_t *s) 
@@ -183,12 +365,70 @@ static void _trigger_cycle_start(switch_t *s)
 }
 
 /*
- * switch_get_switch_mode()  - return switch mode setting
- * switch_get_limit_thrown() - return true if a limit was tripped
- * switch_get_switch_num()   - return switch number most recently thrown
+ * sw_set_stall() - close or open a switch from a motor driver stall report
+ *
+ *	Called from the DMAC interrupt (see tmc2660.h). A stall switch has no pin of its
+ *	own: its edges are processed like pin edges, with the same lockout, latching and
+ *	callbacks, so homing runs on it unchanged. A report that arrives during the
+ *	lockout is dropped - the driver is polled again within the millisecond.
+ */
+void sw_set_stall(uint8_t sw_num, uint8_t state)
+{
+	switch_t *s = &sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS];
+	uint32_t now = SysTickTimer.getValue();
+	uint32_t basepri = __get_BASEPRI();
+
+	__set_BASEPRI(SW_ISR_PRIORITY << (8 - __NVIC_PRIO_BITS));
+	if ((s->mode != SW_MODE_DISABLED) && (s->state != state) && (s->debounce_timeout <= now)) {
+		_switch_edge(s, state, now);
+	}
+	__set_BASEPRI(basepri);
+}
+
+/*
+ * get_switch_mode()  - return switch mode setting
+ * get_switch_state() - return SW_OPEN or SW_CLOSED as of the most recent edge
+ */
+
+uint8_t get_switch_mode(uint8_t sw_num) { return (sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS].mode);}
+uint8_t get_switch_state(uint8_t sw_num) { return (sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS].state);}
+
+/*
+ * sw_arm_latch()          - latch the step positions on the next edge of a switch
+ * sw_set_latch_inhibit()  - also inhibit a motor on the latched edge (call after arming)
+ * sw_get_latch_position() - return the axis position at the latched edge
+ *
+ *	sw_get_latch_position() returns false if the switch has not latched since it
+ *	was armed. The position is in the same absolute coordinates as the runtime and
+ *	is only valid when the runtime is idle, i.e. the runtime position agrees with
+ *	the steps emitted. It is taken from the first motor mapped to the axis.
  */
+void sw_arm_latch(uint8_t sw_num, uint8_t edge)
+{
+	switch_t *s = &sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS];
+	s->latched = false;
+	s->latch_inhibit = -1;
+	s->latch_edge = edge;
+}
+
+void sw_set_latch_inhibit(uint8_t sw_num, int8_t motor)
+{
+	sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS].latch_inhibit = motor;
+}
 
-uint8_t get_switch_mode(uint8_t sw_num) { return (0);}	// ++++
+uint8_t sw_get_latch_position(uint8_t sw_num, float *position)
+{
+	switch_t *s = &sw.s[sw_num/SW_POSITIONS][sw_num%SW_POSITIONS];
+	if (s->latched == false) { return (false);}
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		if (st.m[motor].motor_map != s->axis) { continue;}
+		int32_t steps_since_latch = st_get_step_position(motor) - s->latch_steps[motor];
+		*position = mp_get_runtime_absolute_position(s->axis) - (steps_since_latch / st.m[motor].steps_per_unit);
+		return (true);
+	}
+	return (false);											// no motor drives the axis
+}
 
 /***********************************************************************************
  * CONFIGURATION AND INTERFACE FUNCTIONS
@@ -32,10 +32,24 @@
  *	  - read pin		get raw data from a pin
  *	  - read switch		return processed switch closures
  *
- *	Read pin may be a polled operation or an interrupt on pin change. If interrupts
- *	are used they must be provided for both leading and trailing edge transitions.
+ *	Read pin is driven by the PIO change interrupts, so both leading and trailing
+ *	edges are seen as they happen and the main loop does no switch polling. The
+ *	ISR records the SysTick time and the runtime position of the switch's axis.
+ *	The switches are kept in one bank per PIO port (see swBank in switch.cpp): the
+ *	port is read once, corrected for NO/NC as a mask, and only pins whose state
+ *	differs from the debounced state are visited.
  *
  *	Read switch contains the results of read pin and manages edges and debouncing.
+ *	Changes that arrive during the lockout after an edge are not lost - the switch
+ *	is marked pending and resampled from the SysTick interrupt when lockout ends.
+ *	The when_open and when_closed callbacks only run when a switch is resampled.
+ *
+ *	A switch can be armed to latch the motor step positions on its next leading or
+ *	trailing edge. The capture is made in the edge ISR, so the latched position is
+ *	where the switch actually changed, not where the machine stopped after the
+ *	planner decelerated. Homing and probing latch the homing switch opening.
+ *	The latch can also inhibit a motor at the same instant, which is how gantry
+ *	squaring stops each side of an axis on its own switch.
  */
 #ifndef SWITCH_H_ONCE
 #define SWITCH_H_ONCE
@@ -89,6 +103,8 @@ enum swEdge {
 #define SW_PAIRS AXES				// array sizing
 #define SW_POSITIONS 2				// array sizing
 
+#define SW_ISR_PRIORITY 3			// NVIC priority of the PIO ISRs (kPinInterruptPriorityHigh) - below the DDA
+
 /*
  * Switch control structures
  */
@@ -97,8 +113,15 @@ typedef struct swSwitch {			// one struct per switch
 	uint8_t mode;					// 0=disabled, 1=homing, 2=limit, 3=homing+limit
 	uint8_t state;					// set true if switch is closed
 	uint8_t edge;					// keeps a transient record of edges for immediate inquiry
+	uint8_t axis;					// axis the switch is on
 	uint16_t debounce_ticks;		// number of millisecond ticks for debounce lockout 
 	uint32_t debounce_timeout;		// time to expire current debounce lockout, or 0 if no lockout
+	uint32_t edge_tick;				// SysTick value at the most recent edge
+	float edge_position;			// runtime absolute position of the axis at the most recent edge
+	uint8_t latch_edge;				// swEdge to latch step positions on, or SW_NO_EDGE if not armed
+	uint8_t latched;				// set true once latch_steps holds a capture
+	int8_t latch_inhibit;			// motor to inhibit on the latched edge, or -1
+	int32_t latch_steps[MOTORS];	// motor step positions at the latched edge
 	void (*when_open)(struct swSwitch *s);		// callback to action function when sw is open - passes *s, returns void
 	void (*when_closed)(struct swSwitch *s);	// callback to action function when closed
 	void (*on_leading)(struct swSwitch *s);		// callback to action function for leading edge onset
@@ -116,10 +139,13 @@ extern switches_t sw;
  * Function prototypes
  */
 void switch_init(void);
-uint8_t read_switch(switch_t *s, uint8_t pin_value);
 uint8_t get_switch_mode(uint8_t sw_num);
+uint8_t get_switch_state(uint8_t sw_num);
+void sw_set_stall(uint8_t sw_num, uint8_t state);
 
-stat_t poll_switches(void);
+void sw_arm_latch(uint8_t sw_num, uint8_t edge);
+void sw_set_latch_inhibit(uint8_t sw_num, int8_t motor);
+uint8_t sw_get_latch_position(uint8_t sw_num, float *position);
 
 /*
  * Switch config accessors and text functions
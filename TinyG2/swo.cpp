@@ -0,0 +1,122 @@
+/*
+ * swo.cpp - real-time event trace on the ITM stimulus ports, read out on the SWO pin
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See swo.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "swo.h"
+
+#ifdef __SWO_TRACE
+
+#include "MotateTimers.h"			// brings in the CMSIS core definitions for the ITM
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// not in this version of the CMSIS headers
+#define SWO_ITM_LAR			(*(volatile uint32_t *)0xE0000FB0)	// ITM lock access
+#define SWO_ITM_UNLOCK		0xC5ACCE55
+#define SWO_TPIU_ACPR		(*(volatile uint32_t *)0xE0040010)	// SWO clock prescaler
+#define SWO_TPIU_SPPR		(*(volatile uint32_t *)0xE00400F0)	// pin protocol
+#define SWO_TPIU_FFCR		(*(volatile uint32_t *)0xE0040304)	// formatter and flush control
+#define SWO_TPIU_NRZ		2									// SPPR - asynchronous NRZ (UART)
+#define SWO_TPIU_TRIGIN		0x100								// FFCR - formatter off, trigger in on
+#define SWO_ITM_BUS_ID		1									// trace bus ID of the ITM
+
+swoSingleton_t swo;
+
+static void _set_baud(void);
+
+/*
+ * swo_init() - turn on the ITM and its timestamps, and the ports in $swoe
+ *
+ *	Called once the config is loaded. A probe that sets the ITM up itself when it
+ *	attaches may change the enables - $swoe sets them again.
+ */
+void swo_init()
+{
+	HW_DEMCR |= HW_DEMCR_TRCENA;					// enable the trace blocks
+	SWO_ITM_LAR = SWO_ITM_UNLOCK;
+	_set_baud();
+	ITM->TCR = (SWO_ITM_BUS_ID << ITM_TCR_TraceBusID_Pos) | ITM_TCR_SYNCENA_Msk |
+			   ITM_TCR_TSENA_Msk | ITM_TCR_ITMENA_Msk;	// timestamps in CPU cycles
+	ITM->TPR = 0;									// ports are open to unprivileged code
+	ITM->TER = (uint32_t)swo.ports << 1;			// bit 0 is port 1
+	swo.dropped = 0;
+}
+
+/*
+ * _set_baud() - set the SWO pin to NRZ at $swob, unless the probe sets it up
+ */
+static void _set_baud()
+{
+	if (swo.baud < 1) { return;}
+	SWO_TPIU_SPPR = SWO_TPIU_NRZ;
+	SWO_TPIU_ACPR = (uint32_t)lroundf(F_CPU / swo.baud) - 1;
+	SWO_TPIU_FFCR = SWO_TPIU_TRIGIN;
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * swo_set_swoe() - set the ports to send
+ * swo_set_swob() - set the SWO baud rate
+ */
+stat_t swo_set_swoe(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value >= (1 << (SWO_PORTS-1)))) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	ritorno(set_ui8(cmd));
+	ITM->TER = (uint32_t)swo.ports << 1;
+	return (STAT_OK);
+}
+
+stat_t swo_set_swob(cmdObj_t *cmd)
+{
+	if ((cmd->value < 0) || (cmd->value > F_CPU)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	ritorno(set_flt(cmd));
+	_set_baud();
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_swoe[] PROGMEM = "[swoe] swo trace ports%17d [1=blocks,2=block ends,4=segments,8,16=interrupts,32=dda,64=holds,128=replans]\n";
+static const char fmt_swob[] PROGMEM = "[swob] swo baud rate%19.0f [0=set by the probe]\n";
+
+void swo_print_swoe(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_swoe);}
+void swo_print_swob(cmdObj_t *cmd) { text_print_flt(cmd, fmt_swob);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SWO_TRACE
@@ -0,0 +1,144 @@
+/*
+ * swo.h - real-time event trace on the ITM stimulus ports, read out on the SWO pin
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The SWO trace is enabled by __SWO_TRACE in tinyg2.h. Events are written to the
+ * Cortex-M3 ITM, which sends them out of the TRACESWO pin (TDO on the JTAG header)
+ * to a debug probe - the J-Link's SWO viewer, or any probe that decodes ITM. Nothing
+ * goes through USB, so a production job can be watched live without changing its
+ * timing. An event is one store to a stimulus port, and an event that is off costs
+ * one load and test of the ITM's enable register.
+ *
+ * Each kind of event has its own stimulus port, so the probe tells them apart by port
+ * and each payload is just the value. The ITM adds a timestamp in CPU cycles to the
+ * events, so the probe has the time of each one.
+ *
+ *	port  payload		event
+ *	 1	  32 bit		block started by the runtime - its line number
+ *	 2	  32 bit		block finished by the runtime - its line number
+ *	 3	  32 bit		line segment loaded into the steppers - its FREQUENCY_DDA ticks
+ *	 4	   8 bit		interrupt entered - swoIsr, the exec, load and dwell interrupts
+ *	 5	   8 bit		interrupt exited - swoIsr
+ *	 6	   8 bit		DDA interrupt entered (1) and exited (0)
+ *	 7	   8 bit		feedhold state changed - the new cm.hold_state
+ *	 8	  16 bit		planner pass - trapezoids recomputed by _plan_block_list()
+ *
+ *	$swoe	ports to send, bit 0 is port 1 - written to the ITM's enable register
+ *	$swob	SWO baud rate. 0 leaves the SWO pin to the probe, which most set up
+ *			themselves. Otherwise it must be a divisor of F_CPU and agree with the probe
+ *	{"swod":""}	events dropped because the ITM was still sending the last one
+ *
+ * The DDA interrupt runs at up to FREQUENCY_DDA, which is more events than the SWO
+ * pin can carry at any baud rate - port 6 is for short captures. An event is dropped
+ * rather than waited on, so tracing never stalls the interrupts. The drop count is
+ * written from every interrupt level and may miss a drop that races another.
+ */
+
+#ifndef SWO_H_ONCE
+#define SWO_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __SWO_TRACE
+
+#define SWO_ITM_PORT(n)			(*(volatile uint32_t *)(0xE0000000 + 4*(n)))	// reads 1 when the port can take a write
+#define SWO_ITM_TER				(*(volatile uint32_t *)0xE0000E00)			// stimulus port enables
+
+enum swoPort {							// stimulus ports - see the table above
+	SWO_PORT_BLOCK_START = 1,
+	SWO_PORT_BLOCK_END,
+	SWO_PORT_SEGMENT,
+	SWO_PORT_ISR_ENTER,
+	SWO_PORT_ISR_EXIT,
+	SWO_PORT_DDA,
+	SWO_PORT_HOLD,
+	SWO_PORT_REPLAN,
+	SWO_PORTS							// must be last
+};
+
+enum swoIsr {							// interrupts reported on ports 4 and 5
+	SWO_ISR_EXEC = 0,
+	SWO_ISR_LOAD,
+	SWO_ISR_DWELL
+};
+
+typedef struct swoSingleton {
+	uint8_t ports;						// swoe - port enable bits, bit 0 is port 1
+	float baud;							// swob - SWO baud rate, 0 = set by the probe
+	uint32_t dropped;					// swod - events the ITM was not ready for
+} swoSingleton_t;
+
+extern swoSingleton_t swo;
+
+void swo_init(void);
+
+stat_t swo_set_swoe(cmdObj_t *cmd);
+stat_t swo_set_swob(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void swo_print_swoe(cmdObj_t *cmd);
+	void swo_print_swob(cmdObj_t *cmd);
+#else
+	#define swo_print_swoe tx_print_stub
+	#define swo_print_swob tx_print_stub
+#endif
+
+/*
+ * swo_write32(), swo_write16(), swo_write8() - write an event if its port is on and the ITM can take it
+ *
+ *	The store is the size of the payload, which sets the size of the packet sent.
+ */
+#define _SWO_WRITE(port, type, value) \
+	if ((SWO_ITM_TER & (1UL << (port))) != 0) { \
+		if (SWO_ITM_PORT(port) != 0) { *(volatile type *)&SWO_ITM_PORT(port) = (type)(value);} \
+		else { swo.dropped++;} \
+	}
+
+static inline void swo_write32(const uint8_t port, const uint32_t value) { _SWO_WRITE(port, uint32_t, value)}
+static inline void swo_write16(const uint8_t port, const uint16_t value) { _SWO_WRITE(port, uint16_t, value)}
+static inline void swo_write8(const uint8_t port, const uint8_t value) { _SWO_WRITE(port, uint8_t, value)}
+
+#define SWO_BLOCK_START(linenum) swo_write32(SWO_PORT_BLOCK_START, linenum)
+#define SWO_BLOCK_END(linenum) swo_write32(SWO_PORT_BLOCK_END, linenum)
+#define SWO_SEGMENT(ticks) swo_write32(SWO_PORT_SEGMENT, ticks)
+#define SWO_ISR_ENTER(isr) swo_write8(SWO_PORT_ISR_ENTER, isr)
+#define SWO_ISR_EXIT(isr) swo_write8(SWO_PORT_ISR_EXIT, isr)
+#define SWO_DDA(on) swo_write8(SWO_PORT_DDA, on)
+#define SWO_HOLD_STATE() swo_write8(SWO_PORT_HOLD, cm.hold_state)
+#define SWO_REPLAN(count) swo_write16(SWO_PORT_REPLAN, count)
+
+#else
+
+#define SWO_BLOCK_START(linenum)
+#define SWO_BLOCK_END(linenum)
+#define SWO_SEGMENT(ticks)
+#define SWO_ISR_ENTER(isr)
+#define SWO_ISR_EXIT(isr)
+#define SWO_DDA(on)
+#define SWO_HOLD_STATE()
+#define SWO_REPLAN(count) (void)(count)		// the count is not used
+
+#endif // __SWO_TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: SWO_H_ONCE
@@ -0,0 +1,148 @@
+/*
+ * sync.cpp - segment synchronization of several boards over the kinen_sync line
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See sync.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "text_parser.h"
+#include "stepper.h"
+#include "hardware.h"
+#include "sync.h"
+
+#ifdef __SEGMENT_SYNC
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#define SYNC_SLAVE_TRIM		1		// DDA timer counts a slave runs fast by - 1 of ~420 at 100 KHz
+
+sySingleton_t sy;
+
+/*
+ * sy_reset() - start the count over
+ *
+ *	Called from mp_flush_planner() and when $sym is set. A slave drops the edges it
+ *	has counted ahead of its loads, and takes the present level of the line as its
+ *	reference, so the next edge starts the next segment.
+ */
+void sy_reset()
+{
+	sy.level = kinen_sync_pin.getInputValue();
+	sy.loads = sy.edges;
+	sy.held = false;
+}
+
+/*
+ * sy_load_segment() - synchronize a line segment as it loads
+ *
+ *	Called from _load_move() (see SYNC_LOAD()). The master marks the start of the
+ *	segment with an edge. A slave returns TRUE to hold the segment until an edge it
+ *	has not used yet - the pin ISR requests the load again when one comes.
+ */
+uint8_t sy_load_segment()
+{
+	if (sy.mode == SYNC_MASTER) {
+		kinen_sync_pin.toggle();
+		return (false);
+	}
+	if ((int32_t)(sy.edges - sy.loads) <= 0) {
+		if (sy.held == false) {				// count each segment held once, not each retry
+			sy.held = true;
+			sy.waits++;
+		}
+		return (true);
+	}
+	sy.loads++;
+	sy.held = false;
+	return (false);
+}
+
+/*
+ * sy_pin_change() - count an edge of the sync line (slave)
+ *
+ *	Called from the PIO handler for the port (see SYNC_PIN_CHANGE()) after the
+ *	switch bank has cleared its flags, so the level is tested to tell a sync edge
+ *	from a switch on the same port.
+ */
+void sy_pin_change()
+{
+	uint8_t level = kinen_sync_pin.getInputValue();
+	if (level == sy.level) { return;}
+	sy.level = level;
+	sy.edges++;
+	st_request_load_move();					// a held segment can load now
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * sy_set_sym() - set the sync mode and the sync pin to suit
+ *
+ *	A master drives the line, a slave (or a board that is off) listens to it, so
+ *	two boards left as masters by mistake don't drive each other. A slave runs its
+ *	DDA SYNC_SLAVE_TRIM counts fast so its segments end ahead of the master's.
+ */
+stat_t sy_set_sym(cmdObj_t *cmd)
+{
+	if ((cmd->value < SYNC_OFF) || (cmd->value > SYNC_SLAVE)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	sy.mode = SYNC_OFF;							// no loads synchronized while changing the pin
+	if ((uint8_t)cmd->value == SYNC_MASTER) {
+		kinen_sync_pin.setInterrupts(Motate::kPinInterruptsOff);
+		kinen_sync_pin.setMode(Motate::kOutput);
+		st_trim_dda_clock(0);
+	} else {
+		kinen_sync_pin.setMode(Motate::kInput);
+		if ((uint8_t)cmd->value == SYNC_SLAVE) {
+			kinen_sync_pin.setInterrupts(Motate::kPinInterruptOnChange | Motate::kPinInterruptPriorityHigh);
+			st_trim_dda_clock(SYNC_SLAVE_TRIM);
+		} else {
+			kinen_sync_pin.setInterrupts(Motate::kPinInterruptsOff);
+			st_trim_dda_clock(0);
+		}
+	}
+	sy_reset();
+	sy.waits = 0;
+	sy.mode = (uint8_t)cmd->value;
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_sym[] PROGMEM = "[sym] segment sync mode%16d [0=off,1=master,2=slave]\n";
+static const char fmt_syw[] PROGMEM = "Sync waits:%14.0f\n";
+
+void sy_print_sym(cmdObj_t *cmd) { text_print_ui8(cmd, fmt_sym);}
+void sy_print_syw(cmdObj_t *cmd) { text_print_flt(cmd, fmt_syw);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SEGMENT_SYNC
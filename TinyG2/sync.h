@@ -0,0 +1,103 @@
+/*
+ * sync.h - segment synchronization of several boards over the kinen_sync line
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * Segment synchronization is enabled by __SEGMENT_SYNC in tinyg2.h. It runs the axes
+ * of several boards as one machine - more than 6 motors, or a gantry split across
+ * boards - by starting their segments together. The kinen_sync pins of the boards
+ * are wired together (with a common ground) and one board is set as the master:
+ *
+ *	$sym=1		master - drives the sync line
+ *	$sym=2		slave - follows the sync line
+ *
+ * The master toggles the line as it loads each line segment. A slave holds each of
+ * its line segments in the loader until it sees an edge, so its segments start
+ * within an interrupt latency of the master's and the boards can't drift apart over
+ * a job, whatever their crystals - a slave runs its DDA a fraction of a percent fast
+ * so it ends each segment just ahead of the master and waits. Each edge lets one
+ * segment load. Edges that come before a slave has its segment prepared are counted,
+ * so it never loses its place, but it runs that much behind until the next stop -
+ * send each block to the slaves before the master. $syw reports the segments a
+ * slave has held for an edge. Dwells and M codes are not synchronized.
+ *
+ * The segments are not sent over the line. Every board is sent the same Gcode (by
+ * the host, over its own USB port) and plans it the same way, so the boards prepare
+ * the same sequence of segments - each runs only the motors it has mapped. The
+ * boards must have the same axis, planner and shaper settings for this to hold. A
+ * feedhold, flush or alarm must be sent to all of them. Flushing the planner or
+ * setting $sym starts the count over, so the boards are aligned at a stop.
+ */
+
+#ifndef SYNC_H_ONCE
+#define SYNC_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+enum syMode {							// $sym
+	SYNC_OFF = 0,						// run on its own
+	SYNC_MASTER,						// toggle the sync line at each line segment
+	SYNC_SLAVE							// start each line segment on a sync edge
+};
+
+#ifdef __SEGMENT_SYNC
+
+typedef struct sySingleton {
+	uint8_t mode;						// $sym - see syMode
+	uint8_t level;						// last level seen on the sync line (slave)
+	uint8_t held;						// TRUE while the loader holds a segment for an edge
+	volatile uint32_t edges;			// sync edges seen (written by the pin ISR only)
+	volatile uint32_t loads;			// line segments started (written by the loader only)
+	uint32_t waits;						// $syw - loads held for an edge (slave)
+} sySingleton_t;
+
+extern sySingleton_t sy;
+
+void sy_reset(void);
+uint8_t sy_load_segment(void) HOT_PATH;
+void sy_pin_change(void) HOT_PATH;
+
+stat_t sy_set_sym(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void sy_print_sym(cmdObj_t *cmd);
+	void sy_print_syw(cmdObj_t *cmd);
+#else
+	#define sy_print_sym tx_print_stub
+	#define sy_print_syw tx_print_stub
+#endif
+
+// SYNC_LOAD() is TRUE if the loader must hold the segment. One test when off.
+// SYNC_PIN_CHANGE() is called from the PIO handlers - the port test is compiled out.
+#define SYNC_LOAD() ((sy.mode != SYNC_OFF) && (sy_load_segment() == true))
+#define SYNC_PIN_CHANGE(letter) \
+	if ((Motate::Pin<kinen_sync_pin_num>::portLetter == (letter)) && (sy.mode == SYNC_SLAVE)) { sy_pin_change();}
+
+#else
+
+#define SYNC_LOAD() (false)
+#define SYNC_PIN_CHANGE(letter)
+
+#endif // __SEGMENT_SYNC
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: SYNC_H_ONCE
@@ -32,6 +32,7 @@
 #include "text_parser.h"
 #include "json_parser.h"
 #include "report.h"
+#include "util.h"
 #include "xio.h"					// for ASCII char definitions
 
 #ifdef __cplusplus
@@ -79,6 +80,7 @@ stat_t text_parser(char_t *str)
 	// parse and execute the command (only processes 1 command per line)
 	ritorno(_text_parser_kernal(str, cmd));	// run the parser to decode the command
 	if ((cmd->objtype == TYPE_NULL) || (cmd->objtype == TYPE_PARENT)) {
+		cmd_text_list_start(cmd->index);	// a listing may be continued - see get_grp()
 		if (cmd_get(cmd) == STAT_COMPLETE) {// populate value, group values, or run uber-group displays
 			return (STAT_OK);				// return for uber-group displays so they don't print twice
 		}
@@ -114,9 +116,9 @@ static stat_t _text_parser_kernal(char_t *str, cmdObj_t *cmd)
 		*rd = NUL;							// terminate at end of name
 		strncpy(cmd->token, str, CMD_TOKEN_LEN);
 		str = ++rd;
-		cmd->value = strtof(str, &rd);		// rd used as end pointer
-		if (rd != str) {
-			cmd->objtype = TYPE_FLOAT;
+		uint8_t type = read_number(str, &rd, &cmd->value);	// rd used as end pointer
+		if (type != NUMBER_NONE) {
+			cmd->objtype = (type == NUMBER_INTEGER) ? TYPE_INTEGER : TYPE_FLOAT;
 		}
 	}
 
@@ -149,6 +151,7 @@ void text_response(const stat_t status, char_t *buf)
 	char units[] = "inch";
 	if (cm_get_units_mode(MODEL) != INCHES) { strcpy(units, "mm"); }
 
+	xio_tx_hold();									// send the prompt in one piece
 	if ((status == STAT_OK) || (status == STAT_EAGAIN) || (status == STAT_NOOP)) {
 		fprintf_P(stderr, prompt_ok, units);
 	} else {
@@ -160,6 +163,7 @@ void text_response(const stat_t status, char_t *buf)
 		fprintf(stderr, (char *)*cmd->stringp);
 	}
 	fprintf(stderr, "\n");
+	xio_tx_release();
 }
 
 /***** PRINT FUNCTIONS ********************************************************
@@ -167,44 +171,51 @@ void text_response(const stat_t status, char_t *buf)
  * text_print_inline_pairs()
  * text_print_inline_values()
  * text_print_multiline_formatted()
+ *
+ *	The list is printed a field at a time and the TX output is held until it is all
+ *	printed, so it goes to the host in full USB transfers - see xio_tx_hold().
  */
 
 void text_print_list(stat_t status, uint8_t flags)
 {
+	xio_tx_hold();
 	switch (flags) {
 		case TEXT_NO_PRINT: { break; } 
 		case TEXT_INLINE_PAIRS: { text_print_inline_pairs(cmd_body); break; }
 		case TEXT_INLINE_VALUES: { text_print_inline_values(cmd_body); break; }
 		case TEXT_MULTILINE_FORMATTED: { text_print_multiline_formatted(cmd_body);}
 	}
+	xio_tx_release();
 }
 
 void text_print_inline_pairs(cmdObj_t *cmd)
 {
+	char_t num[48];							// fntoa() output - big enough for FLT_MAX at 3 places
 	for (uint8_t i=0; i<CMD_BODY_LEN-1; i++) {
 		switch (cmd->objtype) {
-			case TYPE_PARENT: 	{ if ((cmd = cmd->nx) == NULL) return; continue;} // NULL means parent with no child
-			case TYPE_FLOAT:	{ fprintf_P(stderr,PSTR("%s:%1.3f"), cmd->token, cmd->value); break;}
-			case TYPE_INTEGER:	{ fprintf_P(stderr,PSTR("%s:%1.0f"), cmd->token, cmd->value); break;}
+			case TYPE_PARENT: 	{ if ((cmd = cmd_next(cmd)) == NULL) return; continue;} // NULL means parent with no child
+			case TYPE_FLOAT:	{ fntoa(num, cmd->value, 3); fprintf_P(stderr,PSTR("%s:%s"), cmd->token, num); break;}
+			case TYPE_INTEGER:	{ fntoa(num, cmd->value, 0); fprintf_P(stderr,PSTR("%s:%s"), cmd->token, num); break;}
 			case TYPE_STRING:	{ fprintf_P(stderr,PSTR("%s:%s"), cmd->token, *cmd->stringp); break;}
 			case TYPE_EMPTY:	{ fprintf_P(stderr,PSTR("\n")); return; }
 		}
-		if ((cmd = cmd->nx) == NULL) return;
+		if ((cmd = cmd_next(cmd)) == NULL) return;
 		if (cmd->objtype != TYPE_EMPTY) { fprintf_P(stderr,PSTR(","));}
 	}
 }
 
 void text_print_inline_values(cmdObj_t *cmd)
 {
+	char_t num[48];
 	for (uint8_t i=0; i<CMD_BODY_LEN-1; i++) {
 		switch (cmd->objtype) {
-			case TYPE_PARENT: 	{ if ((cmd = cmd->nx) == NULL) return; continue;} // NULL means parent with no child
-			case TYPE_FLOAT:	{ fprintf_P(stderr,PSTR("%1.3f"), cmd->value); break;}
-			case TYPE_INTEGER:	{ fprintf_P(stderr,PSTR("%1.0f"), cmd->value); break;}
+			case TYPE_PARENT: 	{ if ((cmd = cmd_next(cmd)) == NULL) return; continue;} // NULL means parent with no child
+			case TYPE_FLOAT:	{ fntoa(num, cmd->value, 3); fprintf_P(stderr,PSTR("%s"), num); break;}
+			case TYPE_INTEGER:	{ fntoa(num, cmd->value, 0); fprintf_P(stderr,PSTR("%s"), num); break;}
 			case TYPE_STRING:	{ fprintf_P(stderr,PSTR("%s"), *cmd->stringp); break;}
 			case TYPE_EMPTY:	{ fprintf_P(stderr,PSTR("\n")); return; }
 		}
-		if ((cmd = cmd->nx) == NULL) return;
+		if ((cmd = cmd_next(cmd)) == NULL) return;
 		if (cmd->objtype != TYPE_EMPTY) { fprintf_P(stderr,PSTR(","));}
 	}
 }
@@ -213,7 +224,7 @@ void text_print_multiline_formatted(cmdObj_t *cmd)
 {
 	for (uint8_t i=0; i<CMD_BODY_LEN-1; i++) {
 		if (cmd->objtype != TYPE_PARENT) { cmd_print(cmd);}
-		if ((cmd = cmd->nx) == NULL) return;
+		if ((cmd = cmd_next(cmd)) == NULL) return;
 		if (cmd->objtype == TYPE_EMPTY) break;
 	}
 }
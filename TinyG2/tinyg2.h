@@ -46,6 +46,39 @@
 #define __TEXT_MODE							// comment out to disable text mode support (saves ~9Kb)
 #define __HELP_SCREENS						// comment out to disable help screens 		(saves ~3.5Kb)
 #define __CANNED_TESTS 						// comment out to remove canned tests 		(saves ~12Kb)
+#define __PLANNER_FAST_MATH					// comment out to use libm roots in the planner (see fast_math.h)
+#define __PLANNER_ARC_MOVES					// comment out to explode arcs into lines (see plan_arc.cpp)
+#define __GCODE_MACROS						// comment out to remove O-word subroutines, loops and #parameters (see gcode_macro.h)
+#define __COORD_TRANSFORM					// comment out to remove G68/G69 rotation and G51/G50 scaling (see cmTransform_t)
+#define __RASTER							// comment out to remove raster engraving {"rst":...} (see raster.h)
+#define __INPUT_SHAPING						// comment out to remove the ZV/ZVD/EI axis shapers $xif, $xiz, $ist (see shaper.h)
+#define __PSO								// comment out to remove position synchronized outputs {"pso":...} (see pso.h)
+#define __LINE_FRAMING						// comment out to remove sequence numbered lines for windowed streaming {"lfm":1} (see frame.h)
+//#define __DUAL_USB_CDC					// second USB serial port for status and queue reports, signals and commands (see xio.cpp)
+//#define __BINARY_STREAM					// USB vendor bulk interface for binary motion frames (see binary_stream.h)
+//#define __UART_DEVICES					// USART ports for an RS-485 pendant and a PLC link, read and written by the PDC, $u1m (see uart.h)
+//#define __PROGRAM_STORE					// Gcode program stored in flash and run from memory (see program_store.h)
+//#define __CHECKPOINT						// job checkpoints in flash for a resume after a power loss, {"ckl":""} (see checkpoint.h)
+//#define __SEGMENT_REPLAY					// record the stored program's segments to flash and replay them, $rpm (see replay.h)
+//#define __MACHINE_PROFILES				// stored axis and motor settings switched with one command, {"mfl":n} (see machine_profile.h)
+//#define __CONFIG_BACKUP					// export and import all persisted settings as one checksummed blob, {"cfx":""} (see config_backup.h)
+#define __HOT_PATH_IN_RAM					// run the stepper ISRs and the exec chain from SRAM (see HOT_PATH, below)
+#define __IDLE_SLEEP						// comment out to keep the main loop spinning when idle (see controller.cpp)
+#define __MOTION_YIELD						// comment out to stop motion tasks running while output waits on the host (see controller_yield())
+//#define __TMC2660							// SPI motor drivers - current, microsteps, stall homing and load (see tmc2660.h)
+//#define __ENCODERS						// quadrature encoders - following error and position correction (see encoder.h)
+//#define __ANALOG_INPUTS					// ADC inputs sampled by the PDC and filtered, $an1..$an4 (see adc.h)
+//#define __AUX_MOTION						// asynchronous A, B, C axes run from their own queue, $xas (see plan_aux.cpp)
+//#define __PRESSURE_ADVANCE				// extruder pressure advance for printers, $pea, $pek (see _pa_kinematics())
+//#define __SEGMENT_SYNC					// start the segments of several boards together on kinen_sync ($sym, see sync.h)
+//#define __SPINDLE_SYNC					// G33 threading and G84 rigid tapping from a spindle encoder, $sse, $ssc (see plan_thread.cpp)
+//#define __SPINDLE_CSS					// G96/G97 constant surface speed for lathes - the spindle follows X every segment (see spindle.h)
+//#define __MICROSTEP_MORPHING			// coarser microsteps above $msr steps/sec, $1mo (see Microstep morphing in stepper.h)
+//#define __STEP_QUEUE						// host step schedules run without the planner, {"sq":...} (see stepq.h)
+
+#ifndef __ENCODERS
+#undef __SPINDLE_SYNC						// the spindle encoder is read by a quadrature decoder
+#endif
 
 /****** DEVELOPMENT SETTINGS ******/
 
@@ -54,6 +87,15 @@
 //#define __SUPPRESS_STARTUP_MESSAGES 		// what it says
 //#define __ENABLE_PROBING					// comment out to take out experimental probing code
 //#define __UNIT_TESTS						// master enable for unit tests; USAGE: uncomment test in .h file
+//#define __PLANNER_BENCHMARK				// run the planner benchmark at startup (see benchmark.h)
+//#define __PROFILER						// time controller tasks and stepper ISRs, read with {"pf":""} (see profiler.h)
+//#define __LATENCY_TEST					// timestamped {"ping":n} and USB throughput tests {"tpi":n}, {"tpo":n} (see latency.h)
+//#define __MOTION_TRACE					// record prepared segments, download with {"mtd":""} (see trace.h)
+//#define __STEP_CAPTURE					// measure step pulse jitter on a looped back step pin, {"scj":""} (see stepcap.h)
+//#define __STRESS_TEST					// drive every motor at $sxr steps/sec and measure ISR headroom, {"sxt":n} (see stress.h)
+//#define __SELF_BENCHMARK				// time the planner, parser and reports on the board, {"bench":n} (see selfbench.h)
+//#define __SWO_TRACE						// block, segment, interrupt and hold events on the ITM for a probe on SWO, $swoe (see swo.h)
+//#define __MEMORY_GUARD					// MPU guard regions after the core structures and under the stack (see memguard.h)
 
 //#ifndef WEAK
 //#define WEAK  __attribute__ ((weak))
@@ -119,10 +161,33 @@ typedef uint8_t char_t;			// In the ARM/GCC++ version char_t is typedef'd to uin
 #define GET_TEXT_ITEM(b,a) b[a]						// get text from an array of strings in flash
 #define GET_UNITS(a) msg_units[cm_get_units_mode(a)]
 
+/* Hot path placement
+ *
+ * Flash runs with wait states at 84 MHz, so code fetched from it stalls on every 
+ * branch the prefetch buffer misses. HOT_PATH puts a function in .ramfunc.hot,
+ * which gcc_flash.ld places at the start of SRAM0 and the startup code copies from
+ * flash with the initialised data. Used for the DDA, load and exec interrupts and 
+ * the functions they call on every segment; their data (st_run, st_prep, mr) is 
+ * already in SRAM. Calls between flash and SRAM need -mlong-calls, which the 
+ * Makefile sets for everything. "make hot_size" lists the functions and their size.
+ */
+#ifdef __HOT_PATH_IN_RAM
+#define HOT_PATH __attribute__ ((long_call, section (".ramfunc.hot")))
+#else
+#define HOT_PATH
+#endif
+#define HOT_TIMER_INTERRUPT(number) template<> HOT_PATH void Timer<number>::interrupt()	// MOTATE_TIMER_INTERRUPT() in SRAM
+
 // IO settings
 #define DEV_STDIN 0				// STDIO defaults - stdio is not yet used in the ARM version
 #define DEV_STDOUT 0
 #define DEV_STDERR 0
+#define DEV_PGM 1				// program store input - see program_store.h
+#define DEV_MACRO 2				// macro body input - see gcode_macro.h
+#define DEV_UART1 3				// USART port inputs - see uart.h
+#define DEV_UART2 4
+#define DEV_USB1 5				// second USB port input - see xio.cpp (__DUAL_USB_CDC)
+#define DEV_INTERNAL(src) (((src) == DEV_PGM) || ((src) == DEV_MACRO))	// read from memory, not from a host
 
 /* String compatibility
  *
@@ -164,15 +229,28 @@ typedef uint8_t char_t;			// In the ARM/GCC++ version char_t is typedef'd to uin
 typedef uint16_t magic_t;		// magic number size
 #define MAGICNUM 0x12EF			// used for memory integrity assertions
 
+// A MEMORY_GUARD is the last member of a guarded structure - see memguard.h.
+// Clear a guarded structure with MG_SIZEOF(), which stops short of the guard.
+#ifdef __MEMORY_GUARD
+#define MG_GUARD_SIZE 32		// smallest MPU region
+typedef struct mgGuard { uint8_t fence[MG_GUARD_SIZE];} __attribute__((aligned(MG_GUARD_SIZE))) mgGuard_t;
+#define MEMORY_GUARD mgGuard_t guard;
+#define MG_SIZEOF(s) __builtin_offsetof(__typeof__(s), guard)
+#else
+#define MEMORY_GUARD
+#define MG_SIZEOF(s) sizeof(s)
+#endif
+
 /***** Axes, motors & PWM channels used by the application *****/
 // Axes, motors & PWM channels must be defines (not enums) so #ifdef <value> can be used
 
 #define AXES	6				// number of axes supported in this version
 #define MOTORS	6				// number of motors on the board
 #define COORDS	6				// number of supported coordinate systems (1-6)
+#define TOOLS	8				// number of tool table entries for G43 H (1-8)
 #define PWMS	2				// number of supported PWM channels
 
-// Note: If you change COORDS you must adjust the entries in cfgArray table in config.c
+// Note: If you change COORDS or TOOLS you must adjust the entries in cfgArray table in config.c
 
 #define AXIS_X	0
 #define AXIS_Y	1
@@ -249,7 +327,7 @@ char *get_status_message(stat_t status);
 #define	STAT_ALARMED 27
 //#define	STAT_MEMORY_FAULT 28
 #define	STAT_ERROR_28 28
-#define	STAT_ERROR_29 29
+#define	STAT_CHECKSUM_MATCH_FAILED 29
 #define	STAT_ERROR_30 30
 #define	STAT_ERROR_31 31
 #define	STAT_ERROR_32 32
@@ -298,7 +376,7 @@ char *get_status_message(stat_t status);
 #define	STAT_SOFT_LIMIT_EXCEEDED 71			// soft limit error
 #define	STAT_COMMAND_NOT_ACCEPTED 72		// command cannot be accepted at this time
 #define	STAT_PROBING_CYCLE_FAILED 73		// probing cycle did not complete
-#define	STAT_ERROR_74 74
+#define	STAT_PLANNED_MOVE_UNDERRUN 74		// a host planned move ended at speed with no move queued after it
 #define	STAT_ERROR_75 75
 #define	STAT_ERROR_76 76
 #define	STAT_ERROR_77 77
@@ -0,0 +1,258 @@
+/*
+ * tmc2660.cpp - SPI configured motor drivers with stall detection
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See tmc2660.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "settings.h"
+#include "text_parser.h"
+#include "stepper.h"
+#include "switch.h"
+#include "tmc2660.h"
+#include "spi.h"
+
+#ifdef __TMC2660
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+tmcSingleton_t tmc;
+
+static int8_t _get_motor(const index_t index);
+static void _set_sgcsconf(uint8_t motor, uint8_t current_scale);
+static stat_t _queue_write(uint8_t motor, uint32_t datagram);
+static void _write_done(spiXfer_t *x);
+
+/*
+ * tmc_init() - build the register images from the config and start the SPI
+ *
+ *	All registers are marked for writing, so the drivers are set up by the first
+ *	passes of tmc_callback(). DRVCONF goes first as it selects the status readout.
+ */
+void tmc_init(void)
+{
+	spi_init();
+	tmc.poll_motor = 0;
+	tmc.poll_tick = 0;
+
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		tmcMotor_t *m = &tmc.m[motor];
+		m->reg[TMC_DRVCONF] = TMC_REG_DRVCONF | (TMC_DRIVER_CONFIG & ~TMC_DRVCONF_RDSEL_MASK) | TMC_DRVCONF_RDSEL_SG;
+		m->reg[TMC_CHOPCONF] = TMC_REG_CHOPCONF | TMC_CHOPPER_CONFIG;
+		m->reg[TMC_SMARTEN] = TMC_REG_SMARTEN | TMC_SMART_ENERGY;
+		m->reg[TMC_SGCSCONF] = TMC_REG_SGCSCONF;
+		m->load = 0;
+		m->flags = 0;
+		tmc_set_microsteps(motor, st.m[motor].microsteps);
+		tmc_set_current(motor, st.m[motor].power_level);
+		m->dirty = (1 << TMC_REGISTERS) - 1;
+	}
+	tmc.ready = true;
+}
+
+/*
+ * tmc_callback() - queue the register writes left by the setters
+ *
+ *	Runs from the controller. Leaves a few slots free in the SPI ring for the polls
+ *	made from SysTick, and carries on next pass if the ring fills.
+ */
+stat_t tmc_callback(void)
+{
+	for (uint8_t motor=0; motor<MOTORS; motor++) {
+		tmcMotor_t *m = &tmc.m[motor];
+		for (uint8_t r=0; (m->dirty != 0) && (r<TMC_REGISTERS); r++) {
+			if ((m->dirty & (1 << r)) == 0) { continue;}
+			if (spi_queue_space() <= MOTORS) { return (STAT_OK);}
+			if (_queue_write(motor, m->reg[r]) == STAT_OK) { m->dirty &= ~(1 << r);}
+		}
+	}
+	return (STAT_NOOP);
+}
+
+/*
+ * tmc_tick() - queue the status polls - called from the SysTick interrupt
+ *
+ *	A poll rewrites DRVCONF, which changes nothing in the driver and returns its
+ *	status like any other datagram.
+ */
+void tmc_tick(void)
+{
+	if (tmc.ready == false) { return;}			// SysTick runs before tmc_init()
+	if (tmc.stall_watch != 0) {
+		for (uint8_t motor=0; motor<MOTORS; motor++) {
+			if (tmc.stall_watch & (1 << motor)) { _queue_write(motor, tmc.m[motor].reg[TMC_DRVCONF]);}
+		}
+	}
+	if (++tmc.poll_tick < TMC_POLL_MS) { return;}
+	tmc.poll_tick = 0;
+	_queue_write(tmc.poll_motor, tmc.m[tmc.poll_motor].reg[TMC_DRVCONF]);
+	if (++tmc.poll_motor >= MOTORS) { tmc.poll_motor = 0;}
+}
+
+/*
+ * tmc_set_microsteps() - set DRVCTRL microstep resolution - called from _set_hw_microsteps()
+ *
+ *	MRES counts down from 256 microsteps (0) to full steps (8). Values that are not a
+ *	power of 2 take the next coarser resolution.
+ */
+void tmc_set_microsteps(uint8_t motor, uint8_t microsteps)
+{
+	uint8_t mres = 8;
+	while ((mres > 0) && ((1 << (9 - mres)) <= microsteps)) { mres--;}
+
+	uint32_t reg = TMC_REG_DRVCTRL | TMC_DRVCTRL_INTPOL | mres;
+	if (reg != tmc.m[motor].reg[TMC_DRVCTRL]) {
+		tmc.m[motor].reg[TMC_DRVCTRL] = reg;
+		tmc.m[motor].dirty |= (1 << TMC_DRVCTRL);
+	}
+}
+
+/*
+ * tmc_set_current() - set the SGCSCONF current scale - called from st_set_motor_power()
+ *
+ *	level is the fraction of full driver current [0..1]. The driver current is
+ *	(CS+1)/32 of full scale, so a level of 0 still leaves 1/32 of the current.
+ */
+void tmc_set_current(uint8_t motor, float level)
+{
+	if (level < 0) { level = 0;}
+	if (level > 1) { level = 1;}
+	_set_sgcsconf(motor, (uint8_t)(level * 31 + 0.5));
+}
+
+static void _set_sgcsconf(uint8_t motor, uint8_t current_scale)
+{
+	tmcMotor_t *m = &tmc.m[motor];
+	uint32_t reg = TMC_REG_SGCSCONF | TMC_SGCSCONF_SFILT |
+				   (((uint32_t)(int8_t)m->stall_threshold & 0x7F) << 8) | (current_scale & 0x1F);
+	if (reg != m->reg[TMC_SGCSCONF]) {
+		m->reg[TMC_SGCSCONF] = reg;
+		m->dirty |= (1 << TMC_SGCSCONF);
+	}
+}
+
+/*
+ * _queue_write() - queue a 20 bit datagram to a motor's driver
+ *
+ *	The datagram is sent as 3 bytes - the driver keeps the last 20 bits - and the
+ *	20 bit response is the first 20 bits that come back.
+ */
+static stat_t _queue_write(uint8_t motor, uint32_t datagram)
+{
+	spiXfer_t x;
+	x.cs = motor + 1;
+	x.length = 3;
+	x.tag = motor;
+	x.tx[0] = (datagram >> 16) & 0x0F;
+	x.tx[1] = (datagram >> 8) & 0xFF;
+	x.tx[2] = datagram & 0xFF;
+	x.done = _write_done;
+	return (spi_queue(&x));
+}
+
+/*
+ * _write_done() - keep the driver status - called from the DMAC interrupt
+ *
+ *	With RDSEL set for stallGuard the response is SG_RESULT in bits 19..10 and the
+ *	status flags in bits 7..0. A motor with a stall switch drives the switch from
+ *	the SG flag unless it is at standstill.
+ */
+static void _write_done(spiXfer_t *x)
+{
+	tmcMotor_t *m = &tmc.m[x->tag];
+	uint32_t status = (((uint32_t)x->rx[0] << 16) | ((uint32_t)x->rx[1] << 8) | x->rx[2]) >> 4;
+
+	m->load = (status >> 10) & 0x3FF;
+	m->flags = status & 0xFF;
+	if ((m->stall_switch != 0) && ((status & TMC_STATUS_STST) == 0)) {
+		sw_set_stall(m->stall_switch - 1, (status & TMC_STATUS_SG) ? SW_CLOSED : SW_OPEN);
+	}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * _get_motor() - helper to return motor number as an index or -1 if na
+ */
+static int8_t _get_motor(const index_t index)
+{
+	char_t *ptr;
+	char_t motors[] = {"123456"};
+	char_t tmp[CMD_TOKEN_LEN+1];
+
+	strcpy_P(tmp, cfgArray[index].group);
+	if ((ptr = strchr(motors, tmp[0])) == NULL) {
+		return (-1);
+	}
+	return (ptr - motors);
+}
+
+stat_t tmc_set_sgt(cmdObj_t *cmd)			// stallGuard threshold
+{
+	if ((cmd->value < -64) || (cmd->value > 63)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	int8_t motor = _get_motor(cmd->index);
+	if (motor < 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	cmd->value = (int8_t)cmd->value;
+	set_flt(cmd);
+	_set_sgcsconf(motor, tmc.m[motor].reg[TMC_SGCSCONF] & 0x1F);
+	return (STAT_OK);
+}
+
+stat_t tmc_set_ssw(cmdObj_t *cmd)			// switch closed by a stall
+{
+	if (cmd->value > (SW_PAIRS * SW_POSITIONS)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	int8_t motor = _get_motor(cmd->index);
+	if (motor < 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	set_ui8(cmd);
+	if (tmc.m[motor].stall_switch != 0) {
+		tmc.stall_watch |= (1 << motor);
+	} else {
+		tmc.stall_watch &= ~(1 << motor);
+	}
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_0sgt[] PROGMEM = "[%s%s] m%s stall threshold%14.0f [-64..63]\n";
+static const char fmt_0ssw[] PROGMEM = "[%s%s] m%s stall switch%17d [0=none,1=x min,2=x max...]\n";
+static const char fmt_0sg[] PROGMEM = "[%s%s] m%s stallGuard load%14lu [0..1023]\n";
+static const char fmt_0sf[] PROGMEM = "[%s%s] m%s driver status flags%9lu [1=stall,2=overtemp,4=temp warn...]\n";
+
+void tmc_print_sgt(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0sgt, cmd->group, cmd->token, cmd->group, cmd->value);}
+void tmc_print_ssw(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0ssw, cmd->group, cmd->token, cmd->group, (uint8_t)cmd->value);}
+void tmc_print_sg(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0sg, cmd->group, cmd->token, cmd->group, (uint32_t)cmd->value);}
+void tmc_print_sf(cmdObj_t *cmd) { fprintf_P(stderr, fmt_0sf, cmd->group, cmd->token, cmd->group, (uint32_t)cmd->value);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __TMC2660
@@ -0,0 +1,142 @@
+/*
+ * tmc2660.h - SPI configured motor drivers with stall detection
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * SPI motor driver support is enabled by __TMC2660 in tinyg2.h, for boards with a
+ * TMC2660 (or register compatible) driver on each motor chip select spi_ss1..6.
+ * The drivers still take step and direction from the DDA - the SPI sets them up and
+ * reads them back:
+ *
+ *	  - Microsteps ($1mi) are written to DRVCTRL, 1 to 128 with step interpolation.
+ *	  - Current is written to the SGCSCONF current scale from the motor power level
+ *		($1pl, $1pi, and the dynamic power of power mode 3) in place of the Vref PWM.
+ *	  - Every datagram returns the driver status. The stallGuard load ($1sg, 0..1023,
+ *		lower is more load) and the status flags ($1sf) are kept for each motor.
+ *
+ * Register writes are queued from the main loop (tmc_callback()). Status is polled by
+ * rewriting DRVCONF from the SysTick interrupt (TMC_TICK()): one motor every
+ * TMC_POLL_MS for live load data, and every millisecond for a motor that has a stall
+ * switch. No SPI transfer is made from the stepper interrupts - see spi.h.
+ *
+ * Sensorless homing: set $1ssw to the switch that a stall of the motor closes,
+ * numbered from 1 like the squaring switches (1=x min, 2=x max, 3=y min...), and
+ * set that switch to homing mode with its input left unwired. A stall closes the
+ * switch and the SG flag clearing opens it again, with the switch's own lockout,
+ * latching and callbacks, so the homing cycle runs on it unchanged. The flag is
+ * ignored while the driver reports standstill, so a stopped motor holds its state.
+ * stallGuard needs some speed, so the homing search and latch velocities have to be
+ * high enough for the chosen threshold ($1sgt, -64..63, higher is less sensitive).
+ */
+
+#ifndef TMC2660_H_ONCE
+#define TMC2660_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __TMC2660
+
+#define TMC_POLL_MS				100		// telemetry poll interval - one motor per poll
+
+// register addresses - the top 3 bits of the 20 bit datagram
+#define TMC_REG_DRVCTRL			0x00000
+#define TMC_REG_CHOPCONF		0x80000
+#define TMC_REG_SMARTEN			0xA0000
+#define TMC_REG_SGCSCONF		0xC0000
+#define TMC_REG_DRVCONF			0xE0000
+
+#define TMC_DRVCTRL_INTPOL		(1UL<<9)	// interpolate the step input to 256 microsteps
+#define TMC_SGCSCONF_SFILT		(1UL<<16)	// stallGuard filter - one reading per 4 full steps
+#define TMC_DRVCONF_RDSEL_SG	(2UL<<4)	// read back the full stallGuard value
+#define TMC_DRVCONF_RDSEL_MASK	(3UL<<4)
+
+// status flags - the low byte of every response
+#define TMC_STATUS_SG			0x01	// stallGuard threshold reached
+#define TMC_STATUS_OT			0x02	// overtemperature shutdown
+#define TMC_STATUS_OTPW			0x04	// overtemperature warning
+#define TMC_STATUS_S2GA			0x08	// short to ground, coil A
+#define TMC_STATUS_S2GB			0x10	// short to ground, coil B
+#define TMC_STATUS_OLA			0x20	// open load, coil A
+#define TMC_STATUS_OLB			0x40	// open load, coil B
+#define TMC_STATUS_STST			0x80	// standstill - no step for 2^20 clocks
+
+enum tmcRegister {						// dirty bits - written in this order
+	TMC_DRVCONF = 0,
+	TMC_DRVCTRL,
+	TMC_CHOPCONF,
+	TMC_SMARTEN,
+	TMC_SGCSCONF,
+	TMC_REGISTERS						// must be last
+};
+
+typedef struct tmcMotor {
+	float stall_threshold;				// $1sgt - stallGuard threshold [-64..63]
+	uint8_t stall_switch;				// $1ssw - switch closed by a stall, 1..12, 0=none
+	uint8_t dirty;						// registers to write - 1 bit per tmcRegister
+	uint32_t reg[TMC_REGISTERS];		// register images, address included
+	volatile uint32_t load;				// $1sg - stallGuard value of the last response
+	volatile uint32_t flags;			// $1sf - status flags of the last response
+} tmcMotor_t;
+
+typedef struct tmcSingleton {
+	uint8_t ready;						// set once the SPI and the register images are set up
+	uint8_t stall_watch;				// motors with a stall switch - 1 bit per motor
+	uint8_t poll_motor;					// next motor for the telemetry poll
+	uint16_t poll_tick;					// SysTicks since the last telemetry poll
+	tmcMotor_t m[MOTORS];
+} tmcSingleton_t;
+
+extern tmcSingleton_t tmc;
+
+void tmc_init(void);
+stat_t tmc_callback(void);
+void tmc_tick(void);
+void tmc_set_microsteps(uint8_t motor, uint8_t microsteps);
+void tmc_set_current(uint8_t motor, float level);
+
+stat_t tmc_set_sgt(cmdObj_t *cmd);
+stat_t tmc_set_ssw(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void tmc_print_sgt(cmdObj_t *cmd);
+	void tmc_print_ssw(cmdObj_t *cmd);
+	void tmc_print_sg(cmdObj_t *cmd);
+	void tmc_print_sf(cmdObj_t *cmd);
+#else
+	#define tmc_print_sgt tx_print_stub
+	#define tmc_print_ssw tx_print_stub
+	#define tmc_print_sg tx_print_stub
+	#define tmc_print_sf tx_print_stub
+#endif
+
+#define TMC_CALLBACK() tmc_callback()
+#define TMC_TICK() tmc_tick()
+
+#else
+
+#define TMC_CALLBACK() (STAT_NOOP)
+#define TMC_TICK()
+
+#endif // __TMC2660
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: TMC2660_H_ONCE
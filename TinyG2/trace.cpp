@@ -0,0 +1,120 @@
+/*
+ * trace.cpp - segment level motion trace recorder
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See trace.h for usage and the download format */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "planner.h"
+#include "stepper.h"
+#include "util.h"
+#include "xio.h"
+#include "trace.h"
+
+#ifdef __MOTION_TRACE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+mtSingleton_t mt;
+
+/*
+ * mt_record_segment() - log the segment just prepared by st_prep_line()
+ *
+ *	Called from _exec_aline_segment() in the exec interrupt, after the segment has
+ *	been prepared but before it is handed to the loader.
+ */
+void mt_record_segment()
+{
+	if ((mt.downloading == true) || ((mt.mode == MT_ONE_SHOT) && (mt.count == MT_RECORDS))) return;
+
+	const stPrepSegment_t *sp = st_get_prep_segment();
+	mtRecord_t *r = &mt.record[mt.head];
+
+	r->linenum = mr.gm.linenum;
+	r->velocity = mr.segment_velocity;
+	r->microseconds = (uint16_t)mr.microseconds;
+	r->move_state = mr.move_state;
+	r->section_state = mr.section_state;
+	r->dda_ticks = sp->dda_ticks;
+	for (uint8_t i=0; i<MOTORS; i++) { r->phase_increment[i] = sp->m[i].phase_increment;}
+
+	if (++mt.head == MT_RECORDS) { mt.head = 0;}
+	if (mt.count < MT_RECORDS) { mt.count++;}
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * mt_set_mode() 	 - set the recording mode and clear the trace
+ * mt_get_download() - send the trace as binary frames and return the record count
+ */
+
+stat_t mt_set_mode(cmdObj_t *cmd)
+{
+	if (cmd->value > MT_ONE_SHOT) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+	mt.mode = MT_OFF;					// stop the exec from writing while clearing
+	mt.head = 0;
+	mt.count = 0;
+	mt.mode = (uint8_t)cmd->value;
+	return (STAT_OK);
+}
+
+stat_t mt_get_download(cmdObj_t *cmd)
+{
+	uint8_t frame[MT_BINARY_HEADER_LEN + (MT_FRAME_RECORDS * MT_RECORD_LEN) + 2];
+	uint16_t first, count;
+
+	mt.downloading = true;				// freeze the trace
+	count = mt.count;
+	first = (count < MT_RECORDS) ? 0 : mt.head;	// oldest record
+
+	for (uint16_t sent = 0; sent < count; ) {
+		uint8_t n = min(MT_FRAME_RECORDS, count - sent);
+		uint8_t *ptr = &frame[MT_BINARY_HEADER_LEN];
+		for (uint8_t i=0; i<n; i++) {
+			memcpy(ptr, &mt.record[(first + sent + i) % MT_RECORDS], MT_RECORD_LEN);
+			ptr += MT_RECORD_LEN;
+		}
+		frame[0] = MT_BINARY_SYNC;
+		frame[1] = (uint8_t)((ptr + 2) - &frame[2]);	// sequence through checksum
+		frame[2] = (uint8_t)(sent & 0xFF);
+		frame[3] = (uint8_t)(sent >> 8);
+		frame[4] = n;
+		uint16_t checksum = compute_fletcher16(&frame[2], ptr - &frame[2]);
+		*ptr++ = (uint8_t)(checksum & 0xFF);
+		*ptr++ = (uint8_t)(checksum >> 8);
+		write(frame, ptr - frame);
+		sent += n;
+	}
+	mt.downloading = false;
+
+	cmd->value = (float)count;
+	cmd->objtype = TYPE_INTEGER;
+	return (STAT_OK);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __MOTION_TRACE
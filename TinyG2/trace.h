@@ -0,0 +1,104 @@
+/*
+ * trace.h - segment level motion trace recorder
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The trace recorder is enabled by __MOTION_TRACE in tinyg2.h. When enabled every
+ * aline segment prepared for the steppers is logged to a RAM ring buffer of the
+ * last MT_RECORDS segments: line number, move and section state, segment velocity,
+ * segment time, and the DDA ticks and per-motor phase increments from st_prep_line().
+ *
+ *	{"mte":1}	start recording, keeping the most recent segments (clears the trace)
+ *	{"mte":2}	start recording, stopping when the buffer is full (clears the trace)
+ *	{"mte":0}	stop recording
+ *	{"mtd":""}	download the trace as binary frames - returns the record count
+ *
+ * The download is a series of frames, oldest record first, sent ahead of the JSON
+ * response. All multi-byte fields are little-endian:
+ *
+ *	  [SYNC][length][sequence(2)][count][record]...[record][checksum(2)]
+ *
+ *	  SYNC		SOH (0x01) - the binary status report uses STX so the two can be told apart
+ *	  length	number of bytes from sequence through checksum, inclusive
+ *	  sequence	uint16 index of the first record in the frame, counting from the oldest
+ *	  count		number of records that follow
+ *	  record	mtRecord_t, packed, MT_RECORD_LEN bytes
+ *	  checksum	Fletcher-16 over sequence through the last record. Low byte is sum1
+ *
+ * Recording is skipped while a download is in progress.
+ */
+
+#ifndef TRACE_H_ONCE
+#define TRACE_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __MOTION_TRACE
+
+#define MT_RECORDS				128		// segments kept - 40 bytes each with 6 motors
+#define MT_BINARY_SYNC			0x01	// ASCII SOH
+#define MT_BINARY_HEADER_LEN	5		// sync, length, sequence, count
+#define MT_RECORD_LEN			(sizeof(mtRecord_t))
+#define MT_FRAME_RECORDS		((255 - 5) / MT_RECORD_LEN)	// records that fit the length byte
+
+enum mtMode {
+	MT_OFF = 0,							// not recording
+	MT_CONTINUOUS,						// overwrite the oldest record when full
+	MT_ONE_SHOT							// stop recording when full
+};
+
+typedef struct mtRecord {				// one prepared segment
+	uint32_t linenum;					// Gcode line number of the move
+	float velocity;						// segment velocity (mm/min)
+	uint16_t microseconds;				// segment time
+	uint8_t move_state;					// mr.move_state - head, body or tail
+	uint8_t section_state;				// mr.section_state - first or second half of the section
+	uint32_t dda_ticks;					// DDA ticks for the segment
+	uint32_t phase_increment[MOTORS];	// per motor - substeps, or the starting increment if ramped
+} __attribute__((packed)) mtRecord_t;
+
+typedef struct mtSingleton {
+	uint8_t mode;						// see mtMode - set by {"mte":n}
+	uint8_t downloading;				// TRUE while the trace is being sent
+	uint16_t head;						// next record to write
+	uint16_t count;						// records held (up to MT_RECORDS)
+	mtRecord_t record[MT_RECORDS];
+} mtSingleton_t;
+
+extern mtSingleton_t mt;
+
+void mt_record_segment(void);
+
+stat_t mt_set_mode(cmdObj_t *cmd);
+stat_t mt_get_download(cmdObj_t *cmd);
+
+// TRACE_SEGMENT() costs one test when the recorder is off
+#define TRACE_SEGMENT() if (mt.mode != MT_OFF) { mt_record_segment();}
+
+#else
+
+#define TRACE_SEGMENT()
+
+#endif // __MOTION_TRACE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: TRACE_H_ONCE
@@ -0,0 +1,316 @@
+/*
+ * uart.cpp - USART ports read and written by the PDC, for a pendant and a PLC link
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/* See uart.h for usage */
+
+#include "tinyg2.h"
+#include "config.h"
+#include "hardware.h"
+#include "text_parser.h"
+#include "switch.h"
+#include "uart.h"
+
+#ifdef __UART_DEVICES
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+uartSingleton_t uart;
+
+typedef struct uartHardware {
+	Usart *usart;
+	uint32_t id;						// peripheral ID for the PMC
+	IRQn_Type irq;
+	Pio *pio;
+	uint32_t pins;						// RXD, TXD and RTS
+	uint8_t peripheral_b;				// TRUE if the pins are on peripheral B
+	uint8_t rs485;						// TRUE if RTS is bonded out for the driver enable
+	uint8_t axis;						// axis whose switch inputs are on RXD and TXD
+} uartHardware_t;
+
+static const uartHardware_t uart_hw[UART_PORTS] = {
+	{ USART1, ID_USART1, USART1_IRQn, PIOA, PIO_PA12A_RXD1 | PIO_PA13A_TXD1 | PIO_PA14A_RTS1, false, true, AXIS_Y },
+	{ USART3, ID_USART3, USART3_IRQn, PIOD, PIO_PD5B_RXD3 | PIO_PD4B_TXD3, true, false, AXIS_X }
+};
+
+static void _open(const uint8_t index);
+static void _close(const uint8_t index);
+static void _tx_start(const uint8_t index);
+
+/*
+ * uart_init() - open the ports that are on
+ */
+void uart_init(void)
+{
+	uart.ready = true;
+	for (uint8_t i=0; i<UART_PORTS; i++) { _open(i);}
+}
+
+/*
+ * _pins_free() - return TRUE if the switch inputs that share the port's pins are disabled
+ */
+static uint8_t _pins_free(const uint8_t index)
+{
+	uint8_t axis = uart_hw[index].axis;
+	return ((sw.s[axis][SW_MIN].mode == SW_MODE_DISABLED) && (sw.s[axis][SW_MAX].mode == SW_MODE_DISABLED));
+}
+
+/*
+ * _open() - (re)start a port in its mode and baud rate, with the PDC receiving into the ring
+ * _close() - stop a port and give its pins back to the PIO
+ *
+ *	Anything unread or unsent is dropped.
+ */
+static void _open(const uint8_t index)
+{
+	uartPort_t *p = &uart.port[index];
+	const uartHardware_t *h = &uart_hw[index];
+	Usart *u = h->usart;
+
+	_close(index);
+	if ((p->mode == UART_OFF) || (_pins_free(index) == false)) { return;}
+
+	hw_enable_periph_clk(h->id);
+	u->US_CR = US_CR_RSTRX | US_CR_RSTTX | US_CR_RXDIS | US_CR_TXDIS | US_CR_RSTSTA;
+	u->US_MR = ((p->mode == UART_RS485) ? US_MR_USART_MODE_RS485 : US_MR_USART_MODE_NORMAL) |
+			   US_MR_USCLKS_MCK | US_MR_CHRL_8_BIT | US_MR_PAR_NO | US_MR_NBSTOP_1_BIT | US_MR_CHMODE_NORMAL;
+	u->US_BRGR = (uint32_t)lroundf(F_CPU / (16 * p->baud));
+	u->US_IDR = 0xFFFFFFFF;
+
+	p->rx_halves = 0;
+	p->rx_read = 0;
+	p->tx_head = 0;
+	p->tx_tail = 0;
+	p->tx_run = 0;
+	u->US_PTCR = US_PTCR_RXTDIS | US_PTCR_TXTDIS;
+	u->US_RPR = (uint32_t)&p->rx_buf[0];		// the first half fills first...
+	u->US_RCR = UART_RX_HALF;
+	u->US_RNPR = (uint32_t)&p->rx_buf[UART_RX_HALF];	// ...and the PDC carries on in the second
+	u->US_RNCR = UART_RX_HALF;
+	u->US_TCR = 0;
+	u->US_TNCR = 0;
+	u->US_PTCR = US_PTCR_RXTEN | US_PTCR_TXTEN;
+	u->US_IER = US_IER_ENDRX;
+
+	h->pio->PIO_IDR = h->pins;					// no switch interrupts from the port's pins
+	h->pio->PIO_PUER = h->pins;					// an unconnected RXD idles high
+	if (h->peripheral_b == true) {
+		h->pio->PIO_ABSR |= h->pins;
+	} else {
+		h->pio->PIO_ABSR &= ~h->pins;
+	}
+	h->pio->PIO_PDR = h->pins;
+
+	NVIC_SetPriority(h->irq, UART_ISR_PRIORITY);
+	NVIC_EnableIRQ(h->irq);
+	u->US_CR = US_CR_RXEN | US_CR_TXEN;
+	p->open = true;
+}
+
+static void _close(const uint8_t index)
+{
+	uartPort_t *p = &uart.port[index];
+	const uartHardware_t *h = &uart_hw[index];
+	Usart *u = h->usart;
+
+	if (p->open == false) { return;}
+	p->open = false;
+	NVIC_DisableIRQ(h->irq);
+	u->US_CR = US_CR_RXDIS | US_CR_TXDIS;
+	u->US_PTCR = US_PTCR_RXTDIS | US_PTCR_TXTDIS;
+	u->US_IDR = 0xFFFFFFFF;
+	h->pio->PIO_PER = h->pins;
+}
+
+/*
+ * _uart_isr() - re-arm the half of the RX ring the PDC finished, and start the next TX run
+ *
+ *	When a half fills the PDC carries on in the other one, and the half it finished
+ *	becomes the next. At that point the PDC is writing over the half before the one
+ *	it finished, so anything in it that is still unread is lost. Writing RNCR clears
+ *	ENDRX, and writing TCR clears ENDTX.
+ */
+static void _uart_isr(const uint8_t index)
+{
+	uartPort_t *p = &uart.port[index];
+	Usart *u = uart_hw[index].usart;
+	uint32_t status = u->US_CSR & u->US_IMR;
+
+	if ((status & US_CSR_ENDRX) != 0) {
+		uint32_t halves = ++p->rx_halves;
+		if ((int32_t)(p->rx_read - (halves - 1) * UART_RX_HALF) < 0) { p->errors++;}
+		u->US_RNPR = (uint32_t)&p->rx_buf[((halves + 1) & 1) * UART_RX_HALF];
+		u->US_RNCR = UART_RX_HALF;
+	}
+	if ((status & US_CSR_ENDTX) != 0) {
+		p->tx_tail = (p->tx_tail + p->tx_run) & UART_TX_MASK;
+		p->tx_run = 0;
+		_tx_start(index);
+	}
+}
+
+void USART1_Handler(void) { _uart_isr(UART_1);}
+void USART3_Handler(void) { _uart_isr(UART_2);}
+
+/*
+ * _tx_start() - have the PDC send the next contiguous run of the TX ring
+ *
+ *	Called from the ISR as a run ends, or by uart_write() while the ENDTX interrupt
+ *	is off - so never from both at once. The interrupt is turned off once the ring
+ *	is empty.
+ */
+static void _tx_start(const uint8_t index)
+{
+	uartPort_t *p = &uart.port[index];
+	Usart *u = uart_hw[index].usart;
+	uint16_t head = p->tx_head;
+	uint16_t tail = p->tx_tail;
+
+	if (head == tail) {
+		u->US_IDR = US_IDR_ENDTX;
+		return;
+	}
+	uint16_t run = ((head > tail) ? head : UART_TX_SIZE) - tail;
+	p->tx_run = run;
+	u->US_TPR = (uint32_t)&p->tx_buf[tail];
+	u->US_TCR = run;
+	u->US_IER = US_IER_ENDTX;
+}
+
+/*
+ * uart_read() - copy out what has arrived, up to size. Returns characters read
+ * uart_get_rx_count() - return characters that have arrived and are not yet read
+ *
+ *	The head of the ring is where the PDC will write next. A hardware overrun or
+ *	framing error is counted and cleared as the port is read.
+ */
+static uint16_t _rx_count(uartPort_t *p, Usart *u)
+{
+	uint32_t halves = p->rx_halves;
+	if ((int32_t)(p->rx_read - (halves - 1) * UART_RX_HALF) < 0) {	// lapped - see _uart_isr()
+		p->rx_read = (halves - 1) * UART_RX_HALF;
+	}
+	return ((u->US_RPR - (uint32_t)p->rx_buf - p->rx_read) & UART_RX_MASK);
+}
+
+int16_t uart_read(const uint8_t index, uint8_t *buf, const uint16_t size)
+{
+	uartPort_t *p = &uart.port[index];
+	Usart *u = uart_hw[index].usart;
+
+	if (p->open == false) { return (0);}
+	if ((u->US_CSR & (US_CSR_OVRE | US_CSR_FRAME)) != 0) {
+		p->errors++;
+		u->US_CR = US_CR_RSTSTA;
+	}
+	uint16_t count = _rx_count(p, u);
+	if (count > size) { count = size;}
+	uint16_t tail = p->rx_read & UART_RX_MASK;
+	uint16_t run = UART_RX_SIZE - tail;
+	if (run > count) { run = count;}
+	memcpy(buf, &p->rx_buf[tail], run);
+	memcpy(buf + run, p->rx_buf, count - run);
+	p->rx_read += count;
+	return (count);
+}
+
+uint16_t uart_get_rx_count(const uint8_t index)
+{
+	if (uart.port[index].open == false) { return (0);}
+	return (_rx_count(&uart.port[index], uart_hw[index].usart));
+}
+
+/*
+ * uart_write() - copy as much as fits into the TX ring and start sending. Returns characters taken
+ *
+ *	Output to a port that is off is dropped, so a response to it never waits.
+ */
+int16_t uart_write(const uint8_t index, const uint8_t *buf, const uint16_t size)
+{
+	uartPort_t *p = &uart.port[index];
+
+	if (p->open == false) { return (size);}
+	uint16_t head = p->tx_head;
+	uint16_t count = (p->tx_tail - head - 1) & UART_TX_MASK;
+	if (count > size) { count = size;}
+	uint16_t run = UART_TX_SIZE - head;
+	if (run > count) { run = count;}
+	memcpy(&p->tx_buf[head], buf, run);
+	memcpy(p->tx_buf, buf + run, count - run);
+	p->tx_head = (head + count) & UART_TX_MASK;
+
+	if ((uart_hw[index].usart->US_IMR & US_IMR_ENDTX) == 0) { _tx_start(index);}
+	return (count);
+}
+
+/***********************************************************************************
+ * CONFIGURATION AND INTERFACE FUNCTIONS
+ * Functions to get and set variables from the cfgArray table
+ ***********************************************************************************/
+
+/*
+ * uart_set_um() - set a port's mode - RS-485 needs RTS, and the port's switches must be off
+ * uart_set_ub() - set a port's baud rate
+ *
+ *	The port is the digit in the token. Both restart the port.
+ */
+stat_t uart_set_um(cmdObj_t *cmd)
+{
+	uint8_t index = cmd->token[1] - '1';
+
+	if ((cmd->value < UART_OFF) || (cmd->value > UART_RS485)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if (((uint8_t)cmd->value == UART_RS485) && (uart_hw[index].rs485 == false)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	if (((uint8_t)cmd->value != UART_OFF) && (uart.ready == true) && (_pins_free(index) == false)) {
+		return (STAT_COMMAND_NOT_ACCEPTED);
+	}
+	ritorno(set_ui8(cmd));
+	if (uart.ready == true) { _open(index);}
+	return (STAT_OK);
+}
+
+stat_t uart_set_ub(cmdObj_t *cmd)
+{
+	uint8_t index = cmd->token[1] - '1';
+
+	if ((cmd->value < UART_BAUD_MIN) || (cmd->value > UART_BAUD_MAX)) { return (STAT_INPUT_VALUE_RANGE_ERROR);}
+	ritorno(set_flt(cmd));
+	if (uart.ready == true) { _open(index);}
+	return (STAT_OK);
+}
+
+/***********************************************************************************
+ * TEXT MODE SUPPORT
+ * Functions to print variables from the cfgArray table
+ ***********************************************************************************/
+
+#ifdef __TEXT_MODE
+
+static const char fmt_um[] PROGMEM = "[%s] uart port mode%19d [0=off,1=RS-232,2=RS-485]\n";
+static const char fmt_ub[] PROGMEM = "[%s] uart port baud rate%14.0f\n";
+
+void uart_print_um(cmdObj_t *cmd) { fprintf_P(stderr, fmt_um, cmd->token, (uint8_t)cmd->value);}
+void uart_print_ub(cmdObj_t *cmd) { fprintf_P(stderr, fmt_ub, cmd->token, cmd->value);}
+
+#endif // __TEXT_MODE
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __UART_DEVICES
@@ -0,0 +1,128 @@
+/*
+ * uart.h - USART ports read and written by the PDC, for a pendant and a PLC link
+ * This file is part of the TinyG project
+ *
+ * Copyright (c) 2013 Alden S. Hart, Jr.
+ *
+ * This file ("the software") is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2 as published by the
+ * Free Software Foundation. You should have received a copy of the GNU General Public
+ * License, version 2 along with the software.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * THE SOFTWARE IS DISTRIBUTED IN THE HOPE THAT IT WILL BE USEFUL, BUT WITHOUT ANY
+ * WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT
+ * SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF
+ * OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+/*
+ * The USART ports are enabled by __UART_DEVICES in tinyg2.h. They are xio devices
+ * (see xio.cpp) - lines read from them are parsed and run like lines from USB, and
+ * are answered on the port they came from. Signals (!, ~, %) are acted on from any
+ * port. Lines are only read while a host is connected on USB, as the controller
+ * starts on that connection (see _command_dispatch()). There are two:
+ *
+ *	  - port 1 is USART1 - RXD1, TXD1 and RTS1 on Due D17, D16 and D23. Meant for an
+ *		RS-485 pendant: in RS-485 mode RTS1 is the driver enable, high while the
+ *		USART sends. Tie the transceiver's receiver enable to it, so the port does
+ *		not hear its own output
+ *	  - port 2 is USART3 - RXD3 and TXD3 on Due D15 and D14. Meant for a PLC link.
+ *		RTS3 is not bonded out on the SAM3X8E, so this port is RS-232 (TTL) only
+ *
+ * In the Due pinout (hardware.h) D14..D17 are the X and Y switch inputs, and D23 is
+ * motor 1's microstep 0 select. A port is only opened with both switches of its
+ * axis disabled - $ysn=0 and $ysx=0 for port 1, $xsn=0 and $xsx=0 for port 2 - and
+ * a board built for RS-485 on port 1 routes motor 1's MS0 elsewhere.
+ *
+ *	$u1m, $u2m	0=off, 1=RS-232, 2=RS-485 (port 1 only)
+ *	$u1b, $u2b	baud rate - 8 data bits, no parity, 1 stop bit
+ *	{"u1e":""}	overruns, framing errors and ring overflows seen - each may lose characters
+ *
+ * Nothing is done per character. The PDC receives into a ring of two halves and
+ * carries on in one while the other is re-armed - the USART interrupt runs once per
+ * UART_RX_HALF characters to do that. The reader finds what has arrived from the
+ * PDC's pointer and copies it out in bulk with uart_read(). Output is copied into a
+ * ring with uart_write() and the PDC sends each contiguous run of it, with one
+ * interrupt per run to start the next.
+ *
+ * The reader must keep within UART_RX_SIZE - UART_RX_HALF characters of the PDC.
+ * xio reads the ports on every pass of the main loop (and while output waits), so
+ * that only fails if the sender runs far ahead of its responses. A lapped reader
+ * skips to the oldest half the PDC has not written over, and counts it in $uNe.
+ */
+
+#ifndef UART_H_ONCE
+#define UART_H_ONCE
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#ifdef __UART_DEVICES
+
+#define UART_RX_SIZE		256			// PDC receive ring - two halves (power of 2)
+#define UART_RX_HALF		(UART_RX_SIZE/2)
+#define UART_RX_MASK		(UART_RX_SIZE-1)
+#define UART_TX_SIZE		512			// transmit ring (power of 2). One slot is always kept empty
+#define UART_TX_MASK		(UART_TX_SIZE-1)
+#define UART_BAUD_MIN		1200
+#define UART_BAUD_MAX		(F_CPU/16)	// one MCK/16 per bit
+#define UART_ISR_PRIORITY	9			// NVIC priority of the USART interrupts - below the ADC
+
+enum uartIndex {						// ports - the 1 and 2 of $u1m, $u2m
+	UART_1 = 0,							// USART1 - pendant
+	UART_2,								// USART3 - PLC link
+	UART_PORTS							// must be last
+};
+
+enum uartMode {							// $uNm
+	UART_OFF = 0,
+	UART_RS232,
+	UART_RS485							// RTS is the driver enable - port 1 only
+};
+
+typedef struct uartPort {
+	uint8_t mode;						// uNm - uartMode
+	float baud;							// uNb - bits per second
+	uint32_t errors;					// uNe - overruns, framing errors and ring overflows
+	uint8_t open;						// TRUE while the USART is running
+	volatile uint32_t rx_halves;		// halves of the RX ring the PDC has filled (written by the ISR only)
+	uint32_t rx_read;					// characters read from the RX ring - the tail is the low bits
+	uint16_t tx_head;					// next slot to write
+	volatile uint16_t tx_tail;			// next character to send (written by the ISR only once sending)
+	volatile uint16_t tx_run;			// characters the PDC is sending from tx_tail
+	uint8_t rx_buf[UART_RX_SIZE];		// PDC receive ring
+	uint8_t tx_buf[UART_TX_SIZE];		// PDC transmit ring
+} uartPort_t;
+
+typedef struct uartSingleton {
+	uint8_t ready;						// set once uart_init() has run - the config load only stores
+	uartPort_t port[UART_PORTS];
+} uartSingleton_t;
+
+extern uartSingleton_t uart;
+
+void uart_init(void);
+int16_t uart_read(const uint8_t index, uint8_t *buf, const uint16_t size);
+int16_t uart_write(const uint8_t index, const uint8_t *buf, const uint16_t size);
+uint16_t uart_get_rx_count(const uint8_t index);
+
+stat_t uart_set_um(cmdObj_t *cmd);
+stat_t uart_set_ub(cmdObj_t *cmd);
+
+#ifdef __TEXT_MODE
+	void uart_print_um(cmdObj_t *cmd);
+	void uart_print_ub(cmdObj_t *cmd);
+#else
+	#define uart_print_um tx_print_stub
+	#define uart_print_ub tx_print_stub
+#endif
+
+#endif // __UART_DEVICES
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // End of include guard: UART_H_ONCE
@@ -162,6 +162,7 @@ float max4(float x1, float x2, float x3, float x4)
  * strcpy_U() 	   - strcpy workalike to get around initial NUL for blank string - possibly wrong
  * isnumber() 	   - isdigit that also accepts plus, minus, and decimal point
  * escape_string() - add escapes to a string - currently for quotes only
+ * read_number()   - fixed-digit decimal to float conversion for JSON and text values
  */
 
 /*
@@ -195,6 +196,80 @@ char_t *escape_string(char_t *dst, char_t *src)
 	return (start_dst);
 }
 
+/*
+ * read_number() - fixed-digit decimal to float conversion for JSON and text values
+ *
+ *	Accepts an optional sign, digits, at most one decimal point and an optional
+ *	exponent (e or E, signed). Up to NUMBER_DIGITS significant digits are accumulated
+ *	in an integer and scaled by a power of ten once at the end, as the Gcode parser
+ *	does, instead of strtof() - which goes through double and is slow on the ARM.
+ *	An integer is converted once and is exact to 2^24, as strtof() would be. Decimals
+ *	are within an ulp or so of strtof(). There is no hex, inf or nan.
+ *
+ *	Returns the type read, and the end pointer as strtof() does - the start if there
+ *	were no digits.
+ */
+const float pow10_float[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+uint8_t read_number(const char_t *str, char_t **end, float *value)
+{
+	const char_t *rd = str;
+	uint32_t mantissa = 0;
+	int16_t exponent = 0;				// power of ten to apply to the mantissa
+	uint8_t digits = 0;					// significant digits in the mantissa
+	uint8_t found = false;				// TRUE once any digit has been read
+	uint8_t type = NUMBER_INTEGER;
+	uint8_t negative = false;
+
+	if (*rd == '-') { negative = true; rd++;}
+	else if (*rd == '+') { rd++;}
+	for (;; rd++) {
+		if (isdigit((char)*rd)) {
+			found = true;
+			if (digits < NUMBER_DIGITS) {
+				mantissa = mantissa * 10 + (*rd - '0');
+				if (mantissa != 0) { digits++;}		// leading zeros are not significant
+				if (type == NUMBER_DECIMAL) { exponent--;}
+			} else if (type == NUMBER_INTEGER) {
+				exponent++;							// dropped integer digit
+			}
+		} else if ((*rd == '.') && (type == NUMBER_INTEGER)) {
+			type = NUMBER_DECIMAL;
+		} else {
+			break;
+		}
+	}
+	*end = (char_t *)str;
+	if (found == false) { return (NUMBER_NONE);}
+
+	if ((*rd == 'e') || (*rd == 'E')) {				// the exponent is only taken if it has digits
+		const char_t *ex = rd + 1;
+		int16_t power = 0;
+		uint8_t minus = (*ex == '-');
+		if ((*ex == '-') || (*ex == '+')) { ex++;}
+		if (isdigit((char)*ex)) {
+			for (; isdigit((char)*ex); ex++) {
+				if (power < 100) { power = power * 10 + (*ex - '0');}	// past float range anyway
+			}
+			exponent += (minus == true) ? -power : power;
+			type = NUMBER_DECIMAL;
+			rd = ex;
+		}
+	}
+	*end = (char_t *)rd;
+
+	*value = (float)mantissa;
+	if (mantissa != 0) {
+		for (; exponent < -NUMBER_DIGITS; exponent += NUMBER_DIGITS) { *value /= pow10_float[NUMBER_DIGITS];}
+		for (; exponent > NUMBER_DIGITS; exponent -= NUMBER_DIGITS) { *value *= pow10_float[NUMBER_DIGITS];}
+		if (exponent < 0) { *value /= pow10_float[-exponent];}
+		else if (exponent > 0) { *value *= pow10_float[exponent];}
+	}
+	if (negative == true) { *value = -*value;}
+	if ((type == NUMBER_INTEGER) && (exponent != 0)) { type = NUMBER_DECIMAL;}	// digits were dropped
+	return (type);
+}
+
 /* 
  * compute_checksum() - calculate the checksum for a string
  * 
@@ -203,20 +278,155 @@ char_t *escape_string(char_t *dst, char_t *src)
  * 	This is based on the the Java hashCode function. 
  *	See http://en.wikipedia.org/wiki/Java_hashCode()
  */
-#define HASHMASK 9999
-
 uint16_t compute_checksum(char_t const *string, const uint16_t length) 
 {
-	uint32_t h = 0;
 	uint16_t len = strlen(string);
 
 	if (length != 0) {
 		len = min(len, length);
 	}
-    for (uint16_t i=0; i<len; i++) {
+	return (compute_checksum_add(0, string, len) % HASHMASK);
+}
+
+/*
+ * compute_checksum_add() - add a run of characters to a running checksum hash
+ *
+ *	Lets a string be checksummed as it is written - start h at 0, add each run as
+ *	it is put out, and the checksum is the final h % HASHMASK.
+ */
+uint32_t compute_checksum_add(uint32_t h, char_t const *string, const uint16_t length)
+{
+	for (uint16_t i=0; i<length; i++) {
 		h = 31 * h + string[i];
-    }
-    return (h % HASHMASK);
+	}
+	return (h);
+}
+
+/*
+ * compute_fletcher16() - Fletcher-16 checksum for binary frames
+ *
+ *	Returns sum2 in the high byte and sum1 in the low byte.
+ */
+uint16_t compute_fletcher16(const uint8_t *data, const uint16_t length)
+{
+	uint16_t sum1 = 0, sum2 = 0;
+	for (uint16_t i=0; i<length; i++) {
+		sum1 = (sum1 + data[i]) % 255;
+		sum2 = (sum2 + sum1) % 255;
+	}
+	return ((sum2 << 8) | sum1);
+}
+
+/*
+ * encode_base64() - base64 encode length bytes, with padding. Returns chars written, less the NUL
+ * decode_base64() - decode a base64 string into at most size bytes
+ *
+ *	For binary data carried in JSON strings. Padding ('=') is optional when decoding.
+ *	Decoding stops at the end of the string or the first padding character.
+ */
+static const char_t base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int8_t _base64_value(char_t c)
+{
+	if ((c >= 'A') && (c <= 'Z')) { return (c - 'A');}
+	if ((c >= 'a') && (c <= 'z')) { return (c - 'a' + 26);}
+	if ((c >= '0') && (c <= '9')) { return (c - '0' + 52);}
+	if (c == '+') { return (62);}
+	if (c == '/') { return (63);}
+	return (-1);
+}
+
+uint16_t encode_base64(char_t *dst, const uint8_t *src, const uint16_t length)
+{
+	char_t *p = dst;
+	for (uint16_t i=0; i<length; i+=3) {
+		uint32_t bits = (uint32_t)src[i] << 16;
+		if (i+1 < length) { bits |= (uint32_t)src[i+1] << 8;}
+		if (i+2 < length) { bits |= src[i+2];}
+		*p++ = base64_chars[(bits >> 18) & 0x3F];
+		*p++ = base64_chars[(bits >> 12) & 0x3F];
+		*p++ = (i+1 < length) ? base64_chars[(bits >> 6) & 0x3F] : '=';
+		*p++ = (i+2 < length) ? base64_chars[bits & 0x3F] : '=';
+	}
+	*p = '\0';
+	return (p - dst);
+}
+
+stat_t decode_base64(const char_t *src, uint8_t *dst, const uint16_t size, uint16_t *length)
+{
+	uint32_t bits = 0;
+	uint8_t nbits = 0;
+
+	*length = 0;
+	for (; (*src != '\0') && (*src != '='); src++) {
+		int8_t value = _base64_value(*src);
+		if (value < 0) { return (STAT_INPUT_VALUE_UNSUPPORTED);}
+		bits = (bits << 6) | value;
+		if ((nbits += 6) < 8) { continue;}
+		nbits -= 8;
+		if (*length == size) { return (STAT_INPUT_EXCEEDS_MAX_LENGTH);}
+		dst[(*length)++] = (uint8_t)(bits >> nbits);
+	}
+	return (STAT_OK);
+}
+
+/*
+ * uintoa() - unsigned integer to ASCII. Returns number of chars written, less the NUL
+ * fntoa()  - fixed precision float to ASCII. Returns number of chars written, less the NUL
+ *
+ *	These replace sprintf() for the high volume JSON and text output. They avoid the 
+ *	promotion to double and the newlib printf machinery, which are both slow on the ARM.
+ *	fntoa() rounds to the requested precision the same way "%0.Nf" does. Precision is 
+ *	limited to 6 places. Values outside the 32 bit integer range fall back to sprintf().
+ */
+static const uint32_t pow10_table[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+uint8_t uintoa(char_t *str, uint32_t n)
+{
+	char_t tmp[10];						// 4294967295 is 10 digits
+	uint8_t i = 0;
+	uint8_t len = 0;
+
+	do {
+		tmp[i++] = '0' + (n % 10);
+		n /= 10;
+	} while (n != 0);
+	while (i != 0) { str[len++] = tmp[--i];}
+	str[len] = '\0';
+	return (len);
+}
+
+uint8_t fntoa(char_t *str, float n, uint8_t precision)
+{
+	if (isnan(n)) { strcpy(str, "nan"); return (3);}
+	if (isinf(n)) { strcpy(str, "inf"); return (3);}
+	if (precision > 6) { precision = 6;}
+	if (fabs(n) >= 2147483647.0) {
+		return ((uint8_t)sprintf((char *)str, "%0.*f", precision, (double)n));
+	}
+	char_t *p = str;
+	uint8_t negative = (n < 0);
+	if (negative) { n = -n;}
+
+	uint32_t integer_part = (uint32_t)n;
+	uint32_t fraction_part = (uint32_t)(((n - integer_part) * pow10_table[precision]) + 0.5f);
+	if (fraction_part >= pow10_table[precision]) {	// rounding carried into the integer part
+		fraction_part -= pow10_table[precision];
+		integer_part++;
+	}
+	if ((negative) && ((integer_part != 0) || (fraction_part != 0))) { *p++ = '-';}
+	p += uintoa(p, integer_part);
+
+	if (precision != 0) {
+		*p++ = '.';
+		for (uint8_t i=precision; i>0; i--) {
+			p[i-1] = '0' + (fraction_part % 10);
+			fraction_part /= 10;
+		}
+		p += precision;
+		*p = '\0';
+	}
+	return (p - str);
 }
 
 /*
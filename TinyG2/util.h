@@ -86,7 +86,23 @@ float max4(float x1, float x2, float x3, float x4);
 
 uint8_t isnumber(char_t c);
 char_t *escape_string(char_t *dst, char_t *src);
+#define HASHMASK 9999			// compute_checksum() returns the hash modulo this
 uint16_t compute_checksum(char_t const *string, const uint16_t length);
+uint32_t compute_checksum_add(uint32_t h, char_t const *string, const uint16_t length);
+uint16_t compute_fletcher16(const uint8_t *data, const uint16_t length);
+uint16_t encode_base64(char_t *dst, const uint8_t *src, const uint16_t length);
+stat_t decode_base64(const char_t *src, uint8_t *dst, const uint16_t size, uint16_t *length);
+uint8_t uintoa(char_t *str, uint32_t n);
+uint8_t fntoa(char_t *str, float n, uint8_t precision);
+
+#define NUMBER_DIGITS 9			// significant digits kept by read_number() (fits a uint32_t)
+enum numberType {				// read_number() returns
+	NUMBER_NONE = 0,			// no digits - the end pointer is the start
+	NUMBER_INTEGER,				// digits only - exact up to 2^24
+	NUMBER_DECIMAL				// has a decimal point or an exponent
+};
+extern const float pow10_float[];	// 1 to 10^NUMBER_DIGITS
+uint8_t read_number(const char_t *str, char_t **end, float *value);
 
 //*** other utilities ***
 
@@ -125,16 +141,16 @@ uint32_t SysTickTimer_getValue(void);
 #endif
 
 #ifndef fp_EQ
-#define fp_EQ(a,b) (fabs(a-b) < EPSILON)	// requires math.h to be included in each file used
+#define fp_EQ(a,b) (fabsf(a-b) < EPSILON)	// requires math.h to be included in each file used
 #endif
 #ifndef fp_NE
-#define fp_NE(a,b) (fabs(a-b) > EPSILON)	// requires math.h to be included in each file used
+#define fp_NE(a,b) (fabsf(a-b) > EPSILON)	// requires math.h to be included in each file used
 #endif
 #ifndef fp_ZERO
-#define fp_ZERO(a) (fabs(a) < EPSILON)		// requires math.h to be included in each file used
+#define fp_ZERO(a) (fabsf(a) < EPSILON)		// requires math.h to be included in each file used
 #endif
 #ifndef fp_NOT_ZERO
-#define fp_NOT_ZERO(a) (fabs(a) > EPSILON)	// requires math.h to be included in each file used
+#define fp_NOT_ZERO(a) (fabsf(a) > EPSILON)	// requires math.h to be included in each file used
 #endif
 #ifndef fp_FALSE
 #define fp_FALSE(a) (a < EPSILON)			// float is interpreted as FALSE (equals zero)
@@ -146,16 +162,19 @@ uint32_t SysTickTimer_getValue(void);
 // Constants
 #define MAX_LONG (2147483647)
 #define MAX_ULONG (4294967295)
-#define MM_PER_INCH (25.4)
-#define INCH_PER_MM (1/25.4)
+#define MM_PER_INCH ((float)25.4)
+#define INCH_PER_MM ((float)(1/25.4))
 #define MICROSECONDS_PER_MINUTE ((float)60000000)
 #define uSec(a) ((float)(a * MICROSECONDS_PER_MINUTE))
 
-#define RADIAN (57.2957795)
-//		M_PI is pi as defined in math.h
+#define RADIAN ((float)57.2957795)
+//		M_PI is pi as defined in math.h - a double, use M_PI_F in float math
+//		The planner, arc, kinematics and canonical machine files are float only. Each turns
+//		on -Wdouble-promotion, so a double sneaking into their math warns at compile time.
 //		M_SQRT2 is radical2 as defined in math.h
+#define M_PI_F ((float)M_PI)
 #ifndef M_SQRT3
-#define M_SQRT3 (1.73205080756888)
+#define M_SQRT3 ((float)1.73205080756888)
 #endif
 
 #ifdef __cplusplus
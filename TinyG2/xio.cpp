@@ -27,18 +27,241 @@
  */
 //#include "Arduino.h"
 #include "tinyg2.h"
+#include "config.h"
+#include "controller.h"
+#include "canonical_machine.h"
 #include "xio.h"
+#include "latency.h"
+#include "uart.h"
+
+/*
+ * Devices
+ *
+ *	Input comes from SerialUSB, with __DUAL_USB_CDC from SerialUSB1, and with
+ *	__UART_DEVICES from the USART ports (see uart.h). Each device is read and written
+ *	in bulk through its entry in the table below - a USB packet or a PDC run at a
+ *	time, never a character at a time. A line is answered on the device it was read
+ *	from (see xio_set_tx_source()), and signals are acted on from any device.
+ */
+typedef struct xioDeviceDesc {
+	int16_t (*read)(uint8_t *buf, const uint16_t size);			// copy out what has arrived - returns characters read
+	int16_t (*write)(const uint8_t *buf, const uint16_t size);	// take what fits without waiting - returns characters taken
+	uint8_t src;												// line source - see DEV_STDIN in tinyg2.h
+} xioDevice_t;
+
+static int16_t _usb_read(uint8_t *buf, const uint16_t size) { return (SerialUSB.readAvailable(buf, size));}
+static int16_t _usb_write(const uint8_t *buf, const uint16_t size) { return (SerialUSB.writeAvailable(buf, size));}
+#ifdef __DUAL_USB_CDC
+static int16_t _usb1_read(uint8_t *buf, const uint16_t size) { return (SerialUSB1.readAvailable(buf, size));}
+static int16_t _usb1_write(const uint8_t *buf, const uint16_t size)
+{
+	if (SerialUSB1.isConnected() == false) { return (size);}	// nobody to answer - drop it rather than wait
+	return (SerialUSB1.writeAvailable(buf, size));
+}
+#endif
+#ifdef __UART_DEVICES
+static int16_t _uart1_read(uint8_t *buf, const uint16_t size) { return (uart_read(UART_1, buf, size));}
+static int16_t _uart1_write(const uint8_t *buf, const uint16_t size) { return (uart_write(UART_1, buf, size));}
+static int16_t _uart2_read(uint8_t *buf, const uint16_t size) { return (uart_read(UART_2, buf, size));}
+static int16_t _uart2_write(const uint8_t *buf, const uint16_t size) { return (uart_write(UART_2, buf, size));}
+#endif
+
+static const xioDevice_t xio_dev[XIO_DEVICES] = {
+	{ _usb_read, _usb_write, DEV_STDIN },
+#ifdef __DUAL_USB_CDC
+	{ _usb1_read, _usb1_write, DEV_USB1 },
+#endif
+#ifdef __UART_DEVICES
+	{ _uart1_read, _uart1_write, DEV_UART1 },
+	{ _uart2_read, _uart2_write, DEV_UART2 },
+#endif
+};
+
+/*
+ * Receive ring buffers
+ *
+ *	Characters are pulled from each device in bulk into its own ring buffer, so
+ *	lines from different devices never mix. read_line() consumes from these buffers,
+ *	and read_char() from the USB one. RX_BUFFER_SIZE must be a power of 2. One slot
+ *	is always kept empty to differentiate a full buffer from an empty one.
+ */
+#define RX_BUFFER_SIZE 256
+#define RX_BUFFER_MASK (RX_BUFFER_SIZE-1)
+
+enum xioRxScan {						// where the signal scanner is in the line - see _rx_scan()
+	RX_SCAN_LINE_START = 0,				// first column - a % here is a program delimiter
+	RX_SCAN_LINE,						// in the line
+	RX_SCAN_PAREN_COMMENT,				// in a (...) comment
+	RX_SCAN_SEMICOLON_COMMENT			// in a ; comment - runs to the end of the line
+};
+
+static struct xioRxBuffer {
+	uint16_t head;						// next slot to fill from the device
+	uint16_t tail;						// next character to consume
+	uint16_t lines;						// line ends (CR or LF) in the buffer
+	uint8_t scan;						// see xioRxScan - kept across reads as a line may span them
+	uint8_t buf[RX_BUFFER_SIZE];		// ring buffer storage
+} rx[XIO_DEVICES];
+
+static uint8_t rx_dev;					// device the line being read comes from - see read_line()
+static uint8_t tx_dev;					// device the primary port writes to - see xio_set_tx_source()
+
+/*
+ * USB transmit ring buffer
+ *
+ *	Output is written into this buffer and sent to the USB endpoint as fast as the 
+ *	host takes it, so printing a response or report doesn't wait on the host. 
+ *	The buffer is drained from the controller loop by xio_tx_callback(), and the 
+ *	controller stops generating output between the watermarks - see xio_tx_throttled().
+ *	TX_BUFFER_SIZE must be a power of 2. One slot is always kept empty.
+ */
+#define TX_BUFFER_SIZE 2048
+#define TX_BUFFER_MASK (TX_BUFFER_SIZE-1)
+#define TX_HI_WATER_MARK (TX_BUFFER_SIZE - OUTPUT_BUFFER_LEN - 256)	// leaves room for a full response
+#define TX_LO_WATER_MARK (TX_BUFFER_SIZE / 4)
+
+static struct xioTxBuffer {
+	uint16_t head;						// next slot to write
+	uint16_t tail;						// next character to send
+	uint8_t throttled;					// TRUE between the high and low watermarks
+	uint8_t held;						// nesting count of xio_tx_hold() - see there
+	uint8_t buf[TX_BUFFER_SIZE];		// ring buffer storage
+} tx;
+
+static uint8_t tx_port;					// see xio_set_tx_port()
+
+/*
+ * _rx_signal() - act on a signal character. Returns true if the character was a signal
+ */
+static uint8_t _rx_signal(uint8_t c)
+{
+	switch (c) {
+		case CHAR_FEEDHOLD: { cm_request_feedhold(); return (true);}
+		case CHAR_CYCLE_START: { cm_request_cycle_start(); return (true);}
+		case CHAR_QUEUE_FLUSH: { cm_request_queue_flush(); return (true);}
+	}
+	return (false);
+}
+
+/*
+ * _rx_is_signal() - TRUE if a character read from a device is a signal, not line text
+ * _rx_scan()	   - advance the scanner past a character kept in the line
+ *
+ *	Comments are text, as they are to the Gcode parser, so a ! or % in one is kept.
+ *	A % in the first column is the program delimiter, which the parser takes as an
+ *	empty block - it is only a queue flush while a feedhold is in effect or requested,
+ *	as in the usual !%~ sequence. Signals are dropped before the scanner sees them, so
+ *	a % after one that starts a line is still in the first column.
+ */
+static uint8_t _rx_is_signal(const struct xioRxBuffer *r, uint8_t c)
+{
+	if (r->scan >= RX_SCAN_PAREN_COMMENT) { return (false);}
+	if ((c == CHAR_QUEUE_FLUSH) && (r->scan == RX_SCAN_LINE_START) &&
+		(cm.hold_state == FEEDHOLD_OFF) && (cm.feedhold_requested == false)) {
+		return (false);
+	}
+	return (_rx_signal(c));
+}
+
+static void _rx_scan(struct xioRxBuffer *r, uint8_t c)
+{
+	if ((c == LF) || (c == CR)) {
+		r->scan = RX_SCAN_LINE_START;
+	} else if (r->scan == RX_SCAN_PAREN_COMMENT) {
+		if (c == ')') { r->scan = RX_SCAN_LINE;}
+	} else if (r->scan != RX_SCAN_SEMICOLON_COMMENT) {
+		r->scan = (c == '(') ? RX_SCAN_PAREN_COMMENT : (c == ';') ? RX_SCAN_SEMICOLON_COMMENT : RX_SCAN_LINE;
+	}
+}
+
+/*
+ * _rx_fill() - top up a device's ring buffer from the device. Returns characters available
+ *
+ *	Reads at most the contiguous free space between head and the end of the buffer 
+ *	(or tail), so it may take two calls to fill a wrapped buffer. That's OK - it 
+ *	will be called again on the next pass if the line is not complete.
+ *
+ *	Signal characters are acted on and dropped from the new characters as they 
+ *	are read, so they never reach read_line() - see xio_rx_callback() and
+ *	_rx_is_signal(). Line ends are counted as they are kept.
+ */
+static uint16_t _rx_fill(const uint8_t d)
+{
+	struct xioRxBuffer *r = &rx[d];
+	uint16_t free_end = (r->tail > r->head) ? (r->tail - 1) : (r->tail == 0) ? (RX_BUFFER_SIZE - 1) : RX_BUFFER_SIZE;
+	if ((free_end > r->head) && ((d != XIO_DEV_USB) || (LATENCY_SINKING() == false))) {
+		uint8_t *rd = &r->buf[r->head];
+		uint8_t *wr = rd;
+		int16_t count = xio_dev[d].read(rd, free_end - r->head);
+
+		for (uint8_t *end = rd + count; rd < end; rd++) {
+			if (_rx_is_signal(r, *rd) == true) { continue;}
+			_rx_scan(r, *rd);
+			if ((*rd == LF) || (*rd == CR)) { r->lines++;}
+			*wr++ = *rd;
+		}
+		r->head = (wr - r->buf) & RX_BUFFER_MASK;
+	}
+	return ((r->head - r->tail) & RX_BUFFER_MASK);
+}
+
+/*
+ * xio_rx_callback() - pull input into the ring buffers so signals are seen promptly
+ *
+ *	Called from the controller ahead of the planner and parser tasks, so a feedhold,
+ *	cycle start or queue flush is acted on within one pass of the main loop - even 
+ *	while a long line is arriving or the reader is waiting on the planner. The 
+ *	signals are only seen once there is room in the ring buffer to read them into,
+ *	which is the case unless the host has run ahead of its line credits.
+ *
+ *	With __DUAL_USB_CDC the second port is the control channel. It is a device like
+ *	the others, so signals sent there are never stuck behind Gcode on the first
+ *	port, and command lines sent there are read, run and answered on it.
+ */
+stat_t xio_rx_callback(void)
+{
+	LATENCY_SINK();						// takes the endpoint from _rx_fill() during a sink test
+	for (uint8_t d=0; d<XIO_DEVICES; d++) { _rx_fill(d);}
+	return (STAT_OK);
+}
 
 /*
  * read_char() - returns single char or -1 (_FDEV_ERR) is none available
  */
 int read_char (void)
 {
-	return SerialUSB.readByte();
+	struct xioRxBuffer *r = &rx[XIO_DEV_USB];
+
+	if ((r->head == r->tail) && (_rx_fill(XIO_DEV_USB) == 0)) { return (_FDEV_ERR);}
+	int c = r->buf[r->tail];
+	r->tail = (r->tail + 1) & RX_BUFFER_MASK;
+	if ((c == LF) || (c == CR)) { r->lines--;}
+	return (c);
+}
+
+/*
+ * _rx_next_line() - pick the device to read the next line from. Returns FALSE if none has one
+ *
+ *	A line is only started once all of it is in a device's buffer, or the buffer is
+ *	full with it, so lines from different devices are never interleaved in the line
+ *	buffer. The devices are taken in turn from the one after the last one read, so
+ *	a host streaming to USB does not shut out a pendant.
+ */
+static uint8_t _rx_next_line(void)
+{
+	for (uint8_t i=1; i<=XIO_DEVICES; i++) {
+		uint8_t d = (rx_dev + i) % XIO_DEVICES;
+		if ((_rx_fill(d) == RX_BUFFER_SIZE-1) || (rx[d].lines != 0)) {
+			rx_dev = d;
+			return (true);
+		}
+	}
+	return (false);
 }
 
 /* 
- *	read_line() - read a complete line from stdin
+ *	read_line() - read a complete line from the next device that has one
+ *	xio_get_rx_source() - return the source of the line being read - DEV_STDIN, DEV_UART1...
  *
  *	Accepts CR or LF as line terminator. Replaces CR or LF with NUL in the returned string.
  *
@@ -59,29 +282,229 @@ int read_char (void)
  *                    Index will equal size.
  *
  *	  STAT_FILE_SIZE_EXCEEDED returned if the starting index exceeds the size.
+ *
+ *	The scanner works on contiguous runs of the RX ring buffer, copying characters 
+ *	into the line buffer until it finds a CR or LF, the run ends, or the line is full.
  */
 
 stat_t read_line (uint8_t *buffer, uint16_t *index, size_t size)
 {
 	if (*index >= size) { return (STAT_FILE_SIZE_EXCEEDED);}
+	if ((*index == 0) && (_rx_next_line() == false)) { return (STAT_EAGAIN);}
+	struct xioRxBuffer *r = &rx[rx_dev];
 
-	for (int c; *index < size; (*index)++ ) {
-		if ((c = read_char()) != _FDEV_ERR) {
-			buffer[*index] = (uint8_t)c;
+	while (*index < size) {
+		if ((r->head == r->tail) && (_rx_fill(rx_dev) == 0)) { return (STAT_EAGAIN);}
+
+		uint16_t run = ((r->head > r->tail) ? r->head : RX_BUFFER_SIZE) - r->tail;
+		if (run > (size - *index)) { run = size - *index;}
+		uint8_t *src = &r->buf[r->tail];
+		uint8_t *dst = &buffer[*index];
+
+		for (uint16_t i=0; i<run; i++) {
+			uint8_t c = src[i];
 			if ((c == LF) || (c == CR)) {
-				buffer[*index] = NUL;
+				dst[i] = NUL;
+				*index += i;
+				r->tail = (r->tail + i + 1) & RX_BUFFER_MASK;
+				r->lines--;
 				return (STAT_OK);
 			}
-			continue;
+			dst[i] = c;
 		}
-		return (STAT_EAGAIN);
-	}	
+		*index += run;
+		r->tail = (r->tail + run) & RX_BUFFER_MASK;
+	}
 	return (STAT_BUFFER_FULL);
 }
 
+uint8_t xio_get_rx_source(void) { return (xio_dev[rx_dev].src);}
+
+/*
+ * _tx_drain() - send as much of the TX buffer as the USB endpoint will take without waiting
+ */
+static void _tx_drain(void)
+{
+	while (tx.head != tx.tail) {
+		uint16_t run = ((tx.head > tx.tail) ? tx.head : TX_BUFFER_SIZE) - tx.tail;
+		int16_t sent = _usb_write(&tx.buf[tx.tail], run);
+		if (sent == 0) { return;}		// endpoint is busy - try again on the next pass
+		tx.tail = (tx.tail + sent) & TX_BUFFER_MASK;
+	}
+}
+
+/*
+ * write() - write to the current output port - also used by _write() for stdio
+ * xio_set_tx_port() - select the output port
+ * xio_set_tx_source() - send the primary port to the device a line was read from
+ * xio_get_tx_source() - return the source whose device the primary port writes to
+ *
+ *	Reports set XIO_PORT_TELEMETRY while they print and set XIO_PORT_PRIMARY after.
+ *	With __DUAL_USB_CDC telemetry goes to SerialUSB1, but only while a host has 
+ *	that port open, and falls back to SerialUSB otherwise. Without it telemetry
+ *	goes to SerialUSB. Telemetry port writes to SerialUSB1 are not buffered - what
+ *	the endpoint does not take is dropped, and the next report replaces it.
+ *
+ *	The primary port writes to the device set by the controller for the line or
+ *	block it is answering - see _respond_to() in controller.cpp. Sources that are
+ *	not a device (the program store, macro bodies) write to SerialUSB.
+ */
+void xio_set_tx_port(uint8_t port) { tx_port = port;}
+
+void xio_set_tx_source(uint8_t src)
+{
+	tx_dev = XIO_DEV_USB;
+	for (uint8_t d=0; d<XIO_DEVICES; d++) {
+		if (xio_dev[d].src == src) { tx_dev = d;}
+	}
+}
+
+uint8_t xio_get_tx_source(void) { return (xio_dev[tx_dev].src);}
+
 size_t write(uint8_t *buffer, size_t size)
 {
-//	SerialUSB.write(buffer, sizeof(buffer));
-	SerialUSB.write(buffer, size);
+#ifdef __DUAL_USB_CDC
+	if ((tx_port == XIO_PORT_TELEMETRY) && (SerialUSB1.isConnected() == true)) {
+		return (SerialUSB1.writeAvailable(buffer, size));
+	}
+#endif
+	return (xio_write((tx_port == XIO_PORT_TELEMETRY) ? XIO_DEV_USB : tx_dev, buffer, size));
+}
+
+/*
+ * xio_write() - write to a device, waiting for room if there is not enough
+ *
+ *	SerialUSB output is copied into the TX buffer and sending is started. All of
+ *	the output is always taken - nothing is dropped. The write only waits on the
+ *	host if the output is larger than the free space, which only happens for
+ *	bursts like help screens, long errors or JSON listings. The controller stops
+ *	at the high watermark well before a normal response could fill the buffer,
+ *	and text mode listings stop there and carry on once it drains (see get_grp()).
+ *	Other devices buffer their own output (see uart_write()) and are written
+ *	until they have taken it all. The motion tasks run while a write waits - see
+ *	controller_yield().
+ */
+size_t xio_write(const uint8_t d, const uint8_t *buffer, size_t size)
+{
+	const uint8_t *src = buffer;
+	size_t count = size;
+
+	if (d != XIO_DEV_USB) {
+		while (count > 0) {
+			int16_t taken = xio_dev[d].write(src, count);
+			if (taken == 0) {
+				controller_yield();		// keep the motion tasks running while the device catches up
+				continue;
+			}
+			src += taken;
+			count -= taken;
+		}
+		return (size);
+	}
+
+	while (count > 0) {
+		uint16_t free_end = (tx.tail > tx.head) ? (tx.tail - 1) : (tx.tail == 0) ? (TX_BUFFER_SIZE - 1) : TX_BUFFER_SIZE;
+		if (free_end == tx.head) {		// buffer is full - wait for the host to take some
+			_tx_drain();
+			controller_yield();			// keep the motion tasks running while the host catches up
+			continue;
+		}
+		uint16_t run = free_end - tx.head;
+		if (run > count) { run = count;}
+		memcpy(&tx.buf[tx.head], src, run);
+		tx.head = (tx.head + run) & TX_BUFFER_MASK;
+		src += run;
+		count -= run;
+	}
+	if (tx.held == 0) { _tx_drain();}
 	return (size);
-}
\ No newline at end of file
+}
+
+/*
+ * xio_tx_hold()	- hold the primary port output in the TX buffer
+ * xio_tx_release() - send it
+ *
+ *	Text mode prints a response a field at a time, each a write() of a few bytes.
+ *	Holding the output over the response sends it to the USB endpoint in full-size
+ *	transfers once it is all written, instead of a short transfer per field. A
+ *	response larger than the free space is still sent as the buffer fills. Holds
+ *	nest - the output is sent on the last release.
+ */
+void xio_tx_hold(void) { tx.held++;}
+
+void xio_tx_release(void)
+{
+	if ((tx.held != 0) && (--tx.held == 0)) { _tx_drain();}
+}
+
+/*
+ * xio_tx_callback() - keep the TX buffer draining to the USB endpoint
+ * xio_get_tx_bufcount() - return the number of characters waiting to be sent
+ * xio_get_rx_bufcount() - return the number of characters received from all devices but not yet taken by read_line()
+ * xio_tx_throttled() - return TRUE if output should be held back
+ *
+ *	Throttling starts when the buffer reaches the high watermark and stops once it
+ *	drains to the low watermark. The controller holds back commands and reports 
+ *	while throttled so output never has to wait on the host.
+ */
+stat_t xio_tx_callback(void)
+{
+	if (tx.head == tx.tail) { return (LATENCY_SOURCE());}	// a throughput test sends once output is out
+	_tx_drain();
+	return (STAT_OK);
+}
+
+uint16_t xio_get_tx_bufcount(void) { return ((tx.head - tx.tail) & TX_BUFFER_MASK);}
+uint32_t xio_get_buffer_size(void)		// see memory.h
+{
+#ifdef __UART_DEVICES
+	return (sizeof(rx) + sizeof(tx) + sizeof(uart));
+#else
+	return (sizeof(rx) + sizeof(tx));
+#endif
+}
+
+uint16_t xio_get_rx_bufcount(void)
+{
+	uint16_t count = 0;
+	for (uint8_t d=0; d<XIO_DEVICES; d++) {
+		count += (rx[d].head - rx[d].tail) & RX_BUFFER_MASK;
+	}
+#ifdef __UART_DEVICES
+	for (uint8_t i=0; i<UART_PORTS; i++) {
+		count += uart_get_rx_count(i);	// not yet read from the PDC ring
+	}
+#endif
+	return (count);
+}
+
+/*
+ * xio_rx_inject() - put a string in the RX buffer as if it came from USB. Returns characters written
+ *
+ *	Nothing is written unless all of it fits. Signal characters are not acted on. Used
+ *	by the stress test to load the input path (see stress.h).
+ */
+uint16_t xio_rx_inject(const char_t *str)
+{
+	struct xioRxBuffer *r = &rx[XIO_DEV_USB];
+	uint16_t len = strlen((const char *)str);
+	if (len > (RX_BUFFER_SIZE - 1 - ((r->head - r->tail) & RX_BUFFER_MASK))) { return (0);}
+	for (uint16_t i=0; i<len; i++) {
+		if ((str[i] == LF) || (str[i] == CR)) { r->lines++;}
+		r->buf[r->head] = str[i];
+		r->head = (r->head + 1) & RX_BUFFER_MASK;
+	}
+	return (len);
+}
+
+uint8_t xio_tx_throttled(void)
+{
+	uint16_t count = xio_get_tx_bufcount();
+
+	if (count >= TX_HI_WATER_MARK) {
+		tx.throttled = true;
+	} else if (count <= TX_LO_WATER_MARK) {
+		tx.throttled = false;
+	}
+	return (tx.throttled);
+}
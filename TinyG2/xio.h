@@ -31,13 +31,43 @@
 #include "tinyg2.h"
 #include "MotateUSB.h"
 #include "MotateUSBCDC.h"
+#include "MotateUSBVendor.h"
 
 //#include "Arduino.h"
 
-//extern Motate::USBDevice< Motate::USBCDC, Motate::USBCDC > usb;
+#if defined(__DUAL_USB_CDC) && defined(__BINARY_STREAM)
+#error "__DUAL_USB_CDC and __BINARY_STREAM do not both fit in the USB endpoint memory"
+#endif
+
+#if defined(__DUAL_USB_CDC)
+extern Motate::USBDevice< Motate::USBCDC, Motate::USBCDC > usb;
+extern typeof usb._mixin_0_type::Serial &SerialUSB;
+extern typeof usb._mixin_1_type::Serial &SerialUSB1;
+#elif defined(__BINARY_STREAM)
+extern Motate::USBDevice< Motate::USBCDC, Motate::USBVendor > usb;
+extern typeof usb._mixin_0_type::Serial &SerialUSB;
+extern typeof usb._mixin_1_type::Vendor &VendorUSB;
+#else
 extern Motate::USBDevice< Motate::USBCDC > usb;
 extern typeof usb._mixin_0_type::Serial &SerialUSB;
-//extern typeof usb._mixin_1_type::Serial &SerialUSB1;
+#endif
+
+enum xioPort {						// output ports for xio_set_tx_port()
+	XIO_PORT_PRIMARY = 0,			// command responses - SerialUSB
+	XIO_PORT_TELEMETRY				// status and queue reports - SerialUSB1 if __DUAL_USB_CDC
+};
+
+enum xioDevice {					// input devices - each has its own RX buffer (see xio.cpp)
+	XIO_DEV_USB = 0,				// SerialUSB - source DEV_STDIN
+#ifdef __DUAL_USB_CDC
+	XIO_DEV_USB1,					// SerialUSB1 - source DEV_USB1
+#endif
+#ifdef __UART_DEVICES
+	XIO_DEV_UART1,					// USART port 1 - source DEV_UART1 (see uart.h)
+	XIO_DEV_UART2,					// USART port 2 - source DEV_UART2
+#endif
+	XIO_DEVICES						// must be last
+};
 
 #define _FDEV_ERR -1
 #define _FDEV_EOF -2
@@ -45,6 +75,26 @@ extern typeof usb._mixin_0_type::Serial &SerialUSB;
 int read_char (void);
 stat_t read_line (uint8_t *buffer, uint16_t *index, size_t size);
 size_t write(uint8_t *buffer, size_t size);
+size_t xio_write(const uint8_t d, const uint8_t *buffer, size_t size);
+uint8_t xio_get_rx_source(void);
+void xio_set_tx_port(uint8_t port);
+void xio_set_tx_source(uint8_t src);
+uint8_t xio_get_tx_source(void);
+void xio_tx_hold(void);
+void xio_tx_release(void);
+stat_t xio_rx_callback(void);
+stat_t xio_tx_callback(void);
+uint16_t xio_get_tx_bufcount(void);
+uint16_t xio_get_rx_bufcount(void);
+uint16_t xio_rx_inject(const char_t *str);
+uint32_t xio_get_buffer_size(void);
+uint8_t xio_tx_throttled(void);
+
+/* Signal characters - acted on as they are received and removed from the input */
+
+#define CHAR_FEEDHOLD (char)'!'
+#define CHAR_CYCLE_START (char)'~'
+#define CHAR_QUEUE_FLUSH (char)'%'
 
 /* Some useful ASCII definitions */
 